@@ -857,6 +857,20 @@ SoundFileRef AudioEngine::getOrLoadSoundFile(const std::string& sound_file_path)
 }
 
 
+bool AudioEngine::removeSoundFileIfUnused(const std::string& sound_file_path)
+{
+	auto res = sound_files.find(sound_file_path);
+	if(res == sound_files.end())
+		return true;
+
+	if(isSoundFileInUse(*res->second))
+		return false;
+
+	sound_files.erase(res);
+	return true;
+}
+
+
 void AudioEngine::playOneShotSound(const std::string& sound_file_path, const Vec4f& pos)
 {
 	if(!initialised)
@@ -49,6 +49,8 @@ struct SoundFile : public ThreadSafeRefCounted
 	float maxVal() const;
 	float minVal() const;
 
+	size_t getMemUsage() const { return sizeof(SoundFile) + buf->buffer.size() * sizeof(float); }
+
 	AudioBufferVRef buf;
 	uint32 num_channels;
 	uint32 sample_rate; // in hz
@@ -192,6 +194,12 @@ public:
 
 	SoundFileRef getOrLoadSoundFile(const std::string& sound_file_path);
 
+	// A cached sound file is in use if anything apart from sound_files references it or its buffer, e.g. a playing one-shot source.
+	static bool isSoundFileInUse(const SoundFile& sound) { return (sound.getRefCount() > 1) || (sound.buf->getRefCount() > 1); }
+
+	// Removes the sound file from sound_files if it is not in use.  Returns true if it was removed.
+	bool removeSoundFileIfUnused(const std::string& sound_file_path);
+
 	static void test();
 private:
 	SoundFileRef loadSoundFile(const std::string& sound_file_path);
@@ -3,11 +3,25 @@ BackupBot.h
 -----------
 Copyright Glare Technologies Limited 2021 -
 
-Backs up resources from the substrata server.
+Backs up the database records and resources from the substrata server.
+
+Each run makes a new snapshot in the backup dir: it asks the server for the records and resources
+changed since the previous snapshot, stores them as content-addressed chunks, and writes a manifest
+listing the changes.  See BackupStore.
+
+Usage:
+backup_bot
+	Makes a new snapshot.
+backup_bot --restore <manifest name> <database output path> [<resources output dir>]
+	Rebuilds a database (and optionally the resource dir) from the chain of manifests ending
+	at the given manifest.  Use 'latest' for the latest manifest.
+
+Reads backup_bot_password, backup_dir and optionally server_hostname from backup_bot_config.xml in the app data dir.
 =====================================================================*/
 
 
 #include "../shared/Protocol.h"
+#include "../shared/BackupStore.h"
 #include <networking/networking.h>
 #include <networking/TLSSocket.h>
 #include <networking/url.h>
@@ -23,198 +37,263 @@ Backs up resources from the substrata server.
 #include <GlareProcess.h>
 #include <CryptoRNG.h>
 #include <Exception.h>
-#include <networking/HTTPClient.h>
+#include <IndigoXMLDoc.h>
+#include <XMLParseUtils.h>
+#include <mathstypes.h>
 #include <tls.h>
 
 
-int main(int argc, char* argv[])
+struct BackupBotConfig
 {
-	Clock::init();
-	Networking::createInstance();
-	PlatformUtils::ignoreUnixSignals();
-	OpenSSL::init();
-	TLSSocket::initTLS();
-
+	std::string backup_bot_password;
+	std::string backup_dir;
+	std::string server_hostname;
+};
 
 
-	try
-	{
+static BackupBotConfig parseBackupBotConfig(const std::string& config_path)
+{
+	IndigoXMLDoc doc(config_path);
+	pugi::xml_node root_elem = doc.getRootElement();
+
+	BackupBotConfig config;
+	config.backup_bot_password = XMLParseUtils::parseString(root_elem, "backup_bot_password");
+	config.backup_dir = XMLParseUtils::parseString(root_elem, "backup_dir");
+	config.server_hostname = XMLParseUtils::parseStringWithDefault(root_elem, "server_hostname", "substrata.info");
+	return config;
+}
 
-		// Create and init TLS client config
-		struct tls_config* client_tls_config = tls_config_new();
-		if(!client_tls_config)
-			throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
-		tls_config_insecure_noverifycert(client_tls_config); // TODO: Fix this, check cert etc..
-		tls_config_insecure_noverifyname(client_tls_config);
 
-		//const std::string server_hostname = "localhost";
-		const std::string server_hostname = "substrata.info";
-		const int server_port = 7600;
-		
-		HTTPClient http_client;
+static const int SERVER_PORT = 7600;
+static const uint64 MAX_BATCH_BYTES = 16 * 1024 * 1024;
 
-		std::string response_data;
-		HTTPClient::ResponseInfo response_info = http_client.downloadFile(server_hostname + "/list_resources", response_data);
-		if(response_info.response_code != 200)
-			throw glare::Exception("response_info.response_code was not 200.");
 
-		//conPrint("Got resource list: " + response_data);
-		FileUtils::writeEntireFileTextMode("resource_urls.txt", response_data);
+// Connects to the server, and does the hello and protocol version exchange.
+static SocketInterfaceRef connectToServer(const std::string& server_hostname, struct tls_config* client_tls_config, uint32 connection_type)
+{
+	MySocketRef plain_socket = new MySocket(server_hostname, SERVER_PORT);
+	plain_socket->setUseNetworkByteOrder(false);
 
-		const std::vector<std::string> URL_and_filenames_on_server = StringUtils::splitIntoLines(response_data);
-		if(URL_and_filenames_on_server.size() % 2 != 0)
-			throw glare::Exception("Expected even number of entries in URL_and_filenames.");
+	SocketInterfaceRef socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
 
+	conPrint("Connected to " + server_hostname + ":" + toString(SERVER_PORT) + "!");
 
+	socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
+	socket->writeUInt32(connection_type); // Write connection type
 
-		MySocketRef plain_socket = new MySocket(server_hostname, server_port);
-		plain_socket->setUseNetworkByteOrder(false);
+	// Read hello response from server
+	const uint32 hello_response = socket->readUInt32();
+	if(hello_response != Protocol::CyberspaceHello)
+		throw glare::Exception("Invalid hello from server: " + toString(hello_response));
 
-		TLSSocketRef socket = new TLSSocket(plain_socket, client_tls_config, server_hostname);
+	const int MAX_STRING_LEN = 10000;
 
-		conPrint("DownloadResourcesThread: Connected to " + server_hostname + ":" + toString(server_port) + "!");
+	// Read protocol version response from server
+	const uint32 protocol_response = socket->readUInt32();
+	if(protocol_response == Protocol::ClientProtocolTooOld)
+	{
+		const std::string msg = socket->readStringLengthFirst(MAX_STRING_LEN);
+		throw glare::Exception(msg);
+	}
+	else if(protocol_response == Protocol::ClientProtocolOK)
+	{}
+	else
+		throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
-		socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
-		socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
-		socket->writeUInt32(Protocol::ConnectionTypeDownloadResources); // Write connection type
+	const uint32 server_protocol_version = socket->readUInt32();
+	if(connection_type == Protocol::ConnectionTypeBackupBot && server_protocol_version < 44)
+		throw glare::Exception("Server is too old for incremental backups (protocol version " + toString(server_protocol_version) + ")");
 
-		// Read hello response from server
-		const uint32 hello_response = socket->readUInt32();
-		if(hello_response != Protocol::CyberspaceHello)
-			throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+	return socket;
+}
 
-		const int MAX_STRING_LEN = 10000;
 
-		// Read protocol version response from server
-		const uint32 protocol_response = socket->readUInt32();
-		if(protocol_response == Protocol::ClientProtocolTooOld)
-		{
-			const std::string msg = socket->readStringLengthFirst(MAX_STRING_LEN);
-			throw glare::Exception(msg);
-		}
-		else if(protocol_response == Protocol::ClientProtocolOK)
-		{}
-		else
-			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+// Downloads the resources with the given URLs, and stores them as chunks.
+// Updates the content hashes in the manifest to the hashes of the data actually received, or 0 if a resource couldn't be downloaded.
+// Resources with content hash 0 are carried over to the next snapshot and downloaded again, see BackupManifest::addResourcesToRetry().
+static void downloadResources(SocketInterfaceRef socket, BackupStore& store, const std::vector<std::string>& URLs, BackupManifest& manifest)
+{
+	for(size_t start_i = 0; start_i < URLs.size(); start_i += 200)
+	{
+		const size_t end_i = myMin(URLs.size(), start_i + 200);
+		conPrint("Downloading resources " + toString(start_i) + " / " + toString(URLs.size()));
 
+		socket->writeUInt32(Protocol::GetFiles);
+		socket->writeUInt64(end_i - start_i); // Write number of files to get
+		for(size_t i=start_i; i<end_i; ++i)
+			socket->writeStringLengthFirst(URLs[i]);
 
-		size_t start_i = 0;
-		while(start_i <= URL_and_filenames_on_server.size())
+		// Read reply, which has an error code for each resource download.
+		for(size_t i=start_i; i<end_i; ++i)
 		{
-			conPrint(toString(start_i) + " / " + toString(URL_and_filenames_on_server.size()));
-			std::vector<std::string> URL_and_filenames_to_get;
-			for(; start_i<URL_and_filenames_on_server.size(); start_i += 2)
+			BackupResource& resource = manifest.resources[URLs[i]];
+
+			const uint32 result = socket->readUInt32();
+			if(result == Protocol::GetFileResultOK)
 			{
-				const std::string URL      = URL_and_filenames_on_server[start_i];
-				const std::string filename = URL_and_filenames_on_server[start_i + 1];
+				const uint64 file_len = socket->readUInt64();
 
-				if(URL_and_filenames_to_get.size() > 200)
-					break;
+				// TODO: cap length in a better way
+				if(file_len > 1000000000)
+					throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
 
-				if(FileUtils::isPathSafe(filename))
-				{
-					const std::string local_path = "d:/substrata_stuff/resources_backup/" + filename;
+				std::vector<uint8> buffer(file_len);
+				if(file_len > 0)
+					socket->readData(buffer.data(), file_len); // Just read entire file.
 
-					if(!FileUtils::fileExists(local_path))
-					{
-						URL_and_filenames_to_get.push_back(URL);
-						URL_and_filenames_to_get.push_back(filename);
-					}
-				}
+				const uint64 hash = store.writeChunk(buffer.data(), buffer.size());
+				if(resource.content_hash != 0 && hash != resource.content_hash)
+					conPrint("Warning: content hash of downloaded resource '" + URLs[i] + "' did not match hash from server.");
+				resource.content_hash = hash;
+				resource.file_size = file_len;
+			}
+			else
+			{
+				conPrint("Server couldn't send file '" + URLs[i] + "' (Result=" + toString(result) + ")");
+				resource.content_hash = 0;
 			}
+		}
+	}
+}
 
-			if(URL_and_filenames_to_get.empty())
-				break;
 
+static void makeBackup(const BackupBotConfig& config, struct tls_config* client_tls_config)
+{
+	Timer timer;
+	BackupStore store(config.backup_dir);
+
+	BackupManifest manifest;
+	BackupManifest prev;
+	uint64 epoch = 0;
+	uint64 seq = 0;
+	const std::string latest = store.getLatestManifestName();
+	if(!latest.empty())
+	{
+		store.readManifest(latest, prev);
+		epoch = prev.epoch;
+		seq = prev.last_seq;
+		manifest.parent_name = latest;
+	}
+
+	// Get changed records and resources
+	size_t num_bytes = 0;
+	{
+		SocketInterfaceRef socket = connectToServer(config.server_hostname, client_tls_config, Protocol::ConnectionTypeBackupBot);
+		socket->writeStringLengthFirst(config.backup_bot_password); // Write password
+
+		for(int i=0; ; ++i)
+		{
+			socket->writeUInt32(Protocol::GetBackupChanges);
+			socket->writeUInt64(epoch);
+			socket->writeUInt64(seq);
+			socket->writeUInt64(MAX_BATCH_BYTES);
 
+			const uint32 msg_type = socket->readUInt32();
+			if(msg_type != Protocol::BackupChanges)
+				throw glare::Exception("Unexpected message type from server: " + toString(msg_type));
 
-			socket->writeUInt32(Protocol::GetFiles);
-			socket->writeUInt64(URL_and_filenames_to_get.size() / 2); // Write number of files to get
+			DatabaseChangeBatch batch;
+			readFromStream(*socket, batch);
 
-			for(size_t i=0; i<URL_and_filenames_to_get.size(); i += 2)
+			if(batch.is_full)
 			{
-				const std::string URL      = URL_and_filenames_to_get[i];
-				socket->writeStringLengthFirst(URL);
+				if(i != 0)
+					throw glare::Exception("Server epoch changed during backup.");
+
+				conPrint("Server change epoch differs from last snapshot, making a full snapshot.");
+				manifest.is_full = true;
+				manifest.parent_name.clear();
 			}
 
-			// Read reply, which has an error code for each resource download.
-			for(size_t i=0; i<URL_and_filenames_to_get.size(); i += 2)
+			for(size_t z=0; z<batch.changes.size(); ++z)
 			{
-				const std::string URL      = URL_and_filenames_to_get[i];
-				const std::string filename = URL_and_filenames_to_get[i + 1];
-
-				const uint32 result = socket->readUInt32();
-				if(result == 0) // If OK:
-				{
-					// Download resource
-					const uint64 file_len = socket->readUInt64();
-					if(file_len > 0)
-					{
-						// TODO: cap length in a better way
-						if(file_len > 1000000000)
-							throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
-
-						std::vector<uint8> buffer(file_len);
-						socket->readData(buffer.data(), file_len); // Just read entire file.
-					
-						const std::string local_path = "d:/substrata_stuff/resources_backup/" + filename;
-
-						// Write downloaded file to disk, clear in-mem buffer.
-						try
-						{
-							FileUtils::writeEntireFile(local_path, buffer);
-
-
-							conPrint("Wrote downloaded file to '" + local_path + "'. (len=" + toString(file_len) + ") ");
-						}
-						catch(glare::Exception& e)
-						{
-							conPrint("Error while writing file to '" + local_path + "': " + e.what());
-						}
-					}
-				}
-				else
+				const DatabaseChange& change = batch.changes[z];
+				uint64 chunk_hash = 0;
+				if(change.type == DatabaseChange::Type_RecordUpdated)
 				{
-					conPrint("DownloadResourcesThread: Server couldn't send file '" + URL + "' (Result=" + toString(result) + ")");
+					chunk_hash = store.writeChunk(change.data.data(), change.data.size());
+					num_bytes += change.data.size();
 				}
+				manifest.applyChange(change, chunk_hash);
 			}
+
+			epoch = batch.epoch;
+			seq = batch.last_seq;
+			if(!batch.more)
+				break;
 		}
 
+		socket->writeUInt32(Protocol::CyberspaceGoodbye);
+	}
+
+	conPrint("Got " + toString(manifest.records.size()) + " changed record(s) (" + toString(num_bytes) + " B), " + toString(manifest.deleted_keys.size()) + " deleted record(s), " +
+		toString(manifest.resources.size()) + " new resource(s).");
+
+	// Retry resources that couldn't be downloaded for the last snapshot.  A full snapshot gets every resource from the server anyway.
+	if(!manifest.is_full)
+	{
+		const size_t num_retries = manifest.addResourcesToRetry(prev);
+		if(num_retries > 0)
+			conPrint("Retrying " + toString(num_retries) + " resource(s) that couldn't be downloaded for the last snapshot.");
+	}
+
+	// Download resources we don't already have a chunk for.  Resource files for different URLs often have the same content, so check the hash.
+	std::vector<std::string> URLs_to_get;
+	for(auto it = manifest.resources.begin(); it != manifest.resources.end(); ++it)
+		if(it->second.content_hash == 0 || !store.hasChunk(it->second.content_hash))
+			URLs_to_get.push_back(it->first);
+
+	if(!URLs_to_get.empty())
+	{
+		SocketInterfaceRef socket = connectToServer(config.server_hostname, client_tls_config, Protocol::ConnectionTypeDownloadResources);
+		downloadResources(socket, store, URLs_to_get, manifest);
+	}
+
+	manifest.epoch = epoch;
+	manifest.last_seq = seq;
+	manifest.time = (uint64)Clock::getSecsSince1970();
+	const std::string name = store.writeManifest(manifest);
+
+	conPrint("Wrote " + std::string(manifest.is_full ? "full" : "incremental") + " manifest '" + name + "', downloaded " + toString(URLs_to_get.size()) + " resource(s), took " +
+		timer.elapsedStringNSigFigs(4));
+}
+
+
+int main(int argc, char* argv[])
+{
+	Clock::init();
+	Networking::createInstance();
+	PlatformUtils::ignoreUnixSignals();
+	OpenSSL::init();
+	TLSSocket::initTLS();
+
+	try
+	{
+		const BackupBotConfig config = parseBackupBotConfig(PlatformUtils::getAppDataDirectory("Cyberspace") + "/backup_bot_config.xml");
+
+		if(argc >= 2 && std::string(argv[1]) == "--restore")
+		{
+			if(argc < 4)
+				throw glare::Exception("Usage: backup_bot --restore <manifest name> <database output path> [<resources output dir>]");
 
+			BackupStore store(config.backup_dir);
+			const std::string manifest_name = (std::string(argv[2]) == "latest") ? store.getLatestManifestName() : std::string(argv[2]);
+			if(manifest_name.empty())
+				throw glare::Exception("No manifests in backup dir '" + config.backup_dir + "'.");
 
+			store.restore(manifest_name, /*db_path=*/argv[3], /*resources_dir=*/(argc >= 5) ? argv[4] : "");
+			return 0;
+		}
+
+		// Create and init TLS client config
+		struct tls_config* client_tls_config = tls_config_new();
+		if(!client_tls_config)
+			throw glare::Exception("Failed to initialise TLS (tls_config_new failed)");
+		tls_config_insecure_noverifycert(client_tls_config); // TODO: Fix this, check cert etc..
+		tls_config_insecure_noverifyname(client_tls_config);
 
-		//	try
-		//	{
-		//		const std::string URL      = URL_and_filenames[i];
-		//		const std::string filename = URL_and_filenames[i + 1];
-
-		//		if(!FileUtils::isPathSafe(filename))
-		//			throw glare::Exception("Filename '" + filename + "' is not safe.");
-
-		//		const std::string local_path = "d:/substrata_stuff/resources_backup/" + filename;
-
-		//		if(!FileUtils::fileExists(local_path))
-		//		{
-		//			conPrint(toString(i) + "/" + toString(URL_and_filenames.size() / 2) + ": Downloading " +  URL + "...");
-
-		//			HTTPClient http_client2;
-		//			response_info = http_client2.downloadFile(server_hostname + "/resource/" + URL, response_data);
-		//			if(response_info.response_code == 200)
-		//			{
-		//				FileUtils::writeEntireFile(local_path, response_data);
-		//				conPrint("Saved '" + URL + "'.");
-		//			}
-		//			else
-		//			{
-		//				conPrint("Received non-200 code for URL '" + URL + "'.");
-		//			}
-		//		}
-		//	}
-		//	catch(glare::Exception& e)
-		//	{
-		//		conPrint("Error while downloading resource: " + e.what());
-		//	}
-		//}
+		makeBackup(config, client_tls_config);
 	}
 	catch(glare::Exception& e)
 	{
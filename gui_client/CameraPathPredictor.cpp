@@ -0,0 +1,159 @@
+/*=====================================================================
+CameraPathPredictor.cpp
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "CameraPathPredictor.h"
+
+
+#include <maths/mathstypes.h>
+#include <utils/ConPrint.h>
+#include <cmath>
+
+
+const float CameraPathPredictor::VELOCITY_TIME_CONSTANT = 0.5f;
+const float CameraPathPredictor::TELEPORT_SPEED = 1000.f;
+
+
+CameraPathPredictor::CameraPathPredictor()
+{
+	reset();
+}
+
+
+void CameraPathPredictor::reset()
+{
+	last_pos = Vec4f(0, 0, 0, 1);
+	last_time = 0;
+	velocity = Vec4f(0, 0, 0, 0);
+	have_sample = false;
+}
+
+
+void CameraPathPredictor::addSample(const Vec4f& pos, double time)
+{
+	if(!have_sample)
+	{
+		last_pos = pos;
+		last_time = time;
+		have_sample = true;
+		return;
+	}
+
+	const double dt = time - last_time;
+	if(dt < 1.0e-4) // Ignore samples with (nearly) the same time, we can't compute a meaningful velocity from them.
+		return;
+
+	const Vec4f sample_velocity = maskWToZero(pos - last_pos) * (float)(1 / dt);
+	if(sample_velocity.length() > TELEPORT_SPEED)
+	{
+		velocity = Vec4f(0, 0, 0, 0);
+	}
+	else
+	{
+		// Exponential moving average.  Using alpha = 1 - exp(-dt / T) makes the average independent of the sample rate.
+		const float alpha = 1.f - std::exp((float)-dt / VELOCITY_TIME_CONSTANT);
+		velocity = velocity + (sample_velocity - velocity) * alpha;
+	}
+
+	last_pos = pos;
+	last_time = time;
+}
+
+
+Vec4f CameraPathPredictor::predictPos(float lookahead_time, float max_dist) const
+{
+	const Vec4f offset = velocity * lookahead_time;
+	const float offset_len = offset.length();
+	if(offset_len > max_dist)
+		return last_pos + offset * (max_dist / offset_len);
+	else
+		return last_pos + offset;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+void CameraPathPredictor::test()
+{
+	conPrint("CameraPathPredictor::test()");
+
+	//-------------------- Test with no samples, and a stationary camera --------------------
+	{
+		CameraPathPredictor predictor;
+		testAssert(predictor.predictPos(5.f, 100.f) == Vec4f(0, 0, 0, 1));
+
+		for(int i=0; i<100; ++i)
+			predictor.addSample(Vec4f(10, 20, 30, 1), i * 0.01);
+		testAssert(predictor.getVelocity() == Vec4f(0, 0, 0, 0));
+		testAssert(predictor.predictPos(5.f, 100.f) == Vec4f(10, 20, 30, 1));
+	}
+
+	//-------------------- Test constant velocity --------------------
+	{
+		CameraPathPredictor predictor;
+		const double dt = 1.0 / 60;
+		for(int i=0; i<=600; ++i) // 10 s at 50 m/s along the x axis.
+			predictor.addSample(Vec4f((float)(i * dt * 50), 0, 2, 1), i * dt);
+
+		testAssert(predictor.getVelocity().getDist(Vec4f(50, 0, 0, 0)) < 1.0e-2f);
+		testAssert(predictor.predictPos(2.f, 1000.f).getDist(Vec4f(600, 0, 2, 1)) < 0.05f);
+
+		// Test clamping to max_dist
+		testAssert(predictor.predictPos(2.f, 40.f).getDist(Vec4f(540, 0, 2, 1)) < 0.05f);
+
+		// Velocity estimate should be roughly independent of the sample rate.
+		CameraPathPredictor predictor2;
+		for(int i=0; i<=100; ++i) // 10 s at 50 m/s along the x axis, sampled at 10 Hz.
+			predictor2.addSample(Vec4f((float)(i * 0.1 * 50), 0, 2, 1), i * 0.1);
+		testAssert(predictor2.getVelocity().getDist(Vec4f(50, 0, 0, 0)) < 1.0e-2f);
+
+		// Samples with the same time should be ignored.
+		predictor2.addSample(Vec4f(1000, 0, 2, 1), 10.0);
+		testAssert(predictor2.getVelocity().getDist(Vec4f(50, 0, 0, 0)) < 1.0e-2f);
+	}
+
+	//-------------------- Test that the camera stopping decays the velocity --------------------
+	{
+		CameraPathPredictor predictor;
+		const double dt = 1.0 / 60;
+		int i = 0;
+		for(; i<=300; ++i)
+			predictor.addSample(Vec4f(0, (float)(i * dt * 20), 0, 1), i * dt);
+		const Vec4f stop_pos(0, (float)(300 * dt * 20), 0, 1);
+		for(; i<=600; ++i)
+			predictor.addSample(stop_pos, i * dt);
+
+		testAssert(predictor.getVelocity().length() < 0.01f);
+		testAssert(predictor.predictPos(5.f, 1000.f).getDist(stop_pos) < 0.1f);
+	}
+
+	//-------------------- Test teleports --------------------
+	{
+		CameraPathPredictor predictor;
+		const double dt = 1.0 / 60;
+		for(int i=0; i<=300; ++i)
+			predictor.addSample(Vec4f((float)(i * dt * 20), 0, 0, 1), i * dt);
+		testAssert(predictor.getVelocity().length() > 19.f);
+
+		// Teleport 10 km in one frame.  We shouldn't predict the camera carrying on at that speed, or even at the speed before the teleport.
+		predictor.addSample(Vec4f(10000, 0, 0, 1), 301 * dt);
+		testAssert(predictor.getVelocity() == Vec4f(0, 0, 0, 0));
+		testAssert(predictor.predictPos(5.f, 1000.f) == Vec4f(10000, 0, 0, 1));
+
+		// Reset should forget the last position.
+		predictor.reset();
+		predictor.addSample(Vec4f(0, 0, 0, 1), 400.0);
+		predictor.addSample(Vec4f(1, 0, 0, 1), 401.0);
+		testAssert(predictor.getVelocity().length() < 1.f);
+	}
+
+	conPrint("CameraPathPredictor::test() done.");
+}
+
+
+#endif // BUILD_TESTS
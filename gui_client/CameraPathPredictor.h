@@ -0,0 +1,52 @@
+/*=====================================================================
+CameraPathPredictor.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <maths/Vec4f.h>
+#include <utils/Platform.h>
+
+
+/*=====================================================================
+CameraPathPredictor
+-------------------
+Estimates the camera velocity from recent camera positions, and extrapolates
+the camera path, so that the ProximityLoader and the load and download queues
+can start loading stuff before the camera gets there (e.g. when flying or driving a vehicle).
+
+The velocity is an exponential moving average of the velocity between samples.
+Moves faster than TELEPORT_SPEED are treated as teleports, and reset the velocity to zero,
+so we don't predict the camera continuing to move at teleport speeds.
+=====================================================================*/
+class CameraPathPredictor
+{
+public:
+	CameraPathPredictor();
+
+	// Adds a camera position sample.  time is in seconds, and should be non-decreasing.
+	void addSample(const Vec4f& pos, double time);
+
+	// Forget previous samples, e.g. when connecting to a new server.
+	void reset();
+
+	// Estimated camera velocity in m/s, with w = 0.
+	const Vec4f& getVelocity() const { return velocity; }
+
+	// Predicted camera position lookahead_time seconds after the last sample, assuming the camera keeps moving at the current velocity.
+	// The distance moved is clamped to max_dist.  Returns the last sample position if there have been no samples or the camera is not moving.
+	Vec4f predictPos(float lookahead_time, float max_dist) const;
+
+	static void test();
+
+	static const float VELOCITY_TIME_CONSTANT; // Time constant (s) of the velocity moving average.
+	static const float TELEPORT_SPEED; // m/s
+
+private:
+	Vec4f last_pos;
+	double last_time;
+	Vec4f velocity;
+	bool have_sample;
+};
@@ -20,6 +20,13 @@ Copyright Glare Technologies Limited 2021 -
 #include <KillThreadMessage.h>
 #include <PlatformUtils.h>
 #include <FileOutStream.h>
+#include <Timer.h>
+#include <zstd.h>
+#include <cmath>
+#include <memory>
+
+
+static_assert(DownloadResourcesThread::MAX_NUM_OUTSTANDING_REQUESTS <= Protocol::MAX_OUTSTANDING_FILE_REQUESTS, "MAX_NUM_OUTSTANDING_REQUESTS <= Protocol::MAX_OUTSTANDING_FILE_REQUESTS");
 
 
 DownloadResourcesThread::DownloadResourcesThread(ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue_, Reference<ResourceManager> resource_manager_, const std::string& hostname_, int port_, 
@@ -30,7 +37,9 @@ DownloadResourcesThread::DownloadResourcesThread(ThreadSafeQueue<Reference<Threa
 	port(port_),
 	num_resources_downloading(num_resources_downloading_),
 	config(config_),
-	download_queue(download_queue_)
+	download_queue(download_queue_),
+	next_request_id(0),
+	server_supports_cell_low_lod_models(false)
 {
 	MySocketRef mysocket = new MySocket();
 	mysocket->setUseNetworkByteOrder(false);
@@ -42,6 +51,15 @@ DownloadResourcesThread::~DownloadResourcesThread()
 {}
 
 
+// Thrown when the thread is told to die part-way through reading a file from the socket.
+// The rest of the file data hasn't been read, so unlike errors decompressing or writing a file, this can't just be logged: the connection has to be closed.
+class DownloadInterruptedExcep : public glare::Exception
+{
+public:
+	DownloadInterruptedExcep() : glare::Exception("Interrupted") {}
+};
+
+
 // Returns true if kill message received
 static bool checkMessageQueue(ThreadSafeQueue<Reference<ThreadMessage> >& queue)
 {
@@ -112,6 +130,494 @@ void DownloadResourcesThread::killConnection()
 }
 
 
+// Reads compressed_len bytes of zstd-compressed data from the socket, decompressing it to a file at path as it is read.
+// All the compressed data is read from the socket even if decompression or writing the file fails, so we can carry on reading the next file.
+// Throws glare::Exception if decompression or writing fails, or the decompressed size isn't file_len.
+// Throws DownloadInterruptedExcep if interrupted, or MySocketExcep on socket errors, in which case the connection can't be used any more.
+void DownloadResourcesThread::readZstdCompressedFile(const std::string& path, uint64 file_len, uint64 compressed_len)
+{
+#if !EMSCRIPTEN
+	ZSTD_DCtx* dctx = ZSTD_createDCtx();
+	if(!dctx)
+		throw glare::Exception("ZSTD_createDCtx failed.");
+
+	std::string error_msg;
+	uint64 decompressed_len = 0;
+	try
+	{
+		std::unique_ptr<FileOutStream> file;
+		try
+		{
+			file.reset(new FileOutStream(path, std::ios::binary | std::ios::trunc)); // Remove any existing data in the file
+		}
+		catch(glare::Exception& e)
+		{
+			error_msg = e.what();
+		}
+
+		js::Vector<uint8, 16> compressed_buf(ZSTD_DStreamInSize());
+		js::Vector<uint8, 16> decompressed_buf(ZSTD_DStreamOutSize());
+
+		uint64 offset = 0;
+		while(offset < compressed_len)
+		{
+			const uint64 chunk_size = myMin<uint64>(compressed_len - offset, compressed_buf.size());
+			socket->readData(compressed_buf.data(), chunk_size);
+			offset += chunk_size;
+
+			if(should_die)
+				throw DownloadInterruptedExcep();
+
+			if(!error_msg.empty())
+				continue; // Just drain the socket after an error.
+
+			ZSTD_inBuffer input = { compressed_buf.data(), chunk_size, 0 };
+			while(input.pos < input.size)
+			{
+				ZSTD_outBuffer output = { decompressed_buf.data(), decompressed_buf.size(), 0 };
+				const size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+				if(ZSTD_isError(ret))
+				{
+					error_msg = std::string("Decompression failed: ") + ZSTD_getErrorName(ret);
+					break;
+				}
+
+				decompressed_len += output.pos;
+				if(decompressed_len > file_len)
+				{
+					error_msg = "Decompressed data was larger than expected.";
+					break;
+				}
+
+				try
+				{
+					file->writeData(decompressed_buf.data(), output.pos);
+				}
+				catch(glare::Exception& e)
+				{
+					error_msg = e.what();
+					break;
+				}
+			}
+		}
+
+		// All the data has been read from the socket now, so errors closing the file can just be thrown.
+		if(error_msg.empty())
+			file->close(); // Manually call close, to check for any errors via failbit.
+	}
+	catch(glare::Exception&)
+	{
+		ZSTD_freeDCtx(dctx);
+		throw;
+	}
+	ZSTD_freeDCtx(dctx);
+
+	if(!error_msg.empty())
+		throw glare::Exception(error_msg);
+	if(decompressed_len != file_len)
+		throw glare::Exception("Decompressed size (" + toString(decompressed_len) + " B) differed from expected size (" + toString(file_len) + " B).");
+#endif
+}
+
+
+// Reads the data for a resource from the socket, after the result code for it has been read, and writes it to disk.
+// Errors writing the file are logged, and the resource is left as not present.  Throws glare::Exception on socket errors or invalid replies.
+void DownloadResourcesThread::readResourceResult(const std::string& URL, uint32 result)
+{
+	ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
+
+	if(result == Protocol::GetFileResultOKZstd)
+	{
+		const uint64 file_len = socket->readUInt64();
+		const uint64 compressed_len = socket->readUInt64();
+		if(file_len > 1000000000 || compressed_len > 1000000000)
+			throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ", compressed len=" + toString(compressed_len) + ").");
+
+		resource->setState(Resource::State_Transferring);
+
+		try
+		{
+			const std::string path = resource_manager->getLocalAbsPathForResource(*resource);
+			readZstdCompressedFile(path, file_len, compressed_len);
+
+			resource->setState(Resource::State_Present);
+			resource_manager->markAsChanged(resource);
+
+			out_msg_queue->enqueue(new ResourceDownloadedMessage(URL));
+		}
+		catch(MySocketExcep&)
+		{
+			resource->setState(Resource::State_NotPresent);
+			throw;
+		}
+		catch(DownloadInterruptedExcep&)
+		{
+			resource->setState(Resource::State_NotPresent);
+			throw; // The rest of the file data is unread, so we can't read any more replies on this connection.
+		}
+		catch(glare::Exception& e)
+		{
+			resource->setState(Resource::State_NotPresent);
+			resource_manager->markAsChanged(resource);
+
+			out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while decompressing file: " + e.what()));
+		}
+	}
+	else if(result == Protocol::GetFileResultOK) // If OK:
+	{
+		// Download resource
+		const uint64 file_len = socket->readUInt64();
+		if(file_len > 0)
+		{
+			if(file_len > 1000000000)
+				throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
+
+			resource->setState(Resource::State_Transferring);
+
+			try
+			{
+				const std::string path = resource_manager->getLocalAbsPathForResource(*resource);
+				{
+					// Errors opening or writing the file are thrown after all the file data has been read from the socket, so we can carry on reading the next reply.
+					std::string error_msg;
+					std::unique_ptr<FileOutStream> file;
+					try
+					{
+						file.reset(new FileOutStream(path, std::ios::binary | std::ios::trunc)); // Remove any existing data in the file
+					}
+					catch(glare::Exception& e)
+					{
+						error_msg = e.what();
+					}
+
+					uint64 offset = 0;
+					const uint64 MAX_CHUNK_SIZE = 1ull << 14;
+					js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
+					while(offset < file_len)
+					{
+						const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
+						assert(offset + chunk_size <= file_len);
+						socket->readData(temp_buf.data(), chunk_size);
+						if(error_msg.empty())
+						{
+							try
+							{
+								file->writeData(temp_buf.data(), chunk_size);
+							}
+							catch(glare::Exception& e)
+							{
+								error_msg = e.what();
+							}
+						}
+						offset += chunk_size;
+
+						if(should_die)
+							throw DownloadInterruptedExcep();
+					}
+
+					if(!error_msg.empty())
+						throw glare::Exception(error_msg);
+
+					file->close(); // Manually call close, to check for any errors via failbit.
+				} // End scope for FileOutStream
+
+				resource->setState(Resource::State_Present);
+				resource_manager->markAsChanged(resource);
+
+				out_msg_queue->enqueue(new ResourceDownloadedMessage(URL));
+			}
+			catch(MySocketExcep&)
+			{
+				resource->setState(Resource::State_NotPresent);
+				throw;
+			}
+			catch(DownloadInterruptedExcep&)
+			{
+				resource->setState(Resource::State_NotPresent);
+				throw; // The rest of the file data is unread, so we can't read any more replies on this connection.
+			}
+			catch(glare::Exception& e)
+			{
+				resource->setState(Resource::State_NotPresent);
+				resource_manager->markAsChanged(resource);
+
+				//conPrint("DownloadResourcesThread: Error while writing file to disk: " + e.what());
+				out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
+			}
+		}
+
+		//conPrint("DownloadResourcesThread: Got file '" + URL + "'.");
+	}
+	else
+	{
+		resource_manager->addToDownloadFailedURLs(URL);
+
+		resource->setState(Resource::State_NotPresent);
+		//conPrint("DownloadResourcesThread: Server couldn't send file '" + URL + "' (Result=" + toString(result) + ")");
+		out_msg_queue->enqueue(new LogMessage("Server couldn't send resource '" + URL + "' (resource not found)"));
+	}
+}
+
+
+// Reads and discards the data for a resource from the socket, after the result code for it has been read.
+// Used for files in a cell low LOD model bundle that we already have, or are downloading with another request.
+void DownloadResourcesThread::skipResourceResult(uint32 result)
+{
+	uint64 len = 0;
+	if(result == Protocol::GetFileResultOKZstd)
+	{
+		socket->readUInt64(); // Uncompressed length
+		len = socket->readUInt64();
+	}
+	else if(result == Protocol::GetFileResultOK)
+		len = socket->readUInt64();
+
+	if(len > 1000000000)
+		throw glare::Exception("downloaded file too large (len=" + toString(len) + ").");
+
+	const uint64 MAX_CHUNK_SIZE = 1ull << 14;
+	js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
+	for(uint64 offset = 0; offset < len; )
+	{
+		const uint64 chunk_size = myMin(len - offset, MAX_CHUNK_SIZE);
+		socket->readData(temp_buf.data(), chunk_size);
+		offset += chunk_size;
+
+		if(should_die)
+			throw DownloadInterruptedExcep();
+	}
+}
+
+
+// Reads a GetFileResultBundle reply to a RequestCellLowLODModels request, after the result code has been read.
+// Files we don't have yet are written to disk as for other downloads, and a ResourceDownloadedMessage is sent for each.
+void DownloadResourcesThread::readCellLowLODModelsBundle()
+{
+	const uint32 num_files = socket->readUInt32();
+	if(num_files > Protocol::MAX_CELL_BUNDLE_FILES)
+		throw glare::Exception("Too many files in cell low LOD model bundle from server: " + toString(num_files));
+
+	for(uint32 i=0; i<num_files; ++i)
+	{
+		const std::string URL = socket->readStringLengthFirst(Protocol::MAX_RESOURCE_URL_LEN);
+		const uint32 result = socket->readUInt32();
+		if(!ResourceManager::isValidURL(URL))
+			throw glare::Exception("Invalid URL in cell low LOD model bundle from server: '" + URL + "'");
+
+		ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
+		if((resource->getState() == Resource::State_NotPresent) && (result != Protocol::GetFileResultNotFound))
+			readResourceResult(URL, result);
+		else
+			skipResourceResult(result); // We already have the file, or it is being downloaded by another request.  Missing files may still be requested individually later.
+	}
+}
+
+
+// Puts the item back in the download queue, so it will be requested again (possibly by another DownloadResourcesThread).
+void DownloadResourcesThread::requeueItem(const DownloadQueueItem& item)
+{
+	for(size_t i=0; i<item.pos_info.size(); ++i)
+		download_queue->enqueueOrUpdateItem(item.URL, Vec4f(item.pos_info[i].pos.x, item.pos_info[i].pos.y, item.pos_info[i].pos.z, 1.f), item.pos_info[i].size_factor);
+}
+
+
+void DownloadResourcesThread::sendFileRequest(const DownloadQueueItem& item)
+{
+	if(resource_manager->isInDownloadFailedURLs(item.URL)) // Don't try to re-download if we already failed to download this session.
+		return;
+
+	ResourceRef resource = resource_manager->getOrCreateResourceForURL(item.URL);
+	if(resource->getState() != Resource::State_NotPresent) // If we already have the file, or another thread is downloading it:
+		return;
+	resource->setState(Resource::State_Transferring);
+
+	const uint32 request_id = next_request_id++;
+	OutstandingRequest& request = outstanding_requests[request_id];
+	request.item = item;
+	Vec4f campos, camdir, predicted_campos;
+	download_queue->getLastCamPosAndDir(campos, camdir, predicted_campos);
+	request.priority = DownloadQueueItem::computePriority(item.pos_info, campos, camdir, predicted_campos);
+	request.cancel_sent = false;
+	request.is_cell_request = false;
+
+	(*this->num_resources_downloading)++;
+
+	socket->writeUInt32(Protocol::RequestFile);
+	socket->writeUInt32(request_id);
+	socket->writeFloat(request.priority);
+	socket->writeStringLengthFirst(item.URL);
+}
+
+
+void DownloadResourcesThread::sendCellLowLODModelsRequest(const CellLowLODModelsRequest& cell_request)
+{
+	const uint32 request_id = next_request_id++;
+	OutstandingRequest& request = outstanding_requests[request_id];
+	request.item.pos_info = cell_request.pos_info;
+	Vec4f campos, camdir, predicted_campos;
+	download_queue->getLastCamPosAndDir(campos, camdir, predicted_campos);
+	request.priority = DownloadQueueItem::computePriority(cell_request.pos_info, campos, camdir, predicted_campos);
+	request.cancel_sent = false;
+	request.is_cell_request = true;
+	request.cell_request = cell_request;
+
+	(*this->num_resources_downloading)++;
+
+	socket->writeUInt32(Protocol::RequestCellLowLODModels);
+	socket->writeUInt32(request_id);
+	socket->writeFloat(request.priority);
+	socket->writeStringLengthFirst(cell_request.world_name);
+	socket->writeInt32(cell_request.cell_coords.x);
+	socket->writeInt32(cell_request.cell_coords.y);
+	socket->writeInt32(cell_request.cell_coords.z);
+}
+
+
+// Sends updated priorities for our outstanding requests to the server, since the camera may have moved since they were sent.
+// If the request window is full, and the front of the download queue is much more important than our least important request, cancels that request
+// so the window slot can be used for the more important item.
+void DownloadResourcesThread::reprioritiseRequests()
+{
+	Vec4f campos, camdir, predicted_campos;
+	download_queue->getLastCamPosAndDir(campos, camdir, predicted_campos);
+
+	uint32 least_important_id = 0;
+	OutstandingRequest* least_important = NULL;
+	for(auto it = outstanding_requests.begin(); it != outstanding_requests.end(); ++it)
+	{
+		OutstandingRequest& request = it->second;
+		if(request.cancel_sent)
+			continue;
+
+		const float new_priority = DownloadQueueItem::computePriority(request.item.pos_info, campos, camdir, predicted_campos);
+		if(std::fabs(new_priority - request.priority) > 0.1f * request.priority) // Don't bother sending small changes.
+		{
+			socket->writeUInt32(Protocol::SetFileRequestPriority);
+			socket->writeUInt32(it->first);
+			socket->writeFloat(new_priority);
+			request.priority = new_priority;
+		}
+
+		if(!request.is_cell_request && (!least_important || (request.priority > least_important->priority)))
+		{
+			least_important_id = it->first;
+			least_important = &request;
+		}
+	}
+
+	float front_priority;
+	if(least_important && (outstanding_requests.size() >= MAX_NUM_OUTSTANDING_REQUESTS) && download_queue->getFrontItemPriority(front_priority) && 
+		(front_priority * 2 < least_important->priority))
+	{
+		socket->writeUInt32(Protocol::CancelFileRequest);
+		socket->writeUInt32(least_important_id);
+		least_important->cancel_sent = true;
+	}
+}
+
+
+void DownloadResourcesThread::readPipelinedReply()
+{
+	const uint32 request_id = socket->readUInt32();
+	const uint32 result = socket->readUInt32();
+
+	auto res = outstanding_requests.find(request_id);
+	if(res == outstanding_requests.end())
+		throw glare::Exception("Invalid request id in reply from server: " + toString(request_id));
+
+	if(res->second.is_cell_request)
+	{
+		if(result == Protocol::GetFileResultBundle)
+			readCellLowLODModelsBundle();
+		else if(result == Protocol::GetFileResultCancelled)
+			download_queue->enqueueCellLowLODModelsRequest(res->second.cell_request);
+		else
+			throw glare::Exception("Invalid result for cell low LOD model request from server: " + toString(result));
+	}
+	else if(result == Protocol::GetFileResultCancelled)
+	{
+		resource_manager->getOrCreateResourceForURL(res->second.item.URL)->setState(Resource::State_NotPresent);
+		requeueItem(res->second.item);
+	}
+	else
+		readResourceResult(res->second.item.URL, result);
+
+	outstanding_requests.erase(res);
+	(*this->num_resources_downloading)--;
+}
+
+
+// Called when the connection is closing.  Resources we were downloading are put back in the download queue.
+void DownloadResourcesThread::abandonOutstandingRequests()
+{
+	for(auto it = outstanding_requests.begin(); it != outstanding_requests.end(); ++it)
+	{
+		if(it->second.is_cell_request)
+			download_queue->enqueueCellLowLODModelsRequest(it->second.cell_request);
+		else
+		{
+			resource_manager->getOrCreateResourceForURL(it->second.item.URL)->setState(Resource::State_NotPresent);
+			requeueItem(it->second.item);
+		}
+		(*this->num_resources_downloading)--;
+	}
+	outstanding_requests.clear();
+}
+
+
+// Downloads resources using pipelined requests.  Keeps up to MAX_NUM_OUTSTANDING_REQUESTS requests in flight, so the connection doesn't sit idle
+// for a round trip after each batch of files, and the server sends the most important requested file next.
+// Returns when the thread should die.
+void DownloadResourcesThread::doPipelinedDownloads()
+{
+	try
+	{
+		Timer reprioritise_timer;
+		while(1)
+		{
+			if(should_die || checkMessageQueue(getMessageQueue()))
+			{
+				abandonOutstandingRequests();
+				socket->writeInt32(Protocol::CyberspaceGoodbye);
+				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the server.
+				return;
+			}
+
+			if(reprioritise_timer.elapsed() > 0.5)
+			{
+				reprioritiseRequests();
+				reprioritise_timer.reset();
+			}
+
+			// Send cell low LOD model requests first, as they are the quickest way to get something shown for the objects in a cell.
+			if(server_supports_cell_low_lod_models)
+			{
+				CellLowLODModelsRequest cell_request;
+				while((outstanding_requests.size() < MAX_NUM_OUTSTANDING_REQUESTS) && download_queue->tryDequeueCellLowLODModelsRequest(cell_request))
+					sendCellLowLODModelsRequest(cell_request);
+			}
+
+			// Fill up the request window from the download queue.  If we don't have any requests in flight, wait a while for something to download.
+			if(outstanding_requests.size() < MAX_NUM_OUTSTANDING_REQUESTS)
+			{
+				download_queue->dequeueItemsWithTimeOut(/*wait_time_s=*/outstanding_requests.empty() ? 0.1 : 0.0, /*max_num_items=*/MAX_NUM_OUTSTANDING_REQUESTS - outstanding_requests.size(), queue_items);
+				for(size_t i=0; i<queue_items.size(); ++i)
+					sendFileRequest(queue_items[i]);
+			}
+
+			// Read the next reply.  This blocks until the reply arrives, but while we have requests in flight the server is always sending something.
+			if(!outstanding_requests.empty())
+				readPipelinedReply();
+		}
+	}
+	catch(glare::Exception&)
+	{
+		abandonOutstandingRequests();
+		throw;
+	}
+}
+
+
 void DownloadResourcesThread::doRun()
 {
 #if !EMSCRIPTEN // Emscripten uses EmscriptenResourceDownloader instead.
@@ -152,7 +658,15 @@ void DownloadResourcesThread::doRun()
 			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
 
 		// Read server protocol version
-		/*const uint32 server_protocol_version =*/ socket->readUInt32();
+		const uint32 server_protocol_version = socket->readUInt32();
+		const bool server_supports_compressed_files = server_protocol_version >= 41; // GetFilesCompressed was added in protocol version 41.
+
+		if(server_protocol_version >= 42) // Pipelined requests were added in protocol version 42.
+		{
+			server_supports_cell_low_lod_models = server_protocol_version >= 45; // RequestCellLowLODModels was added in protocol version 45.
+			doPipelinedDownloads();
+			return;
+		}
 
 		std::set<std::string> URLs_to_get; // Set of URLs that this thread will get from the server.
 
@@ -210,7 +724,7 @@ void DownloadResourcesThread::doRun()
 
 				if(!URLs_to_get.empty())
 				{
-					socket->writeUInt32(Protocol::GetFiles);
+					socket->writeUInt32(server_supports_compressed_files ? Protocol::GetFilesCompressed : Protocol::GetFiles);
 					socket->writeUInt64(URLs_to_get.size()); // Write number of files to get
 
 					for(auto it = URLs_to_get.begin(); it != URLs_to_get.end(); ++it)
@@ -224,71 +738,8 @@ void DownloadResourcesThread::doRun()
 					// Read reply, which has an error code for each resource download.
 					for(auto it = URLs_to_get.begin(); it != URLs_to_get.end(); ++it)
 					{
-						const std::string URL = *it;
-						ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
-
-						
 						const uint32 result = socket->readUInt32();
-						if(result == 0) // If OK:
-						{
-							// Download resource
-							const uint64 file_len = socket->readUInt64();
-							if(file_len > 0)
-							{
-								if(file_len > 1000000000)
-									throw glare::Exception("downloaded file too large (len=" + toString(file_len) + ").");
-
-								resource->setState(Resource::State_Transferring);
-
-								try
-								{
-									const std::string path = resource_manager->getLocalAbsPathForResource(*resource);
-									{
-										FileOutStream file(path, std::ios::binary | std::ios::trunc); // Remove any existing data in the file
-
-										uint64 offset = 0;
-										const uint64 MAX_CHUNK_SIZE = 1ull << 14;
-										js::Vector<uint8, 16> temp_buf(MAX_CHUNK_SIZE);
-										while(offset < file_len)
-										{
-											const uint64 chunk_size = myMin(file_len - offset, MAX_CHUNK_SIZE);
-											assert(offset + chunk_size <= file_len);
-											socket->readData(temp_buf.data(), chunk_size);
-											file.writeData(temp_buf.data(), chunk_size);
-											offset += chunk_size;
-
-											if(should_die)
-												throw glare::Exception("Interrupted");
-										}
-
-										file.close(); // Manually call close, to check for any errors via failbit.
-									} // End scope for FileOutStream
-
-									resource->setState(Resource::State_Present);
-									resource_manager->markAsChanged();
-
-									out_msg_queue->enqueue(new ResourceDownloadedMessage(URL));
-								}
-								catch(glare::Exception& e)
-								{
-									resource->setState(Resource::State_NotPresent);
-									resource_manager->markAsChanged();
-
-									//conPrint("DownloadResourcesThread: Error while writing file to disk: " + e.what());
-									out_msg_queue->enqueue(new LogMessage("DownloadResourcesThread: Error while writing file to disk: " + e.what()));
-								}
-							}
-
-							//conPrint("DownloadResourcesThread: Got file '" + URL + "'.");
-						}
-						else
-						{
-							resource_manager->addToDownloadFailedURLs(URL);
-
-							resource->setState(Resource::State_NotPresent);
-							//conPrint("DownloadResourcesThread: Server couldn't send file '" + URL + "' (Result=" + toString(result) + ")");
-							out_msg_queue->enqueue(new LogMessage("Server couldn't send resource '" + URL + "' (resource not found)"));
-						}
+						readResourceResult(*it, result);
 
 						(*this->num_resources_downloading)--;
 						decrementor.num_decrements++;
@@ -17,6 +17,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <utils/ThreadManager.h>
 #include <utils/ThreadSafeQueue.h>
 #include <set>
+#include <map>
 #include <string>
 class WorkUnit;
 class PrintOutput;
@@ -41,6 +42,12 @@ DownloadResourcesThread
 Downloads any resources from the server as needed.
 This thread gets sent DownloadResourceMessage from MainWindow, when a new file is needed to be downloaded.
 It sends ResourceDownloadedMessages back to MainWindow via the out_msg_queue when files are downloaded.
+
+With servers that support it (protocol version >= 42), requests are pipelined: the thread keeps up to
+MAX_NUM_OUTSTANDING_REQUESTS requests in flight, updates their priorities as the camera moves,
+and cancels requests that have become much less important than items in the download queue.
+With servers with protocol version >= 45, it also sends cell low LOD model requests from the download queue,
+for which the server sends the coarsest LOD models of all the objects in a cell in a single reply.
 =====================================================================*/
 class DownloadResourcesThread : public MessageableThread
 {
@@ -55,7 +62,22 @@ public:
 
 	void killConnection();
 
+	static const size_t MAX_NUM_OUTSTANDING_REQUESTS = 16; // Request window size.  Must be <= Protocol::MAX_OUTSTANDING_FILE_REQUESTS, the server's limit.
+
 private:
+	void readZstdCompressedFile(const std::string& path, uint64 file_len, uint64 compressed_len);
+	void readResourceResult(const std::string& URL, uint32 result);
+	void skipResourceResult(uint32 result);
+	void readCellLowLODModelsBundle();
+
+	void doPipelinedDownloads();
+	void sendFileRequest(const DownloadQueueItem& item);
+	void sendCellLowLODModelsRequest(const CellLowLODModelsRequest& cell_request);
+	void reprioritiseRequests();
+	void readPipelinedReply();
+	void abandonOutstandingRequests();
+	void requeueItem(const DownloadQueueItem& item);
+
 	ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
 	Reference<ResourceManager> resource_manager;
 	std::string hostname;
@@ -67,6 +89,19 @@ private:
 
 	std::vector<DownloadQueueItem> queue_items; // scratch buffer
 
+	struct OutstandingRequest
+	{
+		DownloadQueueItem item; // For cell low LOD model requests, only item.pos_info is used.
+		float priority; // Priority last sent to the server.
+		bool cancel_sent;
+
+		bool is_cell_request; // True if this is a cell low LOD model request.  These aren't cancelled, as the reply is small.
+		CellLowLODModelsRequest cell_request;
+	};
+	std::map<uint32, OutstandingRequest> outstanding_requests; // Pipelined requests the server hasn't replied to yet, keyed by request id.
+	uint32 next_request_id;
+	bool server_supports_cell_low_lod_models;
+
 	glare::AtomicInt should_die;
 public:
 	SocketInterfaceRef socket;
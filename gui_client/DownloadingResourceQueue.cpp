@@ -11,17 +11,30 @@ Copyright Glare Technologies Limited 2024 -
 #include <utils/Lock.h>
 #include <utils/StringUtils.h>
 #include <algorithm>
+#include <limits>
+
+
+float DownloadQueueItem::computePriority(const SmallVector<DownloadQueuePosInfo, 4>& pos_info, const Vec4f& campos_zero_w, const Vec4f& camdir, const Vec4f& predicted_campos_zero_w)
+{
+	assert(pos_info.size() >= 1);
+	float smallest_priority = std::numeric_limits<float>::infinity();
+	for(size_t z=0; z<pos_info.size(); ++z)
+		smallest_priority = myMin(smallest_priority, computeLoadQueuePriority(loadUnalignedVec4f(&pos_info[z].pos.x), pos_info[z].size_factor, campos_zero_w, camdir, predicted_campos_zero_w));
+	return smallest_priority;
+}
 
 
 DownloadingResourceQueue::DownloadingResourceQueue()
-:	begin_i(0)
+:	last_campos(0, 0, 0, 0),
+	last_camdir(0, 0, 0, 0),
+	last_predicted_campos(0, 0, 0, 0)
 {}
 
 
 DownloadingResourceQueue::~DownloadingResourceQueue()
 {
-	for(size_t i = begin_i; i < items.size(); ++i)
-		delete items[i];
+	for(size_t i=0; i<heap.size(); ++i)
+		delete heap[i];
 }
 
 
@@ -41,9 +54,10 @@ void DownloadingResourceQueue::enqueueOrUpdateItem(/*const DownloadQueueItem& it
 			new_item->pos_info.resize(1);
 			new_item->pos_info[0].pos = Vec3f(pos);
 			new_item->pos_info[0].size_factor = size_factor;
+			new_item->priority = DownloadQueueItem::computePriority(new_item->pos_info, last_campos, last_camdir, last_predicted_campos);
 			
 			item_URL_map[URL] = new_item;
-			items.push_back(new_item);
+			heap.push(new_item);
 
 			already_inserted = false;
 		}
@@ -55,6 +69,14 @@ void DownloadingResourceQueue::enqueueOrUpdateItem(/*const DownloadQueueItem& it
 			new_pos_info.pos = Vec3f(pos);
 			new_pos_info.size_factor = size_factor;
 			existing_item->pos_info.push_back(new_pos_info);
+
+			// The priority is the min over positions, so the new position can only make the item more important.
+			const float new_pos_priority = computeLoadQueuePriority(pos, size_factor, last_campos, last_camdir, last_predicted_campos);
+			if(new_pos_priority < existing_item->priority)
+			{
+				existing_item->priority = new_pos_priority;
+				heap.priorityChanged(existing_item);
+			}
 			
 			already_inserted = true;
 		}
@@ -68,57 +90,49 @@ void DownloadingResourceQueue::enqueueOrUpdateItem(/*const DownloadQueueItem& it
 size_t DownloadingResourceQueue::size() const
 {
 	Lock lock(mutex);
-	return items.size() - begin_i;
+	return heap.size();
 }
 
 
-struct QueueItemDistComparator
+void DownloadingResourceQueue::updatePriorities(const Vec3d& campos, const Vec3d& camdir)
 {
-	bool operator () (const DownloadQueueItem* a, const DownloadQueueItem* b)
-	{
-		return a->priority < b->priority;
-	}
-};
+	updatePriorities(campos, camdir, /*predicted_campos=*/campos.toVec4fPoint());
+}
 
 
-void DownloadingResourceQueue::sortQueue(const Vec3d& campos_) // Sort queue
+void DownloadingResourceQueue::updatePriorities(const Vec3d& campos_, const Vec3d& camdir_, const Vec4f& predicted_campos)
 {
-	// Sort download list by distance from camera
 	const Vec4f campos_zero_w((float)campos_.x, (float)campos_.y, (float)campos_.z, 0.f);
+	const Vec4f camdir((float)camdir_.x, (float)camdir_.y, (float)camdir_.z, 0.f);
+	const Vec4f predicted_campos_zero_w = maskWToZero(predicted_campos);
 
 	{
 		Lock lock(mutex);
 
 		Timer timer;
 
-		QueueItemDistComparator comparator;
+		last_campos = campos_zero_w;
+		last_camdir = camdir;
+		last_predicted_campos = predicted_campos_zero_w;
 
-		// Do pass over queue items to compute priority, store and use that for sorting.
-		const size_t items_size = items.size();
-		for(size_t i = begin_i; i < items_size; ++i)
-		{
-			const SmallVector<DownloadQueuePosInfo, 4>& pos_info = items[i]->pos_info;
-			assert(pos_info.size() >= 1);
-			float smallest_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[0].pos.x))) * pos_info[0].size_factor;
-			for(size_t z=1; z<pos_info.size(); ++z)
-			{
-				const float pos_info_z_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[z].pos.x))) * pos_info[z].size_factor;
-				smallest_priority = myMin(smallest_priority, pos_info_z_priority);
-			}
+		// Do pass over queue items to compute priority, then restore heap order.
+		const size_t heap_size = heap.size();
+		for(size_t i=0; i<heap_size; ++i)
+			heap[i]->priority = DownloadQueueItem::computePriority(heap[i]->pos_info, campos_zero_w, camdir, predicted_campos_zero_w);
 
-			items[i]->priority = smallest_priority;
-		}
+		heap.rebuild();
 
-		std::sort(items.begin() + begin_i, items.end(), comparator);
+		// conPrint("!!!!Updating download queue priorities (" + toString(heap.size()) + " items) took " + timer.elapsedStringNSigFigs(4));
+	}
+}
 
-		/*conPrint("Download queue: ");
-		for(int i=(int)begin_i; i<(int)items.size(); ++i)
-		{
-			conPrint("item " + toString(i) + ": " + items[i].URL + ", (" + doubleToStringNSigFigs(items[i].pos.getDist(campos), 3) + " m away)");
-		}*/
 
-		// conPrint("!!!!Sorting download queue (" + toString(items.size() - begin_i) + " items) took " + timer.elapsedStringNSigFigs(4) + " (begin_i: " + toString(begin_i) + ")");
-	}
+void DownloadingResourceQueue::dequeueFrontItem(DownloadQueueItem& item_out)
+{
+	DownloadQueueItem* item = heap.pop();
+	item_URL_map.erase(item->URL);
+	item_out = *item;
+	delete item;
 }
 
 
@@ -128,45 +142,139 @@ void DownloadingResourceQueue::dequeueItemsWithTimeOut(double wait_time_seconds,
 
 	Lock lock(mutex);
 
-	if(begin_i < items.size()) // If there are any items in the queue:
+	if(heap.empty())
+		nonempty.waitWithTimeout(mutex, wait_time_seconds); // Suspend thread until there are (maybe) items in the queue
+
+	for(size_t i=0; (i<max_num_items) && !heap.empty(); ++i) // while we have removed <= max_num_items and there are still items in the queue:
+	{
+		items_out.resize(items_out.size() + 1);
+		dequeueFrontItem(items_out.back());
+	}
+}
+
+
+bool DownloadingResourceQueue::tryDequeueItem(DownloadQueueItem& item_out)
+{
+	Lock lock(mutex);
+
+	if(!heap.empty()) // If there are any items in the queue:
 	{
-		for(size_t i=0; (i<max_num_items) && (begin_i < items.size()); ++i) // while we have removed <= max_num_items and there are still items in the queue:
-		{
-			items_out.push_back(*items[begin_i]);
-			item_URL_map.erase(items[begin_i]->URL);
-			delete items[begin_i];
-			items[begin_i] = NULL;
-			begin_i++;
-		}
-		return;
+		dequeueFrontItem(item_out);
+		return true;
 	}
+	else
+		return false;
+}
 
-	nonempty.waitWithTimeout(mutex, wait_time_seconds); // Suspend thread until there are (maybe) items in the queue
 
-	for(size_t i=0; (i<max_num_items) && (begin_i < items.size()); ++i) // while we have removed <= max_num_items and there are still items in the queue:
+void DownloadingResourceQueue::enqueueCellLowLODModelsRequest(const CellLowLODModelsRequest& request)
+{
 	{
-		items_out.push_back(*items[begin_i]);
-		item_URL_map.erase(items[begin_i]->URL);
-		delete items[begin_i];
-		items[begin_i] = NULL;
-		begin_i++;
+		Lock lock(mutex);
+
+		if(cell_requests.size() >= MAX_NUM_CELL_REQUESTS)
+			cell_requests.pop_front();
+		cell_requests.push_back(request);
 	}
+
+	nonempty.notify(); // Wake up a DownloadResourcesThread waiting in dequeueItemsWithTimeOut().
 }
 
 
-bool DownloadingResourceQueue::tryDequeueItem(DownloadQueueItem& item_out)
+bool DownloadingResourceQueue::tryDequeueCellLowLODModelsRequest(CellLowLODModelsRequest& request_out)
 {
 	Lock lock(mutex);
 
-	if(begin_i < items.size()) // If there are any items in the queue:
+	if(cell_requests.empty())
+		return false;
+
+	request_out = cell_requests.front();
+	cell_requests.pop_front();
+	return true;
+}
+
+
+bool DownloadingResourceQueue::getFrontItemPriority(float& priority_out) const
+{
+	Lock lock(mutex);
+
+	if(!heap.empty())
 	{
-		item_out = *items[begin_i];
-		item_URL_map.erase(items[begin_i]->URL);
-		delete items[begin_i];
-		items[begin_i] = NULL;
-		begin_i++;
+		priority_out = heap.top()->priority;
 		return true;
 	}
 	else
 		return false;
 }
+
+
+void DownloadingResourceQueue::getLastCamPosAndDir(Vec4f& campos_out, Vec4f& camdir_out, Vec4f& predicted_campos_out) const
+{
+	Lock lock(mutex);
+	campos_out = last_campos;
+	camdir_out = last_camdir;
+	predicted_campos_out = last_predicted_campos;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+void DownloadingResourceQueue::test()
+{
+	conPrint("DownloadingResourceQueue::test()");
+
+	{
+		DownloadingResourceQueue queue;
+		queue.updatePriorities(Vec3d(0, 0, 0), Vec3d(1, 0, 0));
+
+		queue.enqueueOrUpdateItem("far", Vec4f(100, 0, 0, 1), /*size_factor=*/1.f);
+		queue.enqueueOrUpdateItem("near", Vec4f(10, 0, 0, 1), /*size_factor=*/1.f);
+		queue.enqueueOrUpdateItem("behind", Vec4f(-8, 0, 0, 1), /*size_factor=*/1.f);
+		testAssert(queue.size() == 3);
+
+		float front_priority;
+		testAssert(queue.getFrontItemPriority(front_priority) && epsEqual(front_priority, 10.f));
+
+		// Another object using "far" is close to the camera, so it should now be the most important.
+		queue.enqueueOrUpdateItem("far", Vec4f(1, 0, 0, 1), /*size_factor=*/1.f);
+		testAssert(queue.size() == 3);
+
+		DownloadQueueItem item;
+		testAssert(queue.tryDequeueItem(item) && item.URL == "far");
+
+		// Turn the camera around, so "behind" is now in front.
+		queue.updatePriorities(Vec3d(0, 0, 0), Vec3d(-1, 0, 0));
+		std::vector<DownloadQueueItem> items;
+		queue.dequeueItemsWithTimeOut(/*wait_time_s=*/0.0, /*max_num_items=*/10, items);
+		testAssert(items.size() == 2);
+		testAssert(items[0].URL == "behind" && items[1].URL == "near");
+
+		testAssert(!queue.tryDequeueItem(item));
+		testAssert(!queue.getFrontItemPriority(front_priority));
+	}
+
+	// Test cell low LOD model requests are dequeued in order, and that the oldest requests are dropped when there are too many.
+	{
+		DownloadingResourceQueue queue;
+		for(int i=0; i<(int)MAX_NUM_CELL_REQUESTS + 2; ++i)
+		{
+			CellLowLODModelsRequest request;
+			request.cell_coords = Vec3<int>(i, 0, 0);
+			queue.enqueueCellLowLODModelsRequest(request);
+		}
+		testAssert(queue.size() == 0); // Cell requests are not counted as download items.
+
+		CellLowLODModelsRequest request;
+		testAssert(queue.tryDequeueCellLowLODModelsRequest(request) && request.cell_coords.x == 2);
+		testAssert(queue.tryDequeueCellLowLODModelsRequest(request) && request.cell_coords.x == 3);
+	}
+
+	conPrint("DownloadingResourceQueue::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2024 -
 #pragma once
 
 
+#include "LoadQueueHeap.h"
 #include <physics/jscol_aabbox.h>
 #include <utils/Platform.h>
 #include <utils/Mutex.h>
@@ -15,6 +16,8 @@ Copyright Glare Technologies Limited 2024 -
 #include <maths/Vec4.h>
 #include <maths/vec3.h>
 #include <vector>
+#include <deque>
+#include <string>
 #include <unordered_map>
 
 
@@ -41,10 +44,25 @@ struct DownloadQueueItem
 		return 1.f / myMax(min_len, aabb_ws_longest_len);
 	}
 
+	// Priority is the smallest computeLoadQueuePriority() value over the using objects: roughly distance from the camera times the size factor for the object,
+	// scaled up for objects not in front of the camera.  Lower values are more important.
+	// Items near predicted_campos_zero_w (the predicted future camera position) are also made more important.
+	static float computePriority(const SmallVector<DownloadQueuePosInfo, 4>& pos_info, const Vec4f& campos_zero_w, const Vec4f& camdir, const Vec4f& predicted_campos_zero_w);
+
 	SmallVector<DownloadQueuePosInfo, 4> pos_info; // Store multiple positions and size factors, since multiple different objects may be using the same resource.
 	std::string URL;
 
-	float priority;
+	float priority; // Computed with the camera position and direction from the last updatePriorities() call.
+	size_t heap_index; // Index in DownloadingResourceQueue heap.
+};
+
+
+// A request for the coarsest LOD models of the objects in a grid cell, which the server sends as a single download.  See Protocol::RequestCellLowLODModels.
+struct CellLowLODModelsRequest
+{
+	std::string world_name;
+	Vec3<int> cell_coords;
+	SmallVector<DownloadQueuePosInfo, 4> pos_info; // Cell centre and size factor, for prioritising the request.
 };
 
 
@@ -52,9 +70,13 @@ struct DownloadQueueItem
 DownloadingResourceQueue
 ------------------------
 Queue of resource URLs to download, together with the position of the object using the resource,
-which is used for sorting the items based on distance from the camera.
+which is used for prioritising the items based on distance from the camera, and view direction.
+Items are kept in a LoadQueueHeap, so adding and updating items is O(log n), and updatePriorities() is O(n).
 
 DownloadResourcesThreads will dequeue items from this queue.
+
+Cell low LOD model requests are kept in a separate FIFO queue, as they are only dequeued by DownloadResourcesThreads connected to servers that support them.
+At most MAX_NUM_CELL_REQUESTS are kept, older requests are dropped since they are likely to be for cells the camera has moved away from.
 =====================================================================*/
 class DownloadingResourceQueue
 {
@@ -66,16 +88,34 @@ public:
 
 	size_t size() const;
 
-	void sortQueue(const Vec3d& campos); // Sort queue (approximately by item distance to camera)
+	void updatePriorities(const Vec3d& campos, const Vec3d& camdir); // Recompute item priorities for the new camera position and (normalised) direction.
+	void updatePriorities(const Vec3d& campos, const Vec3d& camdir, const Vec4f& predicted_campos); // Also takes into account the predicted future camera position.
 
 	void dequeueItemsWithTimeOut(double wait_time_s, size_t max_num_items, std::vector<DownloadQueueItem>& items_out); // Blocks for up to wait_time_s
 
 	bool tryDequeueItem(DownloadQueueItem& item_out);
+
+	static const size_t MAX_NUM_CELL_REQUESTS = 256;
+	void enqueueCellLowLODModelsRequest(const CellLowLODModelsRequest& request);
+	bool tryDequeueCellLowLODModelsRequest(CellLowLODModelsRequest& request_out);
+
+	// Returns false if the queue is empty.
+	bool getFrontItemPriority(float& priority_out) const;
+
+	// Camera position, direction and predicted position passed to the last updatePriorities() call, with w = 0.
+	void getLastCamPosAndDir(Vec4f& campos_out, Vec4f& camdir_out, Vec4f& predicted_campos_out) const;
+
+	static void test();
+
 private:
+	void dequeueFrontItem(DownloadQueueItem& item_out) REQUIRES(mutex);
 
 	mutable Mutex mutex;
 	Condition nonempty;
-	size_t begin_i										GUARDED_BY(mutex);
-	js::Vector<DownloadQueueItem*, 16> items			GUARDED_BY(mutex);
-	std::unordered_map<std::string, DownloadQueueItem*> item_URL_map	GUARDED_BY(mutex); // Map from item URL to pointer to DownloadQueueItem in items.
+	LoadQueueHeap<DownloadQueueItem> heap				GUARDED_BY(mutex);
+	std::unordered_map<std::string, DownloadQueueItem*> item_URL_map	GUARDED_BY(mutex); // Map from item URL to pointer to DownloadQueueItem in heap.
+	std::deque<CellLowLODModelsRequest> cell_requests	GUARDED_BY(mutex);
+	Vec4f last_campos									GUARDED_BY(mutex);
+	Vec4f last_camdir									GUARDED_BY(mutex);
+	Vec4f last_predicted_campos							GUARDED_BY(mutex);
 };
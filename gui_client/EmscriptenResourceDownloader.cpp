@@ -113,7 +113,7 @@ void EmscriptenResourceDownloader::onResourceLoad(Reference<CurrentlyDownloading
 		resource->file_size_B = 0;
 	}
 
-	resource_manager->markAsChanged();
+	resource_manager->markAsChanged(resource);
 
 	out_msg_queue->enqueue(new ResourceDownloadedMessage(downloading_resource->URL)); // Send message back to GUIClient
 }
@@ -140,43 +140,46 @@ void EmscriptenResourceDownloader::onResourceError(Reference<CurrentlyDownloadin
 
 void EmscriptenResourceDownloader::think()
 {
-	const int max_num_concurrent_downloads = 10;
 	const int max_present_resources_total_size_B = 256 * 1024 * 1024;
 
-	if((downloading_resources.size() < max_num_concurrent_downloads) &&
+	// Start downloads for as many queue items as we have free slots, in queue order.
+	// The queue is sorted by distance (and size) of the objects using the resources, so the nearest resources are requested first.
+	// We keep the number of concurrent requests limited, so that the browser doesn't queue lots of requests for far-away resources
+	// in front of ones that get added to the queue later for nearby objects.
+	while((downloading_resources.size() < MAX_NUM_CONCURRENT_DOWNLOADS) &&
 		(resource_manager->getTotalPresentResourcesSizeB() < max_present_resources_total_size_B))
 	{
 		DownloadQueueItem item;
 		const bool got_item = download_queue->tryDequeueItem(item);
-		if(got_item)
+		if(!got_item)
+			break;
+
+		if(!resource_manager->isInDownloadFailedURLs(item.URL)) // Don't try to re-download if we already failed to download this session.
 		{
-			if(!resource_manager->isInDownloadFailedURLs(item.URL)) // Don't try to re-download if we already failed to download this session.
-			{
-				const std::string URL = item.URL;
-				ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
+			const std::string URL = item.URL;
+			ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
 
-				if(resource->getState() == Resource::State_NotPresent)
-				{
-					Reference<CurrentlyDownloadingResource> downloading_resource = new CurrentlyDownloadingResource();
-					downloading_resource->resource_downloader = this;
-					downloading_resource->URL = item.URL;
-					downloading_resources.insert(downloading_resource);
+			if(resource->getState() == Resource::State_NotPresent)
+			{
+				Reference<CurrentlyDownloadingResource> downloading_resource = new CurrentlyDownloadingResource();
+				downloading_resource->resource_downloader = this;
+				downloading_resource->URL = item.URL;
+				downloading_resources.insert(downloading_resource);
 
-					(*this->num_resources_downloading)++;
+				(*this->num_resources_downloading)++;
 
-					const bool use_TLS = hostname != "localhost"; // Don't use TLS on localhost for now, for testing.
-					const std::string protocol = use_TLS ? "https" : "http";
-					const std::string http_URL = protocol + "://" + hostname + "/resource/" + URL;
-					
-					// conPrint("Calling emscripten_wget_data for URL '" + http_URL + "'...");
+				const bool use_TLS = hostname != "localhost"; // Don't use TLS on localhost for now, for testing.
+				const std::string protocol = use_TLS ? "https" : "http";
+				const std::string http_URL = protocol + "://" + hostname + "/resource/" + URL;
+				
+				// conPrint("Calling emscripten_wget_data for URL '" + http_URL + "'...");
 
-					const std::string local_abs_path = resource_manager->getLocalAbsPathForResource(*resource);
+				const std::string local_abs_path = resource_manager->getLocalAbsPathForResource(*resource);
 
 #if EMSCRIPTEN
-					downloading_resource->request_handle = emscripten_async_wget2(http_URL.c_str(), local_abs_path.c_str(), /*requesttype =*/"GET", /*POST params=*/"", 
-						/*userdata arg=*/downloading_resource.ptr(), onLoad, onError, onProgress);
+				downloading_resource->request_handle = emscripten_async_wget2(http_URL.c_str(), local_abs_path.c_str(), /*requesttype =*/"GET", /*POST params=*/"", 
+					/*userdata arg=*/downloading_resource.ptr(), onLoad, onError, onProgress);
 #endif
-				}
 			}
 		}
 	}
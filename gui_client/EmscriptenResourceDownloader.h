@@ -32,6 +32,9 @@ EmscriptenResourceDownloader
 Since downloads with emscripten are async, using emscripten_async_wget2,
 we don't need multi-threading with DownloadResourceThreads.
 So avoid using threads and just call think() every frame.
+
+Each think() call starts downloads for the highest priority items in the DownloadingResourceQueue,
+until MAX_NUM_CONCURRENT_DOWNLOADS downloads are in flight.
 =====================================================================*/
 class EmscriptenResourceDownloader
 {
@@ -46,6 +49,9 @@ public:
 
 	void think();
 
+	// Requests are started in download queue order, with at most this many in flight at once.  About the number of connections a browser will open to one host.
+	static const size_t MAX_NUM_CONCURRENT_DOWNLOADS = 8;
+
 
 	void onResourceLoad(Reference<CurrentlyDownloadingResource> res);
 	void onResourceError(Reference<CurrentlyDownloadingResource> res);
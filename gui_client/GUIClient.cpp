@@ -102,6 +102,14 @@ Copyright Glare Technologies Limited 2024 -
 
 static const double ground_quad_w = 2000.f; // TEMP was 1000, 2000 is for CV rendering
 static const float ob_load_distance = 2000.f;
+static const uint64 PROCESSED_MESH_CACHE_MAX_SIZE_B = 4ull * 1024 * 1024 * 1024;
+static const float COARSEST_LOD_MODEL_IMPORTANCE_FACTOR = 4.f; // Download and load the coarsest LOD model for an object before its other resources.
+// Default memory budget for loaded meshes, physics shapes and textures.  Use a smaller budget for Emscripten due to hard memory usage limits in the browser.
+#if EMSCRIPTEN
+static const int DEFAULT_MEMORY_BUDGET_MB = 1536;
+#else
+static const int DEFAULT_MEMORY_BUDGET_MB = 4096;
+#endif
 // See also  // TEMP HACK: set a smaller max loading distance for CV features in ClientThread.cpp
 
 std::vector<AvatarRef> test_avatars;
@@ -275,6 +283,17 @@ void GUIClient::initialise(const std::string& cache_dir, SettingsStore* settings
 	print("resources_dir: " + resources_dir);
 	resource_manager = new ResourceManager(resources_dir);
 
+	const int memory_budget_MB = myMax(256, settings->getIntValue("memory_budget_MB", /*default val=*/DEFAULT_MEMORY_BUDGET_MB));
+	memory_budget_manager.setBudget((uint64)memory_budget_MB * 1024 * 1024);
+	mesh_manager.setMemoryBudgetManager(&memory_budget_manager);
+
+	texture_load_coordinator = new TextureLoadCoordinator();
+
+#if !defined(EMSCRIPTEN)
+	// With Emscripten we use an in-memory virtual file system, so caching processed meshes in it would just use more memory.
+	processed_mesh_cache = new ProcessedMeshCache(cache_dir + "/processed_meshes", PROCESSED_MESH_CACHE_MAX_SIZE_B);
+#endif
+
 
 	// The user may have changed the resources dir (by changing the custom cache directory) since last time we ran.
 	// In this case, we want to check if each resource is actually present on disk in the current resources dir.
@@ -619,7 +638,7 @@ void GUIClient::afterGLInitInitialise(double device_pixel_ratio, Reference<OpenG
 
 			PhysicsShape physics_shape;
 			Reference<OpenGLMeshRenderData> mesh_data = ModelLoading::makeGLMeshDataAndBatchedMeshForModelPath(path,
-				opengl_engine->vert_buf_allocator.ptr(), false, /*build_dynamic_physics_ob=*/false, opengl_engine->mem_allocator.ptr(), physics_shape);
+				opengl_engine->vert_buf_allocator.ptr(), false, /*build_dynamic_physics_ob=*/false, opengl_engine->mem_allocator.ptr(), /*processed_mesh_cache=*/NULL, physics_shape);
 
 			test_avatar->graphics.skinned_gl_ob = ModelLoading::makeGLObjectForMeshDataAndMaterials(*opengl_engine, mesh_data, /*ob_lod_level=*/0, 
 				test_avatar->avatar_settings.materials, /*lightmap_url=*/std::string(), *resource_manager, ob_to_world_matrix);
@@ -695,8 +714,7 @@ GUIClient::~GUIClient()
 	const std::string resources_db_path = appdata_path + "/resources_db";
 	try
 	{
-		if(resource_manager->hasChanged())
-			resource_manager->saveToDisk(resources_db_path);
+		resource_manager->saveChangesToDisk(resources_db_path);
 	}
 	catch(glare::Exception& e)
 	{
@@ -947,7 +965,7 @@ static inline bool isValidLightMapURL(const std::string& URL)
 
 // Start loading texture, if present
 void GUIClient::startLoadingTextureIfPresent(const std::string& tex_url, const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_task_dist, float importance_factor, 
-	const TextureParams& tex_params)
+	const TextureParams& tex_params, const void* requester)
 {
 	if(isValidImageTextureURL(tex_url))
 	{
@@ -956,14 +974,14 @@ void GUIClient::startLoadingTextureIfPresent(const std::string& tex_url, const V
 		{
 			const std::string local_abs_tex_path = resource_manager->getLocalAbsPathForResource(*resource);
 
-			startLoadingTextureForLocalPath(local_abs_tex_path, resource, centroid_ws, aabb_ws_longest_len, max_task_dist, importance_factor, tex_params);
+			startLoadingTextureForLocalPath(local_abs_tex_path, resource, centroid_ws, aabb_ws_longest_len, max_task_dist, importance_factor, tex_params, requester);
 		}
 	}
 }
 
 
 void GUIClient::startLoadingTextureForLocalPath(const std::string& local_abs_tex_path, const ResourceRef& resource, const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_task_dist, float importance_factor, 
-		const TextureParams& tex_params)
+		const TextureParams& tex_params, const void* requester)
 {
 	//assert(resource_manager->getExistingResourceForURL(tex_url).nonNull() && resource_manager->getExistingResourceForURL(tex_url)->getState() == Resource::State_Present);
 	if(!opengl_engine->isOpenGLTextureInsertedForKey(OpenGLTextureKey(local_abs_tex_path))) // If texture is not uploaded to GPU already:
@@ -975,6 +993,8 @@ void GUIClient::startLoadingTextureForLocalPath(const std::string& local_abs_tex
 			const bool used_by_terrain = this->terrain_system.nonNull() && this->terrain_system->isTextureUsedByTerrain(local_abs_tex_path);
 
 			Reference<LoadTextureTask> task = new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, local_abs_tex_path, resource, tex_params, used_by_terrain);
+			task->job = texture_load_coordinator->createJob(local_abs_tex_path, requester);
+			task->coordinator = texture_load_coordinator;
 
 			load_item_queue.enqueueItem(
 				resource->URL, // key
@@ -987,6 +1007,8 @@ void GUIClient::startLoadingTextureForLocalPath(const std::string& local_abs_tex
 		}
 		else
 		{
+			texture_load_coordinator->addRequester(local_abs_tex_path, requester); // Merge this request into any existing job for the texture.
+
 			load_item_queue.checkUpdateItemPosition(/*key=*/resource->URL, centroid_ws, aabb_ws_longest_len, importance_factor);
 		}
 	}
@@ -996,7 +1018,7 @@ void GUIClient::startLoadingTextureForLocalPath(const std::string& local_abs_tex
 // max_dist_for_ob_lod_level: maximum distance from camera at which the object will still be at ob_lod_level.
 // max_dist_for_ob_lod_level_clamped_0: maximum distance from camera at which the object will still be at max(0, ob_lod_level).   [e.g. treats level -1 as 0]
 void GUIClient::startLoadingTextureForObject(const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_dist_for_ob_lod_level, float max_dist_for_ob_lod_level_clamped_0, float importance_factor, const WorldMaterial& world_mat, int ob_lod_level, 
-	const std::string& texture_url, bool tex_has_alpha, bool use_sRGB, bool allow_compression)
+	const std::string& texture_url, bool tex_has_alpha, bool use_sRGB, bool allow_compression, const void* requester)
 {
 	const std::string lod_tex_url = world_mat.getLODTextureURLForLevel(texture_url, ob_lod_level, tex_has_alpha);
 
@@ -1010,7 +1032,7 @@ void GUIClient::startLoadingTextureForObject(const Vec4f& centroid_ws, float aab
 	TextureParams tex_params;
 	tex_params.use_sRGB = use_sRGB;
 	tex_params.allow_compression = allow_compression;
-	startLoadingTextureIfPresent(lod_tex_url, centroid_ws, aabb_ws_longest_len, use_max_dist_for_ob_lod_level, importance_factor, tex_params);
+	startLoadingTextureIfPresent(lod_tex_url, centroid_ws, aabb_ws_longest_len, use_max_dist_for_ob_lod_level, importance_factor, tex_params, requester);
 }
 
 
@@ -1021,13 +1043,13 @@ void GUIClient::startLoadingTexturesForObject(const WorldObject& ob, int ob_lod_
 	{
 		const WorldMaterial* mat = ob.materials[i].ptr();
 		if(!mat->colour_texture_url.empty())
-			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->colour_texture_url, mat->colourTexHasAlpha(), /*use_sRGB=*/true, /*allow_compression=*/true);
+			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->colour_texture_url, mat->colourTexHasAlpha(), /*use_sRGB=*/true, /*allow_compression=*/true, /*requester=*/&ob);
 		if(!mat->emission_texture_url.empty())
-			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->emission_texture_url, /*has_alpha=*/false, /*use_sRGB=*/true, /*allow_compression=*/true);
+			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->emission_texture_url, /*has_alpha=*/false, /*use_sRGB=*/true, /*allow_compression=*/true, /*requester=*/&ob);
 		if(!mat->roughness.texture_url.empty())
-			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->roughness.texture_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow_compression=*/true);
+			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->roughness.texture_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow_compression=*/true, /*requester=*/&ob);
 		if(!mat->normal_map_url.empty())
-			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->normal_map_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow_compression=*/false);
+			startLoadingTextureForObject(ob.getCentroidWS(), ob.getAABBWSLongestLength(), max_dist_for_ob_lod_level, max_dist_for_ob_lod_level_clamped_0, /*importance factor=*/1.f, *mat, ob_lod_level, mat->normal_map_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow_compression=*/false, /*requester=*/&ob);
 	}
 
 	// Start loading lightmap
@@ -1052,8 +1074,9 @@ void GUIClient::startLoadingTexturesForObject(const WorldObject& ob, int ob_lod_
 					// This code is also in startDownloadingResourcesForObject().
 					tex_params.filtering = OpenGLTexture::Filtering_Bilinear;
 					tex_params.use_mipmaps = false;
-					load_item_queue.enqueueItem(/*key=*/lod_tex_url, ob, 
-						new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, tex_params, /*is_terrain_map=*/false), 
+					Reference<LoadTextureTask> task = new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, tex_params, /*is_terrain_map=*/false);
+					task->job = texture_load_coordinator->createJob(tex_path, /*requester=*/&ob);
+					load_item_queue.enqueueItem(/*key=*/lod_tex_url, ob, task, 
 						max_dist_for_ob_lod_level_clamped_0); // Lightmaps don't have LOD level -1 so used max dist for LOD level >= 0.
 				}
 				// Lightmaps are only used by a single object, so there should be no other uses of the lightmap, so don't need to call load_item_queue.checkUpdateItemPosition()
@@ -1073,13 +1096,56 @@ void GUIClient::startLoadingTexturesForAvatar(const Avatar& av, int ob_lod_level
 	{
 		const WorldMaterial* mat = av.avatar_settings.materials[i].ptr();
 		if(!mat->colour_texture_url.empty())
-			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->colour_texture_url, mat->colourTexHasAlpha(), /*use_sRGB=*/true, /*allow compression=*/true);
+			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->colour_texture_url, mat->colourTexHasAlpha(), /*use_sRGB=*/true, /*allow compression=*/true, /*requester=*/&av);
 		if(!mat->emission_texture_url.empty())
-			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->emission_texture_url, /*has_alpha=*/false, /*use_sRGB=*/true, /*allow compression=*/true);
+			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->emission_texture_url, /*has_alpha=*/false, /*use_sRGB=*/true, /*allow compression=*/true, /*requester=*/&av);
 		if(!mat->roughness.texture_url.empty())
-			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->roughness.texture_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow compression=*/true);
+			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->roughness.texture_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow compression=*/true, /*requester=*/&av);
 		if(!mat->normal_map_url.empty())
-			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->normal_map_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow compression=*/false);
+			startLoadingTextureForObject(av.pos.toVec4fPoint(), /*aabb_ws_longest_len=*/1.8f, max_dist_for_ob_lod_level, max_dist_for_ob_lod_level, our_avatar_importance_factor, *mat, ob_lod_level, mat->normal_map_url, /*has_alpha=*/false, /*use_sRGB=*/false, /*allow compression=*/false, /*requester=*/&av);
+	}
+}
+
+
+// Called when a load task is discarded from the load item queue without being executed, e.g. because it is too far from the camera.
+// Removes the resource from the relevant processing set, so it can be loaded again later.
+void GUIClient::removeDiscardedLoadTaskFromProcessingSets(const glare::TaskRef& task_)
+{
+	if(dynamic_cast<const LoadTextureTask*>(task_.ptr()))
+	{
+		const LoadTextureTask* task = static_cast<const LoadTextureTask*>(task_.ptr());
+		assert(textures_processing.count(task->path) > 0);
+		textures_processing.erase(task->path);
+		if(task->job.nonNull())
+			texture_load_coordinator->jobFinished(task->job);
+	}
+	else if(dynamic_cast<const MakeHypercardTextureTask*>(task_.ptr()))
+	{
+		const MakeHypercardTextureTask* task = static_cast<const MakeHypercardTextureTask*>(task_.ptr());
+		assert(textures_processing.count(task->tex_key) > 0);
+		textures_processing.erase(task->tex_key);
+	}
+	else if(dynamic_cast<const LoadModelTask*>(task_.ptr()))
+	{
+		const LoadModelTask* task = static_cast<const LoadModelTask*>(task_.ptr());
+		if(!task->lod_model_url.empty()) // Will be empty for voxel models
+		{
+			ModelProcessingKey key(task->lod_model_url, task->build_dynamic_physics_ob);
+			//assert(models_processing.count(key) > 0);
+			models_processing.erase(key);
+		}
+	}
+	else if(dynamic_cast<const LoadScriptTask*>(task_.ptr()))
+	{
+		const LoadScriptTask* task = static_cast<const LoadScriptTask*>(task_.ptr());
+		assert(script_content_processing.count(task->script_content) > 0);
+		script_content_processing.erase(task->script_content);
+	}
+	else if(dynamic_cast<const LoadAudioTask*>(task_.ptr()))
+	{
+		const LoadAudioTask* task = static_cast<const LoadAudioTask*>(task_.ptr());
+		assert(audio_processing.count(task->audio_source_url) > 0);
+		audio_processing.erase(task->audio_source_url);
 	}
 }
 
@@ -1094,6 +1160,13 @@ void GUIClient::removeAndDeleteGLObjectsForOb(WorldObject& ob)
 
 	ob.opengl_engine_ob = NULL;
 
+	// Record where the mesh was last used, so the memory budget manager can estimate how likely it is to be used again.
+	if(ob.mesh_manager_data.nonNull())
+	{
+		const float dist = (float)ob.pos.getDist(cam_controller.getPosition());
+		memory_budget_manager.setAssetUseInfo(MemoryBudgetManager::AssetClass_Mesh, ob.mesh_manager_data->model_url, dist, /*screen_size=*/ob.getBiasedAABBLength() / myMax(1.f, dist));
+	}
+
 	ob.mesh_manager_data = NULL;
 
 	ob.loading_or_loaded_model_lod_level = -10;
@@ -1114,6 +1187,13 @@ void GUIClient::removeAndDeleteGLAndPhysicsObjectsForOb(WorldObject& ob)
 		ob.physics_object = NULL;
 	}
 
+	if(ob.mesh_manager_shape_data.nonNull())
+	{
+		const float dist = (float)ob.pos.getDist(cam_controller.getPosition());
+		memory_budget_manager.setAssetUseInfo(MemoryBudgetManager::AssetClass_PhysicsShape, MeshManager::physicsShapeBudgetKey(MeshManagerPhysicsShapeKey(ob.mesh_manager_shape_data->model_url, ob.mesh_manager_shape_data->dynamic)),
+			dist, /*screen_size=*/ob.getBiasedAABBLength() / myMax(1.f, dist));
+	}
+
 	ob.mesh_manager_shape_data = NULL;
 
 	// TOOD: removeObScriptingInfo(&ob);
@@ -1258,6 +1338,26 @@ void GUIClient::startDownloadingResourcesForObject(WorldObject* ob, int ob_lod_l
 			}
 		}
 	}
+
+	// For progressive loading, if we need to download the model for the object, download the coarsest LOD model as well, ahead of the other resources,
+	// so we have something to show for the object quickly.  See loadCoarsestLODModelForObjectWhileRefining().
+	if((ob->object_type == WorldObject::ObjectType_Generic) && !ob->model_url.empty())
+	{
+		const int ob_model_lod_level = myClamp(ob_lod_level, 0, ob->max_model_lod_level);
+		if(shouldUseCoarsestLODModelAsStandIn(ob, ob_model_lod_level) && !resource_manager->isFileForURLPresent(WorldObject::getLODModelURLForLevel(ob->model_url, ob_model_lod_level)))
+		{
+			const std::string coarse_model_url = WorldObject::getLODModelURLForLevel(ob->model_url, ob->max_model_lod_level);
+			if(!resource_manager->isFileForURLPresent(coarse_model_url))
+			{
+				DownloadingResourceInfo info;
+				info.build_dynamic_physics_ob = false;
+				info.pos = ob->pos;
+				info.size_factor = LoadItemQueueItem::sizeFactorForAABBWS(ob->getAABBWSLongestLength(), COARSEST_LOD_MODEL_IMPORTANCE_FACTOR);
+
+				startDownloadingResource(coarse_model_url, ob->getCentroidWS(), ob->getAABBWSLongestLength() * COARSEST_LOD_MODEL_IMPORTANCE_FACTOR, info);
+			}
+		}
+	}
 }
 
 
@@ -2053,6 +2153,7 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->processed_mesh_cache = processed_mesh_cache;
 							load_model_task->build_dynamic_physics_ob = ob->isDynamic();
 
 							load_item_queue.enqueueItem(/*key=*/lod_model_url, *ob, load_model_task, max_dist_for_ob_model_lod_level);
@@ -2066,7 +2167,12 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 				if(!added_opengl_ob)
 					this->loading_model_URL_to_world_ob_UID_map[ModelProcessingKey(lod_model_url, ob->isDynamic())].insert(ob->uid);
 
-				load_placeholder = !added_opengl_ob;
+				// Show the coarsest LOD model while the model is loading, if possible.
+				bool added_coarse_ob = false;
+				if(!added_opengl_ob)
+					added_coarse_ob = loadCoarsestLODModelForObjectWhileRefining(ob, ob_lod_level, ob_model_lod_level, max_dist_for_ob_model_lod_level);
+
+				load_placeholder = !added_opengl_ob && !added_coarse_ob;
 			}
 			else
 			{
@@ -2100,6 +2206,74 @@ void GUIClient::loadModelForObject(WorldObject* ob)
 }
 
 
+// Progressive loading: an object without a model to show yet can show its coarsest LOD model (the smallest model generated by LODGeneration)
+// while the model for its current LOD level is loading.
+// We don't do this for dynamic or scripted (kinematic) objects, as they keep their first physics shape when the model is changed.
+bool GUIClient::shouldUseCoarsestLODModelAsStandIn(const WorldObject* ob, int ob_model_lod_level)
+{
+	return (ob_model_lod_level < ob->max_model_lod_level) && !ob->isDynamic() && ob->script.empty() && (ob->opengl_engine_ob.isNull() || ob->using_placeholder_model);
+}
+
+
+// Called when the model for ob at ob_model_lod_level is not loaded.  
+// If the coarsest LOD model for the object is loaded, assigns it to the object and returns true.  
+// Otherwise starts loading it (ahead of the model at ob_model_lod_level) if it is present on disk, and adds the object to the wait list for it, and returns false.
+bool GUIClient::loadCoarsestLODModelForObjectWhileRefining(WorldObject* ob, int ob_lod_level, int ob_model_lod_level, float max_task_dist)
+{
+	if(!shouldUseCoarsestLODModelAsStandIn(ob, ob_model_lod_level))
+		return false;
+
+	const std::string coarse_model_url = WorldObject::getLODModelURLForLevel(ob->model_url, ob->max_model_lod_level);
+
+	Reference<MeshData> mesh_data = mesh_manager.getMeshData(coarse_model_url);
+	Reference<PhysicsShapeData> physics_shape_data = mesh_manager.getPhysicsShapeData(MeshManagerPhysicsShapeKey(coarse_model_url, /*dynamic=*/false));
+	if(mesh_data.nonNull() && physics_shape_data.nonNull() && mesh_data->gl_meshdata->vbo_handle.valid())
+	{
+		loadPresentCoarsestLODModelForObject(ob, mesh_data, physics_shape_data, ob_lod_level);
+		return true;
+	}
+
+	if(resource_manager->isFileForURLPresent(coarse_model_url))
+	{
+		const bool just_added = this->checkAddModelToProcessingSet(coarse_model_url, /*dynamic_physics_shape=*/false);
+		if(just_added)
+		{
+			Reference<LoadModelTask> load_model_task = new LoadModelTask();
+
+			load_model_task->resource = resource_manager->getOrCreateResourceForURL(coarse_model_url);
+			load_model_task->lod_model_url = coarse_model_url;
+			load_model_task->opengl_engine = this->opengl_engine;
+			load_model_task->unit_cube_shape = this->unit_cube_shape;
+			load_model_task->result_msg_queue = &this->msg_queue;
+			load_model_task->resource_manager = resource_manager;
+			load_model_task->processed_mesh_cache = processed_mesh_cache;
+			load_model_task->build_dynamic_physics_ob = false;
+
+			load_item_queue.enqueueItem(/*key=*/coarse_model_url, ob->getCentroidWS(), ob->getAABBWSLongestLength(), load_model_task, max_task_dist, COARSEST_LOD_MODEL_IMPORTANCE_FACTOR);
+		}
+		else
+			load_item_queue.checkUpdateItemPosition(/*key=*/coarse_model_url, ob->getCentroidWS(), ob->getAABBWSLongestLength(), COARSEST_LOD_MODEL_IMPORTANCE_FACTOR);
+	}
+
+	// If the coarse model file is not present, it should be downloading (see startDownloadingResourcesForObject()), and will be loaded when downloaded.
+	this->loading_model_URL_to_world_ob_UID_map[ModelProcessingKey(coarse_model_url, /*dynamic=*/false)].insert(ob->uid);
+	return false;
+}
+
+
+// Assigns the coarsest LOD model to the object, while the model for the object's current LOD level is still loading.
+void GUIClient::loadPresentCoarsestLODModelForObject(WorldObject* ob, const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data, int ob_lod_level)
+{
+	const int loading_model_lod_level = ob->loading_or_loaded_model_lod_level;
+
+	loadPresentObjectGraphicsAndPhysicsModels(ob, mesh_data, physics_shape_data, ob_lod_level, ob->max_model_lod_level);
+
+	// We are still loading the model at loading_model_lod_level, which will replace the coarse model when loaded.
+	ob->loading_or_loaded_model_lod_level = loading_model_lod_level;
+	ob->loading_or_loaded_lod_level = ob_lod_level;
+}
+
+
 // Create OpenGL and Physics objects for the WorldObject, given that the OpenGL and physics meshes are present in memory.
 void GUIClient::loadPresentObjectGraphicsAndPhysicsModels(WorldObject* ob, const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data, int ob_lod_level, int ob_model_lod_level)
 {
@@ -2224,7 +2398,7 @@ void GUIClient::loadPresentAvatarModel(Avatar* avatar, int av_lod_level, const R
 		const GLMemUsage new_mem_usage = avatar->graphics.skinned_gl_ob->mesh_data->getTotalMemUsage();
 
 		// The mesh manager keeps a running total of the amount of memory used by inserted meshes.  Therefore it needs to be informed if the size of one of them changes.
-		mesh_manager.meshMemoryAllocatedChanged(old_mem_usage, new_mem_usage);
+		mesh_manager.meshMemoryAllocatedChanged(avatar->mesh_data.ptr(), old_mem_usage, new_mem_usage);
 	}
 
 	avatar->graphics.build();
@@ -2356,6 +2530,7 @@ void GUIClient::loadModelForAvatar(Avatar* avatar)
 					load_model_task->unit_cube_shape = this->unit_cube_shape;
 					load_model_task->result_msg_queue = &this->msg_queue;
 					load_model_task->resource_manager = resource_manager;
+					load_model_task->processed_mesh_cache = processed_mesh_cache;
 
 					load_item_queue.enqueueItem(/*key=*/lod_model_url, *avatar, load_model_task, max_dist_for_ob_model_lod_level, our_avatar);
 				}
@@ -3043,6 +3218,14 @@ void GUIClient::unloadObject(WorldObjectRef ob)
 	//conPrint("unloadObject");
 	removeAndDeleteGLAndPhysicsObjectsForOb(*ob);
 
+	texture_load_coordinator->removeRequester(ob.ptr()); // Cancel texture loads that were only wanted by this object.
+
+	// Cancel any queued voxel model task for the object, since it is only used by this object.  (Queued tasks for shared resources such as models and textures
+	// are discarded by load_item_queue.updatePriorities() once they are too far from the camera)
+	LoadItemQueueItem removed_item;
+	if(load_item_queue.removeItem(/*key=*/"voxelob_" + ob->uid.toString(), removed_item))
+		removeDiscardedLoadTaskFromProcessingSets(removed_item.task);
+
 	if(ob->audio_source.nonNull())
 	{
 		audio_engine.removeSource(ob->audio_source);
@@ -3066,10 +3249,35 @@ void GUIClient::newCellInProximity(const Vec3<int>& cell_coords)
 		scratch_packet.writeInt32(cell_coords.z);
 
 		enqueueMessageToSend(*this->client_thread, scratch_packet);
+
+		requestCellLowLODModels(cell_coords);
 	}
 }
 
 
+// Progressive loading: asks the server for the coarsest LOD models of the objects in the cell, in a single download, so that objects in the cell can show
+// their coarse models quickly (see loadCoarsestLODModelForObjectWhileRefining()).  Only done once per cell per connection.
+// The requests are only sent by DownloadResourcesThreads connected to servers that support them.
+void GUIClient::requestCellLowLODModels(const Vec3<int>& cell_coords)
+{
+#if !EMSCRIPTEN // Emscripten downloads resources over HTTP with EmscriptenResourceDownloader, which doesn't support cell requests.
+	if(!cells_with_low_lod_models_requested.insert(cell_coords).second)
+		return;
+
+	const float cell_w = ProximityLoader::getCellWidth();
+
+	CellLowLODModelsRequest request;
+	request.world_name = server_worldname;
+	request.cell_coords = cell_coords;
+	request.pos_info.resize(1);
+	request.pos_info[0].pos = Vec3f(((float)cell_coords.x + 0.5f) * cell_w, ((float)cell_coords.y + 0.5f) * cell_w, ((float)cell_coords.z + 0.5f) * cell_w);
+	request.pos_info[0].size_factor = DownloadQueueItem::sizeFactorForAABBWS(cell_w);
+
+	download_queue.enqueueCellLowLODModelsRequest(request);
+#endif
+}
+
+
 void GUIClient::tryToMoveObject(WorldObjectRef ob, /*const Matrix4f& tentative_new_to_world*/const Vec4f& desired_new_ob_pos)
 {
 	Lock lock(world_state->mutex);
@@ -3269,6 +3477,11 @@ void GUIClient::checkForLODChanges()
 		const Vec4f cam_pos = cam_controller.getPosition().toVec4fPoint();
 #if EMSCRIPTEN
 		const float proj_len_viewable_threshold_ = proj_len_viewable_threshold;
+#else
+		// If the camera is moving, start downloading resources for objects that are within load distance of the predicted camera position.
+		// Not done for Emscripten due to the tighter memory limits.
+		const Vec4f prefetch_pos = proximity_loader.getPrefetchPos();
+		const bool prefetching = prefetch_pos.getDist2(cam_pos) > 1.f;
 #endif
 		const float load_distance2_ = this->load_distance2;
 
@@ -3309,6 +3522,17 @@ void GUIClient::checkForLODChanges()
 					unloadObject(ob);
 					ob->in_proximity = false;
 				}
+
+#if !EMSCRIPTEN
+				if(prefetching)
+				{
+					const float prefetch_pos_to_ob_d2 = ob->getCentroidWS().getDist2(prefetch_pos);
+					const bool in_prefetch_proximity = prefetch_pos_to_ob_d2 < load_distance2_;
+					if(in_prefetch_proximity && !ob->in_prefetch_proximity)
+						startDownloadingResourcesForObject(ob, ob->getLODLevel(prefetch_pos_to_ob_d2));
+					ob->in_prefetch_proximity = in_prefetch_proximity;
+				}
+#endif
 			}
 			else // Else if object is within load distance:
 			{
@@ -3324,6 +3548,7 @@ void GUIClient::checkForLODChanges()
 				if(!ob->in_proximity) // If an object was out of load distance, and moved within load distance:
 				{
 					ob->in_proximity = true;
+					ob->in_prefetch_proximity = false;
 					loadModelForObject(ob);
 					ob->current_lod_level = lod_level;
 				}
@@ -3407,6 +3632,101 @@ struct CloserToCamComparator
 };
 
 
+// Assigns a model that has been loaded into OpenGL to an object that was waiting for it, if the object still wants the model.
+void GUIClient::assignLoadedModelToWaitingObject(const UID& waiting_uid, int loaded_model_lod_level, bool dynamic_physics_shape, 
+	const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data)
+{
+	auto res = this->world_state->objects.find(waiting_uid);
+	if(res != this->world_state->objects.end())
+	{
+		WorldObject* ob = res.getValue().ptr();
+
+		if(ob->in_proximity)
+		{
+			const int ob_lod_level = ob->getLODLevel(cam_controller.getPosition());
+			const int ob_model_lod_level = myClamp(ob_lod_level, 0, ob->max_model_lod_level);
+
+			// Check the object wants this particular LOD level model right now:
+			if((ob_model_lod_level == loaded_model_lod_level) && (ob->isDynamic() == dynamic_physics_shape))
+			{
+				try
+				{
+					if(!isFinite(ob->angle) || !ob->axis.isFinite())
+						throw glare::Exception("Invalid angle or axis");
+
+					loadPresentObjectGraphicsAndPhysicsModels(ob, mesh_data, physics_shape_data, ob_lod_level, ob_model_lod_level);
+				}
+				catch(glare::Exception& e)
+				{
+					print("Error while loading model: " + e.what());
+				}
+			}
+			else if((loaded_model_lod_level == ob->max_model_lod_level) && !dynamic_physics_shape && shouldUseCoarsestLODModelAsStandIn(ob, ob_model_lod_level))
+			{
+				// This is the coarsest LOD model for the object, and the object is still waiting for the model at its current LOD level, so show the coarse model in the meantime.
+				try
+				{
+					if(!isFinite(ob->angle) || !ob->axis.isFinite())
+						throw glare::Exception("Invalid angle or axis");
+
+					loadPresentCoarsestLODModelForObject(ob, mesh_data, physics_shape_data, ob_lod_level);
+				}
+				catch(glare::Exception& e)
+				{
+					print("Error while loading model: " + e.what());
+				}
+			}
+		}
+	}
+}
+
+
+// Assigns a loaded model to the objects that were waiting for it, one object at a time, until we run out of time for this frame.
+// The task may be resumed over several frames, so it marks the mesh and physics shape as used while it holds them, so the memory budget manager doesn't
+// choose them for eviction in the meantime.  The matching meshDataBecameUnused() and shapeDataBecameUnused() calls are made by MeshData::decRefCount() and
+// PhysicsShapeData::decRefCount() when the task is destroyed (when it finishes, or is cleared from the scheduler), if no object has taken a reference.
+class AssignLoadedModelTask : public MainThreadTask
+{
+public:
+	AssignLoadedModelTask(GUIClient* gui_client_, int loaded_model_lod_level_, bool dynamic_physics_shape_, 
+		const Reference<MeshData>& mesh_data_, const Reference<PhysicsShapeData>& physics_shape_data_)
+	:	gui_client(gui_client_), loaded_model_lod_level(loaded_model_lod_level_), dynamic_physics_shape(dynamic_physics_shape_), 
+		mesh_data(mesh_data_), physics_shape_data(physics_shape_data_), next_i(0)
+	{
+		if(mesh_data.nonNull())
+			mesh_data->meshDataBecameUsed();
+		if(physics_shape_data.nonNull())
+			physics_shape_data->shapeDataBecameUsed();
+	}
+
+	virtual bool run(MainThreadWorkScheduler& scheduler) override
+	{
+		if(gui_client->world_state.isNull())
+			return true;
+
+		Lock lock(gui_client->world_state->mutex);
+
+		while(next_i < waiting_obs.size())
+		{
+			gui_client->assignLoadedModelToWaitingObject(waiting_obs[next_i++], loaded_model_lod_level, dynamic_physics_shape, mesh_data, physics_shape_data);
+
+			if(!scheduler.hasTimeRemaining())
+				break;
+		}
+
+		return next_i >= waiting_obs.size();
+	}
+
+	GUIClient* gui_client;
+	int loaded_model_lod_level;
+	bool dynamic_physics_shape;
+	Reference<MeshData> mesh_data;
+	Reference<PhysicsShapeData> physics_shape_data;
+	std::vector<UID> waiting_obs;
+	size_t next_i; // Index of next object in waiting_obs to assign the model to.
+};
+
+
 void GUIClient::processLoading()
 {
 	//double frame_loading_time = 0;
@@ -3415,31 +3735,35 @@ void GUIClient::processLoading()
 	{
 		PERFORMANCEAPI_INSTRUMENT("process loading msgs");
 
-		// Process ModelLoadedThreadMessages and TextureLoadedThreadMessages until we have consumed a certain amount of time.
+		// Process ModelLoadedThreadMessages and TextureLoadedThreadMessages until we have used up the time budget for this frame (see MainThreadWorkScheduler).
 		// We don't want to do too much at one time or it will cause hitches.
 		// We'll alternate between processing model loaded and texture loaded messages, using process_model_loaded_next.
 		// We alternate for fairness.
-		const double MAX_LOADING_TIME = 0.005;// 5 ms
-		Timer loading_timer;
+		main_thread_work_scheduler.beginFrame();
 		//int max_items_to_process = 10;
 		//int num_items_processed = 0;
 		
 		// Also limit to a total number of bytes of data uploaded to OpenGL / the GPU per frame.
 		size_t total_bytes_uploaded = 0;
 		const size_t max_total_upload_bytes = 1024 * 1024;
+		const size_t min_upload_chunk_bytes = 64 * 1024; // Upload chunks are sized to fit in the remaining time budget, but are at least this big, so we make progress.
 
 		int num_models_loaded = 0;
 		int num_textures_loaded = 0;
 		//while((cur_loading_mesh_data.nonNull() || !model_loaded_messages_to_process.empty() || !texture_loaded_messages_to_process.empty()) && (loading_timer.elapsed() < MAX_LOADING_TIME))
-		while((tex_loading_progress.loadingInProgress() || cur_loading_mesh_data.nonNull() || !model_loaded_messages_to_process.empty() || !texture_loaded_messages_to_process.empty()) && 
+		while((main_thread_work_scheduler.hasPendingTasks() || tex_loading_progress.loadingInProgress() || cur_loading_mesh_data.nonNull() || !model_loaded_messages_to_process.empty() || !texture_loaded_messages_to_process.empty()) && 
 			(total_bytes_uploaded < max_total_upload_bytes) && 
-			(loading_timer.elapsed() < MAX_LOADING_TIME) //&&
+			main_thread_work_scheduler.hasTimeRemaining() //&&
 			/*(num_items_processed < max_items_to_process)*/)
 		{
 			//num_items_processed++;
 
+			if(main_thread_work_scheduler.hasPendingTasks()) // If there is finalisation work left over from a previous frame, or from finishing a mesh upload:
+			{
+				main_thread_work_scheduler.runTasks();
+			}
 			// If we are still loading some mesh data into OpenGL (uploading to GPU):
-			if(cur_loading_mesh_data.nonNull() && cur_loading_voxel_ob.isNull()) // If we are currently loading a non-voxel mesh:
+			else if(cur_loading_mesh_data.nonNull() && cur_loading_voxel_ob.isNull()) // If we are currently loading a non-voxel mesh:
 			{
 				Timer load_item_timer;
 				const std::string loading_item_name = cur_loading_lod_model_url;
@@ -3447,8 +3771,15 @@ void GUIClient::processLoading()
 				// Upload a chunk of data to the GPU
 				try
 				{
+					const size_t chunk_max_total_bytes = total_bytes_uploaded + main_thread_work_scheduler.getMaxUnitsForRemainingTime(MainThreadWorkScheduler::WorkType_MeshUpload, 
+						min_upload_chunk_bytes, max_total_upload_bytes - total_bytes_uploaded);
+					const size_t initial_total_bytes_uploaded = total_bytes_uploaded;
+					Timer upload_timer;
+
 					opengl_engine->partialLoadOpenGLMeshDataIntoOpenGL(*opengl_engine->vert_buf_allocator, *cur_loading_mesh_data, mesh_data_loading_progress,
-						total_bytes_uploaded, max_total_upload_bytes);
+						total_bytes_uploaded, chunk_max_total_bytes);
+
+					main_thread_work_scheduler.recordWork(MainThreadWorkScheduler::WorkType_MeshUpload, total_bytes_uploaded - initial_total_bytes_uploaded, upload_timer.elapsed() * 1.0e6);
 				}
 				catch(glare::Exception& e)
 				{
@@ -3477,49 +3808,18 @@ void GUIClient::processLoading()
 					// Data is uploaded - assign to any waiting objects
 					const int loaded_model_lod_level = WorldObject::getLODLevelForURL(cur_loading_lod_model_url/*message->lod_model_url*/);
 
-					// Assign the loaded model for any objects using waiting for this model:
+					// Assign the loaded model for any objects using waiting for this model.
+					// There may be lots of waiting objects (e.g. many instances of the same model), and assigning the model creates OpenGL and physics objects 
+					// and may load scripts, so this is done by an AssignLoadedModelTask, which is resumed next frame if it runs out of time.
 					Lock lock(this->world_state->mutex);
 
 					const ModelProcessingKey model_loading_key(cur_loading_lod_model_url, cur_loading_dynamic_physics_shape);
 					auto res = this->loading_model_URL_to_world_ob_UID_map.find(model_loading_key);
 					if(res != this->loading_model_URL_to_world_ob_UID_map.end())
 					{
-						std::set<UID>& waiting_obs = res->second;
-						for(auto it = waiting_obs.begin(); it != waiting_obs.end(); ++it)
-						{
-							const UID waiting_uid = *it;
-
-							auto res2 = this->world_state->objects.find(waiting_uid);
-							if(res2 != this->world_state->objects.end())
-							{
-								WorldObject* ob = res2.getValue().ptr();
-
-								//ob->aabb_os = cur_loading_mesh_data->aabb_os;
-
-								if(ob->in_proximity)
-								{
-									const int ob_lod_level = ob->getLODLevel(cam_controller.getPosition());
-									const int ob_model_lod_level = myClamp(ob_lod_level, 0, ob->max_model_lod_level);
-								
-									// Check the object wants this particular LOD level model right now:
-									//const std::string current_desired_model_LOD_URL = ob->getLODModelURLForLevel(ob->model_url, ob_model_lod_level);
-									if(/*(current_desired_model_LOD_URL == cur_loading_lod_model_url)*/(ob_model_lod_level == loaded_model_lod_level) && (ob->isDynamic() == cur_loading_dynamic_physics_shape))
-									{
-										try
-										{
-											if(!isFinite(ob->angle) || !ob->axis.isFinite())
-												throw glare::Exception("Invalid angle or axis");
-
-											loadPresentObjectGraphicsAndPhysicsModels(ob, mesh_data, physics_shape_data, ob_lod_level, ob_model_lod_level);
-										}
-										catch(glare::Exception& e)
-										{
-											print("Error while loading model: " + e.what());
-										}
-									}
-								}
-							}
-						}
+						Reference<AssignLoadedModelTask> task = new AssignLoadedModelTask(this, loaded_model_lod_level, cur_loading_dynamic_physics_shape, mesh_data, physics_shape_data);
+						task->waiting_obs.assign(res->second.begin(), res->second.end());
+						main_thread_work_scheduler.addTask(task);
 
 						loading_model_URL_to_world_ob_UID_map.erase(model_loading_key); // Now that this model has been downloaded, remove from map
 					}
@@ -3575,8 +3875,14 @@ void GUIClient::processLoading()
 				Timer load_item_timer;
 
 				// Upload a chunk of data to the GPU
+				const size_t chunk_max_total_bytes = total_bytes_uploaded + main_thread_work_scheduler.getMaxUnitsForRemainingTime(MainThreadWorkScheduler::WorkType_MeshUpload, 
+					min_upload_chunk_bytes, max_total_upload_bytes - total_bytes_uploaded);
+				const size_t initial_total_bytes_uploaded = total_bytes_uploaded;
+
 				opengl_engine->partialLoadOpenGLMeshDataIntoOpenGL(*opengl_engine->vert_buf_allocator, *cur_loading_mesh_data, mesh_data_loading_progress, 
-					total_bytes_uploaded, max_total_upload_bytes);
+					total_bytes_uploaded, chunk_max_total_bytes);
+
+				main_thread_work_scheduler.recordWork(MainThreadWorkScheduler::WorkType_MeshUpload, total_bytes_uploaded - initial_total_bytes_uploaded, load_item_timer.elapsed() * 1.0e6);
 
 				//logMessage("Loaded a chunk of voxel mesh: " + mesh_data_loading_progress.summaryString());
 
@@ -3709,7 +4015,13 @@ void GUIClient::processLoading()
 				// Upload a chunk of data to the GPU
 				try
 				{
-					TextureLoading::partialLoadTextureIntoOpenGL(opengl_engine, tex_loading_progress, total_bytes_uploaded, max_total_upload_bytes);
+					const size_t chunk_max_total_bytes = total_bytes_uploaded + main_thread_work_scheduler.getMaxUnitsForRemainingTime(MainThreadWorkScheduler::WorkType_TextureUpload, 
+						min_upload_chunk_bytes, max_total_upload_bytes - total_bytes_uploaded);
+					const size_t initial_total_bytes_uploaded = total_bytes_uploaded;
+
+					TextureLoading::partialLoadTextureIntoOpenGL(opengl_engine, tex_loading_progress, total_bytes_uploaded, chunk_max_total_bytes);
+
+					main_thread_work_scheduler.recordWork(MainThreadWorkScheduler::WorkType_TextureUpload, total_bytes_uploaded - initial_total_bytes_uploaded, load_item_timer.elapsed() * 1.0e6);
 				}
 				catch(glare::Exception& e)
 				{
@@ -3851,7 +4163,9 @@ void GUIClient::processLoading()
 
 		//frame_loading_time = loading_timer.elapsed();
 
-		this->last_model_and_tex_loading_time = loading_timer.elapsed();
+		main_thread_work_scheduler.endFrame();
+
+		this->last_model_and_tex_loading_time = main_thread_work_scheduler.getStats().last_frame_time_us * 1.0e-6;
 	}
 }
 
@@ -4163,7 +4477,35 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 #endif
 
 
-	mesh_manager.trimMeshMemoryUsage();
+	// Evict cached meshes, physics shapes and sound files if we are over the memory budget.
+	// The texture server and the decoded texture cache manage their own memory, so their usage is just reported for diagnostics.
+	const double budget_cur_time = Clock::getTimeSinceInit();
+	if(texture_server.nonNull())
+		memory_budget_manager.setExternalUsage(MemoryBudgetManager::AssetClass_Texture, texture_server->getTotalMemUsage() + texture_load_coordinator->getDecodedMapCacheSize());
+
+	// Sound files loaded by the audio engine don't tell us when they are used, so update whether they are in use here.  There are only a few of them.
+	for(auto it = audio_engine.sound_files.begin(); it != audio_engine.sound_files.end(); ++it)
+	{
+		if(!memory_budget_manager.isAssetPresent(MemoryBudgetManager::AssetClass_Audio, it->first))
+			memory_budget_manager.addAsset(MemoryBudgetManager::AssetClass_Audio, it->first, it->second->getMemUsage(), budget_cur_time);
+
+		if(glare::AudioEngine::isSoundFileInUse(*it->second))
+			memory_budget_manager.setAssetUsed(MemoryBudgetManager::AssetClass_Audio, it->first, /*used=*/true, budget_cur_time);
+		else if(memory_budget_manager.isAssetUsed(MemoryBudgetManager::AssetClass_Audio, it->first))
+			memory_budget_manager.setAssetUsed(MemoryBudgetManager::AssetClass_Audio, it->first, /*used=*/false, budget_cur_time);
+	}
+
+	temp_memory_evictions.clear();
+	memory_budget_manager.computeEvictions(budget_cur_time, temp_memory_evictions);
+	for(size_t i=0; i<temp_memory_evictions.size(); ++i)
+	{
+		if(temp_memory_evictions[i].asset_class == MemoryBudgetManager::AssetClass_Mesh)
+			mesh_manager.removeEvictedMesh(temp_memory_evictions[i].key);
+		else if(temp_memory_evictions[i].asset_class == MemoryBudgetManager::AssetClass_PhysicsShape)
+			mesh_manager.removeEvictedPhysicsShape(temp_memory_evictions[i].key);
+		else if(temp_memory_evictions[i].asset_class == MemoryBudgetManager::AssetClass_Audio)
+			audio_engine.removeSoundFileIfUnused(temp_memory_evictions[i].key); // Sound files are only evicted when not in use, so this won't be refused.  If it were, the sound file is added back above next frame.
+	}
 
 
 	{
@@ -4231,50 +4573,7 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 		const float dist_from_item = item.getDistanceToCamera(cam_controller.getPosition().toVec4fPoint());
 		if(dist_from_item > item.task_max_dist)
 		{
-			if(dynamic_cast<const LoadTextureTask*>(item.task.ptr()))
-			{
-				const LoadTextureTask* task = static_cast<const LoadTextureTask*>(item.task.ptr());
-				assert(textures_processing.count(task->path) > 0);
-				textures_processing.erase(task->path);
-
-				//conPrint("Discarding texture load task '" + task->path + "' as too far away. (dist_from_item: " + doubleToStringNSigFigs(dist_from_item, 4) + ", task max dist: " + doubleToStringNSigFigs(item.task_max_dist, 3) + ")");
-			}
-			else if(dynamic_cast<const MakeHypercardTextureTask*>(item.task.ptr()))
-			{
-				const MakeHypercardTextureTask* task = static_cast<const MakeHypercardTextureTask*>(item.task.ptr());
-				assert(textures_processing.count(task->tex_key) > 0);
-				textures_processing.erase(task->tex_key);
-
-				//conPrint("Discarding MakeHypercardTextureTask '" + task->tex_key + "' as too far away. (dist_from_item: " + doubleToStringNSigFigs(dist_from_item, 4) + ", task max dist: " + doubleToStringNSigFigs(item.task_max_dist, 3) + ")");
-			}
-			else if(dynamic_cast<const LoadModelTask*>(item.task.ptr()))
-			{
-				const LoadModelTask* task = static_cast<const LoadModelTask*>(item.task.ptr());
-				if(!task->lod_model_url.empty()) // Will be empty for voxel models
-				{
-					ModelProcessingKey key(task->lod_model_url, task->build_dynamic_physics_ob);
-					//assert(models_processing.count(key) > 0);
-					models_processing.erase(key);
-				}
-				
-				//conPrint("Discarding model load task '" + task->lod_model_url + "' as too far away. (dist_from_item: " + doubleToStringNSigFigs(dist_from_item, 4) + ", task max dist: " + doubleToStringNSigFigs(item.task_max_dist, 3) + ")");
-			}
-			else if(dynamic_cast<const LoadScriptTask*>(item.task.ptr()))
-			{
-				const LoadScriptTask* task = static_cast<const LoadScriptTask*>(item.task.ptr());
-				assert(script_content_processing.count(task->script_content) > 0);
-				script_content_processing.erase(task->script_content);
-				
-				//conPrint("Discarding LoadScriptTask as too far away. (dist_from_item: " + doubleToStringNSigFigs(dist_from_item, 4) + ", task max dist: " + doubleToStringNSigFigs(item.task_max_dist, 3) + ")");
-			}
-			else if(dynamic_cast<const LoadAudioTask*>(item.task.ptr()))
-			{
-				const LoadAudioTask* task = static_cast<const LoadAudioTask*>(item.task.ptr());
-				assert(audio_processing.count(task->audio_source_url) > 0);
-				audio_processing.erase(task->audio_source_url);
-				
-				//conPrint("Discarding LoadAudioTask '" + task->audio_source_url + "' as too far away. (dist_from_item: " + doubleToStringNSigFigs(dist_from_item, 4) + ", task max dist: " + doubleToStringNSigFigs(item.task_max_dist, 3) + ")");
-			}
+			removeDiscardedLoadTaskFromProcessingSets(item.task);
 		}
 		else
 		{
@@ -4283,18 +4582,22 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 	}
 
 
-	// Sort load_item_queue every now and then
+	// Update load_item_queue priorities every now and then.  This also discards items that are now too far away to be worth loading.
 	if(load_item_queue_sort_timer.elapsed() > 0.1)
 	{
-		this->load_item_queue.sortQueue(cam_controller.getPosition());
+		temp_discarded_load_items.clear();
+		this->load_item_queue.updatePriorities(cam_controller.getPosition(), cam_controller.getForwardsVec(), /*predicted_campos=*/proximity_loader.getPrefetchPos(), temp_discarded_load_items);
+		for(size_t i=0; i<temp_discarded_load_items.size(); ++i)
+			removeDiscardedLoadTaskFromProcessingSets(temp_discarded_load_items[i].task);
+		temp_discarded_load_items.clear(); // Release task references
 		load_item_queue_sort_timer.reset();
 	}
 
 
-	// Sort download queue every now and then
-	if(download_queue_sort_timer.elapsed() > 2.0)
+	// Update download queue priorities every now and then
+	if(download_queue_sort_timer.elapsed() > 0.5)
 	{
-		this->download_queue.sortQueue(cam_controller.getPosition());
+		this->download_queue.updatePriorities(cam_controller.getPosition(), cam_controller.getForwardsVec(), /*predicted_campos=*/proximity_loader.getPrefetchPos());
 		download_queue_sort_timer.reset();
 	}
 
@@ -4958,7 +5261,7 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 			audio_engine.playOneShotSound(resources_dir_path + "/sounds/jump" + toString(rnd_src_i) + ".wav", jump_sound_pos);
 		}
 	}
-	proximity_loader.updateCamPos(campos);
+	proximity_loader.updateCamPos(campos, cur_time);
 
 	
 
@@ -5166,6 +5469,8 @@ void GUIClient::timerEvent(const MouseCursorState& mouse_cursor_state)
 
 						removeAndDeleteGLAndPhysicsObjectsForOb(*ob);
 
+						texture_load_coordinator->removeRequester(ob);
+
 						//proximity_loader.removeObject(ob);
 
 						// ui->indigoView->objectRemoved(*ob);
@@ -5812,6 +6117,8 @@ void GUIClient::updateAvatarGraphics(double cur_time, double dt, const Vec3d& ca
 					// Remove any OpenGL object for it
 					avatar->graphics.destroy(*opengl_engine);
 
+					texture_load_coordinator->removeRequester(avatar);
+
 					// Remove nametag OpenGL object
 					if(avatar->nametag_gl_ob.nonNull())
 						opengl_engine->removeObject(avatar->nametag_gl_ob);
@@ -6382,8 +6689,36 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 		}
 		else if(dynamic_cast<TextureLoadedThreadMessage*>(msg))
 		{
+			TextureLoadedThreadMessage* m = static_cast<TextureLoadedThreadMessage*>(msg);
+			if(m->job.nonNull())
+				texture_load_coordinator->jobFinished(m->job);
+
 			// Add to texture_loaded_messages_to_process to process later.
-			texture_loaded_messages_to_process.push_back(static_cast<TextureLoadedThreadMessage*>(msg));
+			texture_loaded_messages_to_process.push_back(m);
+		}
+		else if(dynamic_cast<TextureNotLoadedThreadMessage*>(msg))
+		{
+			const TextureNotLoadedThreadMessage* m = static_cast<TextureNotLoadedThreadMessage*>(msg);
+			const LoadTextureTask* task = m->task.ptr();
+
+			if(texture_load_coordinator->getJob(task->path) == task->job.ptr()) // If the job is still current (e.g. it hasn't been replaced after reconnecting):
+			{
+				if(m->cancelled && !task->job->isCancelled())
+				{
+					// The texture was requested again after the task saw that the job was cancelled, so start another task for it.
+					Reference<LoadTextureTask> new_task = new LoadTextureTask(task->opengl_engine, task->resource_manager, task->result_msg_queue, task->path, task->resource, task->tex_params, task->is_terrain_map);
+					new_task->job = task->job;
+					new_task->coordinator = task->coordinator;
+					model_and_texture_loader_task_manager.addTask(new_task);
+				}
+				else
+				{
+					texture_load_coordinator->jobFinished(task->job);
+
+					if(m->cancelled)
+						textures_processing.erase(task->path); // Allow the texture to be loaded again if it is requested later.
+				}
+			}
 		}
 		/*else if(dynamic_cast<BuildScatteringInfoDoneThreadMessage*>(msg))
 		{
@@ -7081,6 +7416,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 					Vec3d pos(0, 0, 0);
 					float size_factor = 1;
 					bool build_dynamic_physics_ob = false;
+					bool load_model = true;
 					// Look up in our map of downloading resources
 					auto res = URL_to_downloading_info.find(URL);
 					if(res != URL_to_downloading_info.end())
@@ -7093,7 +7429,22 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 					}
 					else
 					{
-						assert(0); // If we downloaded the resource we should have added it to URL_to_downloading_info.  NOTE: will this work with NewResourceOnServerMessage tho?
+						// We didn't start this download for an object, so this should be a model from a cell low LOD model bundle (see newCellInProximity()).
+						// Only load it now if an object is waiting for it, otherwise it will be loaded from disk when an object needs it.
+						load_model = false;
+						auto waiting_res = loading_model_URL_to_world_ob_UID_map.find(ModelProcessingKey(URL, /*dynamic=*/false));
+						if(waiting_res != loading_model_URL_to_world_ob_UID_map.end() && !waiting_res->second.empty())
+						{
+							Lock lock(this->world_state->mutex);
+							auto ob_res = this->world_state->objects.find(*waiting_res->second.begin());
+							if(ob_res != this->world_state->objects.end())
+							{
+								const WorldObject* ob = ob_res.getValue().ptr();
+								pos = ob->pos;
+								size_factor = LoadItemQueueItem::sizeFactorForAABBWS(ob->getAABBWSLongestLength(), COARSEST_LOD_MODEL_IMPORTANCE_FACTOR);
+								load_model = true;
+							}
+						}
 					}
 
 					const bool used_by_terrain = this->terrain_system.nonNull() && this->terrain_system->isTextureUsedByTerrain(local_path);
@@ -7111,8 +7462,10 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 							const bool just_added = checkAddTextureToProcessingSet(tex_path); // If not being loaded already:
 							if(just_added)
 							{
-								load_item_queue.enqueueItem(/*key=*/URL, pos.toVec4fPoint(), size_factor, 
-									new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, texture_params, used_by_terrain),
+								Reference<LoadTextureTask> task = new LoadTextureTask(opengl_engine, resource_manager, &this->msg_queue, tex_path, resource, texture_params, used_by_terrain);
+								task->job = texture_load_coordinator->createJob(tex_path, /*requester=*/NULL); // We don't know which objects want this texture, so don't allow the job to be cancelled.
+								task->coordinator = texture_load_coordinator;
+								load_item_queue.enqueueItem(/*key=*/URL, pos.toVec4fPoint(), size_factor, task,
 									/*max task dist=*/std::numeric_limits<float>::infinity()); // NOTE: inf dist is a bit of a hack.
 							}
 							else
@@ -7134,7 +7487,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 							}
 						}
 					}
-					else if(ModelLoading::hasSupportedModelExtension(local_path)) // Else we didn't download a texture, but maybe a model:
+					else if(ModelLoading::hasSupportedModelExtension(local_path) && load_model) // Else we didn't download a texture, but maybe a model:
 					{
 						try
 						{
@@ -7147,6 +7500,7 @@ void GUIClient::handleMessages(double global_time, double cur_time)
 							load_model_task->unit_cube_shape = this->unit_cube_shape;
 							load_model_task->result_msg_queue = &this->msg_queue;
 							load_model_task->resource_manager = resource_manager;
+							load_model_task->processed_mesh_cache = processed_mesh_cache;
 							load_model_task->build_dynamic_physics_ob = build_dynamic_physics_ob;
 
 							load_item_queue.enqueueItem(/*key=*/URL, pos.toVec4fPoint(), size_factor, load_model_task, 
@@ -7259,6 +7613,7 @@ std::string GUIClient::getDiagnosticsString(bool do_graphics_diagnostics, bool d
 	msg += "num obs with scripts: " + toString(obs_with_scripts.size()) + "\n";
 	msg += "last_num_scripts_processed: " + toString(last_num_scripts_processed) + "\n";
 	msg += "last_model_and_tex_loading_time: " + doubleToStringNSigFigs(this->last_model_and_tex_loading_time * 1000, 3) + " ms\n";
+	msg += main_thread_work_scheduler.getDiagnostics() + "\n";
 	msg += "load_item_queue: " + toString(load_item_queue.size()) + "\n";
 	msg += "model_and_texture_loader_task_manager unfinished tasks: " + toString(model_and_texture_loader_task_manager.getNumUnfinishedTasks()) + "\n";
 	msg += "model_loaded_messages_to_process: " + toString(model_loaded_messages_to_process.size()) + "\n";
@@ -7277,6 +7632,9 @@ std::string GUIClient::getDiagnosticsString(bool do_graphics_diagnostics, bool d
 
 	msg += this->mesh_manager.getDiagnostics();
 
+	msg += this->memory_budget_manager.getDiagnostics();
+	msg += this->texture_load_coordinator->getDiagnostics();
+
 	msg += "------------Resource Manager------------\n";
 	msg += resource_manager->getDiagnostics();
 	msg += "----------------------------------------\n";
@@ -9454,6 +9812,7 @@ void GUIClient::disconnectFromServerAndClearAllObjects() // Remove any WorldObje
 
 	this->client_avatar_uid = UID::invalidUID();
 	this->server_protocol_version = 0;
+	this->cells_with_low_lod_models_requested.clear();
 
 
 	this->logged_in_user_id = UserID::invalidUserID();
@@ -9564,6 +9923,8 @@ void GUIClient::disconnectFromServerAndClearAllObjects() // Remove any WorldObje
 
 	proximity_loader.clearAllObjects();
 
+	main_thread_work_scheduler.clearTasks();
+
 	cur_loading_voxel_ob = NULL;
 	cur_loading_mesh_data = NULL;
 
@@ -9594,6 +9955,7 @@ void GUIClient::disconnectFromServerAndClearAllObjects() // Remove any WorldObje
 
 	// Clear textures_processing set etc.
 	textures_processing.clear();
+	texture_load_coordinator->clear();
 	models_processing.clear();
 	audio_processing.clear();
 	script_content_processing.clear();
@@ -9734,6 +10096,16 @@ void GUIClient::connectToServer(const URLParseResults& parse_res)
 		enqueueMessageToSend(*this->client_thread, scratch_packet);
 	}
 
+	// Request the coarsest LOD models for the cells in the initial volume.
+	{
+		const Vec4i begin = proximity_loader.ob_grid.bucketIndicesForPoint(initial_aabb.min_ + Vec4f(1, 1, 1, 0));
+		const Vec4i end   = proximity_loader.ob_grid.bucketIndicesForPoint(initial_aabb.max_ - Vec4f(1, 1, 1, 0)); // inclusive
+		for(int z = begin[2]; z <= end[2]; ++z)
+		for(int y = begin[1]; y <= end[1]; ++y)
+		for(int x = begin[0]; x <= end[0]; ++x)
+			requestCellLowLODModels(Vec3<int>(x, y, z));
+	}
+
 	updateGroundPlane();
 
 	// Init indigoView
@@ -20,6 +20,10 @@ Copyright Glare Technologies Limited 2024 -
 #include "MiniMap.h"
 #include "DownloadingResourceQueue.h"
 #include "LoadItemQueue.h"
+#include "ProcessedMeshCache.h"
+#include "MemoryBudgetManager.h"
+#include "TextureLoadCoordinator.h"
+#include "MainThreadWorkScheduler.h"
 #include "MeshManager.h"
 #include "URLParser.h"
 #include "WorldState.h"
@@ -182,6 +186,11 @@ public:
 public:
 	void loadModelForObject(WorldObject* ob);
 	void loadPresentObjectGraphicsAndPhysicsModels(WorldObject* ob, const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data, int ob_lod_level, int ob_model_lod_level);
+	static bool shouldUseCoarsestLODModelAsStandIn(const WorldObject* ob, int ob_model_lod_level);
+	bool loadCoarsestLODModelForObjectWhileRefining(WorldObject* ob, int ob_lod_level, int ob_model_lod_level, float max_task_dist);
+	void loadPresentCoarsestLODModelForObject(WorldObject* ob, const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data, int ob_lod_level);
+	void assignLoadedModelToWaitingObject(const UID& waiting_uid, int loaded_model_lod_level, bool dynamic_physics_shape, 
+		const Reference<MeshData>& mesh_data, const Reference<PhysicsShapeData>& physics_shape_data) REQUIRES(world_state->mutex);
 	void loadPresentAvatarModel(Avatar* avatar, int av_lod_level, const Reference<MeshData>& mesh_data);
 	void loadModelForAvatar(Avatar* avatar);
 	void loadScriptForObject(WorldObject* ob);
@@ -239,14 +248,16 @@ public:
 	bool checkAddAudioToProcessingSet(const std::string& url); // returns true if was not in processed set (and hence this call added it), false if it was.
 	bool checkAddScriptToProcessingSet(const std::string& script_content); // returns true if was not in processed set (and hence this call added it), false if it was.
 
+	// requester is the object or avatar that wants the texture, used for cancelling texture loads when all requesters are unloaded.  May be NULL if the requester is not tracked.
 	void startLoadingTextureIfPresent(const std::string& tex_url, const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_task_dist, float importance_factor, 
-		const TextureParams& tex_params);
+		const TextureParams& tex_params, const void* requester);
 	void startLoadingTextureForLocalPath(const std::string& local_abs_tex_path, const Reference<Resource>& resource, const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_task_dist, float importance_factor, 
-		const TextureParams& tex_params);
+		const TextureParams& tex_params, const void* requester);
 	void startLoadingTextureForObject(const Vec4f& centroid_ws, float aabb_ws_longest_len, float max_dist_for_ob_lod_level, float max_dist_for_ob_lod_level_clamped_0, float importance_factor, const WorldMaterial& world_mat, 
-		int ob_lod_level, const std::string& texture_url, bool tex_has_alpha, bool use_sRGB, bool allow_compression);
+		int ob_lod_level, const std::string& texture_url, bool tex_has_alpha, bool use_sRGB, bool allow_compression, const void* requester);
 	void startLoadingTexturesForObject(const WorldObject& ob, int ob_lod_level, float max_dist_for_ob_lod_level, float max_dist_for_ob_lod_level_clamped_0);
 	void startLoadingTexturesForAvatar(const Avatar& ob, int ob_lod_level, float max_dist_for_ob_lod_level, bool our_avatar);
+	void removeDiscardedLoadTaskFromProcessingSets(const glare::TaskRef& task);
 	void removeAndDeleteGLObjectsForOb(WorldObject& ob);
 	void removeAndDeleteGLAndPhysicsObjectsForOb(WorldObject& ob);
 	void removeAndDeleteGLObjectForAvatar(Avatar& ob);
@@ -256,6 +267,7 @@ public:
 	//virtual void loadObject(WorldObjectRef ob);
 	virtual void unloadObject(WorldObjectRef ob);
 	virtual void newCellInProximity(const Vec3<int>& cell_coords);
+	void requestCellLowLODModels(const Vec3<int>& cell_coords);
 
 	void tryToMoveObject(WorldObjectRef ob, /*const Matrix4f& tentative_new_to_world*/const Vec4f& desired_new_ob_pos);
 	void doMoveObject(WorldObjectRef ob, const Vec3d& new_ob_pos, const js::AABBox& aabb_os) REQUIRES(world_state->mutex);
@@ -371,6 +383,8 @@ public:
 
 	Reference<ResourceManager> resource_manager;
 
+	Reference<ProcessedMeshCache> processed_mesh_cache; // May be NULL.
+
 
 	// NOTE: these object sets need to be cleared in connectToServer(), also when removing a dead object in ob->state == WorldObject::State_Dead case in timerEvent, the object needs to be removed
 	// from any of these sets it is in.
@@ -439,7 +453,9 @@ public:
 
 	glare::TaskManager* high_priority_task_manager;
 
+	MemoryBudgetManager memory_budget_manager; // Declared before mesh_manager, as mesh_manager references it.
 	MeshManager mesh_manager;
+	std::vector<MemoryBudgetEviction> temp_memory_evictions;
 
 	std::string server_hostname; // e.g. "substrata.info" or "localhost"
 	std::string server_worldname; // e.g. "" or "ono-sendai"
@@ -462,6 +478,8 @@ public:
 	// We have this set so that we don't process the same texture from multiple LoadTextureTasks running in parallel.
 	std::unordered_set<std::string> textures_processing;
 
+	Reference<TextureLoadCoordinator> texture_load_coordinator; // Tracks in-flight LoadTextureTasks and who requested them, and caches recently decoded textures.
+
 	// We build a different physics mesh for dynamic objects, so we need to keep track of which mesh we are building.
 	struct ModelProcessingKey
 	{
@@ -520,6 +538,7 @@ public:
 
 	double last_animated_tex_time;
 	double last_model_and_tex_loading_time;
+	MainThreadWorkScheduler main_thread_work_scheduler; // Limits the time spent finalising loaded models and textures each frame in processLoading().
 	double last_eval_script_time;
 	int last_num_gif_textures_processed;
 	int last_num_mp4_textures_processed;
@@ -548,6 +567,7 @@ public:
 	Timer load_item_queue_sort_timer;
 
 	LoadItemQueue load_item_queue;
+	std::vector<LoadItemQueueItem> temp_discarded_load_items;
 
 	SocketBufferOutStream scratch_packet;
 
@@ -584,6 +604,7 @@ public:
 
 	UID client_avatar_uid; // When we connect to a server, the server assigns a UID to the client/avatar.
 	uint32 server_protocol_version;
+	std::set<Vec3<int>> cells_with_low_lod_models_requested; // Cells we have asked the server for the coarsest LOD models of, in this connection.
 
 	uint64 frame_num;
 
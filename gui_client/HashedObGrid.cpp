@@ -0,0 +1,539 @@
+/*=====================================================================
+HashedObGrid.cpp
+----------------
+Copyright Glare Technologies Limited 2021 -
+=====================================================================*/
+#include "HashedObGrid.h"
+
+
+#include <utils/BitUtils.h>
+#include <algorithm>
+
+
+HashedObGrid::HashedObGrid(float cell_w_, int expected_num_items)
+:	cell_w(cell_w_),
+	recip_cell_w(1 / cell_w_),
+	num_items(0)
+{
+	assert(expected_num_items > 0);
+
+	const uint32 num_hashed_buckets = myMax<uint32>(8, (uint32)Maths::roundToNextHighestPowerOf2((unsigned int)expected_num_items));
+	buckets.resize(num_hashed_buckets + 1);
+
+	hash_mask = num_hashed_buckets - 1;
+	large_items_bucket = num_hashed_buckets;
+}
+
+
+void HashedObGrid::clear()
+{
+	for(size_t i=0; i<buckets.size(); ++i)
+	{
+		buckets[i].aabb_data.clear();
+		buckets[i].items.clear();
+	}
+	item_locations.clear();
+	num_items = 0;
+}
+
+
+static inline void setSlotAABB(HashedObGridBucket& bucket, size_t slot, const js::AABBox& aabb)
+{
+	float* block = bucket.blockData(slot / 4);
+	const size_t lane = slot % 4;
+	block[lane +  0] = aabb.min_[0];
+	block[lane +  4] = aabb.min_[1];
+	block[lane +  8] = aabb.min_[2];
+	block[lane + 12] = aabb.max_[0];
+	block[lane + 16] = aabb.max_[1];
+	block[lane + 20] = aabb.max_[2];
+}
+
+
+uint32 HashedObGrid::bucketIndexForAABB(const js::AABBox& aabb) const
+{
+	const Vec4f extent = aabb.max_ - aabb.min_;
+	if(extent[0] > cell_w || extent[1] > cell_w || extent[2] > cell_w)
+		return large_items_bucket;
+
+	return getBucketIndexForPoint((aabb.min_ + aabb.max_) * 0.5f);
+}
+
+
+void HashedObGrid::addToBucket(uint32 bucket_i, uint32 item, const js::AABBox& aabb)
+{
+	HashedObGridBucket& bucket = buckets[bucket_i];
+
+	const size_t slot = bucket.items.size();
+	if(slot % 4 == 0) // If we need a new block:
+		bucket.aabb_data.resize(bucket.aabb_data.size() + HashedObGridBucket::FLOATS_PER_BLOCK);
+
+	bucket.items.push_back(item);
+	setSlotAABB(bucket, slot, aabb);
+
+	item_locations[item].bucket = bucket_i;
+	item_locations[item].slot = (uint32)slot;
+}
+
+
+void HashedObGrid::removeFromBucket(uint32 bucket_i, uint32 slot)
+{
+	HashedObGridBucket& bucket = buckets[bucket_i];
+
+	assert(bucket.items.size() > 0);
+	const size_t last = bucket.items.size() - 1;
+	if(slot != last)
+	{
+		// Move the last item in the bucket into the removed item's slot.
+		const uint32 moved_item = bucket.items[last];
+		bucket.items[slot] = moved_item;
+
+		const float* src_block = bucket.blockData(last / 4);
+		float* dest_block = bucket.blockData(slot / 4);
+		for(size_t c=0; c<6; ++c)
+			dest_block[c * 4 + slot % 4] = src_block[c * 4 + last % 4];
+
+		item_locations[moved_item].slot = slot;
+	}
+
+	bucket.items.resize(last);
+	if(last % 4 == 0) // If the last block is now unused:
+		bucket.aabb_data.resize(last / 4 * HashedObGridBucket::FLOATS_PER_BLOCK);
+}
+
+
+void HashedObGrid::insert(uint32 item, const js::AABBox& aabb)
+{
+	if(item >= item_locations.size())
+	{
+		ItemLocation invalid_loc;
+		invalid_loc.bucket = INVALID_BUCKET;
+		invalid_loc.slot = 0;
+		item_locations.resize(myMax<size_t>((size_t)item + 1, item_locations.size() * 2), invalid_loc);
+	}
+
+	const uint32 new_bucket_i = bucketIndexForAABB(aabb);
+	const ItemLocation loc = item_locations[item];
+	if(loc.bucket == new_bucket_i)
+	{
+		// Item is staying in the same bucket, just update the AABB.
+		setSlotAABB(buckets[new_bucket_i], loc.slot, aabb);
+		return;
+	}
+
+	if(loc.bucket == INVALID_BUCKET)
+		num_items++;
+	else
+		removeFromBucket(loc.bucket, loc.slot);
+
+	addToBucket(new_bucket_i, item, aabb);
+}
+
+
+void HashedObGrid::remove(uint32 item)
+{
+	if(!contains(item))
+		return;
+
+	removeFromBucket(item_locations[item].bucket, item_locations[item].slot);
+	item_locations[item].bucket = INVALID_BUCKET;
+	num_items--;
+}
+
+
+struct HashedObGridQuery
+{
+	__m128 min_x, min_y, min_z, max_x, max_y, max_z;
+};
+
+
+// Tests the AABBs in the bucket against the query AABB, 4 at a time, and appends the intersecting items to items_out.
+static inline void queryBucket(const HashedObGridBucket& bucket, const HashedObGridQuery& q, std::vector<uint32>& items_out)
+{
+	const size_t n = bucket.items.size();
+	for(size_t i=0; i<n; i += 4)
+	{
+		const float* block = bucket.blockData(i / 4);
+
+		const __m128 hit = _mm_and_ps(
+			_mm_and_ps(
+				_mm_and_ps(_mm_cmple_ps(_mm_load_ps(block +  0), q.max_x), _mm_cmple_ps(_mm_load_ps(block +  4), q.max_y)),
+				_mm_and_ps(_mm_cmple_ps(_mm_load_ps(block +  8), q.max_z), _mm_cmpge_ps(_mm_load_ps(block + 12), q.min_x))
+			),
+			_mm_and_ps(_mm_cmpge_ps(_mm_load_ps(block + 16), q.min_y), _mm_cmpge_ps(_mm_load_ps(block + 20), q.min_z))
+		);
+
+		uint32 mask = (uint32)_mm_movemask_ps(hit);
+		if(n - i < 4)
+			mask &= (1u << (n - i)) - 1; // Ignore unused slots in the last block.
+
+		while(mask != 0)
+		{
+			items_out.push_back(bucket.items[i + BitUtils::lowestSetBitIndex(mask)]);
+			mask &= mask - 1; // Clear lowest set bit
+		}
+	}
+}
+
+
+void HashedObGrid::queryAABB(const js::AABBox& aabb, std::vector<uint32>& items_out) const
+{
+	HashedObGridQuery q;
+	q.min_x = _mm_set1_ps(aabb.min_[0]);
+	q.min_y = _mm_set1_ps(aabb.min_[1]);
+	q.min_z = _mm_set1_ps(aabb.min_[2]);
+	q.max_x = _mm_set1_ps(aabb.max_[0]);
+	q.max_y = _mm_set1_ps(aabb.max_[1]);
+	q.max_z = _mm_set1_ps(aabb.max_[2]);
+
+	// Items in the hashed buckets are no wider than a cell, so the centre of an intersecting item is within the query AABB expanded by half a cell width.
+	const float half_cell_w = cell_w * 0.5f;
+	const Vec4f expanded_min = aabb.min_ - Vec4f(half_cell_w, half_cell_w, half_cell_w, 0);
+	const Vec4f expanded_max = aabb.max_ + Vec4f(half_cell_w, half_cell_w, half_cell_w, 0);
+
+	const uint32 num_hashed_buckets = hash_mask + 1;
+	const Vec4f num_cells_per_axis = (expanded_max - expanded_min) * recip_cell_w + Vec4f(1, 1, 1, 0);
+	if(num_cells_per_axis[0] * num_cells_per_axis[1] * num_cells_per_axis[2] >= (float)num_hashed_buckets)
+	{
+		// The query covers at least as many cells as there are buckets, so just test all buckets.
+		for(uint32 i=0; i<num_hashed_buckets; ++i)
+			queryBucket(buckets[i], q, items_out);
+	}
+	else
+	{
+		const Vec4i begin = bucketIndicesForPoint(expanded_min);
+		const Vec4i end   = bucketIndicesForPoint(expanded_max); // inclusive
+
+		// Different cells may hash to the same bucket, so remove duplicate bucket indices, so we don't return items more than once.
+		temp_bucket_indices.resize(0);
+		for(int z = begin[2]; z <= end[2]; ++z)
+		for(int y = begin[1]; y <= end[1]; ++y)
+		for(int x = begin[0]; x <= end[0]; ++x)
+			temp_bucket_indices.push_back(computeHash(x, y, z));
+
+		std::sort(temp_bucket_indices.begin(), temp_bucket_indices.end());
+		const auto unique_end = std::unique(temp_bucket_indices.begin(), temp_bucket_indices.end());
+
+		for(auto it = temp_bucket_indices.begin(); it != unique_end; ++it)
+			queryBucket(buckets[*it], q, items_out);
+	}
+
+	queryBucket(buckets[large_items_bucket], q, items_out);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/StringUtils.h>
+#include <utils/Timer.h>
+#include <maths/PCG32.h>
+#include <unordered_set>
+#include <memory>
+
+
+static js::AABBox randomAABB(PCG32& rng, const Vec4f& world_min, const Vec4f& world_max, float max_size)
+{
+	const Vec4f centre(
+		world_min[0] + rng.unitRandom() * (world_max[0] - world_min[0]),
+		world_min[1] + rng.unitRandom() * (world_max[1] - world_min[1]),
+		world_min[2] + rng.unitRandom() * (world_max[2] - world_min[2]),
+		1);
+	const Vec4f half_size(rng.unitRandom() * max_size * 0.5f, rng.unitRandom() * max_size * 0.5f, rng.unitRandom() * max_size * 0.5f, 0);
+	return js::AABBox(centre - half_size, centre + half_size);
+}
+
+
+static bool aabbsIntersect(const js::AABBox& a, const js::AABBox& b)
+{
+	return
+		a.min_[0] <= b.max_[0] && a.min_[1] <= b.max_[1] && a.min_[2] <= b.max_[2] &&
+		a.max_[0] >= b.min_[0] && a.max_[1] >= b.min_[1] && a.max_[2] >= b.min_[2];
+}
+
+
+// Checks that a query returns the same items as testing all present items, with no duplicates.
+static void checkQuery(const HashedObGrid& grid, const std::vector<js::AABBox>& aabbs, const std::vector<bool>& present, const js::AABBox& query_aabb)
+{
+	std::vector<uint32> results;
+	grid.queryAABB(query_aabb, results);
+	std::sort(results.begin(), results.end());
+	testAssert(std::unique(results.begin(), results.end()) == results.end());
+
+	std::vector<uint32> ref_results;
+	for(size_t i=0; i<aabbs.size(); ++i)
+		if(present[i] && aabbsIntersect(aabbs[i], query_aabb))
+			ref_results.push_back((uint32)i);
+
+	testAssert(results == ref_results);
+}
+
+
+struct BenchOb
+{
+	js::AABBox aabb;
+};
+
+
+// The previous HashedObGrid implementation (a std::unordered_set of object pointers per bucket, bucketed by AABB centre), for benchmarking.
+class UnorderedSetObGrid
+{
+public:
+	UnorderedSetObGrid(float cell_w_, int num_buckets) : cell_w(cell_w_), recip_cell_w(1 / cell_w_), buckets(num_buckets), hash_mask(num_buckets - 1) {}
+
+	unsigned int bucketForPoint(const Vec4f& p) const
+	{
+		const Vec4i p_i = floorToVec4i(p * recip_cell_w);
+		return (((uint32)p_i[0] * 73856093u) ^ ((uint32)p_i[1] * 19349663u) ^ ((uint32)p_i[2] * 83492791u)) & hash_mask;
+	}
+
+	void insert(BenchOb* ob) { buckets[bucketForPoint((ob->aabb.min_ + ob->aabb.max_) * 0.5f)].insert(ob); }
+	void remove(BenchOb* ob) { buckets[bucketForPoint((ob->aabb.min_ + ob->aabb.max_) * 0.5f)].erase(ob); }
+
+	void queryAABB(const js::AABBox& aabb, float max_ob_half_w, std::vector<BenchOb*>& obs_out) const
+	{
+		const Vec4i begin = floorToVec4i((aabb.min_ - Vec4f(max_ob_half_w, max_ob_half_w, max_ob_half_w, 0)) * recip_cell_w);
+		const Vec4i end   = floorToVec4i((aabb.max_ + Vec4f(max_ob_half_w, max_ob_half_w, max_ob_half_w, 0)) * recip_cell_w);
+		for(int z = begin[2]; z <= end[2]; ++z)
+		for(int y = begin[1]; y <= end[1]; ++y)
+		for(int x = begin[0]; x <= end[0]; ++x)
+		{
+			const std::unordered_set<BenchOb*>& bucket = buckets[(((uint32)x * 73856093u) ^ ((uint32)y * 19349663u) ^ ((uint32)z * 83492791u)) & hash_mask];
+			for(auto it = bucket.begin(); it != bucket.end(); ++it)
+				if(aabbsIntersect((*it)->aabb, aabb))
+					obs_out.push_back(*it);
+		}
+	}
+
+	float cell_w, recip_cell_w;
+	std::vector<std::unordered_set<BenchOb*>> buckets;
+	uint32 hash_mask;
+};
+
+
+// Simulates a dense world: each frame some objects move a little, and we do a bunch of small AABB queries (e.g. for audio occlusion candidates).
+static void benchmarkHashedObGrid()
+{
+	const int N = 100000;
+	const float CELL_W = 20.f;
+	const float MAX_OB_SIZE = 10.f;
+	const int NUM_FRAMES = 20;
+	const int NUM_MOVES_PER_FRAME = 2000;
+	const int NUM_QUERIES_PER_FRAME = 500;
+	const float QUERY_W = 60.f;
+	const Vec4f world_min(-500, -500, 0, 1);
+	const Vec4f world_max(500, 500, 50, 1);
+
+	PCG32 rng(1);
+	std::vector<js::AABBox> initial_aabbs(N);
+	for(int i=0; i<N; ++i)
+		initial_aabbs[i] = randomAABB(rng, world_min, world_max, MAX_OB_SIZE);
+
+	// Generate moves and queries up front so both grids do the same work.
+	std::vector<uint32> move_items(NUM_FRAMES * NUM_MOVES_PER_FRAME);
+	std::vector<Vec4f> move_offsets(NUM_FRAMES * NUM_MOVES_PER_FRAME);
+	for(size_t i=0; i<move_items.size(); ++i)
+	{
+		move_items[i] = (uint32)(rng.unitRandom() * N) % N;
+		move_offsets[i] = Vec4f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, 0, 0) * 4.f;
+	}
+	std::vector<js::AABBox> queries(NUM_FRAMES * NUM_QUERIES_PER_FRAME);
+	for(size_t i=0; i<queries.size(); ++i)
+	{
+		const js::AABBox centre_box = randomAABB(rng, world_min, world_max, 0);
+		queries[i] = js::AABBox(centre_box.min_ - Vec4f(QUERY_W / 2, QUERY_W / 2, QUERY_W / 2, 0), centre_box.min_ + Vec4f(QUERY_W / 2, QUERY_W / 2, QUERY_W / 2, 0));
+	}
+
+	size_t new_num_results = 0;
+	double new_move_time = 0, new_query_time = 0;
+	{
+		HashedObGrid grid(CELL_W, N);
+		std::vector<js::AABBox> aabbs = initial_aabbs;
+		for(int i=0; i<N; ++i)
+			grid.insert(i, aabbs[i]);
+
+		std::vector<uint32> results;
+		for(int f=0; f<NUM_FRAMES; ++f)
+		{
+			Timer timer;
+			for(int i=f * NUM_MOVES_PER_FRAME; i<(f + 1) * NUM_MOVES_PER_FRAME; ++i)
+			{
+				js::AABBox& aabb = aabbs[move_items[i]];
+				aabb = js::AABBox(aabb.min_ + move_offsets[i], aabb.max_ + move_offsets[i]);
+				grid.insert(move_items[i], aabb);
+			}
+			new_move_time += timer.elapsed();
+
+			timer.reset();
+			for(int i=f * NUM_QUERIES_PER_FRAME; i<(f + 1) * NUM_QUERIES_PER_FRAME; ++i)
+			{
+				results.resize(0);
+				grid.queryAABB(queries[i], results);
+				new_num_results += results.size();
+			}
+			new_query_time += timer.elapsed();
+		}
+	}
+
+	size_t old_num_results = 0;
+	double old_move_time = 0, old_query_time = 0;
+	{
+		UnorderedSetObGrid grid(CELL_W, (int)Maths::roundToNextHighestPowerOf2((unsigned int)N));
+		std::vector<std::unique_ptr<BenchOb>> obs(N);
+		for(int i=0; i<N; ++i)
+		{
+			obs[i].reset(new BenchOb());
+			obs[i]->aabb = initial_aabbs[i];
+			grid.insert(obs[i].get());
+		}
+
+		std::vector<BenchOb*> results;
+		for(int f=0; f<NUM_FRAMES; ++f)
+		{
+			Timer timer;
+			for(int i=f * NUM_MOVES_PER_FRAME; i<(f + 1) * NUM_MOVES_PER_FRAME; ++i)
+			{
+				BenchOb* ob = obs[move_items[i]].get();
+				grid.remove(ob);
+				ob->aabb = js::AABBox(ob->aabb.min_ + move_offsets[i], ob->aabb.max_ + move_offsets[i]);
+				grid.insert(ob);
+			}
+			old_move_time += timer.elapsed();
+
+			timer.reset();
+			for(int i=f * NUM_QUERIES_PER_FRAME; i<(f + 1) * NUM_QUERIES_PER_FRAME; ++i)
+			{
+				results.resize(0);
+				grid.queryAABB(queries[i], /*max_ob_half_w=*/MAX_OB_SIZE / 2, results);
+				old_num_results += results.size();
+			}
+			old_query_time += timer.elapsed();
+		}
+	}
+
+	conPrint("HashedObGrid benchmark (" + toString(N) + " objects, " + toString(NUM_MOVES_PER_FRAME) + " moves and " + toString(NUM_QUERIES_PER_FRAME) + " queries per frame):");
+	conPrint("    unordered_set grid: moves: " + doubleToStringNSigFigs(old_move_time / NUM_FRAMES * 1.0e3, 4) + " ms/frame, queries: " + doubleToStringNSigFigs(old_query_time / NUM_FRAMES * 1.0e3, 4) + " ms/frame (" + toString(old_num_results) + " results)");
+	conPrint("    HashedObGrid:       moves: " + doubleToStringNSigFigs(new_move_time / NUM_FRAMES * 1.0e3, 4) + " ms/frame, queries: " + doubleToStringNSigFigs(new_query_time / NUM_FRAMES * 1.0e3, 4) + " ms/frame (" + toString(new_num_results) + " results)");
+}
+
+
+void HashedObGrid::test()
+{
+	conPrint("HashedObGrid::test()");
+
+	//-------------------- Test basic insert, remove and query --------------------
+	{
+		HashedObGrid grid(/*cell_w=*/10.f, /*expected_num_items=*/16);
+		testAssert(grid.size() == 0);
+		testAssert(!grid.contains(0));
+
+		grid.insert(3, js::AABBox(Vec4f(1, 1, 1, 1), Vec4f(2, 2, 2, 1)));
+		grid.insert(7, js::AABBox(Vec4f(-5, -5, -5, 1), Vec4f(-4, -4, -4, 1)));
+		grid.insert(100, js::AABBox(Vec4f(-1000, -1000, -1000, 1), Vec4f(1000, 1000, 1000, 1))); // Large item
+		testAssert(grid.size() == 3);
+		testAssert(grid.contains(3) && grid.contains(7) && grid.contains(100));
+		testAssert(!grid.contains(4) && !grid.contains(1000));
+
+		std::vector<uint32> results;
+		grid.queryAABB(js::AABBox(Vec4f(0, 0, 0, 1), Vec4f(1, 1, 1, 1)), results); // Touching item 3
+		std::sort(results.begin(), results.end());
+		testAssert(results == std::vector<uint32>({3, 100}));
+
+		results.clear();
+		grid.queryAABB(js::AABBox(Vec4f(500, 500, 500, 1), Vec4f(501, 501, 501, 1)), results);
+		testAssert(results == std::vector<uint32>({100}));
+
+		// Moving within a cell
+		grid.insert(3, js::AABBox(Vec4f(3, 3, 3, 1), Vec4f(4, 4, 4, 1)));
+		testAssert(grid.size() == 3);
+		results.clear();
+		grid.queryAABB(js::AABBox(Vec4f(0, 0, 0, 1), Vec4f(1, 1, 1, 1)), results);
+		testAssert(results == std::vector<uint32>({100}));
+
+		// Moving to another cell
+		grid.insert(3, js::AABBox(Vec4f(-5, -5, -5, 1), Vec4f(-4, -4, -4, 1)));
+		results.clear();
+		grid.queryAABB(js::AABBox(Vec4f(-4.5f, -4.5f, -4.5f, 1), Vec4f(-4.5f, -4.5f, -4.5f, 1)), results);
+		std::sort(results.begin(), results.end());
+		testAssert(results == std::vector<uint32>({3, 7, 100}));
+
+		grid.remove(100);
+		grid.remove(100);
+		grid.remove(12345);
+		testAssert(grid.size() == 2);
+		testAssert(!grid.contains(100));
+
+		grid.clear();
+		testAssert(grid.size() == 0);
+		testAssert(!grid.contains(3));
+		results.clear();
+		grid.queryAABB(js::AABBox(Vec4f(-1.0e30f, -1.0e30f, -1.0e30f, 1), Vec4f(1.0e30f, 1.0e30f, 1.0e30f, 1)), results);
+		testAssert(results.empty());
+	}
+
+	//-------------------- Test random inserts, moves, removes and queries against brute force --------------------
+	{
+		PCG32 rng(1);
+		const int N = 2000;
+		const Vec4f world_min(-100, -100, -10, 1);
+		const Vec4f world_max(100, 100, 10, 1);
+		HashedObGrid grid(/*cell_w=*/8.f, /*expected_num_items=*/64); // Use few buckets so we get lots of hash collisions.
+		std::vector<js::AABBox> aabbs(N, js::AABBox(Vec4f(0, 0, 0, 1), Vec4f(0, 0, 0, 1)));
+		std::vector<bool> present(N, false);
+		size_t num_present = 0;
+
+		for(int i=0; i<20000; ++i)
+		{
+			const uint32 item = (uint32)(rng.unitRandom() * N) % N;
+			const float r = rng.unitRandom();
+			if(r < 0.6f)
+			{
+				// Insert or move.  Some items are larger than a cell.
+				const float max_size = (rng.unitRandom() < 0.05f) ? 30.f : 6.f;
+				if(present[item] && rng.unitRandom() < 0.5f)
+				{
+					const Vec4f offset(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, 0);
+					aabbs[item] = js::AABBox(aabbs[item].min_ + offset, aabbs[item].max_ + offset);
+				}
+				else
+					aabbs[item] = randomAABB(rng, world_min, world_max, max_size);
+
+				if(!present[item])
+					num_present++;
+				present[item] = true;
+				grid.insert(item, aabbs[item]);
+			}
+			else if(r < 0.8f)
+			{
+				if(present[item])
+					num_present--;
+				present[item] = false;
+				grid.remove(item);
+			}
+			else
+			{
+				const float query_w = (rng.unitRandom() < 0.1f) ? 300.f : 20.f;
+				checkQuery(grid, aabbs, present, randomAABB(rng, world_min, world_max, query_w));
+			}
+
+			testAssert(grid.size() == num_present);
+			testAssert(grid.contains(item) == present[item]);
+		}
+
+		// Query everything
+		checkQuery(grid, aabbs, present, js::AABBox(Vec4f(-1.0e30f, -1.0e30f, -1.0e30f, 1), Vec4f(1.0e30f, 1.0e30f, 1.0e30f, 1)));
+	}
+
+	// Performance test
+	if(false)
+	{
+		benchmarkHashedObGrid();
+	}
+
+	conPrint("HashedObGrid::test() done.");
+}
+
+
+#endif // BUILD_TESTS
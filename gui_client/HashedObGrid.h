@@ -6,119 +6,113 @@ Copyright Glare Technologies Limited 2021 -
 #pragma once
 
 
-#include "../shared/WorldObject.h"
-#include <unordered_set>
-
+#include <physics/jscol_aabbox.h>
+#include <maths/Vec4i.h>
+#include <maths/mathstypes.h>
+#include <utils/Vector.h>
+#include <vector>
 
 
+/*=====================================================================
+HashedObGridBucket
+------------------
+Items are stored in blocks of 4, with the AABB coordinates of each block in
+structure-of-arrays layout:
+	min_x[4], min_y[4], min_z[4], max_x[4], max_y[4], max_z[4]
+so that the AABBs of 4 items can be tested against a query AABB at once with SSE.
+Unused slots in the last block are ignored by queries.
+=====================================================================*/
 class HashedObGridBucket
 {
 public:
-	//SmallVector<WorldObjectRef, 2> objects;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> objects;
+	static const size_t FLOATS_PER_BLOCK = 24;
+
+	inline size_t size() const { return items.size(); }
+
+	inline float* blockData(size_t block_i) { return &aabb_data[block_i * FLOATS_PER_BLOCK]; }
+	inline const float* blockData(size_t block_i) const { return &aabb_data[block_i * FLOATS_PER_BLOCK]; }
+
+	js::Vector<float, 16> aabb_data; // Size is FLOATS_PER_BLOCK * ceil(items.size() / 4)
+	js::Vector<uint32, 16> items; // Item index for each slot.
 };
 
 
 /*=====================================================================
 HashedObGrid
 ------------
-TODO: Try using open addressing (don't use a vector in buckets, spill into adjacent buckets)
+Spatial hash grid of items with AABBs.  Items are identified by a uint32 index (e.g. an index into an object array),
+which should be reasonably dense, as we keep a location table indexed by item index.
+
+Items are placed in the bucket for the grid cell that contains the AABB centre.
+Items with an AABB wider than a cell are placed in a separate 'large items' bucket that is tested by every query.
+
+The per-bucket data is contiguous (see HashedObGridBucket), so queries don't need to touch the items themselves,
+and moving an item is either an in-place AABB update (if it stays in the same bucket) or a swap-remove and append.
 =====================================================================*/
 class HashedObGrid
 {
 public:
-	HashedObGrid(float cell_w_, int expected_num_items)
-	:	cell_w(cell_w_),
-		recip_cell_w(1 / cell_w_)
-	{
-		assert(expected_num_items > 0);
+	HashedObGrid(float cell_w, int expected_num_items);
 
-		const unsigned int num_buckets = myMax<unsigned int>(8, (unsigned int)Maths::roundToNextHighestPowerOf2((unsigned int)expected_num_items/* * 2*/));
-		buckets.resize(num_buckets);
+	void clear();
 
-		hash_mask = num_buckets - 1;
-	}
+	// Inserts item with the given AABB, or updates the AABB if the item is already inserted.
+	void insert(uint32 item, const js::AABBox& aabb);
 
-	inline void clear()
-	{
-		for(size_t i = 0; i < buckets.size(); ++i)
-			buckets[i].objects.clear();
-	}
+	// Does nothing if the item is not inserted.
+	void remove(uint32 item);
 
-	inline Vec4i bucketIndicesForPoint(const Vec4f& p) const
-	{
-		return floorToVec4i(p * recip_cell_w);
-	}
+	inline bool contains(uint32 item) const { return item < item_locations.size() && item_locations[item].bucket != INVALID_BUCKET; }
 
-	inline void insert(const WorldObjectRef& ob)
-	{
-		unsigned int bucket_i = getBucketIndexForPoint(ob->pos.toVec4fPoint());
-		//buckets[bucket_i].objects.push_back(ob);
-		buckets[bucket_i].objects.insert(ob);
-	}
+	inline size_t size() const { return num_items; }
 
-	inline void remove(const WorldObjectRef& ob)
-	{
-		unsigned int bucket_i = getBucketIndexForPoint(ob->pos.toVec4fPoint());
-		// Find item
-		/*for(size_t i=0; i<buckets[bucket_i].objects.size(); ++i)
-		{
-			if(buckets[bucket_i].objects[i] == ob)
-			{
-				buckets[bucket_i].objects.erase(buckets[bucket_i].objects.begin() + i);
-				return;
-			}
-		}*/
-		buckets[bucket_i].objects.erase(ob);
-	}
+	// Appends to items_out the items with AABBs that intersect aabb (touching counts as intersecting).  Each item is returned at most once.
+	// Not thread-safe, as it uses temp_bucket_indices.
+	void queryAABB(const js::AABBox& aabb, std::vector<uint32>& items_out) const;
 
-#if GUI_CLIENT
-	inline void removeAtLastPos(const WorldObjectRef& ob)
+	inline Vec4i bucketIndicesForPoint(const Vec4f& p) const
 	{
-		//unsigned int bucket_i = getBucketIndexForPoint(ob->last_pos.toVec4fPoint());
-		//buckets[bucket_i].objects.erase(ob);
+		return floorToVec4i(p * recip_cell_w);
 	}
-#endif
-
 
-	inline const HashedObGridBucket& getBucketForIndices(const Vec4i& p) const
+	inline unsigned int getBucketIndexForPoint(const Vec4f& p) const
 	{
-		return buckets[computeHash(p)];
+		return computeHash(bucketIndicesForPoint(p));
 	}
 
-	inline const HashedObGridBucket& getBucketForIndices(const int x, const int y, const int z) const
+	inline unsigned int computeHash(const Vec4i& p_i) const
 	{
-		return buckets[computeHash(x, y, z)];
+		return computeHash(p_i[0], p_i[1], p_i[2]);
 	}
 
-	inline unsigned int getBucketIndexForPoint(const Vec4f& p) const
+	inline unsigned int computeHash(int x, int y, int z) const
 	{
-		const Vec4i p_i = floorToVec4i(p * recip_cell_w); //truncateToVec4i((p - grid_aabb.min_) * recip_cell_w);
-
-		return computeHash(p_i);
+		// Do the multiplications with unsigned ints to avoid signed overflow.
+		return (((uint32)x * 73856093u) ^ ((uint32)y * 19349663u) ^ ((uint32)z * 83492791u)) & hash_mask;
 	}
 
+	static void test();
 
-	inline unsigned int computeHash(const Vec4i& p_i) const
-	{
-		// NOTE: technically possible undefined behaviour here (signed overflow)
+private:
+	static const uint32 INVALID_BUCKET = 0xFFFFFFFFu;
 
-		//unsigned int u[4];
-		//storeVec4i(p_i, u);
-
-		return ((p_i[0] * 73856093) ^ (p_i[1] * 19349663) ^ (p_i[2] * 83492791)) & hash_mask;
-	}
-
-	inline unsigned int computeHash(int x, int y, int z) const
+	struct ItemLocation
 	{
-		// NOTE: technically possible undefined behaviour here (signed overflow)
+		uint32 bucket; // Index into buckets, or INVALID_BUCKET if the item is not inserted.
+		uint32 slot; // Index of the item in the bucket.
+	};
 
-		return ((x * 73856093) ^ (y * 19349663) ^ (z * 83492791)) & hash_mask;
-	}
+	uint32 bucketIndexForAABB(const js::AABBox& aabb) const;
+	void addToBucket(uint32 bucket_i, uint32 item, const js::AABBox& aabb);
+	void removeFromBucket(uint32 bucket_i, uint32 slot);
 
-
-	float recip_cell_w;
 	float cell_w;
-	std::vector<HashedObGridBucket> buckets;
-	uint32 hash_mask; // hash_mask = buckets_size - 1;
+	float recip_cell_w;
+	std::vector<HashedObGridBucket> buckets; // Hashed cell buckets, then the large items bucket at index large_items_bucket.
+	uint32 hash_mask; // hash_mask = num hashed buckets - 1
+	uint32 large_items_bucket;
+	std::vector<ItemLocation> item_locations; // Indexed by item
+	size_t num_items;
+
+	mutable std::vector<uint32> temp_bucket_indices;
 };
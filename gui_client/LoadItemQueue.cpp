@@ -18,12 +18,16 @@ Copyright Glare Technologies Limited 2024 -
 
 
 LoadItemQueue::LoadItemQueue()
-:	begin_i(0)
+:	last_campos(0, 0, 0, 0),
+	last_camdir(0, 0, 0, 0),
+	last_predicted_campos(0, 0, 0, 0)
 {}
 
 
 LoadItemQueue::~LoadItemQueue()
-{}
+{
+	clear();
+}
 
 
 void LoadItemQueue::enqueueItem(const std::string& key, const WorldObject& ob, const glare::TaskRef& task, float task_max_dist)
@@ -59,9 +63,18 @@ void LoadItemQueue::enqueueItem(const std::string& key, const Vec4f& pos, float
 	item->task = task;
 	item->task_max_dist = task_max_dist;
 
-	items.push_back(item);
+	insertItem(item);
+}
+
+
+void LoadItemQueue::insertItem(LoadItemQueueItem* item)
+{
+	// Compute the priority with the last camera position, so the item is placed roughly correctly until the next updatePriorities() call.
+	item->priority = LoadItemQueueItem::computePriority(item->pos_info, last_campos, last_camdir, last_predicted_campos);
+
+	heap.push(item);
 
-	item_map.insert(std::make_pair(key, item));
+	item_map.insert(std::make_pair(item->key, item)); // NOTE: if there is already an item with this key, the map keeps pointing to the existing item.
 }
 
 
@@ -97,103 +110,117 @@ void LoadItemQueue::checkUpdateItemPosition(const std::string& key, const Vec4f&
 		new_pos_info.pos = Vec3f(pos);
 		new_pos_info.size_factor = size_factor;
 		existing_item->pos_info.push_back(new_pos_info);
+
+		// The priority is the min over positions, so the new position can only make the item more important.
+		const float new_pos_priority = computeLoadQueuePriority(pos, size_factor, last_campos, last_camdir, last_predicted_campos);
+		if(new_pos_priority < existing_item->priority)
+		{
+			existing_item->priority = new_pos_priority;
+			heap.priorityChanged(existing_item);
+		}
 	}
 }
 
 
 size_t LoadItemQueue::size() const
 {
-	return items.size() - begin_i;
+	return heap.size();
 }
 
 
 void LoadItemQueue::clear()
 {
-	for(size_t i = begin_i; i < items.size(); ++i)
-		delete items[i];
+	for(size_t i=0; i<heap.size(); ++i)
+		delete heap[i];
 
-	begin_i = 0;
-	items.clear();
+	heap.clear();
 	item_map.clear();
 }
 
 
-struct QueueItemDistComparator
+void LoadItemQueue::updatePriorities(const Vec3d& campos, const Vec3d& camdir, std::vector<LoadItemQueueItem>& discarded_items_out)
 {
-	bool operator () (const LoadItemQueueItem* a, const LoadItemQueueItem* b)
-	{
-		return a->priority < b->priority;
-	}
-};
+	updatePriorities(campos, camdir, /*predicted_campos=*/campos.toVec4fPoint(), discarded_items_out);
+}
 
 
-void LoadItemQueue::sortQueue(const Vec3d& campos_) // Sort queue
+void LoadItemQueue::updatePriorities(const Vec3d& campos_, const Vec3d& camdir_, const Vec4f& predicted_campos, std::vector<LoadItemQueueItem>& discarded_items_out)
 {
-	// Sort items into ascending order of priority: roughly distance from camera
-	
-	const Vec4f campos_zero_w((float)campos_.x, (float)campos_.y, (float)campos_.z, 0.f);
+	last_campos = Vec4f((float)campos_.x, (float)campos_.y, (float)campos_.z, 0.f);
+	last_camdir = Vec4f((float)camdir_.x, (float)camdir_.y, (float)camdir_.z, 0.f);
+	last_predicted_campos = maskWToZero(predicted_campos);
+	const bool have_prediction = last_predicted_campos.getDist2(last_campos) > 0;
 
 	Timer timer;
 
-	// Do pass over queue items to compute priority, store and use that for sorting.
-	const size_t items_size = items.size();
-	for(size_t i = begin_i; i < items_size; ++i)
+	for(size_t i=0; i<heap.size(); )
 	{
-		SmallVector<LoadItemQueuePosInfo, 4>& pos_info = items[i]->pos_info;
-		assert(pos_info.size() >= 1);
-		float smallest_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[0].pos.x))) * pos_info[0].size_factor;
-		for(size_t z=1; z<pos_info.size(); ++z)
+		LoadItemQueueItem* item = heap[i];
+
+		// Discard the item if it is now too far from the camera, instead of waiting until it gets to the front of the queue.
+		if((item->getDistanceToCamera(last_campos) > item->task_max_dist) && 
+			(!have_prediction || (item->getDistanceToCamera(last_predicted_campos) > item->task_max_dist)))
 		{
-			const float pos_info_z_priority = campos_zero_w.getDist(maskWToZero(loadUnalignedVec4f(&pos_info[z].pos.x))) * pos_info[z].size_factor;
-			smallest_priority = myMin(smallest_priority, pos_info_z_priority);
-		}
+			auto res = item_map.find(item->key);
+			if(res != item_map.end() && res->second == item)
+				item_map.erase(res);
 
-		items[i]->priority = smallest_priority;
-	}
+			heap.removeUnordered(i); // Moves the last item to index i, so don't increment i.
 
-	QueueItemDistComparator comparator;
-	std::sort(items.begin() + begin_i, items.end(), comparator);
-
-	//conPrint("\n!!!!Sorting load item queue (" + toString(items.size() - begin_i) + " items) took " + timer.elapsedStringNSigFigs(4));
-
-	/*
-	If the unused space at the start of the array gets too large, copy items back to the start of the array, and trim off the end.
-	                 begin_i                    end
-	---------------------------------------------
-	   unused          |         data           |
-	---------------------------------------------
-	
-	|
-	v
-
-	begin_i                  end
-	--------------------------
-	|         data           |
-	--------------------------
-	
-	*/
-	if(begin_i > 1000)
-	{
-		//conPrint("LoadItemQueue::sortQueue(): copying backwards (begin_i: " + toString(begin_i) + ")");
-		for(size_t i = begin_i; i < items_size; ++i)
-			items[i - begin_i] = items[i];
-		items.resize(items.size() - begin_i);
-		begin_i = 0;
+			discarded_items_out.push_back(*item);
+			delete item;
+		}
+		else
+		{
+			item->priority = LoadItemQueueItem::computePriority(item->pos_info, last_campos, last_camdir, last_predicted_campos);
+			++i;
+		}
 	}
+
+	heap.rebuild();
+
+	//conPrint("\n!!!!Updating load item queue priorities (" + toString(heap.size()) + " items) took " + timer.elapsedStringNSigFigs(4));
 }
 
 
 void LoadItemQueue::dequeueFront(LoadItemQueueItem& item_out)
 {
-	assert(begin_i < items.size());
+	LoadItemQueueItem* item = heap.pop();
+
+	auto res = item_map.find(item->key);
+	if(res != item_map.end() && res->second == item)
+		item_map.erase(res);
+
+	item_out = *item; // Copy to item_out
+
+	delete item;
+}
+
+
+bool LoadItemQueue::removeItem(const std::string& key, LoadItemQueueItem& item_out)
+{
+	auto res = item_map.find(key);
+	if(res == item_map.end())
+		return false;
+
+	LoadItemQueueItem* item = res->second;
+	item_map.erase(res);
+	heap.remove(item);
+
+	item_out = *item;
 
-	item_map.erase(items[begin_i]->key);
+	delete item;
+	return true;
+}
 
-	item_out = *items[begin_i]; // Copy to item_out
 
-	delete items[begin_i];
-	items[begin_i] = NULL;
-	begin_i++;
+float LoadItemQueueItem::computePriority(const SmallVector<LoadItemQueuePosInfo, 4>& pos_info, const Vec4f& campos_zero_w, const Vec4f& camdir, const Vec4f& predicted_campos_zero_w)
+{
+	assert(pos_info.size() >= 1);
+	float smallest_priority = std::numeric_limits<float>::infinity();
+	for(size_t z=0; z<pos_info.size(); ++z)
+		smallest_priority = myMin(smallest_priority, computeLoadQueuePriority(loadUnalignedVec4f(&pos_info[z].pos.x), pos_info[z].size_factor, campos_zero_w, camdir, predicted_campos_zero_w));
+	return smallest_priority;
 }
 
 
@@ -205,3 +232,245 @@ float LoadItemQueueItem::getDistanceToCamera(const Vec4f& cam_pos_) const
 		smallest_dist = myMin(smallest_dist, maskWToZero(loadUnalignedVec4f(&pos_info[i].pos.x)).getDist(cam_pos_zero_w));
 	return smallest_dist;
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <maths/PCG32.h>
+
+
+struct BenchQueueItem
+{
+	Vec3f pos;
+	float size_factor;
+	float priority;
+	size_t heap_index;
+};
+
+
+struct BenchQueueItemComparator
+{
+	bool operator () (const BenchQueueItem* a, const BenchQueueItem* b) const { return a->priority < b->priority; }
+};
+
+
+// Compares re-sorting a large synthetic queue (what LoadItemQueue and DownloadingResourceQueue used to do), with updating priorities and rebuilding the heap,
+// and with adding positions to random items.
+static void benchmarkLoadQueues()
+{
+	const size_t N = 50000;
+	PCG32 rng(1);
+	std::vector<BenchQueueItem> item_storage(N);
+	for(size_t i=0; i<N; ++i)
+	{
+		item_storage[i].pos = Vec3f(rng.unitRandom() * 2000 - 1000, rng.unitRandom() * 2000 - 1000, rng.unitRandom() * 100);
+		item_storage[i].size_factor = LoadItemQueueItem::sizeFactorForAABBWS(rng.unitRandom() * 20, 1.f);
+	}
+
+	const int NUM_ITERS = 20;
+	const Vec4f camdir(1, 0, 0, 0);
+
+	// Full sort
+	double sort_time = 0;
+	{
+		std::vector<BenchQueueItem*> items(N);
+		for(size_t i=0; i<N; ++i)
+			items[i] = &item_storage[i];
+
+		for(int z=0; z<NUM_ITERS; ++z)
+		{
+			const Vec4f campos((float)z * 10.f, 0, 0, 0);
+			Timer timer;
+			for(size_t i=0; i<N; ++i)
+				items[i]->priority = computeLoadQueuePriority(loadUnalignedVec4f(&items[i]->pos.x), items[i]->size_factor, campos, camdir);
+			std::sort(items.begin(), items.end(), BenchQueueItemComparator());
+			sort_time += timer.elapsed();
+		}
+	}
+
+	// Heap rebuild
+	double rebuild_time = 0;
+	double update_time = 0;
+	{
+		LoadQueueHeap<BenchQueueItem> heap;
+		for(size_t i=0; i<N; ++i)
+		{
+			item_storage[i].priority = 0;
+			heap.push(&item_storage[i]);
+		}
+
+		for(int z=0; z<NUM_ITERS; ++z)
+		{
+			const Vec4f campos((float)z * 10.f, 0, 0, 0);
+			Timer timer;
+			for(size_t i=0; i<N; ++i)
+				heap[i]->priority = computeLoadQueuePriority(loadUnalignedVec4f(&heap[i]->pos.x), heap[i]->size_factor, campos, camdir);
+			heap.rebuild();
+			rebuild_time += timer.elapsed();
+		}
+		testAssert(heap.isHeapOrdered());
+
+		// Single item priority updates, as done by checkUpdateItemPosition().
+		Timer timer;
+		for(size_t i=0; i<N; ++i)
+		{
+			BenchQueueItem* item = &item_storage[(size_t)(rng.unitRandom() * N) % N];
+			item->priority *= 0.5f;
+			heap.priorityChanged(item);
+		}
+		update_time = timer.elapsed();
+		testAssert(heap.isHeapOrdered());
+	}
+
+	conPrint("Load queue benchmark (" + toString(N) + " items):");
+	conPrint("    full sort:                  " + doubleToStringNSigFigs(sort_time / NUM_ITERS * 1.0e3, 4) + " ms");
+	conPrint("    priority update + rebuild:  " + doubleToStringNSigFigs(rebuild_time / NUM_ITERS * 1.0e3, 4) + " ms");
+	conPrint("    single item update:         " + doubleToStringNSigFigs(update_time / N * 1.0e9, 4) + " ns");
+}
+
+
+void LoadItemQueue::test()
+{
+	conPrint("LoadItemQueue::test()");
+
+	//-------------------- Test LoadQueueHeap --------------------
+	{
+		PCG32 rng(1);
+		std::vector<BenchQueueItem> item_storage(1000);
+		LoadQueueHeap<BenchQueueItem> heap;
+		for(size_t i=0; i<item_storage.size(); ++i)
+		{
+			item_storage[i].priority = rng.unitRandom();
+			heap.push(&item_storage[i]);
+			testAssert(heap.isHeapOrdered());
+		}
+
+		// Change some priorities
+		for(int i=0; i<1000; ++i)
+		{
+			BenchQueueItem* item = &item_storage[(size_t)(rng.unitRandom() * item_storage.size()) % item_storage.size()];
+			item->priority = rng.unitRandom();
+			heap.priorityChanged(item);
+		}
+		testAssert(heap.isHeapOrdered());
+
+		// Remove some items
+		for(size_t i=0; i<item_storage.size(); i += 3)
+			heap.remove(&item_storage[i]);
+		testAssert(heap.isHeapOrdered());
+		testAssert(item_storage[0].heap_index == LoadQueueHeap<BenchQueueItem>::NOT_IN_HEAP);
+
+		// Items should be popped in order of priority
+		float last_priority = -1;
+		while(!heap.empty())
+		{
+			BenchQueueItem* item = heap.pop();
+			testAssert(item->priority >= last_priority);
+			last_priority = item->priority;
+		}
+	}
+
+	//-------------------- Test computeLoadQueuePriority --------------------
+	{
+		const Vec4f campos(0, 0, 0, 0);
+		const Vec4f camdir(1, 0, 0, 0);
+		const float in_front = computeLoadQueuePriority(Vec4f(10, 0, 0, 1), 1.f, campos, camdir);
+		const float to_side  = computeLoadQueuePriority(Vec4f(0, 10, 0, 1), 1.f, campos, camdir);
+		const float behind   = computeLoadQueuePriority(Vec4f(-10, 0, 0, 1), 1.f, campos, camdir);
+		testAssert(epsEqual(in_front, 10.f));
+		testAssert(in_front < to_side && to_side < behind);
+
+		// Without a camera direction, priority is just distance * size factor.
+		testAssert(epsEqual(computeLoadQueuePriority(Vec4f(-10, 0, 0, 1), 0.5f, campos, Vec4f(0, 0, 0, 0)), 5.f * (1.f + LOAD_PRIORITY_VIEW_DIR_WEIGHT)));
+	}
+
+	//-------------------- Test LoadItemQueue --------------------
+	{
+		LoadItemQueue queue;
+		std::vector<LoadItemQueueItem> discarded;
+		queue.updatePriorities(Vec3d(0, 0, 0), Vec3d(1, 0, 0), discarded);
+
+		queue.enqueueItem("far",    Vec4f(100, 0, 0, 1), /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/1000.f);
+		queue.enqueueItem("near",   Vec4f(10, 0, 0, 1),  /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/1000.f);
+		queue.enqueueItem("behind", Vec4f(-11, 0, 0, 1), /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/1000.f);
+		queue.enqueueItem("closer", Vec4f(50, 0, 0, 1),  /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/60.f);
+		testAssert(queue.size() == 4);
+
+		// Another object using "far" is close to the camera, so it should now be the most important.
+		queue.checkUpdateItemPosition("far", Vec4f(1, 0, 0, 1), /*size_factor=*/1.f);
+
+		LoadItemQueueItem item;
+		queue.dequeueFront(item);
+		testAssert(item.key == "far");
+		queue.dequeueFront(item);
+		testAssert(item.key == "near");
+		queue.dequeueFront(item);
+		testAssert(item.key == "behind"); // Behind the camera at about the same distance as "near", so less important.
+
+		// Move the camera away.  "closer" should be discarded since it's now more than its max dist away.
+		queue.updatePriorities(Vec3d(-100, 0, 0), Vec3d(1, 0, 0), discarded);
+		testAssert(discarded.size() == 1 && discarded[0].key == "closer");
+		testAssert(queue.empty());
+
+		// Test removeItem
+		queue.enqueueItem("a", Vec4f(1, 0, 0, 1), 1.f, NULL, 1000.f);
+		queue.enqueueItem("b", Vec4f(2, 0, 0, 1), 1.f, NULL, 1000.f);
+		testAssert(queue.removeItem("a", item) && item.key == "a");
+		testAssert(!queue.removeItem("a", item));
+		testAssert(queue.size() == 1);
+		queue.checkUpdateItemPosition("a", Vec4f(1, 0, 0, 1), 1.f); // Should do nothing
+		queue.dequeueFront(item);
+		testAssert(item.key == "b");
+		testAssert(queue.empty());
+	}
+
+	//-------------------- Test priorities with a predicted camera position --------------------
+	{
+		const Vec4f campos(0, 0, 0, 0);
+		const Vec4f camdir(1, 0, 0, 0);
+
+		// With the predicted position equal to the camera position, should be the same as without prediction.
+		for(int i=0; i<8; ++i)
+		{
+			const Vec4f pos(std::cos(i * 0.8f) * 10.f, std::sin(i * 0.8f) * 10.f, 1.f, 1);
+			testAssert(computeLoadQueuePriority(pos, 1.f, campos, camdir, campos) == computeLoadQueuePriority(pos, 1.f, campos, camdir));
+		}
+
+		// Items near the predicted position should be more important, but less important than items at the same distance from the camera.
+		const Vec4f predicted_campos(200, 0, 0, 0);
+		const float ahead_priority = computeLoadQueuePriority(Vec4f(210, 0, 0, 1), 1.f, campos, camdir, predicted_campos);
+		testAssert(epsEqual(ahead_priority, 10.f * LOAD_PRIORITY_PREDICTED_POS_FACTOR));
+		testAssert(ahead_priority < computeLoadQueuePriority(Vec4f(210, 0, 0, 1), 1.f, campos, camdir));
+		testAssert(ahead_priority > computeLoadQueuePriority(Vec4f(10, 0, 0, 1), 1.f, campos, camdir, predicted_campos));
+
+		LoadItemQueue queue;
+		std::vector<LoadItemQueueItem> discarded;
+		queue.enqueueItem("ahead",  Vec4f(500, 0, 0, 1), /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/200.f);
+		queue.enqueueItem("middle", Vec4f(150, 0, 0, 1), /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/200.f);
+
+		// "ahead" is too far from the camera to load, but not from the predicted camera position, so shouldn't be discarded.
+		queue.updatePriorities(Vec3d(0, 0, 0), Vec3d(1, 0, 0), /*predicted_campos=*/Vec4f(450, 0, 0, 1), discarded);
+		testAssert(discarded.empty());
+		LoadItemQueueItem item;
+		queue.dequeueFront(item);
+		testAssert(item.key == "ahead");
+
+		// Without the prediction, it would be discarded.
+		queue.enqueueItem("ahead",  Vec4f(500, 0, 0, 1), /*size_factor=*/1.f, /*task=*/NULL, /*task_max_dist=*/200.f);
+		queue.updatePriorities(Vec3d(0, 0, 0), Vec3d(1, 0, 0), discarded);
+		testAssert(discarded.size() == 1 && discarded[0].key == "ahead");
+	}
+
+	// Performance test
+	if(false)
+	{
+		benchmarkLoadQueues();
+	}
+
+	conPrint("LoadItemQueue::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2024 -
 #pragma once
 
 
+#include "LoadQueueHeap.h"
 #include <physics/jscol_aabbox.h>
 #include <maths/Vec4.h>
 #include <maths/vec3.h>
@@ -45,12 +46,16 @@ struct LoadItemQueueItem
 
 	float getDistanceToCamera(const Vec4f& cam_pos_) const; // Get distance from camera to closest position stored in pos_info.
 
+	// Smallest priority (see computeLoadQueuePriority()) over the positions in pos_info.  Lower values are more important.
+	static float computePriority(const SmallVector<LoadItemQueuePosInfo, 4>& pos_info, const Vec4f& campos_zero_w, const Vec4f& camdir, const Vec4f& predicted_campos_zero_w);
+
 	SmallVector<LoadItemQueuePosInfo, 4> pos_info; // Store multiple positions and size factors, since multiple different objects may be using the same resource.
 	std::string key;
 	float task_max_dist; // Max distance from camera before task should be discarded.
 	glare::TaskRef task;
 	
 	float priority;
+	size_t heap_index; // Index in LoadItemQueue heap.
 };
 
 
@@ -58,7 +63,11 @@ struct LoadItemQueueItem
 LoadItemQueue
 -------------
 Queue of load model tasks, load texture tasks etc, together with the position of the item,
-which is used for sorting the tasks based on distance from the camera.
+which is used for prioritising the tasks based on distance from the camera, and view direction.
+
+Items are kept in a heap indexed by key, so items can be added, updated with new positions and removed in O(log n) time.
+When the camera moves, updatePriorities() recomputes all priorities and rebuilds the heap in O(n) time, and removes items that are
+now too far from the camera to be worth loading.
 =====================================================================*/
 class LoadItemQueue
 {
@@ -82,13 +91,30 @@ public:
 
 	size_t size() const;
 
-	void sortQueue(const Vec3d& campos); // Sort queue (approximately by item distance to camera)
+	// Recompute item priorities for the new camera position and direction.  camdir should be normalised.
+	// Items that are now further than task_max_dist from the camera are removed from the queue and appended to discarded_items_out.
+	void updatePriorities(const Vec3d& campos, const Vec3d& camdir, std::vector<LoadItemQueueItem>& discarded_items_out);
 
+	// As above, but items close to predicted_campos (the predicted future camera position) are also made more important, and are not discarded
+	// if they are within task_max_dist of predicted_campos.
+	void updatePriorities(const Vec3d& campos, const Vec3d& camdir, const Vec4f& predicted_campos, std::vector<LoadItemQueueItem>& discarded_items_out);
+
+	// Removes the most important item.  Queue must be non-empty.
 	void dequeueFront(LoadItemQueueItem& item_out);
+
+	// Removes the item with the given key, if present.  Returns true if removed.
+	bool removeItem(const std::string& key, LoadItemQueueItem& item_out);
+
+	static void test();
+
 private:
-	// Valid items are at indices [begin_i, items.size())
-	size_t begin_i;
-	js::Vector<LoadItemQueueItem*, 16> items;
+	void insertItem(LoadItemQueueItem* item);
+
+	LoadQueueHeap<LoadItemQueueItem> heap;
 
 	std::unordered_map<std::string, LoadItemQueueItem*> item_map; // Map from key to pointer to LoadItemQueueItem.
+
+	Vec4f last_campos; // Camera position and direction passed to the last updatePriorities() call, used for computing priorities of new items.
+	Vec4f last_camdir;
+	Vec4f last_predicted_campos;
 };
@@ -34,6 +34,7 @@ void LoadModelTask::run(size_t thread_index)
 		Reference<OpenGLMeshRenderData> gl_meshdata;
 		PhysicsShape physics_shape;
 		int subsample_factor = 1; // computed when loading voxels
+		glare::Allocator* mem_allocator = opengl_engine.nonNull() ? opengl_engine->mem_allocator.ptr() : NULL;
 
 		if(voxel_ob.nonNull())
 		{
@@ -42,14 +43,16 @@ void LoadModelTask::run(size_t thread_index)
 			if(voxel_ob->getCompressedVoxels().size() == 0)
 			{
 				// Add dummy cube marker for zero-voxel case.
-				gl_meshdata = opengl_engine->getCubeMeshData();
+				if(opengl_engine.nonNull())
+					gl_meshdata = opengl_engine->getCubeMeshData();
 				physics_shape = unit_cube_shape;
 			}
 			else
 			{
 				VoxelGroup voxel_group;
-				voxel_group.voxels.setAllocator(opengl_engine->mem_allocator);
-				WorldObject::decompressVoxelGroup(voxel_ob->getCompressedVoxels().data(), voxel_ob->getCompressedVoxels().size(), opengl_engine->mem_allocator.ptr(), /*decompressed group out=*/voxel_group);
+				if(opengl_engine.nonNull())
+					voxel_group.voxels.setAllocator(opengl_engine->mem_allocator);
+				WorldObject::decompressVoxelGroup(voxel_ob->getCompressedVoxels().data(), voxel_ob->getCompressedVoxels().size(), mem_allocator, /*decompressed group out=*/voxel_group);
 
 				const int max_model_lod_level = (voxel_group.voxels.size() > 256) ? 2 : 0;
 				const int use_model_lod_level = myMin(voxel_ob_model_lod_level/*model_lod_level*/, max_model_lod_level);
@@ -69,7 +72,7 @@ void LoadModelTask::run(size_t thread_index)
 
 				const bool need_lightmap_uvs = !voxel_ob->lightmap_url.empty();
 				gl_meshdata = ModelLoading::makeModelForVoxelGroup(voxel_group, subsample_factor, ob_to_world_matrix, /*vert_buf_allocator=*/NULL, /*do_opengl_stuff=*/false, 
-					need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, opengl_engine->mem_allocator.ptr(), /*physics shape out=*/physics_shape);
+					need_lightmap_uvs, mat_transparent, build_dynamic_physics_ob, mem_allocator, /*physics shape out=*/physics_shape);
 
 				// Temp for testing: Save voxels to disk.
 				/*if(voxel_ob->uid.value() == 171111)
@@ -92,7 +95,8 @@ void LoadModelTask::run(size_t thread_index)
 				/*vert_buf_allocator=*/NULL, 
 				true, // skip_opengl_calls - we need to do these on the main thread.
 				build_dynamic_physics_ob,
-				opengl_engine->mem_allocator.ptr(),
+				mem_allocator,
+				processed_mesh_cache.ptr(),
 				/*physics shape out=*/physics_shape);
 		}
 
@@ -9,6 +9,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "../shared/WorldObject.h"
 #include "../shared/Resource.h"
 #include "PhysicsObject.h"
+#include "ProcessedMeshCache.h"
 #include <opengl/OpenGLEngine.h>
 #include <Task.h>
 #include <ThreadMessage.h>
@@ -66,7 +67,8 @@ public:
 	int voxel_ob_model_lod_level; // If we are loading a voxel model, the model LOD level of the object.
 
 	PhysicsShape unit_cube_shape;
-	Reference<OpenGLEngine> opengl_engine;
+	Reference<OpenGLEngine> opengl_engine; // May be NULL, in which case the default allocator is used, and gl_meshdata will be NULL for empty voxel objects.  (Used by the headless stress-test client)
 	Reference<ResourceManager> resource_manager;
+	Reference<ProcessedMeshCache> processed_mesh_cache; // May be NULL.
 	ThreadSafeQueue<Reference<ThreadMessage> >* result_msg_queue;
 };
@@ -0,0 +1,185 @@
+/*=====================================================================
+LoadQueueHeap.h
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <maths/Vec4f.h>
+#include <utils/Platform.h>
+#include <vector>
+#include <limits>
+
+
+// How much less important items directly behind the camera are than items directly in front of the camera, at the same distance.
+// Priority is scaled by 1 + LOAD_PRIORITY_VIEW_DIR_WEIGHT * (1 - cos(angle between camera forwards vector and direction to item)).
+const float LOAD_PRIORITY_VIEW_DIR_WEIGHT = 0.5f;
+
+
+// Priority used for load and download queue items.  Lower values are more important.
+// This is roughly the reciprocal of the projected angle of the object (distance / size), made larger for items that are not in front of the camera.
+// pos may have any w value.  campos_zero_w should have w = 0, camdir should be normalised with w = 0, or the zero vector to not take view direction into account.
+inline float computeLoadQueuePriority(const Vec4f& pos, float size_factor, const Vec4f& campos_zero_w, const Vec4f& camdir)
+{
+	const Vec4f cam_to_pos = maskWToZero(pos) - campos_zero_w;
+	const float dist = cam_to_pos.length();
+	const float cos_angle = (dist > 1.0e-3f) ? (dot(cam_to_pos, camdir) / dist) : 1.f; // Treat items very close to the camera as being in front of it.
+	return dist * size_factor * (1.f + LOAD_PRIORITY_VIEW_DIR_WEIGHT * (1.f - cos_angle));
+}
+
+
+// Items near the predicted future camera position are treated like items directly behind the camera at that distance,
+// so they are loaded ahead of items further away, but after visible items at the same distance from the current camera position.
+const float LOAD_PRIORITY_PREDICTED_POS_FACTOR = 1.f + 2.f * LOAD_PRIORITY_VIEW_DIR_WEIGHT;
+
+
+// Priority that also takes into account where the camera is predicted to be soon (see ProximityLoader::getPrefetchPos()), so that items along the predicted
+// camera path, for example when flying or driving, are loaded before the camera gets there.
+// Never larger than computeLoadQueuePriority().  Gives the same value as computeLoadQueuePriority() when predicted_campos_zero_w = campos_zero_w.
+inline float computeLoadQueuePriority(const Vec4f& pos, float size_factor, const Vec4f& campos_zero_w, const Vec4f& camdir, const Vec4f& predicted_campos_zero_w)
+{
+	const float priority = computeLoadQueuePriority(pos, size_factor, campos_zero_w, camdir);
+	const float predicted_dist = (maskWToZero(pos) - predicted_campos_zero_w).length();
+	return myMin(priority, predicted_dist * size_factor * LOAD_PRIORITY_PREDICTED_POS_FACTOR);
+}
+
+
+/*=====================================================================
+LoadQueueHeap
+-------------
+Binary min-heap of item pointers, ordered by item->priority, where each item stores its index in the heap (item->heap_index).
+This allows O(log n) updates when the priority of a single item changes, and O(log n) removal of arbitrary items,
+as well as O(n) rebuilding after the priorities of all items have changed (e.g. when the camera has moved).
+
+ItemType needs members
+	float priority;
+	size_t heap_index;
+
+Doesn't own the items.  Not threadsafe.
+=====================================================================*/
+template <class ItemType>
+class LoadQueueHeap
+{
+public:
+	static const size_t NOT_IN_HEAP = std::numeric_limits<size_t>::max();
+
+	void push(ItemType* item)
+	{
+		item->heap_index = items.size();
+		items.push_back(item);
+		siftUp(item->heap_index);
+	}
+
+	ItemType* top() const { assert(!items.empty()); return items[0]; }
+
+	ItemType* pop()
+	{
+		ItemType* item = top();
+		remove(item);
+		return item;
+	}
+
+	void remove(ItemType* item)
+	{
+		const size_t i = item->heap_index;
+		assert(i < items.size() && items[i] == item);
+
+		ItemType* last = items.back();
+		items.pop_back();
+		if(i < items.size()) // If the item wasn't the last item, move the last item into its place:
+		{
+			items[i] = last;
+			last->heap_index = i;
+			restoreHeapOrder(i);
+		}
+		item->heap_index = NOT_IN_HEAP;
+	}
+
+	// Should be called after the priority of a single item has changed.
+	void priorityChanged(ItemType* item)
+	{
+		assert(item->heap_index < items.size() && items[item->heap_index] == item);
+		restoreHeapOrder(item->heap_index);
+	}
+
+	// Should be called after the priorities of many items have changed.  O(n).
+	void rebuild()
+	{
+		for(size_t i = items.size() / 2; i-- > 0; )
+			siftDown(i);
+	}
+
+	// Removes items[i], for use while iterating over items.  The last item is moved into index i, and heap order is not maintained, so rebuild() needs to be called afterwards.
+	void removeUnordered(size_t i)
+	{
+		ItemType* removed_item = items[i];
+		items[i] = items.back();
+		items[i]->heap_index = i;
+		items.pop_back();
+		removed_item->heap_index = NOT_IN_HEAP;
+	}
+
+	size_t size() const { return items.size(); }
+	bool empty() const { return items.empty(); }
+	void clear() { items.clear(); }
+
+	// Items are in heap order, not in sorted order.
+	ItemType* operator [] (size_t i) const { return items[i]; }
+
+	bool isHeapOrdered() const // For testing
+	{
+		for(size_t i=1; i<items.size(); ++i)
+			if(items[i]->priority < items[(i - 1) / 2]->priority || items[i]->heap_index != i)
+				return false;
+		return items.empty() || items[0]->heap_index == 0;
+	}
+
+private:
+	void restoreHeapOrder(size_t i)
+	{
+		if(i > 0 && items[i]->priority < items[(i - 1) / 2]->priority)
+			siftUp(i);
+		else
+			siftDown(i);
+	}
+
+	void siftUp(size_t i)
+	{
+		ItemType* item = items[i];
+		while(i > 0)
+		{
+			const size_t parent = (i - 1) / 2;
+			if(!(item->priority < items[parent]->priority))
+				break;
+			items[i] = items[parent];
+			items[i]->heap_index = i;
+			i = parent;
+		}
+		items[i] = item;
+		item->heap_index = i;
+	}
+
+	void siftDown(size_t i)
+	{
+		ItemType* item = items[i];
+		const size_t n = items.size();
+		while(true)
+		{
+			size_t child = 2 * i + 1;
+			if(child >= n)
+				break;
+			if(child + 1 < n && items[child + 1]->priority < items[child]->priority)
+				child++;
+			if(!(items[child]->priority < item->priority))
+				break;
+			items[i] = items[child];
+			items[i]->heap_index = i;
+			i = child;
+		}
+		items[i] = item;
+		item->heap_index = i;
+	}
+
+	std::vector<ItemType*> items;
+};
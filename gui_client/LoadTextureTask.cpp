@@ -31,20 +31,48 @@ LoadTextureTask::LoadTextureTask(const Reference<OpenGLEngine>& opengl_engine_,
 {}
 
 
+void LoadTextureTask::sendNotLoadedMessage(bool cancelled)
+{
+	if(job.nonNull()) // Only needed so the main thread can clean up the job.
+	{
+		Reference<TextureNotLoadedThreadMessage> msg = new TextureNotLoadedThreadMessage();
+		msg->task = this;
+		msg->cancelled = cancelled;
+		result_msg_queue->enqueue(msg);
+	}
+}
+
+
 void LoadTextureTask::run(size_t thread_index)
 {
 	try
 	{
 		// conPrint("LoadTextureTask: processing texture '" + path + "'");
 
+		if(job.nonNull() && job->isCancelled())
+		{
+			sendNotLoadedMessage(/*cancelled=*/true);
+			return;
+		}
+
 		const std::string& key = this->path;
 
-		// Load texture from disk and decode it.
+		// If this is a LOD level of a texture we have recently decoded a higher-detail level of, make it by downsampling the decoded texture.
 		Reference<Map2D> map;
-		if(hasExtension(key, "gif"))
-			map = GIFDecoder::decodeImageSequence(key, opengl_engine->mem_allocator.ptr());
-		else
-			map = ImageDecoding::decodeImage(".", key, opengl_engine->mem_allocator.ptr());
+		if(coordinator.nonNull() && resource.nonNull())
+			map = coordinator->getDerivedLODMap(resource->URL, opengl_engine->getMainTaskManager());
+
+		// Otherwise load texture from disk and decode it.
+		if(map.isNull())
+		{
+			if(hasExtension(key, "gif"))
+				map = GIFDecoder::decodeImageSequence(key, opengl_engine->mem_allocator.ptr());
+			else
+				map = ImageDecoding::decodeImage(".", key, opengl_engine->mem_allocator.ptr());
+
+			if(coordinator.nonNull() && resource.nonNull())
+				coordinator->addDecodedMap(resource->URL, map);
+		}
 
 #if USE_TEXTURE_VIEWS // NOTE: USE_TEXTURE_VIEWS is defined in opengl/TextureAllocator.h
 		// Resize for texture view
@@ -76,6 +104,13 @@ void LoadTextureTask::run(size_t thread_index)
 				throw glare::Exception("Invalid texture for WebGL, is compressed and width or height is not a multiple of 4");
 #endif
 
+		// Building the texture data (compression and mipmaps) is the most expensive part, so check again for cancellation before doing it.
+		if(job.nonNull() && job->isCancelled())
+		{
+			sendNotLoadedMessage(/*cancelled=*/true);
+			return;
+		}
+
 		const bool do_compression = opengl_engine->textureCompressionSupportedAndEnabled() && tex_params.allow_compression && OpenGLTexture::areTextureDimensionsValidForCompression(*map);
 		Reference<TextureData> texture_data = TextureProcessing::buildTextureData(map.ptr(), opengl_engine->mem_allocator.ptr(), opengl_engine->getMainTaskManager(), do_compression, /*build_mipmaps=*/tex_params.use_mipmaps);
 
@@ -93,6 +128,7 @@ void LoadTextureTask::run(size_t thread_index)
 		msg->texture_data = texture_data;
 		if(is_terrain_map)
 			msg->terrain_map = map;
+		msg->job = job;
 
 		texture_data = NULL;
 
@@ -101,14 +137,17 @@ void LoadTextureTask::run(size_t thread_index)
 	catch(ImFormatExcep& )
 	{
 		//conPrint("Warning: failed to decode texture '" + path + "': " + e.what());
+		sendNotLoadedMessage(/*cancelled=*/false);
 	}
 	catch(glare::Exception& e)
 	{
 		result_msg_queue->enqueue(new LogMessage("Failed to load texture '" + path + "': " + e.what()));
+		sendNotLoadedMessage(/*cancelled=*/false);
 	}
 	catch(std::bad_alloc&)
 	{
 		result_msg_queue->enqueue(new LogMessage("Error while loading texture: failed to allocate mem (bad_alloc)"));
+		sendNotLoadedMessage(/*cancelled=*/false);
 	}
 
 
@@ -6,6 +6,7 @@ Copyright Glare Technologies Limited 2019 -
 #pragma once
 
 
+#include "TextureLoadCoordinator.h"
 #include "../shared/Resource.h"
 #include <opengl/OpenGLTexture.h>
 #include <Task.h>
@@ -28,13 +29,19 @@ public:
 	Reference<TextureData> texture_data;
 	
 	Reference<Map2D> terrain_map; // Non-null iff we are loading a terrain map (e.g. is_terrain_map is true)
+
+	Reference<TextureLoadJob> job; // May be NULL
 };
 
 
 /*=====================================================================
 LoadTextureTask
 ---------------
+Decodes a texture and builds the texture data for it, then sends a TextureLoadedThreadMessage
+back to the main thread via result_msg_queue.
 
+If job is non-null and gets cancelled (all the requesters of the texture have been unloaded)
+before the texture data is built, or if loading fails, a TextureNotLoadedThreadMessage is sent instead.
 =====================================================================*/
 class LoadTextureTask : public glare::Task
 {
@@ -51,4 +58,18 @@ public:
 	ResourceRef resource;
 	TextureParams tex_params;
 	bool is_terrain_map;
+
+	Reference<TextureLoadJob> job; // May be NULL
+	Reference<TextureLoadCoordinator> coordinator; // May be NULL.  Used for deriving LOD levels from already decoded textures.
+
+private:
+	void sendNotLoadedMessage(bool cancelled);
+};
+
+
+class TextureNotLoadedThreadMessage : public ThreadMessage
+{
+public:
+	Reference<LoadTextureTask> task;
+	bool cancelled; // True if the job was cancelled, false if loading failed.
 };
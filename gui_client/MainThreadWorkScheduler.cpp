@@ -0,0 +1,387 @@
+/*=====================================================================
+MainThreadWorkScheduler.cpp
+---------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "MainThreadWorkScheduler.h"
+
+
+#include <utils/Clock.h>
+#include <utils/StringUtils.h>
+#include <maths/mathstypes.h>
+
+
+static const double DEFAULT_BUDGET_US = 5000.0; // 5 ms
+
+// Initial cost estimates, before we have measured anything.  Uploads are estimated at 1 MB per 5 ms, which is what we used to allow per frame.
+static const double INITIAL_UPLOAD_COST_PER_BYTE_US = 5000.0 / (1024 * 1024);
+
+// Weight of each new measurement in the cost estimates (exponential moving average).
+static const double COST_ESTIMATE_BLEND_FACTOR = 0.2;
+
+
+MainThreadWorkScheduler::Stats::Stats()
+:	num_frames(0),
+	num_overrun_frames(0),
+	total_overrun_us(0),
+	max_overrun_us(0),
+	last_frame_time_us(0),
+	max_frame_time_us(0),
+	max_task_run_time_us(0),
+	num_tasks_finished(0),
+	num_task_resumes(0)
+{}
+
+
+MainThreadWorkScheduler::MainThreadWorkScheduler()
+:	budget_us(DEFAULT_BUDGET_US),
+	time_func([]() { return Clock::getTimeSinceInit(); }),
+	frame_start_time(0)
+{
+	cost_per_unit_us[WorkType_MeshUpload] = INITIAL_UPLOAD_COST_PER_BYTE_US;
+	cost_per_unit_us[WorkType_TextureUpload] = INITIAL_UPLOAD_COST_PER_BYTE_US;
+}
+
+
+MainThreadWorkScheduler::~MainThreadWorkScheduler()
+{}
+
+
+void MainThreadWorkScheduler::beginFrame()
+{
+	frame_start_time = time_func();
+}
+
+
+void MainThreadWorkScheduler::endFrame()
+{
+	const double frame_time_us = getElapsedThisFrame();
+
+	stats.num_frames++;
+	stats.last_frame_time_us = frame_time_us;
+	stats.max_frame_time_us = myMax(stats.max_frame_time_us, frame_time_us);
+
+	if(frame_time_us > budget_us)
+	{
+		const double overrun_us = frame_time_us - budget_us;
+		stats.num_overrun_frames++;
+		stats.total_overrun_us += overrun_us;
+		stats.max_overrun_us = myMax(stats.max_overrun_us, overrun_us);
+	}
+}
+
+
+double MainThreadWorkScheduler::getElapsedThisFrame() const
+{
+	return (time_func() - frame_start_time) * 1.0e6;
+}
+
+
+void MainThreadWorkScheduler::runTasks()
+{
+	while(!tasks.empty() && hasTimeRemaining())
+	{
+		// Remove the task from the queue before running it, as run() may add tasks or clear the queue.
+		const MainThreadTaskRef task = tasks.front();
+		tasks.pop_front();
+
+		const double run_start_us = getElapsedThisFrame();
+		const bool finished = task->run(*this);
+		stats.max_task_run_time_us = myMax(stats.max_task_run_time_us, getElapsedThisFrame() - run_start_us);
+
+		if(finished)
+			stats.num_tasks_finished++;
+		else
+		{
+			tasks.push_front(task); // Resume the task first next time.
+			stats.num_task_resumes++;
+		}
+	}
+}
+
+
+void MainThreadWorkScheduler::recordWork(WorkType type, size_t num_units, double time_us)
+{
+	if(num_units == 0)
+		return;
+
+	const double measured_cost = myMax(0.0, time_us) / (double)num_units;
+	cost_per_unit_us[type] = cost_per_unit_us[type] * (1 - COST_ESTIMATE_BLEND_FACTOR) + measured_cost * COST_ESTIMATE_BLEND_FACTOR;
+}
+
+
+size_t MainThreadWorkScheduler::getMaxUnitsForRemainingTime(WorkType type, size_t min_units, size_t max_units) const
+{
+	const double remaining_us = budget_us - getElapsedThisFrame();
+
+	size_t num_units;
+	if(remaining_us <= 0)
+		num_units = 0;
+	else if(cost_per_unit_us[type] * (double)max_units <= remaining_us) // Handles zero cost without dividing by zero.
+		num_units = max_units;
+	else
+		num_units = (size_t)(remaining_us / cost_per_unit_us[type]);
+
+	return myMin(myMax(num_units, min_units), max_units);
+}
+
+
+std::string MainThreadWorkScheduler::getDiagnostics() const
+{
+	std::string s = "Main thread work: budget: " + doubleToStringNSigFigs(budget_us * 1.0e-3, 3) + " ms, last frame: " + doubleToStringNSigFigs(stats.last_frame_time_us * 1.0e-3, 3) +
+		" ms, max frame: " + doubleToStringNSigFigs(stats.max_frame_time_us * 1.0e-3, 3) + " ms\n";
+	s += "Overrun frames: " + toString(stats.num_overrun_frames) + " / " + toString(stats.num_frames) + ", max overrun: " + doubleToStringNSigFigs(stats.max_overrun_us * 1.0e-3, 3) + " ms\n";
+	s += "Pending tasks: " + toString(tasks.size()) + ", finished: " + toString(stats.num_tasks_finished) + ", resumes: " + toString(stats.num_task_resumes) +
+		", max task run time: " + doubleToStringNSigFigs(stats.max_task_run_time_us * 1.0e-3, 3) + " ms\n";
+	s += "Upload cost: mesh: " + doubleToStringNSigFigs(cost_per_unit_us[WorkType_MeshUpload] * 1024 * 1024 * 1.0e-3, 3) + " ms/MB, texture: " +
+		doubleToStringNSigFigs(cost_per_unit_us[WorkType_TextureUpload] * 1024 * 1024 * 1.0e-3, 3) + " ms/MB";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/ConPrint.h>
+#include <vector>
+
+
+// A task with a fixed number of units of work, each of which takes unit_cost_us of simulated time.
+class SyntheticTask : public MainThreadTask
+{
+public:
+	SyntheticTask(double* cur_time_, size_t num_units_, double unit_cost_us_) : cur_time(cur_time_), num_units(num_units_), unit_cost_us(unit_cost_us_), num_units_done(0), num_runs(0) {}
+
+	virtual bool run(MainThreadWorkScheduler& scheduler) override
+	{
+		num_runs++;
+		do
+		{
+			*cur_time += unit_cost_us * 1.0e-6;
+			num_units_done++;
+		}
+		while(num_units_done < num_units && scheduler.hasTimeRemaining());
+
+		return num_units_done == num_units;
+	}
+
+	double* cur_time;
+	size_t num_units;
+	double unit_cost_us;
+	size_t num_units_done;
+	int num_runs;
+};
+
+
+// Adds another task when run.
+class SpawningTask : public MainThreadTask
+{
+public:
+	SpawningTask(MainThreadTaskRef task_to_add_) : task_to_add(task_to_add_) {}
+
+	virtual bool run(MainThreadWorkScheduler& scheduler) override
+	{
+		scheduler.addTask(task_to_add);
+		return true;
+	}
+
+	MainThreadTaskRef task_to_add;
+};
+
+
+// Clears the scheduler's tasks when run.
+class ClearingTask : public MainThreadTask
+{
+public:
+	virtual bool run(MainThreadWorkScheduler& scheduler) override
+	{
+		scheduler.clearTasks();
+		return true;
+	}
+};
+
+
+void MainThreadWorkScheduler::test()
+{
+	conPrint("MainThreadWorkScheduler::test()");
+
+	double cur_time = 0;
+
+	//-------------------- Test lots of small tasks are spread over frames without overrunning the budget by more than a unit --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+		scheduler.setBudget(4950); // Not a multiple of the unit cost, so we don't depend on rounding of the times.
+
+		std::vector<Reference<SyntheticTask>> tasks;
+		for(int i=0; i<100; ++i)
+		{
+			tasks.push_back(new SyntheticTask(&cur_time, /*num_units=*/10, /*unit_cost_us=*/100));
+			scheduler.addTask(tasks.back());
+		}
+		testAssert(scheduler.getNumPendingTasks() == 100);
+
+		// Total work is 100 * 10 * 100 us = 100 ms.  Each frame should do 50 units (5 ms), so should take 20 frames.
+		int num_frames = 0;
+		while(scheduler.hasPendingTasks())
+		{
+			scheduler.beginFrame();
+			scheduler.runTasks();
+			testAssert(scheduler.getElapsedThisFrame() <= 4950 + 100 + 1.0e-3); // Shouldn't go over the budget by more than one unit.
+			scheduler.endFrame();
+			num_frames++;
+			testAssert(num_frames <= 20);
+		}
+		testAssert(num_frames == 20);
+
+		for(size_t i=0; i<tasks.size(); ++i)
+			testAssert(tasks[i]->num_units_done == 10);
+
+		testAssert(scheduler.getStats().num_frames == 20);
+		testAssert(scheduler.getStats().num_tasks_finished == 100);
+		testAssert(epsEqual(scheduler.getStats().max_frame_time_us, 5000.0, 1.0e-2));
+		testAssert(epsEqual(scheduler.getStats().max_overrun_us, 50.0, 1.0e-2));
+	}
+
+	//-------------------- Test a large task is resumed over multiple frames, and overruns are recorded --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+		scheduler.setBudget(5000);
+
+		Reference<SyntheticTask> task = new SyntheticTask(&cur_time, /*num_units=*/4, /*unit_cost_us=*/3000);
+		scheduler.addTask(task);
+
+		// Frame 1: does 2 units (6 ms), since there is time remaining after the first unit.
+		scheduler.beginFrame();
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(task->num_units_done == 2);
+		testAssert(scheduler.hasPendingTasks());
+		testAssert(scheduler.getStats().num_overrun_frames == 1);
+		testAssert(epsEqual(scheduler.getStats().max_overrun_us, 1000.0, 1.0e-2));
+		testAssert(scheduler.getStats().num_task_resumes == 1);
+
+		// Frame 2: does the remaining 2 units.
+		scheduler.beginFrame();
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(task->num_units_done == 4);
+		testAssert(task->num_runs == 2);
+		testAssert(!scheduler.hasPendingTasks());
+		testAssert(scheduler.getStats().num_overrun_frames == 2);
+		testAssert(epsEqual(scheduler.getStats().total_overrun_us, 2000.0, 1.0e-2));
+		testAssert(epsEqual(scheduler.getStats().max_task_run_time_us, 6000.0, 1.0e-2));
+		testAssert(scheduler.getStats().num_tasks_finished == 1);
+
+		// An idle frame shouldn't count as an overrun.
+		scheduler.beginFrame();
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(scheduler.getStats().num_frames == 3);
+		testAssert(scheduler.getStats().num_overrun_frames == 2);
+
+		scheduler.resetStats();
+		testAssert(scheduler.getStats().num_frames == 0);
+		testAssert(scheduler.getDiagnostics().size() > 0);
+	}
+
+	//-------------------- Test tasks aren't run when there is no time remaining --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+		scheduler.setBudget(1000);
+
+		Reference<SyntheticTask> task = new SyntheticTask(&cur_time, /*num_units=*/1, /*unit_cost_us=*/10);
+		scheduler.addTask(task);
+
+		scheduler.beginFrame();
+		cur_time += 2000 * 1.0e-6; // Use up the budget with other work
+		testAssert(!scheduler.hasTimeRemaining());
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(task->num_runs == 0);
+		testAssert(scheduler.getNumPendingTasks() == 1);
+
+		scheduler.clearTasks();
+		testAssert(!scheduler.hasPendingTasks());
+	}
+
+	//-------------------- Test tasks added while running tasks --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+
+		Reference<SyntheticTask> task = new SyntheticTask(&cur_time, /*num_units=*/1, /*unit_cost_us=*/10);
+		scheduler.addTask(new SpawningTask(task));
+
+		scheduler.beginFrame();
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(task->num_units_done == 1);
+		testAssert(!scheduler.hasPendingTasks());
+		testAssert(scheduler.getStats().num_tasks_finished == 2);
+	}
+
+	//-------------------- Test a task clearing the tasks while running --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+
+		Reference<SyntheticTask> task = new SyntheticTask(&cur_time, /*num_units=*/1, /*unit_cost_us=*/10);
+		scheduler.addTask(new ClearingTask());
+		scheduler.addTask(task);
+
+		scheduler.beginFrame();
+		scheduler.runTasks();
+		scheduler.endFrame();
+		testAssert(task->num_runs == 0);
+		testAssert(!scheduler.hasPendingTasks());
+		testAssert(scheduler.getStats().num_tasks_finished == 1);
+	}
+
+	//-------------------- Test chunk sizing from cost estimates --------------------
+	{
+		MainThreadWorkScheduler scheduler;
+		scheduler.setTimeFunc([&]() { return cur_time; });
+		scheduler.setBudget(5000);
+
+		// Initial estimate allows 1 MB in 5 ms.
+		scheduler.beginFrame();
+		const size_t initial_max_bytes = scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 0, 1 << 30);
+		testAssert(initial_max_bytes >= 1024 * 1024 - 16 && initial_max_bytes <= 1024 * 1024 + 16);
+
+		// Uploads are measured as taking 1 ms per MB.  The estimate should converge to that.
+		for(int i=0; i<100; ++i)
+			scheduler.recordWork(WorkType_MeshUpload, /*num_units=*/1024 * 1024, /*time_us=*/1000);
+		testAssert(epsEqual(scheduler.getCostPerUnit(WorkType_MeshUpload), 1000.0 / (1024 * 1024), 1.0e-6));
+		testAssert(scheduler.getCostPerUnit(WorkType_TextureUpload) == INITIAL_UPLOAD_COST_PER_BYTE_US); // Other types should be unaffected.
+
+		const size_t max_bytes = scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 0, 1 << 30);
+		testAssert(max_bytes >= 5 * 1024 * 1024 - 16 && max_bytes <= 5 * 1024 * 1024 + 16);
+
+		// Should be clamped to max_units.
+		testAssert(scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 0, 1000) == 1000);
+
+		// After using 4 ms, there is room for about 1 MB.
+		cur_time += 4000 * 1.0e-6;
+		const size_t max_bytes_2 = scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 0, 1 << 30);
+		testAssert(max_bytes_2 >= 1024 * 1024 - 16 && max_bytes_2 <= 1024 * 1024 + 16);
+
+		// When out of time, should return min_units.
+		cur_time += 2000 * 1.0e-6;
+		testAssert(scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 65536, 1 << 30) == 65536);
+		testAssert(scheduler.getMaxUnitsForRemainingTime(WorkType_MeshUpload, 65536, 1000) == 1000);
+
+		// Zero measurements shouldn't change the estimate.
+		scheduler.recordWork(WorkType_TextureUpload, 0, 1000);
+		testAssert(scheduler.getCostPerUnit(WorkType_TextureUpload) == INITIAL_UPLOAD_COST_PER_BYTE_US);
+		scheduler.endFrame();
+	}
+
+	conPrint("MainThreadWorkScheduler::test() done.");
+}
+
+
+#endif // BUILD_TESTS
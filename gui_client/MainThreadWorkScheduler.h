@@ -0,0 +1,132 @@
+/*=====================================================================
+MainThreadWorkScheduler.h
+-------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/RefCounted.h>
+#include <utils/Reference.h>
+#include <utils/Platform.h>
+#include <string>
+#include <deque>
+#include <functional>
+
+
+class MainThreadWorkScheduler;
+
+
+/*=====================================================================
+MainThreadTask
+--------------
+A piece of main-thread work that can be split into units, and resumed next frame if it runs out of time.
+=====================================================================*/
+class MainThreadTask : public RefCounted
+{
+public:
+	virtual ~MainThreadTask() {}
+
+	// Do some units of work, checking scheduler.hasTimeRemaining() after each unit, and returning when there is no time remaining.
+	// Should do at least one unit of work per call, so the task always makes progress.
+	// Returns true if the task is finished, false if it should be resumed later.
+	virtual bool run(MainThreadWorkScheduler& scheduler) = 0;
+};
+typedef Reference<MainThreadTask> MainThreadTaskRef;
+
+
+/*=====================================================================
+MainThreadWorkScheduler
+-----------------------
+Limits the time spent each frame finalising loaded resources on the main thread (uploading mesh and texture data to the GPU,
+creating OpenGL and physics objects, loading scripts etc.) to a per-frame budget, so that streaming in lots of resources doesn't
+cause frame time spikes.
+
+Each frame, beginFrame() is called, then work is done while hasTimeRemaining() is true, then endFrame() is called.
+Work that may take longer than the budget is split into MainThreadTasks, which are resumed next frame if they run out of time.
+
+Also keeps an estimate of the cost of each type of chunked work (e.g. microseconds per byte uploaded to the GPU), so that chunks
+can be sized to fit in the remaining time (see getMaxUnitsForRemainingTime()),
+and keeps stats of time used, and of frames where the budget was overrun.
+
+Times are in microseconds.  Not threadsafe, should just be used on the main thread.
+=====================================================================*/
+class MainThreadWorkScheduler
+{
+public:
+	MainThreadWorkScheduler();
+	~MainThreadWorkScheduler();
+
+	enum WorkType
+	{
+		WorkType_MeshUpload = 0, // Units are bytes
+		WorkType_TextureUpload, // Units are bytes
+		NUM_WORK_TYPES
+	};
+
+	void setBudget(double budget_us_) { budget_us = budget_us_; }
+	double getBudget() const { return budget_us; }
+
+	// Sets the function used to get the current time, in seconds.  Defaults to Clock::getTimeSinceInit().  Used in tests.
+	void setTimeFunc(const std::function<double()>& time_func_) { time_func = time_func_; }
+
+	void beginFrame();
+	void endFrame();
+
+	inline bool hasTimeRemaining() const { return getElapsedThisFrame() < budget_us; }
+	double getElapsedThisFrame() const;
+
+	//----------------------------------- Tasks ----------------------------------------
+	void addTask(const MainThreadTaskRef& task) { tasks.push_back(task); }
+	bool hasPendingTasks() const { return !tasks.empty(); }
+	size_t getNumPendingTasks() const { return tasks.size(); }
+	void clearTasks() { tasks.clear(); }
+
+	// Runs pending tasks in the order they were added, until they are all finished or there is no time remaining.
+	void runTasks();
+	//----------------------------------------------------------------------------------------
+
+	//----------------------------------- Chunk sizing ----------------------------------------
+	// Record that some units of work of the given type took time_us.  Updates the cost estimate for the work type.
+	void recordWork(WorkType type, size_t num_units, double time_us);
+
+	// Estimated cost of one unit of work of the given type.
+	double getCostPerUnit(WorkType type) const { return cost_per_unit_us[type]; }
+
+	// Returns the number of units of work of the given type that are estimated to fit in the remaining time this frame, clamped to [min_units, max_units].
+	// If min_units > max_units, returns max_units.
+	size_t getMaxUnitsForRemainingTime(WorkType type, size_t min_units, size_t max_units) const;
+	//----------------------------------------------------------------------------------------
+
+	//----------------------------------- Diagnostics ----------------------------------------
+	struct Stats
+	{
+		Stats();
+
+		uint64 num_frames;
+		uint64 num_overrun_frames; // Number of frames where the time used was more than the budget.
+		double total_overrun_us;
+		double max_overrun_us;
+		double last_frame_time_us; // Time between beginFrame() and endFrame() for the last frame.
+		double max_frame_time_us;
+		double max_task_run_time_us; // Longest single MainThreadTask::run() call.
+		uint64 num_tasks_finished;
+		uint64 num_task_resumes; // Number of times a task ran out of time and was resumed later.
+	};
+
+	const Stats& getStats() const { return stats; }
+	void resetStats() { stats = Stats(); }
+
+	std::string getDiagnostics() const;
+	//----------------------------------------------------------------------------------------
+
+	static void test();
+
+private:
+	double budget_us;
+	std::function<double()> time_func;
+	double frame_start_time; // In seconds, from time_func.
+	std::deque<MainThreadTaskRef> tasks;
+	double cost_per_unit_us[NUM_WORK_TYPES];
+	Stats stats;
+};
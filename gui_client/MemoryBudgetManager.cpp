@@ -0,0 +1,553 @@
+/*=====================================================================
+MemoryBudgetManager.cpp
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "MemoryBudgetManager.h"
+
+
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+#include <limits>
+
+
+static const float DISTANCE_SCALE = 100.f; // Distance (m) at which the reuse likelihood is halved.
+static const float TIME_SCALE = 60.f; // Time since last use (s) at which the reuse likelihood is halved.
+static const float SCREEN_SIZE_WEIGHT = 4.f;
+
+
+MemoryBudgetManager::MemoryBudgetManager()
+:	num_eviction_passes(0),
+	num_evictions(0),
+	num_eviction_scans(0),
+	budget(2048ull * 1024 * 1024),
+	hysteresis_fraction(0.1f),
+	min_unused_time(2.0),
+	next_eviction_scan_time(-1)
+{
+	for(int i=0; i<NUM_ASSET_CLASSES; ++i)
+	{
+		class_usage_B[i] = 0;
+		class_unused_B[i] = 0;
+		external_usage_B[i] = 0;
+	}
+
+	// Rough reload costs.  Meshes are loaded from the processed mesh cache, physics shapes have to be rebuilt, which is relatively slow.
+	setReloadCost(AssetClass_Mesh,			/*fixed_cost_s=*/0.005f, /*cost_per_MB_s=*/0.02f);
+	setReloadCost(AssetClass_PhysicsShape,	/*fixed_cost_s=*/0.002f, /*cost_per_MB_s=*/0.05f);
+	setReloadCost(AssetClass_Texture,		/*fixed_cost_s=*/0.005f, /*cost_per_MB_s=*/0.03f);
+	setReloadCost(AssetClass_Audio,			/*fixed_cost_s=*/0.005f, /*cost_per_MB_s=*/0.01f);
+}
+
+
+MemoryBudgetManager::~MemoryBudgetManager()
+{}
+
+
+const char* MemoryBudgetManager::assetClassName(int asset_class)
+{
+	switch(asset_class)
+	{
+	case AssetClass_Mesh: return "meshes";
+	case AssetClass_PhysicsShape: return "physics shapes";
+	case AssetClass_Texture: return "textures";
+	case AssetClass_Audio: return "audio";
+	default: return "unknown";
+	}
+}
+
+
+void MemoryBudgetManager::setReloadCost(int asset_class, float fixed_cost_s, float cost_per_MB_s)
+{
+	assert(asset_class >= 0 && asset_class < NUM_ASSET_CLASSES);
+	reload_costs[asset_class].fixed_cost_s = fixed_cost_s;
+	reload_costs[asset_class].cost_per_MB_s = cost_per_MB_s;
+}
+
+
+void MemoryBudgetManager::addAsset(int asset_class, const std::string& key, uint64 size_B, double cur_time)
+{
+	assert(asset_class >= 0 && asset_class < NUM_ASSET_CLASSES);
+
+	auto res = assets[asset_class].find(key);
+	if(res != assets[asset_class].end())
+	{
+		setAssetSize(asset_class, key, size_B);
+		return;
+	}
+
+	AssetInfo info;
+	info.size_B = size_B;
+	info.last_used_time = cur_time;
+	info.distance = 0;
+	info.screen_size = 0;
+	info.used = false;
+	assets[asset_class].insert(std::make_pair(key, info));
+
+	class_usage_B[asset_class] += size_B;
+	class_unused_B[asset_class] += size_B;
+
+	next_eviction_scan_time = myMin(next_eviction_scan_time, cur_time + min_unused_time);
+}
+
+
+void MemoryBudgetManager::removeAsset(int asset_class, const std::string& key)
+{
+	auto res = assets[asset_class].find(key);
+	if(res != assets[asset_class].end())
+	{
+		const AssetInfo& info = res->second;
+		assert(class_usage_B[asset_class] >= info.size_B);
+		class_usage_B[asset_class] -= info.size_B;
+		if(!info.used)
+		{
+			assert(class_unused_B[asset_class] >= info.size_B);
+			class_unused_B[asset_class] -= info.size_B;
+		}
+		assets[asset_class].erase(res);
+	}
+}
+
+
+void MemoryBudgetManager::setAssetSize(int asset_class, const std::string& key, uint64 size_B)
+{
+	auto res = assets[asset_class].find(key);
+	if(res != assets[asset_class].end())
+	{
+		AssetInfo& info = res->second;
+		class_usage_B[asset_class] = class_usage_B[asset_class] - info.size_B + size_B;
+		if(!info.used)
+			class_unused_B[asset_class] = class_unused_B[asset_class] - info.size_B + size_B;
+		info.size_B = size_B;
+	}
+}
+
+
+void MemoryBudgetManager::setAssetUsed(int asset_class, const std::string& key, bool used, double cur_time)
+{
+	auto res = assets[asset_class].find(key);
+	if(res != assets[asset_class].end())
+	{
+		AssetInfo& info = res->second;
+		if(info.used != used)
+		{
+			if(used)
+				class_unused_B[asset_class] -= info.size_B;
+			else
+				class_unused_B[asset_class] += info.size_B;
+			info.used = used;
+		}
+		info.last_used_time = cur_time;
+
+		if(!used)
+			next_eviction_scan_time = myMin(next_eviction_scan_time, cur_time + min_unused_time);
+	}
+}
+
+
+bool MemoryBudgetManager::isAssetUsed(int asset_class, const std::string& key) const
+{
+	auto res = assets[asset_class].find(key);
+	return (res != assets[asset_class].end()) && res->second.used;
+}
+
+
+void MemoryBudgetManager::setAssetUseInfo(int asset_class, const std::string& key, float distance, float screen_size)
+{
+	auto res = assets[asset_class].find(key);
+	if(res != assets[asset_class].end())
+	{
+		res->second.distance = distance;
+		res->second.screen_size = screen_size;
+	}
+}
+
+
+void MemoryBudgetManager::setExternalUsage(int asset_class, uint64 size_B)
+{
+	external_usage_B[asset_class] = size_B;
+}
+
+
+uint64 MemoryBudgetManager::getTotalUsage() const
+{
+	uint64 total = 0;
+	for(int i=0; i<NUM_ASSET_CLASSES; ++i)
+		total += class_usage_B[i] + external_usage_B[i];
+	return total;
+}
+
+
+uint64 MemoryBudgetManager::getManagedUsage() const
+{
+	uint64 total = 0;
+	for(int i=0; i<NUM_ASSET_CLASSES; ++i)
+		total += class_usage_B[i];
+	return total;
+}
+
+
+// Utility of keeping an unused asset in memory, per byte.
+// This is the estimated likelihood of the asset being used again, times the estimated cost of reloading it if it were evicted, divided by its size.
+float MemoryBudgetManager::computeUtilityPerByte(int asset_class, const AssetInfo& info, double cur_time) const
+{
+	const float time_since_use = (float)myMax(0.0, cur_time - info.last_used_time);
+
+	const float reuse_likelihood = (1.f + info.screen_size * SCREEN_SIZE_WEIGHT) / ((1.f + info.distance / DISTANCE_SCALE) * (1.f + time_since_use / TIME_SCALE));
+
+	const float size_MB = (float)info.size_B * (1.f / (1024 * 1024));
+	const float reload_cost_s = reload_costs[asset_class].fixed_cost_s + size_MB * reload_costs[asset_class].cost_per_MB_s;
+
+	return reuse_likelihood * reload_cost_s / (float)myMax<uint64>(1, info.size_B);
+}
+
+
+struct EvictionCandidate
+{
+	float utility_per_B;
+	int asset_class;
+	const std::string* key;
+	uint64 size_B;
+};
+
+
+void MemoryBudgetManager::computeEvictions(double cur_time, std::vector<MemoryBudgetEviction>& evictions_out)
+{
+	uint64 total_usage = getManagedUsage();
+	if(total_usage <= budget)
+		return;
+
+	uint64 total_unused_B = 0;
+	for(int i=0; i<NUM_ASSET_CLASSES; ++i)
+		total_unused_B += class_unused_B[i];
+	if(total_unused_B == 0) // If there is nothing we can evict:
+		return;
+
+	// If the last scan couldn't get under the budget, don't scan again until some cached asset has been unused for long enough to be evicted.
+	if(cur_time < next_eviction_scan_time)
+		return;
+
+	const uint64 target_usage = budget - myMin(budget, (uint64)((double)budget * hysteresis_fraction));
+
+	num_eviction_scans++;
+	double earliest_evictable_time = std::numeric_limits<double>::infinity(); // Earliest time an unused asset that is too recently used to evict now becomes evictable.
+	std::vector<EvictionCandidate> candidates;
+	for(int c=0; c<NUM_ASSET_CLASSES; ++c)
+	{
+		if(class_unused_B[c] == 0)
+			continue;
+		for(auto it = assets[c].begin(); it != assets[c].end(); ++it)
+		{
+			const AssetInfo& info = it->second;
+			if(!info.used && (cur_time - info.last_used_time < min_unused_time))
+				earliest_evictable_time = myMin(earliest_evictable_time, info.last_used_time + min_unused_time);
+			else if(!info.used)
+			{
+				EvictionCandidate candidate;
+				candidate.utility_per_B = computeUtilityPerByte(c, info, cur_time);
+				candidate.asset_class = c;
+				candidate.key = &it->first;
+				candidate.size_B = info.size_B;
+				candidates.push_back(candidate);
+			}
+		}
+	}
+
+	std::sort(candidates.begin(), candidates.end(), [](const EvictionCandidate& a, const EvictionCandidate& b) { return a.utility_per_B < b.utility_per_B; });
+
+	const size_t initial_num_evictions = evictions_out.size();
+	for(size_t i=0; (i<candidates.size()) && (total_usage > target_usage); ++i)
+	{
+		MemoryBudgetEviction eviction;
+		eviction.asset_class = candidates[i].asset_class;
+		eviction.key = *candidates[i].key;
+		evictions_out.push_back(eviction);
+
+		total_usage -= candidates[i].size_B;
+	}
+
+	// Remove evicted assets.  Do this after the loop above, since candidates has pointers to the keys in the asset maps.
+	for(size_t i=initial_num_evictions; i<evictions_out.size(); ++i)
+		removeAsset(evictions_out[i].asset_class, evictions_out[i].key);
+
+	// If we are still over the budget, every evictable asset has been evicted, so there is no point scanning again until another asset becomes evictable.
+	// addAsset() and setAssetUsed() bring this forwards for assets that become unused after now.
+	next_eviction_scan_time = (total_usage > budget) ? earliest_evictable_time : -1;
+
+	if(evictions_out.size() > initial_num_evictions)
+	{
+		num_eviction_passes++;
+		num_evictions += evictions_out.size() - initial_num_evictions;
+	}
+}
+
+
+std::string MemoryBudgetManager::getDiagnostics() const
+{
+	std::string s;
+	s += "---Memory Budget Manager---\n";
+	s += "budget:                 " + getMBSizeString(budget) + "\n";
+	s += "total usage:            " + getMBSizeString(getTotalUsage()) + " (" + getMBSizeString(getManagedUsage()) + " managed)\n";
+	for(int i=0; i<NUM_ASSET_CLASSES; ++i)
+		s += std::string(assetClassName(i)) + ": " + toString(assets[i].size()) + " assets, " + getMBSizeString(class_usage_B[i]) + " (" + getMBSizeString(class_unused_B[i]) + " cached), external: " + getMBSizeString(external_usage_B[i]) + "\n";
+	s += "eviction passes:        " + toString(num_eviction_passes) + ", evictions: " + toString(num_evictions) + ", scans: " + toString(num_eviction_scans) + "\n";
+	s += "---------------------------\n";
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+struct MemBudgetSimResults
+{
+	uint64 num_reloads; // Number of times an asset needed by the camera had been evicted.
+	uint64 num_eviction_passes;
+	uint64 max_usage_over_budget_B; // Max amount the usage was over the budget after computeEvictions(), when there were cached assets that could have been evicted.
+};
+
+
+// Simulates a camera moving back and forth along a line of assets.  Assets within use_radius of the camera are used, and are loaded if they are not present.
+static MemBudgetSimResults simulateMemoryBudget(MemoryBudgetManager& manager, int num_assets, uint64 asset_size_B, float use_radius, int num_steps)
+{
+	MemBudgetSimResults results;
+	results.num_reloads = 0;
+	results.max_usage_over_budget_B = 0;
+
+	std::vector<bool> used(num_assets, false);
+	std::vector<MemoryBudgetEviction> evictions;
+	double time = 0;
+	for(int step=0; step<num_steps; ++step)
+	{
+		time += 0.1;
+
+		// Move camera back and forth along the line.
+		const int period = 2 * num_assets;
+		const int phase = step % period;
+		const float cam_pos = (float)((phase < num_assets) ? phase : (period - phase));
+
+		for(int i=0; i<num_assets; ++i)
+		{
+			const MemoryBudgetManager::AssetClass asset_class = (i % 2 == 0) ? MemoryBudgetManager::AssetClass_Mesh : MemoryBudgetManager::AssetClass_PhysicsShape;
+			const std::string key = toString(i);
+			const float dist = std::fabs((float)i - cam_pos);
+			const bool should_use = dist <= use_radius;
+			if(should_use && !used[i])
+			{
+				if(!manager.isAssetPresent(asset_class, key))
+				{
+					results.num_reloads++;
+					manager.addAsset(asset_class, key, asset_size_B, time);
+				}
+				manager.setAssetUsed(asset_class, key, true, time);
+				used[i] = true;
+			}
+			else if(!should_use && used[i])
+			{
+				manager.setAssetUseInfo(asset_class, key, dist, /*screen_size=*/1.f / myMax(1.f, dist));
+				manager.setAssetUsed(asset_class, key, false, time);
+				used[i] = false;
+			}
+		}
+
+		evictions.clear();
+		manager.computeEvictions(time, evictions);
+
+		bool have_evictable_assets = false;
+		for(int c=0; c<MemoryBudgetManager::NUM_ASSET_CLASSES; ++c)
+			have_evictable_assets = have_evictable_assets || (manager.getClassCachedUsage(c) > 0);
+		if(have_evictable_assets && manager.getTotalUsage() > manager.getBudget())
+			results.max_usage_over_budget_B = myMax(results.max_usage_over_budget_B, manager.getTotalUsage() - manager.getBudget());
+	}
+
+	results.num_eviction_passes = manager.num_eviction_passes;
+	return results;
+}
+
+
+void MemoryBudgetManager::test()
+{
+	conPrint("MemoryBudgetManager::test()");
+
+	const uint64 MB = 1024 * 1024;
+
+	//-------------------- Test basic bookkeeping --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(100 * MB);
+		manager.addAsset(AssetClass_Mesh, "a", 10 * MB, /*cur_time=*/0);
+		manager.addAsset(AssetClass_PhysicsShape, "a", 5 * MB, /*cur_time=*/0);
+		testAssert(manager.getTotalUsage() == 15 * MB);
+		testAssert(manager.getClassCachedUsage(AssetClass_Mesh) == 10 * MB);
+
+		manager.setAssetUsed(AssetClass_Mesh, "a", true, 0);
+		manager.setAssetUsed(AssetClass_Mesh, "a", true, 0);
+		testAssert(manager.getClassCachedUsage(AssetClass_Mesh) == 0);
+
+		manager.setAssetSize(AssetClass_Mesh, "a", 20 * MB);
+		testAssert(manager.getClassUsage(AssetClass_Mesh) == 20 * MB);
+		testAssert(manager.getClassCachedUsage(AssetClass_Mesh) == 0);
+
+		manager.setExternalUsage(AssetClass_Texture, 30 * MB);
+		testAssert(manager.getTotalUsage() == 55 * MB);
+
+		manager.removeAsset(AssetClass_Mesh, "a");
+		manager.removeAsset(AssetClass_Mesh, "a"); // Removing a missing asset should do nothing.
+		testAssert(manager.getClassUsage(AssetClass_Mesh) == 0);
+		testAssert(manager.getTotalUsage() == 35 * MB);
+
+		// Should be under budget, so nothing evicted.
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/100, evictions);
+		testAssert(evictions.empty());
+	}
+
+	//-------------------- Test that used assets and recently used assets aren't evicted --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(10 * MB);
+		manager.addAsset(AssetClass_Mesh, "used", 20 * MB, 0);
+		manager.setAssetUsed(AssetClass_Mesh, "used", true, 0);
+		manager.addAsset(AssetClass_Mesh, "recent", 1 * MB, 0);
+		manager.setAssetUsed(AssetClass_Mesh, "recent", false, /*cur_time=*/9.5);
+
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/10, evictions);
+		testAssert(evictions.empty());
+
+		manager.computeEvictions(/*cur_time=*/20, evictions);
+		testAssert(evictions.size() == 1 && evictions[0].key == "recent");
+		testAssert(!manager.isAssetPresent(AssetClass_Mesh, "recent"));
+	}
+
+	//-------------------- Test that external usage doesn't cause evictions, as it can't be evicted --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(100 * MB);
+		manager.addAsset(AssetClass_Mesh, "a", 50 * MB, 0);
+		manager.setExternalUsage(AssetClass_Texture, 200 * MB);
+		testAssert(manager.getTotalUsage() == 250 * MB);
+		testAssert(manager.getManagedUsage() == 50 * MB);
+
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/100, evictions);
+		testAssert(evictions.empty());
+		testAssert(manager.num_eviction_scans == 0);
+	}
+
+	//-------------------- Test that scans are skipped until something becomes evictable --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(10 * MB);
+		manager.setMinUnusedTimeBeforeEviction(2.0);
+		manager.addAsset(AssetClass_Mesh, "used", 20 * MB, 0);
+		manager.setAssetUsed(AssetClass_Mesh, "used", true, 0);
+		manager.addAsset(AssetClass_Mesh, "a", 1 * MB, /*cur_time=*/0);
+
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/1, evictions); // "a" is too recently used to evict.
+		testAssert(evictions.empty() && manager.num_eviction_scans == 1);
+
+		manager.computeEvictions(/*cur_time=*/1.5, evictions); // Nothing is evictable until time 2, so shouldn't scan.
+		testAssert(evictions.empty() && manager.num_eviction_scans == 1);
+
+		manager.computeEvictions(/*cur_time=*/2.5, evictions);
+		testAssert(evictions.size() == 1 && evictions[0].key == "a" && manager.num_eviction_scans == 2);
+
+		// Still over the budget, with nothing cached, so adding an asset should allow a scan once it is old enough.
+		evictions.clear();
+		manager.addAsset(AssetClass_Mesh, "b", 1 * MB, /*cur_time=*/3);
+		manager.computeEvictions(/*cur_time=*/3.1, evictions);
+		testAssert(evictions.empty() && manager.num_eviction_scans == 2);
+
+		manager.computeEvictions(/*cur_time=*/5, evictions);
+		testAssert(evictions.size() == 1 && evictions[0].key == "b" && manager.num_eviction_scans == 3);
+	}
+
+	//-------------------- Test that eviction is global over classes, and uses utility --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(100 * MB);
+		manager.setHysteresisFraction(0);
+
+		// A large, far away, long-unused texture-like asset, and a nearby recently used mesh.
+		manager.addAsset(AssetClass_Audio, "far", 60 * MB, 0);
+		manager.setAssetUseInfo(AssetClass_Audio, "far", /*distance=*/1000, /*screen_size=*/0);
+		manager.addAsset(AssetClass_Mesh, "near", 60 * MB, 95);
+		manager.setAssetUseInfo(AssetClass_Mesh, "near", /*distance=*/5, /*screen_size=*/1);
+
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/100, evictions);
+		testAssert(evictions.size() == 1);
+		testAssert(evictions[0].asset_class == AssetClass_Audio && evictions[0].key == "far");
+		testAssert(manager.isAssetPresent(AssetClass_Mesh, "near"));
+	}
+
+	//-------------------- Test hysteresis --------------------
+	{
+		MemoryBudgetManager manager;
+		manager.setBudget(100 * MB);
+		manager.setHysteresisFraction(0.2f);
+		for(int i=0; i<30; ++i)
+			manager.addAsset(AssetClass_Mesh, toString(i), 4 * MB, /*cur_time=*/i);
+
+		std::vector<MemoryBudgetEviction> evictions;
+		manager.computeEvictions(/*cur_time=*/100, evictions);
+		testAssert(manager.getTotalUsage() <= 80 * MB); // Should have evicted down to 80% of the budget.
+		testAssert(evictions.size() == 10);
+		// Oldest assets should have been evicted first.
+		for(size_t i=0; i<evictions.size(); ++i)
+			testAssert(stringToInt(evictions[i].key) < 10);
+
+		// Adding a bit more shouldn't trigger more evictions until we are over the budget again.
+		evictions.clear();
+		manager.addAsset(AssetClass_Mesh, "new", 4 * MB, 100);
+		manager.computeEvictions(/*cur_time=*/100, evictions);
+		testAssert(evictions.empty());
+	}
+
+	//-------------------- Simulation: camera moving through a dense area --------------------
+	{
+		// The assets in range need 40 MB, and the budget is 100 MB, so there is room to cache some assets.
+		const int num_assets = 200;
+		const uint64 asset_size_B = 2 * MB;
+		const float use_radius = 10;
+		const int num_steps = 4000;
+
+		MemoryBudgetManager manager;
+		manager.setBudget(100 * MB);
+		manager.setHysteresisFraction(0.1f);
+		manager.setMinUnusedTimeBeforeEviction(0.5);
+		const MemBudgetSimResults results = simulateMemoryBudget(manager, num_assets, asset_size_B, use_radius, num_steps);
+
+		MemoryBudgetManager no_hysteresis_manager;
+		no_hysteresis_manager.setBudget(100 * MB);
+		no_hysteresis_manager.setHysteresisFraction(0);
+		no_hysteresis_manager.setMinUnusedTimeBeforeEviction(0.5);
+		const MemBudgetSimResults no_hysteresis_results = simulateMemoryBudget(no_hysteresis_manager, num_assets, asset_size_B, use_radius, num_steps);
+
+		conPrint("With hysteresis:    reloads: " + toString(results.num_reloads) + ", eviction passes: " + toString(results.num_eviction_passes));
+		conPrint("Without hysteresis: reloads: " + toString(no_hysteresis_results.num_reloads) + ", eviction passes: " + toString(no_hysteresis_results.num_eviction_passes));
+
+		// Usage shouldn't stay over the budget (apart from assets used too recently to be evicted).
+		testAssert(results.max_usage_over_budget_B <= 4 * asset_size_B);
+		testAssert(manager.getTotalUsage() <= manager.getBudget());
+
+		// Hysteresis should batch up evictions.
+		testAssert(results.num_eviction_passes * 2 < no_hysteresis_results.num_eviction_passes);
+
+		// Every asset has to be loaded at least once per pass over the line, but assets shouldn't be reloaded much more than that.
+		const uint64 num_passes = num_steps / num_assets + 1;
+		testAssert(results.num_reloads <= num_passes * num_assets);
+	}
+
+	conPrint("MemoryBudgetManager::test() done.");
+}
+
+
+#endif // BUILD_TESTS
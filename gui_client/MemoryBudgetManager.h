@@ -0,0 +1,131 @@
+/*=====================================================================
+MemoryBudgetManager.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/Platform.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+
+struct MemoryBudgetEviction
+{
+	int asset_class; // MemoryBudgetManager::AssetClass
+	std::string key;
+};
+
+
+/*=====================================================================
+MemoryBudgetManager
+-------------------
+Keeps track of the memory used by loaded assets (meshes, physics shapes etc.) across all asset classes,
+and decides which cached (unused) assets to evict when the total is over a single memory budget.
+
+Eviction decisions are made globally, so one class of asset can't fill the budget while more useful assets
+of another class are evicted.  Cached assets are evicted in order of increasing utility per byte, where the utility
+is an estimate of how likely the asset is to be used again (from the distance and screen size where it was last used,
+and how long ago that was), times the cost of reloading it.
+
+To avoid evicting a few assets every frame when hovering around the budget, eviction starts when the total usage goes
+over the budget, and then continues until usage is hysteresis_fraction below the budget.
+
+Memory used by caches that manage their own eviction (e.g. the texture server) can be reported with setExternalUsage().
+It is included in getTotalUsage() and the diagnostics, but not in the usage compared against the budget, as we can't evict it:
+counting it would make us evict every cached mesh each pass whenever the external caches alone were near the budget.
+
+Scanning for eviction candidates is skipped when it couldn't find anything new to evict: after a pass that couldn't get
+under the budget, the next scan waits until the earliest time a cached asset becomes old enough to evict.
+
+Only does bookkeeping - the owners of the assets do the actual evictions.  Not threadsafe, should just be used on the main thread.
+=====================================================================*/
+class MemoryBudgetManager
+{
+public:
+	MemoryBudgetManager();
+	~MemoryBudgetManager();
+
+	enum AssetClass
+	{
+		AssetClass_Mesh = 0,
+		AssetClass_PhysicsShape,
+		AssetClass_Texture,
+		AssetClass_Audio,
+		NUM_ASSET_CLASSES
+	};
+
+	static const char* assetClassName(int asset_class);
+
+	void setBudget(uint64 budget_B) { budget = budget_B; }
+	uint64 getBudget() const { return budget; }
+
+	void setHysteresisFraction(float f) { hysteresis_fraction = f; }
+
+	// Assets that have been unused for less than this time are not evicted.
+	void setMinUnusedTimeBeforeEviction(double t) { min_unused_time = t; next_eviction_scan_time = -1; }
+
+	// Estimated time to reload an asset of the class, is fixed_cost_s + size in MB * cost_per_MB_s.
+	void setReloadCost(int asset_class, float fixed_cost_s, float cost_per_MB_s);
+
+	// Assets are added as unused.
+	void addAsset(int asset_class, const std::string& key, uint64 size_B, double cur_time);
+	void removeAsset(int asset_class, const std::string& key);
+	void setAssetSize(int asset_class, const std::string& key, uint64 size_B);
+	void setAssetUsed(int asset_class, const std::string& key, bool used, double cur_time);
+
+	// Sets the distance from the camera, and the screen size (approx. projected length / distance) where the asset was last used.  Does nothing if the asset hasn't been added.
+	void setAssetUseInfo(int asset_class, const std::string& key, float distance, float screen_size);
+
+	void setExternalUsage(int asset_class, uint64 size_B);
+
+	// If the total usage is over the budget, chooses cached assets to evict, removes them from the manager, and appends them to evictions_out.
+	void computeEvictions(double cur_time, std::vector<MemoryBudgetEviction>& evictions_out);
+
+	uint64 getTotalUsage() const; // Including external usage.
+	uint64 getManagedUsage() const; // Usage of added assets, which is what is compared against the budget.
+	uint64 getClassUsage(int asset_class) const { return class_usage_B[asset_class] + external_usage_B[asset_class]; }
+	uint64 getClassCachedUsage(int asset_class) const { return class_unused_B[asset_class]; }
+	size_t getNumAssets(int asset_class) const { return assets[asset_class].size(); }
+	bool isAssetPresent(int asset_class, const std::string& key) const { return assets[asset_class].count(key) != 0; }
+	bool isAssetUsed(int asset_class, const std::string& key) const;
+
+	std::string getDiagnostics() const;
+
+	static void test();
+
+	uint64 num_eviction_passes; // Number of times computeEvictions() evicted something.
+	uint64 num_evictions;
+	uint64 num_eviction_scans; // Number of times computeEvictions() scanned all assets for candidates.
+
+private:
+	struct AssetInfo
+	{
+		uint64 size_B;
+		double last_used_time; // Time the asset was last used, or when it became unused if it is unused.
+		float distance;
+		float screen_size;
+		bool used;
+	};
+
+	struct ReloadCost
+	{
+		float fixed_cost_s;
+		float cost_per_MB_s;
+	};
+
+	float computeUtilityPerByte(int asset_class, const AssetInfo& info, double cur_time) const;
+
+	std::unordered_map<std::string, AssetInfo> assets[NUM_ASSET_CLASSES];
+	uint64 class_usage_B[NUM_ASSET_CLASSES]; // Sum of sizes of added assets of each class.
+	uint64 class_unused_B[NUM_ASSET_CLASSES]; // Sum of sizes of unused (cached) assets of each class.
+	uint64 external_usage_B[NUM_ASSET_CLASSES];
+	ReloadCost reload_costs[NUM_ASSET_CLASSES];
+
+	uint64 budget;
+	float hysteresis_fraction;
+	double min_unused_time;
+	double next_eviction_scan_time; // If we are over budget, don't scan for candidates before this time, as nothing more will be evictable before then.
+};
@@ -6,9 +6,12 @@ Copyright Glare Technologies Limited 2022 -
 #include "MeshManager.h"
 
 
+#include "MemoryBudgetManager.h"
 #include <opengl/OpenGLEngine.h>
 #include <opengl/OpenGLMeshRenderData.h>
 #include <utils/PlatformUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Clock.h>
 
 
 void MeshData::meshDataBecameUsed() const
@@ -48,12 +51,19 @@ inline void MeshManager::checkRunningOnMainThread()
 }
 
 
+static inline uint64 meshBudgetSize(const GLMemUsage& mem_usage)
+{
+	return mem_usage.geom_cpu_usage + mem_usage.geom_gpu_usage;
+}
+
+
 
 MeshManager::MeshManager()
 {
 #if !defined(EMSCRIPTEN)
 	main_thread_id = PlatformUtils::getCurrentThreadID();
 #endif
+	budget_manager = NULL;
 	mesh_CPU_mem_usage = 0;
 	mesh_GPU_mem_usage = 0;
 	shape_mem_usage = 0;
@@ -74,10 +84,18 @@ void MeshManager::clear()
 
 	// Before we clear model_URL_to_mesh_map, NULL out references to mesh_manager so meshDataBecameUnused() doesn't trigger.
 	for(auto it = model_URL_to_mesh_map.begin(); it != model_URL_to_mesh_map.end(); ++it)
-		it->second.value->mesh_manager = NULL;
+	{
+		it->second->mesh_manager = NULL;
+		if(budget_manager)
+			budget_manager->removeAsset(MemoryBudgetManager::AssetClass_Mesh, it->first);
+	}
 
 	for(auto it = physics_shape_map.begin(); it != physics_shape_map.end(); ++it)
-		it->second.value->mesh_manager = NULL;
+	{
+		it->second->mesh_manager = NULL;
+		if(budget_manager)
+			budget_manager->removeAsset(MemoryBudgetManager::AssetClass_PhysicsShape, physicsShapeBudgetKey(it->first));
+	}
 
 	model_URL_to_mesh_map.clear();
 	physics_shape_map.clear();
@@ -88,6 +106,19 @@ void MeshManager::clear()
 }
 
 
+void MeshManager::setMemoryBudgetManager(MemoryBudgetManager* budget_manager_)
+{
+	assert(model_URL_to_mesh_map.empty() && physics_shape_map.empty());
+	budget_manager = budget_manager_;
+}
+
+
+std::string MeshManager::physicsShapeBudgetKey(const MeshManagerPhysicsShapeKey& key)
+{
+	return (key.dynamic_physics_shape ? "dyn:" : "static:") + key.URL;
+}
+
+
 Reference<MeshData> MeshManager::insertMesh(const std::string& model_url, const Reference<OpenGLMeshRenderData>& gl_meshdata)
 {
 	checkRunningOnMainThread();
@@ -106,11 +137,14 @@ Reference<MeshData> MeshManager::insertMesh(const std::string& model_url, const
 		mesh_CPU_mem_usage += mesh_mem_usage.geom_cpu_usage;
 		mesh_GPU_mem_usage += mesh_mem_usage.geom_gpu_usage;
 
+		if(budget_manager)
+			budget_manager->addAsset(MemoryBudgetManager::AssetClass_Mesh, model_url, meshBudgetSize(mesh_mem_usage), Clock::getTimeSinceInit());
+
 		return mesh_data;
 	}
 	else
 	{
-		return res->second.value;
+		return res->second;
 	}
 }
 
@@ -129,11 +163,14 @@ Reference<PhysicsShapeData> MeshManager::insertPhysicsShape(const MeshManagerPhy
 		// Add to running total of memory used
 		shape_mem_usage += shape_data->physics_shape.size_B;
 
+		if(budget_manager)
+			budget_manager->addAsset(MemoryBudgetManager::AssetClass_PhysicsShape, physicsShapeBudgetKey(key), shape_data->physics_shape.size_B, Clock::getTimeSinceInit());
+
 		return shape_data;
 	}
 	else
 	{
-		return res->second.value;
+		return res->second;
 	}
 }
 
@@ -144,7 +181,7 @@ Reference<MeshData> MeshManager::getMeshData(const std::string& model_url)
 
 	auto res = model_URL_to_mesh_map.find(model_url);
 	if(res != model_URL_to_mesh_map.end())
-		return res->second.value;
+		return res->second;
 	else
 		return NULL;
 }
@@ -156,7 +193,7 @@ Reference<PhysicsShapeData> MeshManager::getPhysicsShapeData(const MeshManagerPh
 
 	auto res = physics_shape_map.find(key);
 	if(res != physics_shape_map.end())
-		return res->second.value;
+		return res->second;
 	else
 		return NULL;
 }
@@ -168,7 +205,8 @@ void MeshManager::meshDataBecameUsed(const MeshData* meshdata)
 
 	//conPrint("meshDataBecameUsed(): '" + meshdata->model_url + "'");
 
-	model_URL_to_mesh_map.itemBecameUsed(meshdata->model_url);
+	if(budget_manager)
+		budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_Mesh, meshdata->model_url, /*used=*/true, Clock::getTimeSinceInit());
 }
 
 
@@ -178,7 +216,8 @@ void MeshManager::meshDataBecameUnused(const MeshData* meshdata)
 
 	//conPrint("meshDataBecameUnused():'" + meshdata->model_url + "'");
 
-	model_URL_to_mesh_map.itemBecameUnused(meshdata->model_url);
+	if(budget_manager)
+		budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_Mesh, meshdata->model_url, /*used=*/false, Clock::getTimeSinceInit());
 }
 
 
@@ -188,7 +227,8 @@ void MeshManager::physicsShapeDataBecameUsed(const PhysicsShapeData* shape_data)
 
 	//conPrint("physicsShapeDataBecameUsed(): '" + shape_data->model_url + "'");
 
-	physics_shape_map.itemBecameUsed(MeshManagerPhysicsShapeKey(shape_data->model_url, shape_data->dynamic));
+	if(budget_manager)
+		budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_PhysicsShape, physicsShapeBudgetKey(MeshManagerPhysicsShapeKey(shape_data->model_url, shape_data->dynamic)), /*used=*/true, Clock::getTimeSinceInit());
 }
 
 
@@ -198,70 +238,101 @@ void MeshManager::physicsShapeDataBecameUnused(const PhysicsShapeData* shape_dat
 
 	//conPrint("physicsShapeDataBecameUnused(): '" + shape_data->model_url + "'");
 
-	physics_shape_map.itemBecameUnused(MeshManagerPhysicsShapeKey(shape_data->model_url, shape_data->dynamic));
+	if(budget_manager)
+		budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_PhysicsShape, physicsShapeBudgetKey(MeshManagerPhysicsShapeKey(shape_data->model_url, shape_data->dynamic)), /*used=*/false, Clock::getTimeSinceInit());
 }
 
 
 // The mesh manager keeps a running total of the amount of memory used by inserted meshes.  Therefore it needs to be informed if the size of one of them changes.
-void MeshManager::meshMemoryAllocatedChanged(const GLMemUsage& old_mem_usage, const GLMemUsage& new_mem_usage)
+void MeshManager::meshMemoryAllocatedChanged(const MeshData* meshdata, const GLMemUsage& old_mem_usage, const GLMemUsage& new_mem_usage)
 {
 	mesh_CPU_mem_usage += (int64)new_mem_usage.geom_cpu_usage - (int64)old_mem_usage.geom_cpu_usage;
 	mesh_GPU_mem_usage += (int64)new_mem_usage.geom_gpu_usage - (int64)old_mem_usage.geom_gpu_usage;
+
+	if(budget_manager)
+		budget_manager->setAssetSize(MemoryBudgetManager::AssetClass_Mesh, meshdata->model_url, meshBudgetSize(new_mem_usage));
 }
 
 
-void MeshManager::trimMeshMemoryUsage()
+void MeshManager::removeMesh(std::unordered_map<std::string, Reference<MeshData> >::iterator it)
 {
-	// Max sizes for used + cached objects for determining cache size.  Objects will be removed from cache if the total size exceeds these thresholds.
-	// Use smaller sizes for Emscripten due to hard memory usage limits in the browser.
-#if EMSCRIPTEN
-	const size_t max_mesh_CPU_mem_usage = 512ull * 1024ull * 1024ull;
-#else
-	const size_t max_mesh_CPU_mem_usage = 1024ull * 1024ull * 1024ull;
-#endif
+	const GLMemUsage mesh_mem_usage = it->second->gl_meshdata->getTotalMemUsage();
 
-	const size_t max_mesh_GPU_mem_usage = 1024ull * 1024ull * 1024ull;
+	assert(this->mesh_CPU_mem_usage >= mesh_mem_usage.geom_cpu_usage);
+	assert(this->mesh_GPU_mem_usage >= mesh_mem_usage.geom_gpu_usage);
 
-#if EMSCRIPTEN
-	const size_t max_shape_mem_usage    = 512ull * 1024ull * 1024ull;
-#else
-	const size_t max_shape_mem_usage    = 1024ull * 1024ull * 1024ull;
-#endif
+	this->mesh_CPU_mem_usage -= mesh_mem_usage.geom_cpu_usage;
+	this->mesh_GPU_mem_usage -= mesh_mem_usage.geom_gpu_usage;
 
-	// Remove textures from unused texture list until we are using <= max_tex_mem_usage
-	while(((mesh_CPU_mem_usage > max_mesh_CPU_mem_usage) || (mesh_GPU_mem_usage > max_mesh_GPU_mem_usage)) && (model_URL_to_mesh_map.numUnusedItems() > 0))
-	{
-		std::string removed_key;
-		Reference<MeshData> removed_meshdata;
-		const bool removed = model_URL_to_mesh_map.removeLRUUnusedItem(removed_key, removed_meshdata);
-		assert(removed);
-		if(removed)
-		{
-			const GLMemUsage mesh_mem_usage = removed_meshdata->gl_meshdata->getTotalMemUsage();
+	it->second->mesh_manager = NULL;
+	model_URL_to_mesh_map.erase(it);
+}
 
-			assert(this->mesh_CPU_mem_usage >= mesh_mem_usage.geom_cpu_usage);
-			assert(this->mesh_GPU_mem_usage >= mesh_mem_usage.geom_gpu_usage);
 
-			this->mesh_CPU_mem_usage -= mesh_mem_usage.geom_cpu_usage;
-			this->mesh_GPU_mem_usage -= mesh_mem_usage.geom_gpu_usage;
-		}
-	}
+void MeshManager::removePhysicsShape(std::unordered_map<MeshManagerPhysicsShapeKey, Reference<PhysicsShapeData>, MeshManagerPhysicsShapeKeyHasher>::iterator it)
+{
+	const size_t the_shape_mem_usage = it->second->physics_shape.size_B;
 
-	// Trim physics shapes from unused shape list, until we are using <= max_shape_mem_usage
-	while((shape_mem_usage > max_shape_mem_usage) && (physics_shape_map.numUnusedItems() > 0))
+	assert(this->shape_mem_usage >= the_shape_mem_usage);
+
+	this->shape_mem_usage -= the_shape_mem_usage;
+
+	it->second->mesh_manager = NULL;
+	physics_shape_map.erase(it);
+}
+
+
+void MeshManager::removeEvictedMesh(const std::string& model_url)
+{
+	checkRunningOnMainThread();
+
+	auto res = model_URL_to_mesh_map.find(model_url);
+	if(res != model_URL_to_mesh_map.end())
 	{
-		MeshManagerPhysicsShapeKey removed_key;
-		Reference<PhysicsShapeData> removed_meshdata;
-		const bool removed = physics_shape_map.removeLRUUnusedItem(removed_key, removed_meshdata);
-		assert(removed);
-		if(removed)
+		if(res->second->getRefCount() > 1) // If something still holds a reference to the mesh (e.g. a pending main-thread task), it can't be evicted yet.
 		{
-			const size_t the_shape_mem_usage = removed_meshdata->physics_shape.size_B;
+			// computeEvictions() has already removed the mesh from the budget manager, so add it back as used, so it stays tracked.
+			// meshDataBecameUnused() will be called when the other references are dropped, making it evictable again.
+			if(budget_manager)
+			{
+				const double cur_time = Clock::getTimeSinceInit();
+				budget_manager->addAsset(MemoryBudgetManager::AssetClass_Mesh, model_url, meshBudgetSize(res->second->gl_meshdata->getTotalMemUsage()), cur_time);
+				budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_Mesh, model_url, /*used=*/true, cur_time);
+			}
+			return;
+		}
+		removeMesh(res);
+	}
+}
 
-			assert(this->shape_mem_usage >= the_shape_mem_usage);
 
-			this->shape_mem_usage -= the_shape_mem_usage;
+void MeshManager::removeEvictedPhysicsShape(const std::string& budget_key)
+{
+	checkRunningOnMainThread();
+
+	// Budget keys are of the form "dyn:URL" or "static:URL".
+	MeshManagerPhysicsShapeKey key;
+	if(hasPrefix(budget_key, "dyn:"))
+		key = MeshManagerPhysicsShapeKey(budget_key.substr(4), /*dynamic_physics_shape=*/true);
+	else if(hasPrefix(budget_key, "static:"))
+		key = MeshManagerPhysicsShapeKey(budget_key.substr(7), /*dynamic_physics_shape=*/false);
+	else
+		return;
+
+	auto res = physics_shape_map.find(key);
+	if(res != physics_shape_map.end())
+	{
+		if(res->second->getRefCount() > 1) // If something still holds a reference to the shape, it can't be evicted yet.  Add it back as used, as for meshes above.
+		{
+			if(budget_manager)
+			{
+				const double cur_time = Clock::getTimeSinceInit();
+				budget_manager->addAsset(MemoryBudgetManager::AssetClass_PhysicsShape, budget_key, res->second->physics_shape.size_B, cur_time);
+				budget_manager->setAssetUsed(MemoryBudgetManager::AssetClass_PhysicsShape, budget_key, /*used=*/true, cur_time);
+			}
+			return;
 		}
+		removePhysicsShape(res);
 	}
 }
 
@@ -270,17 +341,25 @@ std::string MeshManager::getDiagnostics() const
 {
 	//Timer timer;
 
-	// Get total size of used (active) gl meshes.
+	// Get total size of used (active) gl meshes.  A mesh is used if there are any references to it apart from the one held by the mesh manager.
 	GLMemUsage used_gl_mesh_usage;
+	size_t num_used_meshes = 0;
 	for(auto it = model_URL_to_mesh_map.begin(); it != model_URL_to_mesh_map.end(); ++it)
-		if(model_URL_to_mesh_map.isItemUsed(it->second))
-			used_gl_mesh_usage += it->second.value->gl_meshdata->getTotalMemUsage();
+		if(it->second->getRefCount() > 1)
+		{
+			used_gl_mesh_usage += it->second->gl_meshdata->getTotalMemUsage();
+			num_used_meshes++;
+		}
 
 	// Get total size of used (active) physics shapes
 	size_t used_shape_mem = 0;
+	size_t num_used_shapes = 0;
 	for(auto it = physics_shape_map.begin(); it != physics_shape_map.end(); ++it)
-		if(physics_shape_map.isItemUsed(it->second))
-			used_shape_mem += it->second.value->physics_shape.size_B;
+		if(it->second->getRefCount() > 1)
+		{
+			used_shape_mem += it->second->physics_shape.size_B;
+			num_used_shapes++;
+		}
 
 	const size_t mesh_usage_unused_CPU = this->mesh_CPU_mem_usage - used_gl_mesh_usage.geom_cpu_usage; // CPU Mem usage for unused textures = total mem usage - used mem usage
 	const size_t mesh_usage_unused_GPU = this->mesh_GPU_mem_usage - used_gl_mesh_usage.geom_gpu_usage; // GPU Mem usage for unused textures = total mem usage - used mem usage
@@ -289,13 +368,13 @@ std::string MeshManager::getDiagnostics() const
 
 	std::string msg;
 	msg += "---Mesh Manager---\n";
-	msg += "gl meshes:              " + toString(model_URL_to_mesh_map.size()) + " / " + toString(model_URL_to_mesh_map.numUsedItems()) + " / " + toString(model_URL_to_mesh_map.numUnusedItems()) + "    (total/active/cached)\n";
+	msg += "gl meshes:              " + toString(model_URL_to_mesh_map.size()) + " / " + toString(num_used_meshes) + " / " + toString(model_URL_to_mesh_map.size() - num_used_meshes) + "    (total/active/cached)\n";
 
 	msg += "gl meshes CPU mem:      " + getMBSizeString(this->mesh_CPU_mem_usage) + " / " + getMBSizeString(used_gl_mesh_usage.geom_cpu_usage) + " / " + getMBSizeString(mesh_usage_unused_CPU) + "    (total/active/cached)\n";
 
 	msg += "gl meshes GPU mem:      " + getMBSizeString(this->mesh_GPU_mem_usage) + " / " + getMBSizeString(used_gl_mesh_usage.geom_gpu_usage) + " / " + getMBSizeString(mesh_usage_unused_GPU) + "    (total/active/cached)\n";
 
-	msg += "physics shapes:         " + toString(physics_shape_map.size()) + " / " + toString(physics_shape_map.numUsedItems()) + " / " + toString(physics_shape_map.numUnusedItems()) + "    (total/active/cached)\n";
+	msg += "physics shapes:         " + toString(physics_shape_map.size()) + " / " + toString(num_used_shapes) + " / " + toString(physics_shape_map.size() - num_used_shapes) + "    (total/active/cached)\n";
 
 	msg += "physics shapes CPU mem: " + getMBSizeString(this->shape_mem_usage) + " / " + getMBSizeString(used_shape_mem) + " / " + getMBSizeString(shape_usage_unused) + "    (total/active/cached)\n";
 	msg += "-----------------\n";
@@ -9,10 +9,11 @@ Copyright Glare Technologies Limited 2022 -
 #include "PhysicsObject.h"
 #include <opengl/GLMemUsage.h>
 #include <simpleraytracer/raymesh.h>
-#include <utils/ManagerWithCache.h>
 #include <map>
+#include <unordered_map>
 class OpenGLMeshRenderData;
 class MeshManager;
+class MemoryBudgetManager;
 
 
 struct MeshData
@@ -146,6 +147,10 @@ MeshManager
 -----------
 Caches OpenGLMeshRenderData and physics shapes loaded from disk and built.
 
+Inserted meshes and shapes are registered with the MemoryBudgetManager, which decides which unused (cached) meshes
+and shapes to remove, with removeEvictedMesh() and removeEvictedPhysicsShape().  If there is no MemoryBudgetManager,
+unused meshes and shapes are kept until clear() is called.
+
 NOTE: Do we need to make this class threadsafe?  Or are all methods called on the main thread (in particular meshDataBecameUnused()?)
 =====================================================================*/
 class MeshManager
@@ -168,20 +173,33 @@ public:
 	void physicsShapeDataBecameUnused(const PhysicsShapeData* meshdata); // Called by decRefCount()
 
 	// The mesh manager keeps a running total of the amount of memory used by inserted meshes.  Therefore it needs to be informed if the size of one of them changes.
-	void meshMemoryAllocatedChanged(const GLMemUsage& old_mem_usage, const GLMemUsage& new_mem_usage);
+	void meshMemoryAllocatedChanged(const MeshData* meshdata, const GLMemUsage& old_mem_usage, const GLMemUsage& new_mem_usage);
 
 	std::string getDiagnostics() const;
 
-	void trimMeshMemoryUsage();
+	// budget_manager may be NULL.  Should be set before any meshes are inserted.
+	void setMemoryBudgetManager(MemoryBudgetManager* budget_manager);
+
+	// Key for the physics shape in the memory budget manager.
+	static std::string physicsShapeBudgetKey(const MeshManagerPhysicsShapeKey& key);
+
+	// Remove meshes and shapes chosen for eviction by the memory budget manager.  Does nothing if the mesh or shape is not present.
+	// If the mesh or shape is still referenced from outside the mesh manager, it is not removed, and is added back to the budget manager as used.
+	void removeEvictedMesh(const std::string& model_url);
+	void removeEvictedPhysicsShape(const std::string& budget_key);
 
 	//Mutex& getMutex() { return mutex; }
 private:
 	void checkRunningOnMainThread();
+	void removeMesh(std::unordered_map<std::string, Reference<MeshData> >::iterator it);
+	void removePhysicsShape(std::unordered_map<MeshManagerPhysicsShapeKey, Reference<PhysicsShapeData>, MeshManagerPhysicsShapeKeyHasher>::iterator it);
 
 	//mutable Mutex mutex;
-	ManagerWithCache<std::string, Reference<MeshData> > model_URL_to_mesh_map;
+	std::unordered_map<std::string, Reference<MeshData> > model_URL_to_mesh_map;
+
+	std::unordered_map<MeshManagerPhysicsShapeKey, Reference<PhysicsShapeData>, MeshManagerPhysicsShapeKeyHasher> physics_shape_map;
 
-	ManagerWithCache<MeshManagerPhysicsShapeKey, Reference<PhysicsShapeData>, MeshManagerPhysicsShapeKeyHasher> physics_shape_map;
+	MemoryBudgetManager* budget_manager;
 
 	uint64 main_thread_id;
 
@@ -16,6 +16,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "../shared/ImageDecoding.h"
 #include <graphics/SRGBUtils.h>
 #include <utils/RuntimeCheck.h>
+#include <limits>
 
 
 MiniMap::MiniMap()
@@ -38,6 +39,8 @@ static const float arrow_width_px = 22;
 
 static const int TILE_GRID_RES = 7; // There will be a TILE_GRID_RES x TILE_GRID_RES grid of tiles centered on the camera
 
+static const int MINIMAP_TEXTURE_RES = 256; // Width and height of minimap_texture, which the tiles are drawn into.
+
 // -1 is near clip plane, +1 is the far clip plane.
 static const float MINIMAP_Z = -0.9f;
 static const float ARROW_IMAGE_Z = -0.95f;
@@ -78,7 +81,7 @@ void MiniMap::create(Reference<OpenGLEngine>& opengl_engine_, GUIClient* gui_cli
 
 	expanded = gui_client_->getSettingsStore()->getBoolValue("setting/show_minimap", /*default_value=*/true);
 	
-	minimap_texture = new OpenGLTexture(256, 256, opengl_engine.ptr(), ArrayRef<uint8>(NULL, 0), OpenGLTexture::Format_RGB_Linear_Uint8, OpenGLTexture::Filtering_Bilinear);
+	minimap_texture = new OpenGLTexture(MINIMAP_TEXTURE_RES, MINIMAP_TEXTURE_RES, opengl_engine.ptr(), ArrayRef<uint8>(NULL, 0), OpenGLTexture::Format_RGB_Linear_Uint8, OpenGLTexture::Filtering_Bilinear);
 
 	// Create minimap image
 	minimap_image = new GLUIImage(*gl_ui, opengl_engine, "", Vec2f(1 - margin - minimap_width, gl_ui->getViewportMinMaxY() - margin - minimap_width), Vec2f(minimap_width), /*tooltip=*/"", MINIMAP_Z);
@@ -296,39 +299,92 @@ void MiniMap::think()
 				const int new_centre_y = Maths::floorToInt((float)campos.y / tile_w_ws);
 
 				const int query_rad = 2; // Query 'radius'
-				std::vector<Vec3i> query_indices;
-				query_indices.reserve(Maths::square(2*query_rad + 1) * 2);
-			
-				for(int x=new_centre_x - query_rad; x <= new_centre_x + query_rad; ++x)
-				for(int y=new_centre_y - query_rad; y <= new_centre_y + query_rad; ++y)
+
+				if(gui_client->server_protocol_version >= 43) // QueryMapTilesInRect was introduced in protocol version 43.
 				{
-					Vec3i tile_coords = Vec3i(x, y, tile_z);
-					
-					// Walk out zoom levels and query those tiles as well, in case we don't have a tile at this level and we need to use the zoomed-out tile
-					while(tile_coords.z >= 0)
+					// Query the rectangle of tiles we haven't queried yet, and the tiles covering it at lower zoom levels, in one message.
+					// The server also sends the covering tiles at lower zoom levels, and we mark those as queried too, so if a tile has been queried, so have the tiles covering it.
+					// So we just need the bounding rectangle of the tiles at this zoom level that haven't been queried yet.
+					int x_begin = std::numeric_limits<int>::max();
+					int y_begin = std::numeric_limits<int>::max();
+					int x_end = std::numeric_limits<int>::min();
+					int y_end = std::numeric_limits<int>::min();
+					for(int x=new_centre_x - query_rad; x <= new_centre_x + query_rad; ++x)
+					for(int y=new_centre_y - query_rad; y <= new_centre_y + query_rad; ++y)
+						if(queried_tile_coords.count(Vec3i(x, y, tile_z)) == 0) // If we haven't queried this tile yet:
+						{
+							x_begin = myMin(x_begin, x);
+							y_begin = myMin(y_begin, y);
+							x_end = myMax(x_end, x + 1);
+							y_end = myMax(y_end, y + 1);
+						}
+
+					if(x_begin < x_end) // If we actually have some tiles we haven't queried yet:
 					{
-						if(queried_tile_coords.count(tile_coords) == 0) // If we haven't queried this tile yet:
+						// Mark the tiles in the rect, and the tiles covering them at lower zoom levels, as queried.
+						for(int x=x_begin; x < x_end; ++x)
+						for(int y=y_begin; y < y_end; ++y)
 						{
-							query_indices.push_back(tile_coords);
-							queried_tile_coords.insert(tile_coords); // Mark tile as queried
+							Vec3i tile_coords = Vec3i(x, y, tile_z);
+							while(tile_coords.z >= 0 && queried_tile_coords.insert(tile_coords).second) // Covering tiles of an already queried tile have been queried already.
+							{
+								tile_coords.x = Maths::divideByTwoRoundedDown(tile_coords.x);
+								tile_coords.y = Maths::divideByTwoRoundedDown(tile_coords.y);
+								tile_coords.z--;
+							}
 						}
 
-						tile_coords.x = Maths::divideByTwoRoundedDown(tile_coords.x);
-						tile_coords.y = Maths::divideByTwoRoundedDown(tile_coords.y);
-						tile_coords.z--;
+						// Tiles are drawn into the minimap_texture, so ask for tile images that are about as wide as a tile is there.
+						const int tile_width_px = (int)std::ceil(MINIMAP_TEXTURE_RES * tile_w_ws / map_width_ws);
+
+						MessageUtils::initPacket(scratch_packet, Protocol::QueryMapTilesInRect);
+						scratch_packet.writeInt32(tile_z);
+						scratch_packet.writeInt32(x_begin);
+						scratch_packet.writeInt32(y_begin);
+						scratch_packet.writeInt32(x_end);
+						scratch_packet.writeInt32(y_end);
+						scratch_packet.writeUInt32((uint32)tile_width_px);
+
+						MessageUtils::updatePacketLengthField(scratch_packet);
+						gui_client->client_thread->enqueueDataToSend(scratch_packet.buf);
 					}
 				}
-
-				if(!query_indices.empty()) // If we actually have some tile coords we haven't queried yet:
+				else
 				{
-					// Make QueryMapTiles packet and enqueue to send
-					MessageUtils::initPacket(scratch_packet, Protocol::QueryMapTiles);
+					std::vector<Vec3i> query_indices;
+					query_indices.reserve(Maths::square(2*query_rad + 1) * 2);
 			
-					scratch_packet.writeUInt32((uint32)query_indices.size());
-					scratch_packet.writeData(query_indices.data(), query_indices.size() * sizeof(Vec3i));
+					for(int x=new_centre_x - query_rad; x <= new_centre_x + query_rad; ++x)
+					for(int y=new_centre_y - query_rad; y <= new_centre_y + query_rad; ++y)
+					{
+						Vec3i tile_coords = Vec3i(x, y, tile_z);
+					
+						// Walk out zoom levels and query those tiles as well, in case we don't have a tile at this level and we need to use the zoomed-out tile
+						while(tile_coords.z >= 0)
+						{
+							if(queried_tile_coords.count(tile_coords) == 0) // If we haven't queried this tile yet:
+							{
+								query_indices.push_back(tile_coords);
+								queried_tile_coords.insert(tile_coords); // Mark tile as queried
+							}
+
+							tile_coords.x = Maths::divideByTwoRoundedDown(tile_coords.x);
+							tile_coords.y = Maths::divideByTwoRoundedDown(tile_coords.y);
+							tile_coords.z--;
+						}
+					}
+
+					if(!query_indices.empty()) // If we actually have some tile coords we haven't queried yet:
+					{
+						// Make QueryMapTiles packet and enqueue to send
+						MessageUtils::initPacket(scratch_packet, Protocol::QueryMapTiles);
+			
+						scratch_packet.writeUInt32((uint32)query_indices.size());
+						scratch_packet.writeData(query_indices.data(), query_indices.size() * sizeof(Vec3i));
 
-					MessageUtils::updatePacketLengthField(scratch_packet);
-					gui_client->client_thread->enqueueDataToSend(scratch_packet.buf);
+						MessageUtils::updatePacketLengthField(scratch_packet);
+						gui_client->client_thread->enqueueDataToSend(scratch_packet.buf);
+					}
 				}
 			}
 
@@ -477,7 +533,7 @@ void MiniMap::checkUpdateTilesForCurCamPosition()
 									tex_params.use_mipmaps = false;
 
 									if(resource->getState() == Resource::State_Present)
-										gui_client->startLoadingTextureForLocalPath(local_path, resource, tile_pos.toVec4fPoint(), tile_w_ws, /*max task dist=*/1.0e10f, /*importance factor=*/1.f, tex_params);
+										gui_client->startLoadingTextureForLocalPath(local_path, resource, tile_pos.toVec4fPoint(), tile_w_ws, /*max task dist=*/1.0e10f, /*importance factor=*/1.f, tex_params, /*requester=*/NULL);
 								}
 							}
 
@@ -650,7 +706,7 @@ void MiniMap::handleMapTilesResultReceivedMessage(const MapTilesResultReceivedMe
 
 
 				// Start loading the texture (if not already loaded)
-				gui_client->startLoadingTextureIfPresent(URL, tile_pos.toVec4fPoint(), tile_w_ws, /*max task dist=*/1.0e10f, /*importance factor=*/1.f, tex_params);
+				gui_client->startLoadingTextureIfPresent(URL, tile_pos.toVec4fPoint(), tile_w_ws, /*max task dist=*/1.0e10f, /*importance factor=*/1.f, tex_params, /*requester=*/NULL);
 			}
 		}
 		else
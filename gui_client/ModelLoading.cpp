@@ -9,6 +9,7 @@ Code By Nicholas Chapman.
 
 #include "MeshBuilding.h"
 #include "PhysicsWorld.h"
+#include "ProcessedMeshCache.h"
 #include "../shared/WorldObject.h"
 #include "../shared/ResourceManager.h"
 #include "../shared/VoxelMeshBuilding.h"
@@ -947,8 +948,7 @@ void ModelLoading::setMaterialTexPathsForLODLevel(GLObject& gl_ob, int ob_lod_le
 }
 
 
-Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelPath(const std::string& model_path, VertexBufferAllocator* vert_buf_allocator, bool skip_opengl_calls, bool build_dynamic_physics_ob, 
-	glare::Allocator* mem_allocator, PhysicsShape& physics_shape_out)
+BatchedMeshRef ModelLoading::loadAndProcessModel(const std::string& model_path, glare::Allocator* mem_allocator)
 {
 	// Load mesh from disk:
 	BatchedMeshRef batched_mesh;
@@ -1011,6 +1011,27 @@ Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForMod
 		if(batched_mesh->animation_data.vrm_data.nonNull())
 			rotateVRMMesh(*batched_mesh);
 
+	return batched_mesh;
+}
+
+
+Reference<OpenGLMeshRenderData> ModelLoading::makeGLMeshDataAndBatchedMeshForModelPath(const std::string& model_path, VertexBufferAllocator* vert_buf_allocator, bool skip_opengl_calls, bool build_dynamic_physics_ob, 
+	glare::Allocator* mem_allocator, ProcessedMeshCache* processed_mesh_cache, PhysicsShape& physics_shape_out)
+{
+	BatchedMeshRef batched_mesh;
+	if(processed_mesh_cache)
+	{
+		const uint64 cache_key = processed_mesh_cache->getKeyForModelFile(model_path);
+		batched_mesh = processed_mesh_cache->tryLoadMesh(cache_key, mem_allocator);
+		if(batched_mesh.isNull())
+		{
+			batched_mesh = loadAndProcessModel(model_path, mem_allocator);
+			processed_mesh_cache->storeMesh(cache_key, *batched_mesh);
+		}
+	}
+	else
+		batched_mesh = loadAndProcessModel(model_path, mem_allocator);
+
 	Reference<OpenGLMeshRenderData> gl_meshdata = GLMeshBuilding::buildBatchedMesh(vert_buf_allocator, batched_mesh, /*skip opengl calls=*/skip_opengl_calls, /*instancing_matrix_data=*/NULL);
 
 	gl_meshdata->animation_data = batched_mesh->animation_data;
@@ -21,6 +21,7 @@ class RayMesh;
 class PhysicsShape;
 class VoxelGroup;
 class VertexBufferAllocator;
+class ProcessedMeshCache;
 namespace Indigo { class TaskManager; }
 
 
@@ -82,9 +83,15 @@ public:
 		const std::string& lightmap_url, ResourceManager& resource_manager);
 
 
+	// Load a model file from disk, and process it into a BatchedMesh ready for building OpenGL and physics data:
+	// check and sanitise it, merge batches sharing the same material, and rotate VRM models.
+	// Doesn't make any OpenGL calls.  Throws glare::Exception on failure.
+	static BatchedMeshRef loadAndProcessModel(const std::string& model_path, glare::Allocator* mem_allocator);
+
 	// Build OpenGLMeshRenderData and Physics shape from a mesh on disk identified by lod_model_path.
+	// If processed_mesh_cache is non-null, the processed mesh is loaded from the cache if present, and stored in the cache otherwise.
 	static Reference<OpenGLMeshRenderData> makeGLMeshDataAndBatchedMeshForModelPath(const std::string& lod_model_path, VertexBufferAllocator* vert_buf_allocator, bool skip_opengl_calls, bool build_dynamic_physics_ob, 
-		glare::Allocator* mem_allocator,
+		glare::Allocator* mem_allocator, ProcessedMeshCache* processed_mesh_cache,
 		PhysicsShape& physics_shape_out);
 
 	// Build OpenGLMeshRenderData from voxel data.  Also return a reference to a physics shape.
@@ -0,0 +1,474 @@
+/*=====================================================================
+ProcessedMeshCache.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ProcessedMeshCache.h"
+
+
+#include <utils/FileUtils.h>
+#include <utils/MemMappedFile.h>
+#include <utils/Exception.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/PlatformUtils.h>
+#include <utils/IncludeXXHash.h>
+#include <utils/Lock.h>
+#include <utils/BufferInStream.h>
+#include <utils/BufferOutStream.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+
+
+static const uint32 INDEX_MAGIC = 0x4D434958; // "XICM"
+static const uint32 INDEX_VERSION = 1;
+
+
+ProcessedMeshCache::ProcessedMeshCache(const std::string& cache_dir_, uint64 max_size_B_)
+:	num_hits(0), num_misses(0), cache_dir(cache_dir_), max_size_B(max_size_B_), next_temp_file_index(0), total_size_B(0), next_access_seq(1)
+{
+	try
+	{
+		FileUtils::createDirIfDoesNotExist(cache_dir);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("WARNING: failed to create processed mesh cache dir: " + e.what());
+	}
+
+	Lock lock(mutex);
+	loadIndex();
+	trimToMaxSizeLocked(max_size_B);
+}
+
+
+ProcessedMeshCache::~ProcessedMeshCache()
+{
+	Lock lock(mutex);
+	saveIndex();
+}
+
+
+// Parses the key from a cached mesh filename, as made by pathForKey().  Returns false if the filename isn't a cached mesh filename.
+static bool parseKeyFromFilename(const std::string& filename, uint64& key_out)
+{
+	if((filename.size() != 16 + 6) || !::hasExtension(filename, "bmesh"))
+		return false;
+
+	uint64 key = 0;
+	for(size_t i=0; i<16; ++i)
+	{
+		const char c = filename[i];
+		uint64 digit;
+		if(c >= '0' && c <= '9')
+			digit = c - '0';
+		else if(c >= 'a' && c <= 'f')
+			digit = 10 + (c - 'a');
+		else if(c >= 'A' && c <= 'F')
+			digit = 10 + (c - 'A');
+		else
+			return false;
+		key = (key << 4) | digit;
+	}
+	key_out = key;
+	return true;
+}
+
+
+// Scans the cache dir for cached meshes, and reads their access order from the index file.  Meshes not in the index are treated as least recently used.
+// Also deletes any temp files left over from writes that were interrupted, e.g. by a crash.
+void ProcessedMeshCache::loadIndex()
+{
+	meshes.clear();
+	total_size_B = 0;
+
+	try
+	{
+		const std::vector<std::string> filenames = FileUtils::getFilesInDir(cache_dir);
+		for(size_t i=0; i<filenames.size(); ++i)
+		{
+			const std::string path = cache_dir + "/" + filenames[i];
+			uint64 key;
+			if(parseKeyFromFilename(filenames[i], key))
+			{
+				CachedMeshInfo info;
+				info.size_B = FileUtils::getFileSize(path);
+				info.last_access_seq = 0;
+				meshes[key] = info;
+				total_size_B += info.size_B;
+			}
+			else if(::hasExtension(filenames[i], "tmp"))
+			{
+				try
+				{
+					FileUtils::deleteFile(path);
+				}
+				catch(FileUtils::FileUtilsExcep& e)
+				{
+					conPrint("WARNING: failed to delete processed mesh temp file: " + e.what());
+				}
+			}
+		}
+
+		const std::string index_path = cache_dir + "/index.bin";
+		if(FileUtils::fileExists(index_path))
+		{
+			std::string data;
+			FileUtils::readEntireFile(index_path, data);
+			BufferInStream in(ArrayRef<uint8>((const uint8*)data.data(), data.size()));
+
+			const uint32 magic = in.readUInt32();
+			const uint32 version = in.readUInt32();
+			if(magic != INDEX_MAGIC || version != INDEX_VERSION)
+				throw glare::Exception("Invalid index file.");
+
+			const uint64 num_entries = in.readUInt64();
+			if(num_entries > data.size() / 16)
+				throw glare::Exception("Invalid number of index entries.");
+
+			for(uint64 i=0; i<num_entries; ++i)
+			{
+				const uint64 key = in.readUInt64();
+				const uint64 last_access_seq = in.readUInt64();
+
+				auto res = meshes.find(key);
+				if(res != meshes.end())
+				{
+					res->second.last_access_seq = last_access_seq;
+					next_access_seq = myMax(next_access_seq, last_access_seq + 1);
+				}
+			}
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("WARNING: failed to load processed mesh cache index: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WARNING: failed to load processed mesh cache index: " + e.what());
+	}
+}
+
+
+void ProcessedMeshCache::saveIndex()
+{
+	try
+	{
+		BufferOutStream out;
+		out.writeUInt32(INDEX_MAGIC);
+		out.writeUInt32(INDEX_VERSION);
+		out.writeUInt64(meshes.size());
+		for(auto it = meshes.begin(); it != meshes.end(); ++it)
+		{
+			out.writeUInt64(it->first);
+			out.writeUInt64(it->second.last_access_seq);
+		}
+
+		const std::string index_path = cache_dir + "/index.bin";
+		const std::string temp_path = index_path + "_" + toString(next_temp_file_index.increment()) + ".tmp";
+		FileUtils::writeEntireFile(temp_path, (const char*)out.buf.data(), out.buf.size());
+		FileUtils::moveFile(temp_path, index_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("WARNING: failed to save processed mesh cache index: " + e.what());
+	}
+}
+
+
+uint64 ProcessedMeshCache::computeKeyForModelFile(const std::string& model_path)
+{
+	MemMappedFile file(model_path);
+	const uint64 content_hash = XXH64(file.fileData(), file.fileSize(), /*seed=*/1);
+
+	// Include the version and the extension (which determines how the file is decoded) in the key.
+	const std::string key_str = toString(content_hash) + "_" + toString(PROCESSED_MESH_CACHE_VERSION) + "_" + toLowerCase(getExtension(model_path));
+	return XXH64(key_str.data(), key_str.size(), /*seed=*/1);
+}
+
+
+uint64 ProcessedMeshCache::getKeyForModelFile(const std::string& model_path)
+{
+	uint64 file_size;
+	try
+	{
+		file_size = FileUtils::getFileSize(model_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	{
+		Lock lock(mutex);
+		auto res = model_file_keys.find(model_path);
+		if((res != model_file_keys.end()) && (res->second.file_size == file_size))
+			return res->second.key;
+	}
+
+	const uint64 key = computeKeyForModelFile(model_path); // Hash the file without holding the mutex.
+
+	Lock lock(mutex);
+	ModelFileKey& file_key = model_file_keys[model_path];
+	file_key.file_size = file_size;
+	file_key.key = key;
+	return key;
+}
+
+
+const std::string ProcessedMeshCache::pathForKey(uint64 key) const
+{
+	return cache_dir + "/" + leftPad(toHexString(key), '0', 16) + ".bmesh";
+}
+
+
+BatchedMeshRef ProcessedMeshCache::tryLoadMesh(uint64 key, glare::Allocator* mem_allocator)
+{
+	const std::string path = pathForKey(key);
+	if(!FileUtils::fileExists(path))
+	{
+		num_misses.increment();
+		return BatchedMeshRef();
+	}
+
+	try
+	{
+		BatchedMeshRef mesh = BatchedMesh::readFromFile(path, mem_allocator);
+		num_hits.increment();
+
+		Lock lock(mutex);
+		auto res = meshes.find(key);
+		if(res != meshes.end())
+			res->second.last_access_seq = next_access_seq++;
+
+		return mesh;
+	}
+	catch(glare::Exception& e)
+	{
+		// The cached file may be damaged, e.g. if we crashed while it was being written.  Remove it so it gets rewritten.
+		conPrint("WARNING: failed to read processed mesh '" + path + "': " + e.what());
+		try
+		{
+			FileUtils::deleteFile(path);
+
+			Lock lock(mutex);
+			auto res = meshes.find(key);
+			if(res != meshes.end())
+			{
+				total_size_B -= res->second.size_B;
+				meshes.erase(res);
+			}
+		}
+		catch(FileUtils::FileUtilsExcep&)
+		{}
+		num_misses.increment();
+		return BatchedMeshRef();
+	}
+}
+
+
+void ProcessedMeshCache::storeMesh(uint64 key, const BatchedMesh& mesh)
+{
+	const std::string path = pathForKey(key);
+	try
+	{
+		// Write to a temp file first then move it into place, so other threads loading the same key never see a partially written file.
+		const std::string temp_path = path + "_" + toString(next_temp_file_index.increment()) + ".tmp";
+
+		BatchedMesh::WriteOptions write_options;
+		write_options.use_compression = false; // Don't compress, so reading is as fast as possible.
+		mesh.writeToFile(temp_path, write_options);
+
+		const uint64 size_B = FileUtils::getFileSize(temp_path);
+
+		FileUtils::moveFile(temp_path, path);
+
+		Lock lock(mutex);
+		CachedMeshInfo& info = meshes[key]; // May already exist, if another thread stored the same mesh.  A new entry is zero-initialised.
+		total_size_B = total_size_B - info.size_B + size_B;
+		info.size_B = size_B;
+		info.last_access_seq = next_access_seq++;
+
+		if(total_size_B > max_size_B)
+			trimToMaxSizeLocked(max_size_B);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("WARNING: failed to write processed mesh '" + path + "': " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("WARNING: failed to write processed mesh '" + path + "': " + e.what());
+	}
+}
+
+
+void ProcessedMeshCache::trimToMaxSize(uint64 trim_max_size_B)
+{
+	Lock lock(mutex);
+	trimToMaxSizeLocked(trim_max_size_B);
+}
+
+
+void ProcessedMeshCache::trimToMaxSizeLocked(uint64 trim_max_size_B)
+{
+	if(total_size_B <= trim_max_size_B)
+		return;
+
+	// Sort meshes by last access, least recently used first.
+	std::vector<std::pair<uint64, uint64>> access_seq_and_key;
+	access_seq_and_key.reserve(meshes.size());
+	for(auto it = meshes.begin(); it != meshes.end(); ++it)
+		access_seq_and_key.push_back(std::make_pair(it->second.last_access_seq, it->first));
+	std::sort(access_seq_and_key.begin(), access_seq_and_key.end());
+
+	size_t num_deleted = 0;
+	for(size_t i=0; (i<access_seq_and_key.size()) && (total_size_B > trim_max_size_B); ++i)
+	{
+		const uint64 key = access_seq_and_key[i].second;
+		try
+		{
+			FileUtils::deleteFile(pathForKey(key));
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("WARNING: failed to delete cached mesh: " + e.what()); // May be open for reading in another thread on Windows.  Try again next trim.
+			continue;
+		}
+
+		auto res = meshes.find(key);
+		total_size_B -= res->second.size_B;
+		meshes.erase(res);
+		num_deleted++;
+	}
+
+	if(num_deleted > 0)
+	{
+		conPrint("ProcessedMeshCache: deleted " + toString(num_deleted) + " cached mesh(es) to keep cache under " + toString(trim_max_size_B / (1024 * 1024)) + " MB.");
+		saveIndex();
+	}
+}
+
+
+uint64 ProcessedMeshCache::getTotalSize() const
+{
+	Lock lock(mutex);
+	return total_size_B;
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ModelLoading.h"
+#include <utils/TestUtils.h>
+
+
+void ProcessedMeshCache::test()
+{
+	conPrint("ProcessedMeshCache::test()");
+
+	try
+	{
+		const std::string dir = PlatformUtils::getTempDirPath() + "/processed_mesh_cache_test";
+		FileUtils::createDirIfDoesNotExist(dir);
+
+		const std::string model_path = dir + "/model.obj";
+		FileUtils::writeEntireFileTextMode(model_path, "v 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\nf 1 2 3\nf 2 4 3\n");
+
+		{
+			ProcessedMeshCache cache(dir + "/cache", /*max_size_B=*/0); // Remove any meshes left from previous runs.
+		}
+
+		ProcessedMeshCache cache(dir + "/cache", /*max_size_B=*/1ull << 30);
+		testAssert(cache.getTotalSize() == 0);
+
+		const uint64 key = computeKeyForModelFile(model_path);
+		testAssert(computeKeyForModelFile(model_path) == key);
+		testAssert(cache.getKeyForModelFile(model_path) == key);
+		testAssert(cache.getKeyForModelFile(model_path) == key); // Memoised key
+
+		//-------------------- Test a miss, then a hit after storing the mesh --------------------
+		testAssert(cache.tryLoadMesh(key, /*mem_allocator=*/NULL).isNull());
+		testAssert(cache.num_misses == 1);
+
+		BatchedMeshRef processed_mesh = ModelLoading::loadAndProcessModel(model_path, /*mem_allocator=*/NULL);
+		cache.storeMesh(key, *processed_mesh);
+		testAssert(FileUtils::fileExists(cache.pathForKey(key)));
+
+		BatchedMeshRef cached_mesh = cache.tryLoadMesh(key, /*mem_allocator=*/NULL);
+		testAssert(cached_mesh.nonNull());
+		testAssert(cache.num_hits == 1);
+		testAssert(cached_mesh->numVerts() == processed_mesh->numVerts());
+		testAssert(cached_mesh->numIndices() == processed_mesh->numIndices());
+		testAssert(cached_mesh->vertex_data.size() == processed_mesh->vertex_data.size());
+		testAssert(std::memcmp(cached_mesh->vertex_data.data(), processed_mesh->vertex_data.data(), processed_mesh->vertex_data.size()) == 0);
+		testAssert(cached_mesh->numMaterialsReferenced() == processed_mesh->numMaterialsReferenced());
+
+		//-------------------- Test that a changed model file gets a different key --------------------
+		FileUtils::writeEntireFileTextMode(model_path, "v 0 0 0\nv 2 0 0\nv 0 2 0\nf 1 2 3\n");
+		testAssert(computeKeyForModelFile(model_path) != key);
+		testAssert(cache.getKeyForModelFile(model_path) != key); // File size changed, so should be rehashed.
+
+		//-------------------- Test that a damaged cache file is treated as a miss, and removed --------------------
+		FileUtils::writeEntireFile(cache.pathForKey(key), std::string("not a bmesh"));
+		testAssert(cache.tryLoadMesh(key, /*mem_allocator=*/NULL).isNull());
+		testAssert(!FileUtils::fileExists(cache.pathForKey(key)));
+
+		//-------------------- Test trimming --------------------
+		cache.storeMesh(key, *processed_mesh);
+		cache.storeMesh(key + 1, *processed_mesh);
+		const uint64 mesh_file_size = FileUtils::getFileSize(cache.pathForKey(key));
+		testAssert(cache.getTotalSize() == 2 * mesh_file_size);
+		testAssert(cache.tryLoadMesh(key, /*mem_allocator=*/NULL).nonNull()); // Access key, so key + 1 is least recently used.
+		cache.trimToMaxSize(mesh_file_size);
+		testAssert(FileUtils::fileExists(cache.pathForKey(key)));
+		testAssert(!FileUtils::fileExists(cache.pathForKey(key + 1)));
+		testAssert(cache.getTotalSize() == mesh_file_size);
+
+		//-------------------- Test that storing a mesh trims the cache to the max size --------------------
+		{
+			ProcessedMeshCache small_cache(dir + "/small_cache", /*max_size_B=*/mesh_file_size);
+			small_cache.trimToMaxSize(0);
+			small_cache.storeMesh(key, *processed_mesh);
+			small_cache.storeMesh(key + 1, *processed_mesh);
+			testAssert(!FileUtils::fileExists(small_cache.pathForKey(key)));
+			testAssert(FileUtils::fileExists(small_cache.pathForKey(key + 1)));
+			testAssert(small_cache.getTotalSize() == mesh_file_size);
+		}
+
+		//-------------------- Test that the access order persists between runs, and that stale temp files are deleted --------------------
+		{
+			ProcessedMeshCache first_cache(dir + "/persist_cache", /*max_size_B=*/1ull << 30);
+			first_cache.trimToMaxSize(0);
+			first_cache.storeMesh(key, *processed_mesh);
+			first_cache.storeMesh(key + 1, *processed_mesh);
+			testAssert(first_cache.tryLoadMesh(key, /*mem_allocator=*/NULL).nonNull()); // key + 1 is now least recently used.
+		} // Destructor saves the index.
+		{
+			const std::string temp_path = dir + "/persist_cache/" + leftPad(toHexString(key + 2), '0', 16) + ".bmesh_0.tmp";
+			FileUtils::writeEntireFile(temp_path, std::string("partially written"));
+
+			ProcessedMeshCache reopened_cache(dir + "/persist_cache", /*max_size_B=*/1ull << 30);
+			testAssert(!FileUtils::fileExists(temp_path));
+			testAssert(reopened_cache.getTotalSize() == 2 * mesh_file_size);
+			reopened_cache.trimToMaxSize(mesh_file_size);
+			testAssert(FileUtils::fileExists(reopened_cache.pathForKey(key)));
+			testAssert(!FileUtils::fileExists(reopened_cache.pathForKey(key + 1)));
+		}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ProcessedMeshCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,100 @@
+/*=====================================================================
+ProcessedMeshCache.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <graphics/BatchedMesh.h>
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/AtomicInt.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <string>
+#include <unordered_map>
+namespace glare { class Allocator; }
+
+
+/*=====================================================================
+ProcessedMeshCache
+------------------
+On-disk cache of processed meshes, e.g. meshes that have been decoded from glTF, OBJ etc., sanitised, had batches merged
+and so on by ModelLoading::loadAndProcessModel(), and are ready for building OpenGL and physics data.
+
+Meshes are stored as uncompressed bmesh files, so loading a cached mesh is just a memory-mapped read.
+Meshes are keyed by a hash of the model file contents and the cache version, so a changed model file or a change to the
+processing code (with a version bump) can't load stale data.
+
+The cache is kept under a maximum size by deleting the least recently used meshes when a mesh is stored.
+Access order is saved to an index file in the cache dir, so it persists between runs.
+
+Methods are threadsafe, and may be called from multiple loading tasks at once.
+=====================================================================*/
+class ProcessedMeshCache : public ThreadSafeRefCounted
+{
+public:
+	// Scans cache_dir for cached meshes, deletes temp files left by interrupted writes, and trims the cache to max_size_B.
+	ProcessedMeshCache(const std::string& cache_dir, uint64 max_size_B);
+	~ProcessedMeshCache(); // Saves the access index.
+
+	// Increment when ModelLoading::loadAndProcessModel() changes in a way that changes the processed mesh.
+	static const uint32 PROCESSED_MESH_CACHE_VERSION = 1;
+
+	// Computes the key for the model file at model_path, from the file contents.  Throws glare::Exception on failure.
+	static uint64 computeKeyForModelFile(const std::string& model_path);
+
+	// Same as computeKeyForModelFile(), but remembers the keys of files already hashed, so a model file is only hashed again if its size changes.
+	// Model files are resources, which don't change after they are downloaded.
+	uint64 getKeyForModelFile(const std::string& model_path);
+
+	// Returns the cached mesh for the key, or a null reference if there is no cached mesh, or it could not be read.
+	BatchedMeshRef tryLoadMesh(uint64 key, glare::Allocator* mem_allocator);
+
+	// Writes the mesh to the cache, then deletes least recently used meshes if the cache is over the max size.
+	// Failures are just logged, since the cache is only an optimisation.
+	void storeMesh(uint64 key, const BatchedMesh& mesh);
+
+	// Deletes the least recently used cached meshes until the total size of the cache is <= max_size_B.
+	void trimToMaxSize(uint64 max_size_B);
+
+	uint64 getTotalSize() const;
+
+	const std::string pathForKey(uint64 key) const;
+
+	static void test();
+
+	glare::AtomicInt num_hits;
+	glare::AtomicInt num_misses;
+
+private:
+	void trimToMaxSizeLocked(uint64 max_size_B) REQUIRES(mutex);
+	void loadIndex() REQUIRES(mutex);
+	void saveIndex() REQUIRES(mutex);
+
+	struct CachedMeshInfo
+	{
+		uint64 size_B;
+		uint64 last_access_seq; // Value of next_access_seq when the mesh was last stored or loaded.
+	};
+
+	struct ModelFileKey
+	{
+		uint64 file_size;
+		uint64 key;
+	};
+
+	std::string cache_dir;
+	uint64 max_size_B;
+	glare::AtomicInt next_temp_file_index;
+
+	mutable Mutex mutex;
+	std::unordered_map<uint64, CachedMeshInfo> meshes		GUARDED_BY(mutex); // Map from key to info for cached meshes on disk.
+	uint64 total_size_B										GUARDED_BY(mutex);
+	uint64 next_access_seq									GUARDED_BY(mutex);
+	std::unordered_map<std::string, ModelFileKey> model_file_keys	GUARDED_BY(mutex); // Map from model path to key.
+};
+
+
+typedef Reference<ProcessedMeshCache> ProcessedMeshCacheRef;
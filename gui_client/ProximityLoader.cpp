@@ -6,14 +6,40 @@ Copyright Glare Technologies Limited 2021 -
 #include "ProximityLoader.h"
 
 
-#include "OpenGLEngine.h"
 #include <HashMapInsertOnly2.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <map>
+#include <cmath>
 
 
 static const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in WorkerThread.cpp
+static const float DEFAULT_PREFETCH_LOOKAHEAD_TIME = 5.f;
+static const size_t MAX_NUM_PREFETCHED_CELLS = 1 << 16;
 static bool VERBOSE = false;
 
 
+static inline uint64 cellKey(int x, int y, int z)
+{
+	// Pack 21 bits of each coordinate into the key.  Cell coordinates with CELL_WIDTH = 200 m will easily fit in 21 bits.
+	return ((uint64)(x & 0x1FFFFF) << 42) | ((uint64)(y & 0x1FFFFF) << 21) | (uint64)(z & 0x1FFFFF);
+}
+
+
+static inline bool cellInRange(int x, int y, int z, const Vec4i& begin, const Vec4i& end)
+{
+	return 
+		x >= begin[0] && y >= begin[1] && z >= begin[2] &&
+		x <= end[0]   && y <= end[1]   && z <= end[2];
+}
+
+
+float ProximityLoader::getCellWidth()
+{
+	return CELL_WIDTH;
+}
+
+
 ProximityLoader::ProximityLoader(float load_distance_)
 :	load_distance(load_distance_),
 	load_distance2(load_distance_ * load_distance_),
@@ -21,7 +47,11 @@ ProximityLoader::ProximityLoader(float load_distance_)
 		CELL_WIDTH, // grid cell width
 		1 << 10 // expected_num_items = num buckets
 	),
-	last_cam_pos(0,0,0,1)
+	last_cam_pos(0,0,0,1),
+	prefetch_lookahead_time(DEFAULT_PREFETCH_LOOKAHEAD_TIME),
+	last_prefetch_pos(0,0,0,1),
+	num_prefetched_cells(0),
+	num_prefetched_cells_used(0)
 {
 	// Number of cells to iterate over is approx (2*load_distance / cell_w)^3
 	// If cell_w = load_distance / 2,
@@ -145,6 +175,7 @@ void ProximityLoader::removeObject(WorldObjectRef ob)
 void ProximityLoader::clearAllObjects()
 {
 	ob_grid.clear();
+	prefetched_cells.clear();
 }
 
 
@@ -182,8 +213,10 @@ void ProximityLoader::objectTransformChanged(WorldObject* ob)
 }
 
 
-void ProximityLoader::updateCamPos(const Vec4f& new_cam_pos)
+void ProximityLoader::updateCamPos(const Vec4f& new_cam_pos, double time)
 {
+	path_predictor.addSample(new_cam_pos, time);
+
 	if(new_cam_pos.getDist(last_cam_pos) > 1.0f)
 	{
 		//conPrint("ProximityLoader: walking grid cells, new_cam_pos: " + new_cam_pos.toStringNSigFigs(3));
@@ -258,34 +291,75 @@ void ProximityLoader::updateCamPos(const Vec4f& new_cam_pos)
 					x <= old_end[0]   && y <= old_end[1]   && z <= old_end[2];
 				if(!is_in_old_cells)
 				{
-					if(VERBOSE) conPrint("ProximityLoader: Loading cell " + cell_coords.toString());
-					callbacks->newCellInProximity(cell_coords);
+					if(!prefetched_cells.empty() && (prefetched_cells.erase(cellKey(x, y, z)) != 0)) // If we already queried this cell due to prefetching:
+					{
+						num_prefetched_cells_used++;
+					}
+					else
+					{
+						if(VERBOSE) conPrint("ProximityLoader: Loading cell " + cell_coords.toString());
+						callbacks->newCellInProximity(cell_coords);
+					}
 				}
 			}
 		}
 
 		this->last_cam_pos = new_cam_pos;
 	}
+
+	updatePrefetchCells();
 }
 
 
-std::string ProximityLoader::getDiagnostics() const
+// Calls newCellInProximity() for cells within load distance of the predicted camera position, that are not within load distance of the current camera position,
+// and haven't been prefetched already.
+void ProximityLoader::updatePrefetchCells()
 {
-	size_t num_obs = 0;
-	size_t num_in_proximity_obs = 0;
-	for(size_t i=0; i<ob_grid.buckets.size(); ++i)
+	const Vec4f prefetch_pos = (prefetch_lookahead_time > 0) ? path_predictor.predictPos(prefetch_lookahead_time, /*max dist=*/load_distance) : last_cam_pos;
+
+	if(prefetch_pos.getDist(last_prefetch_pos) > 1.0f)
 	{
-		for(auto it = ob_grid.buckets[i].objects.begin(); it != ob_grid.buckets[i].objects.end(); ++it)
-		{
-			//const WorldObject* ob = it->ptr();
+		// If the set of prefetched cells has got large (for example the camera has been flying for a long time, without coming close to a lot of the prefetched cells),
+		// just clear it.  This may result in some cells being queried twice, which is harmless.
+		if(prefetched_cells.size() > MAX_NUM_PREFETCHED_CELLS)
+			prefetched_cells.clear();
 
-			num_obs++;
-			//if(ob->in_proximity)
-			//	num_in_proximity_obs++;
+		const Vec4i cur_begin = ob_grid.bucketIndicesForPoint(last_cam_pos - Vec4f(load_distance, load_distance, load_distance, 0));
+		const Vec4i cur_end   = ob_grid.bucketIndicesForPoint(last_cam_pos + Vec4f(load_distance, load_distance, load_distance, 0));
+
+		const Vec4i old_begin = ob_grid.bucketIndicesForPoint(last_prefetch_pos - Vec4f(load_distance, load_distance, load_distance, 0));
+		const Vec4i old_end   = ob_grid.bucketIndicesForPoint(last_prefetch_pos + Vec4f(load_distance, load_distance, load_distance, 0));
+
+		const Vec4i begin = ob_grid.bucketIndicesForPoint(prefetch_pos - Vec4f(load_distance, load_distance, load_distance, 0));
+		const Vec4i end   = ob_grid.bucketIndicesForPoint(prefetch_pos + Vec4f(load_distance, load_distance, load_distance, 0));
+
+		for(int z = begin[2]; z <= end[2]; ++z)
+		for(int y = begin[1]; y <= end[1]; ++y)
+		for(int x = begin[0]; x <= end[0]; ++x)
+		{
+			if(!cellInRange(x, y, z, old_begin, old_end) && !cellInRange(x, y, z, cur_begin, cur_end))
+			{
+				if(prefetched_cells.insert(cellKey(x, y, z)).second) // If not already prefetched:
+				{
+					if(VERBOSE) conPrint("ProximityLoader: Prefetching cell " + Vec3<int>(x, y, z).toString());
+					num_prefetched_cells++;
+					callbacks->newCellInProximity(Vec3<int>(x, y, z));
+				}
+			}
 		}
+
+		this->last_prefetch_pos = prefetch_pos;
 	}
+}
+
 
-	return "Obs: " + toString(num_obs) + " (in proximity: " + toString(num_in_proximity_obs) + ", out of proximity: " + toString(num_obs - num_in_proximity_obs) + ")";
+std::string ProximityLoader::getDiagnostics() const
+{
+	const size_t num_obs = ob_grid.size();
+	size_t num_in_proximity_obs = 0;
+
+	return "Obs: " + toString(num_obs) + " (in proximity: " + toString(num_in_proximity_obs) + ", out of proximity: " + toString(num_obs - num_in_proximity_obs) + ")\n" + 
+		"Cam velocity: " + doubleToStringNSigFigs(path_predictor.getVelocity().length(), 3) + " m/s, prefetched cells: " + toString(num_prefetched_cells) + " (used: " + toString(num_prefetched_cells_used) + ")";
 }
 
 
@@ -293,6 +367,9 @@ std::string ProximityLoader::getDiagnostics() const
 js::AABBox ProximityLoader::setCameraPosForNewConnection(const Vec4f& initial_cam_pos)
 {
 	this->last_cam_pos = initial_cam_pos;
+	this->last_prefetch_pos = initial_cam_pos;
+	path_predictor.reset();
+	prefetched_cells.clear();
 
 	// NOTE: Important to use the same maths here for determining which cells to load as we use in updateCamPos() above.
 	// Otherwise some objects will not be loaded in some circumstances.
@@ -309,14 +386,200 @@ js::AABBox ProximityLoader::setCameraPosForNewConnection(const Vec4f& initial_ca
 #if BUILD_TESTS
 
 
+#include <utils/TestUtils.h>
+#include <maths/PCG32.h>
+#include <map>
+
+
+struct CameraTrackSample
+{
+	double time;
+	Vec4f pos;
+};
+
+
+class ProximityLoaderTestCallbacks : public ObLoadingCallbacks
+{
+public:
+	ProximityLoaderTestCallbacks() : cur_time(0), num_duplicate_queries(0) {}
+
+	virtual void unloadObject(WorldObjectRef ob) {}
+
+	virtual void newCellInProximity(const Vec3<int>& cell_coords)
+	{
+		const uint64 key = cellKey(cell_coords.x, cell_coords.y, cell_coords.z);
+		if(cell_query_times.count(key) != 0)
+			num_duplicate_queries++;
+		else
+			cell_query_times[key] = cur_time;
+	}
+
+	double cur_time;
+	std::map<uint64, double> cell_query_times; // Map from cell key to time the cell was first queried.
+	int num_duplicate_queries; // Number of queries for cells that were already queried.  Cells are queried again when the camera comes back to them after moving away.
+};
+
+
+struct TrackReplayResults
+{
+	double mean_lead_time; // Mean over cells the camera came within load distance of, of how long before then the cell was queried.
+	int num_missed_cells; // Number of cells the camera came within load distance of, that were never queried.
+	int num_duplicate_queries;
+	size_t num_queried_cells;
+};
+
+
+// Replays a recorded camera track through a ProximityLoader, and checks when cells are queried, compared to when the camera gets within load distance of them.
+static TrackReplayResults replayCameraTrack(const std::vector<CameraTrackSample>& track, float load_distance, float prefetch_lookahead_time)
+{
+	ProximityLoaderTestCallbacks callbacks;
+	ProximityLoader loader(load_distance);
+	loader.callbacks = &callbacks;
+	loader.setPrefetchLookaheadTime(prefetch_lookahead_time);
+
+	std::map<uint64, double> cell_needed_times; // Map from cell key to the time the camera first came within load distance of the cell.
+	for(size_t i=0; i<track.size(); ++i)
+	{
+		callbacks.cur_time = track[i].time;
+
+		if(i == 0)
+		{
+			// The cells returned by setCameraPosForNewConnection() are queried by the caller.
+			const js::AABBox aabb = loader.setCameraPosForNewConnection(track[i].pos);
+			for(float z = aabb.min_[2] + CELL_WIDTH/2; z < aabb.max_[2]; z += CELL_WIDTH)
+			for(float y = aabb.min_[1] + CELL_WIDTH/2; y < aabb.max_[1]; y += CELL_WIDTH)
+			for(float x = aabb.min_[0] + CELL_WIDTH/2; x < aabb.max_[0]; x += CELL_WIDTH)
+			{
+				const Vec4i cell = loader.ob_grid.bucketIndicesForPoint(Vec4f(x, y, z, 1));
+				callbacks.newCellInProximity(Vec3<int>(cell[0], cell[1], cell[2]));
+			}
+		}
+		else
+			loader.updateCamPos(track[i].pos, track[i].time);
+
+		// Use last_cam_pos instead of the sample position, as the loader ignores moves of less than 1 m.
+		const Vec4i begin = loader.ob_grid.bucketIndicesForPoint(loader.last_cam_pos - Vec4f(load_distance, load_distance, load_distance, 0));
+		const Vec4i end   = loader.ob_grid.bucketIndicesForPoint(loader.last_cam_pos + Vec4f(load_distance, load_distance, load_distance, 0));
+		for(int z = begin[2]; z <= end[2]; ++z)
+		for(int y = begin[1]; y <= end[1]; ++y)
+		for(int x = begin[0]; x <= end[0]; ++x)
+			cell_needed_times.insert(std::make_pair(cellKey(x, y, z), track[i].time)); // Doesn't overwrite an existing time.
+	}
+
+	TrackReplayResults results;
+	results.num_missed_cells = 0;
+	double sum_lead_time = 0;
+	size_t num_lead_times = 0;
+	for(auto it = cell_needed_times.begin(); it != cell_needed_times.end(); ++it)
+	{
+		auto res = callbacks.cell_query_times.find(it->first);
+		if(res == callbacks.cell_query_times.end())
+			results.num_missed_cells++;
+		else if(it->second > track[0].time) // Don't include the initial cells in the lead time, as they can't be queried early.
+		{
+			sum_lead_time += it->second - res->second;
+			num_lead_times++;
+		}
+	}
+	results.mean_lead_time = sum_lead_time / myMax<size_t>(1, num_lead_times);
+	results.num_duplicate_queries = callbacks.num_duplicate_queries;
+	results.num_queried_cells = callbacks.cell_query_times.size();
+	return results;
+}
+
+
 void ProximityLoader::test()
 {
-#if 1
 	conPrint("ProximityLoader::test()");
 
-	
+	const float load_distance = 500.f;
+	const double dt = 1.0 / 60;
+
+	//-------------------- Test flying in a straight line --------------------
+	{
+		std::vector<CameraTrackSample> track;
+		for(int i=0; i<30 * 60; ++i) // 30 s at 100 m/s
+		{
+			CameraTrackSample sample;
+			sample.time = i * dt;
+			sample.pos = Vec4f((float)(sample.time * 100), 10, 2, 1);
+			track.push_back(sample);
+		}
+
+		const TrackReplayResults no_prefetch_results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/0);
+		testAssert(no_prefetch_results.num_missed_cells == 0);
+		testAssert(no_prefetch_results.num_duplicate_queries == 0);
+		testAssert(no_prefetch_results.mean_lead_time < 0.1);
+
+		const TrackReplayResults prefetch_results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/5.f);
+		conPrint("Straight line track: mean cell lead time: " + doubleToStringNSigFigs(no_prefetch_results.mean_lead_time, 3) + " s without prefetching, " + 
+			doubleToStringNSigFigs(prefetch_results.mean_lead_time, 3) + " s with prefetching");
+		testAssert(prefetch_results.num_missed_cells == 0);
+		testAssert(prefetch_results.num_duplicate_queries == 0);
+		testAssert(prefetch_results.mean_lead_time > 3.0);
+	}
+
+	//-------------------- Test driving in a circle --------------------
+	{
+		std::vector<CameraTrackSample> track;
+		const float radius = 300.f;
+		const float speed = 30.f;
+		for(int i=0; i<60 * 60; ++i) // 60 s
+		{
+			CameraTrackSample sample;
+			sample.time = i * dt;
+			const float theta = (float)(sample.time * speed / radius);
+			sample.pos = Vec4f(radius * std::cos(theta), radius * std::sin(theta), 1.5f, 1);
+			track.push_back(sample);
+		}
+
+		// The camera keeps coming back to the same cells on this track, so some cells will be queried multiple times (with or without prefetching).
+		const TrackReplayResults results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/5.f);
+		testAssert(results.num_missed_cells == 0);
+		testAssert(results.mean_lead_time > 1.0);
+	}
+
+	//-------------------- Test a random walk --------------------
+	{
+		PCG32 rng(1);
+		std::vector<CameraTrackSample> track;
+		Vec4f pos(0, 0, 2, 1);
+		Vec4f vel(0, 0, 0, 0);
+		for(int i=0; i<60 * 60; ++i)
+		{
+			CameraTrackSample sample;
+			sample.time = i * dt;
+			vel = vel + Vec4f(rng.unitRandom() - 0.5f, rng.unitRandom() - 0.5f, (rng.unitRandom() - 0.5f) * 0.1f, 0) * 10.f;
+			pos = pos + vel * (float)dt;
+			sample.pos = pos;
+			track.push_back(sample);
+		}
+
+		const TrackReplayResults results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/5.f);
+		testAssert(results.num_missed_cells == 0);
+		testAssert(results.mean_lead_time >= 0);
+	}
+
+	//-------------------- Test teleporting --------------------
+	{
+		std::vector<CameraTrackSample> track;
+		for(int i=0; i<4 * 60; ++i)
+		{
+			CameraTrackSample sample;
+			sample.time = i * dt;
+			sample.pos = (sample.time < 2.0) ? Vec4f(0, 0, 2, 1) : Vec4f(10000, 0, 2, 1);
+			track.push_back(sample);
+		}
+
+		// We shouldn't prefetch anything, as the camera is stationary apart from the teleport.
+		const TrackReplayResults no_prefetch_results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/0);
+		const TrackReplayResults prefetch_results = replayCameraTrack(track, load_distance, /*prefetch_lookahead_time=*/5.f);
+		testAssert(prefetch_results.num_missed_cells == 0);
+		testAssert(prefetch_results.num_duplicate_queries == 0);
+		testAssert(prefetch_results.num_queried_cells == no_prefetch_results.num_queried_cells);
+	}
+
 	conPrint("ProximityLoader::test() done.");
-#endif
 }
 
 
@@ -8,6 +8,7 @@ Copyright Glare Technologies Limited 2021 -
 
 #include "PhysicsWorld.h"
 #include "HashedObGrid.h"
+#include "CameraPathPredictor.h"
 #include "../shared/WorldObject.h"
 #include <string>
 #include <unordered_set>
@@ -35,6 +36,11 @@ NOTE: currently disabled:
 
 When the camera moves close to a new grid cell, calls the newCellInProximity() callback.
 This allows MainWindow to send a QueryObjects message to the server.
+
+Also prefetches cells: the camera path is extrapolated from the camera velocity (see CameraPathPredictor),
+and newCellInProximity() is also called for cells close to the predicted camera position (getPrefetchPos()),
+so objects along the predicted path are queried before the camera gets there.
+Cells that have been prefetched are not queried again when the camera actually gets close to them.
 =====================================================================*/
 class ProximityLoader
 {
@@ -42,6 +48,8 @@ public:
 	ProximityLoader(float load_distance);
 	~ProximityLoader();
 
+	static float getCellWidth(); // Width of the grid cells that objects are queried from the server in.
+
 	void setLoadDistance(float new_load_distance);
 	float getLoadDistance() const { return load_distance; }
 
@@ -59,8 +67,14 @@ public:
 	// Notify the ProximityLoader that an object has changed position
 	void objectTransformChanged(WorldObject* ob);
 
-	// Notify the ProximityLoader that the camera has moved
-	void updateCamPos(const Vec4f& new_cam_pos);
+	// Notify the ProximityLoader that the camera has moved.  time is in seconds, and is used for estimating the camera velocity.
+	void updateCamPos(const Vec4f& new_cam_pos, double time);
+
+	// Predicted camera position, prefetch_lookahead_time seconds from now.  Equal to the camera position if the camera is not moving.
+	const Vec4f& getPrefetchPos() const { return last_prefetch_pos; }
+
+	// Set to zero to disable prefetching.
+	void setPrefetchLookaheadTime(float t) { prefetch_lookahead_time = t; }
 
 	// Sets initial camera position, doesn't issue load object callbacks (assumes no objects downloaded yet)
 	// Returns query AABB
@@ -79,4 +93,14 @@ public:
 	float load_distance2;
 	HashedObGrid ob_grid;
 	Vec4f last_cam_pos;
+
+	CameraPathPredictor path_predictor;
+	float prefetch_lookahead_time; // How far ahead in time we predict the camera position for prefetching, in seconds.
+	Vec4f last_prefetch_pos;
+	std::unordered_set<uint64> prefetched_cells; // Cells that newCellInProximity() was called for due to prefetching, that have not come within load distance of the camera yet.
+	size_t num_prefetched_cells; // Total number of cells prefetched, for diagnostics.
+	size_t num_prefetched_cells_used; // Number of prefetched cells that the camera later came within load distance of.
+
+private:
+	void updatePrefetchCells();
 };
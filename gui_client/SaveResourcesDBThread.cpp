@@ -28,21 +28,14 @@ void SaveResourcesDBThread::doRun()
 
 	while(1)
 	{
+		// Doesn't hold the resource manager mutex while writing to disk, so downloads etc. aren't blocked by the save.
+		try
 		{
-			Lock lock(resource_manager->getMutex());
-			if(resource_manager->hasChanged())
-			{
-				resource_manager->clearChangedFlag();
-
-				try
-				{
-					resource_manager->saveToDisk(path);
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("WARNING: Failed to save resources db: " + e.what());
-				}
-			}
+			resource_manager->saveChangesToDisk(path);
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("WARNING: Failed to save resources db: " + e.what());
 		}
 
 		// Wait for N seconds or until we get a KillThreadMessage.
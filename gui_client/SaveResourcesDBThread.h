@@ -17,6 +17,8 @@ SaveResourcesDBThread
 ---------------------
 Saves resources list to resources database on disk, if the resource manager 
 has changed.
+Changed resources are appended to the resources journal, the whole database
+is only rewritten when the journal gets too long.
 =====================================================================*/
 class SaveResourcesDBThread : public MessageableThread
 {
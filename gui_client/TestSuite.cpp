@@ -7,10 +7,19 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "ModelLoading.h"
+#include "ProcessedMeshCache.h"
+#include "MemoryBudgetManager.h"
+#include "LoadItemQueue.h"
+#include "DownloadingResourceQueue.h"
+#include "TextureLoadCoordinator.h"
+#include "MainThreadWorkScheduler.h"
 #include "PhysicsWorld.h"
 #include "TerrainTests.h"
 #include "URLParser.h"
 #include "CameraController.h"
+#include "CameraPathPredictor.h"
+#include "ProximityLoader.h"
+#include "HashedObGrid.h"
 #include "../shared/VoxelMeshBuilding.h"
 #include "../shared/LODGeneration.h"
 #include "../shared/ImageDecoding.h"
@@ -176,6 +185,14 @@ void TestSuite::test()
 	runTest([&]() { js::AABBox::test(); });
 	runTest([&]() { ReferenceTest::run(); });
 	runTest([&]() { CameraController::test(); });
+	runTest([&]() { MemoryBudgetManager::test(); });
+	runTest([&]() { LoadItemQueue::test(); });
+	runTest([&]() { DownloadingResourceQueue::test(); });
+	runTest([&]() { TextureLoadCoordinator::test(); });
+	runTest([&]() { CameraPathPredictor::test(); });
+	runTest([&]() { ProximityLoader::test(); });
+	runTest([&]() { HashedObGrid::test(); });
+	runTest([&]() { MainThreadWorkScheduler::test(); });
 
 #if !defined(EMSCRIPTEN)
 
@@ -187,6 +204,7 @@ void TestSuite::test()
 	runTest([&]() { PhysicsWorld::test(); });
 	runTest([&]() { FormatDecoderGLTF::test(); });
 	runTest([&]() { BatchedMeshTests::test(); });
+	runTest([&]() { ProcessedMeshCache::test(); });
 	runTest([&]() { EXRDecoder::test(); }, /*mem leak allowed=*/true); // OpenEXR leaks some minor stuff
 	runTest([&]() { TextRenderer::test(); });
 	//runTest([&]() { glare::AudioEngine::test(); }); // Disabled, noisy
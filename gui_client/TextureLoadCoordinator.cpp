@@ -0,0 +1,430 @@
+/*=====================================================================
+TextureLoadCoordinator.cpp
+--------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "TextureLoadCoordinator.h"
+
+
+#include <graphics/ImageMap.h>
+#include <utils/StringUtils.h>
+#include <utils/ConPrint.h>
+#include <utils/Lock.h>
+#include <maths/mathstypes.h>
+#include <algorithm>
+
+
+// The web client has a much smaller memory limit, so keep the decoded image cache small there.
+#if EMSCRIPTEN
+static const size_t DEFAULT_MAX_DECODED_MAP_CACHE_B = 8 * 1024 * 1024;
+#else
+static const size_t DEFAULT_MAX_DECODED_MAP_CACHE_B = 64 * 1024 * 1024;
+#endif
+
+
+TextureLoadCoordinator::TextureLoadCoordinator()
+:	decoded_maps_size_B(0),
+	max_decoded_map_cache_B(DEFAULT_MAX_DECODED_MAP_CACHE_B)
+{}
+
+
+TextureLoadCoordinator::~TextureLoadCoordinator()
+{}
+
+
+Reference<TextureLoadJob> TextureLoadCoordinator::createJob(const std::string& key, const void* requester)
+{
+	// If there is an existing job for this key (e.g. a cancelled one whose task hasn't finished yet), it is replaced.
+	auto res = jobs.find(key);
+	if(res != jobs.end())
+		res->second->cancelled = 1;
+
+	Reference<TextureLoadJob> job = new TextureLoadJob(key);
+	jobs[key] = job;
+	addRequester(key, requester);
+	return job;
+}
+
+
+void TextureLoadCoordinator::addRequester(const std::string& key, const void* requester)
+{
+	auto res = jobs.find(key);
+	if(res == jobs.end())
+		return;
+
+	TextureLoadJob* job = res->second.ptr();
+	bool new_request = true;
+	if(requester)
+	{
+		new_request = job->requesters.insert(requester).second;
+		if(new_request)
+			requester_job_keys[requester].push_back(key);
+	}
+	else
+		job->num_untracked_requesters++;
+
+	if(new_request && (job->requesters.size() + job->num_untracked_requesters > 1)) // Don't count a requester asking again for a texture it has already requested.
+		num_merged_requests++;
+
+	job->cancelled = 0;
+}
+
+
+void TextureLoadCoordinator::removeRequester(const void* requester)
+{
+	auto res = requester_job_keys.find(requester);
+	if(res == requester_job_keys.end())
+		return;
+
+	const std::vector<std::string>& keys = res->second;
+	for(size_t i=0; i<keys.size(); ++i)
+	{
+		auto job_res = jobs.find(keys[i]);
+		if(job_res != jobs.end())
+		{
+			TextureLoadJob* job = job_res->second.ptr();
+			job->requesters.erase(requester);
+			if(job->requesters.empty() && (job->num_untracked_requesters == 0) && !job->isCancelled())
+			{
+				job->cancelled = 1;
+				num_cancelled_jobs++;
+			}
+		}
+	}
+
+	requester_job_keys.erase(res);
+}
+
+
+TextureLoadJob* TextureLoadCoordinator::getJob(const std::string& key)
+{
+	auto res = jobs.find(key);
+	return (res != jobs.end()) ? res->second.ptr() : NULL;
+}
+
+
+void TextureLoadCoordinator::jobFinished(const Reference<TextureLoadJob>& job)
+{
+	auto res = jobs.find(job->key);
+	if(res == jobs.end() || res->second != job)
+		return;
+
+	// Remove the job key from the lists for each requester
+	for(auto it = job->requesters.begin(); it != job->requesters.end(); ++it)
+	{
+		auto req_res = requester_job_keys.find(*it);
+		if(req_res != requester_job_keys.end())
+		{
+			std::vector<std::string>& keys = req_res->second;
+			keys.erase(std::remove(keys.begin(), keys.end(), job->key), keys.end());
+			if(keys.empty())
+				requester_job_keys.erase(req_res);
+		}
+	}
+
+	jobs.erase(res);
+}
+
+
+void TextureLoadCoordinator::clear()
+{
+	for(auto it = jobs.begin(); it != jobs.end(); ++it)
+		it->second->cancelled = 1;
+
+	jobs.clear();
+	requester_job_keys.clear();
+
+	Lock lock(cache_mutex);
+	decoded_maps.clear();
+	decoded_maps_size_B = 0;
+}
+
+
+void TextureLoadCoordinator::parseLODTextureURL(const std::string& URL, std::string& base_name_out, int& lod_level_out)
+{
+	// See getLODTextureURLForLevel() in WorldMaterial.cpp for the LOD URL format.
+	const std::string name = removeDotAndExtension(URL);
+	if(name.size() >= 5)
+	{
+		const size_t suffix_start = name.size() - 5;
+		if((name.compare(suffix_start, 4, "_lod") == 0) && (name[suffix_start + 4] >= '0') && (name[suffix_start + 4] <= '2'))
+		{
+			base_name_out = name.substr(0, suffix_start);
+			lod_level_out = name[suffix_start + 4] - '0';
+			return;
+		}
+	}
+
+	base_name_out = name;
+	lod_level_out = -1;
+}
+
+
+int TextureLoadCoordinator::maxDimForLODLevel(int lod_level)
+{
+	return (lod_level == 0) ? 1024 : ((lod_level == 1) ? 256 : 64);
+}
+
+
+Reference<Map2D> TextureLoadCoordinator::getDerivedLODMap(const std::string& URL, glare::TaskManager* task_manager)
+{
+	// Gif LOD textures are made with GIFDecoder::resizeGIF(), so we can't make them from a single decoded frame.
+	if(!(hasExtension(URL, "jpg") || hasExtension(URL, "png")))
+		return NULL;
+
+	std::string base_name;
+	int lod_level;
+	parseLODTextureURL(URL, base_name, lod_level);
+	if(lod_level < 0)
+		return NULL;
+
+	// Find the lowest-detail cached level that has more detail than the requested level, as it will be the cheapest to downsample.
+	Reference<Map2D> src_map;
+	{
+		Lock lock(cache_mutex);
+
+		auto best = decoded_maps.end();
+		for(auto it = decoded_maps.begin(); it != decoded_maps.end(); ++it)
+			if((it->base_name == base_name) && (it->lod_level < lod_level) && ((best == decoded_maps.end()) || (it->lod_level > best->lod_level)))
+				best = it;
+
+		if(best == decoded_maps.end())
+			return NULL;
+
+		src_map = best->map;
+		decoded_maps.splice(decoded_maps.begin(), decoded_maps, best); // Move to front of LRU list
+	}
+
+	// Compute dimensions in the same way as LODGeneration::generateLODTexture()
+	const int new_max_w_h = maxDimForLODLevel(lod_level);
+	const int min_w_h = 1;
+	const int W = (int)src_map->getMapWidth();
+	const int H = (int)src_map->getMapHeight();
+	int new_w, new_h;
+	if(W > H)
+	{
+		new_w = myMin(W, new_max_w_h);
+		new_h = myMax(min_w_h, (int)((float)new_w * (float)H / (float)W));
+	}
+	else
+	{
+		new_h = myMin(H, new_max_w_h);
+		new_w = myMax(min_w_h, (int)((float)new_h * (float)W / (float)H));
+	}
+
+	Reference<Map2D> resized_map = src_map->resizeMidQuality(new_w, new_h, task_manager);
+
+	// LOD textures without alpha are saved as jpgs, which have 3 channels.
+	if(hasExtension(URL, "jpg") && (resized_map->numChannels() > 3) && resized_map.isType<ImageMapUInt8>())
+		resized_map = resized_map.downcast<ImageMapUInt8>()->extract3ChannelImage();
+
+	num_derived_maps++;
+	return resized_map;
+}
+
+
+void TextureLoadCoordinator::addDecodedMap(const std::string& URL, const Reference<Map2D>& map)
+{
+	if(!map.isType<ImageMapUInt8>() || hasExtension(URL, "gif"))
+		return;
+
+	std::string base_name;
+	int lod_level;
+	parseLODTextureURL(URL, base_name, lod_level);
+	if(lod_level >= 2) // Nothing can be derived from the lowest-detail level.
+		return;
+
+	const size_t size_B = map->getByteSize();
+
+	Lock lock(cache_mutex);
+
+	if(size_B > max_decoded_map_cache_B / 4) // Don't let a single huge image flush the whole cache.
+		return;
+
+	// Remove any existing item for this texture and level
+	for(auto it = decoded_maps.begin(); it != decoded_maps.end(); ++it)
+		if((it->base_name == base_name) && (it->lod_level == lod_level))
+		{
+			decoded_maps_size_B -= it->size_B;
+			decoded_maps.erase(it);
+			break;
+		}
+
+	DecodedMapCacheItem item;
+	item.base_name = base_name;
+	item.lod_level = lod_level;
+	item.map = map;
+	item.size_B = size_B;
+	decoded_maps.push_front(item);
+	decoded_maps_size_B += size_B;
+
+	// Evict least recently used items until we are under budget.
+	while(decoded_maps_size_B > max_decoded_map_cache_B)
+	{
+		decoded_maps_size_B -= decoded_maps.back().size_B;
+		decoded_maps.pop_back();
+	}
+}
+
+
+void TextureLoadCoordinator::setMaxDecodedMapCacheSize(size_t max_B)
+{
+	Lock lock(cache_mutex);
+	max_decoded_map_cache_B = max_B;
+
+	while(decoded_maps_size_B > max_decoded_map_cache_B)
+	{
+		decoded_maps_size_B -= decoded_maps.back().size_B;
+		decoded_maps.pop_back();
+	}
+}
+
+
+size_t TextureLoadCoordinator::getDecodedMapCacheSize() const
+{
+	Lock lock(cache_mutex);
+	return decoded_maps_size_B;
+}
+
+
+std::string TextureLoadCoordinator::getDiagnostics() const
+{
+	size_t num_decoded_maps;
+	size_t size_B;
+	{
+		Lock lock(cache_mutex);
+		num_decoded_maps = decoded_maps.size();
+		size_B = decoded_maps_size_B;
+	}
+
+	return "Texture load jobs: " + toString(jobs.size()) + ", merged requests: " + toString(num_merged_requests.getValue()) + ", cancelled jobs: " + toString(num_cancelled_jobs.getValue()) + "\n" +
+		"Decoded texture cache: " + toString(num_decoded_maps) + " images, " + getMBSizeString(size_B) + ", derived LOD textures: " + toString(num_derived_maps.getValue()) + "\n";
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+void TextureLoadCoordinator::test()
+{
+	conPrint("TextureLoadCoordinator::test()");
+
+	//-------------------- Test parseLODTextureURL --------------------
+	{
+		std::string base_name;
+		int lod_level;
+		parseLODTextureURL("tex_123.png", base_name, lod_level);
+		testAssert(base_name == "tex_123" && lod_level == -1);
+
+		parseLODTextureURL("tex_123_lod0.jpg", base_name, lod_level);
+		testAssert(base_name == "tex_123" && lod_level == 0);
+
+		parseLODTextureURL("tex_123_lod2.png", base_name, lod_level);
+		testAssert(base_name == "tex_123" && lod_level == 2);
+
+		parseLODTextureURL("tex_lod9.png", base_name, lod_level);
+		testAssert(base_name == "tex_lod9" && lod_level == -1);
+
+		parseLODTextureURL("lod", base_name, lod_level);
+		testAssert(lod_level == -1);
+	}
+
+	//-------------------- Test merging requests and cancellation --------------------
+	{
+		TextureLoadCoordinator coordinator;
+		int ob_a, ob_b; // Just used for their addresses
+
+		Reference<TextureLoadJob> job = coordinator.createJob("a.jpg", &ob_a);
+		coordinator.addRequester("a.jpg", &ob_b);
+		coordinator.addRequester("a.jpg", &ob_b); // Adding the same requester again shouldn't add it twice.
+		coordinator.addRequester("b.jpg", &ob_b); // No job for b.jpg, should do nothing.
+		testAssert(coordinator.getJob("a.jpg") == job.ptr());
+		testAssert(coordinator.getJob("b.jpg") == NULL);
+		testAssert(job->requesters.size() == 2);
+		testAssert(coordinator.num_merged_requests.getValue() == 1);
+
+		coordinator.removeRequester(&ob_a);
+		testAssert(!job->isCancelled());
+		coordinator.removeRequester(&ob_b);
+		testAssert(job->isCancelled());
+		testAssert(coordinator.num_cancelled_jobs.getValue() == 1);
+
+		// A new request should un-cancel the job.
+		coordinator.addRequester("a.jpg", &ob_a);
+		testAssert(!job->isCancelled());
+
+		coordinator.jobFinished(job);
+		testAssert(coordinator.numJobs() == 0);
+		testAssert(coordinator.requester_job_keys.empty());
+
+		// Test a job with an untracked requester is not cancelled
+		Reference<TextureLoadJob> job2 = coordinator.createJob("c.jpg", &ob_a);
+		coordinator.addRequester("c.jpg", NULL);
+		coordinator.removeRequester(&ob_a);
+		testAssert(!job2->isCancelled());
+
+		// Test that finishing an old job doesn't remove a newer job for the same key
+		Reference<TextureLoadJob> job3 = coordinator.createJob("c.jpg", &ob_b);
+		testAssert(job2->isCancelled());
+		coordinator.jobFinished(job2);
+		testAssert(coordinator.getJob("c.jpg") == job3.ptr());
+
+		coordinator.clear();
+		testAssert(job3->isCancelled());
+		testAssert(coordinator.numJobs() == 0);
+	}
+
+	//-------------------- Test deriving LOD levels from decoded images --------------------
+	{
+		TextureLoadCoordinator coordinator;
+
+		Reference<ImageMapUInt8> base_map = new ImageMapUInt8(2048, 1024, 4);
+		base_map->zero();
+		coordinator.addDecodedMap("tex_123.png", base_map);
+		testAssert(coordinator.getDecodedMapCacheSize() == base_map->getByteSize());
+
+		// Should not be able to derive the base level, or other textures.
+		testAssert(coordinator.getDerivedLODMap("tex_123.png", NULL).isNull());
+		testAssert(coordinator.getDerivedLODMap("other_lod1.jpg", NULL).isNull());
+		testAssert(coordinator.getDerivedLODMap("tex_123_lod1.gif", NULL).isNull());
+
+		Reference<Map2D> lod1 = coordinator.getDerivedLODMap("tex_123_lod1.jpg", NULL);
+		testAssert(lod1.nonNull());
+		testAssert(lod1->getMapWidth() == 256 && lod1->getMapHeight() == 128);
+		testAssert(lod1->numChannels() == 3); // jpg LOD textures have 3 channels.
+
+		Reference<Map2D> lod2 = coordinator.getDerivedLODMap("tex_123_lod2.png", NULL);
+		testAssert(lod2.nonNull());
+		testAssert(lod2->getMapWidth() == 64 && lod2->getMapHeight() == 32);
+		testAssert(lod2->numChannels() == 4);
+		testAssert(coordinator.num_derived_maps.getValue() == 2);
+
+		// Lowest LOD level images aren't cached, since nothing can be derived from them.
+		coordinator.addDecodedMap("tex_456_lod2.jpg", new ImageMapUInt8(64, 64, 3));
+		testAssert(coordinator.getDecodedMapCacheSize() == base_map->getByteSize());
+
+		// Test LRU eviction
+		coordinator.setMaxDecodedMapCacheSize(base_map->getByteSize() * 4);
+		Reference<ImageMapUInt8> map_b = new ImageMapUInt8(1024, 1024, 4);
+		Reference<ImageMapUInt8> map_c = new ImageMapUInt8(1024, 1024, 4);
+		coordinator.addDecodedMap("b.png", map_b);
+		coordinator.addDecodedMap("c.png", map_c);
+		testAssert(coordinator.getDecodedMapCacheSize() == base_map->getByteSize() + map_b->getByteSize() + map_c->getByteSize());
+
+		// Use tex_123.png, so that b.png is the least recently used, and should be evicted when the cache size is reduced.
+		testAssert(coordinator.getDerivedLODMap("tex_123_lod1.jpg", NULL).nonNull());
+		coordinator.setMaxDecodedMapCacheSize(base_map->getByteSize() + map_c->getByteSize());
+		testAssert(coordinator.getDecodedMapCacheSize() == base_map->getByteSize() + map_c->getByteSize());
+		testAssert(coordinator.getDerivedLODMap("tex_123_lod1.jpg", NULL).nonNull());
+		testAssert(coordinator.getDerivedLODMap("c_lod1.jpg", NULL).nonNull());
+		testAssert(coordinator.getDerivedLODMap("b_lod1.jpg", NULL).isNull());
+	}
+
+	conPrint("TextureLoadCoordinator::test() done.");
+}
+
+
+#endif // BUILD_TESTS
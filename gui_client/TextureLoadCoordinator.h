@@ -0,0 +1,127 @@
+/*=====================================================================
+TextureLoadCoordinator.h
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <utils/ThreadSafeRefCounted.h>
+#include <utils/Reference.h>
+#include <utils/AtomicInt.h>
+#include <utils/Mutex.h>
+#include <utils/Platform.h>
+#include <string>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+class Map2D;
+namespace glare { class TaskManager; }
+
+
+/*=====================================================================
+TextureLoadJob
+--------------
+An in-flight texture load (a LoadTextureTask), shared by all the objects that requested the texture.
+=====================================================================*/
+class TextureLoadJob : public ThreadSafeRefCounted
+{
+public:
+	TextureLoadJob(const std::string& key_) : key(key_), num_untracked_requesters(0), cancelled(0) {}
+
+	bool isCancelled() const { return cancelled != 0; } // Threadsafe
+
+	std::string key; // Local texture path
+	std::unordered_set<const void*> requesters; // Objects and avatars that want this texture.  Only accessed on the main thread.
+	int num_untracked_requesters; // Requesters that don't tell us when they go away (e.g. the minimap).  A job with any of these is never cancelled.
+	glare::AtomicInt cancelled; // Set on the main thread when all requesters have gone away, read by the LoadTextureTask.
+};
+
+
+/*=====================================================================
+TextureLoadCoordinator
+----------------------
+Coordinates LoadTextureTasks, to avoid doing the same decoding work multiple times:
+
+* Requests for a texture that is already being loaded are merged into the existing job, 
+and the job keeps track of the objects that requested it.  When all the requesters have been
+unloaded, the job is cancelled, and the task skips decoding (or skips building the texture data if it has already decoded).
+
+* Decoded images are kept in a small LRU cache (bounded by max_decoded_map_cache_B, which is smaller on the web client), keyed by base texture URL and LOD level.
+Its size is reported to the MemoryBudgetManager along with the texture server usage.
+When a LOD level of a texture is requested (e.g. 'xx_lod1.jpg') and a higher-detail level of the same texture has
+been decoded recently, the LOD level is made by downsampling the decoded image instead of decoding the LOD texture file.
+
+Job tracking is done on the main thread only.  The decoded image cache is threadsafe.
+=====================================================================*/
+class TextureLoadCoordinator : public ThreadSafeRefCounted
+{
+public:
+	TextureLoadCoordinator();
+	~TextureLoadCoordinator();
+
+	//----------------------------------- Job tracking (main thread only) -----------------------------------
+	// Creates a new job for the texture, requested by requester.  requester may be NULL for requesters that we can't track, in which case the job won't be cancelled.
+	Reference<TextureLoadJob> createJob(const std::string& key, const void* requester);
+
+	// Adds another requester to the job for the texture, if there is one.  Un-cancels the job if it was cancelled.
+	void addRequester(const std::string& key, const void* requester);
+
+	// Removes requester from all jobs.  Jobs without any remaining requesters are cancelled.
+	void removeRequester(const void* requester);
+
+	// Returns the current job for the texture, or NULL if none.
+	TextureLoadJob* getJob(const std::string& key);
+
+	// Called when the task for the job has finished (or has been discarded).  Does nothing if job is not the current job for its key.
+	void jobFinished(const Reference<TextureLoadJob>& job);
+
+	// Cancels and removes all jobs.
+	void clear();
+
+	size_t numJobs() const { return jobs.size(); }
+
+	//----------------------------------- Decoded image cache (threadsafe) -----------------------------------
+	// If URL is a LOD texture URL (e.g. 'xx_lod1.jpg'), and a higher-detail level of the texture is in the cache, returns a downsampled copy of it,
+	// with the dimensions that LODGeneration::generateLODTexture() would have given the LOD texture.  Returns NULL otherwise.
+	Reference<Map2D> getDerivedLODMap(const std::string& URL, glare::TaskManager* task_manager);
+
+	// Adds a decoded image to the cache, if lower-detail LOD levels could be derived from it.
+	void addDecodedMap(const std::string& URL, const Reference<Map2D>& map);
+
+	void setMaxDecodedMapCacheSize(size_t max_B);
+	size_t getDecodedMapCacheSize() const;
+
+	// Parses a texture URL into the base texture name and LOD level.  LOD level is -1 for base textures.
+	static void parseLODTextureURL(const std::string& URL, std::string& base_name_out, int& lod_level_out);
+
+	// Max width or height for LOD level textures, as used in LODGeneration::generateLODTexture().
+	static int maxDimForLODLevel(int lod_level);
+
+	std::string getDiagnostics() const;
+
+	static void test();
+
+	// Stats
+	glare::AtomicInt num_merged_requests;
+	glare::AtomicInt num_cancelled_jobs;
+	glare::AtomicInt num_derived_maps;
+
+private:
+	std::unordered_map<std::string, Reference<TextureLoadJob>> jobs; // Map from key to job.
+	std::unordered_map<const void*, std::vector<std::string>> requester_job_keys; // Map from requester to keys of jobs it has requested.
+
+	struct DecodedMapCacheItem
+	{
+		std::string base_name;
+		int lod_level;
+		Reference<Map2D> map;
+		size_t size_B;
+	};
+
+	mutable Mutex cache_mutex;
+	std::list<DecodedMapCacheItem> decoded_maps GUARDED_BY(cache_mutex); // Most recently used items at the front.
+	size_t decoded_maps_size_B GUARDED_BY(cache_mutex);
+	size_t max_decoded_map_cache_B GUARDED_BY(cache_mutex);
+};
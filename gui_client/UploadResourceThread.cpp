@@ -17,6 +17,22 @@ Generated at 2016-01-16 22:59:23 +1300
 #include <MemMappedFile.h>
 #include <PlatformUtils.h>
 #include <SocketBufferOutStream.h>
+#include <IncludeXXHash.h>
+#include <mathstypes.h>
+
+
+const uint32 UploadResourceThread::UPLOAD_CHUNK_SIZE;
+const int UploadResourceThread::NUM_PARALLEL_STREAMS;
+const uint64 UploadResourceThread::PARALLEL_UPLOAD_MIN_BYTES;
+const int UploadResourceThread::MAX_UPLOAD_ATTEMPTS;
+
+
+// Thrown when the server refuses the upload, for example due to the URL being owned by someone else, in which case there is no point retrying.
+class UploadRefusedExcep : public glare::Exception
+{
+public:
+	UploadRefusedExcep(const std::string& msg) : glare::Exception(msg) {}
+};
 
 
 UploadResourceThread::UploadResourceThread(ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue_, const std::string& local_path_, const std::string& resource_URL_, 
@@ -38,70 +54,285 @@ UploadResourceThread::~UploadResourceThread()
 {}
 
 
-void UploadResourceThread::doRun()
-{
 #if !defined(EMSCRIPTEN)
-	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UploadResourceThread");
 
-	try
+
+// Connects to the server and does the hello and protocol version exchange.  Doesn't send the connection type yet, so the caller can choose it based on the server protocol version.
+Reference<TLSSocket> UploadResourceThread::connectToServer(uint32& server_protocol_version_out)
+{
+	MySocketRef plain_socket = new MySocket(hostname, port);
+	plain_socket->setUseNetworkByteOrder(false);
+
+	TLSSocketRef socket = new TLSSocket(plain_socket, config, hostname);
+
+	socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
+	socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
+
+	// Read hello response from server
+	const uint32 hello_response = socket->readUInt32();
+	if(hello_response != Protocol::CyberspaceHello)
+		throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+
+	// Read protocol version response from server
+	const uint32 protocol_response = socket->readUInt32();
+	if(protocol_response == Protocol::ClientProtocolTooOld)
+	{
+		const std::string msg = socket->readStringLengthFirst(10000);
+		throw UploadRefusedExcep(msg);
+	}
+	else if(protocol_response == Protocol::ClientProtocolOK)
 	{
-		//conPrint("UploadResourceThread: Connecting to " + hostname + ":" + toString(port) + "...");
+	}
+	else
+		throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+
+	// Read server protocol version
+	server_protocol_version_out = socket->readUInt32();
+
+	return socket;
+}
 
-		MySocketRef plain_socket = new MySocket(hostname, port);
-		plain_socket->setUseNetworkByteOrder(false);
 
-		TLSSocketRef socket = new TLSSocket(plain_socket, config, hostname);
+void UploadResourceThread::logIn(TLSSocket& socket, uint32 connection_type)
+{
+	socket.writeUInt32(connection_type); // Write connection type
 
-		//conPrint("UploadResourceThread: Connected to " + hostname + ":" + toString(port) + "!");
+	// Send login details
+	socket.writeStringLengthFirst(username);
+	socket.writeStringLengthFirst(password);
+}
 
-		socket->writeUInt32(Protocol::CyberspaceHello); // Write hello
-		socket->writeUInt32(Protocol::CyberspaceProtocolVersion); // Write protocol version
-		socket->writeUInt32(Protocol::ConnectionTypeUploadResource); // Write connection type
 
-		// Read hello response from server
-		const uint32 hello_response = socket->readUInt32();
-		if(hello_response != Protocol::CyberspaceHello)
-			throw glare::Exception("Invalid hello from server: " + toString(hello_response));
+// Sends the upload details for a chunked upload, and reads the response.
+// Returns ResourceAlreadyPresent or UploadAllowed, in which case the chunks the server needs are returned in missing_chunks_out.
+uint32 UploadResourceThread::announceChunkedUpload(TLSSocket& socket, uint64 file_len, uint64 content_hash, std::vector<uint32>& missing_chunks_out)
+{
+	socket.writeStringLengthFirst(resource_URL);
+	socket.writeUInt64(file_len);
+	socket.writeUInt64(content_hash);
+	socket.writeUInt32(UPLOAD_CHUNK_SIZE);
 
-		// Read protocol version response from server
-		const uint32 protocol_response = socket->readUInt32();
-		if(protocol_response == Protocol::ClientProtocolTooOld)
+	const uint32 response = socket.readUInt32();
+	if(response == Protocol::ResourceAlreadyPresent)
+	{
+		return response;
+	}
+	else if(response == Protocol::UploadAllowed)
+	{
+		const uint64 num_chunks = (file_len + UPLOAD_CHUNK_SIZE - 1) / UPLOAD_CHUNK_SIZE;
+		const uint32 num_missing = socket.readUInt32();
+		if(num_missing > num_chunks)
+			throw glare::Exception("Invalid number of missing chunks: " + toString(num_missing));
+
+		missing_chunks_out.resize(num_missing);
+		for(uint32 i=0; i<num_missing; ++i)
 		{
-			const std::string msg = socket->readStringLengthFirst(10000);
-			throw glare::Exception(msg);
+			missing_chunks_out[i] = socket.readUInt32();
+			if(missing_chunks_out[i] >= num_chunks)
+				throw glare::Exception("Invalid chunk index: " + toString(missing_chunks_out[i]));
 		}
-		else if(protocol_response == Protocol::ClientProtocolOK)
+		return response;
+	}
+	else
+	{
+		const std::string msg = socket.readStringLengthFirst(1000);
+		if(response == Protocol::TooManyUploads)
+			throw glare::Exception(msg); // Worth retrying later.
+		else
+			throw UploadRefusedExcep("received error code " + toString(response) + " while trying to upload resource: '" + msg + "'");
+	}
+}
+
+
+// Sends the chunks in missing_chunks that are assigned to this stream (chunk index modulo num_streams == stream_index), then reads and returns the server result code.
+static uint32 sendChunks(TLSSocket& socket, const MemMappedFile& file, const std::vector<uint32>& missing_chunks, int stream_index, int num_streams)
+{
+	for(size_t i=0; i<missing_chunks.size(); ++i)
+	{
+		const uint32 chunk_index = missing_chunks[i];
+		if((int)(chunk_index % num_streams) == stream_index)
 		{
+			const uint64 offset = (uint64)chunk_index * UploadResourceThread::UPLOAD_CHUNK_SIZE;
+			const uint64 chunk_len = myMin<uint64>(UploadResourceThread::UPLOAD_CHUNK_SIZE, file.fileSize() - offset);
+
+			socket.writeUInt32(chunk_index);
+			socket.writeData((const uint8*)file.fileData() + offset, chunk_len);
 		}
-		else
-			throw glare::Exception("Invalid protocol version response from server: " + toString(protocol_response));
+	}
+	socket.writeUInt32(Protocol::EndOfChunks);
+
+	return socket.readUInt32();
+}
 
-		// Read server protocol version
-		/*const uint32 server_protocol_version =*/ socket->readUInt32();
 
-		// Send login details
-		socket->writeStringLengthFirst(username);
-		socket->writeStringLengthFirst(password);
+// Uploads some of the chunks of a file on its own connection, for parallel uploads.
+class ChunkedUploadStreamThread : public MyThread
+{
+public:
+	ChunkedUploadStreamThread(UploadResourceThread* upload_thread_, const MemMappedFile* file_, uint64 content_hash_, int stream_index_, int num_streams_)
+	:	upload_thread(upload_thread_), file(file_), content_hash(content_hash_), stream_index(stream_index_), num_streams(num_streams_), result(0) {}
 
+	virtual void run()
+	{
+		try
+		{
+			uint32 server_protocol_version;
+			TLSSocketRef socket = upload_thread->connectToServer(server_protocol_version);
+			upload_thread->logIn(*socket, Protocol::ConnectionTypeUploadResourceChunked);
 
+			std::vector<uint32> missing_chunks;
+			const uint32 response = upload_thread->announceChunkedUpload(*socket, file->fileSize(), content_hash, missing_chunks);
+			if(response == Protocol::ResourceAlreadyPresent)
+				result = Protocol::UploadComplete;
+			else
+				result = sendChunks(*socket, *file, missing_chunks, stream_index, num_streams);
+		}
+		catch(glare::Exception& e)
+		{
+			error_msg = e.what();
+		}
+	}
+
+	UploadResourceThread* upload_thread;
+	const MemMappedFile* file;
+	uint64 content_hash;
+	int stream_index, num_streams;
+
+	uint32 result; // Server result code, or 0 if there was an error.
+	std::string error_msg;
+};
+
+
+// Does one attempt at a chunked upload.  socket should be connected to a server that supports chunked uploads.
+// Returns true if the server has the complete resource afterwards.  Throws glare::Exception on failure.
+bool UploadResourceThread::uploadChunked(TLSSocket& socket, const MemMappedFile& file, uint64 content_hash)
+{
+	logIn(socket, Protocol::ConnectionTypeUploadResourceChunked);
+
+	std::vector<uint32> missing_chunks;
+	const uint32 response = announceChunkedUpload(socket, file.fileSize(), content_hash, missing_chunks);
+	if(response == Protocol::ResourceAlreadyPresent)
+	{
+		conPrint("UploadResourceThread: Server already has resource with URL '" + resource_URL + "'.");
+		return true;
+	}
+
+	// Use multiple connections if there is a lot to send.  Chunks are split between the connections by chunk index.
+	const uint64 bytes_needed = (uint64)missing_chunks.size() * UPLOAD_CHUNK_SIZE;
+	const int num_streams = (bytes_needed >= PARALLEL_UPLOAD_MIN_BYTES) ? NUM_PARALLEL_STREAMS : 1;
+
+	std::vector<Reference<ChunkedUploadStreamThread>> stream_threads;
+	for(int i=1; i<num_streams; ++i)
+	{
+		stream_threads.push_back(new ChunkedUploadStreamThread(this, &file, content_hash, /*stream index=*/i, num_streams));
+		stream_threads.back()->launch();
+	}
+
+	std::vector<uint32> results;
+	std::string error_msg;
+	try
+	{
+		results.push_back(sendChunks(socket, file, missing_chunks, /*stream index=*/0, num_streams));
+	}
+	catch(glare::Exception& e)
+	{
+		error_msg = e.what();
+	}
+
+	// Wait for the other streams to finish, as they reference the file data.
+	for(size_t i=0; i<stream_threads.size(); ++i)
+	{
+		stream_threads[i]->join();
+		results.push_back(stream_threads[i]->result);
+		if(!stream_threads[i]->error_msg.empty())
+			error_msg = stream_threads[i]->error_msg;
+	}
+
+	// Exactly one connection gets the final result from the server, the others get UploadChunksReceived.
+	for(size_t i=0; i<results.size(); ++i)
+	{
+		if(results[i] == Protocol::UploadComplete)
+		{
+			conPrint("UploadResourceThread: Sent file '" + local_path + "', URL '" + resource_URL + "' (" + toString(missing_chunks.size()) + " chunks sent over " + toString(num_streams) + " connection(s))");
+			return true;
+		}
+		else if(results[i] == Protocol::UploadHashMismatch)
+			throw glare::Exception("Server reported content hash mismatch."); // Server has discarded the data, the next attempt will start from scratch.
+	}
+
+	if(!error_msg.empty())
+		throw glare::Exception(error_msg);
+	return false; // All our chunks were received, but the upload wasn't completed, for example because another connection dropped.  Should try again.
+}
+
+
+#endif // !defined(EMSCRIPTEN)
+
+
+void UploadResourceThread::doRun()
+{
+#if !defined(EMSCRIPTEN)
+	PlatformUtils::setCurrentThreadNameIfTestsEnabled("UploadResourceThread");
+
+	try
+	{
 		// Load resource from disk
 		MemMappedFile file(local_path);
 
-		socket->writeStringLengthFirst(resource_URL); // Write URL
-
-		socket->writeUInt64(file.fileSize()); // Write file size
+		uint32 server_protocol_version;
+		TLSSocketRef socket = connectToServer(server_protocol_version);
 
-		// Read back response from server first, to avoid sending all the data if the upload is not allowed.
-		const uint32 response = socket->readUInt32();
-		if(response == Protocol::UploadAllowed)
+		if(server_protocol_version >= 40) // ConnectionTypeUploadResourceChunked was added in protocol version 40.
 		{
-			socket->writeData(file.fileData(), file.fileSize());
-			conPrint("UploadResourceThread: Sent file '" + local_path + "', URL '" + resource_URL + "' (" + toString(file.fileSize()) + " B)");
+			const uint64 content_hash = XXH64(file.fileData(), file.fileSize(), /*seed=*/1);
+
+			// Resume the upload with a new connection if the connection drops.  The server keeps the chunks it has received.
+			for(int attempt=0; ; ++attempt)
+			{
+				try
+				{
+					if(socket.isNull())
+						socket = connectToServer(server_protocol_version);
+
+					if(uploadChunked(*socket, file, content_hash))
+						break;
+				}
+				catch(UploadRefusedExcep&)
+				{
+					throw;
+				}
+				catch(glare::Exception& e)
+				{
+					conPrint("UploadResourceThread: error while uploading '" + resource_URL + "': " + e.what());
+				}
+
+				socket = NULL;
+				if(attempt + 1 >= MAX_UPLOAD_ATTEMPTS)
+					throw glare::Exception("Failed to upload resource '" + resource_URL + "' after " + toString(MAX_UPLOAD_ATTEMPTS) + " attempts.");
+
+				PlatformUtils::Sleep(1000 << attempt);
+			}
 		}
 		else
 		{
-			const std::string msg = socket->readStringLengthFirst(1000);
-			conPrint("UploadResourceThread: received error code " + toString(response) + " while trying to upload resource: '" + msg + "'");
+			logIn(*socket, Protocol::ConnectionTypeUploadResource);
+
+			socket->writeStringLengthFirst(resource_URL); // Write URL
+
+			socket->writeUInt64(file.fileSize()); // Write file size
+
+			// Read back response from server first, to avoid sending all the data if the upload is not allowed.
+			const uint32 response = socket->readUInt32();
+			if(response == Protocol::UploadAllowed)
+			{
+				socket->writeData(file.fileData(), file.fileSize());
+				conPrint("UploadResourceThread: Sent file '" + local_path + "', URL '" + resource_URL + "' (" + toString(file.fileSize()) + " B)");
+			}
+			else
+			{
+				const std::string msg = socket->readStringLengthFirst(1000);
+				conPrint("UploadResourceThread: received error code " + toString(response) + " while trying to upload resource: '" + msg + "'");
+			}
 		}
 	}
 	catch(MySocketExcep& e)
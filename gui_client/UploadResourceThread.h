@@ -16,17 +16,24 @@ Generated at 2016-01-16 22:59:23 +1300
 #include <MySocket.h>
 #include <set>
 #include <string>
+#include <vector>
 class WorkUnit;
 class PrintOutput;
 class ThreadMessageSink;
 class Server;
 struct tls_config;
+class TLSSocket;
+class MemMappedFile;
 
 
 /*=====================================================================
 UploadResourceThread
 -------------------
 Uploads a single file to the server.
+
+If the server supports it, the file is uploaded in chunks, with its content hash sent first, so the server can skip the upload
+if it already has the file, or just ask for the chunks it doesn't have yet.  If the connection drops, the upload is resumed with a new
+connection.  Large uploads are sent over NUM_PARALLEL_STREAMS connections at once.
 =====================================================================*/
 class UploadResourceThread : public MessageableThread
 {
@@ -37,7 +44,19 @@ public:
 
 	virtual void doRun();
 
+	static const uint32 UPLOAD_CHUNK_SIZE = 1 << 20;
+	static const int NUM_PARALLEL_STREAMS = 4;
+	static const uint64 PARALLEL_UPLOAD_MIN_BYTES = 16 << 20; // Only use multiple connections if at least this much needs to be sent.
+	static const int MAX_UPLOAD_ATTEMPTS = 5;
+
+	// Used by the threads for parallel upload connections as well.
+	Reference<TLSSocket> connectToServer(uint32& server_protocol_version_out);
+	void logIn(TLSSocket& socket, uint32 connection_type);
+	uint32 announceChunkedUpload(TLSSocket& socket, uint64 file_len, uint64 content_hash, std::vector<uint32>& missing_chunks_out);
+
 private:
+	bool uploadChunked(TLSSocket& socket, const MemMappedFile& file, uint64 content_hash);
+
 	//ThreadSafeQueue<Reference<ThreadMessage> >* out_msg_queue;
 	std::string local_path, resource_URL;
 	std::string hostname;
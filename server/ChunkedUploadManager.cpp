@@ -0,0 +1,738 @@
+/*=====================================================================
+ChunkedUploadManager.cpp
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ChunkedUploadManager.h"
+
+
+#include <Lock.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <FileUtils.h>
+#include <BufferOutStream.h>
+#include <BufferInStream.h>
+#include <Clock.h>
+#include <IncludeXXHash.h>
+#include <mathstypes.h>
+
+
+static const uint32 STATE_FILE_MAGIC = 0x43554C53;
+static const uint32 STATE_FILE_VERSION = 2; // Version 2: added uploader id and save time.
+static const size_t SAVE_STATE_INTERVAL_CHUNKS = 64; // Save the received chunk bitmap to disk after this many chunks, so a server crash doesn't lose too much.
+
+
+ChunkedUpload::ChunkedUpload()
+:	file_len(0),
+	content_hash(0),
+	chunk_size(0),
+	num_chunks_received(0),
+	num_streams(0),
+	finishing(false),
+	num_chunks_since_state_save(0)
+{}
+
+
+uint32 ChunkedUpload::numChunks() const
+{
+	return (uint32)((file_len + chunk_size - 1) / chunk_size);
+}
+
+
+uint32 ChunkedUpload::chunkLen(uint32 chunk_index) const
+{
+	return (uint32)myMin<uint64>(chunk_size, file_len - chunkOffset(chunk_index));
+}
+
+
+void ChunkedUpload::getMissingChunks(std::vector<uint32>& missing_out) const
+{
+	Lock lock(mutex);
+	missing_out.clear();
+	for(size_t i=0; i<chunk_received.size(); ++i)
+		if(!chunk_received[i])
+			missing_out.push_back((uint32)i);
+}
+
+
+bool ChunkedUpload::isChunkReceived(uint32 chunk_index) const
+{
+	Lock lock(mutex);
+	return chunk_index < chunk_received.size() && chunk_received[chunk_index] != 0;
+}
+
+
+size_t ChunkedUpload::getNumChunksReceived() const
+{
+	Lock lock(mutex);
+	return num_chunks_received;
+}
+
+
+static uint64 currentTimeS()
+{
+	return (uint64)Clock::getSecsSince1970();
+}
+
+
+ChunkedUploadManager::ChunkedUploadManager(const std::string& partial_upload_dir_)
+:	partial_upload_dir(partial_upload_dir_)
+{
+	FileUtils::createDirIfDoesNotExist(partial_upload_dir);
+
+	sweepStalePartialUploads(currentTimeS(), MAX_PARTIAL_UPLOAD_AGE_S);
+}
+
+
+ChunkedUploadManager::~ChunkedUploadManager()
+{}
+
+
+ChunkedUploadRef ChunkedUploadManager::beginStream(const std::string& URL, uint64 file_len, uint64 content_hash, uint32 chunk_size, const UserID& uploader_id)
+{
+	if(file_len == 0)
+		throw glare::Exception("Invalid file len of zero.");
+	if(chunk_size < MIN_CHUNK_SIZE || chunk_size > MAX_CHUNK_SIZE)
+		throw glare::Exception("Invalid chunk size " + toString(chunk_size) + ".");
+
+	const std::string key = URL + "_" + toString(content_hash) + "_" + toString(file_len) + "_" + toString(chunk_size);
+
+	Lock lock(mutex);
+
+	auto res = active_uploads.find(key);
+	if(res != active_uploads.end())
+	{
+		ChunkedUpload* upload = res->second.ptr();
+		Lock upload_lock(upload->mutex);
+		if(upload->uploader_id != uploader_id)
+			throw glare::Exception("Resource is being uploaded by another user.");
+		upload->num_streams++;
+		return upload;
+	}
+
+	// Name the files with a hash of the key, as the URL may contain characters that aren't valid in file names.
+	const std::string base_path = partial_upload_dir + "/" + toHexString(XXH64(key.data(), key.size(), /*seed=*/1));
+
+	auto partial_res = partial_uploads.find(base_path + ".part");
+	if(partial_res == partial_uploads.end() || partial_res->second.uploader_id != uploader_id) // If this will be a new partial upload for the user:
+		makeRoomForPartialUpload(uploader_id);
+
+	ChunkedUploadRef upload = new ChunkedUpload();
+	upload->key = key;
+	upload->URL = URL;
+	upload->file_len = file_len;
+	upload->content_hash = content_hash;
+	upload->chunk_size = chunk_size;
+	upload->uploader_id = uploader_id;
+	upload->partial_path = base_path + ".part";
+	upload->state_path = base_path + ".state";
+
+	{
+		Lock upload_lock(upload->mutex);
+		upload->chunk_received.resize(upload->numChunks(), 0);
+		loadState(*upload);
+		upload->num_streams = 1;
+	}
+
+	active_uploads[key] = upload;
+
+	PartialUploadInfo& info = partial_uploads[upload->partial_path];
+	info.uploader_id = uploader_id;
+	info.last_activity_time = currentTimeS();
+	return upload;
+}
+
+
+bool ChunkedUploadManager::isPartialUploadActive(const std::string& partial_path) const
+{
+	for(auto it = active_uploads.begin(); it != active_uploads.end(); ++it)
+		if(it->second->partial_path == partial_path)
+			return true;
+	return false;
+}
+
+
+// If the user already has MAX_PARTIAL_UPLOADS_PER_USER partial uploads, deletes the least recently active one that isn't active now.
+// Throws glare::Exception if they are all active.
+void ChunkedUploadManager::makeRoomForPartialUpload(const UserID& uploader_id)
+{
+	size_t num_user_uploads = 0;
+	auto oldest = partial_uploads.end();
+	for(auto it = partial_uploads.begin(); it != partial_uploads.end(); ++it)
+		if(it->second.uploader_id == uploader_id)
+		{
+			num_user_uploads++;
+			if(!isPartialUploadActive(it->first) && ((oldest == partial_uploads.end()) || (it->second.last_activity_time < oldest->second.last_activity_time)))
+				oldest = it;
+		}
+
+	if(num_user_uploads < MAX_PARTIAL_UPLOADS_PER_USER)
+		return;
+
+	if(oldest == partial_uploads.end())
+		throw glare::Exception("Too many uploads in progress.");
+
+	conPrint("ChunkedUploadManager: user " + toString(uploader_id.value()) + " has too many partial uploads, deleting '" + oldest->first + "'.");
+	deletePartialUploadFiles(oldest->first, removeDotAndExtension(oldest->first) + ".state");
+	partial_uploads.erase(oldest);
+}
+
+
+// Loads the received chunk bitmap from the state file if there is a valid one, otherwise starts a new, empty partial file.
+void ChunkedUploadManager::loadState(ChunkedUpload& upload)
+{
+	try
+	{
+		if(FileUtils::fileExists(upload.state_path) && FileUtils::fileExists(upload.partial_path))
+		{
+			std::string data;
+			FileUtils::readEntireFile(upload.state_path, data);
+			BufferInStream in(ArrayRef<uint8>((const uint8*)data.data(), data.size()));
+
+			const uint32 magic = in.readUInt32();
+			const uint32 version = in.readUInt32();
+			if(magic != STATE_FILE_MAGIC || version != STATE_FILE_VERSION)
+				throw glare::Exception("Invalid magic number or version.");
+			const UserID uploader_id(in.readUInt32());
+			/*const uint64 save_time =*/ in.readUInt64();
+			const uint64 file_len = in.readUInt64();
+			const uint64 content_hash = in.readUInt64();
+			const uint32 chunk_size = in.readUInt32();
+			const uint32 num_chunks = in.readUInt32();
+			if(uploader_id == upload.uploader_id && file_len == upload.file_len && content_hash == upload.content_hash && chunk_size == upload.chunk_size &&
+				num_chunks == upload.numChunks())
+			{
+				in.readData(upload.chunk_received.data(), upload.chunk_received.size());
+
+				upload.num_chunks_received = 0;
+				for(size_t i=0; i<upload.chunk_received.size(); ++i)
+					if(upload.chunk_received[i])
+						upload.num_chunks_received++;
+
+				conPrint("ChunkedUploadManager: resuming upload of '" + upload.URL + "', " + toString(upload.num_chunks_received) + " / " + toString(num_chunks) + " chunks already received.");
+				return;
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ChunkedUploadManager: error loading upload state from '" + upload.state_path + "': " + e.what());
+	}
+
+	// Start from scratch
+	std::fill(upload.chunk_received.begin(), upload.chunk_received.end(), (uint8)0);
+	upload.num_chunks_received = 0;
+
+	std::ofstream file(upload.partial_path, std::ios::binary | std::ios::trunc);
+	if(!file)
+		throw glare::Exception("Failed to create partial upload file '" + upload.partial_path + "'.");
+
+	saveState(upload);
+}
+
+
+void ChunkedUploadManager::saveState(ChunkedUpload& upload)
+{
+	BufferOutStream out;
+	out.writeUInt32(STATE_FILE_MAGIC);
+	out.writeUInt32(STATE_FILE_VERSION);
+	out.writeUInt32(upload.uploader_id.value());
+	out.writeUInt64(currentTimeS());
+	out.writeUInt64(upload.file_len);
+	out.writeUInt64(upload.content_hash);
+	out.writeUInt32(upload.chunk_size);
+	out.writeUInt32(upload.numChunks());
+	out.writeData(upload.chunk_received.data(), upload.chunk_received.size());
+
+	try
+	{
+		FileUtils::writeEntireFile(upload.state_path, (const char*)out.buf.data(), out.buf.size());
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ChunkedUploadManager: error saving upload state to '" + upload.state_path + "': " + e.what());
+	}
+
+	upload.num_chunks_since_state_save = 0;
+}
+
+
+void ChunkedUploadManager::openPartialFile(const ChunkedUpload& upload, std::fstream& file_out)
+{
+	file_out.open(upload.partial_path, std::ios::in | std::ios::out | std::ios::binary);
+	if(!file_out)
+		throw glare::Exception("Failed to open partial upload file '" + upload.partial_path + "'.");
+}
+
+
+void ChunkedUploadManager::writeChunk(ChunkedUpload& upload, std::fstream& file, uint32 chunk_index, const uint8* data, size_t len)
+{
+	if(chunk_index >= upload.numChunks())
+		throw glare::Exception("Invalid chunk index " + toString(chunk_index) + ".");
+	if(len != upload.chunkLen(chunk_index))
+		throw glare::Exception("Invalid chunk length " + toString(len) + " for chunk " + toString(chunk_index) + ".");
+
+	if(upload.isChunkReceived(chunk_index))
+		return;
+
+	// Write without holding the upload mutex, so other connections can write their chunks at the same time.
+	// Parallel connections are sent different chunks, but if the same chunk is written twice it will have the same data.
+	file.seekp((std::streamoff)upload.chunkOffset(chunk_index));
+	file.write((const char*)data, (std::streamsize)len);
+	file.flush();
+	if(!file)
+		throw glare::Exception("Failed to write to partial upload file '" + upload.partial_path + "'.");
+
+	Lock lock(upload.mutex);
+	if(!upload.chunk_received[chunk_index])
+	{
+		upload.chunk_received[chunk_index] = 1;
+		upload.num_chunks_received++;
+		upload.num_chunks_since_state_save++;
+		if(upload.num_chunks_since_state_save >= SAVE_STATE_INTERVAL_CHUNKS)
+			saveState(upload);
+	}
+}
+
+
+bool ChunkedUploadManager::endStream(ChunkedUpload& upload)
+{
+	Lock lock(mutex);
+	Lock upload_lock(upload.mutex);
+
+	assert(upload.num_streams > 0);
+	upload.num_streams--;
+
+	if(upload.num_chunks_received == upload.chunk_received.size() && !upload.finishing)
+	{
+		upload.finishing = true; // The caller is now responsible for calling removeUpload().
+		return true;
+	}
+
+	if(upload.num_streams == 0 && !upload.finishing)
+	{
+		// No connections left, save the state so the upload can be resumed later, and free the memory.
+		saveState(upload);
+		active_uploads.erase(upload.key);
+
+		auto res = partial_uploads.find(upload.partial_path);
+		if(res != partial_uploads.end())
+			res->second.last_activity_time = currentTimeS();
+	}
+	return false;
+}
+
+
+bool ChunkedUploadManager::verifyUpload(const ChunkedUpload& upload)
+{
+	if(FileUtils::getFileSize(upload.partial_path) != upload.file_len)
+		return false;
+	return computeFileHash(upload.partial_path) == upload.content_hash;
+}
+
+
+void ChunkedUploadManager::removeUpload(ChunkedUpload& upload)
+{
+	{
+		Lock lock(mutex);
+		auto res = active_uploads.find(upload.key);
+		if(res != active_uploads.end() && res->second.ptr() == &upload)
+			active_uploads.erase(res);
+
+		partial_uploads.erase(upload.partial_path);
+	}
+
+	deletePartialUploadFiles(upload.partial_path, upload.state_path);
+}
+
+
+void ChunkedUploadManager::deletePartialUploadFiles(const std::string& partial_path, const std::string& state_path)
+{
+	try
+	{
+		if(FileUtils::fileExists(partial_path))
+			FileUtils::deleteFile(partial_path);
+		if(FileUtils::fileExists(state_path))
+			FileUtils::deleteFile(state_path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ChunkedUploadManager: error removing partial upload files: " + e.what());
+	}
+}
+
+
+void ChunkedUploadManager::sweepStalePartialUploads(uint64 cur_time_s, uint64 max_age_s)
+{
+	Lock lock(mutex);
+
+	std::vector<std::string> filenames;
+	try
+	{
+		filenames = FileUtils::getFilesInDir(partial_upload_dir);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("ChunkedUploadManager: error listing partial upload dir: " + e.what());
+		return;
+	}
+
+	std::map<std::string, PartialUploadInfo> new_partial_uploads;
+	size_t num_deleted = 0;
+	for(size_t i=0; i<filenames.size(); ++i)
+	{
+		const std::string& filename = filenames[i];
+		const bool is_part_file = hasExtension(filename, "part");
+		if(!is_part_file && !hasExtension(filename, "state"))
+			continue;
+
+		const std::string base_path = partial_upload_dir + "/" + removeDotAndExtension(filename);
+		const std::string partial_path = base_path + ".part";
+		const std::string state_path = base_path + ".state";
+		if(new_partial_uploads.count(partial_path) || !FileUtils::fileExists(is_part_file ? partial_path : state_path)) // If already processed via the other file of the pair, or deleted already:
+			continue;
+
+		if(isPartialUploadActive(partial_path))
+		{
+			PartialUploadInfo info;
+			auto res = partial_uploads.find(partial_path);
+			info.uploader_id = (res != partial_uploads.end()) ? res->second.uploader_id : UserID::invalidUserID();
+			info.last_activity_time = cur_time_s;
+			new_partial_uploads[partial_path] = info;
+			continue;
+		}
+
+		// Read the uploader and last save time from the state file.  Partial uploads with a missing or invalid state file can't be resumed, so are deleted.
+		bool keep = false;
+		PartialUploadInfo info;
+		try
+		{
+			if(FileUtils::fileExists(partial_path) && FileUtils::fileExists(state_path))
+			{
+				std::string data;
+				FileUtils::readEntireFile(state_path, data);
+				BufferInStream in(ArrayRef<uint8>((const uint8*)data.data(), data.size()));
+				const uint32 magic = in.readUInt32();
+				const uint32 version = in.readUInt32();
+				if(magic == STATE_FILE_MAGIC && version == STATE_FILE_VERSION)
+				{
+					info.uploader_id = UserID(in.readUInt32());
+					const uint64 save_time = in.readUInt64();
+
+					// Use the later of the save time and the last activity we know about, as the state file isn't saved on every chunk.
+					auto res = partial_uploads.find(partial_path);
+					info.last_activity_time = (res != partial_uploads.end()) ? myMax(save_time, res->second.last_activity_time) : save_time;
+					keep = (info.last_activity_time + max_age_s) >= cur_time_s;
+				}
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("ChunkedUploadManager: error reading upload state from '" + state_path + "': " + e.what());
+		}
+		catch(FileUtils::FileUtilsExcep& e)
+		{
+			conPrint("ChunkedUploadManager: error reading upload state from '" + state_path + "': " + e.what());
+		}
+
+		if(keep)
+			new_partial_uploads[partial_path] = info;
+		else
+		{
+			deletePartialUploadFiles(partial_path, state_path);
+			num_deleted++;
+		}
+	}
+
+	partial_uploads.swap(new_partial_uploads);
+
+	if(num_deleted > 0)
+		conPrint("ChunkedUploadManager: deleted " + toString(num_deleted) + " stale partial upload(s).");
+}
+
+
+uint64 ChunkedUploadManager::computeFileHash(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if(!file)
+		throw glare::Exception("Failed to open '" + path + "' for hashing.");
+
+	XXH64_state_t* state = XXH64_createState();
+	XXH64_reset(state, /*seed=*/1);
+
+	std::vector<char> buf(1 << 20);
+	while(file)
+	{
+		file.read(buf.data(), buf.size());
+		const std::streamsize num_read = file.gcount();
+		if(num_read > 0)
+			XXH64_update(state, buf.data(), (size_t)num_read);
+	}
+	const bool read_error = file.bad();
+
+	const uint64 hash = XXH64_digest(state);
+	XXH64_freeState(state);
+
+	if(read_error)
+		throw glare::Exception("Error while reading '" + path + "' for hashing.");
+	return hash;
+}
+
+
+size_t ChunkedUploadManager::getNumActiveUploads() const
+{
+	Lock lock(mutex);
+	return active_uploads.size();
+}
+
+
+size_t ChunkedUploadManager::getNumPartialUploads() const
+{
+	Lock lock(mutex);
+	return partial_uploads.size();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+static void writeTestChunks(ChunkedUploadManager& manager, ChunkedUpload& upload, const std::string& data, const std::vector<uint32>& chunk_indices)
+{
+	std::fstream file;
+	ChunkedUploadManager::openPartialFile(upload, file);
+	for(size_t i=0; i<chunk_indices.size(); ++i)
+	{
+		const uint32 c = chunk_indices[i];
+		manager.writeChunk(upload, file, c, (const uint8*)data.data() + upload.chunkOffset(c), upload.chunkLen(c));
+	}
+}
+
+
+void ChunkedUploadManager::test()
+{
+	conPrint("ChunkedUploadManager::test()");
+
+	try
+	{
+		const std::string dir = PlatformUtils::getTempDirPath() + "/chunked_upload_test";
+
+		// Make some test data that is 3.5 chunks long.
+		const uint32 chunk_size = MIN_CHUNK_SIZE;
+		std::string data(chunk_size * 3 + chunk_size / 2, '\0');
+		for(size_t i=0; i<data.size(); ++i)
+			data[i] = (char)(i * 7 + (i >> 9));
+		const uint64 hash = XXH64(data.data(), data.size(), /*seed=*/1);
+		const UserID user_id(1);
+
+		//-------------------- Test a single stream upload in one go --------------------
+		{
+			ChunkedUploadManager manager(dir);
+			ChunkedUploadRef upload = manager.beginStream("a.jpg", data.size(), hash, chunk_size, user_id);
+			testAssert(upload->numChunks() == 4);
+			testAssert(upload->chunkLen(3) == chunk_size / 2);
+
+			std::vector<uint32> missing;
+			upload->getMissingChunks(missing);
+			testAssert(missing == std::vector<uint32>({ 0, 1, 2, 3 }));
+
+			writeTestChunks(manager, *upload, data, missing);
+
+			testAssert(manager.endStream(*upload));
+			testAssert(ChunkedUploadManager::verifyUpload(*upload));
+			testAssert(computeFileHash(upload->partial_path) == hash);
+
+			manager.removeUpload(*upload);
+			testAssert(!FileUtils::fileExists(upload->partial_path));
+			testAssert(manager.getNumActiveUploads() == 0);
+		}
+
+		//-------------------- Test resuming an upload after the connection drops, with a new manager, as if the server restarted --------------------
+		{
+			std::string partial_path;
+			{
+				ChunkedUploadManager manager(dir);
+				ChunkedUploadRef upload = manager.beginStream("b.jpg", data.size(), hash, chunk_size, user_id);
+				writeTestChunks(manager, *upload, data, { 0, 2 });
+				testAssert(!manager.endStream(*upload));
+				testAssert(manager.getNumActiveUploads() == 0);
+				partial_path = upload->partial_path;
+			}
+
+			ChunkedUploadManager manager(dir);
+			ChunkedUploadRef upload = manager.beginStream("b.jpg", data.size(), hash, chunk_size, user_id);
+			testAssert(upload->partial_path == partial_path);
+			std::vector<uint32> missing;
+			upload->getMissingChunks(missing);
+			testAssert(missing == std::vector<uint32>({ 1, 3 }));
+
+			writeTestChunks(manager, *upload, data, missing);
+			testAssert(manager.endStream(*upload));
+			testAssert(ChunkedUploadManager::verifyUpload(*upload));
+			manager.removeUpload(*upload);
+		}
+
+		//-------------------- Test parallel streams: only the stream that ends after all chunks are received should finish the upload --------------------
+		{
+			ChunkedUploadManager manager(dir);
+			ChunkedUploadRef upload_a = manager.beginStream("c.jpg", data.size(), hash, chunk_size, user_id);
+			ChunkedUploadRef upload_b = manager.beginStream("c.jpg", data.size(), hash, chunk_size, user_id);
+			testAssert(upload_a.ptr() == upload_b.ptr());
+			testAssert(manager.getNumActiveUploads() == 1);
+
+			// A different user shouldn't be able to join the upload.
+			try
+			{
+				manager.beginStream("c.jpg", data.size(), hash, chunk_size, UserID(2));
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+
+			writeTestChunks(manager, *upload_a, data, { 0, 2 });
+			testAssert(!manager.endStream(*upload_a));
+			testAssert(manager.getNumActiveUploads() == 1); // Stream b is still uploading.
+
+			writeTestChunks(manager, *upload_b, data, { 1, 3, 1 }); // Writing a chunk twice should be ok.
+			testAssert(upload_b->getNumChunksReceived() == 4);
+			testAssert(manager.endStream(*upload_b));
+			testAssert(ChunkedUploadManager::verifyUpload(*upload_b));
+			manager.removeUpload(*upload_b);
+			testAssert(manager.getNumActiveUploads() == 0);
+		}
+
+		//-------------------- Test that corrupted data fails verification --------------------
+		{
+			std::string bad_data = data;
+			bad_data[chunk_size + 10]++;
+
+			ChunkedUploadManager manager(dir);
+			ChunkedUploadRef upload = manager.beginStream("d.jpg", data.size(), hash, chunk_size, user_id);
+			writeTestChunks(manager, *upload, bad_data, { 0, 1, 2, 3 });
+			testAssert(manager.endStream(*upload));
+			testAssert(!ChunkedUploadManager::verifyUpload(*upload));
+			manager.removeUpload(*upload);
+		}
+
+		//-------------------- Test invalid chunks --------------------
+		{
+			ChunkedUploadManager manager(dir);
+			ChunkedUploadRef upload = manager.beginStream("e.jpg", data.size(), hash, chunk_size, user_id);
+			std::fstream file;
+			ChunkedUploadManager::openPartialFile(*upload, file);
+			try
+			{
+				manager.writeChunk(*upload, file, /*chunk_index=*/4, (const uint8*)data.data(), chunk_size);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+			try
+			{
+				manager.writeChunk(*upload, file, /*chunk_index=*/3, (const uint8*)data.data(), chunk_size); // Last chunk should be shorter
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+			testAssert(!manager.endStream(*upload));
+			manager.removeUpload(*upload);
+
+			try
+			{
+				manager.beginStream("e.jpg", data.size(), hash, /*chunk_size=*/16, user_id);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		//-------------------- Test sweeping stale partial uploads --------------------
+		{
+			const uint64 now = currentTimeS();
+			{
+				ChunkedUploadManager manager(dir);
+				manager.sweepStalePartialUploads(now + MAX_PARTIAL_UPLOAD_AGE_S + 10, MAX_PARTIAL_UPLOAD_AGE_S); // Remove anything left over from previous runs.
+				testAssert(manager.getNumPartialUploads() == 0);
+
+				ChunkedUploadRef upload = manager.beginStream("f.jpg", data.size(), hash, chunk_size, user_id);
+				writeTestChunks(manager, *upload, data, { 0 });
+				testAssert(!manager.endStream(*upload));
+			}
+
+			// A partial file without a state file can't be resumed, so should be deleted on startup.
+			FileUtils::writeEntireFile(dir + "/orphan.part", "abc");
+
+			ChunkedUploadManager manager(dir);
+			testAssert(!FileUtils::fileExists(dir + "/orphan.part"));
+			testAssert(manager.getNumPartialUploads() == 1);
+
+			// A recent partial upload should be kept, an old one deleted.
+			manager.sweepStalePartialUploads(now, MAX_PARTIAL_UPLOAD_AGE_S);
+			testAssert(manager.getNumPartialUploads() == 1);
+
+			ChunkedUploadRef upload = manager.beginStream("f.jpg", data.size(), hash, chunk_size, user_id);
+			const std::string partial_path = upload->partial_path;
+			testAssert(upload->getNumChunksReceived() == 1);
+
+			manager.sweepStalePartialUploads(now + MAX_PARTIAL_UPLOAD_AGE_S + 10, MAX_PARTIAL_UPLOAD_AGE_S); // Shouldn't delete an upload with a connection in progress.
+			testAssert(manager.getNumPartialUploads() == 1 && FileUtils::fileExists(partial_path));
+
+			testAssert(!manager.endStream(*upload));
+			manager.sweepStalePartialUploads(now + MAX_PARTIAL_UPLOAD_AGE_S + 10, MAX_PARTIAL_UPLOAD_AGE_S);
+			testAssert(manager.getNumPartialUploads() == 0 && !FileUtils::fileExists(partial_path));
+		}
+
+		//-------------------- Test the per-user limit on partial uploads --------------------
+		{
+			ChunkedUploadManager manager(dir);
+			const UserID user_b(3);
+
+			std::vector<ChunkedUploadRef> uploads;
+			for(size_t i=0; i<MAX_PARTIAL_UPLOADS_PER_USER; ++i)
+				uploads.push_back(manager.beginStream("cap_" + toString(i) + ".jpg", data.size(), hash, chunk_size, user_b));
+			testAssert(manager.getNumPartialUploads() == MAX_PARTIAL_UPLOADS_PER_USER);
+
+			// All of the user's partial uploads have connections in progress, so another one should be refused.
+			try
+			{
+				manager.beginStream("cap_extra.jpg", data.size(), hash, chunk_size, user_b);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+
+			// Other users shouldn't be affected.
+			ChunkedUploadRef other_upload = manager.beginStream("cap_other.jpg", data.size(), hash, chunk_size, user_id);
+			manager.removeUpload(*other_upload);
+
+			// Once the connections end, a new upload should replace the least recently active one.
+			for(size_t i=0; i<uploads.size(); ++i)
+				testAssert(!manager.endStream(*uploads[i]));
+			ChunkedUploadRef extra = manager.beginStream("cap_extra.jpg", data.size(), hash, chunk_size, user_b);
+			testAssert(manager.getNumPartialUploads() == MAX_PARTIAL_UPLOADS_PER_USER);
+
+			size_t num_deleted = 0;
+			for(size_t i=0; i<uploads.size(); ++i)
+				if(!FileUtils::fileExists(uploads[i]->partial_path))
+					num_deleted++;
+			testAssert(num_deleted == 1);
+
+			manager.removeUpload(*extra);
+			manager.sweepStalePartialUploads(currentTimeS() + MAX_PARTIAL_UPLOAD_AGE_S + 10, MAX_PARTIAL_UPLOAD_AGE_S);
+			testAssert(manager.getNumPartialUploads() == 0);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ChunkedUploadManager::test() done.");
+}
+
+
+#endif // BUILD_TESTS
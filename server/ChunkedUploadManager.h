@@ -0,0 +1,142 @@
+/*=====================================================================
+ChunkedUploadManager.h
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/UserID.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Mutex.h>
+#include <Platform.h>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+ChunkedUpload
+-------------
+A resource upload that is being received in chunks, possibly over multiple connections at once.
+The received chunks are written to a partial file, and which chunks have been received is saved in a
+state file next to it, so the upload can be resumed after the connection drops or the server restarts.
+=====================================================================*/
+class ChunkedUpload : public ThreadSafeRefCounted
+{
+public:
+	ChunkedUpload();
+
+	uint32 numChunks() const;
+	uint64 chunkOffset(uint32 chunk_index) const { return (uint64)chunk_index * chunk_size; }
+	uint32 chunkLen(uint32 chunk_index) const;
+
+	void getMissingChunks(std::vector<uint32>& missing_out) const; // Threadsafe
+	bool isChunkReceived(uint32 chunk_index) const; // Threadsafe
+	size_t getNumChunksReceived() const; // Threadsafe
+
+	std::string key; // Identifies the upload: URL, content hash, file length and chunk size.
+	std::string URL;
+	uint64 file_len;
+	uint64 content_hash; // XXH64 (seed 1) of the complete file, as announced by the client.
+	uint32 chunk_size;
+	UserID uploader_id;
+
+	std::string partial_path; // Path of the file the chunks are written to.
+	std::string state_path; // Path of the file recording which chunks have been received.
+
+	mutable Mutex mutex;
+	std::vector<uint8> chunk_received	GUARDED_BY(mutex); // Non-zero if the chunk has been written to the partial file.
+	size_t num_chunks_received			GUARDED_BY(mutex);
+	int num_streams						GUARDED_BY(mutex); // Number of connections currently uploading chunks.
+	bool finishing						GUARDED_BY(mutex); // Set when all chunks have been received and a connection has taken on verifying and committing the upload.
+	size_t num_chunks_since_state_save	GUARDED_BY(mutex);
+};
+typedef Reference<ChunkedUpload> ChunkedUploadRef;
+
+
+/*=====================================================================
+ChunkedUploadManager
+--------------------
+Keeps track of chunked resource uploads on the server.
+
+Each connection uploading chunks calls beginStream(), then writeChunk() for each chunk it receives, then endStream().
+Uploads with connections in progress are kept in memory, so parallel connections for the same upload share
+the same chunk bitmap.  When the last connection for an upload ends, the state is saved to disk and the upload is
+removed from memory.  A later beginStream() for the same upload loads the state again, which is how uploads are resumed.
+
+endStream() returns true for exactly one connection once all chunks have been received.  That connection should
+call verifyUpload(), and then commit the partial file to the resource dir or discard it with removeUpload().
+
+Partial uploads that are never finished are deleted by sweepStalePartialUploads(), which is called on construction and
+periodically by the main server loop.  Each user can have at most MAX_PARTIAL_UPLOADS_PER_USER partial uploads on disk:
+starting another one deletes the user's least recently active partial upload that has no connections in progress.
+
+Lock order: the manager mutex, then ChunkedUpload mutexes.  Neither is held while reading from sockets.
+=====================================================================*/
+class ChunkedUploadManager : public ThreadSafeRefCounted
+{
+public:
+	ChunkedUploadManager(const std::string& partial_upload_dir);
+	~ChunkedUploadManager();
+
+	static const uint32 MIN_CHUNK_SIZE = 1 << 16;
+	static const uint32 MAX_CHUNK_SIZE = 1 << 24;
+	static const size_t MAX_PARTIAL_UPLOADS_PER_USER = 8;
+	static const uint64 MAX_PARTIAL_UPLOAD_AGE_S = 3 * 24 * 3600; // Partial uploads with no activity for this long are deleted.
+
+	// Finds or creates the upload, and registers a connection uploading chunks for it.  Throws glare::Exception on failure.
+	ChunkedUploadRef beginStream(const std::string& URL, uint64 file_len, uint64 content_hash, uint32 chunk_size, const UserID& uploader_id);
+
+	// Writes the chunk data to the partial file.  file is a stream for the partial file, opened with openPartialFile(), one per connection.
+	// Chunks that have already been received are ignored.  Throws glare::Exception on failure.
+	void writeChunk(ChunkedUpload& upload, std::fstream& file, uint32 chunk_index, const uint8* data, size_t len);
+
+	// Unregisters a connection.  Returns true if all chunks have been received, and this connection should verify and commit the upload.
+	bool endStream(ChunkedUpload& upload);
+
+	// Opens the partial file for writing chunks.  Throws glare::Exception on failure.
+	static void openPartialFile(const ChunkedUpload& upload, std::fstream& file_out);
+
+	// Returns true if the hash of the partial file matches the announced content hash.  Throws glare::Exception on failure.
+	static bool verifyUpload(const ChunkedUpload& upload);
+
+	// Deletes the partial and state files for the upload, and removes it from memory.  Call after the partial file has been moved into the resource dir, or on hash mismatch.
+	void removeUpload(ChunkedUpload& upload);
+
+	// Computes the XXH64 (seed 1) hash of the file at path, streaming it from disk.  Throws glare::Exception on failure.
+	static uint64 computeFileHash(const std::string& path);
+
+	// Deletes partial uploads without connections in progress that have had no activity for more than max_age_s, as well as partial files
+	// without a valid state file.  Re-reads the partial upload dir, so also picks up uploads from previous runs.
+	void sweepStalePartialUploads(uint64 cur_time_s, uint64 max_age_s);
+
+	size_t getNumActiveUploads() const; // Threadsafe
+	size_t getNumPartialUploads() const; // Number of partial uploads on disk, including active ones.  Threadsafe
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(ChunkedUploadManager);
+
+	void saveState(ChunkedUpload& upload) REQUIRES(upload.mutex);
+	void loadState(ChunkedUpload& upload) REQUIRES(upload.mutex);
+
+	bool isPartialUploadActive(const std::string& partial_path) const REQUIRES(mutex);
+	void makeRoomForPartialUpload(const UserID& uploader_id) REQUIRES(mutex);
+	static void deletePartialUploadFiles(const std::string& partial_path, const std::string& state_path);
+
+	struct PartialUploadInfo
+	{
+		UserID uploader_id;
+		uint64 last_activity_time; // Seconds since 1970.
+	};
+
+	std::string partial_upload_dir;
+
+	mutable Mutex mutex;
+	std::map<std::string, ChunkedUploadRef> active_uploads GUARDED_BY(mutex); // Map from upload key to uploads with connections in progress.
+	std::map<std::string, PartialUploadInfo> partial_uploads GUARDED_BY(mutex); // Map from partial file path to info, for all partial uploads on disk.
+};
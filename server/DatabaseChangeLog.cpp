@@ -0,0 +1,705 @@
+/*=====================================================================
+DatabaseChangeLog.cpp
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "DatabaseChangeLog.h"
+
+
+#include <Lock.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <Clock.h>
+#include <CryptoRNG.h>
+#include <MemMappedFile.h>
+#include <IncludeXXHash.h>
+
+
+static uint64 makeRandomEpoch()
+{
+	uint64 epoch = 0;
+	try
+	{
+		CryptoRNG::getRandomBytes((uint8*)&epoch, sizeof(epoch));
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("DatabaseChangeLog: failed to get random bytes for epoch: " + e.what());
+		epoch = (uint64)Clock::getSecsSince1970();
+	}
+	return epoch;
+}
+
+
+DatabaseChangeLog::DatabaseChangeLog()
+:	epoch(makeRandomEpoch()),
+	next_seq(1),
+	pruned_through_seq(0)
+{}
+
+
+DatabaseChangeLog::~DatabaseChangeLog()
+{}
+
+
+uint64 DatabaseChangeLog::takeNextSeq()
+{
+	return next_seq++;
+}
+
+
+void DatabaseChangeLog::recordUpdated(const DatabaseKey& key)
+{
+	Lock lock(mutex);
+
+	auto res = records.find(key.value());
+	if(res == records.end())
+		res = records.insert(std::make_pair(key.value(), RecordEntry())).first;
+	else
+		changes.erase(res->second.seq);
+
+	RecordEntry& entry = res->second;
+	entry.seq = takeNextSeq();
+	entry.deleted = false;
+
+	ChangeRef& change = changes[entry.seq];
+	change.is_resource = false;
+	change.key = key.value();
+}
+
+
+void DatabaseChangeLog::recordDeleted(const DatabaseKey& key)
+{
+	Lock lock(mutex);
+
+	auto res = records.find(key.value());
+	if(res == records.end())
+		res = records.insert(std::make_pair(key.value(), RecordEntry())).first;
+	else
+		changes.erase(res->second.seq);
+
+	// Keep the entry as a tombstone, so incremental backups see the deletion.
+	RecordEntry& entry = res->second;
+	entry.seq = takeNextSeq();
+	entry.deleted = true;
+
+	ChangeRef& change = changes[entry.seq];
+	change.is_resource = false;
+	change.key = key.value();
+}
+
+
+void DatabaseChangeLog::resourcePresent(const std::string& URL, const std::string& local_filename, const std::string& local_abs_path)
+{
+	Lock lock(mutex);
+
+	// Always log a new change, even if the resource is already present with the same filename, as re-uploads to the same URL overwrite the file.
+	auto res = resources.find(URL);
+	if(res != resources.end())
+		changes.erase(res->second.seq);
+	else
+		res = resources.insert(std::make_pair(URL, ResourceEntry())).first;
+
+	ResourceEntry& entry = res->second;
+	entry.seq = takeNextSeq();
+	entry.local_filename = local_filename;
+	entry.local_abs_path = local_abs_path;
+	entry.file_size = 0;
+	entry.content_hash = 0;
+	entry.hashed = false;
+
+	ChangeRef& change = changes[entry.seq];
+	change.is_resource = true;
+	change.key = 0;
+	change.URL = URL;
+}
+
+
+void DatabaseChangeLog::getChanges(uint64 requested_epoch, uint64 since_seq, size_t max_bytes, DatabaseRecordSource& record_source, DatabaseChangeBatch& batch_out)
+{
+	batch_out = DatabaseChangeBatch();
+	batch_out.epoch = epoch;
+
+	std::vector<DatabaseChange> candidates;
+	std::unordered_set<uint64> record_keys; // Keys of updated records in candidates, to get the data for.
+	bool more_candidates;
+	{
+		Lock lock(mutex);
+
+		batch_out.is_full = (requested_epoch != epoch) || (since_seq < pruned_through_seq); // If a tombstone the caller needs has been pruned, the caller needs everything.
+		if(batch_out.is_full)
+			since_seq = 0;
+		else
+		{
+			// The caller has everything up to since_seq, so won't need tombstones up to since_seq again.
+			for(auto it = changes.begin(); (it != changes.end()) && (it->first <= since_seq); )
+			{
+				if(!it->second.is_resource)
+				{
+					auto res = records.find(it->second.key);
+					if(res != records.end() && res->second.deleted)
+					{
+						pruned_through_seq = it->first;
+						records.erase(res);
+						it = changes.erase(it);
+						continue;
+					}
+				}
+				++it;
+			}
+		}
+
+		size_t num_to_hash = 0;
+		auto it = changes.upper_bound(since_seq);
+		for(; it != changes.end(); ++it)
+		{
+			if((candidates.size() >= MAX_CHANGES_PER_BATCH) || (num_to_hash >= MAX_RESOURCE_HASHES_PER_BATCH))
+				break;
+
+			DatabaseChange change;
+			change.seq = it->first;
+			if(it->second.is_resource)
+			{
+				const ResourceEntry& entry = resources[it->second.URL];
+				change.type = DatabaseChange::Type_ResourcePresent;
+				change.URL = it->second.URL;
+				change.local_filename = entry.local_filename;
+				change.file_size = entry.file_size;
+				change.content_hash = entry.content_hash;
+				if(!entry.hashed)
+				{
+					change.data.assign(entry.local_abs_path.begin(), entry.local_abs_path.end()); // Temporarily store the path in data, so we can hash the file without the mutex held.
+					num_to_hash++;
+				}
+			}
+			else
+			{
+				const RecordEntry& entry = records[it->second.key];
+				change.type = entry.deleted ? DatabaseChange::Type_RecordDeleted : DatabaseChange::Type_RecordUpdated;
+				change.key = it->second.key;
+				if(!entry.deleted)
+					record_keys.insert(it->second.key);
+			}
+
+			candidates.push_back(change);
+		}
+
+		more_candidates = it != changes.end();
+	}
+
+	// Re-serialise the updated records.  Done without the mutex held, as the record source locks the world state.
+	std::unordered_map<uint64, std::vector<uint8>> record_data;
+	if(!record_keys.empty())
+		record_source.getRecordData(record_keys, record_data);
+
+	batch_out.last_seq = since_seq;
+	batch_out.more = more_candidates;
+	std::vector<size_t> changes_to_hash; // Indices into batch_out.changes of resources that need hashing.
+	size_t num_bytes = 0;
+	for(size_t i=0; i<candidates.size(); ++i)
+	{
+		if(!batch_out.changes.empty() && (num_bytes >= max_bytes))
+		{
+			batch_out.more = true;
+			break;
+		}
+
+		DatabaseChange& change = candidates[i];
+		batch_out.last_seq = change.seq;
+
+		if(change.type == DatabaseChange::Type_ResourcePresent)
+		{
+			if(!change.data.empty())
+				changes_to_hash.push_back(batch_out.changes.size());
+			num_bytes += change.URL.size() + change.local_filename.size();
+		}
+		else if(change.type == DatabaseChange::Type_RecordDeleted)
+		{
+			if(batch_out.is_full)
+				continue; // A full batch starts from an empty database, so deletions aren't needed.
+		}
+		else
+		{
+			auto res = record_data.find(change.key);
+			if(res == record_data.end())
+				continue; // No live object for the record.  If it has been deleted, the deletion has a later seq, so will be returned by a later call.
+			change.data = std::move(res->second);
+			num_bytes += change.data.size();
+		}
+
+		batch_out.changes.push_back(std::move(change));
+	}
+
+	// Hash resource files.
+	std::vector<size_t> failed_changes; // Indices into batch_out.changes of resources that couldn't be hashed.
+	for(size_t i=0; i<changes_to_hash.size(); ++i)
+	{
+		DatabaseChange& change = batch_out.changes[changes_to_hash[i]];
+		const std::string local_abs_path(change.data.begin(), change.data.end());
+		change.data.clear();
+		try
+		{
+			MemMappedFile file(local_abs_path);
+			change.file_size = file.fileSize();
+			change.content_hash = XXH64(file.fileData(), file.fileSize(), /*seed=*/1);
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("DatabaseChangeLog: failed to hash resource file '" + local_abs_path + "': " + e.what());
+			failed_changes.push_back(changes_to_hash[i]);
+			continue;
+		}
+
+		Lock lock(mutex);
+		auto res = resources.find(change.URL);
+		if(res != resources.end() && res->second.seq == change.seq)
+		{
+			res->second.file_size = change.file_size;
+			res->second.content_hash = change.content_hash;
+			res->second.hashed = true;
+		}
+	}
+
+	// Resources that couldn't be hashed are left out of the batch, and logged again with a new sequence number, so that they are retried
+	// by the next getChanges() call after this batch, instead of being skipped over when the caller advances to last_seq.
+	if(!failed_changes.empty())
+	{
+		{
+			Lock lock(mutex);
+			for(size_t i=0; i<failed_changes.size(); ++i)
+			{
+				const DatabaseChange& change = batch_out.changes[failed_changes[i]];
+				auto res = resources.find(change.URL);
+				if(res != resources.end() && res->second.seq == change.seq) // If the resource hasn't been logged again since:
+				{
+					changes.erase(res->second.seq);
+					res->second.seq = takeNextSeq();
+
+					ChangeRef& retry_change = changes[res->second.seq];
+					retry_change.is_resource = true;
+					retry_change.key = 0;
+					retry_change.URL = change.URL;
+				}
+			}
+		}
+
+		size_t write_i = 0;
+		size_t failed_i = 0;
+		for(size_t i=0; i<batch_out.changes.size(); ++i)
+		{
+			if(failed_i < failed_changes.size() && failed_changes[failed_i] == i)
+				failed_i++;
+			else
+			{
+				if(write_i != i)
+					batch_out.changes[write_i] = std::move(batch_out.changes[i]);
+				write_i++;
+			}
+		}
+		batch_out.changes.resize(write_i);
+	}
+}
+
+
+size_t DatabaseChangeLog::getNumRecords() const
+{
+	Lock lock(mutex);
+	return records.size();
+}
+
+
+#if BUILD_TESTS
+
+
+#include "ServerWorldState.h"
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/FileUtils.h>
+#include <BufferOutStream.h>
+#include <BufferInStream.h>
+
+
+// Record source with the current data for each live record.
+class TestRecordSource : public DatabaseRecordSource
+{
+public:
+	virtual void getRecordData(const std::unordered_set<uint64>& keys, std::unordered_map<uint64, std::vector<uint8>>& data_out)
+	{
+		for(auto it = keys.begin(); it != keys.end(); ++it)
+		{
+			auto res = records.find(*it);
+			if(res != records.end())
+				data_out[*it].assign(res->second.begin(), res->second.end());
+		}
+	}
+
+	std::map<uint64, std::string> records;
+};
+
+
+static std::string dataToString(const std::vector<uint8>& data)
+{
+	return std::string(data.begin(), data.end());
+}
+
+
+// Does what the backup bot does: gets all changes since the last manifest, passing them through the wire format, and writes a new manifest.
+// Resource files are copied from the resource dir instead of being downloaded.
+static std::string doTestBackup(DatabaseChangeLog& log, DatabaseRecordSource& record_source, BackupStore& store, size_t max_bytes)
+{
+	BackupManifest manifest;
+	const std::string latest = store.getLatestManifestName();
+	uint64 epoch = 0;
+	uint64 seq = 0;
+	if(!latest.empty())
+	{
+		BackupManifest prev;
+		store.readManifest(latest, prev);
+		epoch = prev.epoch;
+		seq = prev.last_seq;
+		manifest.parent_name = latest;
+	}
+
+	for(int i=0; ; ++i)
+	{
+		DatabaseChangeBatch sent_batch;
+		log.getChanges(epoch, seq, max_bytes, record_source, sent_batch);
+
+		BufferOutStream out;
+		writeToStream(sent_batch, out);
+		BufferInStream in(ArrayRef<uint8>(out.buf.data(), out.buf.size()));
+		DatabaseChangeBatch batch;
+		readFromStream(in, batch);
+
+		if(batch.is_full)
+		{
+			testAssert(i == 0);
+			manifest.is_full = true;
+			manifest.parent_name.clear();
+		}
+
+		for(size_t z=0; z<batch.changes.size(); ++z)
+		{
+			const DatabaseChange& change = batch.changes[z];
+			uint64 chunk_hash = 0;
+			if(change.type == DatabaseChange::Type_RecordUpdated)
+				chunk_hash = store.writeChunk(change.data.data(), change.data.size());
+			manifest.applyChange(change, chunk_hash);
+		}
+
+		epoch = batch.epoch;
+		seq = batch.last_seq;
+		if(!batch.more)
+			break;
+	}
+
+	manifest.epoch = epoch;
+	manifest.last_seq = seq;
+	return store.writeManifest(manifest);
+}
+
+
+void DatabaseChangeLog::test()
+{
+	conPrint("DatabaseChangeLog::test()");
+
+	try
+	{
+		//-------------------- Test basic change tracking --------------------
+		{
+			DatabaseChangeLog log;
+			TestRecordSource source;
+			source.records[1] = "a";
+			source.records[2] = "b";
+			source.records[3] = "c";
+			log.recordUpdated(DatabaseKey(1));
+			log.recordUpdated(DatabaseKey(2));
+			log.recordUpdated(DatabaseKey(3));
+
+			// A request with the wrong epoch should get everything.
+			DatabaseChangeBatch batch;
+			log.getChanges(/*epoch=*/log.getEpoch() + 1, /*since_seq=*/100, /*max_bytes=*/1000, source, batch);
+			testAssert(batch.is_full && !batch.more);
+			testAssert(batch.epoch == log.getEpoch());
+			testAssert(batch.changes.size() == 3);
+			testAssert(batch.changes[0].key == 1 && dataToString(batch.changes[0].data) == "a");
+			const uint64 seq_after_first = batch.last_seq;
+
+			// No changes since then
+			log.getChanges(log.getEpoch(), seq_after_first, 1000, source, batch);
+			testAssert(!batch.is_full && !batch.more && batch.changes.empty());
+			testAssert(batch.last_seq == seq_after_first);
+
+			// Update and delete some records
+			source.records[1] = "a2";
+			source.records.erase(2);
+			source.records[4] = "d";
+			log.recordUpdated(DatabaseKey(1));
+			log.recordDeleted(DatabaseKey(2));
+			log.recordUpdated(DatabaseKey(4));
+
+			log.getChanges(log.getEpoch(), seq_after_first, 1000, source, batch);
+			testAssert(!batch.is_full && batch.changes.size() == 3);
+			testAssert(batch.changes[0].type == DatabaseChange::Type_RecordUpdated && batch.changes[0].key == 1 && dataToString(batch.changes[0].data) == "a2");
+			testAssert(batch.changes[1].type == DatabaseChange::Type_RecordDeleted && batch.changes[1].key == 2);
+			testAssert(batch.changes[2].key == 4);
+
+			// A full batch should only have the latest state of each record, with no deletions.
+			log.getChanges(0, 0, 1000, source, batch);
+			testAssert(batch.is_full && batch.changes.size() == 3);
+			testAssert(batch.changes[0].key == 3 && batch.changes[1].key == 1 && batch.changes[2].key == 4); // In order of last change.
+
+			// Test paging with max_bytes
+			log.getChanges(log.getEpoch(), 0, /*max_bytes=*/1, source, batch);
+			testAssert(batch.changes.size() == 1 && batch.more);
+			size_t num_changes = batch.changes.size();
+			while(batch.more)
+			{
+				log.getChanges(log.getEpoch(), batch.last_seq, 1, source, batch);
+				testAssert(!batch.changes.empty());
+				num_changes += batch.changes.size();
+			}
+			testAssert(num_changes == 4); // 3 updates and 1 deletion.
+
+			// The deletion was pruned by the request after it.
+			testAssert(log.getNumRecords() == 3);
+		}
+
+		//-------------------- Test records with no live object --------------------
+		{
+			DatabaseChangeLog log;
+			TestRecordSource source;
+			source.records[1] = "a";
+			log.recordUpdated(DatabaseKey(1));
+			log.recordUpdated(DatabaseKey(2)); // Not in source, e.g. the object was removed but the record not deleted yet.
+
+			DatabaseChangeBatch batch;
+			log.getChanges(log.getEpoch(), 0, 1000, source, batch);
+			testAssert(batch.changes.size() == 1 && batch.changes[0].key == 1 && !batch.more);
+
+			// When the deletion is logged, it should be returned.
+			log.recordDeleted(DatabaseKey(2));
+			log.getChanges(log.getEpoch(), batch.last_seq, 1000, source, batch);
+			testAssert(batch.changes.size() == 1 && batch.changes[0].key == 2 && batch.changes[0].type == DatabaseChange::Type_RecordDeleted);
+		}
+
+		//-------------------- Test tombstone pruning --------------------
+		{
+			DatabaseChangeLog log;
+			TestRecordSource source;
+			source.records[1] = "a";
+			log.recordUpdated(DatabaseKey(1));
+			log.recordUpdated(DatabaseKey(2));
+			const uint64 seq_before_delete = 2;
+			log.recordDeleted(DatabaseKey(2));
+
+			DatabaseChangeBatch batch;
+			log.getChanges(log.getEpoch(), 0, 1000, source, batch);
+			testAssert(!batch.is_full && batch.changes.size() == 2);
+			testAssert(batch.changes[1].type == DatabaseChange::Type_RecordDeleted && batch.changes[1].key == 2);
+			const uint64 seq_after_delete = batch.last_seq;
+			testAssert(log.getNumRecords() == 2);
+
+			// Once a request shows the caller has the deletion, the tombstone should be pruned.
+			log.getChanges(log.getEpoch(), seq_after_delete, 1000, source, batch);
+			testAssert(!batch.is_full && batch.changes.empty());
+			testAssert(log.getNumRecords() == 1);
+
+			// A request from before the pruned tombstone can't be given the deletion, so should get everything.
+			log.getChanges(log.getEpoch(), seq_before_delete, 1000, source, batch);
+			testAssert(batch.is_full && batch.changes.size() == 1 && batch.changes[0].key == 1);
+		}
+
+		const std::string dir = PlatformUtils::getTempDirPath() + "/db_change_log_test";
+		const std::string resource_dir = dir + "/resources";
+		FileUtils::createDirIfDoesNotExist(dir);
+		FileUtils::createDirIfDoesNotExist(resource_dir);
+
+		//-------------------- Test resource hashing --------------------
+		{
+			const std::string res_data = "resource contents";
+			FileUtils::writeEntireFile(resource_dir + "/res_a.bin", res_data);
+
+			const std::string missing_path = resource_dir + "/missing.bin";
+			if(FileUtils::fileExists(missing_path))
+				FileUtils::deleteFile(missing_path);
+
+			DatabaseChangeLog log;
+			TestRecordSource source;
+			log.resourcePresent("res_a.bin", "res_a.bin", resource_dir + "/res_a.bin");
+			log.resourcePresent("missing.bin", "missing.bin", missing_path);
+
+			// The first attempt to hash missing.bin fails, so it should be left out of the batch.
+			DatabaseChangeBatch batch;
+			log.getChanges(log.getEpoch(), 0, 1000, source, batch);
+			testAssert(batch.changes.size() == 1 && !batch.more);
+			testAssert(batch.changes[0].type == DatabaseChange::Type_ResourcePresent && batch.changes[0].URL == "res_a.bin");
+			testAssert(batch.changes[0].file_size == res_data.size());
+			testAssert(batch.changes[0].content_hash == XXH64(res_data.data(), res_data.size(), /*seed=*/1));
+			testAssert(batch.changes[0].data.empty());
+			const uint64 seq_after_first = batch.last_seq;
+
+			// Once the file is readable, missing.bin should be returned by the next call, even though the caller has advanced past its original change.
+			const std::string missing_data = "now present";
+			FileUtils::writeEntireFile(missing_path, missing_data);
+			log.getChanges(log.getEpoch(), seq_after_first, 1000, source, batch);
+			testAssert(batch.changes.size() == 1);
+			testAssert(batch.changes[0].URL == "missing.bin");
+			testAssert(batch.changes[0].content_hash == XXH64(missing_data.data(), missing_data.size(), /*seed=*/1));
+			const uint64 seq_after_retry = batch.last_seq;
+
+			log.getChanges(log.getEpoch(), seq_after_retry, 1000, source, batch);
+			testAssert(batch.changes.empty());
+
+			// Re-uploading to the same URL overwrites the file, so should be logged again, and re-hashed.
+			const std::string new_res_data = "new resource contents";
+			FileUtils::writeEntireFile(resource_dir + "/res_a.bin", new_res_data);
+			log.resourcePresent("res_a.bin", "res_a.bin", resource_dir + "/res_a.bin");
+			log.getChanges(log.getEpoch(), seq_after_retry, 1000, source, batch);
+			testAssert(batch.changes.size() == 1);
+			testAssert(batch.changes[0].URL == "res_a.bin");
+			testAssert(batch.changes[0].file_size == new_res_data.size());
+			testAssert(batch.changes[0].content_hash == XXH64(new_res_data.data(), new_res_data.size(), /*seed=*/1));
+
+			FileUtils::deleteFile(missing_path);
+		}
+
+		//-------------------- End-to-end test: incremental backups of a world state database, then restore --------------------
+		{
+			const std::string db_path = dir + "/server_db.bin";
+			const std::string backup_dir = dir + "/backup";
+			if(FileUtils::fileExists(backup_dir + "/latest_manifest.txt"))
+				FileUtils::deleteFile(backup_dir + "/latest_manifest.txt");
+			BackupStore store(backup_dir);
+
+			Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+			world_state->resource_manager = new ResourceManager(resource_dir);
+			world_state->createNewDatabase(db_path);
+
+			const std::string res_data = "mesh data";
+			std::string res_local_filename;
+
+			WorldObjectRef ob_a = new WorldObject();
+			ob_a->uid = UID(1);
+			ob_a->model_url = "mesh_1.bmesh";
+			WorldObjectRef ob_b = new WorldObject();
+			ob_b->uid = UID(2);
+			{
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+				ResourceRef resource = world_state->resource_manager->getOrCreateResourceForURL("mesh_1.bmesh");
+				FileUtils::writeEntireFile(world_state->resource_manager->getLocalAbsPathForResource(*resource), res_data);
+				res_local_filename = resource->getRawLocalPath();
+				resource->setState(Resource::State_Present);
+				world_state->addResourcesAsDBDirty(resource);
+
+				Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+				{
+					ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+					root_world->objects[ob_a->uid] = ob_a;
+					root_world->objects[ob_b->uid] = ob_b;
+					root_world->addWorldObjectAsDBDirty(ob_a);
+					root_world->addWorldObjectAsDBDirty(ob_b);
+				}
+				world_state->serialiseToDisk();
+			}
+
+			const std::string full_name = doTestBackup(world_state->db_change_log, *world_state, store, /*max_bytes=*/64);
+			{
+				BackupManifest full;
+				store.readManifest(full_name, full);
+				testAssert(full.is_full);
+				testAssert(full.records.size() == world_state->db_change_log.getNumRecords()); // 2 objects, the resource, and anything else written.
+				testAssert(full.resources.size() == 1);
+				testAssert(full.resources["mesh_1.bmesh"].content_hash == BackupStore::hashData((const uint8*)res_data.data(), res_data.size()));
+			}
+
+			// Copy the resource into the backup, as the backup bot would after downloading it.
+			store.writeChunk((const uint8*)res_data.data(), res_data.size());
+
+			// Change ob_a and delete ob_b.
+			{
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+				Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+				{
+					ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+					ob_a->content = "changed";
+					root_world->addWorldObjectAsDBDirty(ob_a);
+
+					world_state->db_records_to_delete.insert(ob_b->database_key);
+					root_world->objects.erase(ob_b->uid);
+				}
+				world_state->serialiseToDisk();
+			}
+
+			const std::string incr_name = doTestBackup(world_state->db_change_log, *world_state, store, /*max_bytes=*/1000000);
+			{
+				BackupManifest incr;
+				store.readManifest(incr_name, incr);
+				testAssert(!incr.is_full && incr.parent_name == full_name);
+				testAssert(incr.records.size() == 1); // Just the changed object.
+				testAssert(incr.deleted_keys.size() == 1);
+				testAssert(incr.resources.empty());
+			}
+
+			// An immediate backup with no changes should be an empty incremental manifest.
+			const std::string empty_name = doTestBackup(world_state->db_change_log, *world_state, store, 1000000);
+			{
+				BackupManifest empty;
+				store.readManifest(empty_name, empty);
+				testAssert(!empty.is_full && empty.records.empty() && empty.deleted_keys.empty());
+			}
+
+			// Restore, and load the restored database.
+			const std::string restored_db_path = dir + "/restored_db.bin";
+			const std::string restored_resource_dir = dir + "/restored_resources";
+			store.restore(empty_name, restored_db_path, restored_resource_dir);
+			testAssert(FileUtils::readEntireFile(restored_resource_dir + "/" + res_local_filename) == res_data);
+
+			Reference<ServerAllWorldsState> restored = new ServerAllWorldsState();
+			restored->resource_manager = new ResourceManager(restored_resource_dir);
+			restored->readFromDisk(restored_db_path);
+			{
+				ProfiledLock lock(restored->mutex, LOCK_PROFILER_SITE());
+				Reference<ServerWorldState> root_world = restored->getRootWorldState();
+				ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+				testAssert(root_world->objects.size() == 1);
+				testAssert(root_world->objects[UID(1)]->content == "changed");
+				testAssert(root_world->objects[UID(1)]->model_url == "mesh_1.bmesh");
+				testAssert(restored->resource_manager->isFileForURLPresent("mesh_1.bmesh"));
+			}
+
+			// A new server process (a new change log epoch) should result in a new full manifest, with the same record data as before.
+			std::vector<BackupManifest> chain;
+			store.getManifestChain(empty_name, chain);
+			std::map<uint64, uint64> prev_records;
+			std::map<std::string, BackupResource> prev_resources;
+			BackupStore::computeState(chain, prev_records, prev_resources);
+
+			const std::string full2_name = doTestBackup(restored->db_change_log, *restored, store, 1000000);
+			{
+				BackupManifest full2;
+				store.readManifest(full2_name, full2);
+				testAssert(full2.is_full && full2.parent_name.empty());
+				testAssert(full2.records.size() == prev_records.size());
+				testAssert(full2.resources.size() == 1);
+
+				std::set<uint64> prev_chunks;
+				for(auto it = prev_records.begin(); it != prev_records.end(); ++it)
+					prev_chunks.insert(it->second);
+				for(auto it = full2.records.begin(); it != full2.records.end(); ++it)
+					testAssert(prev_chunks.count(it->second) == 1);
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("DatabaseChangeLog::test() done.");
+}
+
+
+#endif // BUILD_TESTS
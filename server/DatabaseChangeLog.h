@@ -0,0 +1,120 @@
+/*=====================================================================
+DatabaseChangeLog.h
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/BackupStore.h"
+#include <utils/DatabaseKey.h>
+#include <Database.h>
+#include <Mutex.h>
+#include <Platform.h>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+DatabaseRecordSource
+--------------------
+Serialises the current state of database records, for DatabaseChangeLog::getChanges().
+Implemented by ServerAllWorldsState.
+=====================================================================*/
+class DatabaseRecordSource
+{
+public:
+	virtual ~DatabaseRecordSource() {}
+
+	// Writes the record data for each key in keys that has a live object into data_out.  Keys with no live object are left out of data_out.
+	// Called without the DatabaseChangeLog mutex held.
+	virtual void getRecordData(const std::unordered_set<uint64>& keys, std::unordered_map<uint64, std::vector<uint8>>& data_out) = 0;
+};
+
+
+/*=====================================================================
+DatabaseChangeLog
+-----------------
+Tracks which database records and resources have changed, so the backup bot can fetch just the changes since its last snapshot.
+
+Each record write or deletion, and each resource becoming present, is given a new change sequence number.
+Only the latest change for each record or resource is kept, so getChanges() returns the current state of everything
+that changed after since_seq.  Only the key and sequence number of each record is kept: getChanges() gets the record data by re-serialising
+the live object from a DatabaseRecordSource.  Records with no live object (e.g. an object that has been removed, but whose deletion hasn't been
+logged yet) are left out of the batch, as the deletion will be returned by a later call.
+
+Deleted records are kept as tombstones until the backup bot has received them.  A request in the current epoch with since_seq S means the bot
+has a snapshot that includes everything up to S, so tombstones up to S are pruned.  A later request from before S (e.g. from an older snapshot)
+can't be given those deletions any more, so gets everything, with is_full set.
+
+Sequence numbers are not persisted, so a new random epoch is chosen when the server starts.  If the backup bot asks for changes
+in a different epoch, it gets everything, with is_full set.
+
+The mutex is a leaf lock, so ServerAllWorldsState can update the log while holding its own mutex,
+and the backup bot connection can read it without blocking the world state.
+=====================================================================*/
+class DatabaseChangeLog
+{
+public:
+	DatabaseChangeLog();
+	~DatabaseChangeLog();
+
+	static const size_t MAX_RESOURCE_HASHES_PER_BATCH = 64; // Limit on resource files hashed for a single getChanges() call, so a call doesn't take too long.
+	static const size_t MAX_CHANGES_PER_BATCH = 1024; // Limit on changes considered for a single getChanges() call, so we don't re-serialise too many records at once.
+
+	uint64 getEpoch() const { return epoch; }
+
+	void recordUpdated(const DatabaseKey& key);
+	void recordDeleted(const DatabaseKey& key);
+	void resourcePresent(const std::string& URL, const std::string& local_filename, const std::string& local_abs_path); // Always logs a new change, as the file may have been overwritten by a re-upload.
+
+	// Gets changes after since_seq, in sequence order, stopping when the record data exceeds max_bytes (at least one change is returned if there are any).
+	// Gets record data from record_source, and hashes resource files that haven't been hashed yet, without holding the mutex.
+	// Resources whose files can't be hashed are left out of the batch and logged again with a new sequence number, so a later call retries them.
+	// Prunes tombstones up to since_seq.
+	void getChanges(uint64 requested_epoch, uint64 since_seq, size_t max_bytes, DatabaseRecordSource& record_source, DatabaseChangeBatch& batch_out);
+
+	size_t getNumRecords() const; // Including tombstones.
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(DatabaseChangeLog);
+
+	struct RecordEntry
+	{
+		uint64 seq;
+		bool deleted;
+	};
+
+	struct ResourceEntry
+	{
+		uint64 seq;
+		std::string local_filename;
+		std::string local_abs_path;
+		uint64 file_size;
+		uint64 content_hash;
+		bool hashed;
+	};
+
+	struct ChangeRef // Refers to the record or resource changed.
+	{
+		bool is_resource;
+		uint64 key;
+		std::string URL;
+	};
+
+	uint64 takeNextSeq() REQUIRES(mutex);
+
+	const uint64 epoch;
+
+	mutable Mutex mutex;
+	uint64 next_seq GUARDED_BY(mutex);
+	uint64 pruned_through_seq GUARDED_BY(mutex); // Seq of the latest tombstone pruned.  Requests from before this get everything.
+	std::unordered_map<uint64, RecordEntry> records GUARDED_BY(mutex); // Database key value to latest state of record.
+	std::unordered_map<std::string, ResourceEntry> resources GUARDED_BY(mutex); // URL to resource
+	std::map<uint64, ChangeRef> changes GUARDED_BY(mutex); // Sequence number to latest change for each record or resource.
+};
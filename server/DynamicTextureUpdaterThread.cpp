@@ -11,11 +11,13 @@ Copyright Glare Technologies Limited 2023 -
 #include "ServerSideScripting.h"
 #include "MeshLODGenThread.h"
 #include "../shared/ImageDecoding.h"
+#include "../webserver/WebResponseCache.h"
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
 #include <StringUtils.h>
 #include <PlatformUtils.h>
+#include <Clock.h>
 #include <Timer.h>
 #include <TaskManager.h>
 #include <FileUtils.h>
@@ -25,9 +27,31 @@ Copyright Glare Technologies Limited 2023 -
 #include <graphics/ImageMap.h>
 
 
+DynTexFetchResponse HTTPDynTexFetcher::fetch(const std::string& URL, const std::string& if_modified_since)
+{
+	HTTPClient http_client;
+	http_client.max_data_size			= 32 * 1024 * 1024; // 32 MB
+	http_client.max_socket_buffer_size	= 32 * 1024 * 1024; // 32 MB
+	if(!if_modified_since.empty())
+		http_client.additional_headers.push_back("If-Modified-Since: " + if_modified_since);
+
+	DynTexFetchResponse response;
+	HTTPClient::ResponseInfo response_info = http_client.downloadFile(URL, response.data);
+	response.response_code = response_info.response_code;
+	response.mime_type = response_info.mime_type;
+	if(response_info.response_code >= 300 && response_info.response_code != 304)
+		throw glare::Exception("Non 200 HTTP return code: " + toString(response_info.response_code) + ", msg: '" + response_info.response_message + "'");
+	return response;
+}
+
+
+const size_t DynamicTextureUpdaterThread::NUM_FETCH_THREADS;
+
+
 DynamicTextureUpdaterThread::DynamicTextureUpdaterThread(Server* server_, ServerAllWorldsState* world_state_)
 :	server(server_), world_state(world_state_)
 {
+	fetcher = new HTTPDynTexFetcher();
 }
 
 
@@ -44,40 +68,6 @@ struct ObWithDynamicTexture
 };
 
 
-// See if object has a server-side script, if so, add info about it to obs_with_dyn_textures_out.
-static void checkForDynamicTextureToCheck(const std::string& world_name, WorldObject* ob, ServerAllWorldsState* world_state, std::vector<ObWithDynamicTexture>& obs_with_dyn_textures_out) REQUIRES(world_state->mutex)
-{
-	if(!ob->script.empty())
-	{
-		try
-		{
-			Reference<ServerSideScripting::ServerSideScript> script = ServerSideScripting::parseXMLScript(ob->script);
-			if(script.nonNull())
-			{
-				// Look up user who created the object, to check ALLOW_DYN_TEX_UPDATE_CHECKING flag on the user
-				auto user_res = world_state->user_id_to_users.find(ob->creator_id);
-				if(user_res != world_state->user_id_to_users.end())
-				{
-					const User* user = user_res->second.ptr();
-					if(BitUtils::isBitSet(user->flags, User::ALLOW_DYN_TEX_UPDATE_CHECKING))
-					{
-						obs_with_dyn_textures_out.push_back({world_name, ob->uid, script});
-					}
-					else
-					{
-						conPrint("\tDynamicTextureUpdaterThread: User '" + user->name + "' must have ALLOW_DYN_TEX_UPDATE_CHECKING flag set to allow checking for dynamic textures.");
-					}
-				}
-			}
-		}
-		catch(glare::Exception& e)
-		{
-			conPrint("\tDynamicTextureUpdaterThread: Excep while parsing XML script: " + e.what());
-		}
-	}
-}
-
-
 static std::string sanitiseString(const std::string& s)
 {
 	std::string res = s;
@@ -88,171 +78,357 @@ static std::string sanitiseString(const std::string& s)
 }
 
 
-struct DynTextureFetchResults
+// Downloads a single base image URL.  Runs on the fetch task manager threads, so doesn't touch the world state.
+class DynTexFetchTask : public glare::Task
 {
-	std::string substrata_URL; // Set to empty string if exception occurred or download failed.
-};
-
-
-// Returns substrata URL of resource for the downloaded file.
-static std::string fetchFileForURLAndAddAsResource(const std::string& base_URL, ServerAllWorldsState* world_state)
-{
-	HTTPClient http_client;
-	http_client.max_data_size			= 32 * 1024 * 1024; // 32 MB
-	http_client.max_socket_buffer_size	= 32 * 1024 * 1024; // 32 MB
+public:
+	enum Result
+	{
+		Result_Failed,
+		Result_NotModified, // Got a 304 response.
+		Result_Unchanged, // Downloaded the image, but it has the same content hash as last time.
+		Result_Changed
+	};
 
-	std::string data;
-	HTTPClient::ResponseInfo response = http_client.downloadFile(base_URL, data);
+	DynTexFetchTask() : result(Result_Failed), content_hash(0) {}
 
-	if(response.response_code >= 200 && response.response_code < 300)
+	virtual void run(size_t thread_index)
 	{
-		conPrint("\tDynamicTextureUpdaterThread: Got HTTP " + toString(response.response_code) + " response, file size: " + ::getNiceByteSize(data.size()));
-
-		// If original URL didn't have a file extension in it, pick one based on MIME type
-		std::string use_extension = sanitiseString(::getExtension(base_URL));
-		if(use_extension.empty())
+		try
 		{
-			// Work out extension to use - see https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types
-			if(response.mime_type == "image/gif")
-				use_extension = "gif";
-			else if(response.mime_type == "image/jpeg")
-				use_extension = "jpg";
-			else if(response.mime_type == "image/png")
-				use_extension = "png";
-			else
-				throw glare::Exception("Unknown MIME type for image or unsupported MIME type: '" + response.mime_type + "'");
-		}
-
-		if(!ImageDecoding::isSupportedImageExtension(use_extension))
-			throw glare::Exception("Image type extension not supported: '" + use_extension + "'.");
+			const std::string fetch_HTTP_date_ = WebResponseCache::formatHTTPDate(Clock::getSecsSince1970()); // Use the time before the request, so we can't miss changes made during the request.
 
-		if(!ImageDecoding::areMagicBytesValid(data.data(), data.size(), use_extension))
-			throw glare::Exception("Image magic bytes are not valid for extension '" + use_extension + "'.");
+			// Only send a conditional request if we have successfully downloaded this image before.
+			const std::string if_modified_since = prev_state.substrata_URL.empty() ? "" : prev_state.last_fetch_HTTP_date;
 
-		const uint64 hash = XXH64(data.data(), data.size(), /*seed=*/1);
-
-		const std::string URL = ResourceManager::URLForNameAndExtensionAndHash(::removeDotAndExtension(base_URL), use_extension, hash);
+			DynTexFetchResponse response = fetcher->fetch(base_URL, if_modified_since);
+			if(response.response_code == 304)
+			{
+				result = Result_NotModified;
+				return;
+			}
 
-		conPrint("\tDynamicTextureUpdaterThread: current/new URL: " + URL + "");
+			if(!(response.response_code >= 200 && response.response_code < 300))
+				throw glare::Exception("Non 200 HTTP return code: " + toString(response.response_code));
 
-		{
-			Lock lock(world_state->mutex);
-
-			if(!world_state->resource_manager->isFileForURLPresent(URL))
+			// If original URL didn't have a file extension in it, pick one based on MIME type
+			std::string use_extension = sanitiseString(::getExtension(base_URL));
+			if(use_extension.empty())
 			{
-				conPrint("\tDynamicTextureUpdaterThread: Resource not already present, adding to resource_manager...");
+				// Work out extension to use - see https://developer.mozilla.org/en-US/docs/Web/HTTP/Basics_of_HTTP/MIME_types
+				if(response.mime_type == "image/gif")
+					use_extension = "gif";
+				else if(response.mime_type == "image/jpeg")
+					use_extension = "jpg";
+				else if(response.mime_type == "image/png")
+					use_extension = "png";
+				else
+					throw glare::Exception("Unknown MIME type for image or unsupported MIME type: '" + response.mime_type + "'");
+			}
 
-				const std::string local_abs_path = world_state->resource_manager->pathForURL(URL);
+			if(!ImageDecoding::isSupportedImageExtension(use_extension))
+				throw glare::Exception("Image type extension not supported: '" + use_extension + "'.");
 
-				FileUtils::writeEntireFile(local_abs_path, data);
+			if(!ImageDecoding::areMagicBytesValid(response.data.data(), response.data.size(), use_extension))
+				throw glare::Exception("Image magic bytes are not valid for extension '" + use_extension + "'.");
 
-				world_state->resource_manager->setResourceAsLocallyPresentForURL(URL);
+			content_hash = XXH64(response.data.data(), response.data.size(), /*seed=*/1);
+			fetch_HTTP_date = fetch_HTTP_date_;
 
-				ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(URL);
-				world_state->addResourcesAsDBDirty(resource);
+			if(!prev_state.substrata_URL.empty() && (content_hash == prev_state.content_hash))
+			{
+				result = Result_Unchanged;
 			}
 			else
 			{
-				conPrint("\tDynamicTextureUpdaterThread: texture is already present as a resource.");
+				extension = use_extension;
+				data = std::move(response.data);
+				result = Result_Changed;
 			}
-		} // End lock scope
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("\tDynamicTextureUpdaterThread: Excep fetching URL '" + base_URL + "': " + e.what());
+			result = Result_Failed;
+		}
+	}
 
-		return URL;
+	// Inputs
+	DynTexFetcher* fetcher;
+	std::string base_URL;
+	DynTexURLState prev_state;
+
+	// Outputs
+	Result result;
+	std::string data; // Downloaded image, if result is Result_Changed.
+	std::string extension; // If result is Result_Changed.
+	uint64 content_hash;
+	std::string fetch_HTTP_date;
+};
+typedef Reference<DynTexFetchTask> DynTexFetchTaskRef;
+
+
+// Adds the downloaded image as a resource if it isn't present already.  Returns the substrata URL of the resource.
+static std::string addImageAsResource(const DynTexFetchTask& task, ServerAllWorldsState* world_state)
+{
+	const std::string URL = ResourceManager::URLForNameAndExtensionAndHash(::removeDotAndExtension(task.base_URL), task.extension, task.content_hash);
+
+	conPrint("\tDynamicTextureUpdaterThread: current/new URL: " + URL + "");
+
+	if(!world_state->resource_manager->isFileForURLPresent(URL))
+	{
+		conPrint("\tDynamicTextureUpdaterThread: Resource not already present, adding to resource_manager...");
+
+		const std::string local_abs_path = world_state->resource_manager->pathForURL(URL);
+
+		FileUtils::writeEntireFile(local_abs_path, task.data);
+
+		world_state->resource_manager->setResourceAsLocallyPresentForURL(URL);
+
+		ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(URL);
+
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+		world_state->addResourcesAsDBDirty(resource);
 	}
 	else
-		throw glare::Exception("Non 200 HTTP return code: " + toString(response.response_code) + ", msg: '" + response.response_message + "'"); 
+	{
+		conPrint("\tDynamicTextureUpdaterThread: texture is already present as a resource.");
+	}
 
+	return URL;
 }
 
 
-static void checkDynamicTexture(const ObWithDynamicTexture& ob_with_dyn_tex, ServerAllWorldsState* world_state, Server* server, std::map<std::string, DynTextureFetchResults>& fetch_results_map)
+// Sets the texture URL on the object material if it is different.  Returns true if changed.
+static bool updateObjectTexture(const ObWithDynamicTexture& ob_with_dyn_tex, const std::string& substrata_URL, ServerAllWorldsState* world_state, ServerWorldState* world, Server* server) REQUIRES(world_state->mutex, world->mutex)
 {
-	const std::string base_URL = ob_with_dyn_tex.script->base_image_URL;
+	const auto ob_res = world->objects.find(ob_with_dyn_tex.ob_uid);
+	if(ob_res == world->objects.end())
+		return false;
 
-	const auto fetch_it = fetch_results_map.find(base_URL);
-	if(fetch_it == fetch_results_map.end())
-	{
-		conPrint("\tDynamicTextureUpdaterThread: Requesting file at URL '" + ob_with_dyn_tex.script->base_image_URL + "'...");
+	WorldObject* ob = ob_res->second.ptr();
 
-		try
-		{
-			const std::string substrata_URL = fetchFileForURLAndAddAsResource(base_URL, world_state);
+	if(ob_with_dyn_tex.script->material_index >= ob->materials.size())
+		return false;
 
-			fetch_results_map[base_URL] = DynTextureFetchResults({substrata_URL});
-		}
-		catch(glare::Exception& e)
+	WorldMaterial* material = ob->materials[ob_with_dyn_tex.script->material_index].ptr();
+
+	bool tex_URL_changed = false;
+	if(ob_with_dyn_tex.script->material_texture == "colour")
+	{
+		if(substrata_URL != material->colour_texture_url) // If new URL is different from existing texture URL:
 		{
-			conPrint("\tDynamicTextureUpdaterThread: Excep fetching URL '" + base_URL + "': " + e.what());
-			fetch_results_map[base_URL] = DynTextureFetchResults({""});
+			material->colour_texture_url = substrata_URL;
+			tex_URL_changed = true;
 		}
 	}
-
-	assert(fetch_results_map.count(base_URL) > 0);
-	DynTextureFetchResults fetch_results = fetch_results_map[base_URL];
-
-	if(fetch_results.substrata_URL.empty())
+	else if(ob_with_dyn_tex.script->material_texture == "emission")
 	{
-		// We already tried to fetch from this URL, and it failed.
-		conPrint("\tDynamicTextureUpdaterThread: Fetch for URL '" + base_URL + "' failed, skipping");
+		if(substrata_URL != material->emission_texture_url) // If new URL is different from existing texture URL:
+		{
+			material->emission_texture_url = substrata_URL;
+			tex_URL_changed = true;
+		}
 	}
 	else
+		throw glare::Exception("Invalid material_texture type");
+
+	if(tex_URL_changed) // If new URL is different from existing texture URL:
 	{
+		conPrint("\tDynamicTextureUpdaterThread: Texture is different from existing texture, updating object...");
+
+		world->addWorldObjectAsDBDirty(ob);
+		world_state->markAsChanged();
+
+		ob->from_remote_other_dirty = true; // Set this so a ObjectFullUpdate message is sent to clients.
+		world->dirty_from_remote_objects.insert(ob);
+
+		// Send a message to MeshLODGenThread to generate LOD textures for this new texture (if not already generated)
+		if(server)
 		{
-			Lock lock(world_state->mutex);
+			CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
+			msg->ob_uid = ob_with_dyn_tex.ob_uid;
+			server->enqueueMsgForLodGenThread(msg);
+		}
+	}
 
-			const std::string substrata_URL = fetch_results.substrata_URL;
+	return tex_URL_changed;
+}
 
-			// Update object to use new texture
-			const auto ob_res = world_state->world_states[ob_with_dyn_tex.world_name]->objects.find(ob_with_dyn_tex.ob_uid);
-			if(ob_res != world_state->world_states[ob_with_dyn_tex.world_name]->objects.end())
-			{
-				WorldObject* ob = ob_res->second.ptr();
 
-				if(ob_with_dyn_tex.script->material_index < ob->materials.size())
-				{
-					WorldMaterial* material = ob->materials[ob_with_dyn_tex.script->material_index].ptr();
+DynTexUpdateStats DynamicTextureUpdaterThread::checkDynamicTextures()
+{
+	DynTexUpdateStats stats;
 
-					bool tex_URL_changed = false;
-					if(ob_with_dyn_tex.script->material_texture == "colour")
+	//-------------------------------------------  Iterate over objects, get list of objects using dynamic textures -------------------------------------------
+	conPrint("DynamicTextureUpdaterThread: Iterating over world object(s)...");
+	Timer timer;
+	std::vector<ObWithDynamicTexture> obs_with_dyn_textures;
+	std::map<uint64, Reference<ServerSideScripting::ServerSideScript>> new_script_cache; // Scripts seen in this update.  Replaces script_cache afterwards, so scripts no longer used are removed.
+
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+		{
+			ServerWorldState* world = world_it->second.ptr();
+			ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+			for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+			{
+				WorldObject* ob = it->second.ptr();
+				if(ob->script.empty())
+					continue;
+
+				// Look up parsed script in the cache, parse if not present.
+				const uint64 script_hash = XXH64(ob->script.data(), ob->script.size(), /*seed=*/1);
+				Reference<ServerSideScripting::ServerSideScript> script;
+				auto cache_res = script_cache.find(script_hash);
+				if(cache_res != script_cache.end())
+					script = cache_res->second;
+				else
+				{
+					try
 					{
-						if(substrata_URL != material->colour_texture_url) // If new URL is different from existing texture URL:
-						{
-							material->colour_texture_url = substrata_URL;
-							tex_URL_changed = true;
-						}
+						script = ServerSideScripting::parseXMLScript(ob->script);
 					}
-					else if(ob_with_dyn_tex.script->material_texture == "emission")
+					catch(glare::Exception& e)
 					{
-						if(substrata_URL != material->emission_texture_url) // If new URL is different from existing texture URL:
-						{
-							material->emission_texture_url = substrata_URL;
-							tex_URL_changed = true;
-						}
+						conPrint("\tDynamicTextureUpdaterThread: Excep while parsing XML script: " + e.what()); // Script will be cached as NULL, so we only print this once.
 					}
-					else
-						throw glare::Exception("Invalid material_texture type");
+					stats.num_scripts_parsed++;
+				}
+				new_script_cache[script_hash] = script;
 
-					if(tex_URL_changed) // If new URL is different from existing texture URL:
+				if(script.nonNull())
+				{
+					// Look up user who created the object, to check ALLOW_DYN_TEX_UPDATE_CHECKING flag on the user
+					auto user_res = world_state->user_id_to_users.find(ob->creator_id);
+					if(user_res != world_state->user_id_to_users.end())
 					{
-						conPrint("\tDynamicTextureUpdaterThread: Texture is different from existing texture, updating object...");
+						const User* user = user_res->second.ptr();
+						if(BitUtils::isBitSet(user->flags, User::ALLOW_DYN_TEX_UPDATE_CHECKING))
+							obs_with_dyn_textures.push_back({/*world name=*/world_it->first, ob->uid, script});
+						else
+							conPrint("\tDynamicTextureUpdaterThread: User '" + user->name + "' must have ALLOW_DYN_TEX_UPDATE_CHECKING flag set to allow checking for dynamic textures.");
+					}
+				}
+			}
+		}
+	} // End lock scope
 
-						world_state->world_states[ob_with_dyn_tex.world_name]->addWorldObjectAsDBDirty(ob);
-						world_state->markAsChanged();
+	script_cache.swap(new_script_cache);
+	stats.num_obs = obs_with_dyn_textures.size();
 
-						ob->from_remote_other_dirty = true; // Set this so a ObjectFullUpdate message is sent to clients.
-						world_state->world_states[ob_with_dyn_tex.world_name]->dirty_from_remote_objects.insert(ob);
+	conPrint("DynamicTextureUpdaterThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", obs_with_dyn_textures: " + toString(obs_with_dyn_textures.size()));
+	//----------------------------------------------------------------------------------------------------------------------------------------------------
 
-						// Send a message to MeshLODGenThread to generate LOD textures for this new texture (if not already generated)
-						CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
-						msg->ob_uid = ob_with_dyn_tex.ob_uid;
-						server->enqueueMsgForLodGenThread(msg);
-					}
-					else
-						conPrint("\tDynamicTextureUpdaterThread: Texture is the same as existing texture on object.");
-				}
+	//-------------------------------------------  Download each unique base image concurrently, without holding the world lock -------------------------------------------
+	conPrint("DynamicTextureUpdaterThread: Checking for image updates...");
+	timer.reset();
+
+	std::map<std::string, DynTexFetchTaskRef> fetch_tasks; // Map from base URL to task
+	for(size_t i=0; i<obs_with_dyn_textures.size(); ++i)
+	{
+		const std::string& base_URL = obs_with_dyn_textures[i].script->base_image_URL;
+		if(fetch_tasks.count(base_URL) == 0)
+		{
+			DynTexFetchTaskRef task = new DynTexFetchTask();
+			task->fetcher = fetcher.ptr();
+			task->base_URL = base_URL;
+			const auto state_res = url_states.find(base_URL);
+			if(state_res != url_states.end())
+				task->prev_state = state_res->second;
+			fetch_tasks[base_URL] = task;
+		}
+	}
+	stats.num_URLs = fetch_tasks.size();
+
+	if(!fetch_tasks.empty())
+	{
+		glare::TaskManager task_manager("DynamicTextureUpdaterThread fetch task manager", myMin(NUM_FETCH_THREADS, fetch_tasks.size())); // Limits the number of concurrent connections.
+		for(auto it = fetch_tasks.begin(); it != fetch_tasks.end(); ++it)
+			task_manager.addTask(it->second);
+		task_manager.waitForTasksToComplete();
+	}
+
+	//-------------------------------------------  Add changed images as resources, and update URL states -------------------------------------------
+	for(auto it = fetch_tasks.begin(); it != fetch_tasks.end(); ++it)
+	{
+		const DynTexFetchTask& task = *it->second;
+		DynTexURLState& state = url_states[task.base_URL];
+		switch(task.result)
+		{
+		case DynTexFetchTask::Result_Failed:
+			stats.num_fetch_failures++;
+			break;
+		case DynTexFetchTask::Result_NotModified:
+			stats.num_not_modified++;
+			break;
+		case DynTexFetchTask::Result_Unchanged:
+			stats.num_unchanged_content++;
+			state.last_fetch_HTTP_date = task.fetch_HTTP_date;
+			break;
+		case DynTexFetchTask::Result_Changed:
+			try
+			{
+				state.substrata_URL = addImageAsResource(task, world_state);
+				state.content_hash = task.content_hash;
+				state.last_fetch_HTTP_date = task.fetch_HTTP_date;
+				stats.num_changed++;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("\tDynamicTextureUpdaterThread: Excep adding image for URL '" + task.base_URL + "' as resource: " + e.what());
+				stats.num_fetch_failures++;
 			}
-		} // End lock scope
+			break;
+		}
 	}
+
+	// Remove states for URLs no longer used by any object.
+	for(auto it = url_states.begin(); it != url_states.end(); )
+	{
+		if(fetch_tasks.count(it->first) == 0)
+			it = url_states.erase(it);
+		else
+			++it;
+	}
+
+	//-------------------------------------------  Update objects to use the current textures -------------------------------------------
+	// Objects may be using an older texture even if the image hasn't changed since the last update, e.g. if the script was just edited, so check all objects.
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		for(size_t i=0; i<obs_with_dyn_textures.size(); ++i)
+		{
+			const ObWithDynamicTexture& ob_with_dyn_tex = obs_with_dyn_textures[i];
+
+			const DynTexURLState& state = url_states[ob_with_dyn_tex.script->base_image_URL];
+			if(state.substrata_URL.empty())
+				continue; // We have never successfully downloaded this image.
+
+			const auto world_res = world_state->world_states.find(ob_with_dyn_tex.world_name);
+			if(world_res == world_state->world_states.end())
+				continue;
+			ServerWorldState* world = world_res->second.ptr();
+			ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+
+			try
+			{
+				if(updateObjectTexture(ob_with_dyn_tex, state.substrata_URL, world_state, world, server))
+					stats.num_obs_updated++;
+			}
+			catch(glare::Exception& e)
+			{
+				conPrint("\tDynamicTextureUpdaterThread: glare::Exception while updating object: " + e.what());
+			}
+		}
+	} // End lock scope
+
+	conPrint("DynamicTextureUpdaterThread: Done checking for image updates. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ", URLs: " + toString(stats.num_URLs) + ", changed: " + toString(stats.num_changed) +
+		", not modified: " + toString(stats.num_not_modified) + ", unchanged content: " + toString(stats.num_unchanged_content) + ", failed: " + toString(stats.num_fetch_failures) + ", objects updated: " + toString(stats.num_obs_updated) + ")");
+
+	return stats;
 }
 
 
@@ -266,7 +442,7 @@ void DynamicTextureUpdaterThread::doRun()
 		{
 			Timer time_since_last_scan;
 
-			//-------------------------------------------  Wait until we have a kill message, or N seconds have elapsed, or the force-update flag is set ------------------------------------------- 
+			//-------------------------------------------  Wait until we have a kill message, or N seconds have elapsed, or the force-update flag is set -------------------------------------------
 			while(time_since_last_scan.elapsed() < 3600.0)
 			{
 				// Block for a while, or until we have a message
@@ -280,7 +456,7 @@ void DynamicTextureUpdaterThread::doRun()
 
 				// Check if the force-update flag is set (can be set in admin web interface).  If so, abort wait.
 				{
-					Lock lock(world_state->mutex);
+					ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 					if(world_state->force_dyn_tex_update)
 					{
 						world_state->force_dyn_tex_update = false;
@@ -289,65 +465,237 @@ void DynamicTextureUpdaterThread::doRun()
 				}
 			}
 
-			//-------------------------------------------  Iterate over objects, get list of objects using dynamic textures -------------------------------------------
-			conPrint("DynamicTextureUpdaterThread: Iterating over world object(s)...");
-			Timer timer;
-			std::vector<ObWithDynamicTexture> obs_with_dyn_textures;
+			checkDynamicTextures();
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("DynamicTextureUpdaterThread: glare::Exception: " + e.what());
+	}
+	catch(std::exception& e) // catch std::bad_alloc etc..
+	{
+		conPrint(std::string("DynamicTextureUpdaterThread: Caught std::exception: ") + e.what());
+	}
+}
 
-			{
-				Lock lock(world_state->mutex);
 
-				for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
-				{
-					ServerWorldState* world = world_it->second.ptr();
-					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
-					{
-						WorldObject* ob = it->second.ptr();
-						try
-						{
-							checkForDynamicTextureToCheck(/*world name=*/world_it->first, ob, world_state, obs_with_dyn_textures);
-						}
-						catch(glare::Exception& e)
-						{
-							conPrint("\tDynamicTextureUpdaterThread: exception while processing object: " + e.what());
-						}
-					}
-				}
-			} // End lock scope
+#if BUILD_TESTS
 
-			conPrint("DynamicTextureUpdaterThread: Iterating over objects took " + timer.elapsedStringNSigFigs(4) + ", obs_with_dyn_textures: " + toString(obs_with_dyn_textures.size()));
-			//----------------------------------------------------------------------------------------------------------------------------------------------------
 
-			//-------------------------------------------  Check each dynamic texture, without holding the world lock -------------------------------------------
-			conPrint("DynamicTextureUpdaterThread: Checking for image updates...");
-			timer.reset();
+#include <utils/TestUtils.h>
+#include <atomic>
+#include <set>
 
-			std::map<std::string, DynTextureFetchResults> fetch_results_map;
 
-			for(size_t i=0; i<obs_with_dyn_textures.size(); ++i)
+// Stands in for a web server serving images.  Supports If-Modified-Since with a per-URL modification counter instead of real dates.
+class TestDynTexFetcher : public DynTexFetcher
+{
+public:
+	TestDynTexFetcher() : num_requests(0), num_conditional_requests(0), num_concurrent(0), max_num_concurrent(0), fetch_delay_s(0), ignore_if_modified_since(false) {}
+
+	virtual DynTexFetchResponse fetch(const std::string& URL, const std::string& if_modified_since) override
+	{
+		num_requests++;
+		if(!if_modified_since.empty())
+			num_conditional_requests++;
+
+		const int cur_num_concurrent = ++num_concurrent;
+		int prev_max = max_num_concurrent;
+		while(cur_num_concurrent > prev_max && !max_num_concurrent.compare_exchange_weak(prev_max, cur_num_concurrent))
+		{}
+
+		if(fetch_delay_s > 0)
+			PlatformUtils::Sleep((int)(fetch_delay_s * 1000));
+
+		DynTexFetchResponse response;
+		{
+			Lock lock(mutex);
+			const auto res = images.find(URL);
+			if(res == images.end())
 			{
-				const ObWithDynamicTexture& ob_with_dyn_tex = obs_with_dyn_textures[i];
-				try
-				{
-					conPrint("DynamicTextureUpdaterThread: Checking dynamic texture for URL '" + ob_with_dyn_tex.script->base_image_URL + "'");
+				num_concurrent--;
+				throw glare::Exception("404 not found");
+			}
 
-					checkDynamicTexture(ob_with_dyn_tex, world_state, server, fetch_results_map);
-				}
-				catch(glare::Exception& e)
-				{
-					conPrint("\tDynamicTextureUpdaterThread: glare::Exception while checking dynamic texture changes: " + e.what());
-				}
+			if(!if_modified_since.empty() && !ignore_if_modified_since && (modified_since_last_fetch.count(URL) == 0))
+				response.response_code = 304;
+			else
+			{
+				response.response_code = 200;
+				response.mime_type = "image/png";
+				response.data = res->second;
 			}
-			conPrint("DynamicTextureUpdaterThread: Done checking for image updates textures. (Elapsed: " + timer.elapsedStringNSigFigs(4) + ")");
-			//----------------------------------------------------------------------------------------------------------------------------------------------------
+			modified_since_last_fetch.erase(URL);
 		}
+
+		num_concurrent--;
+		return response;
 	}
-	catch(glare::Exception& e)
+
+	void setImage(const std::string& URL, const std::string& data)
 	{
-		conPrint("DynamicTextureUpdaterThread: glare::Exception: " + e.what());
+		Lock lock(mutex);
+		images[URL] = data;
+		modified_since_last_fetch.insert(URL);
 	}
-	catch(std::exception& e) // catch std::bad_alloc etc..
+
+	Mutex mutex;
+	std::map<std::string, std::string> images;
+	std::set<std::string> modified_since_last_fetch;
+
+	std::atomic<int> num_requests;
+	std::atomic<int> num_conditional_requests;
+	std::atomic<int> num_concurrent;
+	std::atomic<int> max_num_concurrent;
+	double fetch_delay_s;
+	bool ignore_if_modified_since; // Simulate a server that doesn't support conditional requests.
+};
+
+
+static std::string makeTestPNGData(const std::string& content)
+{
+	const unsigned char png_magic[] = { 0x89, 0x50, 0x4E, 0x47, 0x0D, 0x0A, 0x1A, 0x0A };
+	return std::string((const char*)png_magic, sizeof(png_magic)) + content;
+}
+
+
+static WorldObjectRef makeTestDynTexObject(uint64 uid, const std::string& base_URL)
+{
+	WorldObjectRef ob = new WorldObject();
+	ob->uid = UID(uid);
+	ob->creator_id = UserID(1);
+	ob->materials.push_back(new WorldMaterial());
+	ob->script = "<script><dynamic_texture_update><base_url>" + base_URL + "</base_url></dynamic_texture_update></script>";
+	return ob;
+}
+
+
+void DynamicTextureUpdaterThread::test()
+{
+	conPrint("DynamicTextureUpdaterThread::test()");
+
+	const std::string resource_dir = PlatformUtils::getTempDirPath() + "/dyn_tex_test_resources";
+	FileUtils::createDirIfDoesNotExist(resource_dir);
+
+	Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+	world_state->resource_manager = new ResourceManager(resource_dir);
+
+	Reference<TestDynTexFetcher> fetcher = new TestDynTexFetcher();
+
+	Reference<DynamicTextureUpdaterThread> updater = new DynamicTextureUpdaterThread(/*server=*/NULL, world_state.ptr());
+	updater->fetcher = fetcher.ptr();
+
+	const std::string image_URL = "http://example.com/image.png";
+	fetcher->setImage(image_URL, makeTestPNGData("frame 1"));
+
+	WorldObjectRef ob_a = makeTestDynTexObject(1, image_URL);
+	WorldObjectRef ob_b = makeTestDynTexObject(2, image_URL); // Uses the same URL, should only be downloaded once.
 	{
-		conPrint(std::string("DynamicTextureUpdaterThread: Caught std::exception: ") + e.what());
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		UserRef user = new User();
+		user->id = UserID(1);
+		user->name = "dyntexuser";
+		user->flags = User::ALLOW_DYN_TEX_UPDATE_CHECKING;
+		world_state->addUser(user);
+
+		Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+		ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+		root_world->objects[ob_a->uid] = ob_a;
+		root_world->objects[ob_b->uid] = ob_b;
 	}
+
+	//-------------------- First update: should download the image and set the texture on both objects --------------------
+	{
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_obs == 2);
+		testAssert(stats.num_URLs == 1);
+		testAssert(stats.num_scripts_parsed == 1); // Both objects have the same script.
+		testAssert(stats.num_changed == 1);
+		testAssert(stats.num_obs_updated == 2);
+		testAssert(fetcher->num_requests == 1);
+		testAssert(fetcher->num_conditional_requests == 0);
+		testAssert(!ob_a->materials[0]->colour_texture_url.empty());
+		testAssert(ob_a->materials[0]->colour_texture_url == ob_b->materials[0]->colour_texture_url);
+		testAssert(world_state->resource_manager->isFileForURLPresent(ob_a->materials[0]->colour_texture_url));
+	}
+	const std::string frame_1_URL = ob_a->materials[0]->colour_texture_url;
+
+	//-------------------- Second update, image not modified: should send a conditional request and get a 304 --------------------
+	{
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_scripts_parsed == 0); // Scripts should be cached.
+		testAssert(stats.num_not_modified == 1);
+		testAssert(stats.num_changed == 0);
+		testAssert(stats.num_obs_updated == 0);
+		testAssert(fetcher->num_requests == 2);
+		testAssert(fetcher->num_conditional_requests == 1);
+		testAssert(ob_a->materials[0]->colour_texture_url == frame_1_URL);
+	}
+
+	//-------------------- Server ignores If-Modified-Since and sends the same image again: should be detected by content hash --------------------
+	{
+		fetcher->ignore_if_modified_since = true;
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_unchanged_content == 1);
+		testAssert(stats.num_changed == 0);
+		testAssert(stats.num_obs_updated == 0);
+		testAssert(ob_a->materials[0]->colour_texture_url == frame_1_URL);
+		fetcher->ignore_if_modified_since = false;
+	}
+
+	//-------------------- Image changes: objects should be updated to use the new image --------------------
+	{
+		fetcher->setImage(image_URL, makeTestPNGData("frame 2"));
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_changed == 1);
+		testAssert(stats.num_obs_updated == 2);
+		testAssert(ob_a->materials[0]->colour_texture_url != frame_1_URL);
+		testAssert(ob_b->materials[0]->colour_texture_url == ob_a->materials[0]->colour_texture_url);
+	}
+
+	//-------------------- Editing a script should cause it to be reparsed, failed fetches shouldn't change the object --------------------
+	{
+		const std::string frame_2_URL = ob_a->materials[0]->colour_texture_url;
+		{
+			ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+			Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+			ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+			ob_b->script = "<script><dynamic_texture_update><base_url>http://example.com/missing.png</base_url></dynamic_texture_update></script>";
+		}
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_scripts_parsed == 1);
+		testAssert(stats.num_URLs == 2);
+		testAssert(stats.num_fetch_failures == 1);
+		testAssert(ob_b->materials[0]->colour_texture_url == frame_2_URL);
+	}
+
+	//-------------------- Test that many URLs are fetched concurrently, with a bounded number of concurrent fetches --------------------
+	{
+		{
+			ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+			Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+			ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+			for(int i=0; i<32; ++i)
+			{
+				const std::string URL = "http://example.com/image_" + toString(i) + ".png";
+				fetcher->setImage(URL, makeTestPNGData("image " + toString(i)));
+				WorldObjectRef ob = makeTestDynTexObject(100 + i, URL);
+				root_world->objects[ob->uid] = ob;
+			}
+		}
+
+		fetcher->fetch_delay_s = 0.05;
+		fetcher->max_num_concurrent = 0;
+		const DynTexUpdateStats stats = updater->checkDynamicTextures();
+		testAssert(stats.num_changed == 32);
+		testAssert(stats.num_obs_updated == 32);
+		testAssert(fetcher->max_num_concurrent > 1);
+		testAssert(fetcher->max_num_concurrent <= (int)NUM_FETCH_THREADS);
+	}
+
+	conPrint("DynamicTextureUpdaterThread::test() done.");
 }
+
+
+#endif // BUILD_TESTS
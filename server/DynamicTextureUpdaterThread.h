@@ -7,11 +7,74 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "../shared/UID.h"
+#include "ServerSideScripting.h"
 #include <MessageableThread.h>
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <map>
+#include <string>
 class Server;
 class ServerAllWorldsState;
 
 
+struct DynTexFetchResponse
+{
+	int response_code;
+	std::string mime_type;
+	std::string data;
+};
+
+
+/*=====================================================================
+DynTexFetcher
+-------------
+Downloads base images for dynamic textures.  Overridden in tests, so we don't need a real HTTP server.
+fetch() is called from multiple threads at once.
+=====================================================================*/
+class DynTexFetcher : public ThreadSafeRefCounted
+{
+public:
+	virtual ~DynTexFetcher() {}
+
+	// If if_modified_since is non-empty, it is sent as an If-Modified-Since header, and the response code may be 304.
+	// Throws glare::Exception on failure.
+	virtual DynTexFetchResponse fetch(const std::string& URL, const std::string& if_modified_since) = 0;
+};
+
+
+class HTTPDynTexFetcher : public DynTexFetcher
+{
+public:
+	virtual DynTexFetchResponse fetch(const std::string& URL, const std::string& if_modified_since) override;
+};
+
+
+// What we know about a base image URL from previous update cycles.
+struct DynTexURLState
+{
+	DynTexURLState() : content_hash(0) {}
+
+	std::string substrata_URL; // URL of the resource for the last image downloaded from the URL.  Empty if never successfully downloaded.
+	uint64 content_hash; // Hash of the last image downloaded.
+	std::string last_fetch_HTTP_date; // Time the image was last downloaded, as an HTTP-date, for If-Modified-Since.
+};
+
+
+struct DynTexUpdateStats
+{
+	DynTexUpdateStats() : num_obs(0), num_URLs(0), num_scripts_parsed(0), num_fetch_failures(0), num_not_modified(0), num_unchanged_content(0), num_changed(0), num_obs_updated(0) {}
+
+	size_t num_obs; // Number of objects with dynamic textures that are allowed to be checked.
+	size_t num_URLs; // Number of unique base image URLs.
+	size_t num_scripts_parsed; // Number of scripts that weren't in the script cache.
+	size_t num_fetch_failures;
+	size_t num_not_modified; // Number of 304 responses.
+	size_t num_unchanged_content; // Number of downloads that had the same content as last time.
+	size_t num_changed; // Number of downloads that had new content (including the first download for each URL).
+	size_t num_obs_updated; // Number of objects that had a texture URL changed.
+};
+
+
 /*=====================================================================
 DynamicTextureUpdaterThread
 ---------------------------
@@ -20,6 +83,10 @@ These scripts download an image from a fixed URL periodically,
 and if the image changes, add it as a resource to the substrata server,
 and assign the image to the specified object material.
 
+Base images are downloaded concurrently, on NUM_FETCH_THREADS threads, and each unique URL is downloaded once per update.
+Requests are conditional (If-Modified-Since the last download), and images with the same content hash as the last download
+are not added as resources again.  Parsed scripts are cached by script content, so scripts are only parsed when they change.
+
 Note that this code runs on the server, so we have to be a bit careful with it.
 =====================================================================*/
 class DynamicTextureUpdaterThread : public MessageableThread
@@ -31,7 +98,20 @@ public:
 
 	virtual void doRun();
 
+	static const size_t NUM_FETCH_THREADS = 8;
+
+	// Runs a single update: finds objects with dynamic texture scripts, downloads their base images, and updates the objects if the images changed.
+	// Called from doRun(), or directly in tests.
+	DynTexUpdateStats checkDynamicTextures();
+
+	static void test();
+
+	Reference<DynTexFetcher> fetcher;
+
 private:
-	Server* server;
+	Server* server; // May be NULL in tests.
 	ServerAllWorldsState* world_state;
+
+	std::map<std::string, DynTexURLState> url_states; // Map from base image URL to state.  Only accessed by this thread.
+	std::map<uint64, Reference<ServerSideScripting::ServerSideScript>> script_cache; // Map from hash of script text to parsed script (NULL if the script has no dynamic texture update).
 };
@@ -17,6 +17,7 @@ Code By Nicholas Chapman.
 #include <KillThreadMessage.h>
 #include <Exception.h>
 #include <Timer.h>
+#include <Clock.h>
 #include <tls.h>
 #include <TLSSocket.h>
 
@@ -80,6 +81,10 @@ void ListenerThread::doRun()
 				MySocketRef plain_worker_sock = sock->acceptConnection(); // Blocks
 				plain_worker_sock->setUseNetworkByteOrder(false);
 
+				// Drop connections from IP addresses that are connecting too often, before doing the TLS handshake or creating a worker thread.
+				if(!server->rate_limiters.connections.tryConsume(plain_worker_sock->getOtherEndIPAddress().toString(), Clock::getTimeSinceInit()))
+					continue; // Socket is closed when plain_worker_sock goes out of scope.
+
 				conPrint("Client connected from " + IPAddress::formatIPAddressAndPort(plain_worker_sock->getOtherEndIPAddress(), plain_worker_sock->getOtherEndPort()));
 
 				plain_worker_sock->enableTCPKeepAlive(30.f); // Some connections seem to get stuck doing nothing for long periods, so enable keepalive to kill them.
@@ -0,0 +1,222 @@
+/*=====================================================================
+LockProfiler.cpp
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "LockProfiler.h"
+
+
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <algorithm>
+#include <cstring>
+
+
+static std::atomic<LockProfilerSite*> first_site(NULL);
+
+
+std::atomic<bool> LockProfiler::profiling_enabled(false);
+
+
+LockProfilerSite::LockProfilerSite(const char* file_, int line_, const char* name_)
+:	file(file_),
+	line(line_),
+	name(name_),
+	next_site(NULL)
+{
+	LockProfiler::registerSite(this);
+}
+
+
+std::string LockProfilerSite::description() const
+{
+	// Strip off the directory part of the path, __FILE__ may be a full path.
+	const char* filename = file;
+	for(const char* c = file; *c != '\0'; ++c)
+		if(*c == '/' || *c == '\\')
+			filename = c + 1;
+
+	std::string s = std::string(filename) + ":" + toString(line);
+	if(name)
+		s += " (" + std::string(name) + ")";
+	return s;
+}
+
+
+void LockProfiler::setEnabled(bool enabled)
+{
+	profiling_enabled.store(enabled);
+}
+
+
+void LockProfiler::registerSite(LockProfilerSite* site)
+{
+	// Push onto the front of the singly-linked list.  Sites are never removed, so this is all we need to do.
+	LockProfilerSite* head = first_site.load();
+	do
+	{
+		site->next_site = head;
+	}
+	while(!first_site.compare_exchange_weak(head, site));
+}
+
+
+void LockProfiler::getSiteStats(std::vector<SiteStats>& stats_out)
+{
+	stats_out.clear();
+
+	uint64 counts[MetricHistogram::NUM_BUCKETS];
+	for(const LockProfilerSite* site = first_site.load(); site != NULL; site = site->next_site)
+	{
+		SiteStats stats;
+		stats.site = site;
+
+		uint64 hold_count;
+		site->hold_time.getTotals(counts, hold_count, stats.total_hold_s);
+		uint64 wait_count;
+		site->wait_time.getTotals(counts, wait_count, stats.total_wait_s);
+
+		if(wait_count == 0)
+			continue;
+
+		stats.num_acquisitions = wait_count;
+		stats.wait_p99_s = site->wait_time.getQuantileUpperBound(0.99);
+		stats.hold_p99_s = site->hold_time.getQuantileUpperBound(0.99);
+		stats_out.push_back(stats);
+	}
+
+	std::sort(stats_out.begin(), stats_out.end(), [](const SiteStats& a, const SiteStats& b) { return a.total_hold_s > b.total_hold_s; });
+}
+
+
+std::string LockProfiler::getWorstHoldersReport(size_t max_num_sites)
+{
+	std::vector<SiteStats> stats;
+	getSiteStats(stats);
+
+	std::string s = "World state mutex: worst holders (of " + toString(stats.size()) + " sites):\n";
+	for(size_t i=0; i<std::min(max_num_sites, stats.size()); ++i)
+	{
+		s += "  " + stats[i].site->description() + ": " + toString(stats[i].num_acquisitions) + " acquisitions, total hold " + doubleToStringMaxNDecimalPlaces(stats[i].total_hold_s, 3) +
+			" s, total wait " + doubleToStringMaxNDecimalPlaces(stats[i].total_wait_s, 3) + " s, p99 hold <= " + doubleToStringMaxNDecimalPlaces(stats[i].hold_p99_s * 1.0e3, 3) +
+			" ms, p99 wait <= " + doubleToStringMaxNDecimalPlaces(stats[i].wait_p99_s * 1.0e3, 3) + " ms\n";
+	}
+	return s;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/MyThread.h>
+#include <utils/PlatformUtils.h>
+
+
+class LockProfilerTestThread : public MyThread
+{
+public:
+	LockProfilerTestThread(::Mutex* mutex_, int num_iters_) : mutex(mutex_), num_iters(num_iters_) {}
+
+	virtual void run()
+	{
+		for(int i=0; i<num_iters; ++i)
+		{
+			ProfiledLock lock(*mutex, LOCK_PROFILER_NAMED_SITE("LockProfiler test thread"));
+			counter++;
+		}
+	}
+
+	static int counter;
+	::Mutex* mutex;
+	int num_iters;
+};
+
+int LockProfilerTestThread::counter = 0;
+
+
+static const LockProfilerSite* findSiteWithName(const std::vector<LockProfiler::SiteStats>& stats, const char* name, size_t& index_out)
+{
+	for(size_t i=0; i<stats.size(); ++i)
+		if(stats[i].site->name && (std::strcmp(stats[i].site->name, name) == 0))
+		{
+			index_out = i;
+			return stats[i].site;
+		}
+	return NULL;
+}
+
+
+void LockProfiler::test()
+{
+	conPrint("LockProfiler::test()");
+
+	const bool was_enabled = isEnabled();
+
+	::Mutex mutex;
+
+	//-------------------- Test that nothing is recorded when profiling is disabled --------------------
+	{
+		setEnabled(false);
+		{
+			ProfiledLock lock(mutex, LOCK_PROFILER_NAMED_SITE("LockProfiler test disabled"));
+		}
+
+		std::vector<SiteStats> stats;
+		getSiteStats(stats);
+		size_t index;
+		testAssert(findSiteWithName(stats, "LockProfiler test disabled", index) == NULL);
+	}
+
+	//-------------------- Test counting acquisitions from multiple threads --------------------
+	{
+		setEnabled(true);
+
+		const int num_threads = 8;
+		const int num_iters = 1000;
+		std::vector<Reference<LockProfilerTestThread>> threads;
+		for(int i=0; i<num_threads; ++i)
+		{
+			threads.push_back(new LockProfilerTestThread(&mutex, num_iters));
+			threads.back()->launch();
+		}
+		for(size_t i=0; i<threads.size(); ++i)
+			threads[i]->join();
+
+		testAssert(LockProfilerTestThread::counter == num_threads * num_iters);
+
+		// A single long hold, which should be the worst holder.
+		{
+			ProfiledLock lock(mutex, LOCK_PROFILER_NAMED_SITE("LockProfiler test long hold"));
+			PlatformUtils::Sleep(20);
+		}
+
+		std::vector<SiteStats> stats;
+		getSiteStats(stats);
+
+		size_t index;
+		testAssert(findSiteWithName(stats, "LockProfiler test thread", index) != NULL);
+		testAssert(stats[index].num_acquisitions == (uint64)num_threads * num_iters);
+
+		testAssert(findSiteWithName(stats, "LockProfiler test long hold", index) != NULL);
+		testAssert(stats[index].num_acquisitions == 1);
+		testAssert(stats[index].total_hold_s >= 0.015);
+		testAssert(stats[index].hold_p99_s >= 0.01);
+
+		// Stats should be sorted by decreasing total hold time.
+		for(size_t i=1; i<stats.size(); ++i)
+			testAssert(stats[i-1].total_hold_s >= stats[i].total_hold_s);
+
+		const std::string report = getWorstHoldersReport(/*max num sites=*/100);
+		conPrint(report);
+		testAssert(report.find("LockProfiler.cpp:") != std::string::npos);
+		testAssert(report.find("(LockProfiler test long hold)") != std::string::npos);
+	}
+
+	setEnabled(was_enabled);
+
+	conPrint("LockProfiler::test() done.");
+}
+
+
+#endif // BUILD_TESTS
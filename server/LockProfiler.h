@@ -0,0 +1,140 @@
+/*=====================================================================
+LockProfiler.h
+--------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ServerMetrics.h"
+#include <Mutex.h>
+#include <Platform.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+LockProfilerSite
+----------------
+Wait-time and hold-time histograms for a single place in the code where a mutex is acquired.
+Constructed as a function-local static by the LOCK_PROFILER_SITE() macro, so each site is
+constructed and registered once, the first time it is executed, and lives until the program exits.
+=====================================================================*/
+class LockProfilerSite
+{
+public:
+	LockProfilerSite(const char* file, int line, const char* name);
+
+	// Returns something like "WorkerThread.cpp:1234", or "WorkerThread.cpp:1234 (name)" if a name was given.
+	std::string description() const;
+
+	const char* file;
+	int line;
+	const char* name; // May be NULL.
+
+	MetricHistogram wait_time; // Time spent blocked waiting to acquire the mutex.
+	MetricHistogram hold_time; // Time the mutex was held for.
+
+	LockProfilerSite* next_site; // Next site in the list of all registered sites.
+
+private:
+	GLARE_DISABLE_COPY(LockProfilerSite);
+};
+
+
+/*=====================================================================
+LockProfiler
+------------
+Optional contention profiling for the world state mutex (ServerAllWorldsState::mutex).
+Disabled by default, in which case ProfiledLock just costs a relaxed atomic load over a plain Lock.
+Enabled with the profile_world_state_mutex server config option, or from the admin lock profile page.
+=====================================================================*/
+namespace LockProfiler
+{
+	extern std::atomic<bool> profiling_enabled;
+
+	inline bool isEnabled() { return profiling_enabled.load(std::memory_order_relaxed); }
+	void setEnabled(bool enabled);
+
+	inline uint64 getCurTimeNs() { return (uint64)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	void registerSite(LockProfilerSite* site); // Threadsafe
+
+	struct SiteStats
+	{
+		const LockProfilerSite* site;
+		uint64 num_acquisitions;
+		double total_wait_s;
+		double total_hold_s;
+		double wait_p99_s; // Upper bound of histogram bucket
+		double hold_p99_s; // Upper bound of histogram bucket
+	};
+
+	// Gets stats for all sites that have been acquired at least once while profiling was enabled, sorted by decreasing total hold time.
+	void getSiteStats(std::vector<SiteStats>& stats_out);
+
+	// Returns a multi-line report of the sites with the largest total hold times, for printing to the log.
+	std::string getWorstHoldersReport(size_t max_num_sites);
+
+	void test();
+}
+
+
+/*=====================================================================
+ProfiledLock
+------------
+Scoped lock like Lock, that records wait and hold times to the given site when profiling is enabled.
+Usage:
+
+ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+=====================================================================*/
+class SCOPED_CAPABILITY ProfiledLock
+{
+public:
+	inline ProfiledLock(::Mutex& mutex_, LockProfilerSite* site_) ACQUIRE(mutex_)
+	:	mutex(mutex_)
+	{
+		if(LockProfiler::isEnabled())
+		{
+			site = site_;
+			const uint64 wait_start_time = LockProfiler::getCurTimeNs();
+			mutex.acquire();
+			acquired_time = LockProfiler::getCurTimeNs();
+			site->wait_time.recordDuration((double)(acquired_time - wait_start_time) * 1.0e-9);
+		}
+		else
+		{
+			site = NULL;
+			acquired_time = 0;
+			mutex.acquire();
+		}
+	}
+
+	inline ~ProfiledLock() RELEASE()
+	{
+		if(site)
+		{
+			const uint64 hold_time_ns = LockProfiler::getCurTimeNs() - acquired_time;
+			mutex.release();
+			site->hold_time.recordDuration((double)hold_time_ns * 1.0e-9); // Record after releasing so we don't extend the hold time.
+		}
+		else
+			mutex.release();
+	}
+
+private:
+	GLARE_DISABLE_COPY(ProfiledLock);
+
+	::Mutex& mutex;
+	LockProfilerSite* site; // NULL if profiling was disabled when the lock was acquired.
+	uint64 acquired_time;
+};
+
+
+// Evaluates to a pointer to a LockProfilerSite unique to this place in the source.
+#define LOCK_PROFILER_SITE() ([]() -> LockProfilerSite* { static LockProfilerSite lock_profiler_site(__FILE__, __LINE__, NULL); return &lock_profiler_site; }())
+
+// As above, but with a name for the site, for e.g. when a single site covers a long-running operation.
+#define LOCK_PROFILER_NAMED_SITE(site_name) ([]() -> LockProfilerSite* { static LockProfilerSite lock_profiler_site(__FILE__, __LINE__, site_name); return &lock_profiler_site; }())
@@ -78,6 +78,7 @@ struct MeshLODGenThreadTexInfo
 
 
 // Set object world space AABB if not set yet, or if it's incorrect.
+// The object and the world dirty set are protected by world->mutex, which the caller must hold.  Doesn't lock world_state->mutex.
 static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldState* world, WorldObject* ob)
 {
 	try
@@ -117,10 +118,7 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 
 				/*const int new_max_lod_level = (voxel_group.voxels.size() > 256) ? 2 : 0;
 				if(new_max_lod_level != ob->max_model_lod_level)
-				{
-					Lock lock(world_state->mutex);
 					world->addWorldObjectAsDBDirty(ob);
-				}
 
 				ob->max_model_lod_level = new_max_lod_level;*/
 			}
@@ -147,8 +145,6 @@ static void checkObjectSpaceAABB(ServerAllWorldsState* world_state, ServerWorldS
 		// Compute and assign aabb_ws to object.
 		if(!aabb_os.isEmpty()) // If we got a valid aabb_os:
 		{
-			Lock lock(world_state->mutex);
-
 			const bool updating_aabb_ws = !(approxEq(aabb_os.min_, ob->getAABBOS().min_) && approxEq(aabb_os.max_, ob->getAABBOS().max_)); //aabb_os != ob->getAABBOS();
 			if(updating_aabb_ws)
 			{
@@ -187,10 +183,7 @@ static void checkForLODMeshesToGenerate(ServerAllWorldsState* world_state, Serve
 				
 				const int new_max_lod_level = (batched_mesh->numVerts() <= 4 * 6) ? 0 : 2; // If this is a very small model (e.g. a cuboid), don't generate LOD versions of it.
 				if(new_max_lod_level != ob->max_model_lod_level)
-				{
-					Lock lock(world_state->mutex);
 					world->addWorldObjectAsDBDirty(ob);
-				}
 
 				ob->max_model_lod_level = new_max_lod_level;
 				*/
@@ -310,10 +303,7 @@ static void checkMaterialFlags(ServerAllWorldsState* world_state, ServerWorldSta
 
 							if(mat->flags != old_flags)
 							{
-								{
-									Lock lock(world_state->mutex);
-									world->addWorldObjectAsDBDirty(ob);
-								}
+								world->addWorldObjectAsDBDirty(ob); // Caller holds world->mutex.
 								conPrint("Updated mat flags: (for mat with tex " + tex_abs_path + "): is_hi_res: " + boolToString(is_high_res));
 							}
 						}
@@ -497,13 +487,21 @@ void MeshLODGenThread::doRun()
 			Timer timer;
 			
 			{
-				Lock lock(world_state->mutex);
+				// Take a snapshot of the world list while holding the all-worlds mutex, then process each world while holding just its own mutex.
+				std::vector<Reference<ServerWorldState>> worlds;
+				{
+					ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+					worlds.reserve(world_state->world_states.size());
+					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+						worlds.push_back(world_it->second);
+				}
 
 				if(do_initial_full_scan)
 				{
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
 						for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 						{
 							WorldObject* ob = it->second.ptr();
@@ -530,9 +528,10 @@ void MeshLODGenThread::doRun()
 				else
 				{
 					// Look up object for UID
-					for(auto world_it = world_state->world_states.begin(); world_it != world_state->world_states.end(); ++world_it)
+					for(size_t w=0; w<worlds.size(); ++w)
 					{
-						ServerWorldState* world = world_it->second.ptr();
+						ServerWorldState* world = worlds[w].ptr();
+						ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
 						auto res = world->objects.find(ob_to_scan_UID);
 						if(res != world->objects.end())
 						{
@@ -571,7 +570,7 @@ void MeshLODGenThread::doRun()
 
 					// Now that we have generated the LOD model, add it to resources.
 					{ // lock scope
-						Lock lock(world_state->mutex);
+						ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 						const std::string raw_path = FileUtils::getFilename(mesh_to_gen.LOD_model_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
 
@@ -611,7 +610,7 @@ void MeshLODGenThread::doRun()
 
 					// Now that we have generated the LOD model, add it to resources.
 					{ // lock scope
-						Lock lock(world_state->mutex);
+						ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 						const std::string raw_path = FileUtils::getFilename(tex_to_gen.LOD_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
 
@@ -652,7 +651,7 @@ void MeshLODGenThread::doRun()
 
 					// Now that we have generated the LOD model, add it to resources.
 					{ // lock scope
-						Lock lock(world_state->mutex);
+						ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 						const std::string raw_path = FileUtils::getFilename(tex_to_gen.ktx_tex_abs_path); // NOTE: assuming we can get raw/relative path from abs path like this.
 
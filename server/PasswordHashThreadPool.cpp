@@ -0,0 +1,229 @@
+/*=====================================================================
+PasswordHashThreadPool.cpp
+--------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "PasswordHashThreadPool.h"
+
+
+#include <Lock.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <PlatformUtils.h>
+
+
+class PasswordHashThread : public MyThread
+{
+public:
+	PasswordHashThread(ThreadSafeQueue<PasswordHashTaskRef>* task_queue_) : task_queue(task_queue_) {}
+
+	virtual void run()
+	{
+		PlatformUtils::setCurrentThreadName("PasswordHashThread");
+
+		while(1)
+		{
+			PasswordHashTaskRef task;
+			task_queue->dequeue(task);
+			if(task.isNull())
+				return; // Quit message
+
+			std::string result_hash, error_msg;
+			bool failed = false;
+			try
+			{
+				result_hash = PasswordHashing::computeHash(task->password, task->salt, task->params);
+			}
+			catch(glare::Exception& e)
+			{
+				error_msg = e.what();
+				failed = true;
+			}
+			catch(std::bad_alloc&)
+			{
+				error_msg = "Out of memory while hashing password";
+				failed = true;
+			}
+
+			{
+				Lock lock(task->mutex);
+				task->result_hash = result_hash;
+				task->error_msg = error_msg;
+				task->failed = failed;
+				task->done = true;
+				task->done_cond.notify();
+			}
+		}
+	}
+
+	ThreadSafeQueue<PasswordHashTaskRef>* task_queue;
+};
+
+
+PasswordHashThreadPool::PasswordHashThreadPool(int num_threads, size_t max_queue_size_)
+:	max_queue_size(max_queue_size_),
+	num_queued_or_running(0)
+{
+	for(int i=0; i<num_threads; ++i)
+	{
+		threads.push_back(new PasswordHashThread(&task_queue));
+		threads.back()->launch();
+	}
+}
+
+
+PasswordHashThreadPool::~PasswordHashThreadPool()
+{
+	// Tasks are processed in order, so any tasks already queued will be done before the threads see the quit messages.
+	for(size_t i=0; i<threads.size(); ++i)
+		task_queue.enqueue(PasswordHashTaskRef());
+
+	for(size_t i=0; i<threads.size(); ++i)
+		threads[i]->join();
+}
+
+
+std::string PasswordHashThreadPool::computeHash(const std::string& password, const std::string& salt, const PasswordHashParams& params)
+{
+	if(num_queued_or_running.fetch_add(1) >= max_queue_size)
+	{
+		num_queued_or_running--;
+		throw glare::Exception("Server is busy, please try again later.");
+	}
+
+	PasswordHashTaskRef task = new PasswordHashTask();
+	task->password = password;
+	task->salt = salt;
+	task->params = params;
+
+	task_queue.enqueue(task);
+
+	std::string result_hash, error_msg;
+	bool failed;
+	{
+		Lock lock(task->mutex);
+		while(!task->done)
+			task->done_cond.wait(task->mutex); // Suspend thread until the task is done.
+		result_hash = task->result_hash;
+		error_msg = task->error_msg;
+		failed = task->failed;
+	}
+
+	num_queued_or_running--;
+
+	if(failed)
+		throw glare::Exception(error_msg);
+
+	return result_hash;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/Timer.h>
+
+
+class PasswordHashTestThread : public MyThread
+{
+public:
+	PasswordHashTestThread(PasswordHashThreadPool* pool_, int index_) : pool(pool_), index(index_), succeeded(false), got_busy_exception(false) {}
+
+	virtual void run()
+	{
+		try
+		{
+			const PasswordHashParams params(PasswordHashParams::Scheme_BalloonSHA256, 1 << 12, 2);
+			result = pool->computeHash("password" + toString(index), "salt", params);
+			succeeded = result == PasswordHashing::computeHash("password" + toString(index), "salt", params);
+		}
+		catch(glare::Exception&)
+		{
+			got_busy_exception = true;
+		}
+	}
+
+	PasswordHashThreadPool* pool;
+	int index;
+	std::string result;
+	bool succeeded;
+	bool got_busy_exception;
+};
+
+
+void PasswordHashThreadPool::test()
+{
+	conPrint("PasswordHashThreadPool::test()");
+
+	//-------------------- Test basic hashing --------------------
+	{
+		Reference<PasswordHashThreadPool> pool = new PasswordHashThreadPool(/*num threads=*/2, /*max queue size=*/16);
+
+		const PasswordHashParams params(PasswordHashParams::Scheme_BalloonSHA256, 64, 1);
+		testAssert(pool->computeHash("password", "salt", params) == PasswordHashing::computeHash("password", "salt", params));
+		testAssert(pool->computeHash("password", "salt", PasswordHashParams()) == PasswordHashing::computeSaltedSHA256Hash("password", "salt"));
+		testAssert(pool->getNumQueuedOrRunning() == 0);
+
+		// Invalid params should result in an exception on the calling thread, and shouldn't stop the pool.
+		try
+		{
+			pool->computeHash("password", "salt", PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 0, 0));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+		testAssert(pool->getNumQueuedOrRunning() == 0);
+		testAssert(pool->computeHash("password", "salt", params) == PasswordHashing::computeHash("password", "salt", params));
+	}
+
+	//-------------------- Test many concurrent callers, with a queue large enough for all of them --------------------
+	{
+		Reference<PasswordHashThreadPool> pool = new PasswordHashThreadPool(/*num threads=*/2, /*max queue size=*/16);
+
+		std::vector<Reference<PasswordHashTestThread>> threads;
+		for(int i=0; i<16; ++i)
+		{
+			threads.push_back(new PasswordHashTestThread(pool.ptr(), i));
+			threads.back()->launch();
+		}
+		for(size_t i=0; i<threads.size(); ++i)
+		{
+			threads[i]->join();
+			testAssert(threads[i]->succeeded);
+			testAssert(!threads[i]->got_busy_exception);
+		}
+		testAssert(pool->getNumQueuedOrRunning() == 0);
+	}
+
+	//-------------------- Test that callers beyond the queue limit are rejected --------------------
+	{
+		Reference<PasswordHashThreadPool> pool = new PasswordHashThreadPool(/*num threads=*/1, /*max queue size=*/2);
+
+		std::vector<Reference<PasswordHashTestThread>> threads;
+		for(int i=0; i<32; ++i)
+		{
+			threads.push_back(new PasswordHashTestThread(pool.ptr(), i));
+			threads.back()->launch();
+		}
+		int num_succeeded = 0;
+		int num_busy = 0;
+		for(size_t i=0; i<threads.size(); ++i)
+		{
+			threads[i]->join();
+			testAssert(threads[i]->succeeded != threads[i]->got_busy_exception);
+			if(threads[i]->succeeded) num_succeeded++;
+			if(threads[i]->got_busy_exception) num_busy++;
+		}
+		conPrint("num_succeeded: " + toString(num_succeeded) + ", num_busy: " + toString(num_busy));
+		testAssert(num_succeeded >= 1);
+		testAssert(num_succeeded + num_busy == 32);
+		testAssert(pool->getNumQueuedOrRunning() == 0);
+	}
+
+	conPrint("PasswordHashThreadPool::test() done.");
+}
+
+
+#endif // BUILD_TESTS
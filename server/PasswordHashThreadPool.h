@@ -0,0 +1,80 @@
+/*=====================================================================
+PasswordHashThreadPool.h
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "PasswordHashing.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <ThreadSafeQueue.h>
+#include <MyThread.h>
+#include <Mutex.h>
+#include <Condition.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+
+class PasswordHashTask : public ThreadSafeRefCounted
+{
+public:
+	PasswordHashTask() : done(false), failed(false) {}
+
+	std::string password;
+	std::string salt;
+	PasswordHashParams params;
+
+	// Set by the pool thread.
+	std::string result_hash;
+	std::string error_msg; // Set if failed is true.
+	bool done;
+	bool failed;
+
+	Mutex mutex; // Protects done, failed and the results.
+	Condition done_cond;
+};
+typedef Reference<PasswordHashTask> PasswordHashTaskRef;
+
+
+class PasswordHashThread;
+
+
+/*=====================================================================
+PasswordHashThreadPool
+----------------------
+A fixed number of threads that compute password hashes.
+
+Password hashing is deliberately slow and memory-hungry, so instead of hashing on whichever
+web or worker thread handles a login, hashes are computed here.  This bounds the CPU and memory
+used by hashing to num_threads hashes at a time, no matter how many logins arrive at once.
+Callers block until their hash is done, but don't hold any world state locks while waiting,
+so players already in-world aren't affected by a burst of logins.
+
+If more than max_queue_size hashes are waiting, computeHash() throws instead of queueing, so
+a login storm gets 'server busy' errors rather than an ever-growing backlog.
+=====================================================================*/
+class PasswordHashThreadPool : public ThreadSafeRefCounted
+{
+public:
+	PasswordHashThreadPool(int num_threads, size_t max_queue_size);
+	~PasswordHashThreadPool(); // Finishes any queued tasks, then stops and joins the threads.
+
+	// Computes PasswordHashing::computeHash() on a pool thread, blocking until done.  Threadsafe.
+	// Throws glare::Exception if the queue is full, or if hashing failed.
+	std::string computeHash(const std::string& password, const std::string& salt, const PasswordHashParams& params);
+
+	size_t getNumQueuedOrRunning() const { return num_queued_or_running.load(); }
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(PasswordHashThreadPool);
+
+	ThreadSafeQueue<PasswordHashTaskRef> task_queue; // A NULL task tells a thread to exit.
+	std::vector<Reference<PasswordHashThread>> threads;
+	size_t max_queue_size;
+	std::atomic<size_t> num_queued_or_running;
+};
@@ -0,0 +1,304 @@
+/*=====================================================================
+PasswordHashing.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "PasswordHashing.h"
+
+
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <SHA256.h>
+#include <Base64.h>
+#include <CryptoRNG.h>
+#include <vector>
+#include <cstring>
+
+
+static const uint32 MAX_SPACE_COST = 1 << 22; // 128 MB
+static const uint32 MAX_TIME_COST = 64;
+
+
+bool PasswordHashParams::isWeakerThan(const PasswordHashParams& other) const
+{
+	if(scheme != other.scheme)
+		return scheme < other.scheme; // Later schemes are stronger.
+
+	if(scheme == Scheme_SaltedSHA256)
+		return false;
+
+	return (space_cost < other.space_cost) || (time_cost < other.time_cost);
+}
+
+
+PasswordHashParams PasswordHashing::defaultParams()
+{
+	return PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, /*space cost=*/1 << 14, /*time cost=*/2);
+}
+
+
+void PasswordHashing::checkParamsValid(const PasswordHashParams& params)
+{
+	if(params.scheme == PasswordHashParams::Scheme_SaltedSHA256)
+		return;
+	else if(params.scheme == PasswordHashParams::Scheme_BalloonSHA256)
+	{
+		if(params.space_cost < 1 || params.space_cost > MAX_SPACE_COST)
+			throw glare::Exception("Invalid password hash space cost " + toString(params.space_cost));
+		if(params.time_cost < 1 || params.time_cost > MAX_TIME_COST)
+			throw glare::Exception("Invalid password hash time cost " + toString(params.time_cost));
+	}
+	else
+		throw glare::Exception("Unknown password hash scheme " + toString(params.scheme));
+}
+
+
+std::string PasswordHashing::computeHash(const std::string& password, const std::string& salt, const PasswordHashParams& params)
+{
+	checkParamsValid(params);
+
+	if(params.scheme == PasswordHashParams::Scheme_SaltedSHA256)
+		return computeSaltedSHA256Hash(password, salt);
+	else
+		return computeBalloonSHA256Hash(password, salt, params.space_cost, params.time_cost);
+}
+
+
+std::string PasswordHashing::computeSaltedSHA256Hash(const std::string& password, const std::string& salt)
+{
+	const std::string message = "jdfrY%TFkj&Cg&------" + password + "------" + salt;
+
+	std::vector<unsigned char> digest;
+	SHA256::hash((const unsigned char*)&(*message.begin()), (const unsigned char*)&(*message.begin()) + message.size(), digest);
+
+	std::string digest_str;
+	digest_str.resize(digest.size());
+	std::memcpy(&digest_str[0], digest.data(), digest.size());
+	return digest_str;
+}
+
+
+static const size_t BLOCK_SIZE = 32; // SHA-256 digest size
+
+
+static inline void writeLE64(uint64 x, uint8* dest)
+{
+	for(int i=0; i<8; ++i)
+		dest[i] = (uint8)(x >> (8 * i));
+}
+
+
+static inline uint64 readLE64(const uint8* src)
+{
+	uint64 x = 0;
+	for(int i=0; i<8; ++i)
+		x |= (uint64)src[i] << (8 * i);
+	return x;
+}
+
+
+// Hashes counter || a || b (b may be empty), writing the digest to dest, and increments counter.
+static inline void hashBlocks(uint64& counter, const uint8* a, size_t a_len, const uint8* b, size_t b_len, std::vector<uint8>& msg, std::vector<unsigned char>& digest, uint8* dest)
+{
+	msg.resize(8 + a_len + b_len);
+	writeLE64(counter++, msg.data());
+	if(a_len > 0) std::memcpy(msg.data() + 8, a, a_len);
+	if(b_len > 0) std::memcpy(msg.data() + 8 + a_len, b, b_len);
+
+	SHA256::hash(msg.data(), msg.data() + msg.size(), digest);
+	std::memcpy(dest, digest.data(), BLOCK_SIZE);
+}
+
+
+// Balloon hashing, see 'Balloon Hashing: A Memory-Hard Function Providing Provable Protection Against Sequential Attacks', Boneh, Corrigan-Gibbs, Schechter, 2016.
+// Uses delta = 3 dependencies per block.
+std::string PasswordHashing::computeBalloonSHA256Hash(const std::string& password, const std::string& salt, uint32 space_cost, uint32 time_cost)
+{
+	if(space_cost < 1 || space_cost > MAX_SPACE_COST || time_cost < 1 || time_cost > MAX_TIME_COST)
+		throw glare::Exception("Invalid balloon hash costs");
+
+	const int DELTA = 3;
+
+	std::vector<uint8> buf(space_cost * BLOCK_SIZE);
+	std::vector<uint8> msg;
+	msg.reserve(8 + password.size() + salt.size() + 2 * BLOCK_SIZE);
+	std::vector<unsigned char> digest;
+	uint64 counter = 0;
+
+	// Step 1: Expand input into buffer
+	hashBlocks(counter, (const uint8*)password.data(), password.size(), (const uint8*)salt.data(), salt.size(), msg, digest, &buf[0]);
+	for(size_t m=1; m<space_cost; ++m)
+		hashBlocks(counter, &buf[(m - 1) * BLOCK_SIZE], BLOCK_SIZE, NULL, 0, msg, digest, &buf[m * BLOCK_SIZE]);
+
+	// Step 2: Mix buffer contents
+	uint8 index_block[24];
+	uint8 other_index_digest[BLOCK_SIZE];
+	for(uint64 t=0; t<time_cost; ++t)
+		for(uint64 m=0; m<space_cost; ++m)
+		{
+			// Hash previous and current blocks
+			const size_t prev = (size_t)((m + space_cost - 1) % space_cost);
+			hashBlocks(counter, &buf[prev * BLOCK_SIZE], BLOCK_SIZE, &buf[m * BLOCK_SIZE], BLOCK_SIZE, msg, digest, &buf[m * BLOCK_SIZE]);
+
+			// Hash in pseudorandomly chosen blocks
+			for(uint64 i=0; i<DELTA; ++i)
+			{
+				writeLE64(t, index_block);
+				writeLE64(m, index_block + 8);
+				writeLE64(i, index_block + 16);
+				hashBlocks(counter, (const uint8*)salt.data(), salt.size(), index_block, sizeof(index_block), msg, digest, other_index_digest);
+				const size_t other = (size_t)(readLE64(other_index_digest) % space_cost);
+
+				hashBlocks(counter, &buf[m * BLOCK_SIZE], BLOCK_SIZE, &buf[other * BLOCK_SIZE], BLOCK_SIZE, msg, digest, &buf[m * BLOCK_SIZE]);
+			}
+		}
+
+	// Step 3: Extract output from buffer
+	return std::string((const char*)&buf[(space_cost - 1) * BLOCK_SIZE], BLOCK_SIZE);
+}
+
+
+std::string PasswordHashing::generateSalt()
+{
+	uint8 random_bytes[32];
+	CryptoRNG::getRandomBytes(random_bytes, 32); // throws glare::Exception
+
+	std::string salt;
+	Base64::encode(random_bytes, 32, salt); // Convert random bytes to base-64.
+	return salt;
+}
+
+
+bool PasswordHashing::hashesEqual(const std::string& a, const std::string& b)
+{
+	if(a.size() != b.size())
+		return false;
+
+	uint8 diff = 0;
+	for(size_t i=0; i<a.size(); ++i)
+		diff |= (uint8)a[i] ^ (uint8)b[i];
+	return diff == 0;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/Timer.h>
+
+
+static std::string toHex(const std::string& s)
+{
+	const char* digits = "0123456789abcdef";
+	std::string res;
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		res.push_back(digits[(uint8)s[i] >> 4]);
+		res.push_back(digits[(uint8)s[i] & 0xF]);
+	}
+	return res;
+}
+
+
+void PasswordHashing::test()
+{
+	conPrint("PasswordHashing::test()");
+
+	//-------------------- Test legacy salted SHA-256 scheme --------------------
+	{
+		const std::string hash = computeHash("password", "salt", PasswordHashParams());
+		testAssert(hash.size() == 32);
+		testAssert(hash == computeSaltedSHA256Hash("password", "salt"));
+		testAssert(toHex(hash) == "bfd5d266576ce94e5b027575b703ef75eb108ef4b4531aa717018468023e6325");
+	}
+
+	//-------------------- Test Balloon hashing --------------------
+	{
+		// Known-answer tests
+		testAssert(toHex(computeBalloonSHA256Hash("password", "salt", /*space cost=*/16, /*time cost=*/1)) == "595e1f2ce41a9257b65fcf5d4cd79cfb0ad124f00738af7a58e114051589022d");
+		testAssert(toHex(computeBalloonSHA256Hash("password", "salt", /*space cost=*/1024, /*time cost=*/3)) == "c5065d119ad19e8aea86bbb031696a9525a0e1e29cf6402c32df1a4680f7e737");
+
+		const PasswordHashParams params(PasswordHashParams::Scheme_BalloonSHA256, 1024, 2);
+		const std::string hash = computeHash("password", "salt", params);
+		testAssert(hash.size() == 32);
+		testAssert(hash == computeHash("password", "salt", params)); // Deterministic
+		testAssert(hash != computeHash("passwore", "salt", params));
+		testAssert(hash != computeHash("password", "salu", params));
+		testAssert(hash != computeHash("password", "salt", PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 1025, 2)));
+		testAssert(hash != computeHash("password", "salt", PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 1024, 3)));
+		testAssert(hash != computeHash("password", "salt", PasswordHashParams()));
+
+		// Edge-case costs
+		testAssert(computeBalloonSHA256Hash("", "", 1, 1).size() == 32);
+	}
+
+	//-------------------- Test invalid params are rejected --------------------
+	{
+		try
+		{
+			computeHash("password", "salt", PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 0, 1));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		try
+		{
+			computeHash("password", "salt", PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 1 << 30, 1));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		try
+		{
+			computeHash("password", "salt", PasswordHashParams(123, 16, 1));
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+
+	//-------------------- Test isWeakerThan --------------------
+	{
+		const PasswordHashParams legacy;
+		const PasswordHashParams balloon(PasswordHashParams::Scheme_BalloonSHA256, 1024, 2);
+		testAssert(legacy.isWeakerThan(balloon));
+		testAssert(!balloon.isWeakerThan(legacy));
+		testAssert(!balloon.isWeakerThan(balloon));
+		testAssert(!legacy.isWeakerThan(legacy));
+		testAssert(PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 512, 2).isWeakerThan(balloon));
+		testAssert(PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 1024, 1).isWeakerThan(balloon));
+		testAssert(!PasswordHashParams(PasswordHashParams::Scheme_BalloonSHA256, 2048, 2).isWeakerThan(balloon));
+	}
+
+	//-------------------- Test hashesEqual --------------------
+	{
+		testAssert(hashesEqual("", ""));
+		testAssert(hashesEqual("abc", "abc"));
+		testAssert(!hashesEqual("abc", "abd"));
+		testAssert(!hashesEqual("abc", "abcd"));
+	}
+
+	//-------------------- Test generateSalt --------------------
+	{
+		const std::string salt_a = generateSalt();
+		const std::string salt_b = generateSalt();
+		testAssert(salt_a.size() >= 43);
+		testAssert(salt_a != salt_b);
+	}
+
+	//-------------------- Time the default params --------------------
+	{
+		Timer timer;
+		computeHash("password", generateSalt(), defaultParams());
+		conPrint("Password hash with default params took " + timer.elapsedStringNSigFigs(4));
+	}
+
+	conPrint("PasswordHashing::test() done.");
+}
+
+
+#endif // BUILD_TESTS
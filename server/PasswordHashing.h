@@ -0,0 +1,65 @@
+/*=====================================================================
+PasswordHashing.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <string>
+
+
+/*=====================================================================
+PasswordHashParams
+------------------
+The scheme and costs used to compute a password hash.  Stored with each user,
+so that we can increase the costs over time, and rehash passwords when users log in.
+=====================================================================*/
+class PasswordHashParams
+{
+public:
+	PasswordHashParams() : scheme(Scheme_SaltedSHA256), space_cost(0), time_cost(0) {}
+	PasswordHashParams(uint32 scheme_, uint32 space_cost_, uint32 time_cost_) : scheme(scheme_), space_cost(space_cost_), time_cost(time_cost_) {}
+
+	static const uint32 Scheme_SaltedSHA256 = 0; // Original scheme: a single salted SHA-256 hash.  Costs are ignored.
+	static const uint32 Scheme_BalloonSHA256 = 1; // Balloon hashing with SHA-256, which is memory-hard.
+
+	bool operator == (const PasswordHashParams& other) const { return scheme == other.scheme && space_cost == other.space_cost && time_cost == other.time_cost; }
+	bool operator != (const PasswordHashParams& other) const { return !(*this == other); }
+
+	// Is a hash computed with these params cheaper to brute-force than one computed with other?  Used to decide if a password should be rehashed.
+	bool isWeakerThan(const PasswordHashParams& other) const;
+
+	uint32 scheme;
+	uint32 space_cost; // Number of 32-byte blocks in the Balloon buffer.
+	uint32 time_cost; // Number of mixing rounds over the Balloon buffer.
+};
+
+
+/*=====================================================================
+PasswordHashing
+---------------
+Password hashing functions.  These are deliberately slow, so shouldn't be called while
+holding ServerAllWorldsState::mutex.  See PasswordHashThreadPool and ServerAllWorldsState::computePasswordHash().
+=====================================================================*/
+namespace PasswordHashing
+{
+	// The params used for new hashes, unless overridden by the server config.  Uses 512 KB of memory per hash.
+	PasswordHashParams defaultParams();
+
+	// Throws glare::Exception if the params are not valid (e.g. costs out of range).
+	void checkParamsValid(const PasswordHashParams& params);
+
+	// Returns the raw hash digest (32 bytes).  Throws glare::Exception if the params are invalid.
+	std::string computeHash(const std::string& password, const std::string& salt, const PasswordHashParams& params);
+
+	std::string computeSaltedSHA256Hash(const std::string& password, const std::string& salt);
+	std::string computeBalloonSHA256Hash(const std::string& password, const std::string& salt, uint32 space_cost, uint32 time_cost);
+
+	std::string generateSalt(); // Returns 256 random bits, base-64 encoded.  Throws glare::Exception on failure.
+
+	bool hashesEqual(const std::string& a, const std::string& b); // Constant-time comparison (for equal lengths).
+
+	void test();
+}
@@ -0,0 +1,273 @@
+/*=====================================================================
+RateLimiter.cpp
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "RateLimiter.h"
+
+
+#include "../shared/Protocol.h"
+#include <Lock.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <mathstypes.h>
+#include <functional>
+
+
+RateLimiter::RateLimiter(const std::string& name_)
+:	name(name_),
+	max_buckets_per_shard(4096)
+{}
+
+
+RateLimiter::~RateLimiter()
+{}
+
+
+void RateLimiter::setParams(const RateLimitParams& params_)
+{
+	params = params_;
+}
+
+
+bool RateLimiter::tryConsume(const std::string& key, double cur_time)
+{
+	if(!params.enabled())
+	{
+		num_allowed.increment();
+		return true;
+	}
+
+	Shard& shard = shards[std::hash<std::string>()(key) % NUM_SHARDS];
+	bool allowed;
+	{
+		Lock lock(shard.mutex);
+
+		auto res = shard.buckets.find(key);
+		if(res == shard.buckets.end())
+		{
+			if(shard.buckets.size() >= max_buckets_per_shard)
+				pruneShard(shard, cur_time);
+
+			Bucket new_bucket;
+			new_bucket.tokens = params.burst;
+			new_bucket.last_update_time = cur_time;
+			res = shard.buckets.insert(std::make_pair(key, new_bucket)).first;
+		}
+
+		Bucket& bucket = res->second;
+		bucket.tokens = myMin(params.burst, bucket.tokens + myMax(0.0, cur_time - bucket.last_update_time) * params.rate_per_s);
+		bucket.last_update_time = cur_time;
+
+		allowed = bucket.tokens >= 1.0;
+		if(allowed)
+			bucket.tokens -= 1.0;
+	}
+
+	if(allowed)
+		num_allowed.increment();
+	else
+		num_rejected.increment();
+	return allowed;
+}
+
+
+// Removes buckets that would have refilled completely by cur_time.  If that doesn't free up enough space, removes all buckets, so we can't use
+// unbounded memory when getting connections from lots of different addresses.  (Removing a bucket just resets it to full)
+void RateLimiter::pruneShard(Shard& shard, double cur_time)
+{
+	for(auto it = shard.buckets.begin(); it != shard.buckets.end(); )
+	{
+		const double refilled_tokens = it->second.tokens + (cur_time - it->second.last_update_time) * params.rate_per_s;
+		if(refilled_tokens >= params.burst)
+			it = shard.buckets.erase(it);
+		else
+			++it;
+	}
+
+	if(shard.buckets.size() >= max_buckets_per_shard / 2)
+	{
+		conPrint("RateLimiter '" + name + "': too many buckets, clearing shard.");
+		shard.buckets.clear();
+	}
+}
+
+
+size_t RateLimiter::getNumBuckets() const
+{
+	size_t num = 0;
+	for(int i=0; i<NUM_SHARDS; ++i)
+	{
+		Lock lock(shards[i].mutex);
+		num += shards[i].buckets.size();
+	}
+	return num;
+}
+
+
+ServerRateLimiters::ServerRateLimiters()
+:	connections("connections"),
+	object_transform_updates("object transform updates"),
+	chat_messages("chat messages"),
+	object_queries("object queries"),
+	resource_uploads("resource uploads"),
+	web_requests("web requests"),
+	web_auth_requests("web auth requests")
+{}
+
+
+RateLimiter* ServerRateLimiters::getLimiterForMessageType(uint32 msg_type)
+{
+	switch(msg_type)
+	{
+	case Protocol::ObjectTransformUpdate:
+		return &object_transform_updates;
+	case Protocol::ChatMessageID:
+		return &chat_messages;
+	case Protocol::QueryObjects:
+	case Protocol::QueryObjectsInAABB:
+		return &object_queries;
+	default:
+		return NULL;
+	}
+}
+
+
+void ServerRateLimiters::getLimiters(std::vector<RateLimiter*>& limiters_out)
+{
+	limiters_out = { &connections, &object_transform_updates, &chat_messages, &object_queries, &resource_uploads, &web_requests, &web_auth_requests };
+}
+
+
+std::string ServerRateLimiters::clientKey(const UserID& user_id, const IPAddress& ip_addr)
+{
+	if(user_id.valid())
+		return "user " + user_id.toString();
+	else
+		return ip_addr.toString();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/MyThread.h>
+
+
+class RateLimiterTestThread : public MyThread
+{
+public:
+	RateLimiterTestThread(RateLimiter* limiter_) : limiter(limiter_), num_allowed(0) {}
+
+	virtual void run()
+	{
+		for(int i=0; i<10000; ++i)
+			if(limiter->tryConsume("key", /*cur_time=*/0.0))
+				num_allowed++;
+	}
+
+	RateLimiter* limiter;
+	int num_allowed;
+};
+
+
+void RateLimiter::test()
+{
+	conPrint("RateLimiter::test()");
+
+	//-------------------- Test basic token bucket behaviour --------------------
+	{
+		RateLimiter limiter("test");
+		limiter.setParams(RateLimitParams(/*rate_per_s=*/1.0, /*burst=*/3.0));
+
+		// Should be able to use the whole burst straight away.
+		testAssert(limiter.tryConsume("a", 0.0));
+		testAssert(limiter.tryConsume("a", 0.0));
+		testAssert(limiter.tryConsume("a", 0.0));
+		testAssert(!limiter.tryConsume("a", 0.0));
+		testAssert(!limiter.tryConsume("a", 0.5));
+
+		// Other keys should have their own buckets.
+		testAssert(limiter.tryConsume("b", 0.5));
+		testAssert(limiter.getNumBuckets() == 2);
+
+		// One token should have been added after 1 s.
+		testAssert(limiter.tryConsume("a", 1.0));
+		testAssert(!limiter.tryConsume("a", 1.0));
+
+		// Bucket shouldn't fill past the burst size.
+		testAssert(limiter.tryConsume("a", 100.0));
+		testAssert(limiter.tryConsume("a", 100.0));
+		testAssert(limiter.tryConsume("a", 100.0));
+		testAssert(!limiter.tryConsume("a", 100.0));
+
+		// Time going backwards shouldn't add tokens.
+		testAssert(!limiter.tryConsume("a", 50.0));
+
+		testAssert(limiter.num_allowed.getValue() == 8);
+		testAssert(limiter.num_rejected.getValue() == 5);
+	}
+
+	//-------------------- Test that a disabled limiter allows everything --------------------
+	{
+		RateLimiter limiter("test");
+		for(int i=0; i<1000; ++i)
+			testAssert(limiter.tryConsume("a", 0.0));
+		testAssert(limiter.getNumBuckets() == 0);
+	}
+
+	//-------------------- Test pruning of buckets --------------------
+	{
+		RateLimiter limiter("test");
+		limiter.setParams(RateLimitParams(/*rate_per_s=*/1.0, /*burst=*/2.0));
+		limiter.max_buckets_per_shard = 4;
+
+		for(int i=0; i<1000; ++i)
+			limiter.tryConsume(toString(i), 0.0);
+		testAssert(limiter.getNumBuckets() <= NUM_SHARDS * 4);
+
+		// An empty bucket that has been pruned due to memory pressure may be reset, but a recently used bucket in a shard that isn't full shouldn't be.
+		testAssert(limiter.tryConsume("x", 1000.0));
+		testAssert(limiter.tryConsume("x", 1000.0));
+		testAssert(!limiter.tryConsume("x", 1000.0));
+	}
+
+	//-------------------- Test concurrent use of a single bucket --------------------
+	{
+		RateLimiter limiter("test");
+		limiter.setParams(RateLimitParams(/*rate_per_s=*/1.0, /*burst=*/1000.0));
+
+		std::vector<Reference<RateLimiterTestThread>> threads;
+		for(int i=0; i<8; ++i)
+		{
+			threads.push_back(new RateLimiterTestThread(&limiter));
+			threads.back()->launch();
+		}
+		int total_allowed = 0;
+		for(size_t i=0; i<threads.size(); ++i)
+		{
+			threads[i]->join();
+			total_allowed += threads[i]->num_allowed;
+		}
+		testAssert(total_allowed == 1000);
+		testAssert(limiter.num_allowed.getValue() == 1000);
+		testAssert(limiter.num_rejected.getValue() == 8 * 10000 - 1000);
+	}
+
+	//-------------------- Test ServerRateLimiters --------------------
+	{
+		ServerRateLimiters limiters;
+		testAssert(limiters.getLimiterForMessageType(Protocol::ChatMessageID) == &limiters.chat_messages);
+		testAssert(limiters.getLimiterForMessageType(Protocol::QueryObjectsInAABB) == &limiters.object_queries);
+		testAssert(limiters.getLimiterForMessageType(Protocol::CyberspaceGoodbye) == NULL);
+
+		testAssert(ServerRateLimiters::clientKey(UserID(10), IPAddress("127.0.0.1")) == "user 10");
+		testAssert(ServerRateLimiters::clientKey(UserID::invalidUserID(), IPAddress("127.0.0.1")) == "127.0.0.1");
+	}
+
+	conPrint("RateLimiter::test() done.");
+}
+
+
+#endif // BUILD_TESTS
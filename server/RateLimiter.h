@@ -0,0 +1,121 @@
+/*=====================================================================
+RateLimiter.h
+-------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "ServerMetrics.h"
+#include "../shared/UserID.h"
+#include <IPAddress.h>
+#include <Mutex.h>
+#include <Platform.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+class RateLimitParams
+{
+public:
+	RateLimitParams() : rate_per_s(0), burst(0) {}
+	RateLimitParams(double rate_per_s_, double burst_) : rate_per_s(rate_per_s_), burst(burst_) {}
+
+	bool enabled() const { return rate_per_s > 0; }
+
+	double rate_per_s; // Rate at which tokens are added to each bucket.  <= 0 means no limit.
+	double burst; // Max number of tokens in a bucket, e.g. the number of actions that can be done in a burst after being idle.
+};
+
+
+/*=====================================================================
+RateLimiter
+-----------
+Token-bucket rate limiter, with one bucket per key (an IP address or user id).
+Each allowed action takes a token from the bucket for the key, and tokens are added back at rate_per_s,
+up to burst tokens.
+
+Buckets are split over NUM_SHARDS maps, each with its own mutex, so threads checking different keys
+rarely contend.  The mutexes are leaf locks, and are never held while taking any other lock.
+Buckets that have refilled completely are the same as missing buckets, so are pruned when a shard gets too big.
+=====================================================================*/
+class RateLimiter
+{
+public:
+	RateLimiter(const std::string& name);
+	~RateLimiter();
+
+	static const int NUM_SHARDS = 16;
+
+	// Not threadsafe, should be called at startup before the limiter is used.
+	void setParams(const RateLimitParams& params);
+	const RateLimitParams& getParams() const { return params; }
+
+	// Takes a token from the bucket for key and returns true if there is one, otherwise returns false.
+	// cur_time is in seconds, from e.g. Clock::getTimeSinceInit().  Threadsafe.
+	bool tryConsume(const std::string& key, double cur_time);
+
+	size_t getNumBuckets() const; // Threadsafe
+
+	static void test();
+
+	const std::string name;
+
+	MetricCounter num_allowed;
+	MetricCounter num_rejected;
+
+private:
+	GLARE_DISABLE_COPY(RateLimiter);
+
+	struct Bucket
+	{
+		double tokens;
+		double last_update_time;
+	};
+
+	struct alignas(64) Shard
+	{
+		mutable Mutex mutex;
+		std::unordered_map<std::string, Bucket> buckets GUARDED_BY(mutex);
+	};
+
+	void pruneShard(Shard& shard, double cur_time) REQUIRES(shard.mutex);
+
+	Shard shards[NUM_SHARDS];
+	RateLimitParams params;
+	size_t max_buckets_per_shard;
+};
+
+
+/*=====================================================================
+ServerRateLimiters
+------------------
+The rate limiters for the server, checked where connections, messages and requests come in,
+before they do any work that needs the world state mutex.
+Game messages and resource uploads are keyed by user id for logged-in clients, otherwise by IP address.
+=====================================================================*/
+class ServerRateLimiters
+{
+public:
+	ServerRateLimiters();
+
+	// Returns the limiter for client messages of the given type, or NULL if messages of that type are not rate limited.
+	RateLimiter* getLimiterForMessageType(uint32 msg_type);
+
+	void getLimiters(std::vector<RateLimiter*>& limiters_out);
+
+	// Returns the key to use for a client: the user id if the client is logged in, otherwise the IP address.
+	static std::string clientKey(const UserID& user_id, const IPAddress& ip_addr);
+
+	RateLimiter connections; // Connections accepted by ListenerThread, keyed by IP.
+	RateLimiter object_transform_updates;
+	RateLimiter chat_messages;
+	RateLimiter object_queries; // QueryObjects and QueryObjectsInAABB messages.
+	RateLimiter resource_uploads;
+	RateLimiter web_requests; // All web requests, keyed by IP.
+	RateLimiter web_auth_requests; // Login, signup and password POST requests, which are expensive due to password hashing.  Keyed by IP.
+
+private:
+	GLARE_DISABLE_COPY(ServerRateLimiters);
+};
@@ -0,0 +1,246 @@
+/*=====================================================================
+ResourceCompression.cpp
+-----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceCompression.h"
+
+
+#include <MemMappedFile.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <FileUtils.h>
+#include <Timer.h>
+#include <Vector.h>
+#include <zlib.h>
+#include <zstd.h>
+
+
+namespace ResourceCompression
+{
+
+
+static const uint64 MAX_COMPRESS_FILE_SIZE = 256 * 1024 * 1024; // Don't compress larger files than this, to bound memory usage while compressing.
+static const double MAX_COMPRESSED_RATIO = 0.9; // Only keep a variant if it is at most this fraction of the original size.
+
+
+bool isCompressibleURL(const std::string& URL)
+{
+	const std::string ext = ::toLowerCase(::getExtension(URL));
+	return
+		ext == "bmesh" || ext == "glb" || ext == "gltf" || ext == "obj" || ext == "stl" || ext == "vox" || ext == "igmesh" || // Meshes
+		ext == "bmp" || ext == "tga" || ext == "exr" || ext == "hdr" || ext == "ktx" || ext == "ktx2" || // Textures that may be uncompressed
+		ext == "wav";
+}
+
+
+std::string zstdVariantPath(const std::string& local_path)
+{
+	return local_path + ".zst";
+}
+
+
+std::string deflateVariantPath(const std::string& local_path)
+{
+	return local_path + ".deflate";
+}
+
+
+static std::string noCompressionMarkerPath(const std::string& local_path)
+{
+	return local_path + ".nocompress";
+}
+
+
+bool compressionAttempted(const std::string& local_path)
+{
+	return FileUtils::fileExists(zstdVariantPath(local_path)) || FileUtils::fileExists(noCompressionMarkerPath(local_path));
+}
+
+
+// Write to a temp file then move it into place, so the webserver and worker threads never see a partially written variant.
+static void writeVariantFile(const std::string& path, const js::Vector<uint8, 16>& data)
+{
+	const std::string temp_path = path + ".tmp";
+	FileUtils::writeEntireFile(temp_path, (const char*)data.data(), data.size());
+	if(FileUtils::fileExists(path))
+		FileUtils::deleteFile(path);
+	FileUtils::moveFile(temp_path, path);
+}
+
+
+bool makeCompressedVariants(const std::string& local_path)
+{
+	try
+	{
+		Timer timer;
+
+		MemMappedFile file(local_path);
+		const size_t file_size = file.fileSize();
+		if(file_size == 0 || file_size > MAX_COMPRESS_FILE_SIZE)
+		{
+			FileUtils::writeEntireFile(noCompressionMarkerPath(local_path), std::string());
+			return false;
+		}
+
+#if BUILD_TESTS
+		const bool use_high_compression_level = false; // don't spend long compressing for debug modes
+#else
+		const bool use_high_compression_level = true;
+#endif
+
+		// Do zstd compression.  See WebDataStore for why we don't use levels >= 20.  Use a lower level for large files so we don't take minutes on one file.
+		js::Vector<uint8, 16> zstd_data(ZSTD_compressBound(file_size));
+		const int zstd_level = use_high_compression_level ? ((file_size <= 16 * 1024 * 1024) ? 19 : 9) : 1;
+		const size_t zstd_size = ZSTD_compress(zstd_data.data(), zstd_data.size(), file.fileData(), file_size, zstd_level);
+		if(ZSTD_isError(zstd_size))
+			throw glare::Exception(std::string("Compression failed: ") + ZSTD_getErrorName(zstd_size));
+
+		if((double)zstd_size > (double)file_size * MAX_COMPRESSED_RATIO)
+		{
+			// Not worth compressing.  Deflate won't do better than zstd so don't try that either.
+			removeCompressedVariants(local_path);
+			FileUtils::writeEntireFile(noCompressionMarkerPath(local_path), std::string());
+			return false;
+		}
+
+		// Do deflate compression, for web clients that don't accept zstd.
+		uLong deflate_size = compressBound((uLong)file_size);
+		js::Vector<uint8, 16> deflate_data(deflate_size);
+		const int result = ::compress2(deflate_data.data(), &deflate_size, (const Bytef*)file.fileData(), (uLong)file_size, use_high_compression_level ? Z_BEST_COMPRESSION : Z_BEST_SPEED);
+		if(result != Z_OK)
+			throw glare::Exception("Compression failed.");
+
+		if((double)deflate_size <= (double)file_size * MAX_COMPRESSED_RATIO)
+		{
+			deflate_data.resize(deflate_size);
+			writeVariantFile(deflateVariantPath(local_path), deflate_data);
+		}
+
+		// Write the zstd variant last, as its existence is used to mark the resource as done.
+		zstd_data.resize(zstd_size);
+		writeVariantFile(zstdVariantPath(local_path), zstd_data);
+
+		conPrint("Compressed resource '" + FileUtils::getFilename(local_path) + "' from " + toString(file_size) + " B to " + toString(zstd_size) + " B (zstd), " + 
+			toString((uint64)deflate_size) + " B (deflate).  Elapsed: " + timer.elapsedStringNPlaces(3));
+		return true;
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+}
+
+
+void removeCompressedVariants(const std::string& local_path)
+{
+	try
+	{
+		const std::string paths[] = { zstdVariantPath(local_path), deflateVariantPath(local_path), noCompressionMarkerPath(local_path) };
+		for(size_t i=0; i<staticArrayNumElems(paths); ++i)
+			if(FileUtils::fileExists(paths[i]))
+				FileUtils::deleteFile(paths[i]);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		conPrint("Error while removing compressed variants: " + e.what());
+	}
+}
+
+
+} // end namespace ResourceCompression
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+void ResourceCompression::test()
+{
+	conPrint("ResourceCompression::test()");
+
+	try
+	{
+		testAssert(isCompressibleURL("model_123.glb"));
+		testAssert(isCompressibleURL("model_123.BMESH"));
+		testAssert(isCompressibleURL("tex_123.ktx2"));
+		testAssert(!isCompressibleURL("tex_123.jpg"));
+		testAssert(!isCompressibleURL("video_123.mp4"));
+		testAssert(!isCompressibleURL("noext"));
+
+		const std::string dir = PlatformUtils::getTempDirPath() + "/resource_compression_test";
+		FileUtils::createDirIfDoesNotExist(dir);
+
+		//-------------------- Test compressible data --------------------
+		{
+			std::string data;
+			for(int i=0; i<10000; ++i)
+				data += "vertex " + toString(i % 100) + " 0.0 1.0\n";
+
+			const std::string path = dir + "/compressible.obj";
+			FileUtils::writeEntireFile(path, data);
+			removeCompressedVariants(path);
+			testAssert(!compressionAttempted(path));
+
+			testAssert(makeCompressedVariants(path));
+			testAssert(compressionAttempted(path));
+
+			// Check the zstd variant decompresses to the original data
+			std::string zstd_data;
+			FileUtils::readEntireFile(zstdVariantPath(path), zstd_data);
+			testAssert(zstd_data.size() < data.size() / 2);
+			testAssert(ZSTD_getFrameContentSize(zstd_data.data(), zstd_data.size()) == data.size());
+			std::string decompressed(data.size(), '\0');
+			const size_t res = ZSTD_decompress(&decompressed[0], decompressed.size(), zstd_data.data(), zstd_data.size());
+			testAssert(!ZSTD_isError(res) && res == data.size());
+			testAssert(decompressed == data);
+
+			// Check the deflate variant
+			std::string deflate_data;
+			FileUtils::readEntireFile(deflateVariantPath(path), deflate_data);
+			std::string inflated(data.size(), '\0');
+			uLongf inflated_size = (uLongf)inflated.size();
+			testAssert(::uncompress((Bytef*)&inflated[0], &inflated_size, (const Bytef*)deflate_data.data(), (uLong)deflate_data.size()) == Z_OK);
+			testAssert(inflated_size == data.size() && inflated == data);
+
+			removeCompressedVariants(path);
+			testAssert(!compressionAttempted(path));
+			testAssert(!FileUtils::fileExists(deflateVariantPath(path)));
+		}
+
+		//-------------------- Test incompressible data --------------------
+		{
+			std::string data(100000, '\0');
+			uint64 x = 12345;
+			for(size_t i=0; i<data.size(); ++i)
+			{
+				x = x * 6364136223846793005ull + 1442695040888963407ull;
+				data[i] = (char)(x >> 56);
+			}
+
+			const std::string path = dir + "/incompressible.glb";
+			FileUtils::writeEntireFile(path, data);
+			removeCompressedVariants(path);
+
+			testAssert(!makeCompressedVariants(path));
+			testAssert(compressionAttempted(path)); // Marker should have been written
+			testAssert(!FileUtils::fileExists(zstdVariantPath(path)));
+			testAssert(!FileUtils::fileExists(deflateVariantPath(path)));
+
+			removeCompressedVariants(path);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceCompression::test() done.");
+}
+
+
+#endif // BUILD_TESTS
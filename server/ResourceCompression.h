@@ -0,0 +1,43 @@
+/*=====================================================================
+ResourceCompression.h
+---------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <string>
+
+
+/*=====================================================================
+ResourceCompression
+-------------------
+Precompressed variants of resources, for serving to clients that accept compressed content.
+
+For a resource file at local_path, a zstd variant is stored at local_path + ".zst", and a deflate
+(zlib format, as used by HTTP Content-Encoding: deflate) variant at local_path + ".deflate".
+If a resource doesn't compress well, a marker file is written instead so we don't try again.
+Variants are written by ResourceCompressionThread.
+=====================================================================*/
+namespace ResourceCompression
+{
+
+// Returns true if resources with this URL are worth trying to compress, e.g. meshes and uncompressed images, but not JPEGs or MP4s.
+bool isCompressibleURL(const std::string& URL);
+
+std::string zstdVariantPath(const std::string& local_path);
+std::string deflateVariantPath(const std::string& local_path);
+
+// Returns true if variants have been written, or the file was found to not be worth compressing.
+bool compressionAttempted(const std::string& local_path);
+
+// Writes zstd and deflate variants of the file, if they are sufficiently smaller than the file.  Otherwise writes the marker file.
+// Returns true if any variants were written.  Throws glare::Exception on failure.
+bool makeCompressedVariants(const std::string& local_path);
+
+// Removes any variants and marker file, for when the resource file is replaced.
+void removeCompressedVariants(const std::string& local_path);
+
+void test();
+
+}
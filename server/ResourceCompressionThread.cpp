@@ -0,0 +1,133 @@
+/*=====================================================================
+ResourceCompressionThread.cpp
+-----------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceCompressionThread.h"
+
+
+#include "ServerWorldState.h"
+#include "ResourceCompression.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <KillThreadMessage.h>
+
+
+ResourceCompressionThread::ResourceCompressionThread(ServerAllWorldsState* world_state_)
+:	world_state(world_state_)
+{
+}
+
+
+ResourceCompressionThread::~ResourceCompressionThread()
+{
+}
+
+
+void ResourceCompressionThread::compressResource(const std::string& local_path)
+{
+	try
+	{
+		ResourceCompression::makeCompressedVariants(local_path);
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ResourceCompressionThread: error while compressing '" + local_path + "': " + e.what());
+	}
+}
+
+
+void ResourceCompressionThread::compressResourceForURL(const std::string& URL)
+{
+	if(!ResourceCompression::isCompressibleURL(URL))
+		return;
+
+	const ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(URL);
+	if(resource.nonNull() && resource->getState() == Resource::State_Present)
+	{
+		const std::string local_path = world_state->resource_manager->getLocalAbsPathForResource(*resource);
+		if(!ResourceCompression::compressionAttempted(local_path))
+			compressResource(local_path);
+	}
+}
+
+
+// Handles any queued messages without blocking, during the initial scan.  URLs from CompressResourceMessages are appended to URLs_to_compress_out, to be done after the scan.
+// Returns true if we got a kill message.
+bool ResourceCompressionThread::checkMessages(std::vector<std::string>& URLs_to_compress_out)
+{
+	ThreadSafeQueue<ThreadMessageRef>& queue = getMessageQueue();
+	Lock lock(queue.getMutex());
+	while(!queue.unlockedEmpty())
+	{
+		ThreadMessageRef msg;
+		queue.unlockedDequeue(msg);
+		if(dynamic_cast<CompressResourceMessage*>(msg.ptr()))
+			URLs_to_compress_out.push_back(static_cast<CompressResourceMessage*>(msg.ptr())->URL);
+		else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			return true;
+	}
+	return false;
+}
+
+
+void ResourceCompressionThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("ResourceCompressionThread");
+
+	try
+	{
+		// Initial scan over all resources.  Get the candidate paths while holding the resource manager lock, then check which need compressing without it.
+		std::vector<std::string> paths;
+		{
+			Lock lock(world_state->resource_manager->getMutex());
+			for(auto it = world_state->resource_manager->getResourcesForURL().begin(); it != world_state->resource_manager->getResourcesForURL().end(); ++it)
+			{
+				const Resource* resource = it->second.ptr();
+				if(resource->getState() == Resource::State_Present && ResourceCompression::isCompressibleURL(resource->URL))
+					paths.push_back(world_state->resource_manager->getLocalAbsPathForResource(*resource));
+			}
+		}
+
+		std::vector<std::string> URLs_to_compress; // From messages received during the scan.
+		size_t num_compressed = 0;
+		for(size_t i=0; i<paths.size(); ++i)
+		{
+			if(checkMessages(URLs_to_compress))
+				return;
+
+			if(!ResourceCompression::compressionAttempted(paths[i]))
+			{
+				compressResource(paths[i]);
+				num_compressed++;
+			}
+		}
+		conPrint("ResourceCompressionThread: initial scan done, compressed " + toString(num_compressed) + " / " + toString(paths.size()) + " compressible resource(s).");
+
+		for(size_t i=0; i<URLs_to_compress.size(); ++i)
+			compressResourceForURL(URLs_to_compress[i]);
+
+		while(1)
+		{
+			// Block until we have a message
+			ThreadMessageRef msg;
+			getMessageQueue().dequeue(msg);
+
+			if(dynamic_cast<CompressResourceMessage*>(msg.ptr()))
+			{
+				compressResourceForURL(static_cast<CompressResourceMessage*>(msg.ptr())->URL);
+			}
+			else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			{
+				return;
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ResourceCompressionThread: glare::Exception: " + e.what());
+	}
+}
@@ -0,0 +1,46 @@
+/*=====================================================================
+ResourceCompressionThread.h
+---------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <MessageableThread.h>
+#include <string>
+#include <vector>
+class ServerAllWorldsState;
+
+
+class CompressResourceMessage : public ThreadMessage
+{
+public:
+	CompressResourceMessage(const std::string& URL_) : URL(URL_) {}
+	std::string URL;
+};
+
+
+/*=====================================================================
+ResourceCompressionThread
+-------------------------
+Writes precompressed variants of resources, see ResourceCompression.
+
+When this thread starts, it does a scan over all resources, and compresses any that haven't been tried yet.
+After that it waits for CompressResourceMessage messages, which are sent when a resource is uploaded.
+=====================================================================*/
+class ResourceCompressionThread : public MessageableThread
+{
+public:
+	ResourceCompressionThread(ServerAllWorldsState* world_state);
+
+	virtual ~ResourceCompressionThread();
+
+	virtual void doRun();
+
+private:
+	void compressResource(const std::string& local_path);
+	void compressResourceForURL(const std::string& URL);
+	bool checkMessages(std::vector<std::string>& URLs_to_compress_out);
+
+	ServerAllWorldsState* world_state;
+};
@@ -0,0 +1,205 @@
+/*=====================================================================
+ResourceRequestQueue.cpp
+------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ResourceRequestQueue.h"
+
+
+#include "../shared/Protocol.h"
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <cmath>
+#include <limits>
+
+
+ResourceRequestQueue::ResourceRequestQueue()
+:	next_seq_num(0)
+{}
+
+
+void ResourceRequestQueue::addRequest(uint32 request_id, float priority, const std::string& URL)
+{
+	Request request;
+	request.request_id = request_id;
+	request.priority = priority;
+	request.URL = URL;
+	request.is_cell_low_lod_models_request = false;
+	request.cell_coords = Vec3<int>(0, 0, 0);
+	addRequest(request);
+}
+
+
+void ResourceRequestQueue::addCellLowLODModelsRequest(uint32 request_id, float priority, const std::string& world_name, const Vec3<int>& cell_coords)
+{
+	Request request;
+	request.request_id = request_id;
+	request.priority = priority;
+	request.is_cell_low_lod_models_request = true;
+	request.world_name = world_name;
+	request.cell_coords = cell_coords;
+	addRequest(request);
+}
+
+
+void ResourceRequestQueue::addRequest(const Request& request)
+{
+	if(requests.size() >= Protocol::MAX_OUTSTANDING_FILE_REQUESTS)
+		throw glare::Exception("Too many outstanding resource requests.");
+	if(findRequest(request.request_id) != requests.size())
+		throw glare::Exception("Duplicate resource request id " + toString(request.request_id));
+
+	QueuedRequest queued_request;
+	queued_request.request = request;
+	queued_request.request.priority = std::isnan(request.priority) ? std::numeric_limits<float>::infinity() : request.priority; // Treat NaN priorities as least important, so comparisons are well-defined.
+	queued_request.seq_num = next_seq_num++;
+	requests.push_back(queued_request);
+}
+
+
+bool ResourceRequestQueue::removeRequest(uint32 request_id)
+{
+	const size_t index = findRequest(request_id);
+	if(index == requests.size())
+		return false;
+
+	requests[index] = requests.back();
+	requests.pop_back();
+	return true;
+}
+
+
+bool ResourceRequestQueue::setPriority(uint32 request_id, float priority)
+{
+	const size_t index = findRequest(request_id);
+	if(index == requests.size())
+		return false;
+
+	requests[index].request.priority = std::isnan(priority) ? std::numeric_limits<float>::infinity() : priority;
+	return true;
+}
+
+
+bool ResourceRequestQueue::popMostImportant(Request& request_out)
+{
+	if(requests.empty())
+		return false;
+
+	size_t best_index = 0;
+	for(size_t i=1; i<requests.size(); ++i)
+	{
+		const QueuedRequest& a = requests[i];
+		const QueuedRequest& best = requests[best_index];
+		if(a.request.priority < best.request.priority || (a.request.priority == best.request.priority && a.seq_num < best.seq_num))
+			best_index = i;
+	}
+
+	request_out = requests[best_index].request;
+	requests[best_index] = requests.back();
+	requests.pop_back();
+	return true;
+}
+
+
+size_t ResourceRequestQueue::findRequest(uint32 request_id) const
+{
+	for(size_t i=0; i<requests.size(); ++i)
+		if(requests[i].request.request_id == request_id)
+			return i;
+	return requests.size();
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+void ResourceRequestQueue::test()
+{
+	conPrint("ResourceRequestQueue::test()");
+
+	//-------------------- Test requests are popped in priority order, with ties in request order --------------------
+	{
+		ResourceRequestQueue queue;
+		queue.addRequest(1, 10.f, "a");
+		queue.addRequest(2, 5.f, "b");
+		queue.addRequest(3, 10.f, "c");
+		queue.addRequest(4, 1.f, "d");
+		testAssert(queue.size() == 4);
+
+		Request request;
+		testAssert(queue.popMostImportant(request) && request.request_id == 4 && request.URL == "d" && !request.is_cell_low_lod_models_request);
+		testAssert(queue.popMostImportant(request) && request.request_id == 2);
+		testAssert(queue.popMostImportant(request) && request.request_id == 1);
+		testAssert(queue.popMostImportant(request) && request.request_id == 3);
+		testAssert(!queue.popMostImportant(request));
+		testAssert(queue.empty());
+	}
+
+	//-------------------- Test cancelling and re-prioritising --------------------
+	{
+		ResourceRequestQueue queue;
+		queue.addRequest(1, 1.f, "a");
+		queue.addRequest(2, 2.f, "b");
+		queue.addRequest(3, 3.f, "c");
+
+		testAssert(queue.removeRequest(1));
+		testAssert(!queue.removeRequest(1));
+		testAssert(queue.setPriority(3, 0.5f));
+		testAssert(!queue.setPriority(100, 0.5f));
+		queue.setPriority(2, std::numeric_limits<float>::quiet_NaN());
+
+		Request request;
+		testAssert(queue.popMostImportant(request) && request.request_id == 3);
+		testAssert(queue.popMostImportant(request) && request.request_id == 2);
+		testAssert(queue.empty());
+
+		// Removed ids may be reused.
+		queue.addRequest(1, 1.f, "a");
+		testAssert(queue.size() == 1);
+	}
+
+	//-------------------- Test cell low LOD model requests are queued with file requests --------------------
+	{
+		ResourceRequestQueue queue;
+		queue.addRequest(1, 10.f, "a");
+		queue.addCellLowLODModelsRequest(2, 1.f, "world", Vec3<int>(1, -2, 3));
+
+		Request request;
+		testAssert(queue.popMostImportant(request) && request.request_id == 2);
+		testAssert(request.is_cell_low_lod_models_request && request.world_name == "world" && request.cell_coords == Vec3<int>(1, -2, 3));
+		testAssert(queue.popMostImportant(request) && request.request_id == 1 && !request.is_cell_low_lod_models_request);
+		testAssert(queue.empty());
+	}
+
+	//-------------------- Test invalid requests --------------------
+	{
+		ResourceRequestQueue queue;
+		queue.addRequest(1, 1.f, "a");
+		try
+		{
+			queue.addRequest(1, 1.f, "b");
+			failTest("Expected exception for duplicate request id");
+		}
+		catch(glare::Exception&)
+		{}
+
+		for(uint32 i=2; queue.size() < Protocol::MAX_OUTSTANDING_FILE_REQUESTS; ++i)
+			queue.addRequest(i, 1.f, "a");
+		try
+		{
+			queue.addRequest(100000, 1.f, "a");
+			failTest("Expected exception for too many requests");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+
+	conPrint("ResourceRequestQueue::test() done.");
+}
+
+
+#endif // BUILD_TESTS
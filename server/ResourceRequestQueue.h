@@ -0,0 +1,71 @@
+/*=====================================================================
+ResourceRequestQueue.h
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <vec3.h>
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+ResourceRequestQueue
+--------------------
+Pipelined resource download requests (RequestFile and RequestCellLowLODModels) from a single client that haven't been
+replied to yet.  Used by WorkerThread::handleResourceDownloadConnection(),
+which sends the most important request next, so the client can re-prioritise
+requests as the camera moves.
+
+Lower priority values are more important, requests with the same priority are
+sent in the order they were received.
+There are at most Protocol::MAX_OUTSTANDING_FILE_REQUESTS requests, so linear scans are fine.
+=====================================================================*/
+class ResourceRequestQueue
+{
+public:
+	ResourceRequestQueue();
+
+	struct Request
+	{
+		uint32 request_id;
+		float priority;
+		std::string URL;
+
+		bool is_cell_low_lod_models_request; // If true, this is a RequestCellLowLODModels request for the cell at cell_coords in the given world, and URL is unused.
+		std::string world_name;
+		Vec3<int> cell_coords;
+	};
+
+	// Throws glare::Exception if there are already Protocol::MAX_OUTSTANDING_FILE_REQUESTS requests, or a request with the same id.
+	void addRequest(uint32 request_id, float priority, const std::string& URL);
+	void addCellLowLODModelsRequest(uint32 request_id, float priority, const std::string& world_name, const Vec3<int>& cell_coords);
+
+	// Returns false if there was no request with the given id, e.g. if it has already been sent.
+	bool removeRequest(uint32 request_id);
+	bool setPriority(uint32 request_id, float priority);
+
+	// Removes the most important request and returns it in request_out.  Returns false if the queue is empty.
+	bool popMostImportant(Request& request_out);
+
+	bool empty() const { return requests.empty(); }
+	size_t size() const { return requests.size(); }
+
+	static void test();
+
+private:
+	void addRequest(const Request& request);
+	size_t findRequest(uint32 request_id) const; // Returns index in requests, or requests.size() if not found.
+
+	struct QueuedRequest
+	{
+		Request request;
+		uint64 seq_num; // Order the request was received in.
+	};
+
+	std::vector<QueuedRequest> requests;
+	uint64 next_seq_num;
+};
@@ -0,0 +1,170 @@
+/*=====================================================================
+ScreenshotVariantThread.cpp
+---------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ScreenshotVariantThread.h"
+
+
+#include "ServerWorldState.h"
+#include "ScreenshotVariants.h"
+#include <ConPrint.h>
+#include <Exception.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <PlatformUtils.h>
+#include <FileUtils.h>
+#include <KillThreadMessage.h>
+
+
+ScreenshotVariantThread::ScreenshotVariantThread(ServerAllWorldsState* world_state_)
+:	world_state(world_state_)
+{
+}
+
+
+ScreenshotVariantThread::~ScreenshotVariantThread()
+{
+}
+
+
+ScreenshotVariantThread::ScreenshotInfo ScreenshotVariantThread::getScreenshotInfo(const Screenshot& screenshot)
+{
+	ScreenshotInfo info;
+	info.local_path = screenshot.local_path;
+	info.URL = screenshot.URL;
+	info.is_map_tile = screenshot.is_map_tile;
+	return info;
+}
+
+
+void ScreenshotVariantThread::addTileVariantResource(const ScreenshotInfo& info, int width)
+{
+	const std::string URL = ScreenshotVariants::variantPath(info.URL, width);
+	ResourceRef resource = world_state->resource_manager->getOrCreateResourceForURL(URL); // Will create a new Resource ob if not already inserted.
+	if(resource->getState() == Resource::State_Present)
+		return;
+
+	FileUtils::copyFile(ScreenshotVariants::variantPath(info.local_path, width), world_state->resource_manager->getLocalAbsPathForResource(*resource));
+
+	resource->owner_id = UserID::invalidUserID();
+	resource->setState(Resource::State_Present);
+
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+		world_state->addResourcesAsDBDirty(resource);
+	}
+}
+
+
+void ScreenshotVariantThread::processScreenshot(const ScreenshotInfo& info)
+{
+	const int* widths = info.is_map_tile ? ScreenshotVariants::TILE_VARIANT_WIDTHS : ScreenshotVariants::THUMBNAIL_WIDTHS;
+	const size_t num_widths = info.is_map_tile ? staticArrayNumElems(ScreenshotVariants::TILE_VARIANT_WIDTHS) : staticArrayNumElems(ScreenshotVariants::THUMBNAIL_WIDTHS);
+	try
+	{
+		if(!ScreenshotVariants::variantsExist(info.local_path, widths, num_widths))
+			ScreenshotVariants::makeVariants(info.local_path, widths, num_widths);
+
+		if(info.is_map_tile && !info.URL.empty())
+		{
+			for(size_t i=0; i<num_widths; ++i)
+				if(FileUtils::fileExists(ScreenshotVariants::variantPath(info.local_path, widths[i])))
+					addTileVariantResource(info, widths[i]);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ScreenshotVariantThread: error while making variants of '" + info.local_path + "': " + e.what());
+	}
+}
+
+
+// Handles any queued messages without blocking, during the initial scan.  Screenshots from MakeScreenshotVariantsMessages are appended to screenshots_out, to be done after the scan.
+// Returns true if we got a kill message.
+bool ScreenshotVariantThread::checkMessages(std::vector<ScreenshotRef>& screenshots_out)
+{
+	ThreadSafeQueue<ThreadMessageRef>& queue = getMessageQueue();
+	Lock lock(queue.getMutex());
+	while(!queue.unlockedEmpty())
+	{
+		ThreadMessageRef msg;
+		queue.unlockedDequeue(msg);
+		if(dynamic_cast<MakeScreenshotVariantsMessage*>(msg.ptr()))
+			screenshots_out.push_back(static_cast<MakeScreenshotVariantsMessage*>(msg.ptr())->screenshot);
+		else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			return true;
+	}
+	return false;
+}
+
+
+void ScreenshotVariantThread::doRun()
+{
+	PlatformUtils::setCurrentThreadName("ScreenshotVariantThread");
+
+	try
+	{
+		// Initial scan over all done screenshots and map tiles.
+		std::vector<ScreenshotInfo> infos;
+		{
+			ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+			for(auto it = world_state->screenshots.begin(); it != world_state->screenshots.end(); ++it)
+				if(it->second->state == Screenshot::ScreenshotState_done && !it->second->is_map_tile)
+					infos.push_back(getScreenshotInfo(*it->second));
+
+			for(auto it = world_state->map_tile_info.info.begin(); it != world_state->map_tile_info.info.end(); ++it)
+			{
+				const TileInfo& tile_info = it->second;
+				if(tile_info.cur_tile_screenshot.nonNull() && tile_info.cur_tile_screenshot->state == Screenshot::ScreenshotState_done)
+					infos.push_back(getScreenshotInfo(*tile_info.cur_tile_screenshot));
+			}
+		}
+
+		std::vector<ScreenshotRef> screenshots_to_process; // From messages received during the scan.
+		for(size_t i=0; i<infos.size(); ++i)
+		{
+			if(checkMessages(screenshots_to_process))
+				return;
+
+			processScreenshot(infos[i]);
+		}
+		conPrint("ScreenshotVariantThread: initial scan done, checked " + toString(infos.size()) + " screenshot(s).");
+
+		for(size_t i=0; i<screenshots_to_process.size(); ++i)
+		{
+			ScreenshotInfo info;
+			{
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+				info = getScreenshotInfo(*screenshots_to_process[i]);
+			}
+			processScreenshot(info);
+		}
+
+		while(1)
+		{
+			// Block until we have a message
+			ThreadMessageRef msg;
+			getMessageQueue().dequeue(msg);
+
+			if(dynamic_cast<MakeScreenshotVariantsMessage*>(msg.ptr()))
+			{
+				ScreenshotInfo info;
+				{
+					ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+					info = getScreenshotInfo(*static_cast<MakeScreenshotVariantsMessage*>(msg.ptr())->screenshot);
+				}
+				processScreenshot(info);
+			}
+			else if(dynamic_cast<KillThreadMessage*>(msg.ptr()))
+			{
+				return;
+			}
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("ScreenshotVariantThread: glare::Exception: " + e.what());
+	}
+}
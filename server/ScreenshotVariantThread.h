@@ -0,0 +1,57 @@
+/*=====================================================================
+ScreenshotVariantThread.h
+-------------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "Screenshot.h"
+#include <MessageableThread.h>
+#include <string>
+#include <vector>
+class ServerAllWorldsState;
+
+
+class MakeScreenshotVariantsMessage : public ThreadMessage
+{
+public:
+	MakeScreenshotVariantsMessage(const ScreenshotRef& screenshot_) : screenshot(screenshot_) {}
+	ScreenshotRef screenshot;
+};
+
+
+/*=====================================================================
+ScreenshotVariantThread
+-----------------------
+Writes reduced-resolution variants of screenshots and map tiles, see ScreenshotVariants.
+Map tile variants are added as resources as well.
+
+When this thread starts, it does a scan over all done screenshots and map tiles, and makes any missing variants.
+After that it waits for MakeScreenshotVariantsMessage messages, which are sent when the screenshot bot sends a new screenshot.
+=====================================================================*/
+class ScreenshotVariantThread : public MessageableThread
+{
+public:
+	ScreenshotVariantThread(ServerAllWorldsState* world_state);
+
+	virtual ~ScreenshotVariantThread();
+
+	virtual void doRun();
+
+private:
+	// Copied from a Screenshot while holding the world state lock.
+	struct ScreenshotInfo
+	{
+		std::string local_path;
+		std::string URL;
+		bool is_map_tile;
+	};
+
+	static ScreenshotInfo getScreenshotInfo(const Screenshot& screenshot);
+	void processScreenshot(const ScreenshotInfo& info);
+	void addTileVariantResource(const ScreenshotInfo& info, int width);
+	bool checkMessages(std::vector<ScreenshotRef>& screenshots_out);
+
+	ServerAllWorldsState* world_state;
+};
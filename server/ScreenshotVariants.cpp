@@ -0,0 +1,213 @@
+/*=====================================================================
+ScreenshotVariants.cpp
+----------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ScreenshotVariants.h"
+
+
+#include "../shared/ImageDecoding.h"
+#include <graphics/ImageMap.h>
+#include <graphics/jpegdecoder.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <FileUtils.h>
+#include <RuntimeCheck.h>
+
+
+namespace ScreenshotVariants
+{
+
+
+const int THUMBNAIL_WIDTHS[2] = { 160, 320 };
+const int TILE_VARIANT_WIDTHS[2] = { 64, 128 };
+
+
+std::string variantPath(const std::string& path, int width)
+{
+	return ::removeDotAndExtension(path) + "_w" + toString(width) + ".jpg";
+}
+
+
+int chooseVariantWidth(const int* widths, size_t num_widths, int min_width)
+{
+	for(size_t i=0; i<num_widths; ++i)
+		if(widths[i] >= min_width)
+			return widths[i];
+	return 0;
+}
+
+
+// makeVariants() writes this file after making the variants, containing the list of widths it was called with.
+// Variants aren't made for widths that are as large as the image, so this lets us tell that the variants are done without decoding the image again.
+static std::string variantsDoneMarkerPath(const std::string& path)
+{
+	return ::removeDotAndExtension(path) + "_variants.txt";
+}
+
+
+static std::string widthsString(const int* widths, size_t num_widths)
+{
+	std::string s;
+	for(size_t i=0; i<num_widths; ++i)
+		s += (i > 0 ? "," : "") + toString(widths[i]);
+	return s;
+}
+
+
+bool variantsExist(const std::string& path, const int* widths, size_t num_widths)
+{
+	bool all_exist = true;
+	for(size_t i=0; i<num_widths; ++i)
+		if(!FileUtils::fileExists(variantPath(path, widths[i])))
+		{
+			all_exist = false;
+			break;
+		}
+	if(all_exist)
+		return true;
+
+	// Some variants may not have been made because the image is too small, check the marker file.
+	try
+	{
+		const std::string marker_path = variantsDoneMarkerPath(path);
+		if(!FileUtils::fileExists(marker_path))
+			return false;
+
+		std::string marker_contents;
+		FileUtils::readEntireFile(marker_path, marker_contents);
+		return marker_contents == widthsString(widths, num_widths);
+	}
+	catch(FileUtils::FileUtilsExcep&)
+	{
+		return false;
+	}
+}
+
+
+std::vector<int> makeVariants(const std::string& path, const int* widths, size_t num_widths)
+{
+	Reference<Map2D> map = ImageDecoding::decodeImage(".", path);
+	if(!map.isType<ImageMapUInt8>())
+		throw glare::Exception("Unhandled image type: " + path);
+
+	Reference<ImageMapUInt8> imagemap = map.downcast<ImageMapUInt8>();
+	if((imagemap->getWidth() == 0) || (imagemap->getHeight() == 0))
+		throw glare::Exception("Invalid image dimensions (zero)");
+
+	if(imagemap->getN() > 3)
+	{
+		Reference<Map2D> rgb_map = imagemap->extract3ChannelImage(); // JPEG can't store alpha.
+		imagemap = rgb_map.downcast<ImageMapUInt8>();
+	}
+
+	std::vector<int> widths_written;
+	for(size_t i=0; i<num_widths; ++i)
+	{
+		const int new_w = widths[i];
+		if(new_w >= (int)imagemap->getWidth()) // Don't make variants that are as large as the original.
+			continue;
+
+		const int new_h = myMax(1, (int)((float)new_w * (float)imagemap->getHeight() / (float)imagemap->getWidth()));
+
+		Reference<Map2D> resized_map = imagemap->resizeMidQuality(new_w, new_h, /*task manager=*/NULL);
+		runtimeCheck(resized_map.isType<ImageMapUInt8>());
+
+		JPEGDecoder::SaveOptions options;
+		options.quality = 85;
+		JPEGDecoder::save(resized_map.downcast<ImageMapUInt8>(), variantPath(path, new_w), options);
+
+		widths_written.push_back(new_w);
+	}
+
+	try
+	{
+		FileUtils::writeEntireFile(variantsDoneMarkerPath(path), widthsString(widths, num_widths));
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception("Error writing variants marker file: " + e.what());
+	}
+
+	return widths_written;
+}
+
+
+} // end namespace ScreenshotVariants
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+void ScreenshotVariants::test()
+{
+	conPrint("ScreenshotVariants::test()");
+
+	try
+	{
+		testAssert(variantPath("a/screenshot_abc.jpg", 320) == "a/screenshot_abc_w320.jpg");
+		testAssert(variantPath("tile_1_2_3_abc.jpg", 64) == "tile_1_2_3_abc_w64.jpg");
+
+		testAssert(chooseVariantWidth(TILE_VARIANT_WIDTHS, 2, 10) == 64);
+		testAssert(chooseVariantWidth(TILE_VARIANT_WIDTHS, 2, 64) == 64);
+		testAssert(chooseVariantWidth(TILE_VARIANT_WIDTHS, 2, 65) == 128);
+		testAssert(chooseVariantWidth(TILE_VARIANT_WIDTHS, 2, 200) == 0);
+		testAssert(chooseVariantWidth(TILE_VARIANT_WIDTHS, 0, 10) == 0);
+
+		const std::string dir = PlatformUtils::getTempDirPath() + "/screenshot_variants_test";
+		FileUtils::createDirIfDoesNotExist(dir);
+
+		// Make a test image
+		Reference<ImageMapUInt8> image = new ImageMapUInt8(256, 200, 3);
+		for(size_t y=0; y<image->getHeight(); ++y)
+		for(size_t x=0; x<image->getWidth(); ++x)
+		{
+			image->getPixel(x, y)[0] = (uint8)x;
+			image->getPixel(x, y)[1] = (uint8)y;
+			image->getPixel(x, y)[2] = 128;
+		}
+
+		const std::string path = dir + "/tile_test.jpg";
+		JPEGDecoder::save(image, path, JPEGDecoder::SaveOptions());
+
+		const int widths[] = { 64, 128, 256, 512 };
+		for(size_t i=0; i<staticArrayNumElems(widths); ++i)
+			if(FileUtils::fileExists(variantPath(path, widths[i])))
+				FileUtils::deleteFile(variantPath(path, widths[i]));
+		if(FileUtils::fileExists(variantsDoneMarkerPath(path)))
+			FileUtils::deleteFile(variantsDoneMarkerPath(path));
+
+		testAssert(!variantsExist(path, widths, 2));
+		testAssert(!variantsExist(path, widths, staticArrayNumElems(widths)));
+
+		const std::vector<int> widths_written = makeVariants(path, widths, staticArrayNumElems(widths));
+		testAssert(widths_written.size() == 2 && widths_written[0] == 64 && widths_written[1] == 128); // Variants as large as the image shouldn't be written.
+		testAssert(variantsExist(path, widths, 2));
+		testAssert(!FileUtils::fileExists(variantPath(path, 256)));
+
+		// The 256 and 512 px variants weren't made as the image is too small, but the variants should be considered done, so the image isn't decoded again.
+		testAssert(variantsExist(path, widths, staticArrayNumElems(widths)));
+
+		// If we ask for a different list of widths, the variants aren't done.
+		const int other_widths[] = { 32, 64, 128 };
+		testAssert(!variantsExist(path, other_widths, staticArrayNumElems(other_widths)));
+
+		Reference<Map2D> variant = ImageDecoding::decodeImage(".", variantPath(path, 128));
+		testAssert(variant->getMapWidth() == 128 && variant->getMapHeight() == 100);
+		testAssert(FileUtils::getFileSize(variantPath(path, 64)) < FileUtils::getFileSize(path));
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ScreenshotVariants::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,50 @@
+/*=====================================================================
+ScreenshotVariants.h
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <string>
+#include <vector>
+
+
+/*=====================================================================
+ScreenshotVariants
+------------------
+Reduced-resolution JPEG variants of screenshots and map tiles.
+
+Screenshots get thumbnails at THUMBNAIL_WIDTHS, for web pages that show screenshots at a small size.
+Map tiles (256 px wide) get variants at TILE_VARIANT_WIDTHS, which are also added as resources,
+so clients can download a smaller tile image when they draw it at a small size.
+
+For an image at path "dir/name.jpg", the variant with width w is stored at "dir/name_w<w>.jpg".
+The same naming is used for map tile resource URLs.  Variants are written by ScreenshotVariantThread.
+=====================================================================*/
+namespace ScreenshotVariants
+{
+
+const int FULL_TILE_WIDTH = 256; // Width of map tile screenshots.
+
+extern const int THUMBNAIL_WIDTHS[2];
+extern const int TILE_VARIANT_WIDTHS[2];
+
+std::string variantPath(const std::string& path, int width); // Also used for URLs.
+
+// Returns the width of the smallest variant that is at least min_width wide, or 0 if the original image should be used.
+// widths should be sorted in ascending order.
+int chooseVariantWidth(const int* widths, size_t num_widths, int min_width);
+
+// Returns true if all the variants for the image at path exist, or makeVariants() has been run for the image with these widths.
+// Doesn't decode the image.
+bool variantsExist(const std::string& path, const int* widths, size_t num_widths);
+
+// Writes a JPEG variant for each width that is smaller than the image width, and returns the widths written.
+// Also writes a small marker file next to the image, so variantsExist() can tell the variants are done even if some weren't written.
+// Throws glare::Exception on failure.
+std::vector<int> makeVariants(const std::string& path, const int* widths, size_t num_widths);
+
+void test();
+
+} // end namespace ScreenshotVariants
@@ -9,6 +9,8 @@ Copyright Glare Technologies Limited 2023 -
 #include "ListenerThread.h"
 #include "UDPHandlerThread.h"
 #include "MeshLODGenThread.h"
+#include "ResourceCompressionThread.h"
+#include "ScreenshotVariantThread.h"
 #include "DynamicTextureUpdaterThread.h"
 //#include "ChunkGenThread.h"
 #include "WorkerThread.h"
@@ -20,6 +22,7 @@ Copyright Glare Technologies Limited 2023 -
 #include "../webserver/WebServerRequestHandler.h"
 #include "../webserver/AccountHandlers.h"
 #include "../webserver/WebDataStore.h"
+#include "../webserver/WebResponseCache.h"
 #include "../webserver/WebDataFileWatcherThread.h"
 #if USE_GLARE_PARCEL_AUCTION_CODE
 #include <webserver/CoinbasePollerThread.h>
@@ -170,6 +173,16 @@ static ServerCredentials parseServerCredentials(const std::string& server_state_
 }
 
 
+// Parses e.g. <chat_message_rate_limit_per_s> and <chat_message_rate_limit_burst> elements.
+static RateLimitParams parseRateLimitParams(pugi::xml_node root_elem, const std::string& name, const RateLimitParams& default_params)
+{
+	return RateLimitParams(
+		XMLParseUtils::parseDoubleWithDefault(root_elem, (name + "_per_s").c_str(), default_params.rate_per_s),
+		XMLParseUtils::parseDoubleWithDefault(root_elem, (name + "_burst").c_str(), default_params.burst)
+	);
+}
+
+
 static ServerConfig parseServerConfig(const std::string& config_path)
 {
 	IndigoXMLDoc doc(config_path);
@@ -183,6 +196,17 @@ static ServerConfig parseServerConfig(const std::string& config_path)
 	config.tls_private_key_path			= XMLParseUtils::parseStringWithDefault(root_elem, "tls_private_key_path", /*default val=*/"");
 	config.allow_light_mapper_bot_full_perms = XMLParseUtils::parseBoolWithDefault(root_elem, "allow_light_mapper_bot_full_perms", /*default val=*/false);
 	config.update_parcel_sales			= XMLParseUtils::parseBoolWithDefault(root_elem, "update_parcel_sales", /*default val=*/false);
+	config.profile_world_state_mutex	= XMLParseUtils::parseBoolWithDefault(root_elem, "profile_world_state_mutex", /*default val=*/false);
+	config.password_hash_space_cost		= XMLParseUtils::parseIntWithDefault(root_elem, "password_hash_space_cost", /*default val=*/0);
+	config.password_hash_time_cost		= XMLParseUtils::parseIntWithDefault(root_elem, "password_hash_time_cost", /*default val=*/0);
+	config.password_hash_num_threads	= XMLParseUtils::parseIntWithDefault(root_elem, "password_hash_num_threads", /*default val=*/2);
+	config.connection_rate_limit				= parseRateLimitParams(root_elem, "connection_rate_limit", config.connection_rate_limit);
+	config.object_transform_update_rate_limit	= parseRateLimitParams(root_elem, "object_transform_update_rate_limit", config.object_transform_update_rate_limit);
+	config.chat_message_rate_limit				= parseRateLimitParams(root_elem, "chat_message_rate_limit", config.chat_message_rate_limit);
+	config.object_query_rate_limit				= parseRateLimitParams(root_elem, "object_query_rate_limit", config.object_query_rate_limit);
+	config.resource_upload_rate_limit			= parseRateLimitParams(root_elem, "resource_upload_rate_limit", config.resource_upload_rate_limit);
+	config.web_request_rate_limit				= parseRateLimitParams(root_elem, "web_request_rate_limit", config.web_request_rate_limit);
+	config.web_auth_request_rate_limit			= parseRateLimitParams(root_elem, "web_auth_request_rate_limit", config.web_auth_request_rate_limit);
 	return config;
 }
 
@@ -255,6 +279,39 @@ int main(int argc, char *argv[])
 
 		server.config = server_config;
 
+		if(server_config.profile_world_state_mutex)
+		{
+			conPrint("Enabling world state mutex profiling.");
+			LockProfiler::setEnabled(true);
+		}
+
+		// Set up rate limiters.  Don't rate limit in dev mode, where we may be running lots of test clients from one machine.
+		if(!dev_mode)
+		{
+			server.rate_limiters.connections.setParams(server_config.connection_rate_limit);
+			server.rate_limiters.object_transform_updates.setParams(server_config.object_transform_update_rate_limit);
+			server.rate_limiters.chat_messages.setParams(server_config.chat_message_rate_limit);
+			server.rate_limiters.object_queries.setParams(server_config.object_query_rate_limit);
+			server.rate_limiters.resource_uploads.setParams(server_config.resource_upload_rate_limit);
+			server.rate_limiters.web_requests.setParams(server_config.web_request_rate_limit);
+			server.rate_limiters.web_auth_requests.setParams(server_config.web_auth_request_rate_limit);
+		}
+
+		// Set up password hashing
+		{
+			PasswordHashParams params = PasswordHashing::defaultParams();
+			if(server_config.password_hash_space_cost > 0)
+				params.space_cost = (uint32)server_config.password_hash_space_cost;
+			if(server_config.password_hash_time_cost > 0)
+				params.time_cost = (uint32)server_config.password_hash_time_cost;
+			PasswordHashing::checkParamsValid(params); // Throws glare::Exception if invalid.
+			server.world_state->password_hash_params = params;
+
+			const int num_threads = myClamp(server_config.password_hash_num_threads, 1, 64);
+			server.world_state->password_hash_pool = new PasswordHashThreadPool(num_threads, /*max queue size=*/32 * num_threads);
+			conPrint("Password hashing: space_cost: " + toString(params.space_cost) + ", time_cost: " + toString(params.time_cost) + ", num threads: " + toString(num_threads));
+		}
+
 		// Parse server credentials
 		try
 		{
@@ -272,6 +329,8 @@ int main(int argc, char *argv[])
 
 		server.world_state->resource_manager = new ResourceManager(server_resource_dir);
 
+		server.chunked_upload_manager = new ChunkedUploadManager(server_state_dir + "/partial_uploads");
+
 
 		// Copy default avatar model into resource dir
 		{
@@ -338,6 +397,8 @@ int main(int argc, char *argv[])
 		
 		server.world_state->denormaliseData();
 
+		server.world_state->updateWebDataSnapshot(); // Build initial snapshot before the web server starts.
+
 		// If there are explicit paths to cert file and private key file in server config, use them, otherwise use default paths.
 		std::string tls_certificate_path, tls_private_key_path;
 		if(!server_config.tls_certificate_path.empty())
@@ -413,10 +474,13 @@ int main(int argc, char *argv[])
 
 		web_data_store->loadAndCompressFiles();
 
+		Reference<WebResponseCache> web_response_cache = new WebResponseCache(/*max total size=*/64 * 1024 * 1024);
+
 		Reference<WebServerSharedRequestHandler> shared_request_handler = new WebServerSharedRequestHandler();
 		shared_request_handler->data_store = web_data_store.ptr();
 		shared_request_handler->server = &server;
 		shared_request_handler->world_state = server.world_state.ptr();
+		shared_request_handler->response_cache = dev_mode ? NULL : web_response_cache.ptr(); // Don't cache pages in dev mode, so edits to fragment files show up straight away.
 		shared_request_handler->dev_mode = dev_mode;
 
 		ThreadManager web_thread_manager;
@@ -459,6 +523,10 @@ int main(int argc, char *argv[])
 
 		server.mesh_lod_gen_thread_manager.addThread(new MeshLODGenThread(server.world_state.ptr()));
 
+		server.resource_compression_thread_manager.addThread(new ResourceCompressionThread(server.world_state.ptr()));
+
+		server.screenshot_variant_thread_manager.addThread(new ScreenshotVariantThread(server.world_state.ptr()));
+
 		//thread_manager.addThread(new ChunkGenThread(server.world_state.ptr()));
 
 		server.udp_handler_thread_manager.addThread(new UDPHandlerThread(&server));
@@ -466,9 +534,13 @@ int main(int argc, char *argv[])
 		server.dyn_tex_updater_thread_manager.addThread(new DynamicTextureUpdaterThread(&server, server.world_state.ptr()));
 
 		Timer save_state_timer;
+		Timer web_data_snapshot_timer;
+		Timer partial_upload_sweep_timer;
 
 		// A map from world name to a vector of packets to send to clients connected to that world.
 		std::map<std::string, std::vector<std::string>> broadcast_packets;
+		std::vector<std::pair<std::string, Reference<ServerWorldState>>> worlds_to_process;
+		std::vector<DatabaseKey> db_records_to_delete; // Keys of deleted objects, collected while holding just the world locks.  Added to server.world_state->db_records_to_delete under the all-worlds lock.
 
 		// Main server loop
 		uint64 loop_iter = 0;
@@ -478,13 +550,19 @@ int main(int argc, char *argv[])
 
 			SocketBufferOutStream scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
-			{ // Begin scope for world_state->mutex lock
+			Timer tick_timer;
 
-				Lock lock(server.world_state->mutex);
+			// Copy the list of worlds, so we only hold the all-worlds lock briefly.  Each world is then processed while holding just its own lock.
+			{
+				ProfiledLock lock(server.world_state->mutex, LOCK_PROFILER_SITE());
+				worlds_to_process.assign(server.world_state->world_states.begin(), server.world_state->world_states.end());
+			}
 
-				for(auto world_it = server.world_state->world_states.begin(); world_it != server.world_state->world_states.end(); ++world_it)
+			{
+				for(auto world_it = worlds_to_process.begin(); world_it != worlds_to_process.end(); ++world_it)
 				{
 					Reference<ServerWorldState> world_state = world_it->second;
+					ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 					std::vector<std::string>& world_packets = broadcast_packets[world_it->first];
 
@@ -607,8 +685,8 @@ int main(int argc, char *argv[])
 								// Remove from dirty-set, so it's not updated in DB.
 								world_state->db_dirty_world_objects.erase(ob);
 
-								// Add DB record to list of records to be deleted.
-								server.world_state->db_records_to_delete.insert(ob->database_key);
+								// Add DB record to list of records to be deleted.  db_records_to_delete is protected by the all-worlds lock, so is added to below.
+								db_records_to_delete.push_back(ob->database_key);
 
 								// Remove ob from object map
 								world_state->objects.erase(ob->uid);
@@ -712,6 +790,14 @@ int main(int argc, char *argv[])
 					world_state->dirty_from_remote_objects.clear();
 				} // End for each server world
 
+				worlds_to_process.clear(); // Don't keep worlds alive longer than needed.
+
+
+				ProfiledLock lock(server.world_state->mutex, LOCK_PROFILER_SITE());
+
+				for(size_t z=0; z<db_records_to_delete.size(); ++z)
+					server.world_state->db_records_to_delete.insert(db_records_to_delete[z]);
+				db_records_to_delete.clear();
 
 				if(server.world_state->server_admin_message_changed)
 				{
@@ -732,7 +818,7 @@ int main(int argc, char *argv[])
 					server.world_state->server_admin_message_changed = false;
 				}
 
-			} // End scope for world_state->mutex lock
+			}
 
 			// Enqueue packets to worker threads to send
 			// For each connected client, get packets for the world the client is connected to, and send to them.
@@ -751,6 +837,8 @@ int main(int argc, char *argv[])
 			// Clear broadcast_packets vectors of packets.
 			for(auto it = broadcast_packets.begin(); it != broadcast_packets.end(); ++it)
 				it->second.clear();
+
+			server.metrics.tick_duration.recordDuration(tick_timer.elapsed());
 			
 			if((loop_iter % 40) == 0) // Approx every 4 s.
 			{
@@ -795,14 +883,36 @@ int main(int argc, char *argv[])
 			}
 #endif
 
+			if(LockProfiler::isEnabled() && ((loop_iter % 600) == 0)) // Approx every 60 s.
+				conPrint(LockProfiler::getWorstHoldersReport(/*max num sites=*/8));
+
+			// Rebuild the web data snapshot if any parcels, auctions, users or news posts have changed, at most once a second.
+			// Also rebuild every 10 s regardless, to pick up ephemeral state like BTC_per_EUR and the OpenSea listings.
+			if(((web_data_snapshot_timer.elapsed() > 1.0) && server.world_state->isWebDataSnapshotStale()) || (web_data_snapshot_timer.elapsed() > 10.0))
+			{
+				server.world_state->updateWebDataSnapshot();
+				web_data_snapshot_timer.reset();
+			}
+
+			// Delete partial uploads that haven't been resumed for a long time.  (Also done on startup by the ChunkedUploadManager constructor.)
+			if(server.chunked_upload_manager.nonNull() && (partial_upload_sweep_timer.elapsed() > 3600.0))
+			{
+				server.chunked_upload_manager->sweepStalePartialUploads((uint64)Clock::getSecsSince1970(), ChunkedUploadManager::MAX_PARTIAL_UPLOAD_AGE_S);
+				partial_upload_sweep_timer.reset();
+			}
+
 			if(server.world_state->hasChanged() && (save_state_timer.elapsed() > 10.0))
 			{
 				try
 				{
 					// Save world state to disk
-					Lock lock2(server.world_state->mutex);
+					ProfiledLock lock2(server.world_state->mutex, LOCK_PROFILER_SITE());
+
+					Timer serialise_timer;
+					const size_t num_records_written = server.world_state->serialiseToDisk();
 
-					server.world_state->serialiseToDisk();
+					server.metrics.serialise_to_disk_duration.recordDuration(serialise_timer.elapsed());
+					server.metrics.serialise_to_disk_records_written.add(num_records_written);
 
 					server.world_state->clearChangedFlag();
 					save_state_timer.reset();
@@ -7,6 +7,9 @@ Copyright Glare Technologies Limited 2016 -
 
 
 #include "ServerWorldState.h"
+#include "ServerMetrics.h"
+#include "RateLimiter.h"
+#include "ChunkedUploadManager.h"
 #include "ThreadManager.h"
 #include "../shared/ResourceManager.h"
 #include <IPAddress.h>
@@ -16,7 +19,9 @@ class WorkerThread;
 class ServerConfig
 {
 public:
-	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false) {}
+	ServerConfig() : allow_light_mapper_bot_full_perms(false), update_parcel_sales(false), profile_world_state_mutex(false), password_hash_space_cost(0), password_hash_time_cost(0), password_hash_num_threads(2),
+		connection_rate_limit(/*rate_per_s=*/2, /*burst=*/30), object_transform_update_rate_limit(100, 500), chat_message_rate_limit(1, 10), object_query_rate_limit(50, 1000),
+		resource_upload_rate_limit(5, 200), web_request_rate_limit(20, 200), web_auth_request_rate_limit(0.2, 10) {}
 	
 	std::string webserver_fragments_dir; // empty string = use default.
 	std::string webserver_public_files_dir; // empty string = use default.
@@ -28,6 +33,21 @@ public:
 	bool allow_light_mapper_bot_full_perms; // Allow lightmapper bot (User account with name "lightmapperbot" to have full write permissions.
 
 	bool update_parcel_sales; // Should we run auctions?
+
+	bool profile_world_state_mutex; // Record wait and hold times for each place the world state mutex is locked.  See LockProfiler.
+
+	int password_hash_space_cost; // Costs for new password hashes, see PasswordHashing.  0 = use default.
+	int password_hash_time_cost; // 0 = use default.
+	int password_hash_num_threads; // Number of threads in the password hashing thread pool.
+
+	// Rate limits, see ServerRateLimiters.  A rate <= 0 disables the limit.
+	RateLimitParams connection_rate_limit;
+	RateLimitParams object_transform_update_rate_limit;
+	RateLimitParams chat_message_rate_limit;
+	RateLimitParams object_query_rate_limit;
+	RateLimitParams resource_upload_rate_limit;
+	RateLimitParams web_request_rate_limit;
+	RateLimitParams web_auth_request_rate_limit;
 };
 
 
@@ -51,6 +71,8 @@ public:
 	double getCurrentGlobalTime() const;
 
 	void enqueueMsgForLodGenThread(ThreadMessageRef msg) { mesh_lod_gen_thread_manager.enqueueMessage(msg); }
+	void enqueueMsgForResourceCompressionThread(ThreadMessageRef msg) { resource_compression_thread_manager.enqueueMessage(msg); }
+	void enqueueMsgForScreenshotVariantThread(ThreadMessageRef msg) { screenshot_variant_thread_manager.enqueueMessage(msg); }
 
 
 	// Called from off main thread
@@ -68,6 +90,10 @@ public:
 
 	ThreadManager mesh_lod_gen_thread_manager;
 
+	ThreadManager resource_compression_thread_manager;
+
+	ThreadManager screenshot_variant_thread_manager;
+
 	ThreadManager udp_handler_thread_manager;
 
 	ThreadManager dyn_tex_updater_thread_manager;
@@ -79,4 +105,10 @@ public:
 	Mutex connected_clients_mutex;
 	std::map<WorkerThread*, ServerConnectedClientInfo> connected_clients;
 	glare::AtomicInt connected_clients_changed;
+
+	ServerMetrics metrics;
+
+	ServerRateLimiters rate_limiters;
+
+	Reference<ChunkedUploadManager> chunked_upload_manager; // May be NULL, e.g. when fuzzing.
 };
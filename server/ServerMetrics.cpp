@@ -0,0 +1,512 @@
+/*=====================================================================
+ServerMetrics.cpp
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "ServerMetrics.h"
+
+
+#include "../shared/Protocol.h"
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <cstring>
+#include <cmath>
+#include <limits>
+
+
+static std::atomic<int> next_thread_shard_index(0);
+
+
+int MetricsShards::getThreadShardIndex()
+{
+	static thread_local int index = next_thread_shard_index.fetch_add(1) % NUM_SHARDS;
+	return index;
+}
+
+
+MetricCounter::MetricCounter()
+{
+	for(int i=0; i<MetricsShards::NUM_SHARDS; ++i)
+		shards[i].val = 0;
+}
+
+
+uint64 MetricCounter::getValue() const
+{
+	uint64 sum = 0;
+	for(int i=0; i<MetricsShards::NUM_SHARDS; ++i)
+		sum += shards[i].val.load(std::memory_order_relaxed);
+	return sum;
+}
+
+
+const double MetricHistogram::bucket_upper_bounds[MetricHistogram::NUM_BUCKETS - 1] = {
+	0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0
+};
+
+
+MetricHistogram::MetricHistogram()
+{
+	for(int i=0; i<MetricsShards::NUM_SHARDS; ++i)
+	{
+		for(int z=0; z<NUM_BUCKETS; ++z)
+			shards[i].bucket_counts[z] = 0;
+		shards[i].sum_ns = 0;
+	}
+}
+
+
+void MetricHistogram::recordDuration(double t_s)
+{
+	int bucket = NUM_BUCKETS - 1;
+	for(int i=0; i<NUM_BUCKETS - 1; ++i)
+		if(t_s <= bucket_upper_bounds[i])
+		{
+			bucket = i;
+			break;
+		}
+
+	Shard& shard = shards[MetricsShards::getThreadShardIndex()];
+	shard.bucket_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+	shard.sum_ns.fetch_add((t_s > 0) ? (uint64)(t_s * 1.0e9) : 0, std::memory_order_relaxed);
+}
+
+
+void MetricHistogram::getTotals(uint64* bucket_counts_out, uint64& count_out, double& sum_s_out) const
+{
+	uint64 sum_ns = 0;
+	count_out = 0;
+	for(int z=0; z<NUM_BUCKETS; ++z)
+		bucket_counts_out[z] = 0;
+
+	for(int i=0; i<MetricsShards::NUM_SHARDS; ++i)
+	{
+		for(int z=0; z<NUM_BUCKETS; ++z)
+		{
+			const uint64 c = shards[i].bucket_counts[z].load(std::memory_order_relaxed);
+			bucket_counts_out[z] += c;
+			count_out += c;
+		}
+		sum_ns += shards[i].sum_ns.load(std::memory_order_relaxed);
+	}
+
+	sum_s_out = sum_ns * 1.0e-9;
+}
+
+
+double MetricHistogram::getQuantileUpperBound(double q) const
+{
+	uint64 counts[NUM_BUCKETS];
+	uint64 count;
+	double sum_s;
+	getTotals(counts, count, sum_s);
+	if(count == 0)
+		return 0;
+
+	const uint64 target = (uint64)(q * count);
+	uint64 cumulative = 0;
+	for(int z=0; z<NUM_BUCKETS - 1; ++z)
+	{
+		cumulative += counts[z];
+		if(cumulative > target)
+			return bucket_upper_bounds[z];
+	}
+	return std::numeric_limits<double>::infinity();
+}
+
+
+void MetricHistogram::appendPrometheusText(const std::string& name, const std::string& labels, std::string& s) const
+{
+	uint64 counts[NUM_BUCKETS];
+	uint64 count;
+	double sum_s;
+	getTotals(counts, count, sum_s);
+
+	const std::string label_prefix = labels.empty() ? "" : (labels + ",");
+
+	uint64 cumulative = 0;
+	for(int z=0; z<NUM_BUCKETS; ++z)
+	{
+		cumulative += counts[z];
+		const std::string le = (z < NUM_BUCKETS - 1) ? doubleToStringMaxNDecimalPlaces(bucket_upper_bounds[z], 6) : std::string("+Inf");
+		s += name + "_bucket{" + label_prefix + "le=\"" + le + "\"} " + toString(cumulative) + "\n";
+	}
+
+	const std::string label_str = labels.empty() ? "" : ("{" + labels + "}");
+	s += name + "_sum" + label_str + " " + doubleToStringMaxNDecimalPlaces(sum_s, 9) + "\n";
+	s += name + "_count" + label_str + " " + toString(count) + "\n";
+}
+
+
+struct MessageTypeInfo
+{
+	uint32 msg_type;
+	const char* name;
+};
+
+// Message types we keep individual counts for.  Any other message type is counted under 'Unknown'.
+static const MessageTypeInfo message_types[] = {
+	{ Protocol::CyberspaceGoodbye,				"CyberspaceGoodbye" },
+	{ Protocol::ClientUDPSocketOpen,			"ClientUDPSocketOpen" },
+	{ Protocol::AudioStreamToServerStarted,		"AudioStreamToServerStarted" },
+	{ Protocol::AudioStreamToServerEnded,		"AudioStreamToServerEnded" },
+	{ Protocol::AvatarCreated,					"AvatarCreated" },
+	{ Protocol::AvatarDestroyed,				"AvatarDestroyed" },
+	{ Protocol::AvatarTransformUpdate,			"AvatarTransformUpdate" },
+	{ Protocol::AvatarFullUpdate,				"AvatarFullUpdate" },
+	{ Protocol::CreateAvatar,					"CreateAvatar" },
+	{ Protocol::AvatarIsHere,					"AvatarIsHere" },
+	{ Protocol::AvatarPerformGesture,			"AvatarPerformGesture" },
+	{ Protocol::AvatarStopGesture,				"AvatarStopGesture" },
+	{ Protocol::AvatarEnteredVehicle,			"AvatarEnteredVehicle" },
+	{ Protocol::AvatarExitedVehicle,			"AvatarExitedVehicle" },
+	{ Protocol::ChatMessageID,					"ChatMessage" },
+	{ Protocol::ObjectCreated,					"ObjectCreated" },
+	{ Protocol::ObjectDestroyed,				"ObjectDestroyed" },
+	{ Protocol::ObjectTransformUpdate,			"ObjectTransformUpdate" },
+	{ Protocol::ObjectFullUpdate,				"ObjectFullUpdate" },
+	{ Protocol::ObjectLightmapURLChanged,		"ObjectLightmapURLChanged" },
+	{ Protocol::ObjectFlagsChanged,				"ObjectFlagsChanged" },
+	{ Protocol::ObjectModelURLChanged,			"ObjectModelURLChanged" },
+	{ Protocol::ObjectPhysicsOwnershipTaken,	"ObjectPhysicsOwnershipTaken" },
+	{ Protocol::ObjectPhysicsTransformUpdate,	"ObjectPhysicsTransformUpdate" },
+	{ Protocol::SummonObject,					"SummonObject" },
+	{ Protocol::CreateObject,					"CreateObject" },
+	{ Protocol::DestroyObject,					"DestroyObject" },
+	{ Protocol::QueryObjects,					"QueryObjects" },
+	{ Protocol::ObjectInitialSend,				"ObjectInitialSend" },
+	{ Protocol::QueryObjectsInAABB,				"QueryObjectsInAABB" },
+	{ Protocol::ParcelCreated,					"ParcelCreated" },
+	{ Protocol::ParcelDestroyed,				"ParcelDestroyed" },
+	{ Protocol::ParcelFullUpdate,				"ParcelFullUpdate" },
+	{ Protocol::QueryParcels,					"QueryParcels" },
+	{ Protocol::ParcelList,						"ParcelList" },
+	{ Protocol::GetAllObjects,					"GetAllObjects" },
+	{ Protocol::AllObjectsSent,					"AllObjectsSent" },
+	{ Protocol::WorldSettingsInitialSendMessage,"WorldSettingsInitialSendMessage" },
+	{ Protocol::WorldSettingsUpdate,			"WorldSettingsUpdate" },
+	{ Protocol::QueryMapTiles,					"QueryMapTiles" },
+	{ Protocol::MapTilesResult,					"MapTilesResult" },
+	{ Protocol::QueryMapTilesInRect,			"QueryMapTilesInRect" },
+	{ Protocol::GetFile,						"GetFile" },
+	{ Protocol::GetFiles,						"GetFiles" },
+	{ Protocol::NewResourceOnServer,			"NewResourceOnServer" },
+	{ Protocol::UserSelectedObject,				"UserSelectedObject" },
+	{ Protocol::UserDeselectedObject,			"UserDeselectedObject" },
+	{ Protocol::InfoMessageID,					"InfoMessage" },
+	{ Protocol::ErrorMessageID,					"ErrorMessage" },
+	{ Protocol::ServerAdminMessageID,			"ServerAdminMessage" },
+	{ Protocol::LogInMessage,					"LogInMessage" },
+	{ Protocol::LogOutMessage,					"LogOutMessage" },
+	{ Protocol::SignUpMessage,					"SignUpMessage" },
+	{ Protocol::LoggedInMessageID,				"LoggedInMessage" },
+	{ Protocol::LoggedOutMessageID,				"LoggedOutMessage" },
+	{ Protocol::SignedUpMessageID,				"SignedUpMessage" },
+	{ Protocol::RequestPasswordReset,			"RequestPasswordReset" },
+	{ Protocol::ChangePasswordWithResetToken,	"ChangePasswordWithResetToken" },
+	{ Protocol::TimeSyncMessage,				"TimeSyncMessage" },
+	{ Protocol::KeepAlive,						"KeepAlive" }
+};
+
+static const int NUM_MESSAGE_TYPES = (int)staticArrayNumElems(message_types);
+
+
+// Paths routed by WebServerRequestHandler::handleRequest(), with any trailing ID stripped.  See webHandlerKeyForPath().
+static const char* web_get_handler_paths[] = {
+	"/", "/terms", "/about_parcel_sales", "/about_scripting", "/about_substrata", "/running_your_own_server", "/bot_status", "/faq", "/map",
+	"/pdt_landing", "/parcel_auction_list", "/recent_parcel_sales", "/parcel_auction", "/buy_parcel_with_paypal", "/buy_parcel_with_coinbase", "/order",
+	"/parcel", "/edit_parcel_description", "/add_parcel_writer", "/remove_parcel_writer",
+	"/admin", "/admin_users", "/admin_user", "/admin_parcels", "/admin_parcel_auctions", "/admin_parcel_auction", "/admin_orders", "/admin_sub_eth_transactions",
+	"/admin_news_posts", "/admin_sub_eth_transaction", "/admin_map", "/admin_create_parcel_auction", "/admin_set_parcel_owner", "/admin_order",
+	"/login", "/signup", "/reset_password", "/reset_password_email", "/change_password", "/account", "/prove_eth_address_owner", "/prove_parcel_owner_by_nft",
+	"/make_parcel_into_nft", "/parcel_claim_succeeded", "/parcel_claim_failed", "/parcel_claim_invalid", "/making_parcel_into_nft", "/making_parcel_into_nft_failed",
+	"/p", "/screenshot", "/tile", "/news_post", "/edit_news_post", "/news", "/files", "/resource", "/webclient", "/gui_client.data", "/metrics"
+};
+
+static const char* web_post_handler_paths[] = {
+	"/login_post", "/logout_post", "/signup_post", "/reset_password_post", "/change_password_post", "/set_new_password_post",
+	"/ipn_listener", "/coinbase_webhook", "/buy_parcel_now_paypal", "/buy_parcel_now_coinbase", "/buy_parcel_with_paypal_post", "/buy_parcel_with_coinbase_post",
+	"/admin_create_parcel_auction_post", "/admin_set_parcel_owner_post", "/admin_regenerate_parcel_auction_screenshots", "/admin_regenerate_parcel_screenshots",
+	"/admin_regenerate_multiple_parcel_screenshots", "/admin_terminate_parcel_auction", "/admin_mark_parcel_as_nft_minted_post", "/admin_mark_parcel_as_not_nft_post",
+	"/admin_retry_parcel_mint_post", "/admin_set_transaction_state_to_new_post", "/admin_set_transaction_state_to_completed_post", "/admin_set_transaction_state_hash",
+	"/admin_set_transaction_nonce", "/admin_set_server_admin_message_post", "/admin_set_read_only_mode_post", "/admin_force_dyn_tex_update_post",
+	"/admin_delete_transaction_post", "/admin_regen_map_tiles_post", "/admin_recreate_map_tiles_post", "/admin_set_min_next_nonce_post",
+	"/admin_set_user_as_world_gardener_post", "/admin_set_user_allow_dyn_tex_update_post", "/admin_new_news_post",
+	"/regenerate_parcel_screenshots", "/edit_parcel_description_post", "/add_parcel_writer_post", "/remove_parcel_writer_post",
+	"/account_eth_sign_message_post", "/make_parcel_into_nft_post", "/claim_parcel_owner_by_nft_post", "/edit_news_post_post", "/delete_news_post"
+};
+
+
+// Strip anything after the first path component, e.g. "/parcel/123" -> "/parcel", so that we don't get a histogram per parcel.
+static std::string webHandlerKeyForPath(const std::string& verb, const std::string& path)
+{
+	const size_t slash_pos = path.find('/', 1);
+	const std::string first_component = (slash_pos == std::string::npos) ? path : path.substr(0, slash_pos);
+	return verb + " " + first_component;
+}
+
+
+ServerMetrics::ServerMetrics()
+{
+	messages_in			= new MetricCounter[NUM_MESSAGE_TYPES + 1];
+	messages_in_bytes	= new MetricCounter[NUM_MESSAGE_TYPES + 1];
+	messages_out		= new MetricCounter[NUM_MESSAGE_TYPES + 1];
+	messages_out_bytes	= new MetricCounter[NUM_MESSAGE_TYPES + 1];
+
+	for(size_t i=0; i<staticArrayNumElems(web_get_handler_paths); ++i)
+		web_handler_latency[std::string("GET ") + web_get_handler_paths[i]] = new MetricHistogram();
+	for(size_t i=0; i<staticArrayNumElems(web_post_handler_paths); ++i)
+		web_handler_latency[std::string("POST ") + web_post_handler_paths[i]] = new MetricHistogram();
+
+	other_web_handler_latency = new MetricHistogram();
+}
+
+
+ServerMetrics::~ServerMetrics()
+{
+	delete[] messages_in;
+	delete[] messages_in_bytes;
+	delete[] messages_out;
+	delete[] messages_out_bytes;
+}
+
+
+int ServerMetrics::messageTypeIndex(uint32 msg_type)
+{
+	for(int i=0; i<NUM_MESSAGE_TYPES; ++i)
+		if(message_types[i].msg_type == msg_type)
+			return i;
+	return NUM_MESSAGE_TYPES;
+}
+
+
+void ServerMetrics::recordMessageIn(uint32 msg_type, size_t msg_len)
+{
+	const int index = messageTypeIndex(msg_type);
+	messages_in[index].increment();
+	messages_in_bytes[index].add(msg_len);
+	bytes_received.add(msg_len);
+}
+
+
+void ServerMetrics::recordMessageOut(const void* msg_data, size_t msg_len)
+{
+	if(msg_len < sizeof(uint32))
+		return;
+
+	uint32 msg_type;
+	std::memcpy(&msg_type, msg_data, sizeof(uint32));
+
+	const int index = messageTypeIndex(msg_type);
+	messages_out[index].increment();
+	messages_out_bytes[index].add(msg_len);
+}
+
+
+MetricHistogram* ServerMetrics::getWebHandlerLatencyHistogram(const std::string& verb, const std::string& path)
+{
+	const auto res = web_handler_latency.find(webHandlerKeyForPath(verb, path));
+	if(res != web_handler_latency.end())
+		return res->second.ptr();
+	else
+		return other_web_handler_latency.ptr();
+}
+
+
+static void appendCounter(const std::string& name, const std::string& help, const MetricCounter& counter, std::string& s)
+{
+	s += "# HELP " + name + " " + help + "\n";
+	s += "# TYPE " + name + " counter\n";
+	s += name + " " + toString(counter.getValue()) + "\n";
+}
+
+
+static void appendHistogram(const std::string& name, const std::string& help, const MetricHistogram& hist, std::string& s)
+{
+	s += "# HELP " + name + " " + help + "\n";
+	s += "# TYPE " + name + " histogram\n";
+	hist.appendPrometheusText(name, "", s);
+}
+
+
+void ServerMetrics::appendPrometheusText(std::string& s) const
+{
+	appendCounter("substrata_bytes_sent_total", "Bytes sent to clients on updates and resource connections.", bytes_sent, s);
+	appendCounter("substrata_bytes_received_total", "Bytes received from clients on updates and resource connections.", bytes_received, s);
+
+	s += "# HELP substrata_send_queue_bytes Bytes currently queued in WorkerThread send queues.\n";
+	s += "# TYPE substrata_send_queue_bytes gauge\n";
+	const uint64 enqueued = send_queue_bytes_enqueued.getValue();
+	const uint64 dequeued = send_queue_bytes_dequeued.getValue();
+	s += "substrata_send_queue_bytes " + toString(enqueued >= dequeued ? (enqueued - dequeued) : (uint64)0) + "\n";
+
+	s += "# HELP substrata_messages_in_total Messages received from clients, by message type.\n";
+	s += "# TYPE substrata_messages_in_total counter\n";
+	for(int i=0; i<=NUM_MESSAGE_TYPES; ++i)
+	{
+		const uint64 count = messages_in[i].getValue();
+		if(count > 0)
+			s += std::string("substrata_messages_in_total{type=\"") + ((i < NUM_MESSAGE_TYPES) ? message_types[i].name : "Unknown") + "\"} " + toString(count) + "\n";
+	}
+
+	s += "# HELP substrata_messages_in_bytes_total Bytes of messages received from clients, by message type.\n";
+	s += "# TYPE substrata_messages_in_bytes_total counter\n";
+	for(int i=0; i<=NUM_MESSAGE_TYPES; ++i)
+	{
+		const uint64 count = messages_in_bytes[i].getValue();
+		if(count > 0)
+			s += std::string("substrata_messages_in_bytes_total{type=\"") + ((i < NUM_MESSAGE_TYPES) ? message_types[i].name : "Unknown") + "\"} " + toString(count) + "\n";
+	}
+
+	s += "# HELP substrata_messages_out_total Messages queued to be sent to clients, by message type.\n";
+	s += "# TYPE substrata_messages_out_total counter\n";
+	for(int i=0; i<=NUM_MESSAGE_TYPES; ++i)
+	{
+		const uint64 count = messages_out[i].getValue();
+		if(count > 0)
+			s += std::string("substrata_messages_out_total{type=\"") + ((i < NUM_MESSAGE_TYPES) ? message_types[i].name : "Unknown") + "\"} " + toString(count) + "\n";
+	}
+
+	s += "# HELP substrata_messages_out_bytes_total Bytes of messages queued to be sent to clients, by message type.\n";
+	s += "# TYPE substrata_messages_out_bytes_total counter\n";
+	for(int i=0; i<=NUM_MESSAGE_TYPES; ++i)
+	{
+		const uint64 count = messages_out_bytes[i].getValue();
+		if(count > 0)
+			s += std::string("substrata_messages_out_bytes_total{type=\"") + ((i < NUM_MESSAGE_TYPES) ? message_types[i].name : "Unknown") + "\"} " + toString(count) + "\n";
+	}
+
+	appendHistogram("substrata_tick_duration_seconds", "Duration of the main server loop broadcast-generation step.", tick_duration, s);
+	appendHistogram("substrata_serialise_to_disk_duration_seconds", "Duration of ServerAllWorldsState::serialiseToDisk().", serialise_to_disk_duration, s);
+	appendCounter("substrata_serialise_to_disk_records_written_total", "Database records written by serialiseToDisk().", serialise_to_disk_records_written, s);
+
+	appendCounter("substrata_udp_packets_received_total", "UDP packets received by the UDPHandlerThread.", udp_packets_received, s);
+	appendCounter("substrata_udp_voice_packets_relayed_total", "Voice UDP packets sent on to clients (one per destination client).", udp_voice_packets_relayed, s);
+
+	appendCounter("substrata_web_response_cache_hits_total", "Web page requests served from the WebResponseCache.", web_response_cache_hits, s);
+	appendCounter("substrata_web_response_cache_misses_total", "Cacheable web page requests that had to be rendered.", web_response_cache_misses, s);
+	appendCounter("substrata_web_not_modified_responses_total", "304 Not Modified responses sent for cacheable web pages.", web_not_modified_responses, s);
+
+	s += "# HELP substrata_web_request_duration_seconds Web request handling latency, by handler.\n";
+	s += "# TYPE substrata_web_request_duration_seconds histogram\n";
+	for(auto it = web_handler_latency.begin(); it != web_handler_latency.end(); ++it)
+	{
+		uint64 counts[MetricHistogram::NUM_BUCKETS];
+		uint64 count;
+		double sum_s;
+		it->second->getTotals(counts, count, sum_s);
+		if(count > 0) // Don't write out the (many) handlers that haven't been used.
+			it->second->appendPrometheusText("substrata_web_request_duration_seconds", "handler=\"" + it->first + "\"", s);
+	}
+	other_web_handler_latency->appendPrometheusText("substrata_web_request_duration_seconds", "handler=\"other\"", s);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/MyThread.h>
+#include <vector>
+
+
+class MetricsTestThread : public MyThread
+{
+public:
+	MetricsTestThread(ServerMetrics* metrics_, int num_iters_) : metrics(metrics_), num_iters(num_iters_) {}
+
+	virtual void run()
+	{
+		for(int i=0; i<num_iters; ++i)
+		{
+			metrics->bytes_sent.add(2);
+			metrics->tick_duration.recordDuration(0.0001);
+		}
+	}
+
+	ServerMetrics* metrics;
+	int num_iters;
+};
+
+
+void ServerMetrics::test()
+{
+	conPrint("ServerMetrics::test()");
+
+	//-------------------- Test MetricCounter summing over shards --------------------
+	{
+		ServerMetrics metrics;
+
+		const int num_threads = 24; // More threads than shards, so some shards are shared.
+		const int num_iters = 10000;
+		std::vector<Reference<MetricsTestThread>> threads;
+		for(int i=0; i<num_threads; ++i)
+		{
+			threads.push_back(new MetricsTestThread(&metrics, num_iters));
+			threads.back()->launch();
+		}
+		for(size_t i=0; i<threads.size(); ++i)
+			threads[i]->join();
+
+		testAssert(metrics.bytes_sent.getValue() == (uint64)num_threads * num_iters * 2);
+
+		uint64 counts[MetricHistogram::NUM_BUCKETS];
+		uint64 count;
+		double sum_s;
+		metrics.tick_duration.getTotals(counts, count, sum_s);
+		testAssert(count == (uint64)num_threads * num_iters);
+		testAssert(counts[1] == count); // 0.0001 should be in the <= 0.0001 bucket.
+		testAssert(std::fabs(sum_s - num_threads * num_iters * 0.0001) < 1.0e-3);
+	}
+
+	//-------------------- Test MetricHistogram bucketing and quantiles --------------------
+	{
+		MetricHistogram hist;
+		testAssert(hist.getQuantileUpperBound(0.5) == 0);
+
+		for(int i=0; i<90; ++i)
+			hist.recordDuration(0.002);
+		for(int i=0; i<10; ++i)
+			hist.recordDuration(20.0); // Goes in the +Inf bucket
+
+		testAssert(hist.getQuantileUpperBound(0.5) == 0.0025);
+		testAssert(hist.getQuantileUpperBound(0.89) == 0.0025);
+		testAssert(hist.getQuantileUpperBound(0.95) == std::numeric_limits<double>::infinity());
+
+		std::string s;
+		hist.appendPrometheusText("test_hist", "", s);
+		testAssert(s.find("test_hist_bucket{le=\"+Inf\"} 100\n") != std::string::npos);
+		testAssert(s.find("test_hist_count 100\n") != std::string::npos);
+	}
+
+	//-------------------- Test message type counting and web handler lookup --------------------
+	{
+		ServerMetrics metrics;
+		metrics.recordMessageIn(Protocol::ChatMessageID, 100);
+		metrics.recordMessageIn(Protocol::ChatMessageID, 50);
+		metrics.recordMessageIn(/*msg type=*/123456, 10);
+
+		const uint32 msg_type = Protocol::TimeSyncMessage;
+		uint8 msg[16];
+		std::memcpy(msg, &msg_type, sizeof(uint32));
+		metrics.recordMessageOut(msg, sizeof(msg));
+
+		testAssert(metrics.bytes_received.getValue() == 160);
+
+		std::string s;
+		metrics.appendPrometheusText(s);
+		testAssert(s.find("substrata_messages_in_total{type=\"ChatMessage\"} 2\n") != std::string::npos);
+		testAssert(s.find("substrata_messages_in_total{type=\"Unknown\"} 1\n") != std::string::npos);
+		testAssert(s.find("substrata_messages_out_bytes_total{type=\"TimeSyncMessage\"} 16\n") != std::string::npos);
+
+		testAssert(metrics.getWebHandlerLatencyHistogram("GET", "/parcel/123") == metrics.getWebHandlerLatencyHistogram("GET", "/parcel/456"));
+		testAssert(metrics.getWebHandlerLatencyHistogram("GET", "/parcel/123") != metrics.getWebHandlerLatencyHistogram("GET", "/"));
+		testAssert(metrics.getWebHandlerLatencyHistogram("GET", "/nonexistent_page") == metrics.other_web_handler_latency.ptr());
+		testAssert(metrics.getWebHandlerLatencyHistogram("POST", "/parcel/123") == metrics.other_web_handler_latency.ptr());
+	}
+
+	conPrint("ServerMetrics::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,155 @@
+/*=====================================================================
+ServerMetrics.h
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Platform.h>
+#include <atomic>
+#include <string>
+#include <map>
+
+
+namespace MetricsShards
+{
+	const int NUM_SHARDS = 16;
+
+	// Returns the shard index for the calling thread.  Each thread gets a fixed index, assigned round-robin on first use.
+	int getThreadShardIndex();
+}
+
+
+/*=====================================================================
+MetricCounter
+-------------
+A monotonically increasing counter that can be incremented from many threads without contention.
+The count is split over NUM_SHARDS cache-line sized slots, each thread only adds to its own slot.
+Reading the value sums over all the slots.
+=====================================================================*/
+class MetricCounter
+{
+public:
+	MetricCounter();
+
+	inline void add(uint64 x) { shards[MetricsShards::getThreadShardIndex()].val.fetch_add(x, std::memory_order_relaxed); }
+	inline void increment() { add(1); }
+
+	uint64 getValue() const;
+
+private:
+	GLARE_DISABLE_COPY(MetricCounter);
+
+	struct alignas(64) Shard
+	{
+		std::atomic<uint64> val;
+	};
+	Shard shards[MetricsShards::NUM_SHARDS];
+};
+
+
+/*=====================================================================
+MetricHistogram
+---------------
+A histogram of durations, with fixed exponentially-spaced buckets.
+Recording is lock-free, using per-thread shards as in MetricCounter.
+=====================================================================*/
+class MetricHistogram : public ThreadSafeRefCounted
+{
+public:
+	static const int NUM_BUCKETS = 18; // Including the final +Inf bucket.
+
+	MetricHistogram();
+
+	void recordDuration(double t_s); // Threadsafe
+
+	// Sums over shards.  bucket_counts_out should have NUM_BUCKETS elements.  Counts are non-cumulative.
+	void getTotals(uint64* bucket_counts_out, uint64& count_out, double& sum_s_out) const;
+
+	// Returns an estimate of the given quantile (0-1), in seconds.  Returns the upper bound of the bucket the quantile falls in.
+	double getQuantileUpperBound(double q) const;
+
+	// Append in Prometheus text exposition format.  labels is something like 'handler="/parcel"', or empty.
+	void appendPrometheusText(const std::string& name, const std::string& labels, std::string& s) const;
+
+	static const double bucket_upper_bounds[NUM_BUCKETS - 1]; // In seconds.
+
+private:
+	GLARE_DISABLE_COPY(MetricHistogram);
+
+	struct alignas(64) Shard
+	{
+		std::atomic<uint64> bucket_counts[NUM_BUCKETS];
+		std::atomic<uint64> sum_ns;
+	};
+	Shard shards[MetricsShards::NUM_SHARDS];
+};
+typedef Reference<MetricHistogram> MetricHistogramRef;
+
+
+/*=====================================================================
+ServerMetrics
+-------------
+Server-wide counters and latency histograms.
+Rendered in text form at /metrics by MetricsHandlers.
+
+All the record/add methods are threadsafe and lock-free, so may be called from hot paths.
+Gauges that can be cheaply computed from existing server state (connected clients per world, queue depths) are computed
+when the metrics are rendered instead.
+=====================================================================*/
+class ServerMetrics
+{
+public:
+	ServerMetrics();
+	~ServerMetrics();
+
+	void recordMessageIn(uint32 msg_type, size_t msg_len);
+
+	// Counts a single message (with type and length header) that is being queued to be sent to a client.
+	void recordMessageOut(const void* msg_data, size_t msg_len);
+
+	// Returns the latency histogram for the web handler that will serve the given path.  Never returns NULL.
+	MetricHistogram* getWebHandlerLatencyHistogram(const std::string& verb, const std::string& path);
+
+	// Append all metrics in this object in Prometheus text exposition format.
+	void appendPrometheusText(std::string& s) const;
+
+	static void test();
+
+	MetricCounter bytes_sent;
+	MetricCounter bytes_received;
+
+	// Total number of bytes added to, and removed from, the WorkerThread send queues.  Queue depth = enqueued - dequeued.
+	MetricCounter send_queue_bytes_enqueued;
+	MetricCounter send_queue_bytes_dequeued;
+
+	MetricHistogram tick_duration; // Time taken for the main server loop to process dirty avatars and objects and enqueue broadcast packets.
+
+	MetricHistogram serialise_to_disk_duration;
+	MetricCounter serialise_to_disk_records_written;
+
+	MetricCounter udp_packets_received;
+	MetricCounter udp_voice_packets_relayed; // One per destination client.
+
+	MetricCounter web_response_cache_hits;
+	MetricCounter web_response_cache_misses;
+	MetricCounter web_not_modified_responses; // 304 responses sent for cached pages.
+
+private:
+	GLARE_DISABLE_COPY(ServerMetrics);
+
+	static int messageTypeIndex(uint32 msg_type);
+
+	// Indexed by messageTypeIndex(), last element is for unknown message types.
+	MetricCounter* messages_in;
+	MetricCounter* messages_in_bytes;
+	MetricCounter* messages_out;
+	MetricCounter* messages_out_bytes;
+
+	// Built in the constructor and not modified after, so can be read from multiple threads without locking.
+	std::map<std::string, MetricHistogramRef> web_handler_latency;
+	MetricHistogramRef other_web_handler_latency;
+};
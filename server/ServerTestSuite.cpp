@@ -7,8 +7,25 @@ Copyright Glare Technologies Limited 2023 -
 
 
 #include "AccountHandlers.h"
+#include "ServerMetrics.h"
+#include "LockProfiler.h"
+#include "WebDataSnapshot.h"
+#include "ServerWorldState.h"
+#include "PasswordHashing.h"
+#include "PasswordHashThreadPool.h"
+#include "RateLimiter.h"
+#include "ChunkedUploadManager.h"
+#include "ResourceCompression.h"
+#include "ResourceRequestQueue.h"
+#include "ScreenshotVariants.h"
+#include "DatabaseChangeLog.h"
+#include "DynamicTextureUpdaterThread.h"
+#include "../webserver/WebResponseCache.h"
+#include "../webserver/ResourceHandlers.h"
 #include "../shared/WorldObject.h"
 #include "../shared/LODGeneration.h"
+#include "../shared/BackupStore.h"
+#include "../shared/ResourceManager.h"
 #include "../ethereum/RLP.h"
 #include "../ethereum/Signing.h"
 #include "../ethereum/Infura.h"
@@ -101,6 +118,23 @@ void ServerTestSuite::test()
 	runTest([&]() { RLP::test();														});
 	runTest([&]() { Signing::test();													});
 	runTest([&]() { AccountHandlers::test();											});
+	runTest([&]() { ServerMetrics::test();												});
+	runTest([&]() { LockProfiler::test();												});
+	runTest([&]() { ServerAllWorldsState::test();										});
+	runTest([&]() { WebDataSnapshot::test();											});
+	runTest([&]() { WebResponseCache::test();											});
+	runTest([&]() { PasswordHashing::test();											});
+	runTest([&]() { PasswordHashThreadPool::test();										});
+	runTest([&]() { DynamicTextureUpdaterThread::test();								});
+	runTest([&]() { RateLimiter::test();												});
+	runTest([&]() { ChunkedUploadManager::test();										});
+	runTest([&]() { ResourceCompression::test();										});
+	runTest([&]() { ResourceHandlers::test();											});
+	runTest([&]() { ResourceRequestQueue::test();										});
+	runTest([&]() { ScreenshotVariants::test();											});
+	runTest([&]() { BackupStore::test();												});
+	runTest([&]() { DatabaseChangeLog::test();											});
+	runTest([&]() { ResourceManager::test();											});
 	runTest([&]() { HTTPClient::test();													}, /*mem leak allowed=*/true); // Leaks due to libtls allocating globals
 	
 	// runTest([&]() { BatchedMeshTests::test();										}); // Uses some Indigo files
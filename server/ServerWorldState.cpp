@@ -44,6 +44,11 @@ ServerAllWorldsState::ServerAllWorldsState()
 	read_only_mode = false;
 
 	force_dyn_tex_update = false;
+
+	password_hash_params = PasswordHashing::defaultParams();
+
+	web_data_snapshot = new WebDataSnapshot();
+	web_data_snapshot_stale = 1;
 }
 
 
@@ -54,17 +59,46 @@ ServerAllWorldsState::~ServerAllWorldsState()
 
 Reference<ServerWorldState> ServerAllWorldsState::getRootWorldState() // Guaranteed to return a non-null reference
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	return world_states[""]; 
 }
 
 
+WebDataSnapshotRef ServerAllWorldsState::getWebDataSnapshot() const
+{
+	Lock lock(web_data_snapshot_mutex);
+
+	return web_data_snapshot;
+}
+
+
+void ServerAllWorldsState::updateWebDataSnapshot()
+{
+	// Clear the stale flags before copying, so that any changes made while we are copying will cause another update.
+	web_data_snapshot_stale = 0;
+	getRootWorldState()->parcels_changed = 0;
+
+	WebDataSnapshotRef new_snapshot = WebDataSnapshot::build(*this);
+
+	Lock lock(web_data_snapshot_mutex);
+	if(new_snapshot->version > web_data_snapshot->version) // Don't replace a newer snapshot, in case of concurrent updates.
+		web_data_snapshot = new_snapshot;
+	// Web handlers that are still using the old snapshot hold a reference to it, so it will be freed when they are done with it.
+}
+
+
+bool ServerAllWorldsState::isWebDataSnapshotStale()
+{
+	return (web_data_snapshot_stale != 0) || (getRootWorldState()->parcels_changed != 0);
+}
+
+
 void ServerAllWorldsState::createNewDatabase(const std::string& path)
 {
 	conPrint("Creating new world state database at '" + path + "'...");
 
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	database.openAndMakeOrClearDatabase(path);
 }
@@ -99,7 +133,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 {
 	conPrint("Reading world state from '" + path + "'...");
 
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	Timer timer;
 
@@ -135,6 +169,8 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 			if(record.isRecordValid())
 			{
+				db_change_log.recordUpdated(database_key);
+
 				BufferViewInStream stream(ArrayRef<uint8>(database.getInitialRecordData(record), record.len));
 
 				// Now deserialise from our temp buffer
@@ -160,9 +196,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
 					world_ob->database_key = database_key;
-					world_states[world_name]->objects[world_ob->uid] = world_ob; // Add to object map
+
+					Reference<ServerWorldState> world = world_states[world_name];
+					ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+					world->objects[world_ob->uid] = world_ob; // Add to object map
 					num_obs++;
 
+					Lock uid_lock(uid_mutex);
 					next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 				}
 				else if(chunk == USER_CHUNK)
@@ -189,7 +229,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					readFromStream(stream, *parcel);
 
 					parcel->database_key = database_key;
-					world_states[world_name]->parcels[parcel->id] = parcel; // Add to parcel map
+
+					Reference<ServerWorldState> world = world_states[world_name];
+					ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+					world->parcels[parcel->id] = parcel; // Add to parcel map
 					num_parcels++;
 				}
 				else if(chunk == WORLD_SETTINGS_CHUNK)
@@ -201,16 +244,19 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 					if(world_states.count(world_name) == 0) 
 						world_states[world_name] = new ServerWorldState();
 
+					Reference<ServerWorldState> world = world_states[world_name];
+					ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+
 					// NOTE: There was a bug with multiple world settings for the same world getting saved to the database.  Resolve ambiguity of which one to use by choosing the setting with the largest database key value.
 					// Use these new settings iff the existing settings are either uninitialised (in which case database_key will be invalid), or the settings we are reading from the DB have a greater key 
 					// value than the existing settings.
-					const bool use_settings = !world_states[world_name]->world_settings.database_key.valid() || (database_key.value() > world_states[world_name]->world_settings.database_key.value());
+					const bool use_settings = !world->world_settings.database_key.valid() || (database_key.value() > world->world_settings.database_key.value());
 					if(use_settings)
 					{	
 						// Deserialise world settings
-						readWorldSettingsFromStream(stream, world_states[world_name]->world_settings);
+						readWorldSettingsFromStream(stream, world->world_settings);
 
-						world_states[world_name]->world_settings.database_key = database_key;
+						world->world_settings.database_key = database_key;
 					}
 
 					num_world_settings++;
@@ -230,6 +276,9 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 					resource->database_key = database_key;
 					this->resource_manager->addResource(resource);
+
+					if(resource->getState() == Resource::State_Present)
+						db_change_log.resourcePresent(resource->URL, resource->getRawLocalPath(), resource_manager->getLocalAbsPathForResource(*resource));
 				}
 				else if(chunk == ORDER_CHUNK)
 				{
@@ -400,9 +449,13 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				//TEMP HACK: clear lightmap needed flag
 				BitUtils::zeroBit(world_ob->flags, WorldObject::LIGHTMAP_NEEDS_COMPUTING_FLAG);
 
-				current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				{
+					ProfiledLock world_lock(current_world->mutex, LOCK_PROFILER_SITE());
+					current_world->objects[world_ob->uid] = world_ob; // Add to object map
+				}
 				num_obs++;
 
+				Lock uid_lock(uid_mutex);
 				next_object_uid = UID(myMax(world_ob->uid.value() + 1, next_object_uid.value()));
 			}
 			else if(chunk == USER_CHUNK)
@@ -420,7 +473,10 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 				ParcelRef parcel = new Parcel();
 				readFromStream(stream, *parcel);
 
-				current_world->parcels[parcel->id] = parcel; // Add to parcel map
+				{
+					ProfiledLock world_lock(current_world->mutex, LOCK_PROFILER_SITE());
+					current_world->parcels[parcel->id] = parcel; // Add to parcel map
+				}
 				num_parcels++;
 			}
 			else if(chunk == RESOURCE_CHUNK)
@@ -552,12 +608,15 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 	}
 
 
+	rebuildUserIndexes();
+
 	denormaliseData();
 
 	// Compress voxel data if needed.
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 		{
 			/*WorldObject* ob = it->second.ptr();
@@ -580,7 +639,7 @@ void ServerAllWorldsState::readFromDisk(const std::string& path)
 
 void ServerAllWorldsState::addEverythingToDirtySets()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	for(auto it = resource_manager->getResourcesForURL().begin(); it != resource_manager->getResourcesForURL().end(); ++it)
 		db_dirty_resources.insert(it->second);
@@ -594,6 +653,7 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
 			world_state->db_dirty_world_objects.insert(it->second);
@@ -622,16 +682,9 @@ void ServerAllWorldsState::addEverythingToDirtySets()
 }
 
 
-bool ServerAllWorldsState::isInReadOnlyMode()
-{ 
-	Lock lock(mutex); 
-	return read_only_mode; 
-}
-
-
 void ServerAllWorldsState::clearAndReset() // Just for fuzzing
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 	next_object_uid = UID(0);
 	next_avatar_uid = UID(0);
 }
@@ -639,11 +692,12 @@ void ServerAllWorldsState::clearAndReset() // Just for fuzzing
 
 void ServerAllWorldsState::denormaliseData()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 	{
 		Reference<ServerWorldState> world_state = world_it->second;
+		ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 		// Build cached fields like WorldObject::creator_name
 		for(auto i=world_state->objects.begin(); i != world_state->objects.end(); ++i)
@@ -692,13 +746,225 @@ void ServerAllWorldsState::denormaliseData()
 }
 
 
+// Adds the user to the index, unless a user with a lower id is already there for the key.
+static void addToUserIndex(std::map<std::string, UserRef>& index, const std::string& key, const UserRef& user)
+{
+	if(key.empty())
+		return;
+
+	auto res = index.find(key);
+	if(res == index.end() || (user->id < res->second->id))
+		index[key] = user;
+}
+
+
+void ServerAllWorldsState::addUser(const UserRef user)
+{
+	user_id_to_users[user->id] = user;
+	name_to_users[user->name] = user;
+
+	addToUserIndex(lower_case_name_to_users, ::toLowerCase(user->name), user);
+	addToUserIndex(email_to_users, ::toLowerCase(user->email_address), user);
+	indexPasswordResetsForUser(user.ptr());
+}
+
+
+User* ServerAllWorldsState::findUserByNameCaseInsensitive(const std::string& name)
+{
+	const auto res = lower_case_name_to_users.find(::toLowerCase(name));
+	return (res != lower_case_name_to_users.end()) ? res->second.ptr() : NULL;
+}
+
+
+User* ServerAllWorldsState::findUserByEmail(const std::string& email_address)
+{
+	const auto res = email_to_users.find(::toLowerCase(email_address));
+	return (res != email_to_users.end()) ? res->second.ptr() : NULL;
+}
+
+
+User* ServerAllWorldsState::findUserForResetTokenHash(const std::array<uint8, 32>& token_hash)
+{
+	const auto res = reset_token_hash_to_users.find(token_hash);
+	return (res != reset_token_hash_to_users.end()) ? res->second.ptr() : NULL;
+}
+
+
+User* ServerAllWorldsState::findUserForWebSession(const std::string& session_id)
+{
+	// user_web_sessions is already keyed by session id, so this is two map lookups.
+	const auto res = user_web_sessions.find(session_id);
+	if(res == user_web_sessions.end())
+		return NULL;
+
+	const auto user_res = user_id_to_users.find(res->second->user_id);
+	return (user_res != user_id_to_users.end()) ? user_res->second.ptr() : NULL;
+}
+
+
+void ServerAllWorldsState::indexPasswordResetsForUser(User* user)
+{
+	for(size_t i=0; i<user->password_resets.size(); ++i)
+		reset_token_hash_to_users[user->password_resets[i].token_hash] = user;
+}
+
+
+bool ServerAllWorldsState::resetUserPasswordWithTokenHash(const std::array<uint8, 32>& token_hash, const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params)
+{
+	User* user = findUserForResetTokenHash(token_hash);
+	if(!user)
+		return false;
+
+	if(!user->resetPasswordWithTokenHash(token_hash, new_hashed_password, new_salt, new_params))
+		return false;
+
+	reset_token_hash_to_users.erase(token_hash); // resetPasswordWithTokenHash() removed the token from the user.
+	addUserAsDBDirty(user);
+	return true;
+}
+
+
+void ServerAllWorldsState::rebuildUserIndexes()
+{
+	name_to_users.clear();
+	lower_case_name_to_users.clear();
+	email_to_users.clear();
+	reset_token_hash_to_users.clear();
+
+	// Iterate in order of increasing user id, so users with lower ids take precedence for duplicate keys.
+	for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
+		addUser(it->second);
+}
+
+
+template <class Key>
+static bool userIndexesEqual(const std::map<Key, UserRef>& a, const std::map<Key, UserRef>& b)
+{
+	if(a.size() != b.size())
+		return false;
+	for(auto it_a = a.begin(), it_b = b.begin(); it_a != a.end(); ++it_a, ++it_b)
+		if(!(it_a->first == it_b->first) || (it_a->second.ptr() != it_b->second.ptr()))
+			return false;
+	return true;
+}
+
+
+bool ServerAllWorldsState::userIndexesAreConsistent()
+{
+	const std::map<std::string, UserRef> old_name_to_users = name_to_users;
+	const std::map<std::string, UserRef> old_lower_case_name_to_users = lower_case_name_to_users;
+	const std::map<std::string, UserRef> old_email_to_users = email_to_users;
+	const std::map<std::array<uint8, 32>, UserRef> old_reset_token_hash_to_users = reset_token_hash_to_users;
+
+	rebuildUserIndexes();
+
+	return 
+		userIndexesEqual(name_to_users, old_name_to_users) &&
+		userIndexesEqual(lower_case_name_to_users, old_lower_case_name_to_users) &&
+		userIndexesEqual(email_to_users, old_email_to_users) &&
+		userIndexesEqual(reset_token_hash_to_users, old_reset_token_hash_to_users);
+}
+
+
+std::string ServerAllWorldsState::computePasswordHash(const std::string& password, const std::string& salt, const PasswordHashParams& params)
+{
+	if(password_hash_pool.nonNull())
+		return password_hash_pool->computeHash(password, salt, params);
+	else
+		return PasswordHashing::computeHash(password, salt, params);
+}
+
+
+UserID ServerAllWorldsState::checkUserPassword(const std::string& username, const std::string& password)
+{
+	UserID user_id = UserID::invalidUserID();
+	{
+		ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
+		const auto res = name_to_users.find(username);
+		if(res != name_to_users.end())
+			user_id = res->second->id;
+	}
+
+	if(!user_id.valid())
+	{
+		// Hash the password anyway, with the same params as for a real user, so that the response time doesn't reveal whether the username exists.
+		const std::string dummy_salt = "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA="; // Same length as salts from PasswordHashing::generateSalt().
+		computePasswordHash(password, dummy_salt, password_hash_params);
+		return UserID::invalidUserID();
+	}
+
+	return checkPasswordForUser(user_id, password) ? user_id : UserID::invalidUserID();
+}
+
+
+bool ServerAllWorldsState::checkPasswordForUser(const UserID& user_id, const std::string& password)
+{
+	// Copy what we need to check the password, so we don't hold the mutex while hashing.
+	std::string hashed_password, salt;
+	PasswordHashParams params;
+	{
+		ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
+		const auto res = user_id_to_users.find(user_id);
+		if(res == user_id_to_users.end())
+			return false;
+		hashed_password = res->second->hashed_password;
+		salt = res->second->password_hash_salt;
+		params = res->second->password_hash_params;
+	}
+
+	const std::string attempt_hash = computePasswordHash(password, salt, params);
+	if(!PasswordHashing::hashesEqual(attempt_hash, hashed_password))
+		return false;
+
+	// Password is valid.  If the stored hash is weaker than we want, rehash it now that we have the password.
+	if(params.isWeakerThan(password_hash_params) && !isInReadOnlyMode())
+	{
+		try
+		{
+			const std::string new_salt = PasswordHashing::generateSalt();
+			const std::string new_hash = computePasswordHash(password, new_salt, password_hash_params);
+
+			ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
+			const auto res = user_id_to_users.find(user_id);
+			if(res != user_id_to_users.end() && (res->second->hashed_password == hashed_password)) // Don't overwrite the password if it was changed while we were hashing.
+			{
+				res->second->setPasswordHash(new_hash, new_salt, password_hash_params);
+				addUserAsDBDirty(res->second);
+			}
+		}
+		catch(glare::Exception& e)
+		{
+			// The login is still valid, we can rehash next time.
+			conPrint("Failed to rehash password for user " + user_id.toString() + ": " + e.what());
+		}
+	}
+
+	return true;
+}
+
+
+void ServerAllWorldsState::setUserPassword(const UserID& user_id, const std::string& new_password)
+{
+	const std::string new_salt = PasswordHashing::generateSalt();
+	const std::string new_hash = computePasswordHash(new_password, new_salt, password_hash_params);
+
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
+	const auto res = user_id_to_users.find(user_id);
+	if(res != user_id_to_users.end())
+	{
+		res->second->setPasswordHash(new_hash, new_salt, password_hash_params);
+		addUserAsDBDirty(res->second);
+	}
+}
+
+
 // Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
 // Then saves the updates to disk.
 void ServerAllWorldsState::saveSanitisedDatabase()
 {
 	conPrint("Saving sanitised world state to disk...");
 
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	try
 	{
@@ -708,6 +974,7 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 		for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 			// Sanitise parcels
 			for(auto it = world_state->parcels.begin(); it != world_state->parcels.end(); ++it)
@@ -739,6 +1006,8 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 
 				i++;
 			}
+
+			rebuildUserIndexes(); // Since we changed names, email addresses and password resets.
 		}
 
 		// resource objects
@@ -822,8 +1091,284 @@ void ServerAllWorldsState::saveSanitisedDatabase()
 }
 
 
+// Functions that write the database record data for each record type, into buf.
+// Used by serialiseToDisk(), and by getRecordData() to re-serialise records for backups.
+
+static void writeWorldObjectRecord(const std::string& world_name, const WorldObject& ob, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(WORLD_OBJECT_CHUNK);
+	buf.writeStringLengthFirst(world_name); // Write world name
+	ob.writeToStream(buf); // Write object
+}
+
+
+static void writeParcelRecord(const std::string& world_name, const Parcel& parcel, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(PARCEL_CHUNK);
+	buf.writeStringLengthFirst(world_name); // Write world name
+	writeToStream(parcel, buf); // Write parcel
+}
+
+
+static void writeWorldSettingsRecord(const std::string& world_name, const WorldSettings& world_settings, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(WORLD_SETTINGS_CHUNK);
+	buf.writeStringLengthFirst(world_name); // Write world name
+	world_settings.writeToStream(buf); // Write world settings
+}
+
+
+static void writeUserRecord(const User& user, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(USER_CHUNK);
+	writeUserToStream(user, buf);
+}
+
+
+static void writeResourceRecord(Resource& resource, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(RESOURCE_CHUNK);
+	resource.writeToStream(buf);
+}
+
+
+static void writeOrderRecord(const Order& order, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(ORDER_CHUNK);
+	writeToStream(order, buf);
+}
+
+
+static void writeUserWebSessionRecord(const UserWebSession& session, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(USER_WEB_SESSION_CHUNK);
+	writeToStream(session, buf);
+}
+
+
+static void writeParcelAuctionRecord(const ParcelAuction& auction, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(PARCEL_AUCTION_CHUNK);
+	writeToStream(auction, buf);
+}
+
+
+static void writeScreenshotRecord(const Screenshot& shot, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(SCREENSHOT_CHUNK);
+	writeScreenshotToStream(shot, buf);
+}
+
+
+static void writeSubEthTransactionRecord(const SubEthTransaction& trans, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(SUB_ETH_TRANSACTIONS_CHUNK);
+	writeToStream(trans, buf);
+}
+
+
+static void writeNewsPostRecord(const NewsPost& post, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(NEWS_POST_CHUNK);
+	writeToStream(post, buf);
+}
+
+
+static void writeMapTileInfoRecord(const MapTileInfo& map_tile_info, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(MAP_TILE_INFO_CHUNK);
+	buf.writeUInt32(MAP_TILE_INFO_VERSION);
+	buf.writeInt32((int)map_tile_info.info.size());
+	for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
+	{
+		Vec3<int> v = it->first;
+		const TileInfo& tile_info = it->second;
+
+		buf.writeInt32(v.x);
+		buf.writeInt32(v.y);
+		buf.writeInt32(v.z);
+
+		buf.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
+		if(tile_info.cur_tile_screenshot.nonNull())
+			writeScreenshotToStream(*tile_info.cur_tile_screenshot, buf);
+
+		buf.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
+		if(tile_info.prev_tile_screenshot.nonNull())
+			writeScreenshotToStream(*tile_info.prev_tile_screenshot, buf);
+	}
+}
+
+
+static void writeLastParcelUpdateInfoRecord(const LastParcelUpdateInfo& last_parcel_update_info, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(LAST_PARCEL_SALE_UPDATE_CHUNK);
+	buf.writeUInt32(PARCEL_SALE_UPDATE_VERSION);
+	buf.writeInt32(last_parcel_update_info.last_parcel_sale_update_hour);
+	buf.writeInt32(last_parcel_update_info.last_parcel_sale_update_day);
+	buf.writeInt32(last_parcel_update_info.last_parcel_sale_update_year);
+}
+
+
+static void writeEthInfoRecord(const EthInfo& eth_info, BufferOutStream& buf)
+{
+	buf.clear();
+	buf.writeUInt32(ETH_INFO_CHUNK);
+	buf.writeUInt32(ETH_INFO_CHUNK_VERSION);
+	buf.writeInt32(eth_info.min_next_nonce);
+}
+
+
+// Writes the record to the database, and logs the change for incremental backups.
+void ServerAllWorldsState::updateDatabaseRecord(const DatabaseKey& key, const BufferOutStream& record_data)
+{
+	const ArrayRef<uint8> data(record_data.buf.data(), record_data.buf.size());
+	database.updateRecord(key, data);
+	db_change_log.recordUpdated(key);
+}
+
+
+static inline bool isRecordWanted(const DatabaseKey& key, const std::unordered_set<uint64>& keys)
+{
+	return key.valid() && (keys.count(key.value()) != 0);
+}
+
+
+static inline void takeRecordData(const DatabaseKey& key, const BufferOutStream& buf, std::unordered_map<uint64, std::vector<uint8>>& data_out)
+{
+	data_out[key.value()].assign(buf.buf.begin(), buf.buf.end());
+}
+
+
+// Re-serialises the live objects for the requested records, for backups.  Locks mutex and each world's mutex in turn, so must be called without them held.
+// Records with no live object, such as objects that have been removed but whose records haven't been deleted from the database yet, are left out.
+void ServerAllWorldsState::getRecordData(const std::unordered_set<uint64>& keys, std::unordered_map<uint64, std::vector<uint8>>& data_out)
+{
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
+
+	BufferOutStream temp_buf;
+
+	for(auto world_it = world_states.begin(); world_it != world_states.end(); ++world_it)
+	{
+		const std::string& world_name = world_it->first;
+		ServerWorldState* world_state = world_it->second.ptr();
+		ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		for(auto it = world_state->objects.begin(); it != world_state->objects.end(); ++it)
+			if(isRecordWanted(it->second->database_key, keys))
+			{
+				writeWorldObjectRecord(world_name, *it->second, temp_buf);
+				takeRecordData(it->second->database_key, temp_buf, data_out);
+			}
+
+		for(auto it = world_state->parcels.begin(); it != world_state->parcels.end(); ++it)
+			if(isRecordWanted(it->second->database_key, keys))
+			{
+				writeParcelRecord(world_name, *it->second, temp_buf);
+				takeRecordData(it->second->database_key, temp_buf, data_out);
+			}
+
+		if(isRecordWanted(world_state->world_settings.database_key, keys))
+		{
+			writeWorldSettingsRecord(world_name, world_state->world_settings, temp_buf);
+			takeRecordData(world_state->world_settings.database_key, temp_buf, data_out);
+		}
+	}
+
+	for(auto it = user_id_to_users.begin(); it != user_id_to_users.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeUserRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	{
+		Lock resource_lock(resource_manager->getMutex());
+		const std::map<std::string, ResourceRef>& resources = resource_manager->getResourcesForURL();
+		for(auto it = resources.begin(); it != resources.end(); ++it)
+			if(isRecordWanted(it->second->database_key, keys))
+			{
+				writeResourceRecord(*it->second, temp_buf);
+				takeRecordData(it->second->database_key, temp_buf, data_out);
+			}
+	}
+
+	for(auto it = orders.begin(); it != orders.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeOrderRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	for(auto it = user_web_sessions.begin(); it != user_web_sessions.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeUserWebSessionRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	for(auto it = parcel_auctions.begin(); it != parcel_auctions.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeParcelAuctionRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	for(auto it = screenshots.begin(); it != screenshots.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeScreenshotRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	for(auto it = sub_eth_transactions.begin(); it != sub_eth_transactions.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeSubEthTransactionRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	for(auto it = news_posts.begin(); it != news_posts.end(); ++it)
+		if(isRecordWanted(it->second->database_key, keys))
+		{
+			writeNewsPostRecord(*it->second, temp_buf);
+			takeRecordData(it->second->database_key, temp_buf, data_out);
+		}
+
+	if(isRecordWanted(map_tile_info.database_key, keys))
+	{
+		writeMapTileInfoRecord(map_tile_info, temp_buf);
+		takeRecordData(map_tile_info.database_key, temp_buf, data_out);
+	}
+
+	if(isRecordWanted(last_parcel_update_info.database_key, keys))
+	{
+		writeLastParcelUpdateInfoRecord(last_parcel_update_info, temp_buf);
+		takeRecordData(last_parcel_update_info.database_key, temp_buf, data_out);
+	}
+
+	if(isRecordWanted(eth_info.database_key, keys))
+	{
+		writeEthInfoRecord(eth_info, temp_buf);
+		takeRecordData(eth_info.database_key, temp_buf, data_out);
+	}
+}
+
+
 // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
-void ServerAllWorldsState::serialiseToDisk()
+size_t ServerAllWorldsState::serialiseToDisk()
 {
 	conPrint("Saving world state to disk...");
 
@@ -850,6 +1395,7 @@ void ServerAllWorldsState::serialiseToDisk()
 		{
 			const DatabaseKey key = *it;
 			database.deleteRecord(key);
+			db_change_log.recordDeleted(key);
 		}
 		db_records_to_delete.clear();
 
@@ -863,21 +1409,19 @@ void ServerAllWorldsState::serialiseToDisk()
 		{
 			const std::string world_name = world_it->first;
 			Reference<ServerWorldState> world_state = world_it->second;
+			ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE()); // Note that we hold this world's lock while writing its records.  Other worlds aren't blocked.
 
 			// Write objects
 			{
 				for(auto it = world_state->db_dirty_world_objects.begin(); it != world_state->db_dirty_world_objects.end(); ++it)
 				{
 					WorldObject* ob = it->ptr();
-					temp_buf.clear();
-					temp_buf.writeUInt32(WORLD_OBJECT_CHUNK);
-					temp_buf.writeStringLengthFirst(world_name); // Write world name
-					ob->writeToStream(temp_buf); // Write object
+					writeWorldObjectRecord(world_name, *ob, temp_buf);
 
 					if(!ob->database_key.valid())
 						ob->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(ob->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					updateDatabaseRecord(ob->database_key, temp_buf);
 
 					num_obs++;
 				}
@@ -890,15 +1434,12 @@ void ServerAllWorldsState::serialiseToDisk()
 				for(auto it = world_state->db_dirty_parcels.begin(); it != world_state->db_dirty_parcels.end(); ++it)
 				{
 					Parcel* parcel = it->ptr();
-					temp_buf.clear();
-					temp_buf.writeUInt32(PARCEL_CHUNK);
-					temp_buf.writeStringLengthFirst(world_name); // Write world name
-					writeToStream(*parcel, temp_buf); // Write parcel
+					writeParcelRecord(world_name, *parcel, temp_buf);
 
 					if(!parcel->database_key.valid())
 						parcel->database_key = database.allocUnusedKey(); // Get a new key
 
-					database.updateRecord(parcel->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+					updateDatabaseRecord(parcel->database_key, temp_buf);
 
 					num_parcels++;
 				}
@@ -909,15 +1450,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			// Save the world settings if dirty
 			if(world_state->world_settings.db_dirty)
 			{
-				temp_buf.clear();
-				temp_buf.writeUInt32(WORLD_SETTINGS_CHUNK);
-				temp_buf.writeStringLengthFirst(world_name); // Write world name
-				world_state->world_settings.writeToStream(temp_buf); // Write world settings to temp_buf
+				writeWorldSettingsRecord(world_name, world_state->world_settings, temp_buf);
 
 				if(!world_state->world_settings.database_key.valid())
 					world_state->world_settings.database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(world_state->world_settings.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(world_state->world_settings.database_key, temp_buf);
 
 				world_state->world_settings.db_dirty = false;
 
@@ -930,14 +1468,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto it=db_dirty_users.begin(); it != db_dirty_users.end(); ++it)
 			{
 				User* user = it->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(USER_CHUNK);
-				writeUserToStream(*user, temp_buf);
+				writeUserRecord(*user, temp_buf);
 
 				if(!user->database_key.valid())
 					user->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(user->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(user->database_key, temp_buf);
 
 				num_users++;
 			}
@@ -950,14 +1486,15 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto i=db_dirty_resources.begin(); i != db_dirty_resources.end(); ++i)
 			{
 				Resource* resource = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(RESOURCE_CHUNK);
-				resource->writeToStream(temp_buf);
+				writeResourceRecord(*resource, temp_buf);
 
 				if(!resource->database_key.valid())
 					resource->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(resource->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(resource->database_key, temp_buf);
+
+				if(resource->getState() == Resource::State_Present)
+					db_change_log.resourcePresent(resource->URL, resource->getRawLocalPath(), resource_manager->getLocalAbsPathForResource(*resource));
 
 				num_resources++;
 			}
@@ -970,14 +1507,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto i=db_dirty_orders.begin(); i != db_dirty_orders.end(); ++i)
 			{
 				Order* order = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(ORDER_CHUNK);
-				writeToStream(*order, temp_buf);
+				writeOrderRecord(*order, temp_buf);
 
 				if(!order->database_key.valid())
 					order->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(order->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(order->database_key, temp_buf);
 
 				num_orders++;
 			}
@@ -990,14 +1525,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto i=db_dirty_userwebsessions.begin(); i != db_dirty_userwebsessions.end(); ++i)
 			{
 				UserWebSession* session = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(USER_WEB_SESSION_CHUNK);
-				writeToStream(*session, temp_buf);
+				writeUserWebSessionRecord(*session, temp_buf);
 
 				if(!session->database_key.valid())
 					session->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(session->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(session->database_key, temp_buf);
 
 				num_sessions++;
 			}
@@ -1010,14 +1543,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto i=db_dirty_parcel_auctions.begin(); i != db_dirty_parcel_auctions.end(); ++i)
 			{
 				ParcelAuction* auction = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(PARCEL_AUCTION_CHUNK);
-				writeToStream(*auction, temp_buf);
+				writeParcelAuctionRecord(*auction, temp_buf);
 
 				if(!auction->database_key.valid())
 					auction->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(auction->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(auction->database_key, temp_buf);
 
 				num_auctions++;
 			}
@@ -1030,14 +1561,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto it=db_dirty_screenshots.begin(); it != db_dirty_screenshots.end(); ++it)
 			{
 				Screenshot* shot = it->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(SCREENSHOT_CHUNK);
-				writeScreenshotToStream(*shot, temp_buf);
+				writeScreenshotRecord(*shot, temp_buf);
 
 				if(!shot->database_key.valid())
 					shot->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(shot->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(shot->database_key, temp_buf);
 
 				num_screenshots++;
 			}
@@ -1050,14 +1579,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto i=db_dirty_sub_eth_transactions.begin(); i != db_dirty_sub_eth_transactions.end(); ++i)
 			{
 				SubEthTransaction* trans = i->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(SUB_ETH_TRANSACTIONS_CHUNK);
-				writeToStream(*trans, temp_buf);
+				writeSubEthTransactionRecord(*trans, temp_buf);
 
 				if(!trans->database_key.valid())
 					trans->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(trans->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(trans->database_key, temp_buf);
 
 				num_sub_eth_transactions++;
 			}
@@ -1070,14 +1597,12 @@ void ServerAllWorldsState::serialiseToDisk()
 			for(auto it=db_dirty_news_posts.begin(); it != db_dirty_news_posts.end(); ++it)
 			{
 				NewsPost* post = it->ptr();
-				temp_buf.clear();
-				temp_buf.writeUInt32(NEWS_POST_CHUNK);
-				writeToStream(*post, temp_buf);
+				writeNewsPostRecord(*post, temp_buf);
 
 				if(!post->database_key.valid())
 					post->database_key = database.allocUnusedKey(); // Get a new key
 
-				database.updateRecord(post->database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+				updateDatabaseRecord(post->database_key, temp_buf);
 
 				num_news_posts++;
 			}
@@ -1088,32 +1613,12 @@ void ServerAllWorldsState::serialiseToDisk()
 		// Write MAP_TILE_INFO_CHUNK
 		if(map_tile_info.db_dirty)
 		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(MAP_TILE_INFO_CHUNK);
-			temp_buf.writeUInt32(MAP_TILE_INFO_VERSION);
-			temp_buf.writeInt32((int)map_tile_info.info.size());
-			for(auto it=map_tile_info.info.begin(); it != map_tile_info.info.end(); ++it)
-			{
-				Vec3<int> v = it->first;
-				const TileInfo& tile_info = it->second;
-
-				temp_buf.writeInt32(v.x);
-				temp_buf.writeInt32(v.y);
-				temp_buf.writeInt32(v.z);
-
-				temp_buf.writeInt32(tile_info.cur_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.cur_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.cur_tile_screenshot, temp_buf);
-
-				temp_buf.writeInt32(tile_info.prev_tile_screenshot.nonNull() ? 1 : 0);
-				if(tile_info.prev_tile_screenshot.nonNull())
-					writeScreenshotToStream(*tile_info.prev_tile_screenshot, temp_buf);
-			}
+			writeMapTileInfoRecord(map_tile_info, temp_buf);
 
 			if(!map_tile_info.database_key.valid())
 				map_tile_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(map_tile_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			updateDatabaseRecord(map_tile_info.database_key, temp_buf);
 
 			map_tile_info.db_dirty = false;
 
@@ -1123,17 +1628,12 @@ void ServerAllWorldsState::serialiseToDisk()
 		// Write LAST_PARCEL_SALE_UPDATE_CHUNK
 		if(last_parcel_update_info.db_dirty)
 		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(LAST_PARCEL_SALE_UPDATE_CHUNK);
-			temp_buf.writeUInt32(PARCEL_SALE_UPDATE_VERSION);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_hour);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_day);
-			temp_buf.writeInt32(this->last_parcel_update_info.last_parcel_sale_update_year);
+			writeLastParcelUpdateInfoRecord(last_parcel_update_info, temp_buf);
 
 			if(!last_parcel_update_info.database_key.valid())
 				last_parcel_update_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(last_parcel_update_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			updateDatabaseRecord(last_parcel_update_info.database_key, temp_buf);
 
 			last_parcel_update_info.db_dirty = false;
 		}
@@ -1141,15 +1641,12 @@ void ServerAllWorldsState::serialiseToDisk()
 		// Write ETH_INFO_CHUNK
 		if(eth_info.db_dirty)
 		{
-			temp_buf.clear();
-			temp_buf.writeUInt32(ETH_INFO_CHUNK);
-			temp_buf.writeUInt32(ETH_INFO_CHUNK_VERSION);
-			temp_buf.writeInt32(this->eth_info.min_next_nonce);
+			writeEthInfoRecord(eth_info, temp_buf);
 
 			if(!eth_info.database_key.valid())
 				eth_info.database_key = database.allocUnusedKey(); // Get a new key
 
-			database.updateRecord(eth_info.database_key, ArrayRef<uint8>(temp_buf.buf.data(), temp_buf.buf.size()));
+			updateDatabaseRecord(eth_info.database_key, temp_buf);
 
 			eth_info.db_dirty = false;
 		}
@@ -1161,6 +1658,9 @@ void ServerAllWorldsState::serialiseToDisk()
 			toString(num_sessions) + " session(s), " + toString(num_auctions) + " auction(s), " + toString(num_screenshots) + " screenshot(s), " +
 			toString(num_sub_eth_transactions) + " sub eth transction(s), " + toString(num_tiles_written) + " tiles, " + toString(num_world_settings) + " world setting(s), " + 
 			toString(num_news_posts) + "news post(s) in " + timer.elapsedStringNSigFigs(4));
+
+		return num_obs + num_users + num_parcels + num_resources + num_orders + num_sessions + num_auctions + num_screenshots + num_sub_eth_transactions + 
+			num_world_settings + num_news_posts + ((num_tiles_written > 0) ? 1 : 0);
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -1171,7 +1671,7 @@ void ServerAllWorldsState::serialiseToDisk()
 
 std::string ServerAllWorldsState::getCredential(const std::string& key) // Throws glare::Exception if not found
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	auto res = server_credentials.creds.find(key);
 	if(res == server_credentials.creds.end())
@@ -1182,7 +1682,7 @@ std::string ServerAllWorldsState::getCredential(const std::string& key) // Throw
 
 UID ServerAllWorldsState::getNextObjectUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_object_uid;
 	next_object_uid = UID(next_object_uid.value() + 1);
@@ -1192,7 +1692,7 @@ UID ServerAllWorldsState::getNextObjectUID()
 
 UID ServerAllWorldsState::getNextAvatarUID()
 {
-	Lock lock(mutex);
+	Lock lock(uid_mutex);
 
 	const UID next = next_avatar_uid;
 	next_avatar_uid = UID(next_avatar_uid.value() + 1);
@@ -1202,21 +1702,21 @@ UID ServerAllWorldsState::getNextAvatarUID()
 
 uint64 ServerAllWorldsState::getNextOrderUID()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 	return next_order_uid++;
 }
 
 
 uint64 ServerAllWorldsState::getNextSubEthTransactionUID()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 	return next_sub_eth_transaction_uid++;
 }
 
 
 uint64 ServerAllWorldsState::getNextScreenshotUID()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	uint64 highest_id = 0;
 
@@ -1242,7 +1742,7 @@ uint64 ServerAllWorldsState::getNextScreenshotUID()
 
 uint64 ServerAllWorldsState::getNextNewsPostUID()
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 
 	uint64 highest_id = 0;
 
@@ -1255,14 +1755,14 @@ uint64 ServerAllWorldsState::getNextNewsPostUID()
 
 void ServerAllWorldsState::setUserWebMessage(const UserID& user_id, const std::string& s)
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 	user_web_messages[user_id] = s;
 }
 
 
 std::string ServerAllWorldsState::getAndRemoveUserWebMessage(const UserID& user_id) // returns empty string if no message or user
 {
-	Lock lock(mutex);
+	ProfiledLock lock(mutex, LOCK_PROFILER_SITE());
 	auto res = user_web_messages.find(user_id);
 	if(res != user_web_messages.end())
 	{
@@ -1273,3 +1773,156 @@ std::string ServerAllWorldsState::getAndRemoveUserWebMessage(const UserID& user_
 	else
 		return std::string();
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+static const PasswordHashParams test_params(PasswordHashParams::Scheme_BalloonSHA256, /*space_cost=*/256, /*time_cost=*/1); // Cheap, to keep the tests fast.
+
+
+static UserRef makeTestUser(uint32 id, const std::string& name, const std::string& email_address)
+{
+	UserRef user = new User();
+	user->id = UserID(id);
+	user->name = name;
+	user->email_address = email_address;
+	user->created_time = TimeStamp::currentTime();
+	user->setNewPasswordAndSalt("password", test_params);
+	return user;
+}
+
+
+static std::array<uint8, 32> makeTestTokenHash(uint8 x)
+{
+	std::array<uint8, 32> hash;
+	hash.fill(x);
+	return hash;
+}
+
+
+void ServerAllWorldsState::test()
+{
+	conPrint("ServerAllWorldsState::test()");
+
+	const std::string db_path = PlatformUtils::getTempDirPath() + "/user_index_test_db.bin";
+
+	//-------------------- Test user index lookups and consistency on mutation --------------------
+	{
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(PlatformUtils::getTempDirPath() + "/user_index_test_resources");
+		world_state->createNewDatabase(db_path);
+
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		world_state->addUser(makeTestUser(1, "alice", "b@example.com"));
+		world_state->addUser(makeTestUser(0, "Alice", "a@example.com")); // Added after user 1, but has a lower id, so should take precedence.
+		world_state->addUser(makeTestUser(2, "Bob", "A@Example.com"));
+		world_state->addUser(makeTestUser(3, "carol", ""));
+		testAssert(world_state->userIndexesAreConsistent());
+
+		testAssert(world_state->findUserByNameCaseInsensitive("ALICE")->id == UserID(0));
+		testAssert(world_state->findUserByNameCaseInsensitive("bob")->id == UserID(2));
+		testAssert(world_state->findUserByNameCaseInsensitive("dave") == NULL);
+		testAssert(world_state->findUserByEmail("a@example.COM")->id == UserID(0));
+		testAssert(world_state->findUserByEmail("b@example.com")->id == UserID(1));
+		testAssert(world_state->findUserByEmail("") == NULL); // Users without email addresses shouldn't be indexed.
+		testAssert(world_state->name_to_users["alice"]->id == UserID(1)); // Exact name lookups should still work.
+
+		// Password resets
+		User* bob = world_state->user_id_to_users[UserID(2)].ptr();
+		PasswordReset reset;
+		reset.created_time = TimeStamp::currentTime();
+		reset.token_hash = makeTestTokenHash(1);
+		bob->password_resets.push_back(reset);
+		testAssert(!world_state->userIndexesAreConsistent()); // Not indexed yet.  (userIndexesAreConsistent() rebuilds the indexes, so will be consistent afterwards)
+		bob->password_resets.clear();
+
+		bob->password_resets.push_back(reset);
+		world_state->indexPasswordResetsForUser(bob);
+		testAssert(world_state->userIndexesAreConsistent());
+		testAssert(world_state->findUserForResetTokenHash(makeTestTokenHash(1)) == bob);
+		testAssert(world_state->findUserForResetTokenHash(makeTestTokenHash(2)) == NULL);
+
+		const std::string new_salt = PasswordHashing::generateSalt();
+		const std::string new_hash = PasswordHashing::computeHash("newpassword", new_salt, test_params);
+		testAssert(!world_state->resetUserPasswordWithTokenHash(makeTestTokenHash(2), new_hash, new_salt, test_params));
+		testAssert(world_state->resetUserPasswordWithTokenHash(makeTestTokenHash(1), new_hash, new_salt, test_params));
+		testAssert(bob->isPasswordValid("newpassword"));
+		testAssert(bob->password_resets.empty());
+		testAssert(world_state->findUserForResetTokenHash(makeTestTokenHash(1)) == NULL);
+		testAssert(!world_state->resetUserPasswordWithTokenHash(makeTestTokenHash(1), new_hash, new_salt, test_params)); // Token should only be usable once.
+		testAssert(world_state->userIndexesAreConsistent());
+
+		// Add another reset, which should be persisted.
+		reset.token_hash = makeTestTokenHash(3);
+		bob->password_resets.push_back(reset);
+		world_state->indexPasswordResetsForUser(bob);
+
+		// Web sessions
+		UserWebSessionRef session = new UserWebSession();
+		session->id = "session_a";
+		session->user_id = UserID(2);
+		session->created_time = TimeStamp::currentTime();
+		world_state->user_web_sessions[session->id] = session;
+		testAssert(world_state->findUserForWebSession("session_a") == bob);
+		testAssert(world_state->findUserForWebSession("session_b") == NULL);
+
+		// Write to disk, so we can test that the indexes are rebuilt when reading.
+		world_state->addEverythingToDirtySets();
+		world_state->serialiseToDisk();
+	}
+
+	//-------------------- Test indexes are rebuilt in readFromDisk --------------------
+	{
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->resource_manager = new ResourceManager(PlatformUtils::getTempDirPath() + "/user_index_test_resources");
+		world_state->readFromDisk(db_path);
+
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		testAssert(world_state->user_id_to_users.size() == 4);
+		testAssert(world_state->userIndexesAreConsistent());
+		testAssert(world_state->findUserByNameCaseInsensitive("ALICE")->id == UserID(0));
+		testAssert(world_state->findUserByEmail("a@example.com")->id == UserID(0));
+		testAssert(world_state->findUserForResetTokenHash(makeTestTokenHash(3))->id == UserID(2));
+		testAssert(world_state->findUserForResetTokenHash(makeTestTokenHash(1)) == NULL);
+		testAssert(world_state->findUserForWebSession("session_a")->id == UserID(2));
+	}
+
+	//-------------------- Test password checking, and rehashing of passwords with weaker params on login --------------------
+	{
+		Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+		world_state->password_hash_params = test_params;
+		world_state->password_hash_pool = new PasswordHashThreadPool(/*num threads=*/2, /*max queue size=*/16);
+
+		UserRef legacy_user = makeTestUser(5, "dave", "");
+		legacy_user->setNewPasswordAndSalt("legacypassword", PasswordHashParams()); // Use the original salted SHA-256 scheme.
+		{
+			ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+			world_state->addUser(legacy_user);
+		}
+
+		testAssert(!world_state->checkUserPassword("dave", "wrongpassword").valid());
+		testAssert(!world_state->checkUserPassword("nobody", "legacypassword").valid());
+		testAssert(legacy_user->password_hash_params == PasswordHashParams()); // Should not have been rehashed on a failed login.
+
+		testAssert(world_state->checkUserPassword("dave", "legacypassword") == UserID(5));
+		testAssert(legacy_user->password_hash_params == test_params); // Should have been rehashed.
+		testAssert(legacy_user->isPasswordValid("legacypassword"));
+		testAssert(world_state->checkUserPassword("dave", "legacypassword") == UserID(5)); // Should still be able to log in.
+
+		world_state->setUserPassword(UserID(5), "changedpassword");
+		testAssert(!world_state->checkPasswordForUser(UserID(5), "legacypassword"));
+		testAssert(world_state->checkPasswordForUser(UserID(5), "changedpassword"));
+	}
+
+	conPrint("ServerAllWorldsState::test() done.");
+}
+
+
+#endif // BUILD_TESTS
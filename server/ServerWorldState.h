@@ -19,31 +19,50 @@ Generated at 2016-01-12 12:22:34 +1300
 #include "ParcelAuction.h"
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
+#include "WebDataSnapshot.h"
+#include "LockProfiler.h"
+#include "PasswordHashThreadPool.h"
+#include "DatabaseChangeLog.h"
 #include <ThreadSafeRefCounted.h>
 #include <Platform.h>
 #include <Mutex.h>
 #include <Database.h>
 #include <map>
 #include <unordered_set>
+#include <array>
+#include <atomic>
+class BufferOutStream;
 
 
+/*=====================================================================
+ServerWorldState
+----------------
+The objects, parcels and avatars in a single world.
+
+Protected by its own mutex, so that activity in one world doesn't block clients in other worlds.
+See the lock ordering notes on ServerAllWorldsState below.
+=====================================================================*/
 class ServerWorldState : public ThreadSafeRefCounted
 {
 public:
-	void addParcelAsDBDirty(const ParcelRef parcel) { db_dirty_parcels.insert(parcel); }
-	void addWorldObjectAsDBDirty(const WorldObjectRef ob) { db_dirty_world_objects.insert(ob); }
+	void addParcelAsDBDirty(const ParcelRef parcel)			REQUIRES(mutex) { db_dirty_parcels.insert(parcel); parcels_changed = 1; }
+	void addWorldObjectAsDBDirty(const WorldObjectRef ob)	REQUIRES(mutex) { db_dirty_world_objects.insert(ob); }
+
+	WorldSettings world_settings GUARDED_BY(mutex);
 
-	WorldSettings world_settings;
+	std::map<UID, Reference<Avatar>> avatars GUARDED_BY(mutex);
 
-	std::map<UID, Reference<Avatar>> avatars;
+	std::map<UID, WorldObjectRef> objects GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects GUARDED_BY(mutex);
 
-	std::map<UID, WorldObjectRef> objects;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> dirty_from_remote_objects;
+	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels GUARDED_BY(mutex);
+	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects GUARDED_BY(mutex);
 
-	std::unordered_set<ParcelRef, ParcelRefHash> db_dirty_parcels;
-	std::unordered_set<WorldObjectRef, WorldObjectRefHash> db_dirty_world_objects;
+	std::map<ParcelID, ParcelRef> parcels GUARDED_BY(mutex);
 
-	std::map<ParcelID, ParcelRef> parcels;
+	glare::AtomicInt parcels_changed; // Set when a parcel is added to db_dirty_parcels.  Used to tell when the web data snapshot needs to be rebuilt.
+
+	mutable ::Mutex mutex; // Lock with ProfiledLock, see LockProfiler.
 };
 
 
@@ -100,11 +119,23 @@ struct ServerCredentials
 
 
 /*=====================================================================
-ServerWorldState
-----------------
+ServerAllWorldsState
+--------------------
+Lock ordering:
+
+ServerAllWorldsState::mutex protects the world_states map, users, web sessions, orders, auctions etc.
+ServerWorldState::mutex protects the contents of a single world.
+ResourceManager has its own mutex, which protects the resource map.
 
+If both are needed, lock ServerAllWorldsState::mutex first, then ServerWorldState::mutex.
+Don't lock ServerAllWorldsState::mutex while holding a ServerWorldState::mutex,
+and only hold one ServerWorldState::mutex at a time.
+The ResourceManager mutex can be locked while holding either, but nothing else may be locked while holding it.
+
+Code that only touches a single world (e.g. a WorkerThread handling object and avatar updates) should take
+just that world's mutex, via a Reference<ServerWorldState> it already holds.
 =====================================================================*/
-class ServerAllWorldsState : public ThreadSafeRefCounted
+class ServerAllWorldsState : public ThreadSafeRefCounted, public DatabaseRecordSource
 {
 public:
 	ServerAllWorldsState();
@@ -112,7 +143,10 @@ public:
 
 	void readFromDisk(const std::string& path);
 	void createNewDatabase(const std::string& path);
-	void serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.
+	size_t serialiseToDisk() REQUIRES(mutex); // Write any changed data (objects in dirty set) to disk.  Mutex should be held already.  Returns number of records written.
+
+	// DatabaseRecordSource interface.  Re-serialises live objects for backups.  Locks mutex, so mutex should not be held already.
+	virtual void getRecordData(const std::unordered_set<uint64>& keys, std::unordered_map<uint64, std::vector<uint8>>& data_out) override;
 	void denormaliseData(); // Build/update cached/denormalised fields like creator_name.  Mutex should be locked already.
 
 	// Removes sensitive information from the database, such as user passwords, email addresses, billing information, web sessions etc.
@@ -121,8 +155,8 @@ public:
 
 	std::string getCredential(const std::string& key); // Throws glare::Exception if not found
 
-	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks mutex.
-	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks mutex.
+	UID getNextObjectUID(); // Gets and then increments next_object_uid.  Locks uid_mutex only, so can be called while holding a ServerWorldState mutex.
+	UID getNextAvatarUID(); // Gets and then increments next_avatar_uid.  Locks uid_mutex only.
 	uint64 getNextOrderUID(); // Gets and then increments next_order_uid.  Locks mutex.
 	uint64 getNextSubEthTransactionUID();
 	uint64 getNextScreenshotUID();
@@ -135,27 +169,62 @@ public:
 	void setUserWebMessage(const UserID& user_id, const std::string& s);
 	std::string getAndRemoveUserWebMessage(const UserID& user_id); // returns empty string if no message or user
 
-	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference
+	Reference<ServerWorldState> getRootWorldState(); // Guaranteed to return a non-null reference.  Locks mutex.
 
 	void addResourcesAsDBDirty(const ResourceRef resource)					REQUIRES(mutex) { db_dirty_resources.insert(resource); changed = 1; }
 	void addSubEthTransactionAsDBDirty(const SubEthTransactionRef trans)	REQUIRES(mutex) { db_dirty_sub_eth_transactions.insert(trans); changed = 1; }
 	void addOrderAsDBDirty(const OrderRef order)							REQUIRES(mutex) { db_dirty_orders.insert(order); changed = 1; }
-	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; }
+	void addParcelAuctionAsDBDirty(const ParcelAuctionRef parcel_auction)	REQUIRES(mutex) { db_dirty_parcel_auctions.insert(parcel_auction); changed = 1; web_data_snapshot_stale = 1; }
 	void addUserWebSessionAsDBDirty(const UserWebSessionRef screenshot)		REQUIRES(mutex) { db_dirty_userwebsessions.insert(screenshot); changed = 1; }
 	void addScreenshotAsDBDirty(const ScreenshotRef screenshot)				REQUIRES(mutex) { db_dirty_screenshots.insert(screenshot); changed = 1; }
 	void addUserAsDBDirty(const UserRef user)								REQUIRES(mutex) { db_dirty_users.insert(user); changed = 1; }
-	void addNewsPostAsDBDirty(const NewsPostRef post)						REQUIRES(mutex) { db_dirty_news_posts.insert(post); changed = 1; }
+	void addNewsPostAsDBDirty(const NewsPostRef post)						REQUIRES(mutex) { db_dirty_news_posts.insert(post); changed = 1; web_data_snapshot_stale = 1; }
 
 	void addEverythingToDirtySets();
 
-	bool isInReadOnlyMode();
+	// User lookups, using secondary indexes that are rebuilt by readFromDisk() and kept consistent with user_id_to_users.
+	// So add users with addUser(), and index new password resets with indexPasswordResetsForUser(), rather than modifying the maps directly.
+	void addUser(const UserRef user) REQUIRES(mutex); // Adds to user_id_to_users, name_to_users and the secondary indexes.
+	User* findUserByNameCaseInsensitive(const std::string& name) REQUIRES(mutex); // Returns NULL if not found.  If several users have the same lower-cased name, returns the one with the lowest id.
+	User* findUserByEmail(const std::string& email_address) REQUIRES(mutex); // Case-insensitive.  Returns NULL if not found.  If several users have the same email address, returns the one with the lowest id.
+	User* findUserForResetTokenHash(const std::array<uint8, 32>& token_hash) REQUIRES(mutex); // Returns NULL if no user has a pending password reset with the token hash.  Doesn't check expiry.
+	User* findUserForWebSession(const std::string& session_id) REQUIRES(mutex); // Returns NULL if no such session, or the session user doesn't exist.
+	void indexPasswordResetsForUser(User* user) REQUIRES(mutex); // Call after adding to user->password_resets.
+	bool resetUserPasswordWithTokenHash(const std::array<uint8, 32>& token_hash, const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params) REQUIRES(mutex); // Returns true if the token was valid and the password was reset.
+	void rebuildUserIndexes() REQUIRES(mutex);
+	bool userIndexesAreConsistent() REQUIRES(mutex); // For testing: compares the indexes against freshly rebuilt ones.
+
+	// Password checking and hashing.  These hash on password_hash_pool if it is set, otherwise on the calling thread.
+	// They don't hold mutex while hashing, so must not be called while holding mutex.  Throw glare::Exception if the pool is too busy.
+	std::string computePasswordHash(const std::string& password, const std::string& salt, const PasswordHashParams& params);
+	// Returns the id of the user with the given name if the password is valid for them, or an invalid UserID otherwise.
+	// If the password is valid but the user's hash was computed with weaker params than password_hash_params, rehashes the password with password_hash_params.
+	UserID checkUserPassword(const std::string& username, const std::string& password);
+	bool checkPasswordForUser(const UserID& user_id, const std::string& password); // As above, for a user id.
+	void setUserPassword(const UserID& user_id, const std::string& new_password); // Hashes the new password with password_hash_params and marks the user as DB-dirty.
+
+	static void test();
+
+	// Read-copy-update snapshot of the data web page handlers loop over, so they can render pages without holding mutex.  See WebDataSnapshot.
+	WebDataSnapshotRef getWebDataSnapshot() const; // Never returns NULL.  Only locks web_data_snapshot_mutex, so is cheap.
+	void updateWebDataSnapshot(); // Builds a new snapshot and publishes it.  Locks mutex and the root world mutex while copying.
+	bool isWebDataSnapshotStale(); // Has any of the snapshotted data been marked as DB-dirty since the last update?  Locks mutex.
+	void markWebDataSnapshotStale() { web_data_snapshot_stale = 1; }
+
+	bool isInReadOnlyMode() const { return read_only_mode; } // Doesn't lock mutex, so can be called while holding a ServerWorldState mutex.
 
 	void clearAndReset(); // Just for fuzzing
 
 	Reference<ResourceManager> resource_manager;
 
+	Reference<PasswordHashThreadPool> password_hash_pool; // May be NULL.  Set at startup.
+	PasswordHashParams password_hash_params; // Params for new password hashes.  Set at startup from the server config, and not modified after.
+
 	std::map<UserID, Reference<User>> user_id_to_users GUARDED_BY(mutex);  // User id to user
 	std::map<std::string, Reference<User>> name_to_users GUARDED_BY(mutex); // Username to user
+	std::map<std::string, Reference<User>> lower_case_name_to_users GUARDED_BY(mutex); // Lower-cased username to user.  See findUserByNameCaseInsensitive().
+	std::map<std::string, Reference<User>> email_to_users GUARDED_BY(mutex); // Lower-cased email address to user.  See findUserByEmail().
+	std::map<std::array<uint8, 32>, Reference<User>> reset_token_hash_to_users GUARDED_BY(mutex); // Password reset token hash to user.
 
 	std::map<uint64, OrderRef> orders GUARDED_BY(mutex); // Order ID to order
 
@@ -196,7 +265,7 @@ public:
 	bool server_admin_message_changed GUARDED_BY(mutex);
 
 	// Ephemeral state - is the server in read-only mode?  When true, clients can't make changes to objects etc.
-	bool read_only_mode GUARDED_BY(mutex);
+	std::atomic<bool> read_only_mode;
 
 	// Ephemeral state - do we want to force the DynamicTextureUpdaterThread to do a run?
 	bool force_dyn_tex_update GUARDED_BY(mutex);
@@ -218,14 +287,23 @@ public:
 
 	ServerCredentials server_credentials;
 
-	mutable ::Mutex mutex;
+	DatabaseChangeLog db_change_log; // Changes to database records and resources, for incremental backups.  Has its own mutex, see DatabaseChangeLog.
+
+	mutable ::Mutex mutex; // Lock with ProfiledLock, so contention can be profiled.  See LockProfiler.
 private:
 	GLARE_DISABLE_COPY(ServerAllWorldsState);
 
+	void updateDatabaseRecord(const DatabaseKey& key, const BufferOutStream& record_data) REQUIRES(mutex);
+
 	glare::AtomicInt changed;
 
-	UID next_object_uid GUARDED_BY(mutex);
-	UID next_avatar_uid GUARDED_BY(mutex);
+	mutable ::Mutex web_data_snapshot_mutex; // Leaf lock, just protects the web_data_snapshot reference.
+	WebDataSnapshotRef web_data_snapshot GUARDED_BY(web_data_snapshot_mutex);
+	glare::AtomicInt web_data_snapshot_stale;
+
+	::Mutex uid_mutex; // Leaf lock, nothing else is locked while holding it.
+	UID next_object_uid GUARDED_BY(uid_mutex);
+	UID next_avatar_uid GUARDED_BY(uid_mutex);
 	uint64 next_order_uid GUARDED_BY(mutex);
 	uint64 next_sub_eth_transaction_uid GUARDED_BY(mutex);
 
@@ -49,6 +49,7 @@ void UDPHandlerThread::doRun()
 			const size_t packet_len = udp_socket->readPacket(packet_buf.data(), (int)packet_buf.size(), sender_ip_addr, sender_port);
 
 			num_packets_rcvd++;
+			server->metrics.udp_packets_received.increment();
 			if(num_packets_rcvd % 512 == 0) // Log occasional packets:
 				conPrint("UDPHandlerThread: Received packet (packet " + toString(num_packets_rcvd) + ") of length " + toString(packet_len) + " from " + sender_ip_addr.toString() + ", port " + toString(sender_port));
 
@@ -82,6 +83,8 @@ void UDPHandlerThread::doRun()
 
 						udp_socket->sendPacket(packet_buf.data(), packet_len, connected_clients[i].ip_addr, connected_clients[i].client_UDP_port);
 					}
+
+					server->metrics.udp_voice_packets_relayed.add(connected_clients.size());
 				}
 				else if(type == 2)
 				{
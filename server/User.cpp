@@ -33,22 +33,8 @@ User::~User()
 
 bool User::isPasswordValid(const std::string& password_attempt) const
 {
-	const std::string attempt_digest = computePasswordHash(password_attempt, this->password_hash_salt);
-	return attempt_digest == this->hashed_password;
-}
-
-
-std::string User::computePasswordHash(const std::string& password, const std::string& salt)
-{
-	const std::string message = "jdfrY%TFkj&Cg&------" + password + "------" + salt;
-
-	std::vector<unsigned char> digest;
-	SHA256::hash((const unsigned char*)&(*message.begin()), (const unsigned char*)&(*message.begin()) + message.size(), digest);
-
-	std::string digest_str;
-	digest_str.resize(digest.size());
-	std::memcpy(&digest_str[0], digest.data(), digest.size());
-	return digest_str;
+	const std::string attempt_digest = PasswordHashing::computeHash(password_attempt, this->password_hash_salt, this->password_hash_params);
+	return PasswordHashing::hashesEqual(attempt_digest, this->hashed_password);
 }
 
 
@@ -106,7 +92,7 @@ bool User::isResetTokenHashValidForUser(const std::array<uint8, 32>& reset_token
 }
 
 
-bool User::resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_hash, const std::string& new_password)
+bool User::resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_hash, const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params)
 {
 	for(size_t i=0; i<password_resets.size(); ++i)
 	{
@@ -116,7 +102,7 @@ bool User::resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_h
 			if(password_resets[i].created_time.numSecondsAgo() < RESET_TOKEN_VALIDITY_DURATION_S)
 			{
 				// Valid reset token - apply password reset
-				this->hashed_password = computePasswordHash(new_password, this->password_hash_salt);
+				setPasswordHash(new_hashed_password, new_salt, new_params);
 
 				// Remove this reset token
 				password_resets.erase(password_resets.begin() + i);
@@ -129,22 +115,26 @@ bool User::resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_h
 }
 
 
-void User::setNewPasswordAndSalt(const std::string& new_password)
+void User::setNewPasswordAndSalt(const std::string& new_password, const PasswordHashParams& params)
 {
 	// We need a random salt for the user.
-	uint8 random_bytes[32];
-	CryptoRNG::getRandomBytes(random_bytes, 32); // throws glare::Exception
+	const std::string user_salt = PasswordHashing::generateSalt(); // throws glare::Exception
 
-	std::string user_salt;
-	Base64::encode(random_bytes, 32, user_salt); // Convert random bytes to base-64.
+	setPasswordHash(PasswordHashing::computeHash(new_password, user_salt, params), user_salt, params);
+}
 
-	this->hashed_password = computePasswordHash(new_password, user_salt);
-	this->password_hash_salt = user_salt;
+
+void User::setPasswordHash(const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params)
+{
+	this->hashed_password = new_hashed_password;
+	this->password_hash_salt = new_salt;
+	this->password_hash_params = new_params;
 }
 
 
-static const uint32 USER_SERIALISATION_VERSION = 5;
+static const uint32 USER_SERIALISATION_VERSION = 6;
 
+// Version 6: Added password_hash_params
 // Version 5: Added flags
 // Version 4: Added avatar_settings
 // Version 3: Added controlled_eth_address
@@ -175,6 +165,10 @@ void writeUserToStream(const User& user, RandomAccessOutStream& stream)
 	writeAvatarSettingsToStream(user.avatar_settings, stream);
 
 	stream.writeUInt32(user.flags);
+
+	stream.writeUInt32(user.password_hash_params.scheme);
+	stream.writeUInt32(user.password_hash_params.space_cost);
+	stream.writeUInt32(user.password_hash_params.time_cost);
 }
 
 
@@ -216,4 +210,14 @@ void readUserFromStream(RandomAccessInStream& stream, User& user)
 
 	if(v >= 5)
 		user.flags = stream.readUInt32();
+
+	if(v >= 6)
+	{
+		user.password_hash_params.scheme = stream.readUInt32();
+		user.password_hash_params.space_cost = stream.readUInt32();
+		user.password_hash_params.time_cost = stream.readUInt32();
+		PasswordHashing::checkParamsValid(user.password_hash_params); // Throws glare::Exception if invalid, so a corrupted record can't make us allocate huge amounts of memory.
+	}
+	else
+		user.password_hash_params = PasswordHashParams(); // Older users are using the original salted SHA-256 scheme.
 }
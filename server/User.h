@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2017 -
 
 
 #include "PasswordReset.h"
+#include "PasswordHashing.h"
 #include "../shared/TimeStamp.h"
 #include "../shared/UserID.h"
 #include "../shared/WorldMaterial.h"
@@ -45,10 +46,8 @@ public:
 	~User();
 
 
-	// Return digest
-	static std::string computePasswordHash(const std::string& password, const std::string& salt);
-
 	// Does the password, when hashed, match the password disgest we have stored?
+	// Computes the hash on the calling thread, so prefer ServerAllWorldsState::checkUserPassword(), which doesn't hold the world state mutex while hashing.
 	bool isPasswordValid(const std::string& password) const;
 
 	// Adds reset token to list of reset tokens for user.
@@ -56,9 +55,13 @@ public:
 	void sendPasswordResetEmail(const EmailSendingInfo& sending_info); // throws glare::Exception on error
 
 	bool isResetTokenHashValidForUser(const std::array<uint8, 32>& reset_token_hash) const;
-	bool resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_hash, const std::string& new_password);
+	// Sets the password hash to new_hashed_password (computed with new_salt and new_params) if the reset token is valid.
+	bool resetPasswordWithTokenHash(const std::array<uint8, 32>& reset_token_hash, const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params);
+
+	// Generates a new salt and hashes the password on the calling thread.
+	void setNewPasswordAndSalt(const std::string& new_password, const PasswordHashParams& params = PasswordHashing::defaultParams());
 
-	void setNewPasswordAndSalt(const std::string& new_password);
+	void setPasswordHash(const std::string& new_hashed_password, const std::string& new_salt, const PasswordHashParams& new_params);
 
 	UserID id;
 
@@ -69,6 +72,7 @@ public:
 
 	std::string hashed_password; // SHA-256 hash, so 256/8 = 32 bytes
 	std::string password_hash_salt; // Base-64 encoded 256 random bits.
+	PasswordHashParams password_hash_params; // Scheme and costs used to compute hashed_password.
 
 	std::string current_eth_signing_nonce; // Doesn't need to be serialised, should be generated and used relatively quickly.
 	std::string controlled_eth_address; // Eth address that user controls, in hex encoding with 0x prefix.  Empty if no such address.
@@ -0,0 +1,212 @@
+/*=====================================================================
+WebDataSnapshot.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WebDataSnapshot.h"
+
+
+#include "ServerWorldState.h"
+#include <ConPrint.h>
+#include <atomic>
+
+
+static std::atomic<uint64> next_snapshot_version(1);
+
+
+WebDataSnapshot::WebDataSnapshot()
+:	version(0),
+	build_time(0),
+	BTC_per_EUR(0),
+	ETH_per_EUR(0)
+{}
+
+
+WebDataSnapshot::~WebDataSnapshot()
+{}
+
+
+static ParcelRef copyParcel(const Parcel& parcel)
+{
+	ParcelRef copy = new Parcel();
+	copy->id = parcel.id;
+	copy->copyNetworkStateFrom(parcel, /*restrict_changes=*/false); // Copies most fields and calls build().
+	copy->screenshot_ids = parcel.screenshot_ids;
+	copy->nft_status = parcel.nft_status;
+	copy->minting_transaction_id = parcel.minting_transaction_id;
+	return copy;
+}
+
+
+static ParcelAuctionRef copyParcelAuction(const ParcelAuction& auction)
+{
+	ParcelAuctionRef copy = new ParcelAuction();
+	copy->id = auction.id;
+	copy->parcel_id = auction.parcel_id;
+	copy->auction_state = auction.auction_state;
+	copy->auction_start_time = auction.auction_start_time;
+	copy->auction_end_time = auction.auction_end_time;
+	copy->auction_start_price = auction.auction_start_price;
+	copy->auction_end_price = auction.auction_end_price;
+	copy->sold_price = auction.sold_price;
+	copy->auction_sold_time = auction.auction_sold_time;
+	copy->order_id = auction.order_id;
+	copy->last_locked_time = auction.last_locked_time;
+	copy->lock_duration = auction.lock_duration;
+	copy->screenshot_ids = auction.screenshot_ids;
+	copy->auction_locks = auction.auction_locks;
+	return copy;
+}
+
+
+static NewsPostRef copyNewsPost(const NewsPost& post)
+{
+	NewsPostRef copy = new NewsPost();
+	copy->id = post.id;
+	copy->creator_id = post.creator_id;
+	copy->created_time = post.created_time;
+	copy->last_modified_time = post.last_modified_time;
+	copy->title = post.title;
+	copy->content = post.content;
+	copy->thumbnail_URL = post.thumbnail_URL;
+	copy->state = post.state;
+	return copy;
+}
+
+
+Reference<WebDataSnapshot> WebDataSnapshot::build(ServerAllWorldsState& world_state)
+{
+	Reference<WebDataSnapshot> snapshot = new WebDataSnapshot();
+	snapshot->version = next_snapshot_version++;
+	snapshot->build_time = TimeStamp::currentTime();
+
+	ProfiledLock lock(world_state.mutex, LOCK_PROFILER_NAMED_SITE("WebDataSnapshot::build"));
+
+	{
+		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_NAMED_SITE("WebDataSnapshot::build root world"));
+
+		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
+			snapshot->root_world_parcels.insert(snapshot->root_world_parcels.end(), std::make_pair(it->first, copyParcel(*it->second)));
+	}
+
+	for(auto it = world_state.parcel_auctions.begin(); it != world_state.parcel_auctions.end(); ++it)
+		snapshot->parcel_auctions.insert(snapshot->parcel_auctions.end(), std::make_pair(it->first, copyParcelAuction(*it->second)));
+
+	for(auto it = world_state.news_posts.begin(); it != world_state.news_posts.end(); ++it)
+		snapshot->news_posts.insert(snapshot->news_posts.end(), std::make_pair(it->first, copyNewsPost(*it->second)));
+
+	snapshot->opensea_listed_parcel_ids.reserve(world_state.opensea_parcel_listings.size());
+	for(size_t i=0; i<world_state.opensea_parcel_listings.size(); ++i)
+		snapshot->opensea_listed_parcel_ids.push_back(world_state.opensea_parcel_listings[i].parcel_id);
+
+	snapshot->BTC_per_EUR = world_state.BTC_per_EUR;
+	snapshot->ETH_per_EUR = world_state.ETH_per_EUR;
+
+	return snapshot;
+}
+
+
+const Parcel* WebDataSnapshot::findParcel(const ParcelID& id) const
+{
+	const auto res = root_world_parcels.find(id);
+	return (res != root_world_parcels.end()) ? res->second.ptr() : NULL;
+}
+
+
+const ParcelAuction* WebDataSnapshot::findParcelAuction(uint32 id) const
+{
+	const auto res = parcel_auctions.find(id);
+	return (res != parcel_auctions.end()) ? res->second.ptr() : NULL;
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+void WebDataSnapshot::test()
+{
+	conPrint("WebDataSnapshot::test()");
+
+	Reference<ServerAllWorldsState> world_state = new ServerAllWorldsState();
+
+	// Initial snapshot should be empty, but non-null.
+	{
+		WebDataSnapshotRef snapshot = world_state->getWebDataSnapshot();
+		testAssert(snapshot.nonNull());
+		testAssert(snapshot->root_world_parcels.empty());
+		testAssert(world_state->isWebDataSnapshotStale());
+	}
+
+	ParcelRef parcel = new Parcel();
+	parcel->id = ParcelID(10);
+	parcel->owner_id = UserID(1);
+	parcel->description = "original description";
+	parcel->verts[0] = Vec2d(0, 0);
+	parcel->verts[1] = Vec2d(10, 0);
+	parcel->verts[2] = Vec2d(10, 10);
+	parcel->verts[3] = Vec2d(0, 10);
+	parcel->zbounds = Vec2d(-1, 10);
+	parcel->parcel_auction_ids.push_back(5);
+	parcel->build();
+
+	NewsPostRef post = new NewsPost();
+	post->id = 3;
+	post->title = "hello";
+	post->state = NewsPost::State_published;
+
+	ParcelAuctionRef auction = new ParcelAuction();
+	auction->id = 5;
+	auction->parcel_id = parcel->id;
+	auction->auction_state = ParcelAuction::AuctionState_ForSale;
+
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+		Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+		{
+			ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+			root_world->parcels[parcel->id] = parcel;
+			root_world->addParcelAsDBDirty(parcel);
+		}
+		world_state->news_posts[post->id] = post;
+		world_state->parcel_auctions[auction->id] = auction;
+	}
+
+	world_state->updateWebDataSnapshot();
+	testAssert(!world_state->isWebDataSnapshotStale());
+
+	WebDataSnapshotRef snapshot = world_state->getWebDataSnapshot();
+	testAssert(snapshot->root_world_parcels.size() == 1);
+	testAssert(snapshot->findParcel(ParcelID(10)) != NULL);
+	testAssert(snapshot->findParcel(ParcelID(10)) != parcel.ptr()); // Should be a copy
+	testAssert(snapshot->findParcel(ParcelID(10))->description == "original description");
+	testAssert(snapshot->findParcel(ParcelID(10))->aabb_max.x == 10);
+	testAssert(snapshot->findParcel(ParcelID(11)) == NULL);
+	testAssert(snapshot->findParcelAuction(5) != NULL && snapshot->findParcelAuction(5)->parcel_id == ParcelID(10));
+	testAssert(snapshot->news_posts.size() == 1 && snapshot->news_posts.begin()->second->title == "hello");
+
+	// Modify the live data.  The snapshot we hold should not change.
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+		Reference<ServerWorldState> root_world = world_state->getRootWorldState();
+		ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+		parcel->description = "new description";
+		root_world->addParcelAsDBDirty(parcel);
+	}
+	testAssert(world_state->isWebDataSnapshotStale());
+	testAssert(snapshot->findParcel(ParcelID(10))->description == "original description");
+
+	world_state->updateWebDataSnapshot();
+	WebDataSnapshotRef new_snapshot = world_state->getWebDataSnapshot();
+	testAssert(new_snapshot->version > snapshot->version);
+	testAssert(new_snapshot->findParcel(ParcelID(10))->description == "new description");
+	testAssert(snapshot->findParcel(ParcelID(10))->description == "original description");
+
+	conPrint("WebDataSnapshot::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,69 @@
+/*=====================================================================
+WebDataSnapshot.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../shared/Parcel.h"
+#include "../shared/ParcelID.h"
+#include "../shared/TimeStamp.h"
+#include "ParcelAuction.h"
+#include "NewsPost.h"
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Platform.h>
+#include <map>
+#include <vector>
+#include <string>
+
+
+class ServerAllWorldsState;
+
+
+/*=====================================================================
+WebDataSnapshot
+---------------
+A read-only copy of the world state data that web page handlers loop over:
+the root world parcels, parcel auctions and news posts.
+Users aren't copied, as there are a lot of them and no handler loops over them; handlers that need a user look it up under the mutex.
+
+Snapshots are built by the main server loop when the data has changed (see ServerAllWorldsState::updateWebDataSnapshot()),
+and published by swapping a reference, so web handlers can render pages from a snapshot without holding
+ServerAllWorldsState::mutex or the root world mutex.
+Everything in a snapshot is a copy, and is not modified after the snapshot is published, so may be read from any thread.
+A snapshot may be a second or so behind the live world state.
+=====================================================================*/
+class WebDataSnapshot : public ThreadSafeRefCounted
+{
+public:
+	WebDataSnapshot();
+	~WebDataSnapshot();
+
+	// Copies data out of world_state.  Locks world_state.mutex and the root world mutex.
+	static Reference<WebDataSnapshot> build(ServerAllWorldsState& world_state);
+
+	// Returns NULL if not found.
+	const Parcel* findParcel(const ParcelID& id) const;
+	const ParcelAuction* findParcelAuction(uint32 id) const;
+
+	static void test();
+
+	uint64 version; // Incremented each time a snapshot is built.
+	TimeStamp build_time;
+
+	std::map<ParcelID, ParcelRef> root_world_parcels;
+	std::map<uint32, ParcelAuctionRef> parcel_auctions;
+	std::map<uint64, NewsPostRef> news_posts;
+
+	std::vector<ParcelID> opensea_listed_parcel_ids;
+	double BTC_per_EUR;
+	double ETH_per_EUR;
+
+private:
+	GLARE_DISABLE_COPY(WebDataSnapshot);
+};
+
+
+typedef Reference<WebDataSnapshot> WebDataSnapshotRef;
@@ -11,6 +11,12 @@ Copyright Glare Technologies Limited 2018 -
 #include "Screenshot.h"
 #include "SubEthTransaction.h"
 #include "MeshLODGenThread.h"
+#include "ChunkedUploadManager.h"
+#include "ResourceCompression.h"
+#include "ResourceCompressionThread.h"
+#include "ResourceRequestQueue.h"
+#include "ScreenshotVariants.h"
+#include "ScreenshotVariantThread.h"
 #include "../webserver/LoginHandlers.h"
 #include "../shared/Protocol.h"
 #include "../shared/ProtocolStructs.h"
@@ -18,7 +24,9 @@ Copyright Glare Technologies Limited 2018 -
 #include "../shared/WorldObject.h"
 #include "../shared/MessageUtils.h"
 #include "../shared/FileTypes.h"
+#include "../shared/BackupStore.h"
 #include <vec3.h>
+#include <mathstypes.h>
 #include <ConPrint.h>
 #include <Clock.h>
 #include <AESEncryption.h>
@@ -43,15 +51,118 @@ Copyright Glare Technologies Limited 2018 -
 #include <algorithm>
 #include <RuntimeCheck.h>
 #include <Timer.h>
+#include <map>
+#include <deque>
+#include <unordered_set>
+#include <cstring>
 
 
 static const bool VERBOSE = false;
 static const int MAX_STRING_LEN = 10000;
 static const bool CAPTURE_TRACES = false; // If true, records a trace of data read from the socket, for fuzz seeding.
+static const float CELL_WIDTH = 200.f; // Width of the QueryObjects grid cells.  NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
+static const size_t MAX_DEFERRED_MESSAGE_BYTES = 1024 * 1024; // A client with more rate-limited messages than this waiting to be processed is disconnected.
+
+
+// ObjectTransformUpdate and object query messages from a client that were rate limited.
+// Instead of being dropped, they are processed later, once the client's rate limit allows.
+// Transform updates are coalesced, so only the latest update for each object is kept.  Object queries are kept and processed in order.
+struct DeferredClientMessages
+{
+	struct Message
+	{
+		uint32 msg_type;
+		std::vector<uint8> data; // Entire message, including the type and length header.
+	};
+
+	DeferredClientMessages() : total_bytes(0) {}
+
+	bool empty() const { return transform_updates.empty() && object_queries.empty(); }
+
+	static bool isDeferrableMessageType(uint32 msg_type)
+	{
+		return msg_type == Protocol::ObjectTransformUpdate || msg_type == Protocol::QueryObjects || msg_type == Protocol::QueryObjectsInAABB;
+	}
+
+	// Returns true if the message must be deferred even if the rate limit allows it, so that it is not processed before earlier deferred messages.
+	bool mustDefer(uint32 msg_type, BufferInStream& msg_buffer) const
+	{
+		if(msg_type == Protocol::ObjectTransformUpdate)
+			return !transform_updates.empty() && (transform_updates.count(peekObjectUID(msg_buffer)) > 0);
+		else
+			return !object_queries.empty();
+	}
+
+	// Stores the message in msg_buffer to be processed later.  Throws glare::Exception if the client has too many deferred messages.
+	void deferMessage(uint32 msg_type, BufferInStream& msg_buffer)
+	{
+		Message msg;
+		msg.msg_type = msg_type;
+		msg.data.assign(msg_buffer.buf.data(), msg_buffer.buf.data() + msg_buffer.buf.size());
+
+		if(msg_type == Protocol::ObjectTransformUpdate)
+		{
+			Message& existing = transform_updates[peekObjectUID(msg_buffer)];
+			total_bytes -= existing.data.size();
+			total_bytes += msg.data.size();
+			existing = std::move(msg);
+		}
+		else
+		{
+			total_bytes += msg.data.size();
+			object_queries.push_back(std::move(msg));
+		}
+
+		if(total_bytes > MAX_DEFERRED_MESSAGE_BYTES)
+			throw glare::Exception("Client is sending rate-limited messages too quickly, disconnecting.");
+	}
+
+	// If there is a deferred message that the rate limit now allows, copies it into msg_buffer, ready for processing, and returns true.
+	bool takeMessage(ServerRateLimiters& rate_limiters, const std::string& rate_limit_key, BufferInStream& msg_buffer, uint32& msg_type_out)
+	{
+		if(!object_queries.empty() && rate_limiters.object_queries.tryConsume(rate_limit_key, Clock::getTimeSinceInit()))
+		{
+			setMessageBuffer(object_queries.front(), msg_buffer, msg_type_out);
+			object_queries.pop_front();
+			return true;
+		}
+		if(!transform_updates.empty() && rate_limiters.object_transform_updates.tryConsume(rate_limit_key, Clock::getTimeSinceInit()))
+		{
+			setMessageBuffer(transform_updates.begin()->second, msg_buffer, msg_type_out);
+			transform_updates.erase(transform_updates.begin());
+			return true;
+		}
+		return false;
+	}
+
+private:
+	// ObjectTransformUpdate messages start with the object UID.
+	static UID peekObjectUID(BufferInStream& msg_buffer)
+	{
+		const size_t initial_read_index = msg_buffer.read_index;
+		const UID uid = readUIDFromStream(msg_buffer);
+		msg_buffer.read_index = initial_read_index;
+		return uid;
+	}
+
+	void setMessageBuffer(const Message& msg, BufferInStream& msg_buffer, uint32& msg_type_out)
+	{
+		msg_buffer.buf.resizeNoCopy(msg.data.size());
+		std::memcpy(msg_buffer.buf.data(), msg.data.data(), msg.data.size());
+		msg_buffer.read_index = sizeof(uint32) * 2;
+		msg_type_out = msg.msg_type;
+		total_bytes -= msg.data.size();
+	}
+
+	std::map<UID, Message> transform_updates;
+	std::deque<Message> object_queries;
+	size_t total_bytes;
+};
 
 
 WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* server_)
-:	socket(socket_),
+:	connected_to_world(0),
+	socket(socket_),
 	server(server_),
 	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder),
 	fuzzing(false),
@@ -66,6 +177,8 @@ WorkerThread::WorkerThread(const Reference<SocketInterface>& socket_, Server* se
 
 WorkerThread::~WorkerThread()
 {
+	// Any data still in the send queue will never be sent, so remove it from the send queue size metric.
+	server->metrics.send_queue_bytes_dequeued.add(data_to_send.size());
 }
 
 
@@ -138,7 +251,7 @@ static void enqueuePacketToBroadcast(const SocketBufferOutStream& packet_buffer,
 }
 
 
-void WorkerThread::handleResourceUploadConnection()
+void WorkerThread::handleResourceUploadConnection(bool chunked)
 {
 	conPrintIfNotFuzzing("handleResourceUploadConnection()");
 
@@ -149,22 +262,7 @@ void WorkerThread::handleResourceUploadConnection()
 
 		conPrintIfNotFuzzing("\tusername: '" + username + "'");
 
-		UserID client_user_id = UserID::invalidUserID();
-		std::string client_user_name;
-		{
-			Lock lock(server->world_state->mutex);
-			auto res = server->world_state->name_to_users.find(username);
-			if(res != server->world_state->name_to_users.end())
-			{
-				User* user = res->second.getPointer();
-				if(user->isPasswordValid(password))
-				{
-					// Password is valid, log user in.
-					client_user_id = user->id;
-					client_user_name = user->name;
-				}
-			}
-		}
+		const UserID client_user_id = server->world_state->checkUserPassword(username, password); // Hashes without holding the world state mutex.
 
 		if(!client_user_id.valid())
 		{
@@ -176,6 +274,16 @@ void WorkerThread::handleResourceUploadConnection()
 			return;
 		}
 
+		if(!server->rate_limiters.resource_uploads.tryConsume(ServerRateLimiters::clientKey(client_user_id, socket->getOtherEndIPAddress()), Clock::getTimeSinceInit()))
+		{
+			conPrintIfNotFuzzing("\tToo many uploads.");
+			socket->writeUInt32(Protocol::TooManyUploads); // Note that this is not a framed message.
+			socket->writeStringLengthFirst("Too many uploads, please try again later.");
+
+			socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+			return;
+		}
+
 		if(server->world_state->isInReadOnlyMode())
 		{
 			conPrint("\tin read only-mode..");
@@ -201,7 +309,7 @@ void WorkerThread::handleResourceUploadConnection()
 		ResourceRef resource = server->world_state->resource_manager->getOrCreateResourceForURL(URL); // Will create a new Resource ob if not already inserted.
 
 		{
-			Lock lock(server->world_state->mutex);
+			ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 			server->world_state->addResourcesAsDBDirty(resource);
 		}
 
@@ -229,6 +337,12 @@ void WorkerThread::handleResourceUploadConnection()
 		
 		// resource->setState(Resource::State_Transferring); // Don't set this (for now) or we will have to handle changing it on exceptions below.
 
+		if(chunked)
+		{
+			receiveChunkedUpload(resource, URL, client_user_id);
+			return;
+		}
+
 
 		const uint64 file_len = socket->readUInt64();
 		conPrintIfNotFuzzing("\tfile_len: " + toString(file_len) + " B");
@@ -271,6 +385,7 @@ void WorkerThread::handleResourceUploadConnection()
 					file.writeData(temp_buf.data(), chunk_size);
 
 				offset += chunk_size;
+				server->metrics.bytes_received.add(chunk_size);
 			}
 
 			file.close(); // Manually call close, to check for any errors via failbit.
@@ -279,76 +394,410 @@ void WorkerThread::handleResourceUploadConnection()
 
 		conPrintIfNotFuzzing("\tReceived file with URL '" + URL + "' from client. (" + toString(file_len) + " B)");
 
-		resource->owner_id = client_user_id;
-		resource->setState(Resource::State_Present);
+		resourceUploaded(resource, URL, client_user_id);
 
-		{
-			Lock lock(server->world_state->mutex);
-			server->world_state->addResourcesAsDBDirty(resource);
-		}
 
-		// Send NewResourceOnServer message to connected clients
-		{
-			MessageUtils::initPacket(scratch_packet, Protocol::NewResourceOnServer);
-			scratch_packet.writeStringLengthFirst(URL);
-			MessageUtils::updatePacketLengthField(scratch_packet);
+		// Connection will be closed by the client after the client has uploaded the file.  Wait for the connection to close.
+		socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+		socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+	}
+	catch(MySocketExcep& e)
+	{
+		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
+			conPrint("Resource upload client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		else
+			conPrint("Socket error: " + e.what());
+	}
+	catch(glare::Exception& e)
+	{
+		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+	}
+	catch(std::bad_alloc&)
+	{
+		conPrint("WorkerThread: Caught std::bad_alloc.");
+	}
+}
 
-			enqueuePacketToBroadcast(scratch_packet, server);
-		}
+
+// Marks the resource as present and owned by the uploader, tells clients about it, and asks the LOD gen thread to process objects using it.
+void WorkerThread::resourceUploaded(const Reference<Resource>& resource, const std::string& URL, const UserID& client_user_id)
+{
+	// Remove any compressed variants of a previous file at this URL, and get the ResourceCompressionThread to make new ones.
+	if(!fuzzing)
+		ResourceCompression::removeCompressedVariants(server->world_state->resource_manager->getLocalAbsPathForResource(*resource));
+	server->enqueueMsgForResourceCompressionThread(new CompressResourceMessage(URL));
+
+	resource->owner_id = client_user_id;
+	resource->setState(Resource::State_Present);
+
+	{
+		ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
+		server->world_state->addResourcesAsDBDirty(resource);
+	}
+
+	// Send NewResourceOnServer message to connected clients
+	{
+		MessageUtils::initPacket(scratch_packet, Protocol::NewResourceOnServer);
+		scratch_packet.writeStringLengthFirst(URL);
+		MessageUtils::updatePacketLengthField(scratch_packet);
+
+		enqueuePacketToBroadcast(scratch_packet, server);
+	}
 
 
-		// See if this is a resource that is used by an object.  If so, send a message to the MeshLodGenThread to generate LOD levels and KTX versions of it if applicable.
+	// See if this is a resource that is used by an object.  If so, send a message to the MeshLodGenThread to generate LOD levels and KTX versions of it if applicable.
+	{
+		std::vector<UID> ob_uids; // UIDs of objects which use this resource
 		{
-			std::vector<UID> ob_uids; // UIDs of objects which use this resource
+			ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
+			for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
 			{
-				Lock lock(server->world_state->mutex);
-				for(auto world_it = server->world_state->world_states.begin(); world_it != server->world_state->world_states.end(); ++world_it)
+				ServerWorldState* world = world_it->second.ptr();
+				ProfiledLock world_lock(world->mutex, LOCK_PROFILER_SITE());
+
+				std::set<DependencyURL> URLs;
+				for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
 				{
-					ServerWorldState* world = world_it->second.ptr();
+					const WorldObject* ob = it->second.ptr();
+					URLs.clear();
+					ob->getDependencyURLSetForAllLODLevels(URLs);
 
-					std::set<DependencyURL> URLs;
-					for(auto it = world->objects.begin(); it != world->objects.end(); ++it)
+					if(URLs.count(DependencyURL(URL)) > 0) // If the object uses the resource with this URL:
 					{
-						const WorldObject* ob = it->second.ptr();
-						URLs.clear();
-						ob->getDependencyURLSetForAllLODLevels(URLs);
-
-						if(URLs.count(DependencyURL(URL)) > 0) // If the object uses the resource with this URL:
-						{
-							ob_uids.push_back(ob->uid);
-						}
+						ob_uids.push_back(ob->uid);
 					}
 				}
 			}
+		}
 
-			for(size_t i=0; i<ob_uids.size(); ++i)
-			{
-				CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
-				msg->ob_uid = ob_uids[i];
-				server->enqueueMsgForLodGenThread(msg);
-			}
+		for(size_t i=0; i<ob_uids.size(); ++i)
+		{
+			CheckGenResourcesForObject* msg = new CheckGenResourcesForObject();
+			msg->ob_uid = ob_uids[i];
+			server->enqueueMsgForLodGenThread(msg);
 		}
+	}
+}
 
 
-		// Connection will be closed by the client after the client has uploaded the file.  Wait for the connection to close.
-		socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-		socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+// Handles the rest of a ConnectionTypeUploadResourceChunked connection, after the client has logged in and been allowed to write to the URL.
+// See the protocol description in Protocol.h.
+void WorkerThread::receiveChunkedUpload(const Reference<Resource>& resource, const std::string& URL, const UserID& client_user_id)
+{
+	const uint64 file_len = socket->readUInt64();
+	const uint64 content_hash = socket->readUInt64();
+	const uint32 chunk_size = socket->readUInt32();
+	conPrintIfNotFuzzing("\tfile_len: " + toString(file_len) + " B, content_hash: " + toString(content_hash) + ", chunk_size: " + toString(chunk_size) + " B");
+
+	if(file_len == 0 || file_len > 1000000000)
+	{
+		socket->writeUInt32(Protocol::InvalidFileSize); // Note that this is not a framed message.
+		socket->writeStringLengthFirst("Invalid file len.");
+		return;
 	}
-	catch(MySocketExcep& e)
+
+	if(server->chunked_upload_manager.isNull())
 	{
-		if(e.excepType() == MySocketExcep::ExcepType_ConnectionClosedGracefully)
-			conPrint("Resource upload client from " + IPAddress::formatIPAddressAndPort(socket->getOtherEndIPAddress(), socket->getOtherEndPort()) + " closed connection gracefully.");
+		socket->writeUInt32(Protocol::UploadFailed);
+		socket->writeStringLengthFirst("Chunked uploads are not supported.");
+		return;
+	}
+
+	// If we already have the resource with the same content, the client doesn't need to send anything.
+	if(resource->getState() == Resource::State_Present)
+	{
+		const std::string local_path = server->world_state->resource_manager->pathForURL(URL);
+		if(FileUtils::fileExists(local_path) && (FileUtils::getFileSize(local_path) == file_len) && (ChunkedUploadManager::computeFileHash(local_path) == content_hash))
+		{
+			conPrintIfNotFuzzing("\tResource already present.");
+			socket->writeUInt32(Protocol::ResourceAlreadyPresent);
+			return;
+		}
+	}
+
+	ChunkedUploadManager* manager = server->chunked_upload_manager.ptr();
+	ChunkedUploadRef upload;
+	try
+	{
+		upload = manager->beginStream(URL, file_len, content_hash, chunk_size, client_user_id);
+	}
+	catch(glare::Exception& e)
+	{
+		socket->writeUInt32(Protocol::UploadFailed);
+		socket->writeStringLengthFirst(e.what());
+		return;
+	}
+
+	try
+	{
+		std::vector<uint32> missing_chunks;
+		upload->getMissingChunks(missing_chunks);
+		conPrintIfNotFuzzing("\t" + toString(missing_chunks.size()) + " / " + toString(upload->numChunks()) + " chunks needed.");
+
+		socket->writeUInt32(Protocol::UploadAllowed);
+		socket->writeUInt32((uint32)missing_chunks.size());
+		for(size_t i=0; i<missing_chunks.size(); ++i)
+			socket->writeUInt32(missing_chunks[i]);
+
+		std::fstream file;
+		ChunkedUploadManager::openPartialFile(*upload, file);
+
+		js::Vector<uint8, 16> chunk_buf(chunk_size);
+		while(1)
+		{
+			const uint32 chunk_index = socket->readUInt32();
+			if(chunk_index == Protocol::EndOfChunks)
+				break;
+			if(chunk_index >= upload->numChunks())
+				throw glare::Exception("Invalid chunk index " + toString(chunk_index));
+
+			const uint32 chunk_len = upload->chunkLen(chunk_index);
+			socket->readData(chunk_buf.data(), chunk_len);
+			server->metrics.bytes_received.add(chunk_len);
+
+			manager->writeChunk(*upload, file, chunk_index, chunk_buf.data(), chunk_len);
+		}
+	}
+	catch(...) // Catch everything (not just glare::Exception, but std::bad_alloc etc. as well) so that the stream is always ended.
+	{
+		// The connection dropped or the client sent something invalid.  The chunks received so far are kept, so the client can resume the upload.
+		// If this was the last chunk needed, we can still finish the upload though.
+		if(manager->endStream(*upload))
+			commitChunkedUpload(*upload, resource, client_user_id);
+		throw;
+	}
+
+	const uint32 result = manager->endStream(*upload) ? commitChunkedUpload(*upload, resource, client_user_id) : Protocol::UploadChunksReceived;
+	socket->writeUInt32(result);
+
+	// Connection will be closed by the client after it has read the result.  Wait for the connection to close.
+	socket->startGracefulShutdown();
+	socket->waitForGracefulDisconnect();
+}
+
+
+// Called once all chunks of a chunked upload have been received.  Checks the hash, then moves the partial file into the resource dir.
+// Returns the result code to send to the client.
+uint32 WorkerThread::commitChunkedUpload(ChunkedUpload& upload, const Reference<Resource>& resource, const UserID& client_user_id)
+{
+	ChunkedUploadManager* manager = server->chunked_upload_manager.ptr();
+	try
+	{
+		if(!ChunkedUploadManager::verifyUpload(upload))
+		{
+			conPrint("\tChunked upload of '" + upload.URL + "' failed hash verification, discarding.");
+			manager->removeUpload(upload);
+			return Protocol::UploadHashMismatch;
+		}
+
+		const std::string local_path = server->world_state->resource_manager->pathForURL(upload.URL);
+		if(FileUtils::fileExists(local_path))
+			FileUtils::deleteFile(local_path);
+		FileUtils::moveFile(upload.partial_path, local_path);
+	}
+	catch(...) // endStream() returned true for this connection, so we are responsible for removing the upload, whatever went wrong.
+	{
+		manager->removeUpload(upload);
+		throw;
+	}
+
+	manager->removeUpload(upload); // Removes the state file, the partial file has been moved already.
+
+	conPrintIfNotFuzzing("\tReceived and verified file with URL '" + upload.URL + "' from client. (" + toString(upload.file_len) + " B)");
+
+	resourceUploaded(resource, upload.URL, client_user_id);
+
+	return Protocol::UploadComplete;
+}
+
+
+// Writes the result code for the resource with the given URL, followed by the resource data if we have it.
+// The zstd-compressed variant of the resource is sent if there is one and client_accepts_zstd is true.
+void WorkerThread::sendResource(const std::string& URL, bool client_accepts_zstd)
+{
+	if(!ResourceManager::isValidURL(URL))
+	{
+		conPrint("\tRequested URL was invalid.");
+		socket->writeUInt32(Protocol::GetFileResultNotFound); // write error msg to client
+		return;
+	}
+
+	// conPrint("\tRequested URL was valid.");
+
+	const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
+	if(resource.isNull() || (resource->getState() != Resource::State_Present))
+	{
+		conPrintIfNotFuzzing("\tRequested URL was not present on disk.");
+		socket->writeUInt32(Protocol::GetFileResultNotFound); // write error msg to client
+		return;
+	}
+
+	const std::string local_path = server->world_state->resource_manager->getLocalAbsPathForResource(*resource);
+
+	// conPrint("\tlocal path: '" + local_path + "'");
+
+	try
+	{
+		// Send the precompressed variant if there is one and the client accepts it.
+		const std::string zstd_path = ResourceCompression::zstdVariantPath(local_path);
+		if(client_accepts_zstd && ResourceCompression::isCompressibleURL(URL) && FileUtils::fileExists(zstd_path))
+		{
+			MemMappedFile file(local_path);
+			MemMappedFile zstd_file(zstd_path);
+			socket->writeUInt32(Protocol::GetFileResultOKZstd);
+			socket->writeUInt64(file.fileSize()); // Write uncompressed file size
+			socket->writeUInt64(zstd_file.fileSize()); // Write compressed size
+			socket->writeData(zstd_file.fileData(), zstd_file.fileSize());
+			server->metrics.bytes_sent.add(zstd_file.fileSize());
+
+			conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(zstd_file.fileSize()) + " B compressed, " + toString(file.fileSize()) + " B uncompressed)");
+		}
 		else
-			conPrint("Socket error: " + e.what());
+		{
+			// Load resource off disk
+			MemMappedFile file(local_path);
+			// conPrint("\tSending file to client.");
+			socket->writeUInt32(Protocol::GetFileResultOK); // write OK msg to client
+			socket->writeUInt64(file.fileSize()); // Write file size
+			socket->writeData(file.fileData(), file.fileSize()); // Write file data
+			server->metrics.bytes_sent.add(file.fileSize());
+
+			conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
+		}
 	}
 	catch(glare::Exception& e)
 	{
-		conPrintIfNotFuzzing("glare::Exception: " + e.what());
+		conPrintIfNotFuzzing("\tException while trying to load file for URL: " + e.what());
+
+		socket->writeUInt32(Protocol::GetFileResultNotFound); // write error msg to client
 	}
-	catch(std::bad_alloc&)
+}
+
+
+// Writes a GetFileResultBundle reply to a RequestCellLowLODModels request: the coarsest LOD models of the static objects in the given cell,
+// so that a client can show something for all the objects in the cell with a single download.  The client is expected to write the request id first.
+void WorkerThread::sendCellLowLODModels(const std::string& world_name, const Vec3<int>& cell_coords)
+{
+	const js::AABBox cell_aabb(
+		Vec4f(0,0,0,1) + Vec4f((float)cell_coords.x,     (float)cell_coords.y,     (float)cell_coords.z,     0)*CELL_WIDTH,
+		Vec4f(0,0,0,1) + Vec4f((float)(cell_coords.x+1), (float)(cell_coords.y+1), (float)(cell_coords.z+1), 0)*CELL_WIDTH
+	);
+
+	std::vector<std::string> URLs;
 	{
-		conPrint("WorkerThread: Caught std::bad_alloc.");
+		Reference<ServerWorldState> world;
+		{
+			ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
+			auto res = server->world_state->world_states.find(world_name);
+			if(res != server->world_state->world_states.end())
+				world = res->second;
+		}
+
+		if(world.nonNull())
+		{
+			std::unordered_set<std::string> URL_set;
+
+			ProfiledLock lock(world->mutex, LOCK_PROFILER_SITE());
+			for(auto it = world->objects.begin(); (it != world->objects.end()) && (URLs.size() < Protocol::MAX_CELL_BUNDLE_FILES); ++it)
+			{
+				const WorldObject* ob = it->second.ptr();
+
+				// The client only uses the coarsest LOD model as a stand-in for static objects, see GUIClient::shouldUseCoarsestLODModelAsStandIn().
+				if((ob->object_type == WorldObject::ObjectType_Generic) && !ob->model_url.empty() && (ob->max_model_lod_level > 0) && !ob->isDynamic() && ob->script.empty() && 
+					cell_aabb.contains(ob->pos.toVec4fPoint()))
+				{
+					const std::string URL = WorldObject::getLODModelURLForLevel(ob->model_url, ob->max_model_lod_level);
+					if(URL_set.insert(URL).second)
+						URLs.push_back(URL);
+				}
+			}
+		}
+	}
+
+	// Only send models we have.  LOD models may not have been generated yet.
+	for(size_t i=0; i<URLs.size(); )
+	{
+		const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URLs[i]);
+		if(resource.nonNull() && (resource->getState() == Resource::State_Present))
+			++i;
+		else
+		{
+			URLs[i] = URLs.back();
+			URLs.pop_back();
+		}
+	}
+
+	conPrintIfNotFuzzing("\tSending " + toString(URLs.size()) + " low LOD model(s) for cell (" + toString(cell_coords.x) + ", " + toString(cell_coords.y) + ", " + toString(cell_coords.z) + ") in world '" + world_name + "'");
+
+	socket->writeUInt32(Protocol::GetFileResultBundle);
+	socket->writeUInt32((uint32)URLs.size());
+	for(size_t i=0; i<URLs.size(); ++i)
+	{
+		socket->writeStringLengthFirst(URLs[i]);
+		sendResource(URLs[i], /*client_accepts_zstd=*/true);
+	}
+}
+
+
+// Sends a MapTilesResult message with the image URLs of the given tiles.  An empty URL is sent for tiles we don't have an image for.
+// tile_widths_px gives the width in pixels each tile will be drawn at, and the URL of the smallest tile image variant that is at least that wide is sent.
+// If tile_widths_px is empty, the full resolution tile images are used.
+void WorkerThread::sendMapTilesResult(const std::vector<Vec3i>& tile_coords, const std::vector<int>& tile_widths_px)
+{
+	ServerAllWorldsState* world_state = server->world_state.getPointer();
+
+	std::vector<std::string> result_URLs(tile_coords.size());
+	{
+		ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+
+		for(size_t i=0; i<tile_coords.size(); ++i)
+		{
+			auto res = world_state->map_tile_info.info.find(tile_coords[i]);
+			if(res != world_state->map_tile_info.info.end())
+			{
+				const TileInfo& tile_info = res->second;
+				if(tile_info.cur_tile_screenshot.nonNull())
+				{
+					result_URLs[i] = tile_info.cur_tile_screenshot->URL;
+				}
+				else if(tile_info.prev_tile_screenshot.nonNull())
+				{
+					result_URLs[i] = tile_info.prev_tile_screenshot->URL;
+				}
+
+				// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
+			}
+		}
+	}
+
+	// Use a reduced-resolution variant of each tile image if there is one and it's large enough.
+	for(size_t i=0; i<tile_widths_px.size() && i<result_URLs.size(); ++i)
+	{
+		const int variant_width = ScreenshotVariants::chooseVariantWidth(ScreenshotVariants::TILE_VARIANT_WIDTHS, staticArrayNumElems(ScreenshotVariants::TILE_VARIANT_WIDTHS), tile_widths_px[i]);
+		if(variant_width != 0 && !result_URLs[i].empty())
+		{
+			const std::string variant_URL = ScreenshotVariants::variantPath(result_URLs[i], variant_width);
+			const ResourceRef resource = world_state->resource_manager->getExistingResourceForURL(variant_URL);
+			if(resource.nonNull() && (resource->getState() == Resource::State_Present))
+				result_URLs[i] = variant_URL;
+		}
 	}
+
+	// Send result URLs back
+	MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
+	scratch_packet.writeUInt32((uint32)tile_coords.size());
+
+	// Write tile coords
+	scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
+
+	// Write URLS
+	for(size_t i=0; i<result_URLs.size(); ++i)
+		scratch_packet.writeStringLengthFirst(result_URLs[i]);
+
+	MessageUtils::updatePacketLengthField(scratch_packet);
+
+	socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
+	socket->flush();
 }
 
 
@@ -358,74 +807,106 @@ void WorkerThread::handleResourceDownloadConnection()
 
 	try
 	{
+		ResourceRequestQueue pending_requests; // Pipelined requests that we haven't replied to yet.
 
 		while(1)
 		{
-			const uint32 msg_type = socket->readUInt32();
-			if(msg_type == Protocol::GetFiles)
+			// If we have pipelined requests to reply to, just handle any messages that have arrived already, so that cancellations and priority changes 
+			// are applied before we send the next reply.  Otherwise block until the next message arrives.
+			while(pending_requests.empty() || socket->readable(/*timeout (s)=*/0))
 			{
-				const uint64 num_resources = socket->readUInt64();
-				
-				conPrintIfNotFuzzing("Handling GetFiles:\tnum resources requested: " + toString(num_resources));
-
-				for(size_t i=0; i<num_resources; ++i)
+				const uint32 msg_type = socket->readUInt32();
+				if(msg_type == Protocol::RequestFile)
 				{
-					const std::string URL = socket->readStringLengthFirst(MAX_STRING_LEN);
-
-					conPrintIfNotFuzzing("\tRequested URL: '" + URL + "'");
+					const uint32 request_id = socket->readUInt32();
+					const float priority = socket->readFloat();
+					const std::string URL = socket->readStringLengthFirst(Protocol::MAX_RESOURCE_URL_LEN);
 
-					if(!ResourceManager::isValidURL(URL))
+					if(pending_requests.size() >= Protocol::MAX_OUTSTANDING_FILE_REQUESTS)
 					{
-						conPrint("\tRequested URL was invalid.");
-						socket->writeUInt32(1); // write error msg to client
+						conPrintIfNotFuzzing("handleResourceDownloadConnection(): Client exceeded max outstanding file requests (" + toString(Protocol::MAX_OUTSTANDING_FILE_REQUESTS) + "), closing connection.");
+						return;
 					}
-					else
+
+					pending_requests.addRequest(request_id, priority, URL);
+				}
+				else if(msg_type == Protocol::RequestCellLowLODModels)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const float priority = socket->readFloat();
+					const std::string world_name = socket->readStringLengthFirst(MAX_STRING_LEN);
+					Vec3<int> cell_coords;
+					cell_coords.x = socket->readInt32();
+					cell_coords.y = socket->readInt32();
+					cell_coords.z = socket->readInt32();
+
+					if(pending_requests.size() >= Protocol::MAX_OUTSTANDING_FILE_REQUESTS)
 					{
-						// conPrint("\tRequested URL was valid.");
+						conPrintIfNotFuzzing("handleResourceDownloadConnection(): Client exceeded max outstanding file requests (" + toString(Protocol::MAX_OUTSTANDING_FILE_REQUESTS) + "), closing connection.");
+						return;
+					}
 
-						const ResourceRef resource = server->world_state->resource_manager->getExistingResourceForURL(URL);
-						if(resource.isNull() || (resource->getState() != Resource::State_Present))
-						{
-							conPrintIfNotFuzzing("\tRequested URL was not present on disk.");
-							socket->writeUInt32(1); // write error msg to client
-						}
-						else
-						{
-							const std::string local_path = server->world_state->resource_manager->getLocalAbsPathForResource(*resource);
+					pending_requests.addCellLowLODModelsRequest(request_id, priority, world_name, cell_coords);
+				}
+				else if(msg_type == Protocol::CancelFileRequest)
+				{
+					const uint32 request_id = socket->readUInt32();
+					if(pending_requests.removeRequest(request_id)) // If we haven't sent the file already:
+					{
+						socket->writeUInt32(request_id);
+						socket->writeUInt32(Protocol::GetFileResultCancelled);
+					}
+				}
+				else if(msg_type == Protocol::SetFileRequestPriority)
+				{
+					const uint32 request_id = socket->readUInt32();
+					const float priority = socket->readFloat();
+					pending_requests.setPriority(request_id, priority);
+				}
+				else if(msg_type == Protocol::GetFiles || msg_type == Protocol::GetFilesCompressed)
+				{
+					const bool client_accepts_zstd = msg_type == Protocol::GetFilesCompressed;
+					const uint64 num_resources = socket->readUInt64();
+				
+					conPrintIfNotFuzzing("Handling GetFiles:\tnum resources requested: " + toString(num_resources));
 
-							// conPrint("\tlocal path: '" + local_path + "'");
+					for(size_t i=0; i<num_resources; ++i)
+					{
+						const std::string URL = socket->readStringLengthFirst(Protocol::MAX_RESOURCE_URL_LEN);
 
-							try
-							{
-								// Load resource off disk
-								MemMappedFile file(local_path);
-								// conPrint("\tSending file to client.");
-								socket->writeUInt32(0); // write OK msg to client
-								socket->writeUInt64(file.fileSize()); // Write file size
-								socket->writeData(file.fileData(), file.fileSize()); // Write file data
-
-								conPrintIfNotFuzzing("\tSent file '" + local_path + "' to client. (" + toString(file.fileSize()) + " B)");
-							}
-							catch(glare::Exception& e)
-							{
-								conPrintIfNotFuzzing("\tException while trying to load file for URL: " + e.what());
+						conPrintIfNotFuzzing("\tRequested URL: '" + URL + "'");
 
-								socket->writeUInt32(1); // write error msg to client
-							}
-						}
+						sendResource(URL, client_accepts_zstd);
 					}
 				}
+				else if(msg_type == Protocol::CyberspaceGoodbye)
+				{
+					socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
+					socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
+					return;
+				}
+				else
+				{
+					conPrintIfNotFuzzing("handleResourceDownloadConnection(): Unhandled msg type: " + toString(msg_type));
+					return;
+				}
 			}
-			else if(msg_type == Protocol::CyberspaceGoodbye)
-			{
-				socket->startGracefulShutdown(); // Tell sockets lib to send a FIN packet to the client.
-				socket->waitForGracefulDisconnect(); // Wait for a FIN packet from the client. (indicated by recv() returning 0).  We can then close the socket without going into a wait state.
-				return;
-			}
-			else
+
+			// Reply to the most important pipelined request.
+			ResourceRequestQueue::Request request;
+			if(pending_requests.popMostImportant(request))
 			{
-				conPrintIfNotFuzzing("handleResourceDownloadConnection(): Unhandled msg type: " + toString(msg_type));
-				return;
+				socket->writeUInt32(request.request_id);
+				if(request.is_cell_low_lod_models_request)
+				{
+					sendCellLowLODModels(request.world_name, request.cell_coords);
+				}
+				else
+				{
+					conPrintIfNotFuzzing("\tRequested URL: '" + request.URL + "' (request id: " + toString(request.request_id) + ", priority: " + toString(request.priority) + ")");
+
+					sendResource(request.URL, /*client_accepts_zstd=*/true); // Clients using RequestFile always accept zstd.
+				}
 			}
 		}
 	}
@@ -463,7 +944,7 @@ void WorkerThread::handleScreenshotBotConnection()
 			ScreenshotRef screenshot;
 
 			{ // lock scope
-				Lock lock(server->world_state->mutex);
+				ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 
 				server->world_state->last_screenshot_bot_contact_time = TimeStamp::currentTime();
 
@@ -559,7 +1040,7 @@ void WorkerThread::handleScreenshotBotConnection()
 						resource->setState(Resource::State_Present);
 
 						{
-							Lock lock(server->world_state->mutex);
+							ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 							server->world_state->addResourcesAsDBDirty(resource);
 						}
 
@@ -571,12 +1052,14 @@ void WorkerThread::handleScreenshotBotConnection()
 					screenshot->local_path = screenshot_path;
 
 					{
-						Lock lock(server->world_state->mutex);
+						ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 						server->world_state->addScreenshotAsDBDirty(screenshot);
 
 						if(screenshot->is_map_tile) // If we received a tile screenshot, mark map tile info as dirty to get it saved.
 							server->world_state->map_tile_info.db_dirty = true;
 					}
+
+					server->enqueueMsgForScreenshotVariantThread(new MakeScreenshotVariantsMessage(screenshot));
 				}
 				else
 					throw glare::Exception("Client reported screenshot taking failed.");
@@ -620,7 +1103,7 @@ void WorkerThread::handleEthBotConnection()
 			SubEthTransactionRef trans;
 			uint64 largest_nonce_used = 0; 
 			{ // lock scope
-				Lock lock(server->world_state->mutex);
+				ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 
 				server->world_state->last_eth_bot_contact_time = TimeStamp::currentTime();
 
@@ -650,7 +1133,7 @@ void WorkerThread::handleEthBotConnection()
 
 				// Update transaction nonce and submitted_time
 				{ // lock scope
-					Lock lock(server->world_state->mutex);
+					ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 
 					trans->nonce = next_nonce; 
 					trans->submitted_time = TimeStamp::currentTime();
@@ -670,19 +1153,22 @@ void WorkerThread::handleEthBotConnection()
 
 					// Mark parcel as minted as an NFT
 					{ // lock scope
-						Lock lock(server->world_state->mutex);
+						ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 
 						trans->state = SubEthTransaction::State_Completed; // State_Submitted;
 						trans->transaction_hash = transaction_hash;
 
 						server->world_state->addSubEthTransactionAsDBDirty(trans);
 
-						auto parcel_res = server->world_state->getRootWorldState()->parcels.find(trans->parcel_id);
-						if(parcel_res != server->world_state->getRootWorldState()->parcels.end())
+						Reference<ServerWorldState> root_world = server->world_state->getRootWorldState();
+						ProfiledLock world_lock(root_world->mutex, LOCK_PROFILER_SITE());
+
+						auto parcel_res = root_world->parcels.find(trans->parcel_id);
+						if(parcel_res != root_world->parcels.end())
 						{
 							Parcel* parcel = parcel_res->second.ptr();
 							parcel->nft_status = Parcel::NFTStatus_MintedNFT;
-							server->world_state->getRootWorldState()->addParcelAsDBDirty(parcel);
+							root_world->addParcelAsDBDirty(parcel);
 							server->world_state->markAsChanged();
 						}
 					} // End lock scope
@@ -694,7 +1180,7 @@ void WorkerThread::handleEthBotConnection()
 					const std::string submission_error_message = socket->readStringLengthFirst(10000);
 
 					{ // lock scope
-						Lock lock(server->world_state->mutex);
+						ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 
 						trans->state = SubEthTransaction::State_Submitted;
 						trans->transaction_hash = UInt256(0);
@@ -727,6 +1213,55 @@ void WorkerThread::handleEthBotConnection()
 }
 
 
+// Sends batches of database and resource changes to the backup bot.  See the backup protocol description in Protocol.h.
+// Doesn't hold the world state mutex: DatabaseChangeLog has its own mutex, and getChanges() locks the world state itself, briefly, to re-serialise changed records.
+void WorkerThread::handleBackupBotConnection()
+{
+	conPrintIfNotFuzzing("handleBackupBotConnection()");
+
+	try
+	{
+		// Do authentication
+		const std::string password = socket->readStringLengthFirst(10000);
+		if(password != server->world_state->getCredential("backup_bot_password"))
+			throw glare::Exception("backup bot password was not correct.");
+
+		const uint64 MAX_BATCH_BYTES = 64 * 1024 * 1024;
+
+		while(1)
+		{
+			const uint32 msg_type = socket->readUInt32();
+			if(msg_type == Protocol::GetBackupChanges)
+			{
+				const uint64 epoch = socket->readUInt64();
+				const uint64 since_seq = socket->readUInt64();
+				const uint64 max_bytes = myMin(socket->readUInt64(), MAX_BATCH_BYTES);
+
+				DatabaseChangeBatch batch;
+				server->world_state->db_change_log.getChanges(epoch, since_seq, (size_t)max_bytes, /*record_source=*/*server->world_state, batch);
+
+				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
+				packet.writeUInt32(Protocol::BackupChanges);
+				writeToStream(batch, packet);
+				socket->writeData(packet.buf.data(), packet.buf.size());
+
+				conPrint("handleBackupBotConnection: sent " + toString(batch.changes.size()) + " change(s), up to seq " + toString(batch.last_seq) + (batch.is_full ? " (full)" : ""));
+			}
+			else if(msg_type == Protocol::CyberspaceGoodbye)
+			{
+				return;
+			}
+			else
+				throw glare::Exception("handleBackupBotConnection: Unknown message type " + toString(msg_type));
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("handleBackupBotConnection: glare::Exception: " + e.what());
+	}
+}
+
+
 static bool objectIsInParcelForWhichLoggedInUserHasWritePerms(const WorldObject& ob, const UserID& user_id, ServerWorldState& world_state)
 {
 	assert(user_id.valid());
@@ -841,7 +1376,11 @@ void WorkerThread::doRun()
 	
 		if(connection_type == Protocol::ConnectionTypeUploadResource)
 		{
-			handleResourceUploadConnection();
+			handleResourceUploadConnection(/*chunked=*/false);
+		}
+		else if(connection_type == Protocol::ConnectionTypeUploadResourceChunked)
+		{
+			handleResourceUploadConnection(/*chunked=*/true);
 		}
 		else if(connection_type == Protocol::ConnectionTypeDownloadResources)
 		{
@@ -855,6 +1394,10 @@ void WorkerThread::doRun()
 		{
 			handleEthBotConnection();
 		}
+		else if(connection_type == Protocol::ConnectionTypeBackupBot)
+		{
+			handleBackupBotConnection();
+		}
 		else if(connection_type == Protocol::ConnectionTypeUpdates)
 		{
 			if(CAPTURE_TRACES)
@@ -866,7 +1409,7 @@ void WorkerThread::doRun()
 			
 
 			{
-				Lock lock(world_state->mutex);
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 				// Create world if didn't exist before.
 				// For now only the main world ("") and personal worlds are allowed
 				if(world_name == "")
@@ -882,6 +1425,7 @@ void WorkerThread::doRun()
 			}
 
 			this->connected_world_name = world_name;
+			this->connected_to_world = 1;
 
 			// Write avatar UID assigned to the connected client.
 			client_avatar_uid = world_state->getNextAvatarUID();
@@ -890,7 +1434,7 @@ void WorkerThread::doRun()
 			// If the client connected via a websocket, they can be logged in with a session cookie.
 			// Note that this may only work if the websocket connects over TLS.
 			{
-				Lock lock(world_state->mutex);
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 				User* cookie_logged_in_user = LoginHandlers::getLoggedInUser(*world_state, this->websocket_request_info);
 	
 				if(cookie_logged_in_user != NULL)
@@ -927,7 +1471,7 @@ void WorkerThread::doRun()
 			// Send a ServerAdminMessage to client if we have a non-empty message.
 			std::string server_admin_msg;
 			{ // Lock scope
-				Lock lock(world_state->mutex);
+				ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 				server_admin_msg = world_state->server_admin_message;
 			} // End lock scope
 			if(!server_admin_msg.empty())
@@ -944,7 +1488,10 @@ void WorkerThread::doRun()
 			{
 				MessageUtils::initPacket(scratch_packet, Protocol::WorldSettingsInitialSendMessage);
 
-				cur_world_state->world_settings.writeToStream(scratch_packet);
+				{
+					ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
+					cur_world_state->world_settings.writeToStream(scratch_packet);
+				}
 
 				MessageUtils::updatePacketLengthField(scratch_packet);
 				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
@@ -956,7 +1503,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 					for(auto it = cur_world_state->avatars.begin(); it != cur_world_state->avatars.end(); ++it)
 					{
 						const Avatar* avatar = it->second.getPointer();
@@ -975,7 +1522,7 @@ void WorkerThread::doRun()
 
 			// Send all current object data to client
 			/*{
-				Lock lock(world_state->mutex);
+				ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 				for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 				{
 					const WorldObject* ob = it->second.getPointer();
@@ -993,7 +1540,7 @@ void WorkerThread::doRun()
 				SocketBufferOutStream packet(SocketBufferOutStream::DontUseNetworkByteOrder);
 
 				{ // Lock scope
-					Lock lock(world_state->mutex);
+					ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 					for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 					{
 						const Parcel* parcel = it->second.getPointer();
@@ -1024,6 +1571,10 @@ void WorkerThread::doRun()
 
 			socket->setNoDelayEnabled(true); // We want to send out lots of little packets with low latency.  So disable Nagle's algorithm, e.g. send coalescing.
 
+			const IPAddress client_ip_addr = socket->getOtherEndIPAddress(); // For rate limiting clients that aren't logged in.
+
+			DeferredClientMessages deferred_messages;
+
 			bool keep_looping = true;
 			while(keep_looping) // write to / read from socket loop
 			{
@@ -1039,42 +1590,79 @@ void WorkerThread::doRun()
 
 				if(temp_data_to_send.nonEmpty())
 				{
+					server->metrics.send_queue_bytes_dequeued.add(temp_data_to_send.size());
+
 					socket->writeData(temp_data_to_send.data(), temp_data_to_send.size());
 					socket->flush();
+
+					server->metrics.bytes_sent.add(temp_data_to_send.size());
 					temp_data_to_send.clear();
 				}
 
 
 				if(logged_in_user_is_lightmapper_bot)
 				{
-					Lock lock(server->world_state->mutex);
+					ProfiledLock lock(server->world_state->mutex, LOCK_PROFILER_SITE());
 					server->world_state->last_lightmapper_bot_contact_time = TimeStamp::currentTime(); // bit of a hack
 				}
 
 
+				const std::string rate_limit_key = ServerRateLimiters::clientKey(client_user_id, client_ip_addr);
+
+				// Process any deferred (previously rate-limited) message that the rate limit now allows, before reading more messages from the socket.
+				uint32 msg_type = 0;
+				bool have_msg = !deferred_messages.empty() && deferred_messages.takeMessage(server->rate_limiters, rate_limit_key, msg_buffer, msg_type);
+				if(!have_msg)
+				{
 #if defined(_WIN32) || defined(OSX)
-				if(socket->readable(0.05)) // If socket has some data to read from it:
+					have_msg = socket->readable(0.05); // If socket has some data to read from it:
 #else
-				if(socket->readable(event_fd)) // Block until either the socket is readable or the event fd is signalled, which means we have data to write.
+					// Block until either the socket is readable or the event fd is signalled, which means we have data to write.
+					// If there are deferred messages, only wait a short time, so they can be processed when the rate limit allows.
+					have_msg = deferred_messages.empty() ? socket->readable(event_fd) : socket->readable(0.05);
 #endif
-				{
-					// Read msg type and length
-					uint32 msg_type_and_len[2];
-					socket->readData(msg_type_and_len, sizeof(uint32) * 2);
-					const uint32 msg_type = msg_type_and_len[0];
-					const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+					if(have_msg)
+					{
+						// Read msg type and length
+						uint32 msg_type_and_len[2];
+						socket->readData(msg_type_and_len, sizeof(uint32) * 2);
+						msg_type = msg_type_and_len[0];
+						const uint32 msg_len = msg_type_and_len[1]; // Length of message, including the message type and length fields.
+
+						if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
+							throw glare::Exception("Invalid message size: " + toString(msg_len));
 
-					if((msg_len < sizeof(uint32) * 2) || (msg_len > 1000000))
-						throw glare::Exception("Invalid message size: " + toString(msg_len));
+						// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
 
-					// conPrint("WorkerThread: Read message header: id: " + toString(msg_type) + ", len: " + toString(msg_len));
+						// Read entire message
+						msg_buffer.buf.resizeNoCopy(msg_len);
+						msg_buffer.read_index = sizeof(uint32) * 2;
 
-					// Read entire message
-					msg_buffer.buf.resizeNoCopy(msg_len);
-					msg_buffer.read_index = sizeof(uint32) * 2;
+						socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
 
-					socket->readData(msg_buffer.buf.data() + sizeof(uint32) * 2, msg_len - sizeof(uint32) * 2); // Read rest of message, store in msg_buffer.
+						server->metrics.recordMessageIn(msg_type, msg_len);
 
+						// Rate limit clients that are sending too many messages of some types, before doing any work for them (e.g. taking the world state mutex).
+						// Chat messages over the limit are dropped.  Transform updates and object queries are deferred until the limit allows, so the
+						// latest object transforms still get applied and queried cells still get sent.
+						RateLimiter* rate_limiter = server->rate_limiters.getLimiterForMessageType(msg_type);
+						if(rate_limiter)
+						{
+							const bool deferrable = DeferredClientMessages::isDeferrableMessageType(msg_type);
+							if((deferrable && deferred_messages.mustDefer(msg_type, msg_buffer)) || !rate_limiter->tryConsume(rate_limit_key, Clock::getTimeSinceInit()))
+							{
+								if(deferrable)
+									deferred_messages.deferMessage(msg_type, msg_buffer); // Throws glare::Exception if the client has too many deferred messages, which disconnects it.
+								else if(msg_type == Protocol::ChatMessageID)
+									writeErrorMessageToClient(socket, "You are sending chat messages too quickly, please wait a bit.");
+								continue;
+							}
+						}
+					}
+				}
+
+				if(have_msg)
+				{
 					switch(msg_type)
 					{
 					case Protocol::CyberspaceGoodbye:
@@ -1141,7 +1729,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1209,8 +1797,10 @@ void WorkerThread::doRun()
 							readAvatarFromNetworkStreamGivenUID(msg_buffer, temp_avatar); // Read message data before grabbing lock
 
 							// Look up existing avatar in world state
+							bool avatar_settings_changed = false;
+							AvatarSettings new_avatar_settings;
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1218,29 +1808,28 @@ void WorkerThread::doRun()
 									avatar->copyNetworkStateFrom(temp_avatar);
 									avatar->other_dirty = true;
 
+									avatar_settings_changed = client_user_id.valid() && !(client_user_avatar_settings == avatar->avatar_settings);
+									if(avatar_settings_changed)
+										new_avatar_settings = avatar->avatar_settings;
 
-									// Store avatar settings in the user data
-									if(client_user_id.valid())
-									{
-										const bool avatar_settings_changed = !(client_user_avatar_settings == avatar->avatar_settings);
-
-										if(avatar_settings_changed && !world_state->isInReadOnlyMode())
-										{
-											client_user_avatar_settings = avatar->avatar_settings;
+									//conPrint("updated avatar transform");
+								}
+							}
 
-											auto res2 = world_state->user_id_to_users.find(client_user_id);
-											if(res2 != world_state->user_id_to_users.end())
-											{
-												Reference<User> client_user = res2->second;
-												client_user->avatar_settings = avatar->avatar_settings;
-												world_state->addUserAsDBDirty(client_user);
+							// Store avatar settings in the user data.  This is done after releasing the world lock, as we need the all-worlds lock to access the user.
+							if(avatar_settings_changed && !world_state->isInReadOnlyMode())
+							{
+								client_user_avatar_settings = new_avatar_settings;
 
-												conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
-											}
-										}
-									}
+								ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+								auto res2 = world_state->user_id_to_users.find(client_user_id);
+								if(res2 != world_state->user_id_to_users.end())
+								{
+									Reference<User> client_user = res2->second;
+									client_user->avatar_settings = new_avatar_settings;
+									world_state->addUserAsDBDirty(client_user);
 
-									//conPrint("updated avatar transform");
+									conPrintIfNotFuzzing("Updated user avatar settings.  model_url: " + client_user->avatar_settings.model_url);
 								}
 							}
 
@@ -1272,7 +1861,7 @@ void WorkerThread::doRun()
 
 							// Look up existing avatar in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->avatars.find(use_avatar_uid);
 								if(res == cur_world_state->avatars.end())
 								{
@@ -1308,7 +1897,7 @@ void WorkerThread::doRun()
 
 							// Mark avatar as dead
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->avatars.find(avatar_uid);
 								if(res != cur_world_state->avatars.end())
 								{
@@ -1377,7 +1966,7 @@ void WorkerThread::doRun()
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1432,7 +2021,7 @@ void WorkerThread::doRun()
 								std::string err_msg_to_client;
 								bool send_summon_object_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->objects.find(summon_msg.object_uid); // Look up existing object in world state
 									if(res != cur_world_state->objects.end())
 									{
@@ -1510,7 +2099,7 @@ void WorkerThread::doRun()
 								std::string err_msg_to_client;
 								// Look up existing object in world state
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1573,7 +2162,7 @@ void WorkerThread::doRun()
 								// Look up existing object in world state
 								bool send_must_be_owner_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1622,7 +2211,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1651,7 +2240,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1680,7 +2269,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1711,7 +2300,7 @@ void WorkerThread::doRun()
 
 							// Look up existing object in world state
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								auto res = cur_world_state->objects.find(object_uid);
 								if(res != cur_world_state->objects.end())
 								{
@@ -1777,7 +2366,7 @@ void WorkerThread::doRun()
 
 								// Insert object into world state
 								{
-									::Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 
 									new_ob->uid = world_state->getNextObjectUID();
 									new_ob->state = WorldObject::State_JustCreated;
@@ -1810,7 +2399,7 @@ void WorkerThread::doRun()
 							{
 								bool send_must_be_owner_msg = false;
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->objects.find(object_uid);
 									if(res != cur_world_state->objects.end())
 									{
@@ -1845,7 +2434,7 @@ void WorkerThread::doRun()
 							SocketBufferOutStream temp_buf(SocketBufferOutStream::DontUseNetworkByteOrder); // Will contain several messages
 
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 								{
 									const WorldObject* ob = it->second.getPointer();
@@ -1865,6 +2454,7 @@ void WorkerThread::doRun()
 
 							socket->writeData(temp_buf.buf.data(), temp_buf.buf.size());
 							socket->flush();
+							server->metrics.bytes_sent.add(temp_buf.buf.size());
 
 							break;
 						}
@@ -1893,8 +2483,6 @@ void WorkerThread::doRun()
 								//if(i < 10)
 								//	conPrint("cell " + toString(i) + " coords: " + toString(x) + ", " + toString(y) + ", " + toString(z));
 
-								const float CELL_WIDTH = 200.f; // NOTE: has to be the same value as in gui_client/ProximityLoader.cpp.
-
 								cell_aabbs[i] = js::AABBox(
 									Vec4f(0,0,0,1) + Vec4f((float)x,     (float)y,     (float)z,     0)*CELL_WIDTH,
 									Vec4f(0,0,0,1) + Vec4f((float)(x+1), (float)(y+1), (float)(z+1), 0)*CELL_WIDTH
@@ -1906,7 +2494,7 @@ void WorkerThread::doRun()
 							int num_obs_written = 0;
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 								{
 									const WorldObject* ob = it->second.ptr();
@@ -1940,6 +2528,7 @@ void WorkerThread::doRun()
 
 								socket->writeData(packet.buf.data(), packet.buf.size()); // Write data to network
 								socket->flush();
+								server->metrics.bytes_sent.add(packet.buf.size());
 							}
 						
 							break;
@@ -1985,7 +2574,7 @@ void WorkerThread::doRun()
 							obs.reserve(16384);
 
 							{ // Lock scope
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								for(auto it = cur_world_state->objects.begin(); it != cur_world_state->objects.end(); ++it)
 								{
 									const WorldObject* ob = it->second.ptr();
@@ -2048,6 +2637,7 @@ void WorkerThread::doRun()
 									}
 								}
 
+								server->metrics.bytes_sent.add(packet.buf.size());
 								conPrintIfNotFuzzing("QueryObjectsInAABB: Sending back info on objects took " + timer.elapsedStringNSigFigs(4));
 							}
 
@@ -2060,7 +2650,7 @@ void WorkerThread::doRun()
 							// Send all current parcel data to client
 							MessageUtils::initPacket(scratch_packet, Protocol::ParcelList);
 							{
-								Lock lock(world_state->mutex);
+								ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 								scratch_packet.writeUInt64(cur_world_state->parcels.size()); // Write num parcels
 								for(auto it = cur_world_state->parcels.begin(); it != cur_world_state->parcels.end(); ++it)
 									writeToNetworkStream(*it->second, scratch_packet, client_protocol_version); // Write parcel
@@ -2068,6 +2658,7 @@ void WorkerThread::doRun()
 							MessageUtils::updatePacketLengthField(scratch_packet);
 							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size()); // Send the data
 							socket->flush();
+							server->metrics.bytes_sent.add(scratch_packet.buf.size());
 							break;
 						}
 					case Protocol::ParcelFullUpdate: // Client wants to update a parcel
@@ -2092,7 +2683,7 @@ void WorkerThread::doRun()
 								// Look up existing parcel in world state
 								std::string error_msg;
 								{
-									Lock lock(world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									auto res = cur_world_state->parcels.find(parcel_id);
 									if(res != cur_world_state->parcels.end())
 									{
@@ -2189,17 +2780,20 @@ void WorkerThread::doRun()
 							conPrintIfNotFuzzing("username: '" + username + "'");
 						
 							bool logged_in = false;
+							std::string login_failure_msg = "Login failed: username or password incorrect.";
+							try
 							{
-								Lock lock(world_state->mutex);
-								auto res = world_state->name_to_users.find(username);
-								if(res != world_state->name_to_users.end())
+								// Check the password without holding the world state mutex, as hashing is slow.
+								const UserID user_id = world_state->checkUserPassword(username, password);
+								conPrintIfNotFuzzing("password_valid: " + boolToString(user_id.valid()));
+								if(user_id.valid())
 								{
-									User* user = res->second.getPointer();
-									const bool password_valid = user->isPasswordValid(password);
-									conPrintIfNotFuzzing("password_valid: " + boolToString(password_valid));
-									if(password_valid)
+									ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+									auto res = world_state->user_id_to_users.find(user_id);
+									if(res != world_state->user_id_to_users.end())
 									{
 										// Password is valid, log user in.
+										User* user = res->second.getPointer();
 										client_user_id = user->id;
 										client_user_name = user->name;
 										client_user_avatar_settings = user->avatar_settings;
@@ -2209,6 +2803,10 @@ void WorkerThread::doRun()
 									}
 								}
 							}
+							catch(glare::Exception& e) // Password hashing pool may be too busy.
+							{
+								login_failure_msg = "Login failed: " + e.what();
+							}
 
 							conPrintIfNotFuzzing("logged_in: " + boolToString(logged_in));
 							if(logged_in)
@@ -2231,7 +2829,7 @@ void WorkerThread::doRun()
 							{
 								// Login failed.  Send error message back to client
 								MessageUtils::initPacket(scratch_packet, Protocol::ErrorMessageID);
-								scratch_packet.writeStringLengthFirst("Login failed: username or password incorrect.");
+								scratch_packet.writeStringLengthFirst(login_failure_msg);
 								MessageUtils::updatePacketLengthField(scratch_packet);
 
 								socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
@@ -2285,9 +2883,12 @@ void WorkerThread::doRun()
 											msg_to_client = "Password is too short, must have at least 6 characters";
 										else
 										{
-											Lock lock(world_state->mutex);
-											auto res = world_state->name_to_users.find(username);
-											if(res == world_state->name_to_users.end())
+											// Hash the password before taking the world state mutex, as hashing is slow.
+											const std::string salt = PasswordHashing::generateSalt();
+											const std::string hashed_password = world_state->computePasswordHash(password, salt, world_state->password_hash_params);
+
+											ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
+											if(!world_state->findUserByNameCaseInsensitive(username))
 											{
 												Reference<User> new_user = new User();
 												new_user->id = UserID((uint32)world_state->name_to_users.size());
@@ -2295,13 +2896,12 @@ void WorkerThread::doRun()
 												new_user->name = username;
 												new_user->email_address = email;
 
-												new_user->setNewPasswordAndSalt(password);
+												new_user->setPasswordHash(hashed_password, salt, world_state->password_hash_params);
 
 												world_state->addUserAsDBDirty(new_user);
 
 												// Add new user to world state
-												world_state->user_id_to_users.insert(std::make_pair(new_user->id, new_user));
-												world_state->name_to_users   .insert(std::make_pair(username,     new_user));
+												world_state->addUser(new_user);
 												world_state->markAsChanged(); // Mark as changed so gets saved to disk.
 
 												client_user_id = new_user->id; // Log user in as well.
@@ -2369,7 +2969,7 @@ void WorkerThread::doRun()
 							//// TEMP: Send password reset email in this thread for now. 
 							//// TODO: move to another thread (make some kind of background task?)
 							//{
-							//	Lock lock(world_state->mutex);
+							//	ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
 							//		if(it->second->email_address == email)
 							//		{
@@ -2404,7 +3004,7 @@ void WorkerThread::doRun()
 							////conPrint("new_password: " + new_password);
 							//
 							//{
-							//	Lock lock(world_state->mutex);
+							//	ProfiledLock lock(world_state->mutex, LOCK_PROFILER_SITE());
 							//
 							//	// Find user with the given email address:
 							//	for(auto it = world_state->user_id_to_users.begin(); it != world_state->user_id_to_users.end(); ++it)
@@ -2432,7 +3032,7 @@ void WorkerThread::doRun()
 							if(userConnectedToTheirPersonalWorldOrGodUser(client_user_id, client_user_name, this->connected_world_name))
 							{
 								{
-									Lock lock(server->world_state->mutex);
+									ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 									cur_world_state->world_settings.copyNetworkStateFrom(world_settings);
 									cur_world_state->world_settings.db_dirty = true;
 									world_state->markAsChanged();
@@ -2484,45 +3084,49 @@ void WorkerThread::doRun()
 							std::vector<Vec3i> tile_coords(num_tiles);
 							msg_buffer.readData(tile_coords.data(), num_tiles * sizeof(Vec3i));
 
-							std::vector<std::string> result_URLs(num_tiles);
-							{
-								Lock lock(world_state->mutex);
+							sendMapTilesResult(tile_coords, /*tile_widths_px=*/std::vector<int>());
 
-								for(size_t i=0; i<tile_coords.size(); ++i)
+							break;
+						}
+					case Protocol::QueryMapTilesInRect:
+						{
+							conPrintIfNotFuzzing("QueryMapTilesInRect");
+
+							const int tile_z  = msg_buffer.readInt32();
+							const int x_begin = msg_buffer.readInt32();
+							const int y_begin = msg_buffer.readInt32();
+							const int x_end   = msg_buffer.readInt32();
+							const int y_end   = msg_buffer.readInt32();
+							const uint32 tile_width_px = msg_buffer.readUInt32();
+
+							// Check the rect is valid and not too large.  Use int64 to avoid overflow.
+							if(tile_z < 0 || tile_z > 16 || x_end <= x_begin || y_end <= y_begin || ((int64)x_end - (int64)x_begin) * ((int64)y_end - (int64)y_begin) > 256)
+								throw glare::Exception("QueryMapTilesInRect: invalid rect");
+
+							// Get the tiles in the rect, and the tiles covering them at each lower zoom level, in case the client doesn't have a tile at this level and needs to use a zoomed-out tile.
+							// Tiles at lower zoom levels cover a larger area, so will be drawn larger.
+							std::vector<Vec3i> tile_coords;
+							std::vector<int> tile_widths_px;
+							int lvl_tile_width_px = (int)myMin(tile_width_px, (uint32)ScreenshotVariants::FULL_TILE_WIDTH);
+							int lvl_x_begin = x_begin, lvl_y_begin = y_begin, lvl_x_end = x_end, lvl_y_end = y_end;
+							for(int z = tile_z; z >= 0; --z)
+							{
+								for(int y = lvl_y_begin; y < lvl_y_end; ++y)
+								for(int x = lvl_x_begin; x < lvl_x_end; ++x)
 								{
-									auto res = world_state->map_tile_info.info.find(tile_coords[i]);
-									if(res != world_state->map_tile_info.info.end())
-									{
-										const TileInfo& tile_info = res->second;
-										if(tile_info.cur_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.cur_tile_screenshot->URL;
-										}
-										else if(tile_info.prev_tile_screenshot.nonNull())
-										{
-											result_URLs[i] = tile_info.prev_tile_screenshot->URL;
-										}
-
-										// conPrint("QueryMapTiles: Found result_URLs[i]: " + result_URLs[i]);
-									}
+									tile_coords.push_back(Vec3i(x, y, z));
+									tile_widths_px.push_back(lvl_tile_width_px);
 								}
-							}
 
-							// Send result URLs back
-							MessageUtils::initPacket(scratch_packet, Protocol::MapTilesResult);
-							scratch_packet.writeUInt32(num_tiles);
+								lvl_tile_width_px = myMin(lvl_tile_width_px * 2, ScreenshotVariants::FULL_TILE_WIDTH);
 
-							// Write tile coords
-							scratch_packet.writeData(tile_coords.data(), tile_coords.size() * sizeof(Vec3i));
-
-							// Write URLS
-							for(size_t i=0; i<result_URLs.size(); ++i)
-								scratch_packet.writeStringLengthFirst(result_URLs[i]);
-
-							MessageUtils::updatePacketLengthField(scratch_packet);
+								lvl_x_begin = Maths::divideByTwoRoundedDown(lvl_x_begin);
+								lvl_y_begin = Maths::divideByTwoRoundedDown(lvl_y_begin);
+								lvl_x_end = Maths::divideByTwoRoundedDown(lvl_x_end - 1) + 1;
+								lvl_y_end = Maths::divideByTwoRoundedDown(lvl_y_end - 1) + 1;
+							}
 
-							socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
-							socket->flush();
+							sendMapTilesResult(tile_coords, tile_widths_px);
 
 							break;
 						}
@@ -2578,7 +3182,7 @@ void WorkerThread::doRun()
 	// Mark avatar corresponding to client as dead.  Note that we want to do this after catching any exceptions, so avatar is removed on broken connections etc.
 	if(cur_world_state.nonNull())
 	{
-		Lock lock(world_state->mutex);
+		ProfiledLock lock(cur_world_state->mutex, LOCK_PROFILER_SITE());
 		if(cur_world_state->avatars.count(client_avatar_uid) == 1)
 		{
 			cur_world_state->avatars[client_avatar_uid]->state = Avatar::State_Dead;
@@ -2604,6 +3208,9 @@ void WorkerThread::enqueueDataToSend(const std::string& data)
 	// Append data to data_to_send
 	if(!data.empty())
 	{
+		server->metrics.recordMessageOut(data.data(), data.size());
+		server->metrics.send_queue_bytes_enqueued.add(data.size());
+
 		Lock lock(data_to_send_mutex);
 		const size_t write_i = data_to_send.size();
 		data_to_send.resize(write_i + data.size());
@@ -2619,6 +3226,9 @@ void WorkerThread::enqueueDataToSend(const SocketBufferOutStream& packet) // thr
 	// Append data to data_to_send
 	if(!packet.buf.empty())
 	{
+		server->metrics.recordMessageOut(packet.buf.data(), packet.buf.size());
+		server->metrics.send_queue_bytes_enqueued.add(packet.buf.size());
+
 		Lock lock(data_to_send_mutex);
 		const size_t write_i = data_to_send.size();
 		data_to_send.resize(write_i + packet.buf.size());
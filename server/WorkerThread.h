@@ -15,8 +15,14 @@ Copyright Glare Technologies Limited 2018 -
 #include <SocketBufferOutStream.h>
 #include <Vector.h>
 #include <BufferInStream.h>
+#include <AtomicInt.h>
+#include <vec3.h>
 #include <string>
+#include <vector>
 class Server;
+class Resource;
+class UserID;
+class ChunkedUpload;
 
 
 /*=====================================================================
@@ -34,6 +40,7 @@ public:
 	virtual void doRun();
 
 	std::string connected_world_name;
+	glare::AtomicInt connected_to_world; // Set to non-zero once this is an updates connection and connected_world_name has been set.  Used for metrics.
 
 	void enqueueDataToSend(const std::string& data); // threadsafe
 	void enqueueDataToSend(const SocketBufferOutStream& packet); // threadsafe
@@ -42,10 +49,17 @@ public:
 
 private:
 	void sendGetFileMessageIfNeeded(const std::string& resource_URL);
-	void handleResourceUploadConnection();
+	void handleResourceUploadConnection(bool chunked);
+	void receiveChunkedUpload(const Reference<Resource>& resource, const std::string& URL, const UserID& client_user_id);
+	uint32 commitChunkedUpload(ChunkedUpload& upload, const Reference<Resource>& resource, const UserID& client_user_id);
+	void resourceUploaded(const Reference<Resource>& resource, const std::string& URL, const UserID& client_user_id);
 	void handleResourceDownloadConnection();
+	void sendResource(const std::string& URL, bool client_accepts_zstd);
+	void sendCellLowLODModels(const std::string& world_name, const Vec3<int>& cell_coords);
+	void sendMapTilesResult(const std::vector<Vec3i>& tile_coords, const std::vector<int>& tile_widths_px);
 	void handleScreenshotBotConnection();
 	void handleEthBotConnection();
+	void handleBackupBotConnection();
 	void conPrintIfNotFuzzing(const std::string& msg);
 
 	Reference<SocketInterface> socket;
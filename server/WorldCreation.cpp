@@ -599,11 +599,12 @@ static void updateToUseImageCubeMeshes(ServerAllWorldsState& all_worlds_state)
 
 	size_t num_updated = 0;
 	{
-		Lock lock(all_worlds_state.mutex);
+		ProfiledLock lock(all_worlds_state.mutex, LOCK_PROFILER_SITE());
 		
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -654,11 +655,12 @@ void WorldCreation::removeHypercardMaterials(ServerAllWorldsState& all_worlds_st
 
 	size_t num_updated = 0;
 	{
-		Lock lock(all_worlds_state.mutex);
+		ProfiledLock lock(all_worlds_state.mutex, LOCK_PROFILER_SITE());
 
 		for(auto world_it = all_worlds_state.world_states.begin(); world_it != all_worlds_state.world_states.end(); ++world_it)
 		{
 			Reference<ServerWorldState> world_state = world_it->second;
+			ProfiledLock world_lock(world_state->mutex, LOCK_PROFILER_SITE());
 
 			for(auto i = world_state->objects.begin(); i != world_state->objects.end(); ++i)
 			{
@@ -0,0 +1,644 @@
+/*=====================================================================
+BackupStore.cpp
+---------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "BackupStore.h"
+
+
+#include <Database.h>
+#include <BufferOutStream.h>
+#include <BufferInStream.h>
+#include <InStream.h>
+#include <OutStream.h>
+#include <Exception.h>
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <FileUtils.h>
+#include <Clock.h>
+#include <IncludeXXHash.h>
+#include <algorithm>
+
+
+static const uint32 MAX_NUM_CHANGES_PER_BATCH = 1000000;
+static const uint32 MAX_RECORD_LEN = 64 * 1024 * 1024;
+static const size_t MAX_STRING_LEN = 10000;
+
+static const uint32 MANIFEST_MAGIC = 0x4D425553;
+static const uint32 MANIFEST_VERSION = 1;
+
+
+void writeToStream(const DatabaseChangeBatch& batch, OutStream& stream)
+{
+	stream.writeUInt64(batch.epoch);
+	stream.writeUInt64(batch.last_seq);
+	stream.writeUInt32((batch.is_full ? 1 : 0) | (batch.more ? 2 : 0));
+	stream.writeUInt32((uint32)batch.changes.size());
+	for(size_t i=0; i<batch.changes.size(); ++i)
+	{
+		const DatabaseChange& change = batch.changes[i];
+		stream.writeUInt32((uint32)change.type);
+		stream.writeUInt64(change.seq);
+		if(change.type == DatabaseChange::Type_RecordUpdated)
+		{
+			stream.writeUInt64(change.key);
+			stream.writeUInt32((uint32)change.data.size());
+			stream.writeData(change.data.data(), change.data.size());
+		}
+		else if(change.type == DatabaseChange::Type_RecordDeleted)
+		{
+			stream.writeUInt64(change.key);
+		}
+		else
+		{
+			stream.writeStringLengthFirst(change.URL);
+			stream.writeStringLengthFirst(change.local_filename);
+			stream.writeUInt64(change.file_size);
+			stream.writeUInt64(change.content_hash);
+		}
+	}
+}
+
+
+void readFromStream(InStream& stream, DatabaseChangeBatch& batch)
+{
+	batch.epoch = stream.readUInt64();
+	batch.last_seq = stream.readUInt64();
+	const uint32 flags = stream.readUInt32();
+	batch.is_full = (flags & 1) != 0;
+	batch.more = (flags & 2) != 0;
+
+	const uint32 num_changes = stream.readUInt32();
+	if(num_changes > MAX_NUM_CHANGES_PER_BATCH)
+		throw glare::Exception("Too many changes in batch: " + toString(num_changes));
+
+	batch.changes.resize(num_changes);
+	for(uint32 i=0; i<num_changes; ++i)
+	{
+		DatabaseChange& change = batch.changes[i];
+		const uint32 type = stream.readUInt32();
+		change.seq = stream.readUInt64();
+		if(type == DatabaseChange::Type_RecordUpdated)
+		{
+			change.type = DatabaseChange::Type_RecordUpdated;
+			change.key = stream.readUInt64();
+			const uint32 len = stream.readUInt32();
+			if(len > MAX_RECORD_LEN)
+				throw glare::Exception("Record too large: " + toString(len));
+			change.data.resize(len);
+			stream.readData(change.data.data(), len);
+		}
+		else if(type == DatabaseChange::Type_RecordDeleted)
+		{
+			change.type = DatabaseChange::Type_RecordDeleted;
+			change.key = stream.readUInt64();
+		}
+		else if(type == DatabaseChange::Type_ResourcePresent)
+		{
+			change.type = DatabaseChange::Type_ResourcePresent;
+			change.URL = stream.readStringLengthFirst(MAX_STRING_LEN);
+			change.local_filename = stream.readStringLengthFirst(MAX_STRING_LEN);
+			change.file_size = stream.readUInt64();
+			change.content_hash = stream.readUInt64();
+		}
+		else
+			throw glare::Exception("Invalid change type: " + toString(type));
+	}
+}
+
+
+void BackupManifest::applyChange(const DatabaseChange& change, uint64 record_chunk_hash)
+{
+	if(change.type == DatabaseChange::Type_RecordUpdated)
+	{
+		records[change.key] = record_chunk_hash;
+		deleted_keys.erase(change.key);
+	}
+	else if(change.type == DatabaseChange::Type_RecordDeleted)
+	{
+		records.erase(change.key);
+		if(!is_full) // A full manifest starts from an empty database, so doesn't need to record deletions.
+			deleted_keys.insert(change.key);
+	}
+	else
+	{
+		BackupResource& resource = resources[change.URL];
+		resource.local_filename = change.local_filename;
+		resource.file_size = change.file_size;
+		resource.content_hash = change.content_hash;
+	}
+}
+
+
+size_t BackupManifest::addResourcesToRetry(const BackupManifest& parent)
+{
+	size_t num_added = 0;
+	for(auto it = parent.resources.begin(); it != parent.resources.end(); ++it)
+	{
+		if(it->second.content_hash == 0 && resources.count(it->first) == 0)
+		{
+			resources[it->first] = it->second;
+			num_added++;
+		}
+	}
+	return num_added;
+}
+
+
+BackupStore::BackupStore(const std::string& backup_dir_)
+:	backup_dir(backup_dir_)
+{
+	FileUtils::createDirIfDoesNotExist(backup_dir);
+	FileUtils::createDirIfDoesNotExist(backup_dir + "/chunks");
+	FileUtils::createDirIfDoesNotExist(backup_dir + "/manifests");
+}
+
+
+uint64 BackupStore::hashData(const uint8* data, size_t len)
+{
+	return XXH64(data, len, /*seed=*/1);
+}
+
+
+// Chunks are spread over 256 subdirectories, so no single directory gets too large.
+std::string BackupStore::chunkPath(uint64 hash) const
+{
+	const std::string hex = leftPad(toHexString(hash), '0', 16);
+	return backup_dir + "/chunks/" + hex.substr(0, 2) + "/" + hex;
+}
+
+
+bool BackupStore::hasChunk(uint64 hash) const
+{
+	return FileUtils::fileExists(chunkPath(hash));
+}
+
+
+uint64 BackupStore::writeChunk(const uint8* data, size_t len)
+{
+	const uint64 hash = hashData(data, len);
+	const std::string path = chunkPath(hash);
+	if(!FileUtils::fileExists(path))
+	{
+		FileUtils::createDirIfDoesNotExist(FileUtils::getDirectory(path));
+
+		// Write to a temp file then move it into place, so an interrupted write doesn't leave a truncated chunk.
+		const std::string temp_path = path + ".tmp";
+		FileUtils::writeEntireFile(temp_path, (const char*)data, len);
+		FileUtils::moveFile(temp_path, path);
+	}
+	return hash;
+}
+
+
+void BackupStore::readChunk(uint64 hash, std::vector<uint8>& data_out) const
+{
+	std::string data;
+	FileUtils::readEntireFile(chunkPath(hash), data);
+	if(hashData((const uint8*)data.data(), data.size()) != hash)
+		throw glare::Exception("Chunk " + toHexString(hash) + " is corrupt (hash mismatch).");
+	data_out.assign((const uint8*)data.data(), (const uint8*)data.data() + data.size());
+}
+
+
+std::string BackupStore::writeManifest(const BackupManifest& manifest)
+{
+	BufferOutStream out;
+	out.writeUInt32(MANIFEST_MAGIC);
+	out.writeUInt32(MANIFEST_VERSION);
+	out.writeStringLengthFirst(manifest.parent_name);
+	out.writeUInt64(manifest.epoch);
+	out.writeUInt64(manifest.last_seq);
+	out.writeUInt32(manifest.is_full ? 1 : 0);
+	out.writeUInt64(manifest.time);
+
+	out.writeUInt64(manifest.records.size());
+	for(auto it = manifest.records.begin(); it != manifest.records.end(); ++it)
+	{
+		out.writeUInt64(it->first);
+		out.writeUInt64(it->second);
+	}
+
+	out.writeUInt64(manifest.deleted_keys.size());
+	for(auto it = manifest.deleted_keys.begin(); it != manifest.deleted_keys.end(); ++it)
+		out.writeUInt64(*it);
+
+	out.writeUInt64(manifest.resources.size());
+	for(auto it = manifest.resources.begin(); it != manifest.resources.end(); ++it)
+	{
+		out.writeStringLengthFirst(it->first);
+		out.writeStringLengthFirst(it->second.local_filename);
+		out.writeUInt64(it->second.file_size);
+		out.writeUInt64(it->second.content_hash);
+	}
+
+	// Manifests are numbered consecutively.
+	uint64 index = 0;
+	const std::string latest = getLatestManifestName();
+	if(!latest.empty())
+		index = stringToUInt64(::eatPrefix(latest, "manifest_")) + 1;
+	const std::string name = "manifest_" + toString(index);
+
+	const std::string path = backup_dir + "/manifests/" + name;
+	FileUtils::writeEntireFile(path + ".tmp", (const char*)out.buf.data(), out.buf.size());
+	FileUtils::moveFile(path + ".tmp", path);
+
+	FileUtils::writeEntireFileTextMode(backup_dir + "/latest_manifest.txt.tmp", name);
+	FileUtils::moveFile(backup_dir + "/latest_manifest.txt.tmp", backup_dir + "/latest_manifest.txt");
+	return name;
+}
+
+
+void BackupStore::readManifest(const std::string& name, BackupManifest& manifest_out) const
+{
+	if(!FileUtils::isPathSafe(name))
+		throw glare::Exception("Invalid manifest name '" + name + "'.");
+
+	std::string data;
+	FileUtils::readEntireFile(backup_dir + "/manifests/" + name, data);
+	BufferInStream in(ArrayRef<uint8>((const uint8*)data.data(), data.size()));
+
+	if(in.readUInt32() != MANIFEST_MAGIC)
+		throw glare::Exception("Manifest '" + name + "' has invalid magic number.");
+	const uint32 version = in.readUInt32();
+	if(version != MANIFEST_VERSION)
+		throw glare::Exception("Manifest '" + name + "' has unhandled version " + toString(version) + ".");
+
+	manifest_out = BackupManifest();
+	manifest_out.parent_name = in.readStringLengthFirst(MAX_STRING_LEN);
+	manifest_out.epoch = in.readUInt64();
+	manifest_out.last_seq = in.readUInt64();
+	manifest_out.is_full = in.readUInt32() != 0;
+	manifest_out.time = in.readUInt64();
+
+	const uint64 num_records = in.readUInt64();
+	for(uint64 i=0; i<num_records; ++i)
+	{
+		const uint64 key = in.readUInt64();
+		manifest_out.records[key] = in.readUInt64();
+	}
+
+	const uint64 num_deleted = in.readUInt64();
+	for(uint64 i=0; i<num_deleted; ++i)
+		manifest_out.deleted_keys.insert(in.readUInt64());
+
+	const uint64 num_resources = in.readUInt64();
+	for(uint64 i=0; i<num_resources; ++i)
+	{
+		const std::string URL = in.readStringLengthFirst(MAX_STRING_LEN);
+		BackupResource& resource = manifest_out.resources[URL];
+		resource.local_filename = in.readStringLengthFirst(MAX_STRING_LEN);
+		resource.file_size = in.readUInt64();
+		resource.content_hash = in.readUInt64();
+	}
+}
+
+
+std::string BackupStore::getLatestManifestName() const
+{
+	const std::string path = backup_dir + "/latest_manifest.txt";
+	if(!FileUtils::fileExists(path))
+		return std::string();
+	return ::stripHeadAndTailWhitespace(FileUtils::readEntireFileTextMode(path));
+}
+
+
+void BackupStore::getManifestChain(const std::string& name, std::vector<BackupManifest>& chain_out) const
+{
+	chain_out.clear();
+
+	std::string cur_name = name;
+	while(1)
+	{
+		if(chain_out.size() > 100000)
+			throw glare::Exception("Manifest chain too long, or has a cycle.");
+
+		BackupManifest manifest;
+		readManifest(cur_name, manifest);
+		chain_out.push_back(manifest);
+
+		if(manifest.is_full)
+			break;
+		if(manifest.parent_name.empty())
+			throw glare::Exception("Incremental manifest '" + cur_name + "' has no parent.");
+		cur_name = manifest.parent_name;
+	}
+
+	std::reverse(chain_out.begin(), chain_out.end());
+}
+
+
+void BackupStore::computeState(const std::vector<BackupManifest>& chain, std::map<uint64, uint64>& records_out, std::map<std::string, BackupResource>& resources_out)
+{
+	records_out.clear();
+	resources_out.clear();
+
+	for(size_t i=0; i<chain.size(); ++i)
+	{
+		const BackupManifest& manifest = chain[i];
+		if(manifest.is_full)
+			records_out.clear(); // Resources are never removed, so keep any from earlier manifests.
+
+		for(auto it = manifest.deleted_keys.begin(); it != manifest.deleted_keys.end(); ++it)
+			records_out.erase(*it);
+
+		for(auto it = manifest.records.begin(); it != manifest.records.end(); ++it)
+			records_out[it->first] = it->second;
+
+		for(auto it = manifest.resources.begin(); it != manifest.resources.end(); ++it)
+			resources_out[it->first] = it->second;
+	}
+}
+
+
+void BackupStore::restore(const std::string& manifest_name, const std::string& db_path, const std::string& resources_dir) const
+{
+	std::vector<BackupManifest> chain;
+	getManifestChain(manifest_name, chain);
+
+	std::map<uint64, uint64> records;
+	std::map<std::string, BackupResource> resources;
+	computeState(chain, records, resources);
+
+	conPrint("Restoring " + toString(records.size()) + " record(s) from a chain of " + toString(chain.size()) + " manifest(s) to '" + db_path + "'...");
+
+	// Write records in key order, so that the relative order of keys is preserved.  (ServerAllWorldsState::readFromDisk uses key order to resolve duplicate world settings)
+	{
+		Database database;
+		database.openAndMakeOrClearDatabase(db_path);
+
+		std::vector<uint8> data;
+		for(auto it = records.begin(); it != records.end(); ++it)
+		{
+			readChunk(it->second, data);
+			database.updateRecord(database.allocUnusedKey(), ArrayRef<uint8>(data.data(), data.size()));
+		}
+
+		database.flush();
+	}
+
+	if(!resources_dir.empty())
+	{
+		FileUtils::createDirIfDoesNotExist(resources_dir);
+
+		size_t num_restored = 0;
+		for(auto it = resources.begin(); it != resources.end(); ++it)
+		{
+			const BackupResource& resource = it->second;
+			if(resource.content_hash == 0)
+			{
+				conPrint("Resource '" + it->first + "' was not backed up, skipping.");
+				continue;
+			}
+			if(!FileUtils::isPathSafe(resource.local_filename))
+			{
+				conPrint("Resource '" + it->first + "' has unsafe filename '" + resource.local_filename + "', skipping.");
+				continue;
+			}
+
+			const std::string path = resources_dir + "/" + resource.local_filename;
+			if(!FileUtils::fileExists(path))
+				FileUtils::copyFile(chunkPath(resource.content_hash), path);
+			num_restored++;
+		}
+
+		conPrint("Restored " + toString(num_restored) + " resource(s) to '" + resources_dir + "'.");
+	}
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+static DatabaseChange makeRecordUpdatedChange(uint64 seq, uint64 key, const std::string& data)
+{
+	DatabaseChange change;
+	change.type = DatabaseChange::Type_RecordUpdated;
+	change.seq = seq;
+	change.key = key;
+	change.data.assign((const uint8*)data.data(), (const uint8*)data.data() + data.size());
+	return change;
+}
+
+
+void BackupStore::test()
+{
+	conPrint("BackupStore::test()");
+
+	try
+	{
+		//-------------------- Test batch serialisation --------------------
+		{
+			DatabaseChangeBatch batch;
+			batch.epoch = 0x1234567890ABCDEFull;
+			batch.last_seq = 10;
+			batch.is_full = true;
+			batch.more = true;
+			batch.changes.push_back(makeRecordUpdatedChange(8, 100, "hello"));
+
+			DatabaseChange deleted;
+			deleted.type = DatabaseChange::Type_RecordDeleted;
+			deleted.seq = 9;
+			deleted.key = 101;
+			batch.changes.push_back(deleted);
+
+			DatabaseChange resource;
+			resource.type = DatabaseChange::Type_ResourcePresent;
+			resource.seq = 10;
+			resource.URL = "a.jpg";
+			resource.local_filename = "a_123.jpg";
+			resource.file_size = 3;
+			resource.content_hash = 456;
+			batch.changes.push_back(resource);
+
+			BufferOutStream out;
+			writeToStream(batch, out);
+			BufferInStream in(ArrayRef<uint8>(out.buf.data(), out.buf.size()));
+			DatabaseChangeBatch batch2;
+			readFromStream(in, batch2);
+
+			testAssert(batch2.epoch == batch.epoch && batch2.last_seq == 10 && batch2.is_full && batch2.more);
+			testAssert(batch2.changes.size() == 3);
+			testAssert(batch2.changes[0].type == DatabaseChange::Type_RecordUpdated && batch2.changes[0].key == 100 && batch2.changes[0].data == batch.changes[0].data);
+			testAssert(batch2.changes[1].type == DatabaseChange::Type_RecordDeleted && batch2.changes[1].key == 101 && batch2.changes[1].seq == 9);
+			testAssert(batch2.changes[2].type == DatabaseChange::Type_ResourcePresent && batch2.changes[2].URL == "a.jpg" && batch2.changes[2].local_filename == "a_123.jpg" &&
+				batch2.changes[2].file_size == 3 && batch2.changes[2].content_hash == 456);
+
+			// Invalid change types should be rejected.
+			BufferOutStream bad;
+			bad.writeUInt64(1);
+			bad.writeUInt64(1);
+			bad.writeUInt32(0);
+			bad.writeUInt32(1);
+			bad.writeUInt32(10);
+			bad.writeUInt64(1);
+			BufferInStream bad_in(ArrayRef<uint8>(bad.buf.data(), bad.buf.size()));
+			try
+			{
+				readFromStream(bad_in, batch2);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+		}
+
+		const std::string dir = PlatformUtils::getTempDirPath() + "/backup_store_test";
+		if(FileUtils::fileExists(dir + "/latest_manifest.txt")) // Start with no manifests.  Chunks left from previous runs are fine.
+			FileUtils::deleteFile(dir + "/latest_manifest.txt");
+
+		//-------------------- Test chunks --------------------
+		{
+			BackupStore store(dir);
+			const std::string data = "some chunk data";
+			const uint64 hash = store.writeChunk((const uint8*)data.data(), data.size());
+			testAssert(hash == hashData((const uint8*)data.data(), data.size()));
+			testAssert(store.hasChunk(hash));
+			testAssert(store.writeChunk((const uint8*)data.data(), data.size()) == hash); // Writing again should be a no-op.
+
+			std::vector<uint8> data2;
+			store.readChunk(hash, data2);
+			testAssert(std::string(data2.begin(), data2.end()) == data);
+
+			// Corrupt the chunk, reading should fail.
+			FileUtils::writeEntireFile(store.chunkPath(hash), std::string("corrupted"));
+			try
+			{
+				store.readChunk(hash, data2);
+				failTest("Expected exception");
+			}
+			catch(glare::Exception&)
+			{}
+			FileUtils::deleteFile(store.chunkPath(hash));
+		}
+
+		//-------------------- Test manifest chains and restore --------------------
+		{
+			BackupStore store(dir);
+			testAssert(store.getLatestManifestName().empty());
+
+			const std::string a1 = "record a v1", a2 = "record a v2", b = "record b", c = "record c";
+
+			BackupManifest full;
+			full.is_full = true;
+			full.epoch = 1;
+			full.last_seq = 3;
+			full.applyChange(makeRecordUpdatedChange(1, 10, a1), store.writeChunk((const uint8*)a1.data(), a1.size()));
+			full.applyChange(makeRecordUpdatedChange(2, 20, b), store.writeChunk((const uint8*)b.data(), b.size()));
+			const std::string res_data = "resource data";
+			DatabaseChange res_change;
+			res_change.type = DatabaseChange::Type_ResourcePresent;
+			res_change.URL = "res.bin";
+			res_change.local_filename = "res_1.bin";
+			res_change.file_size = res_data.size();
+			res_change.content_hash = store.writeChunk((const uint8*)res_data.data(), res_data.size());
+			full.applyChange(res_change, 0);
+			const std::string full_name = store.writeManifest(full);
+			testAssert(store.getLatestManifestName() == full_name);
+
+			BackupManifest incr;
+			incr.parent_name = full_name;
+			incr.epoch = 1;
+			incr.last_seq = 6;
+			incr.applyChange(makeRecordUpdatedChange(4, 10, a2), store.writeChunk((const uint8*)a2.data(), a2.size()));
+			DatabaseChange del;
+			del.type = DatabaseChange::Type_RecordDeleted;
+			del.key = 20;
+			incr.applyChange(del, 0);
+			incr.applyChange(makeRecordUpdatedChange(6, 30, c), store.writeChunk((const uint8*)c.data(), c.size()));
+			const std::string incr_name = store.writeManifest(incr);
+			testAssert(incr_name != full_name);
+			testAssert(store.getLatestManifestName() == incr_name);
+
+			BackupManifest incr2;
+			store.readManifest(incr_name, incr2);
+			testAssert(incr2.parent_name == full_name && !incr2.is_full && incr2.last_seq == 6);
+			testAssert(incr2.records.size() == 2 && incr2.deleted_keys.count(20) == 1);
+
+			std::vector<BackupManifest> chain;
+			store.getManifestChain(incr_name, chain);
+			testAssert(chain.size() == 2 && chain[0].is_full);
+
+			std::map<uint64, uint64> records;
+			std::map<std::string, BackupResource> resources;
+			computeState(chain, records, resources);
+			testAssert(records.size() == 2);
+			testAssert(records[10] == hashData((const uint8*)a2.data(), a2.size()));
+			testAssert(records[30] == hashData((const uint8*)c.data(), c.size()));
+			testAssert(resources.size() == 1 && resources["res.bin"].local_filename == "res_1.bin");
+
+			// Restore as of the full manifest and as of the incremental one.
+			const std::string db_path = dir + "/restored.bin";
+			const std::string resources_dir = dir + "/restored_resources";
+			store.restore(incr_name, db_path, resources_dir);
+			testAssert(FileUtils::readEntireFile(resources_dir + "/res_1.bin") == res_data);
+
+			{
+				Database database;
+				database.startReadingFromDisk(db_path);
+				std::vector<std::string> restored;
+				for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end(); ++it)
+					if(it->second.isRecordValid())
+						restored.push_back(std::string((const char*)database.getInitialRecordData(it->second), it->second.len));
+				database.finishReadingFromDisk();
+				std::sort(restored.begin(), restored.end());
+				testAssert(restored == std::vector<std::string>({ a2, c }));
+			}
+
+			store.restore(full_name, db_path, /*resources_dir=*/"");
+			{
+				Database database;
+				database.startReadingFromDisk(db_path);
+				size_t num_valid = 0;
+				for(auto it = database.getRecordMap().begin(); it != database.getRecordMap().end(); ++it)
+					if(it->second.isRecordValid())
+						num_valid++;
+				database.finishReadingFromDisk();
+				testAssert(num_valid == 2);
+			}
+		}
+
+		//-------------------- Test retrying resources that couldn't be backed up --------------------
+		{
+			BackupManifest parent;
+			DatabaseChange res_change;
+			res_change.type = DatabaseChange::Type_ResourcePresent;
+			res_change.URL = "failed.bin";
+			res_change.local_filename = "failed_1.bin";
+			res_change.content_hash = 0; // Download failed.
+			parent.applyChange(res_change, 0);
+			res_change.URL = "ok.bin";
+			res_change.local_filename = "ok_1.bin";
+			res_change.content_hash = 123;
+			parent.applyChange(res_change, 0);
+			res_change.URL = "failed2.bin";
+			res_change.local_filename = "failed2_1.bin";
+			res_change.content_hash = 0;
+			parent.applyChange(res_change, 0);
+
+			// failed2.bin has been re-uploaded since, so the child already has a newer entry for it.
+			BackupManifest child;
+			res_change.local_filename = "failed2_2.bin";
+			res_change.content_hash = 456;
+			child.applyChange(res_change, 0);
+
+			testAssert(child.addResourcesToRetry(parent) == 1);
+			testAssert(child.resources.size() == 2);
+			testAssert(child.resources["failed.bin"].local_filename == "failed_1.bin" && child.resources["failed.bin"].content_hash == 0);
+			testAssert(child.resources["failed2.bin"].local_filename == "failed2_2.bin" && child.resources["failed2.bin"].content_hash == 456);
+			testAssert(child.resources.count("ok.bin") == 0);
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("BackupStore::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,140 @@
+/*=====================================================================
+BackupStore.h
+-------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <Platform.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+class InStream;
+class OutStream;
+
+
+/*=====================================================================
+DatabaseChange
+--------------
+A change to the server database or resources, as sent to the backup bot.
+See DatabaseChangeLog and Protocol::GetBackupChanges.
+=====================================================================*/
+struct DatabaseChange
+{
+	enum Type
+	{
+		Type_RecordUpdated = 0, // A database record was written.  key and data are set.
+		Type_RecordDeleted = 1, // A database record was deleted.  key is set.
+		Type_ResourcePresent = 2 // A resource file is present on the server.  URL, local_filename, file_size and content_hash are set.
+	};
+
+	DatabaseChange() : type(Type_RecordUpdated), seq(0), key(0), file_size(0), content_hash(0) {}
+
+	Type type;
+	uint64 seq; // Change sequence number.
+	uint64 key; // Database key value.
+	std::vector<uint8> data; // Record data.
+	std::string URL;
+	std::string local_filename; // Path of the resource file, relative to the resource dir.
+	uint64 file_size;
+	uint64 content_hash; // XXH64 with seed 1 of the resource file, or 0 if the server couldn't read the file.
+};
+
+
+struct DatabaseChangeBatch
+{
+	DatabaseChangeBatch() : epoch(0), last_seq(0), is_full(false), more(false) {}
+
+	uint64 epoch; // Identifies the server's sequence of changes.  Sequence numbers can only be compared within an epoch.
+	uint64 last_seq; // Pass as since_seq to get the next batch.
+	bool is_full; // True if the requested epoch didn't match, so the changes are relative to an empty database.
+	bool more; // Are there more changes after last_seq?
+	std::vector<DatabaseChange> changes; // In sequence order.
+};
+
+void writeToStream(const DatabaseChangeBatch& batch, OutStream& stream);
+void readFromStream(InStream& stream, DatabaseChangeBatch& batch); // Throws glare::Exception on invalid data.
+
+
+struct BackupResource
+{
+	BackupResource() : file_size(0), content_hash(0) {}
+
+	std::string local_filename;
+	uint64 file_size;
+	uint64 content_hash; // Chunk hash of the file.  0 if the file couldn't be backed up.
+};
+
+
+/*=====================================================================
+BackupManifest
+--------------
+The changes in one backup snapshot.
+A full manifest has the complete state, an incremental manifest just has the changes since its parent.
+=====================================================================*/
+struct BackupManifest
+{
+	BackupManifest() : epoch(0), last_seq(0), is_full(false), time(0) {}
+
+	std::string parent_name; // Name of the previous manifest in the chain.  Empty for full manifests.
+	uint64 epoch; // Server change epoch and sequence number this snapshot is up to date with.
+	uint64 last_seq;
+	bool is_full;
+	uint64 time; // Time the snapshot was made, seconds since 1970.
+
+	std::map<uint64, uint64> records; // Database key value to chunk hash, for records written since the parent.
+	std::set<uint64> deleted_keys; // Keys of records deleted since the parent.
+	std::map<std::string, BackupResource> resources; // Resource URL to resource, for resources added since the parent.
+
+	void applyChange(const DatabaseChange& change, uint64 record_chunk_hash);
+
+	// Copies resources that couldn't be backed up (content_hash 0) from the parent manifest, unless this manifest already has them,
+	// so that they are downloaded again for this snapshot.  Returns the number of resources copied.
+	size_t addResourcesToRetry(const BackupManifest& parent);
+};
+
+
+/*=====================================================================
+BackupStore
+-----------
+Directory of content-addressed chunks and manifests, written by the backup bot.
+Chunks are stored under chunks/, named by the XXH64 hash (seed 1) of their contents, so each distinct record
+version or resource file is only stored once, however many snapshots refer to it.
+Manifests are stored under manifests/, and latest_manifest.txt has the name of the most recent one.
+=====================================================================*/
+class BackupStore
+{
+public:
+	BackupStore(const std::string& backup_dir); // Creates the directories if they don't exist.
+
+	static uint64 hashData(const uint8* data, size_t len);
+
+	std::string chunkPath(uint64 hash) const;
+	bool hasChunk(uint64 hash) const;
+	uint64 writeChunk(const uint8* data, size_t len); // Returns the hash of the data.  Doesn't write anything if the chunk is already present.
+	void readChunk(uint64 hash, std::vector<uint8>& data_out) const; // Throws glare::Exception if missing, or if the data doesn't match the hash.
+
+	// Manifests are written to a temp file then moved into place, and latest_manifest.txt is only updated after that,
+	// so an interrupted backup leaves the previous manifest as the latest.
+	std::string writeManifest(const BackupManifest& manifest); // Returns name of the new manifest, and makes it the latest.
+	void readManifest(const std::string& name, BackupManifest& manifest_out) const;
+	std::string getLatestManifestName() const; // Returns empty string if there are no manifests.
+
+	// Returns the chain of manifests from the last full manifest up to and including the named one, oldest first.
+	void getManifestChain(const std::string& name, std::vector<BackupManifest>& chain_out) const;
+
+	// Combines a manifest chain to get the state at the end of it.
+	static void computeState(const std::vector<BackupManifest>& chain, std::map<uint64, uint64>& records_out, std::map<std::string, BackupResource>& resources_out);
+
+	// Rebuilds a database at db_path from the chain ending at the named manifest.
+	// Records are written in database key order, with new keys allocated by the database.
+	// If resources_dir is non-empty, resource files are written to it as well.
+	void restore(const std::string& manifest_name, const std::string& db_path, const std::string& resources_dir) const;
+
+	static void test();
+
+private:
+	std::string backup_dir;
+};
@@ -33,13 +33,19 @@ CyberspaceProtocolVersion
 	Added scale to ObjectTransformUpdate message.
 38: Use length-prefixed serialisation for WorldMaterial, sending server version to client.
 39: Added QueryMapTiles, MapTilesResult
+40: Added ConnectionTypeUploadResourceChunked
+41: Added GetFilesCompressed
+42: Added pipelined resource downloads: RequestFile, CancelFileRequest, SetFileRequestPriority
+43: Added QueryMapTilesInRect
+44: Added ConnectionTypeBackupBot
+45: Added RequestCellLowLODModels
 */
 namespace Protocol
 {
 
 const uint32 CyberspaceHello = 1357924680;
 
-const uint32 CyberspaceProtocolVersion = 39;
+const uint32 CyberspaceProtocolVersion = 45;
 
 const uint32 ClientProtocolOK		= 10000;
 const uint32 ClientProtocolTooOld	= 10001;
@@ -56,6 +62,8 @@ const uint32 ConnectionTypeDownloadResources	= 502;
 //const uint32 ConnectionTypeWebsite				= 503; // A connection from the webserver.
 const uint32 ConnectionTypeScreenshotBot		= 504; // A connection from the screenshot bot.
 const uint32 ConnectionTypeEthBot				= 505; // A connection from the Ethereum bot.
+const uint32 ConnectionTypeUploadResourceChunked	= 506; // Resumable resource upload, see below.  Clients should only use this if the server protocol version is >= 40.
+const uint32 ConnectionTypeBackupBot			= 507; // A connection from the backup bot, see below.  Only use if the server protocol version is >= 44.
 
 
 const uint32 AvatarCreated			= 1000;
@@ -106,11 +114,48 @@ const uint32 WorldSettingsUpdate	= 3701;
 
 const uint32 QueryMapTiles			= 3800; // Client wants to query map tile image URLs
 const uint32 MapTilesResult			= 3801; // Server is sending back a list of tile image URLs to the client.
+const uint32 QueryMapTilesInRect	= 3802; // Client wants map tile image URLs for a rectangle of tiles, and the tiles covering it at all lower zoom levels.  Only send if server protocol version >= 43.
+// QueryMapTilesInRect: tile z (int32), tile x begin, y begin, x end, y end (int32, ends exclusive), tile image width the client will draw tiles at (uint32).
+// The server replies with MapTilesResult, giving the URL of the smallest tile image variant that is at least that wide.
 
 
 //TEMP HACK move elsewhere
 const uint32 GetFile				= 4000;
 const uint32 GetFiles				= 4001; // Client wants to download multiple resources from the server.
+const uint32 GetFilesCompressed		= 4002; // Same as GetFiles, but the server may send zstd-compressed resources.  Only send if server protocol version >= 41.
+const uint32 RequestFile			= 4003; // Pipelined download request.  Only send if server protocol version >= 42.
+const uint32 CancelFileRequest		= 4004;
+const uint32 SetFileRequestPriority	= 4005;
+const uint32 RequestCellLowLODModels	= 4006; // Pipelined request for the coarsest LOD models of the objects in a cell, sent as a single reply.  Only send if server protocol version >= 45.
+
+// Per-resource results in replies to GetFiles and GetFilesCompressed
+const uint32 GetFileResultOK			= 0; // Followed by file length (uint64) and file data.
+const uint32 GetFileResultNotFound		= 1;
+const uint32 GetFileResultOKZstd		= 2; // Followed by uncompressed length (uint64), compressed length (uint64) and zstd-compressed data.  Only sent for GetFilesCompressed and RequestFile.
+const uint32 GetFileResultCancelled		= 3; // Only sent for RequestFile and RequestCellLowLODModels.
+const uint32 GetFileResultBundle		= 4; // Only sent for RequestCellLowLODModels, see below.
+
+/*
+Pipelined downloads on a ConnectionTypeDownloadResources connection:
+Client sends RequestFile messages at any time: request id (uint32), priority (float), URL (string).
+	Request ids are chosen by the client and must be unique among its outstanding requests.  Lower priority values are more important.
+Client may send CancelFileRequest: request id (uint32), and SetFileRequestPriority: request id (uint32), priority (float).
+Server sends one reply for each request: request id (uint32), then a result code and data as for GetFilesCompressed.
+	Replies are sent in priority order of the requests the server has received so far, not in request order.
+	Cancelled requests get a GetFileResultCancelled reply, unless the file has already been sent.
+A client may have at most MAX_OUTSTANDING_FILE_REQUESTS requests that haven't been replied to, and URLs may be at most MAX_RESOURCE_URL_LEN bytes.
+	The server closes the connection if either limit is exceeded.
+
+Client may also send RequestCellLowLODModels: request id (uint32), priority (float), world name (string), cell coords (3 x int32).
+	Cells are the same CELL_WIDTH grid cells as used by QueryObjects.  This request counts towards MAX_OUTSTANDING_FILE_REQUESTS.
+	The server replies with the request id, then GetFileResultBundle (or GetFileResultCancelled), number of files (uint32), then for each file:
+	URL (string), then a result code and data as for GetFilesCompressed.
+	The files are the coarsest LOD models of the static objects in the cell, so a client can show something for all of them with one download.
+	At most MAX_CELL_BUNDLE_FILES files are sent.
+*/
+const uint32 MAX_OUTSTANDING_FILE_REQUESTS	= 64; // Should be >= DownloadResourcesThread::MAX_NUM_OUTSTANDING_REQUESTS.
+const uint32 MAX_RESOURCE_URL_LEN			= 1024;
+const uint32 MAX_CELL_BUNDLE_FILES			= 256;
 
 const uint32 NewResourceOnServer	= 4100; // A file has been uploaded to the server
 
@@ -121,6 +166,29 @@ const uint32 InvalidFileSize		= 5102;
 const uint32 NoWritePermissions		= 5103;
 const uint32 ServerIsInReadOnlyMode	= 5104;
 const uint32 InvalidFileType		= 5105;
+const uint32 TooManyUploads			= 5106; // Client has been rate limited.
+const uint32 ResourceAlreadyPresent	= 5107; // Server already has the resource with the same content, no need to upload it.
+const uint32 UploadHashMismatch		= 5108; // The uploaded data didn't match the announced content hash.  The partial upload has been discarded.
+const uint32 UploadChunksReceived	= 5109; // All chunks sent on this connection have been received, but the upload isn't complete yet (other connections still uploading chunks).
+const uint32 UploadComplete			= 5110; // All chunks have been received and verified, and the resource has been added.
+const uint32 UploadFailed			= 5111;
+
+/*
+Chunked upload protocol (ConnectionTypeUploadResourceChunked):
+After login, client sends:
+	URL (string)
+	file length (uint64)
+	content hash (uint64): XXH64 with seed 1 of the whole file
+	chunk size (uint32): between 64 KB and 16 MB.
+Server replies with ResourceAlreadyPresent, or UploadAllowed followed by the number of chunks it doesn't have yet (uint32) and their indices (uint32 each),
+or another code followed by an error message string.
+Client then sends chunks as chunk index (uint32) followed by the chunk data, then EndOfChunks.
+Server replies with UploadChunksReceived, UploadComplete or UploadHashMismatch.
+
+Chunks the server has received are kept if the connection drops, so the client can resume the upload by connecting again.
+The client may upload different chunks of the same file over multiple connections at once.
+*/
+const uint32 EndOfChunks			= 0xFFFFFFFF;
 
 
 //TEMP HACK move elsewhere
@@ -152,6 +220,21 @@ const uint32 SubmitEthTransactionRequest		= 12001;
 const uint32 EthTransactionSubmitted			= 12002;
 const uint32 EthTransactionSubmissionFailed		= 12003;
 
+
+const uint32 GetBackupChanges		= 14001; // Backup bot wants the database records and resources changed since its last snapshot.
+const uint32 BackupChanges			= 14002; // Server is sending back a batch of changes.
+
+/*
+Backup protocol (ConnectionTypeBackupBot):
+Bot sends the backup bot password (string).
+Bot then sends GetBackupChanges messages: epoch (uint64), since_seq (uint64), max bytes of record data to send (uint64).
+	Use epoch 0 and since_seq 0 for the first request.
+Server replies with BackupChanges followed by a DatabaseChangeBatch, see writeToStream(const DatabaseChangeBatch&) in shared/BackupStore.cpp.
+	If the epoch doesn't match the server's current epoch (e.g. the server has restarted), the batch has all records and resources, and the is_full flag set.
+	The bot should keep requesting changes since the returned last_seq while the more flag is set.
+Resource files are then downloaded with GetFiles on a ConnectionTypeDownloadResources connection.
+*/
+
 const uint32 KeepAlive				= 13000; // A message that doesn't do anything apart from provide a means for the client or server to check a connection is still working by making a socket call.
 
 } // end namespace Protocol
@@ -16,11 +16,14 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <Timer.h>
 #include <FileInStream.h>
 #include <FileOutStream.h>
+#include <BufferInStream.h>
+#include <BufferOutStream.h>
 #include <IncludeXXHash.h>
+#include <maths/mathstypes.h>
 
 
 ResourceManager::ResourceManager(const std::string& base_resource_dir_)
-:	base_resource_dir(base_resource_dir_), changed(0), total_present_resources_size_B(0)
+:	base_resource_dir(base_resource_dir_), changed(0), full_save_needed(true), snapshot_id(0), journal_num_records(0), total_present_resources_size_B(0)
 {
 }
 
@@ -136,7 +139,7 @@ ResourceRef ResourceManager::getOrCreateResourceForURL(const std::string& URL) /
 			UserID::invalidUserID()
 		);
 		resource_for_url[URL] = resource;
-		this->changed = 1;
+		addChangedResource(resource);
 		return resource;
 	}
 	else
@@ -179,7 +182,7 @@ void ResourceManager::copyLocalFileToResourceDir(const std::string& local_path,
 		res->setState(Resource::State_Present);
 
 		if(!already_exists || (prev_state != Resource::State_Present))
-			this->changed = 1;
+			addChangedResource(res);
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -208,7 +211,7 @@ std::string ResourceManager::copyLocalFileToResourceDirIfNotPresent(const std::s
 		res->setState(Resource::State_Present);
 
 		if(!already_exists || (prev_state != Resource::State_Present))
-			this->changed = 1;
+			markAsChanged(res);
 
 		return URL;
 	}
@@ -229,7 +232,7 @@ void ResourceManager::setResourceAsLocallyPresentForURL(const std::string& URL)
 		ResourceRef res = getOrCreateResourceForURL(URL);
 		res->setState(Resource::State_Present);
 
-		this->changed = 1;
+		addChangedResource(res);
 	}
 	catch(FileUtils::FileUtilsExcep& e)
 	{
@@ -278,7 +281,7 @@ void ResourceManager::deleteResourceLocally(const ResourceRef& resource)
 		assert(this->total_present_resources_size_B >= (int64)resource->file_size_B);
 		this->total_present_resources_size_B -= (int64)resource->file_size_B;
 
-		this->changed = 1;
+		addChangedResource(resource);
 	}
 }
 
@@ -289,12 +292,33 @@ void ResourceManager::addResource(ResourceRef& res)
 
 	resource_for_url[res->URL] = res;
 
-	this->changed = 1;
+	addChangedResource(res);
 }
 
 
 void ResourceManager::markAsChanged() // Thread-safe
 {
+	Lock lock(mutex);
+
+	this->full_save_needed = true;
+	this->changed = 1;
+}
+
+
+void ResourceManager::markAsChanged(const ResourceRef& resource) // Thread-safe
+{
+	Lock lock(mutex);
+
+	addChangedResource(resource);
+}
+
+
+void ResourceManager::addChangedResource(const ResourceRef& resource)
+{
+	// If a new snapshot is going to be written, it will include this resource, so we don't need to keep track of it.
+	// This also means changed_resources doesn't grow on the server, where the resources database is not saved like this.
+	if(!full_save_needed)
+		changed_resources[resource->URL] = resource;
 	this->changed = 1;
 }
 
@@ -362,14 +386,141 @@ std::string ResourceManager::getDiagnostics() const
 
 
 static const uint32 RESOURCE_MANAGER_MAGIC_NUMBER = 587732371;
-static const uint32 RESOURCE_MANAGER_SERIALISATION_VERSION = 2;
+static const uint32 RESOURCE_MANAGER_SERIALISATION_VERSION = 3;
 static const uint32 RESOURCE_CHUNK = 103;
 static const uint32 EOS_CHUNK = 1000;
 /*
 Version history:
 2: Serialising resource state
+3: Serialising snapshot id, which is matched against the journal
 */
 
+static const uint32 RESOURCE_JOURNAL_MAGIC_NUMBER = 587732372;
+static const uint32 RESOURCE_JOURNAL_SERIALISATION_VERSION = 1;
+static const size_t JOURNAL_HEADER_SIZE = 16; // magic number, version, snapshot id
+static const size_t JOURNAL_RECORD_HEADER_SIZE = 12; // record length, record hash
+static const uint32 MAX_JOURNAL_RECORD_LEN = 1 << 20;
+
+// A new snapshot is written when the journal would have more records than this, or more records than there are resources, whichever is greater.
+static const size_t MIN_JOURNAL_RECORDS_BEFORE_COMPACTION = 1024;
+
+
+static uint64 hashJournalRecord(const uint8* data, size_t len)
+{
+	return XXH64(data, len, /*seed=*/1);
+}
+
+
+// Appends a journal record for the resource to out.  temp is used as scratch space.
+static void writeJournalRecord(BufferOutStream& out, BufferOutStream& temp, Resource& resource)
+{
+	temp.buf.resize(0);
+	resource.writeToStream(temp);
+
+	out.writeUInt32((uint32)temp.buf.size());
+	out.writeUInt64(hashJournalRecord(temp.buf.data(), temp.buf.size()));
+	out.writeData(temp.buf.data(), temp.buf.size());
+}
+
+
+void ResourceManager::processLoadedResource(ResourceRef& resource, bool check_resources_present_on_disk)
+{
+	resource_for_url[resource->URL] = resource;
+
+	//TEMP:
+	//if(resource->getLocalPath().size() >= 260)
+	//	resource->setLocalPath(this->computeLocalPathFromURLHash(resource->URL, ::getExtension(resource->getLocalPath())));
+
+	const Resource::State prev_resource_state = resource->getState();
+
+	if(check_resources_present_on_disk)
+	{
+		if(FileUtils::fileExists(resource->getLocalAbsPath(this->base_resource_dir)))
+			resource->setState(Resource::State_Present);
+		else
+			resource->setState(Resource::State_NotPresent);
+	}
+	else
+	{
+		if(resource->getState() == Resource::State_Transferring)
+		{
+			// Any resources that were transferring when the resources database was last saved, may not have been completely downloaded.
+			// Mark them as NotPresent so they will be re-downloaded.
+			resource->setState(Resource::State_NotPresent);
+		}
+	}
+
+	if(resource->getState() != prev_resource_state) // Mark resource as changed if we changed its state, so the change gets saved to disk.
+		addChangedResource(resource);
+}
+
+
+// Replays the records in the journal over the resources loaded from the snapshot.
+// Returns false if the journal is not for the loaded snapshot, or if it is damaged, e.g. if the last record was only partially written due to a crash.
+// Records before any damage are still replayed.  In either case a new snapshot should be written.
+bool ResourceManager::loadJournal(const std::string& journal_path, bool check_resources_present_on_disk, size_t& num_records_out)
+{
+	num_records_out = 0;
+
+	std::string data;
+	try
+	{
+		FileUtils::readEntireFile(journal_path, data);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	const uint8* const journal_data = (const uint8*)data.data();
+	if(data.size() < JOURNAL_HEADER_SIZE)
+		return false;
+
+	BufferInStream header_stream(ArrayRef<uint8>(journal_data, JOURNAL_HEADER_SIZE));
+	if(header_stream.readUInt32() != RESOURCE_JOURNAL_MAGIC_NUMBER)
+		return false;
+	if(header_stream.readUInt32() > RESOURCE_JOURNAL_SERIALISATION_VERSION)
+		return false;
+	if(header_stream.readUInt64() != this->snapshot_id) // If the journal was written for an older snapshot, its changes are already in the loaded snapshot.
+		return false;
+
+	size_t offset = JOURNAL_HEADER_SIZE;
+	while(offset < data.size())
+	{
+		if(data.size() - offset < JOURNAL_RECORD_HEADER_SIZE)
+			return false;
+
+		BufferInStream record_header_stream(ArrayRef<uint8>(journal_data + offset, JOURNAL_RECORD_HEADER_SIZE));
+		const uint32 record_len = record_header_stream.readUInt32();
+		const uint64 record_hash = record_header_stream.readUInt64();
+		offset += JOURNAL_RECORD_HEADER_SIZE;
+
+		if(record_len > MAX_JOURNAL_RECORD_LEN || (data.size() - offset < record_len))
+			return false;
+		if(hashJournalRecord(journal_data + offset, record_len) != record_hash)
+			return false;
+
+		try
+		{
+			BufferInStream record_stream(ArrayRef<uint8>(journal_data + offset, record_len));
+			ResourceRef resource = new Resource();
+			readFromStream(record_stream, *resource);
+			processLoadedResource(resource, check_resources_present_on_disk);
+		}
+		catch(glare::Exception& e)
+		{
+			conPrint("WARNING: failed to read resources journal record: " + e.what());
+			return false;
+		}
+
+		offset += record_len;
+		num_records_out++;
+	}
+
+	return true;
+}
+
+
 void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk)
 {
 	conPrint("Reading resource info from '" + path + "'...");
@@ -393,7 +544,11 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 	// From version 2, we save the resource state with the resources, so we don't have to recompute it when loading the resources.
 	const bool check_resources_present_on_disk = (version == 1) || force_check_if_resources_exist_on_disk;
 
-	size_t num_resources_present = 0;
+	// From version 3, the snapshot has an id, which is also written at the start of the journal.
+	const uint64 loaded_snapshot_id = (version >= 3) ? stream.readUInt64() : 0;
+
+	this->full_save_needed = false; // So that resources with states changed while loading are tracked in changed_resources.
+
 	while(1)
 	{
 		const uint32 chunk = stream.readUInt32();
@@ -405,42 +560,7 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 
 			// conPrint("Loaded resource:\n  URL: '" + resource->URL + "'\n  local_path: '" + resource->getLocalPath() + "'\n  owner_id: " + resource->owner_id.toString());
 
-			resource_for_url[resource->URL] = resource;
-
-			//TEMP:
-			//if(resource->getLocalPath().size() >= 260)
-			//	resource->setLocalPath(this->computeLocalPathFromURLHash(resource->URL, ::getExtension(resource->getLocalPath())));
-
-			const Resource::State prev_resource_state = resource->getState();
-
-			if(check_resources_present_on_disk)
-			{
-				if(FileUtils::fileExists(resource->getLocalAbsPath(this->base_resource_dir)))
-				{
-					resource->setState(Resource::State_Present);
-					num_resources_present++;
-				}
-				else
-				{
-					resource->setState(Resource::State_NotPresent);
-				}
-			}
-			else
-			{
-				if(resource->getState() == Resource::State_Present)
-				{
-					num_resources_present++;
-				}
-				else if(resource->getState() == Resource::State_Transferring)
-				{
-					// Any resources that were transferring when the resources database was last saved, may not have been completely downloaded.
-					// Mark them as NotPresent so they will be re-downloaded.
-					resource->setState(Resource::State_NotPresent);
-				}
-			}
-
-			if(resource->getState() != prev_resource_state) // Set changed flag for DB if we changed a resource state, so the DB gets saved to disk.
-				this->changed = 1;
+			processLoadedResource(resource, check_resources_present_on_disk);
 		}
 		else if(chunk == EOS_CHUNK)
 		{
@@ -452,8 +572,58 @@ void ResourceManager::loadFromDisk(const std::string& path, bool force_check_if_
 		}
 	}
 
+	this->snapshot_id = loaded_snapshot_id;
+	this->journal_num_records = 0;
+
+	// Replay any changes made after the snapshot was written.  Snapshots from before version 3 don't have a journal.
+	const std::string journal_path = path + "_journal";
+	bool journal_valid = false;
+	if(version >= 3 && FileUtils::fileExists(journal_path))
+	{
+		journal_valid = loadJournal(journal_path, check_resources_present_on_disk, this->journal_num_records);
+		if(!journal_valid)
+			conPrint("WARNING: resources journal was stale or damaged, will write a new resources snapshot.");
+	}
+
+	// If there is no valid journal to append to, write a new snapshot (and journal) on the next save.
+	this->full_save_needed = !journal_valid;
+	if(full_save_needed)
+		this->changed = 1;
+
+	size_t num_resources_present = 0;
+	for(auto it = resource_for_url.begin(); it != resource_for_url.end(); ++it)
+		if(it->second->getState() == Resource::State_Present)
+			num_resources_present++;
+
 	conPrint("Loaded info on " + toString(resource_for_url.size()) + " resource(s). (check_resources_present_on_disk: " + boolToString(check_resources_present_on_disk) + ", " + 
-		toString(num_resources_present) + " present on disk, changed: " + boolToString(changed) + ")  Elapsed: " + timer.elapsedStringNSigFigs(3) + "");
+		toString(num_resources_present) + " present on disk, " + toString(journal_num_records) + " journal record(s), changed: " + boolToString(changed) + ")  Elapsed: " + timer.elapsedStringNSigFigs(3) + "");
+}
+
+
+// Writes the snapshot to path, then starts a new journal for it.
+// The snapshot is written to a temp file and moved into place, so a crash can't leave a partially written snapshot.
+// If we crash after writing the snapshot but before starting the new journal, the old journal will have the old snapshot id, so will be ignored when loading.
+void ResourceManager::writeSnapshot(const std::string& path, const BufferOutStream& snapshot_data, uint64 new_snapshot_id)
+{
+	try
+	{
+		const std::string temp_path = path + "_temp";
+		FileUtils::writeEntireFile(temp_path, (const char*)snapshot_data.buf.data(), snapshot_data.buf.size());
+		FileUtils::moveFile(temp_path, path);
+
+		BufferOutStream journal_header;
+		journal_header.writeUInt32(RESOURCE_JOURNAL_MAGIC_NUMBER);
+		journal_header.writeUInt32(RESOURCE_JOURNAL_SERIALISATION_VERSION);
+		journal_header.writeUInt64(new_snapshot_id);
+
+		const std::string journal_temp_path = path + "_journal_temp";
+		FileUtils::writeEntireFile(journal_temp_path, (const char*)journal_header.buf.data(), journal_header.buf.size());
+		FileUtils::moveFile(journal_temp_path, path + "_journal");
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
 }
 
 
@@ -462,40 +632,102 @@ void ResourceManager::saveToDisk(const std::string& path)
 	conPrint("Saving resources to disk...");
 	Timer timer;
 
-	Lock lock(mutex);
+	// Serialise the resources while holding the mutex, then write them to disk after releasing it, so other threads don't have to wait for the disk writes.
+	BufferOutStream snapshot_data;
+	uint64 new_snapshot_id;
+	size_t num_resources;
+	{
+		Lock lock(mutex);
+
+		new_snapshot_id = this->snapshot_id + 1;
+		num_resources = resource_for_url.size();
+
+		// Write magic number
+		snapshot_data.writeUInt32(RESOURCE_MANAGER_MAGIC_NUMBER);
+
+		// Write version
+		snapshot_data.writeUInt32(RESOURCE_MANAGER_SERIALISATION_VERSION);
+
+		snapshot_data.writeUInt64(new_snapshot_id);
+
+		// Write resource objects
+		for(auto i=resource_for_url.begin(); i != resource_for_url.end(); ++i)
+		{
+			snapshot_data.writeUInt32(RESOURCE_CHUNK);
+			i->second->writeToStream(snapshot_data);
+		}
+
+		snapshot_data.writeUInt32(EOS_CHUNK); // Write end-of-stream chunk
+
+		// Any resources changed from now on will be appended to the new journal.
+		this->snapshot_id = new_snapshot_id;
+		this->journal_num_records = 0;
+		this->full_save_needed = false;
+		this->changed_resources.clear();
+		this->changed = 0;
+	}
 
 	try
 	{
-		const std::string temp_path = path + "_temp";
+		writeSnapshot(path, snapshot_data, new_snapshot_id);
+	}
+	catch(glare::Exception&)
+	{
+		// The journal on disk may not match snapshot_id now, so we need to try writing a new snapshot again.
+		Lock lock(mutex);
+		this->full_save_needed = true;
+		this->changed = 1;
+		throw;
+	}
 
-		{
-			FileOutStream stream(temp_path);
+	conPrint("\tDone saving " + toString(num_resources) + " resource(s) to disk.  (Elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+}
 
-			// Write magic number
-			stream.writeUInt32(RESOURCE_MANAGER_MAGIC_NUMBER);
 
-			// Write version
-			stream.writeUInt32(RESOURCE_MANAGER_SERIALISATION_VERSION);
+void ResourceManager::saveChangesToDisk(const std::string& path)
+{
+	BufferOutStream journal_records;
+	bool write_snapshot;
+	{
+		Lock lock(mutex);
 
-			// Write resource objects
-			{
-				for(auto i=resource_for_url.begin(); i != resource_for_url.end(); ++i)
-				{
-					stream.writeUInt32(RESOURCE_CHUNK);
-					i->second->writeToStream(stream);
-				}
-			}
+		if(changed == 0)
+			return;
 
-			stream.writeUInt32(EOS_CHUNK); // Write end-of-stream chunk
+		const size_t max_journal_records = myMax(MIN_JOURNAL_RECORDS_BEFORE_COMPACTION, resource_for_url.size());
+		write_snapshot = full_save_needed || (journal_num_records + changed_resources.size() > max_journal_records);
+		if(!write_snapshot)
+		{
+			// Just copy the changed resources while holding the mutex.
+			BufferOutStream temp;
+			for(auto it = changed_resources.begin(); it != changed_resources.end(); ++it)
+				writeJournalRecord(journal_records, temp, *it->second);
+
+			this->journal_num_records += changed_resources.size();
+			this->changed_resources.clear();
+			this->changed = 0;
 		}
+	}
 
-		FileUtils::moveFile(temp_path, path);
+	if(write_snapshot)
+	{
+		saveToDisk(path); // Compact the journal into a new snapshot.
+		return;
+	}
 
-		conPrint("\tDone saving resources to disk.  (Elapsed: " + timer.elapsedStringNSigFigs(3) + ")");
+	try
+	{
+		FileOutStream file(path + "_journal", std::ios::binary | std::ios::app);
+		file.writeData(journal_records.buf.data(), journal_records.buf.size());
+		file.close(); // Manually call close, to check for any errors via failbit.
 	}
-	catch(FileUtils::FileUtilsExcep& e)
+	catch(glare::Exception&)
 	{
-		throw glare::Exception(e.what());
+		// The journal may have a partially written record at the end now, and we have lost track of what changed, so write a new snapshot next time.
+		Lock lock(mutex);
+		this->full_save_needed = true;
+		this->changed = 1;
+		throw;
 	}
 }
 
@@ -512,3 +744,163 @@ int64 ResourceManager::getTotalPresentResourcesSizeB() const
 	Lock lock(mutex);
 	return total_present_resources_size_B;
 }
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+#include <utils/PlatformUtils.h>
+
+
+void ResourceManager::test()
+{
+	conPrint("ResourceManager::test()");
+
+	const std::string dir = PlatformUtils::getTempDirPath() + "/resource_manager_test";
+	FileUtils::createDirIfDoesNotExist(dir);
+	const std::string db_path = dir + "/resources_db";
+	const std::string journal_path = db_path + "_journal";
+	if(FileUtils::fileExists(db_path))
+		FileUtils::deleteFile(db_path);
+	if(FileUtils::fileExists(journal_path))
+		FileUtils::deleteFile(journal_path);
+
+	std::string journal_with_b_present;
+
+	//-------------------- Test that changes are appended to the journal --------------------
+	{
+		ResourceManager manager(dir);
+		ResourceRef a = manager.getOrCreateResourceForURL("a.png");
+		ResourceRef b = manager.getOrCreateResourceForURL("b.png");
+		testAssert(a->getState() == Resource::State_NotPresent);
+
+		// There is no snapshot yet, so the first save should write one, with an empty journal.
+		manager.saveChangesToDisk(db_path);
+		testAssert(!manager.hasChanged());
+		testAssert(FileUtils::getFileSize(journal_path) == JOURNAL_HEADER_SIZE);
+
+		std::string snapshot_data;
+		FileUtils::readEntireFile(db_path, snapshot_data);
+
+		a->setState(Resource::State_Present);
+		manager.markAsChanged(a);
+		manager.saveChangesToDisk(db_path);
+		testAssert(!manager.hasChanged());
+		testAssert(manager.journal_num_records == 1);
+		testAssert(FileUtils::getFileSize(journal_path) > JOURNAL_HEADER_SIZE);
+
+		// The snapshot shouldn't have been rewritten.
+		std::string snapshot_data2;
+		FileUtils::readEntireFile(db_path, snapshot_data2);
+		testAssert(snapshot_data2 == snapshot_data);
+
+		// Saving with no changes shouldn't write anything.
+		const uint64 journal_size = FileUtils::getFileSize(journal_path);
+		manager.saveChangesToDisk(db_path);
+		testAssert(FileUtils::getFileSize(journal_path) == journal_size);
+
+		// Resources that were transferring should be loaded as not present.
+		b->setState(Resource::State_Transferring);
+		manager.markAsChanged(b);
+		manager.saveChangesToDisk(db_path);
+		testAssert(manager.journal_num_records == 2);
+	}
+
+	//-------------------- Test loading the snapshot and replaying the journal --------------------
+	{
+		ResourceManager manager(dir);
+		manager.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		testAssert(manager.getResourcesForURL().size() == 2);
+		testAssert(manager.getExistingResourceForURL("a.png")->getState() == Resource::State_Present);
+		testAssert(manager.getExistingResourceForURL("b.png")->getState() == Resource::State_NotPresent);
+		testAssert(manager.journal_num_records == 2);
+		testAssert(!manager.full_save_needed);
+
+		// Save the journal with b present, for the stale journal test below.
+		ResourceRef b = manager.getExistingResourceForURL("b.png");
+		b->setState(Resource::State_Present);
+		manager.markAsChanged(b);
+		manager.saveChangesToDisk(db_path);
+		FileUtils::readEntireFile(journal_path, journal_with_b_present);
+	}
+
+	//-------------------- Test loading a journal with a partially written record at the end --------------------
+	{
+		std::string journal_data;
+		FileUtils::readEntireFile(journal_path, journal_data);
+		BufferOutStream partial_record;
+		partial_record.writeUInt32(100);
+		partial_record.writeUInt64(0);
+		partial_record.writeUInt32(0);
+		journal_data.append((const char*)partial_record.buf.data(), partial_record.buf.size());
+		FileUtils::writeEntireFile(journal_path, journal_data);
+
+		ResourceManager manager(dir);
+		manager.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		testAssert(manager.getExistingResourceForURL("b.png")->getState() == Resource::State_Present); // Records before the partial record should have been replayed.
+		testAssert(manager.full_save_needed);
+		testAssert(manager.hasChanged());
+
+		// Saving should write a new snapshot, and start a new journal without the partial record.
+		manager.saveChangesToDisk(db_path);
+		testAssert(FileUtils::getFileSize(journal_path) == JOURNAL_HEADER_SIZE);
+
+		ResourceManager manager2(dir);
+		manager2.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		testAssert(manager2.getResourcesForURL().size() == 2);
+		testAssert(manager2.getExistingResourceForURL("a.png")->getState() == Resource::State_Present);
+		testAssert(manager2.getExistingResourceForURL("b.png")->getState() == Resource::State_Present);
+		testAssert(!manager2.full_save_needed);
+
+		// Now set b as not present, and write a new snapshot.
+		ResourceRef b = manager2.getExistingResourceForURL("b.png");
+		b->setState(Resource::State_NotPresent);
+		manager2.markAsChanged(b);
+		manager2.saveToDisk(db_path);
+	}
+
+	//-------------------- Test that a journal for an older snapshot is ignored --------------------
+	{
+		// Simulate a crash after writing the new snapshot, but before starting the new journal.
+		FileUtils::writeEntireFile(journal_path, journal_with_b_present);
+
+		ResourceManager manager(dir);
+		manager.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		testAssert(manager.getExistingResourceForURL("b.png")->getState() == Resource::State_NotPresent);
+		testAssert(manager.full_save_needed);
+	}
+
+	//-------------------- Test compaction of the journal --------------------
+	{
+		ResourceManager manager(dir);
+		manager.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		manager.saveChangesToDisk(db_path);
+
+		std::vector<ResourceRef> resources;
+		for(int i=0; i<10; ++i)
+			resources.push_back(manager.getOrCreateResourceForURL("res_" + toString(i) + ".png"));
+
+		for(int z=0; z<300; ++z)
+		{
+			for(size_t i=0; i<resources.size(); ++i)
+			{
+				resources[i]->setState(((z + i) % 2 == 0) ? Resource::State_Present : Resource::State_NotPresent);
+				manager.markAsChanged(resources[i]);
+			}
+			manager.saveChangesToDisk(db_path);
+			testAssert(manager.journal_num_records <= MIN_JOURNAL_RECORDS_BEFORE_COMPACTION);
+		}
+
+		ResourceManager manager2(dir);
+		manager2.loadFromDisk(db_path, /*force_check_if_resources_exist_on_disk=*/false);
+		testAssert(manager2.getResourcesForURL().size() == 12);
+		for(size_t i=0; i<resources.size(); ++i)
+			testAssert(manager2.getExistingResourceForURL(resources[i]->URL)->getState() == resources[i]->getState());
+	}
+
+	conPrint("ResourceManager::test() done.");
+}
+
+
+#endif // BUILD_TESTS
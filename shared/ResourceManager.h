@@ -16,6 +16,7 @@ Generated at 2016-01-12 12:22:34 +1300
 #include <unordered_set>
 #include <Mutex.h>
 #include <AtomicInt.h>
+class BufferOutStream;
 
 
 /*=====================================================================
@@ -79,8 +80,8 @@ public:
 	std::map<std::string, ResourceRef>& getResourcesForURL() { return resource_for_url; }
 
 	bool hasChanged() const { return changed != 0; }
-	void clearChangedFlag() { changed = 0; }
-	void markAsChanged(); // Thread-safe
+	void markAsChanged(); // Thread-safe.  Marks the whole database as changed, so it will be completely rewritten on the next save.
+	void markAsChanged(const ResourceRef& resource); // Thread-safe.  Marks just the given resource as changed, so it will be appended to the journal on the next save.
 
 	Mutex& getMutex() { return mutex; }
 
@@ -88,17 +89,41 @@ public:
 	int64 getTotalPresentResourcesSizeB() const;
 
 	// Just used on client:
+	// The resources database is stored as a snapshot file at path, and a journal file at path + "_journal".
+	// The journal has a record for each resource change since the snapshot was written.
+	// Loads the snapshot, then replays the journal over it.  Throws glare::Exception on failure.
 	void loadFromDisk(const std::string& path, bool force_check_if_resources_exist_on_disk);
+
+	// Writes a new snapshot with all resources, and starts a new, empty journal.
+	// The resources are serialised to memory while holding the mutex, but the files are written without holding it.
+	// Should only be called by one thread at a time.  Throws glare::Exception on failure.
 	void saveToDisk(const std::string& path);
 
+	// Appends the resources changed since the last save to the journal, if there were any.
+	// Writes a new snapshot instead if the journal has got too long, or if the whole database has been marked as changed.
+	// Like saveToDisk(), doesn't hold the mutex while writing files, and should only be called by one thread at a time.  Throws glare::Exception on failure.
+	void saveChangesToDisk(const std::string& path);
+
+	static void test();
+
 	std::string getDiagnostics() const;
 private:
+	void addChangedResource(const ResourceRef& resource) REQUIRES(mutex);
+	void processLoadedResource(ResourceRef& resource, bool check_resources_present_on_disk) REQUIRES(mutex);
+	bool loadJournal(const std::string& journal_path, bool check_resources_present_on_disk, size_t& num_records_out) REQUIRES(mutex);
+	void writeSnapshot(const std::string& path, const BufferOutStream& snapshot_data, uint64 new_snapshot_id);
+
 	std::string base_resource_dir;
 
 	mutable Mutex mutex;
 	std::map<std::string, ResourceRef> resource_for_url			GUARDED_BY(mutex);
 	glare::AtomicInt changed;
 
+	std::map<std::string, ResourceRef> changed_resources		GUARDED_BY(mutex); // Resources that have changed since the last save, keyed by URL.
+	bool full_save_needed										GUARDED_BY(mutex); // If true, the next save will write a new snapshot, e.g. because there is no valid journal on disk.
+	uint64 snapshot_id											GUARDED_BY(mutex); // Id of the snapshot on disk.  Journal entries are only replayed over the snapshot with the same id.
+	size_t journal_num_records									GUARDED_BY(mutex); // Number of records in the journal on disk.
+
 
 	std::unordered_set<std::string> download_failed_URLs; // Ephemeral state, used to prevent trying to download the same resource over and over again in one client execution.
 
@@ -69,6 +69,7 @@ WorldObject::WorldObject() noexcept
 #if GUI_CLIENT
 	is_selected = false;
 	in_proximity = false;
+	in_prefetch_proximity = false;
 	lightmap_baking = false;
 	current_lod_level = 0;
 	loading_or_loaded_model_lod_level = -10;
@@ -253,6 +253,7 @@ private:
 public:
 	int current_lod_level; // LOD level as a function of distance from camera etc.. Kept up to date.
 	bool in_proximity; // Is the object currently in load proximity to camera?
+	bool in_prefetch_proximity; // Is the object in load proximity to the predicted camera position, but not the current camera position?  If so its resources are being downloaded.
 private:
 	js::AABBox aabb_os; // Object-space AABB
 public:
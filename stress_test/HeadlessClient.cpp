@@ -0,0 +1,1055 @@
+/*=====================================================================
+HeadlessClient.cpp
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "HeadlessClient.h"
+
+
+#include "../gui_client/ClientThread.h"
+#include "../gui_client/DownloadResourcesThread.h"
+#include "../gui_client/LoadModelTask.h"
+#include "../gui_client/LoadScriptTask.h"
+#include "../gui_client/ThreadMessages.h"
+#include "../gui_client/WinterShaderEvaluator.h"
+#include "../gui_client/PhysicsObject.h"
+#include "../gui_client/URLWhitelist.h"
+#include "../shared/Protocol.h"
+#include "../shared/MessageUtils.h"
+#include "../shared/FileTypes.h"
+#include <dll/include/IndigoMesh.h>
+#include <utils/Clock.h>
+#include <utils/ConPrint.h>
+#include <utils/Exception.h>
+#include <utils/FileUtils.h>
+#include <utils/PlatformUtils.h>
+#include <utils/StringUtils.h>
+#include <utils/Lock.h>
+#include <utils/Task.h>
+#include <algorithm>
+#include <limits>
+
+
+static const int NUM_RESOURCE_DOWNLOAD_THREADS = 4; // Same as GUIClient
+static const size_t MAX_NUM_LOAD_TASKS_IN_FLIGHT = 4; // Per client.  The load task manager is shared between all clients.
+
+
+HeadlessClientPath HeadlessClientPath::loadFromFile(const std::string& path, double speed)
+{
+	HeadlessClientPath res;
+	res.speed = speed;
+
+	std::string contents;
+	try
+	{
+		contents = FileUtils::readEntireFileTextMode(path);
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		throw glare::Exception(e.what());
+	}
+
+	const std::vector<std::string> lines = ::split(contents, '\n');
+	for(size_t i=0; i<lines.size(); ++i)
+	{
+		const std::string line = ::stripHeadAndTailWhitespace(lines[i]);
+		if(line.empty() || hasPrefix(line, "#"))
+			continue;
+
+		const std::vector<std::string> components = ::split(line, ' ');
+		if(components.size() != 3)
+			throw glare::Exception("Error reading path file '" + path + "', line " + toString(i + 1) + ": expected 'x y z'");
+
+		res.addWaypoint(Vec3d(stringToDouble(components[0]), stringToDouble(components[1]), stringToDouble(components[2])));
+	}
+
+	if(res.waypoints.size() < 2)
+		throw glare::Exception("Path file '" + path + "' needs at least 2 waypoints.");
+	return res;
+}
+
+
+HeadlessClientPath HeadlessClientPath::makeCirclePath(const Vec3d& centre, double radius, double speed)
+{
+	HeadlessClientPath res;
+	res.speed = speed;
+
+	const int N = 32;
+	for(int i=0; i<N; ++i)
+	{
+		const double theta = Maths::get2Pi<double>() * i / N;
+		res.addWaypoint(centre + Vec3d(cos(theta), sin(theta), 0) * radius);
+	}
+	return res;
+}
+
+
+void HeadlessClientPath::addWaypoint(const Vec3d& p)
+{
+	// The path is a closed loop, so total_length includes the segment from the last waypoint back to the first.
+	if(waypoints.empty())
+		cumulative_lengths.push_back(0);
+	else
+		cumulative_lengths.push_back(cumulative_lengths.back() + waypoints.back().getDist(p));
+
+	waypoints.push_back(p);
+	total_length = cumulative_lengths.back() + waypoints.back().getDist(waypoints[0]);
+}
+
+
+size_t HeadlessClientPath::segmentForDist(double d, double& dist_along_segment_out) const
+{
+	assert(!waypoints.empty());
+	if(total_length <= 0)
+	{
+		dist_along_segment_out = 0;
+		return 0;
+	}
+
+	d = std::fmod(d, total_length);
+	if(d < 0)
+		d += total_length;
+
+	// Find the last waypoint with cumulative length <= d
+	const size_t i = (size_t)(std::upper_bound(cumulative_lengths.begin(), cumulative_lengths.end(), d) - cumulative_lengths.begin()) - 1;
+	dist_along_segment_out = d - cumulative_lengths[i];
+	return i;
+}
+
+
+Vec3d HeadlessClientPath::getPositionAtDist(double d) const
+{
+	if(waypoints.empty())
+		return Vec3d(0, 0, 0);
+
+	double dist_along_segment;
+	const size_t i = segmentForDist(d, dist_along_segment);
+	const Vec3d& a = waypoints[i];
+	const Vec3d& b = waypoints[(i + 1) % waypoints.size()];
+	const double seg_len = a.getDist(b);
+	if(seg_len <= 0)
+		return a;
+	return a + (b - a) * (dist_along_segment / seg_len);
+}
+
+
+Vec3d HeadlessClientPath::getDirectionAtDist(double d) const
+{
+	if(waypoints.size() < 2)
+		return Vec3d(1, 0, 0);
+
+	double dist_along_segment;
+	const size_t i = segmentForDist(d, dist_along_segment);
+	const Vec3d delta = waypoints[(i + 1) % waypoints.size()] - waypoints[i];
+	const double len = delta.length();
+	return (len > 0) ? (delta / len) : Vec3d(1, 0, 0);
+}
+
+
+float computePercentile(std::vector<float>& values, float percentile)
+{
+	if(values.empty())
+		return 0;
+
+	const size_t index = myMin(values.size() - 1, (size_t)(percentile * values.size()));
+	std::nth_element(values.begin(), values.begin() + index, values.end());
+	return values[index];
+}
+
+
+
+
+//-----------------------------------------------------------------------------------------------------
+
+
+/*=====================================================================
+HeadlessLoadTaskWrapper
+-----------------------
+Runs one of the client's load tasks (LoadModelTask or LoadScriptTask) on the shared load task manager,
+then decrements the owning client's count of tasks in flight, so the client can wait for its tasks to finish before shutting down.
+=====================================================================*/
+class HeadlessLoadTaskWrapper : public glare::Task
+{
+public:
+	virtual void run(size_t thread_index)
+	{
+		task->run(thread_index);
+		task = NULL;
+		(*num_load_tasks_in_flight)--; // NOTE: must be the last access of client state, as the client may be destroyed after this.
+	}
+
+	glare::TaskRef task;
+	glare::AtomicInt* num_load_tasks_in_flight;
+};
+
+
+// Physics shapes for dynamic objects are different from those for static objects, so they are loaded separately.
+static std::string modelKeyForURL(const std::string& lod_model_url, bool dynamic)
+{
+	return dynamic ? ("dyn:" + lod_model_url) : lod_model_url;
+}
+
+
+static std::string voxelLoadKeyForOb(const WorldObject& ob)
+{
+	return "voxelob_" + ob.uid.toString(); // Same key as GUIClient uses.
+}
+
+
+// Physics shape for a unit cube, used by LoadModelTask for voxel objects with no voxels.
+// GUIClient uses the image cube shape for this, but making that needs an OpenGL vertex buffer allocator.
+static PhysicsShape makeUnitCubeShape()
+{
+	Indigo::MeshRef mesh = new Indigo::Mesh();
+	for(unsigned int i=0; i<8; ++i)
+		mesh->addVertex(Indigo::Vec3f((float)(i & 1), (float)((i >> 1) & 1), (float)((i >> 2) & 1)));
+
+	const unsigned int quads[6][4] = { {0, 2, 3, 1}, {4, 5, 7, 6}, {0, 1, 5, 4}, {2, 6, 7, 3}, {0, 4, 6, 2}, {1, 3, 7, 5} };
+	for(int q=0; q<6; ++q)
+	{
+		const unsigned int vertex_indices[]   = { quads[q][0], quads[q][1], quads[q][2] };
+		mesh->addTriangle(vertex_indices, vertex_indices, 0);
+		const unsigned int vertex_indices_2[] = { quads[q][0], quads[q][2], quads[q][3] };
+		mesh->addTriangle(vertex_indices_2, vertex_indices_2, 0);
+	}
+	mesh->endOfModel();
+
+	return PhysicsWorld::createJoltShapeForIndigoMesh(*mesh, /*build_dynamic_physics_ob=*/false);
+}
+
+
+HeadlessClient::HeadlessClient(const HeadlessClientConfig& config_, struct tls_config* client_tls_config_, glare::TaskManager* load_task_manager_)
+:	config(config_),
+	client_tls_config(client_tls_config_),
+	load_task_manager(load_task_manager_),
+	should_die(0),
+	num_resources_downloading(0),
+	proximity_loader(config_.load_distance),
+	avatar_created(false),
+	cam_dir(1, 0, 0),
+	dist_along_path(config_.path_start_offset),
+	last_transform_send_time(0),
+	last_proximity_check_time(0),
+	last_queue_update_time(0),
+	num_load_tasks_in_flight(0),
+	scratch_packet(SocketBufferOutStream::DontUseNetworkByteOrder)
+{
+	proximity_loader.callbacks = this;
+	cam_pos = config.path.getPositionAtDist(dist_along_path);
+}
+
+
+HeadlessClient::~HeadlessClient()
+{
+}
+
+
+void HeadlessClient::run()
+{
+	try
+	{
+		connect();
+
+		const double start_time = Clock::getTimeSinceInit();
+		double last_frame_start_time = start_time;
+		const double target_frame_time = 1.0 / config.frame_rate;
+
+		while((should_die == 0) && (Clock::getTimeSinceInit() - start_time < config.run_time_s))
+		{
+			const double frame_start_time = Clock::getTimeSinceInit();
+			const double dt = myMin(0.1, frame_start_time - last_frame_start_time);
+			last_frame_start_time = frame_start_time;
+
+			runFrame(frame_start_time, dt);
+
+			const double frame_work_time = Clock::getTimeSinceInit() - frame_start_time;
+			{
+				Lock lock(stats_mutex);
+				stats.frame_times_s.push_back((float)frame_work_time);
+			}
+
+			if(frame_work_time < target_frame_time)
+				PlatformUtils::Sleep((int)((target_frame_time - frame_work_time) * 1000));
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("HeadlessClient: Error: " + e.what());
+		Lock lock(stats_mutex);
+		stats.error_msg = e.what();
+	}
+
+	shutdown();
+}
+
+
+HeadlessClientStats HeadlessClient::getStats() const
+{
+	Lock lock(stats_mutex);
+	return stats;
+}
+
+
+void HeadlessClient::connect()
+{
+	FileUtils::createDirIfDoesNotExist(config.cache_dir);
+	resource_manager = new ResourceManager(config.cache_dir);
+	processed_mesh_cache = new ProcessedMeshCache(config.cache_dir + "/processed_meshes");
+
+	world_ob_pool_allocator = new glare::PoolAllocator(sizeof(WorldObject), 64);
+
+	world_state = new WorldState();
+	world_state->url_whitelist->loadDefaultWhitelist();
+
+	client_thread = new ClientThread(&msg_queue, config.server_hostname, config.server_port, config.world_name, client_tls_config, world_ob_pool_allocator);
+	client_thread->world_state = world_state;
+	client_thread_manager.addThread(client_thread);
+
+	for(int z=0; z<NUM_RESOURCE_DOWNLOAD_THREADS; ++z)
+		resource_download_thread_manager.addThread(new DownloadResourcesThread(&msg_queue, resource_manager, config.server_hostname, config.server_port, &num_resources_downloading, client_tls_config,
+			&download_queue));
+
+	physics_world = new PhysicsWorld(load_task_manager);
+	unit_cube_shape = makeUnitCubeShape();
+
+	const js::AABBox initial_aabb = proximity_loader.setCameraPosForNewConnection(cam_pos.toVec4fPoint());
+
+	// Send QueryObjectsInAABB for initial volume around camera to server
+	MessageUtils::initPacket(scratch_packet, Protocol::QueryObjectsInAABB);
+	writeToStream<double>(cam_pos, scratch_packet); // Send camera position
+	scratch_packet.writeFloat((float)initial_aabb.min_[0]);
+	scratch_packet.writeFloat((float)initial_aabb.min_[1]);
+	scratch_packet.writeFloat((float)initial_aabb.min_[2]);
+	scratch_packet.writeFloat((float)initial_aabb.max_[0]);
+	scratch_packet.writeFloat((float)initial_aabb.max_[1]);
+	scratch_packet.writeFloat((float)initial_aabb.max_[2]);
+	enqueueMessageToSend(scratch_packet);
+}
+
+
+void HeadlessClient::shutdown()
+{
+	client_thread_manager.killThreadsBlocking();
+	resource_download_thread_manager.killThreadsBlocking();
+
+	// Wait for our load tasks on the shared task manager to finish, so they don't post messages to msg_queue after it has been destroyed.
+	while(num_load_tasks_in_flight > 0)
+		PlatformUtils::Sleep(1);
+
+	load_item_queue.clear();
+
+	for(auto it = ob_physics_objects.begin(); it != ob_physics_objects.end(); ++it)
+		physics_world->removeObject(it->second);
+	ob_physics_objects.clear();
+
+	obs_with_scripts.clear();
+	script_evaluators.clear();
+	loaded_models.clear();
+	physics_world = NULL;
+}
+
+
+void HeadlessClient::runFrame(double cur_time, double dt)
+{
+	// Move camera along path
+	dist_along_path += config.path.speed * dt;
+	cam_pos = config.path.getPositionAtDist(dist_along_path);
+	cam_dir = config.path.getDirectionAtDist(dist_along_path);
+
+	handleMessages(cur_time);
+
+	processDirtyObjects(cur_time);
+
+	proximity_loader.updateCamPos(cam_pos.toVec4fPoint(), cur_time); // Will call newCellInProximity() for new cells.
+
+	if(cur_time - last_proximity_check_time > 0.5)
+	{
+		checkObjectsInProximity(cur_time);
+		last_proximity_check_time = cur_time;
+	}
+
+	// Update queue priorities every now and then, as GUIClient does.
+	if(cur_time - last_queue_update_time > 0.5)
+	{
+		download_queue.updatePriorities(cam_pos, cam_dir, /*predicted_campos=*/proximity_loader.getPrefetchPos());
+
+		temp_discarded_items.clear();
+		load_item_queue.updatePriorities(cam_pos, cam_dir, /*predicted_campos=*/proximity_loader.getPrefetchPos(), temp_discarded_items);
+		for(size_t i=0; i<temp_discarded_items.size(); ++i)
+		{
+			// Will be re-queued if an object needs it again.
+			const LoadScriptTask* script_task = dynamic_cast<const LoadScriptTask*>(temp_discarded_items[i].task.ptr());
+			if(script_task)
+				loading_scripts.erase(script_task->script_content);
+			else
+				loading_models.erase(temp_discarded_items[i].key);
+		}
+		temp_discarded_items.clear();
+
+		last_queue_update_time = cur_time;
+	}
+
+	// Pass load tasks to the shared task manager
+	while(!load_item_queue.empty() && ((size_t)num_load_tasks_in_flight < MAX_NUM_LOAD_TASKS_IN_FLIGHT))
+	{
+		LoadItemQueueItem item;
+		load_item_queue.dequeueFront(item);
+		addLoadTask(item.task);
+	}
+
+	evalObjectScripts(dt);
+
+	physics_world->think(dt);
+
+	// Send AvatarTransformUpdate packet every 0.1 s
+	if(avatar_created && (cur_time - last_transform_send_time > 0.1))
+	{
+		const Vec3f angles(0, Maths::pi_2<float>(), (float)std::atan2(cam_dir.y, cam_dir.x));
+		const uint32 anim_state = 0;
+
+		MessageUtils::initPacket(scratch_packet, Protocol::AvatarTransformUpdate);
+		writeToStream(client_avatar_uid, scratch_packet);
+		writeToStream(cam_pos, scratch_packet);
+		writeToStream(angles, scratch_packet);
+		scratch_packet.writeUInt32(anim_state);
+		enqueueMessageToSend(scratch_packet);
+
+		last_transform_send_time = cur_time;
+	}
+}
+
+
+void HeadlessClient::handleMessages(double cur_time)
+{
+	std::vector<Reference<ThreadMessage> > msgs;
+	{
+		Lock lock(msg_queue.getMutex());
+		while(!msg_queue.unlockedEmpty())
+			msgs.push_back(msg_queue.unlockedDequeue());
+	}
+
+	for(size_t i=0; i<msgs.size(); ++i)
+	{
+		ThreadMessage* msg = msgs[i].ptr();
+		if(dynamic_cast<const ModelLoadedThreadMessage*>(msg))
+		{
+			handleModelLoadedMessage(*static_cast<const ModelLoadedThreadMessage*>(msg), cur_time);
+		}
+		else if(dynamic_cast<const ScriptLoadedThreadMessage*>(msg))
+		{
+			const ScriptLoadedThreadMessage* m = static_cast<const ScriptLoadedThreadMessage*>(msg);
+			script_evaluators[m->script] = m->script_evaluator;
+			loading_scripts.erase(m->script);
+
+			Lock lock(stats_mutex);
+			stats.num_scripts_loaded++;
+		}
+		else if(dynamic_cast<const LogMessage*>(msg))
+		{
+			// Load tasks report errors with a LogMessage.  DownloadResourcesThreads also use LogMessage.
+			const std::string& log_msg = static_cast<const LogMessage*>(msg)->msg;
+			conPrint("HeadlessClient: " + log_msg);
+
+			if(hasPrefix(log_msg, "Error while loading model"))
+			{
+				Lock lock(stats_mutex);
+				stats.num_model_load_failures++;
+			}
+		}
+		else if(dynamic_cast<const ClientConnectedToServerMessage*>(msg))
+		{
+			client_avatar_uid = static_cast<const ClientConnectedToServerMessage*>(msg)->client_avatar_uid;
+
+			// Send CreateAvatar packet for this client's avatar
+			MessageUtils::initPacket(scratch_packet, Protocol::CreateAvatar);
+			Avatar avatar;
+			avatar.uid = client_avatar_uid;
+			avatar.pos = cam_pos;
+			avatar.rotation = Vec3f(0, Maths::pi_2<float>(), 0);
+			writeAvatarToNetworkStream(avatar, scratch_packet);
+			enqueueMessageToSend(scratch_packet);
+
+			avatar_created = true;
+
+			Lock lock(stats_mutex);
+			stats.connected = true;
+		}
+		else if(dynamic_cast<const ClientConnectingToServerMessage*>(msg))
+		{}
+		else if(dynamic_cast<const ClientProtocolTooOldMessage*>(msg))
+		{
+			throw glare::Exception("Client protocol is too old for server.");
+		}
+		else if(dynamic_cast<const ClientDisconnectedFromServerMessage*>(msg))
+		{
+			const ClientDisconnectedFromServerMessage* m = static_cast<const ClientDisconnectedFromServerMessage*>(msg);
+			throw glare::Exception("Disconnected from server: " + m->error_message);
+		}
+		else if(dynamic_cast<const ResourceDownloadedMessage*>(msg))
+		{
+			const std::string& URL = static_cast<const ResourceDownloadedMessage*>(msg)->URL;
+			{
+				Lock lock(stats_mutex);
+				stats.num_resources_downloaded++;
+			}
+
+			// If this is a model that objects are waiting on, start loading it.
+			for(int dynamic=0; dynamic<2; ++dynamic)
+			{
+				const std::string model_key = modelKeyForURL(URL, dynamic != 0);
+				auto res = obs_waiting_for_model.find(model_key);
+				if(res != obs_waiting_for_model.end() && !res->second.empty())
+					startLoadingModel(URL, *res->second[0]);
+			}
+		}
+		// Other messages (chat, avatar gestures etc.) are ignored.
+	}
+}
+
+
+void HeadlessClient::processDirtyObjects(double cur_time)
+{
+	const float load_distance2 = Maths::square(config.load_distance);
+	const Vec4f campos = cam_pos.toVec4fPoint();
+
+	Lock lock(world_state->mutex);
+
+	for(auto it = world_state->dirty_from_remote_objects.begin(); it != world_state->dirty_from_remote_objects.end(); ++it)
+	{
+		WorldObject* ob = it->ptr();
+
+		if(ob->from_remote_other_dirty || ob->from_remote_model_url_dirty)
+		{
+			if(ob->state == WorldObject::State_Dead)
+			{
+				unloadObject(ob);
+				world_state->objects.erase(ob->uid);
+			}
+			else
+			{
+				if(ob->state != WorldObject::State_JustCreated && ob->state != WorldObject::State_InitialSend)
+					removePhysicsObjectForOb(ob); // Model or materials may have changed, reload.
+
+				ob->in_proximity = ob->getCentroidWS().getDist2(campos) < load_distance2;
+				if(ob->in_proximity)
+					startLoadingObject(ob, cur_time);
+
+				ob->state = WorldObject::State_Alive;
+				ob->from_remote_other_dirty = false;
+				ob->from_remote_model_url_dirty = false;
+			}
+		}
+
+		if(ob->from_remote_transform_dirty || ob->from_remote_physics_transform_dirty || ob->from_remote_summoned_dirty)
+		{
+			auto res = ob_physics_objects.find(ob->uid);
+			if(res != ob_physics_objects.end())
+				physics_world->setNewObToWorldTransform(*res->second, ob->pos.toVec4fVector(), Quatf::fromAxisAndAngle(normalise(ob->axis), ob->angle), Vec4f(0), Vec4f(0));
+
+			ob->from_remote_transform_dirty = false;
+			ob->from_remote_physics_transform_dirty = false;
+			ob->from_remote_summoned_dirty = false;
+		}
+
+		ob->from_remote_lightmap_url_dirty = false;
+		ob->from_remote_physics_ownership_dirty = false;
+	}
+
+	world_state->dirty_from_remote_objects.clear();
+
+	Lock stats_lock(stats_mutex);
+	stats.num_objects = world_state->objects.size();
+}
+
+
+// Load objects that have come into load distance, and unload objects that have moved out of it.
+void HeadlessClient::checkObjectsInProximity(double cur_time)
+{
+	const float load_distance2 = Maths::square(config.load_distance);
+	const Vec4f campos = cam_pos.toVec4fPoint();
+
+	Lock lock(world_state->mutex);
+
+	for(auto it = world_state->objects.valuesBegin(); it != world_state->objects.valuesEnd(); ++it)
+	{
+		WorldObject* ob = it.getValue().ptr();
+
+		const bool in_proximity = ob->getCentroidWS().getDist2(campos) < load_distance2;
+		if(in_proximity && !ob->in_proximity)
+		{
+			ob->in_proximity = true;
+			startLoadingObject(ob, cur_time);
+		}
+		else if(!in_proximity && ob->in_proximity)
+		{
+			ob->in_proximity = false;
+			unloadObject(ob);
+		}
+	}
+}
+
+
+void HeadlessClient::unloadObject(WorldObjectRef ob)
+{
+	removePhysicsObjectForOb(ob.ptr());
+	obs_with_scripts.erase(ob);
+}
+
+
+void HeadlessClient::newCellInProximity(const Vec3<int>& cell_coords)
+{
+	// Make QueryObjects packet and enqueue to send to server
+	MessageUtils::initPacket(scratch_packet, Protocol::QueryObjects);
+	writeToStream<double>(cam_pos, scratch_packet); // Send camera position
+	scratch_packet.writeUInt32(1); // Num cells to query
+	scratch_packet.writeInt32(cell_coords.x);
+	scratch_packet.writeInt32(cell_coords.y);
+	scratch_packet.writeInt32(cell_coords.z);
+	enqueueMessageToSend(scratch_packet);
+}
+
+
+void HeadlessClient::startLoadingObject(WorldObject* ob, double cur_time)
+{
+	startLoadingScript(ob);
+
+	if(ob->object_type == WorldObject::ObjectType_VoxelGroup)
+	{
+		startLoadingVoxels(ob, cur_time);
+		return;
+	}
+
+	if(ob->object_type != WorldObject::ObjectType_Generic || ob->model_url.empty())
+		return; // Hypercards, spotlights etc. use built-in meshes in GUIClient, so have no model to load.
+
+	// Download dependencies (model, textures, lightmap) for the current LOD level.
+	const int ob_lod_level = ob->getLODLevel(cam_pos);
+	WorldObject::GetDependencyOptions options;
+	std::set<DependencyURL> dependency_URLs;
+	ob->getDependencyURLSet(ob_lod_level, options, dependency_URLs);
+	for(auto it = dependency_URLs.begin(); it != dependency_URLs.end(); ++it)
+		if(!FileTypes::hasAudioFileExtension(it->URL) && !FileTypes::hasSupportedVideoFileExtension(it->URL))
+			startDownloadingResource(it->URL, *ob);
+
+	const std::string lod_model_url = WorldObject::getLODModelURLForLevel(ob->model_url, ob->getModelLODLevel(cam_pos));
+
+	const std::string model_key = modelKeyForURL(lod_model_url, ob->isDynamic());
+	auto loaded_res = loaded_models.find(model_key);
+	if(loaded_res != loaded_models.end())
+	{
+		addPhysicsObjectForOb(ob, loaded_res->second);
+		return;
+	}
+
+	obs_waiting_for_model[model_key].push_back(ob);
+	if(model_needed_time.count(model_key) == 0)
+		model_needed_time[model_key] = cur_time;
+
+	if(resource_manager->isFileForURLPresent(lod_model_url))
+		startLoadingModel(lod_model_url, *ob);
+}
+
+
+void HeadlessClient::startDownloadingResource(const std::string& URL, const WorldObject& ob)
+{
+	if(hasPrefix(URL, "http://") || hasPrefix(URL, "https://"))
+		return; // External resources aren't served by the substrata server, and aren't needed for load testing it.
+
+	ResourceRef resource = resource_manager->getOrCreateResourceForURL(URL);
+	if(resource->getState() != Resource::State_NotPresent || resource_manager->isInDownloadFailedURLs(URL))
+		return;
+
+	download_queue.enqueueOrUpdateItem(URL, ob.getCentroidWS(), /*size factor=*/DownloadQueueItem::sizeFactorForAABBWS(ob.getAABBWSLongestLength()));
+}
+
+
+// Adapted from the model loading code in GUIClient::loadModelForObject()
+void HeadlessClient::startLoadingModel(const std::string& lod_model_url, const WorldObject& ob)
+{
+	const std::string model_key = modelKeyForURL(lod_model_url, ob.isDynamic());
+	if(loading_models.count(model_key))
+		return;
+
+	Reference<LoadModelTask> load_model_task = new LoadModelTask();
+	load_model_task->resource = resource_manager->getOrCreateResourceForURL(lod_model_url);
+	load_model_task->lod_model_url = lod_model_url;
+	load_model_task->unit_cube_shape = this->unit_cube_shape;
+	load_model_task->result_msg_queue = &this->msg_queue;
+	load_model_task->resource_manager = resource_manager;
+	load_model_task->processed_mesh_cache = processed_mesh_cache;
+	load_model_task->build_dynamic_physics_ob = ob.isDynamic();
+
+	load_item_queue.enqueueItem(/*key=*/model_key, ob, load_model_task, /*task max dist=*/std::numeric_limits<float>::infinity());
+	loading_models.insert(model_key);
+}
+
+
+// Adapted from the voxel group loading code in GUIClient::loadModelForObject()
+void HeadlessClient::startLoadingVoxels(WorldObject* ob, double cur_time)
+{
+	const std::string load_key = voxelLoadKeyForOb(*ob);
+	if(loading_models.count(load_key))
+		return;
+
+	if(ob_physics_objects.count(ob->uid))
+		return; // Already loaded.
+
+	Reference<LoadModelTask> load_model_task = new LoadModelTask();
+	load_model_task->voxel_ob_model_lod_level = ob->getModelLODLevel(cam_pos);
+	load_model_task->unit_cube_shape = this->unit_cube_shape;
+	load_model_task->result_msg_queue = &this->msg_queue;
+	load_model_task->resource_manager = resource_manager;
+	load_model_task->voxel_ob = ob;
+	load_model_task->build_dynamic_physics_ob = ob->isDynamic();
+
+	load_item_queue.enqueueItem(/*key=*/load_key, *ob, load_model_task, /*task max dist=*/std::numeric_limits<float>::infinity());
+	loading_models.insert(load_key);
+	if(model_needed_time.count(load_key) == 0)
+		model_needed_time[load_key] = cur_time;
+}
+
+
+// Winter scripts are built with LoadScriptTask, as in GUIClient::loadScriptForObject().
+void HeadlessClient::startLoadingScript(WorldObject* ob)
+{
+	if(ob->script.empty() || hasPrefix(ob->script, "<?xml"))
+	{
+		obs_with_scripts.erase(ob);
+		return;
+	}
+
+	obs_with_scripts.insert(ob);
+
+	if(script_evaluators.count(ob->script) || loading_scripts.count(ob->script))
+		return;
+
+	Reference<LoadScriptTask> task = new LoadScriptTask();
+	task->base_dir_path = config.base_dir_path;
+	task->result_msg_queue = &msg_queue;
+	task->script_content = ob->script;
+	load_item_queue.enqueueItem(/*key=*/"script_" + ob->uid.toString(), *ob, task, /*task max dist=*/std::numeric_limits<float>::infinity());
+	loading_scripts.insert(ob->script);
+}
+
+
+void HeadlessClient::handleModelLoadedMessage(const ModelLoadedThreadMessage& msg, double cur_time)
+{
+	if(msg.voxel_ob_uid.valid())
+	{
+		Lock lock(world_state->mutex);
+
+		auto res = world_state->objects.find(msg.voxel_ob_uid);
+		if(res != world_state->objects.end())
+		{
+			WorldObject* ob = res.getValue().ptr();
+			const std::string load_key = voxelLoadKeyForOb(*ob);
+			loading_models.erase(load_key);
+			recordLoadTime(load_key, cur_time);
+
+			if(ob->in_proximity && (ob->state != WorldObject::State_Dead)) // Object may be out of load distance now that it has actually been loaded.
+			{
+				removePhysicsObjectForOb(ob);
+				addPhysicsObjectForOb(ob, msg.physics_shape);
+			}
+		}
+	}
+	else
+	{
+		modelLoaded(modelKeyForURL(msg.lod_model_url, msg.built_dynamic_physics_ob), msg.physics_shape, cur_time);
+	}
+}
+
+
+void HeadlessClient::modelLoaded(const std::string& model_key, const PhysicsShape& shape, double cur_time)
+{
+	loaded_models[model_key] = shape;
+	loading_models.erase(model_key);
+
+	recordLoadTime(model_key, cur_time);
+
+	auto waiting_res = obs_waiting_for_model.find(model_key);
+	if(waiting_res != obs_waiting_for_model.end())
+	{
+		Lock lock(world_state->mutex);
+		for(size_t i=0; i<waiting_res->second.size(); ++i)
+		{
+			WorldObject* ob = waiting_res->second[i].ptr();
+			if(ob->in_proximity && (ob->state != WorldObject::State_Dead))
+				addPhysicsObjectForOb(ob, shape);
+		}
+		obs_waiting_for_model.erase(waiting_res);
+	}
+}
+
+
+void HeadlessClient::recordLoadTime(const std::string& load_key, double cur_time)
+{
+	auto needed_res = model_needed_time.find(load_key);
+	if(needed_res != model_needed_time.end())
+	{
+		Lock lock(stats_mutex);
+		stats.load_times_s.push_back((float)(cur_time - needed_res->second));
+		stats.num_models_loaded++;
+		model_needed_time.erase(needed_res);
+	}
+}
+
+
+// Adapted from GUIClient::handleModelLoadedMessage()
+void HeadlessClient::addPhysicsObjectForOb(WorldObject* ob, const PhysicsShape& shape)
+{
+	if(ob_physics_objects.count(ob->uid))
+		return;
+
+	Reference<PhysicsObject> physics_ob = new PhysicsObject(/*collidable=*/ob->isCollidable());
+
+	PhysicsShape use_shape = shape;
+	if(ob->centre_of_mass_offset_os != Vec3f(0.f))
+		use_shape = PhysicsWorld::createCOMOffsetShapeForShape(shape, ob->centre_of_mass_offset_os.toVec4fVector());
+
+	physics_ob->shape = use_shape;
+	physics_ob->userdata = ob;
+	physics_ob->userdata_type = 0;
+	physics_ob->ob_uid = ob->uid;
+	physics_ob->pos = ob->pos.toVec4fPoint();
+	physics_ob->rot = Quatf::fromAxisAndAngle(normalise(ob->axis), ob->angle);
+	physics_ob->scale = useScaleForWorldOb(ob->scale);
+	physics_ob->kinematic = !ob->script.empty();
+	physics_ob->dynamic = ob->isDynamic();
+	physics_ob->mass = ob->mass;
+	physics_ob->friction = ob->friction;
+	physics_ob->restitution = ob->restitution;
+
+	physics_world->addObject(physics_ob);
+	ob_physics_objects[ob->uid] = physics_ob;
+}
+
+
+void HeadlessClient::removePhysicsObjectForOb(WorldObject* ob)
+{
+	auto res = ob_physics_objects.find(ob->uid);
+	if(res != ob_physics_objects.end())
+	{
+		physics_world->removeObject(res->second);
+		ob_physics_objects.erase(res);
+	}
+}
+
+
+// Adapted from Scripting::evalObjectScript(): evaluates the Winter script for each scripted object, and moves its physics object.
+void HeadlessClient::evalObjectScripts(double dt)
+{
+	if(obs_with_scripts.empty())
+		return;
+
+	CybWinterEnv winter_env;
+	winter_env.instance_index = 0;
+	winter_env.num_instances = 1;
+
+	Lock lock(world_state->mutex);
+
+	const float global_time = (float)world_state->getCurrentGlobalTime();
+
+	for(auto it = obs_with_scripts.begin(); it != obs_with_scripts.end(); ++it)
+	{
+		WorldObject* ob = it->ptr();
+
+		auto evaluator_res = script_evaluators.find(ob->script);
+		if(evaluator_res == script_evaluators.end())
+			continue; // Script is still being built, or failed to build.
+		WinterShaderEvaluator* script_evaluator = evaluator_res->second.ptr();
+
+		if(script_evaluator->jitted_evalRotation)
+		{
+			const Vec4f rot = script_evaluator->evalRotation(global_time, winter_env);
+			ob->angle = rot.length();
+			if(isFinite(ob->angle) && (ob->angle > 0))
+				ob->axis = Vec3f(normalise(rot));
+			else
+			{
+				ob->angle = 0;
+				ob->axis = Vec3f(1, 0, 0);
+			}
+		}
+
+		if(script_evaluator->jitted_evalTranslation)
+			ob->translation = script_evaluator->evalTranslation(global_time, winter_env);
+
+		const Vec4f translation = ob->pos.toVec4fPoint() + ob->translation;
+		if(!translation.isFinite())
+			continue;
+
+		auto physics_res = ob_physics_objects.find(ob->uid);
+		if(physics_res != ob_physics_objects.end())
+			physics_world->moveKinematicObject(*physics_res->second, translation, Quatf::fromAxisAndAngle(normalise(ob->axis), ob->angle), (float)dt);
+	}
+}
+
+
+void HeadlessClient::addLoadTask(const glare::TaskRef& task)
+{
+	Reference<HeadlessLoadTaskWrapper> wrapper = new HeadlessLoadTaskWrapper();
+	wrapper->task = task;
+	wrapper->num_load_tasks_in_flight = &num_load_tasks_in_flight;
+
+	num_load_tasks_in_flight++;
+	load_task_manager->addTask(wrapper);
+}
+
+
+void HeadlessClient::enqueueMessageToSend(SocketBufferOutStream& packet)
+{
+	MessageUtils::updatePacketLengthField(packet);
+	client_thread->enqueueDataToSend(packet.buf);
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+static bool vecEqual(const Vec3d& a, const Vec3d& b)
+{
+	return a.getDist(b) < 1.0e-9;
+}
+
+
+void HeadlessClient::test()
+{
+	conPrint("HeadlessClient::test()");
+
+	//-------------------- Test HeadlessClientPath with a square path --------------------
+	{
+		HeadlessClientPath path;
+		path.addWaypoint(Vec3d(0, 0, 0));
+		path.addWaypoint(Vec3d(10, 0, 0));
+		path.addWaypoint(Vec3d(10, 10, 0));
+		path.addWaypoint(Vec3d(0, 10, 0));
+
+		testAssert(epsEqual(path.getTotalLength(), 40.0)); // Includes the closing segment back to the first waypoint.
+
+		testAssert(vecEqual(path.getPositionAtDist(0), Vec3d(0, 0, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(5), Vec3d(5, 0, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(10), Vec3d(10, 0, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(15), Vec3d(10, 5, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(35), Vec3d(0, 5, 0))); // On the closing segment
+
+		// Distances wrap around the loop
+		testAssert(vecEqual(path.getPositionAtDist(40), Vec3d(0, 0, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(45), Vec3d(5, 0, 0)));
+		testAssert(vecEqual(path.getPositionAtDist(-5), Vec3d(0, 5, 0)));
+
+		testAssert(vecEqual(path.getDirectionAtDist(5), Vec3d(1, 0, 0)));
+		testAssert(vecEqual(path.getDirectionAtDist(15), Vec3d(0, 1, 0)));
+		testAssert(vecEqual(path.getDirectionAtDist(25), Vec3d(-1, 0, 0)));
+		testAssert(vecEqual(path.getDirectionAtDist(35), Vec3d(0, -1, 0)));
+	}
+
+	//-------------------- Test degenerate paths --------------------
+	{
+		HeadlessClientPath path;
+		testAssert(vecEqual(path.getPositionAtDist(1), Vec3d(0, 0, 0)));
+		testAssert(vecEqual(path.getDirectionAtDist(1), Vec3d(1, 0, 0)));
+
+		path.addWaypoint(Vec3d(1, 2, 3));
+		testAssert(path.getTotalLength() == 0);
+		testAssert(vecEqual(path.getPositionAtDist(10), Vec3d(1, 2, 3)));
+	}
+
+	//-------------------- Test makeCirclePath --------------------
+	{
+		const double radius = 10;
+		HeadlessClientPath path = HeadlessClientPath::makeCirclePath(Vec3d(1, 2, 3), radius, /*speed=*/3.0);
+		testAssert(path.speed == 3.0);
+
+		// 32 chords of a circle of radius 10
+		testAssert(epsEqual(path.getTotalLength(), 32 * 2 * radius * std::sin(Maths::pi<double>() / 32)));
+
+		for(int i=0; i<100; ++i)
+		{
+			const double d = path.getTotalLength() * i / 37.0;
+			const Vec3d pos = path.getPositionAtDist(d);
+			testAssert(pos.z == 3);
+			const double dist_from_centre = pos.getDist(Vec3d(1, 2, 3));
+			testAssert(dist_from_centre <= radius + 1.0e-9 && dist_from_centre >= radius * std::cos(Maths::pi<double>() / 32) - 1.0e-9);
+			testAssert(epsEqual(path.getDirectionAtDist(d).length(), 1.0));
+		}
+	}
+
+	//-------------------- Test loadFromFile --------------------
+	try
+	{
+		const std::string path_file = PlatformUtils::getTempDirPath() + "/headless_client_path_test.txt";
+
+		FileUtils::writeEntireFileTextMode(path_file, "# A comment\n0 0 0\n\n10 0 0\n  10 10 0  \n");
+		HeadlessClientPath path = HeadlessClientPath::loadFromFile(path_file, /*speed=*/5.0);
+		testAssert(path.speed == 5.0);
+		testAssert(epsEqual(path.getTotalLength(), 20.0 + std::sqrt(200.0)));
+		testAssert(vecEqual(path.getPositionAtDist(15), Vec3d(10, 5, 0)));
+
+		// Lines without 3 components should fail
+		FileUtils::writeEntireFileTextMode(path_file, "0 0 0\n10 0\n");
+		try
+		{
+			HeadlessClientPath::loadFromFile(path_file, /*speed=*/5.0);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		// Paths with fewer than 2 waypoints should fail
+		FileUtils::writeEntireFileTextMode(path_file, "0 0 0\n");
+		try
+		{
+			HeadlessClientPath::loadFromFile(path_file, /*speed=*/5.0);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+
+		FileUtils::deleteFile(path_file);
+
+		// Missing files should fail
+		try
+		{
+			HeadlessClientPath::loadFromFile(path_file, /*speed=*/5.0);
+			failTest("Expected exception");
+		}
+		catch(glare::Exception&)
+		{}
+	}
+	catch(FileUtils::FileUtilsExcep& e)
+	{
+		failTest(e.what());
+	}
+
+	//-------------------- Test computePercentile --------------------
+	{
+		std::vector<float> values;
+		testAssert(computePercentile(values, 0.5f) == 0);
+
+		values.push_back(7);
+		testAssert(computePercentile(values, 0.f) == 7);
+		testAssert(computePercentile(values, 0.5f) == 7);
+		testAssert(computePercentile(values, 1.f) == 7);
+
+		// Values 1..100, in a scrambled order
+		values.clear();
+		for(int i=0; i<100; ++i)
+			values.push_back((float)(1 + (i * 37) % 100));
+
+		testAssert(computePercentile(values, 0.f) == 1);
+		testAssert(computePercentile(values, 0.5f) == 51);
+		testAssert(computePercentile(values, 0.25f) == 26);
+		testAssert(computePercentile(values, 0.75f) == 76);
+		testAssert(computePercentile(values, 1.f) == 100); // Index is clamped to the last element.
+		testAssert(values.size() == 100);
+	}
+
+	conPrint("HeadlessClient::test() done.");
+}
+
+
+#endif // BUILD_TESTS
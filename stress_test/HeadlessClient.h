@@ -0,0 +1,210 @@
+/*=====================================================================
+HeadlessClient.h
+----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include "../gui_client/ProximityLoader.h"
+#include "../gui_client/DownloadingResourceQueue.h"
+#include "../gui_client/LoadItemQueue.h"
+#include "../gui_client/PhysicsWorld.h"
+#include "../gui_client/WorldState.h"
+#include "../gui_client/ProcessedMeshCache.h"
+#include "../shared/ResourceManager.h"
+#include "../shared/UID.h"
+#include <utils/MyThread.h>
+#include <utils/ThreadManager.h>
+#include <utils/ThreadSafeQueue.h>
+#include <utils/SocketBufferOutStream.h>
+#include <utils/TaskManager.h>
+#include <utils/PoolAllocator.h>
+#include <maths/vec3.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+class ClientThread;
+class PhysicsObject;
+class WinterShaderEvaluator;
+class ModelLoadedThreadMessage;
+struct tls_config;
+
+
+/*=====================================================================
+HeadlessClientPath
+------------------
+A scripted camera path: a closed loop of waypoints, followed at a constant speed.
+=====================================================================*/
+class HeadlessClientPath
+{
+public:
+	HeadlessClientPath() : speed(2.0), total_length(0) {}
+
+	// Loads waypoints from a text file with one 'x y z' waypoint per line.  Throws glare::Exception on failure.
+	static HeadlessClientPath loadFromFile(const std::string& path, double speed);
+	static HeadlessClientPath makeCirclePath(const Vec3d& centre, double radius, double speed);
+
+	void addWaypoint(const Vec3d& p);
+
+	// Position and (normalised) direction of travel, at distance d along the path.  Wraps around to the start of the path.
+	Vec3d getPositionAtDist(double d) const;
+	Vec3d getDirectionAtDist(double d) const;
+
+	double getTotalLength() const { return total_length; }
+
+	double speed; // m/s
+private:
+	size_t segmentForDist(double d, double& dist_along_segment_out) const;
+
+	std::vector<Vec3d> waypoints;
+	std::vector<double> cumulative_lengths; // cumulative_lengths[i] = distance along the path to waypoints[i].
+	double total_length;
+};
+
+
+struct HeadlessClientStats
+{
+	HeadlessClientStats() : num_objects(0), num_models_loaded(0), num_model_load_failures(0), num_scripts_loaded(0), num_resources_downloaded(0), connected(false) {}
+
+	std::vector<float> frame_times_s; // Time spent doing work each frame (excluding sleeping until the next frame)
+	std::vector<float> load_times_s; // For each loaded model: time from when the model was first needed until its physics object was added.
+	size_t num_objects;
+	size_t num_models_loaded;
+	size_t num_model_load_failures;
+	size_t num_scripts_loaded;
+	size_t num_resources_downloaded;
+	bool connected;
+	std::string error_msg; // Non-empty if the client stopped with an error.
+};
+
+
+struct HeadlessClientConfig
+{
+	HeadlessClientConfig() : server_port(7600), load_distance(500.f), frame_rate(60.0), run_time_s(60.0), path_start_offset(0) {}
+
+	std::string server_hostname;
+	int server_port;
+	std::string world_name;
+	std::string cache_dir; // Directory for this client's downloaded resources.
+	std::string base_dir_path; // Directory containing data/resources/winter_stdlib.txt, for building Winter scripts.
+	float load_distance;
+	double frame_rate; // Target frame rate.  Clients sleep for the rest of each frame.
+	double run_time_s;
+	HeadlessClientPath path;
+	double path_start_offset; // Distance along the path to start at, so clients following the same path are spread out.
+};
+
+
+/*=====================================================================
+HeadlessClient
+--------------
+A client for load testing, that runs the non-rendering parts of the GUI client:
+ClientThread message handling and WorldState updates, ProximityLoader cell queries,
+resource downloading with DownloadResourcesThreads, and prioritised loading with LoadItemQueue, running the
+client's LoadModelTask and LoadScriptTask on a shared task manager, and a PhysicsWorld.
+
+Rendering, audio and UI are replaced by null implementations: LoadModelTask builds mesh data and physics shapes,
+but the mesh data is never uploaded to OpenGL, textures are downloaded but not decoded, and audio is not loaded.
+Winter scripts are built and evaluated each frame, moving the objects' physics objects.  XML scripts (path controllers and vehicles) are not run.
+
+The camera follows a scripted path, and the client records frame times and model load times.
+Each client runs in its own thread, so many clients can be run in one process.
+=====================================================================*/
+class HeadlessClient : public MyThread, public ObLoadingCallbacks
+{
+public:
+	HeadlessClient(const HeadlessClientConfig& config, struct tls_config* client_tls_config, glare::TaskManager* load_task_manager);
+	~HeadlessClient();
+
+	virtual void run();
+
+	void kill() { should_die = 1; }
+
+	// Threadsafe.  Returns a copy of the stats.
+	HeadlessClientStats getStats() const;
+
+	static void test(); // Tests HeadlessClientPath and computePercentile().
+
+	// ObLoadingCallbacks interface
+	virtual void unloadObject(WorldObjectRef ob);
+	virtual void newCellInProximity(const Vec3<int>& cell_coords);
+
+private:
+	void connect();
+	void shutdown();
+	void runFrame(double cur_time, double dt);
+	void handleMessages(double cur_time);
+	void processDirtyObjects(double cur_time);
+	void checkObjectsInProximity(double cur_time);
+	void startLoadingObject(WorldObject* ob, double cur_time);
+	void startDownloadingResource(const std::string& URL, const WorldObject& ob);
+	void startLoadingModel(const std::string& lod_model_url, const WorldObject& ob);
+	void startLoadingVoxels(WorldObject* ob, double cur_time);
+	void startLoadingScript(WorldObject* ob);
+	void handleModelLoadedMessage(const ModelLoadedThreadMessage& msg, double cur_time);
+	void modelLoaded(const std::string& model_key, const PhysicsShape& shape, double cur_time);
+	void recordLoadTime(const std::string& load_key, double cur_time);
+	void addPhysicsObjectForOb(WorldObject* ob, const PhysicsShape& shape);
+	void removePhysicsObjectForOb(WorldObject* ob);
+	void evalObjectScripts(double dt);
+	void addLoadTask(const glare::TaskRef& task);
+	void enqueueMessageToSend(SocketBufferOutStream& packet);
+
+	HeadlessClientConfig config;
+	struct tls_config* client_tls_config;
+	glare::TaskManager* load_task_manager;
+
+	glare::AtomicInt should_die;
+
+	ThreadSafeQueue<Reference<ThreadMessage> > msg_queue; // For messages from ClientThread, DownloadResourcesThreads and load tasks.
+	ThreadManager client_thread_manager;
+	ThreadManager resource_download_thread_manager;
+	Reference<ClientThread> client_thread;
+	Reference<WorldState> world_state;
+	Reference<ResourceManager> resource_manager;
+	Reference<glare::PoolAllocator> world_ob_pool_allocator;
+	Reference<PhysicsWorld> physics_world;
+	glare::AtomicInt num_resources_downloading;
+	ProcessedMeshCacheRef processed_mesh_cache;
+	PhysicsShape unit_cube_shape; // Used by LoadModelTask for voxel objects with no voxels.
+
+	ProximityLoader proximity_loader;
+	DownloadingResourceQueue download_queue;
+	LoadItemQueue load_item_queue;
+
+	UID client_avatar_uid;
+	bool avatar_created;
+	Vec3d cam_pos;
+	Vec3d cam_dir;
+	double dist_along_path;
+	double last_transform_send_time;
+	double last_proximity_check_time;
+	double last_queue_update_time;
+
+	// Models are keyed by LOD model URL, with a prefix for dynamic physics shapes.
+	std::map<std::string, PhysicsShape> loaded_models; // Map from model key to physics shape.
+	std::set<std::string> loading_models; // Models that are in load_item_queue or being loaded by a task.
+	std::map<std::string, double> model_needed_time; // Map from model or voxel load key to time it was first needed, for items that are downloading or loading.
+	std::map<std::string, std::vector<WorldObjectRef>> obs_waiting_for_model; // Map from model key to objects that will use it once loaded.
+	glare::AtomicInt num_load_tasks_in_flight; // Number of our tasks added to load_task_manager that haven't finished running yet.
+	std::vector<LoadItemQueueItem> temp_discarded_items;
+
+	// WorldObject::physics_object only exists in the GUI client, so physics objects are kept here, keyed by object UID.
+	std::unordered_map<UID, Reference<PhysicsObject>, UIDHasher> ob_physics_objects;
+
+	std::set<std::string> loading_scripts; // Script contents that are in load_item_queue or being built by a task.
+	std::map<std::string, Reference<WinterShaderEvaluator>> script_evaluators; // Map from script content to built evaluator.
+	std::set<WorldObjectRef> obs_with_scripts; // In-proximity objects with a Winter script.
+
+	SocketBufferOutStream scratch_packet;
+
+	mutable Mutex stats_mutex;
+	HeadlessClientStats stats GUARDED_BY(stats_mutex);
+};
+
+
+// Returns the given percentile (in [0, 1]) of values.  Sorts values.  Returns 0 if values is empty.
+float computePercentile(std::vector<float>& values, float percentile);
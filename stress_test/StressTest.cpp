@@ -1,10 +1,12 @@
 /*=====================================================================
-ScreenshotBot.h
-----------------
+StressTest.cpp
+--------------
 Copyright Glare Technologies Limited 2021 -
 =====================================================================*/
 
 
+#include "HeadlessClient.h"
+#include "../gui_client/PhysicsWorld.h"
 #include "../shared/Protocol.h"
 #include "../shared/UID.h"
 #include "../shared/Avatar.h"
@@ -20,6 +22,8 @@ Copyright Glare Technologies Limited 2021 -
 #include <Timer.h>
 #include <MyThread.h>
 #include <PCG32.h>
+#include <TaskManager.h>
+#include <ArgumentParser.h>
 #include <ConPrint.h>
 #include <OpenSSL.h>
 #include <Exception.h>
@@ -132,7 +136,7 @@ public:
 				avatar.uid = client_avatar_uid;
 				avatar.pos = cur_pos;
 				avatar.rotation = cur_angles;
-				writeToNetworkStream(avatar, scratch_packet);
+				writeAvatarToNetworkStream(avatar, scratch_packet);
 
 				updatePacketLengthField(scratch_packet);
 				socket->writeData(scratch_packet.buf.data(), scratch_packet.buf.size());
@@ -231,6 +235,83 @@ public:
 };
 
 
+static void printPercentiles(const std::string& name, std::vector<float>& values_s)
+{
+	conPrint(name + ": p50: " + doubleToStringNSigFigs(computePercentile(values_s, 0.5f) * 1.0e3, 4) + " ms, p90: " + doubleToStringNSigFigs(computePercentile(values_s, 0.9f) * 1.0e3, 4) + 
+		" ms, p99: " + doubleToStringNSigFigs(computePercentile(values_s, 0.99f) * 1.0e3, 4) + " ms, max: " + doubleToStringNSigFigs(computePercentile(values_s, 1.f) * 1.0e3, 4) + " ms (" + toString(values_s.size()) + " samples)");
+}
+
+
+// Runs a number of HeadlessClients in this process, each following the path, then prints frame time and load time percentiles.
+static void runHeadlessClients(const ArgumentParser& parsed_args, struct tls_config* client_tls_config)
+{
+	PhysicsWorld::init();
+
+	const int num_clients = parsed_args.isArgPresent("--num_clients") ? stringToInt(parsed_args.getArgStringValue("--num_clients")) : 10;
+	const double run_time_s = parsed_args.isArgPresent("--duration") ? stringToDouble(parsed_args.getArgStringValue("--duration")) : 60.0;
+
+	HeadlessClientConfig config;
+	config.server_hostname = parsed_args.isArgPresent("--server") ? parsed_args.getArgStringValue("--server") : "localhost";
+	config.server_port = parsed_args.isArgPresent("--port") ? stringToInt(parsed_args.getArgStringValue("--port")) : 7600;
+	config.run_time_s = run_time_s;
+	if(parsed_args.isArgPresent("--path"))
+		config.path = HeadlessClientPath::loadFromFile(parsed_args.getArgStringValue("--path"), /*speed=*/2.0);
+	else
+		config.path = HeadlessClientPath::makeCirclePath(Vec3d(0, 0, 1.67), /*radius=*/50.0, /*speed=*/2.0);
+
+	config.base_dir_path = parsed_args.isArgPresent("--base_dir") ? parsed_args.getArgStringValue("--base_dir") : PlatformUtils::getResourceDirectoryPath();
+
+	const std::string cache_dir = parsed_args.isArgPresent("--cache_dir") ? parsed_args.getArgStringValue("--cache_dir") : (PlatformUtils::getTempDirPath() + "/substrata_headless_clients");
+
+	// Model loading and physics tasks for all clients run on this task manager, like the single model_and_texture_loader_task_manager in GUIClient.
+	glare::TaskManager load_task_manager("headless client load task manager", /*num threads=*/PlatformUtils::getNumLogicalProcessors());
+
+	conPrint("Running " + toString(num_clients) + " headless clients against " + config.server_hostname + ":" + toString(config.server_port) + " for " + 
+		doubleToStringNSigFigs(run_time_s, 4) + " s...");
+
+	PCG32 rng(1);
+	std::vector<Reference<HeadlessClient>> clients;
+	for(int i=0; i<num_clients; ++i)
+	{
+		HeadlessClientConfig client_config = config;
+		client_config.cache_dir = cache_dir + "/client_" + toString(i); // Each client has its own cache, so all clients download everything.
+		client_config.path_start_offset = rng.unitRandom() * config.path.getTotalLength();
+
+		Reference<HeadlessClient> client = new HeadlessClient(client_config, client_tls_config, &load_task_manager);
+		client->launch();
+		clients.push_back(client);
+	}
+
+	for(size_t i=0; i<clients.size(); ++i)
+		clients[i]->join();
+
+	std::vector<float> all_frame_times, all_load_times;
+	size_t total_models_loaded = 0;
+	for(size_t i=0; i<clients.size(); ++i)
+	{
+		HeadlessClientStats stats = clients[i]->getStats();
+
+		conPrint("---------------- Client " + toString(i) + " ----------------");
+		if(!stats.error_msg.empty())
+			conPrint("Error: " + stats.error_msg);
+		conPrint("objects: " + toString(stats.num_objects) + ", resources downloaded: " + toString(stats.num_resources_downloaded) + ", models loaded: " + toString(stats.num_models_loaded) + 
+			", load failures: " + toString(stats.num_model_load_failures) + ", scripts loaded: " + toString(stats.num_scripts_loaded));
+
+		all_frame_times.insert(all_frame_times.end(), stats.frame_times_s.begin(), stats.frame_times_s.end());
+		all_load_times.insert(all_load_times.end(), stats.load_times_s.begin(), stats.load_times_s.end());
+		total_models_loaded += stats.num_models_loaded;
+
+		printPercentiles("frame time", stats.frame_times_s);
+		printPercentiles("load time ", stats.load_times_s);
+	}
+
+	conPrint("---------------- All clients ----------------");
+	conPrint("models loaded: " + toString(total_models_loaded));
+	printPercentiles("frame time", all_frame_times);
+	printPercentiles("load time ", all_load_times);
+}
+
+
 int main(int argc, char* argv[])
 {
 	Clock::init();
@@ -247,6 +328,50 @@ int main(int argc, char* argv[])
 	tls_config_insecure_noverifycert(client_tls_config); // TODO: Fix this, check cert etc..
 	tls_config_insecure_noverifyname(client_tls_config);
 
+	try
+	{
+		std::map<std::string, std::vector<ArgumentParser::ArgumentType> > syntax;
+		syntax["--test"] = std::vector<ArgumentParser::ArgumentType>(); // Run unit tests
+		syntax["--headless"] = std::vector<ArgumentParser::ArgumentType>(); // Run headless clients instead of the simple bots.
+		syntax["--server"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--port"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--num_clients"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--duration"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Run time in seconds
+		syntax["--path"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Path file, with one 'x y z' waypoint per line
+		syntax["--cache_dir"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string);
+		syntax["--base_dir"] = std::vector<ArgumentParser::ArgumentType>(1, ArgumentParser::ArgumentType_string); // Directory containing data/resources, for building Winter scripts
+
+		std::vector<std::string> args;
+		for(int i=0; i<argc; ++i)
+			args.push_back(argv[i]);
+
+		ArgumentParser parsed_args(args, syntax, /*allow_unnamed_arg=*/false);
+
+#if BUILD_TESTS
+		if(parsed_args.isArgPresent("--test"))
+		{
+			HeadlessClient::test();
+			return 0;
+		}
+#endif
+
+		if(parsed_args.isArgPresent("--headless"))
+		{
+			runHeadlessClients(parsed_args, client_tls_config);
+			return 0;
+		}
+	}
+	catch(ArgumentParserExcep& e)
+	{
+		conPrint("ArgumentParserExcep: " + e.what());
+		return 1;
+	}
+	catch(glare::Exception& e)
+	{
+		conPrint("Error: " + e.what());
+		return 1;
+	}
+
 
 	const int NUM_THREADS = 300;
 	std::vector<Reference<StressTestBotThread>> threads;
@@ -43,9 +43,11 @@ namespace AccountHandlers
 void renderUserAccountPage(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	std::string page;
+	UserID logged_in_user_id;
+	std::string controlled_eth_address;
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -69,20 +71,24 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 				page += "<div class=\"msg\">" + web::Escaping::HTMLEscape(msg) + "</div>  \n";
 		}
 
+		logged_in_user_id = logged_in_user->id;
+		controlled_eth_address = logged_in_user->controlled_eth_address;
+	} // end lock scope
 
 
-		//-------------------------------- List parcels owned by user --------------------------------
-
+	//-------------------------------- List parcels owned by user --------------------------------
+	// Use the web data snapshot, so we don't hold the world state mutex while iterating over all parcels.
+	{
 		page += "<h2>Parcels</h2>\n";
 
-		Reference<ServerWorldState> root_world = world_state.getRootWorldState();
+		WebDataSnapshotRef snapshot = world_state.getWebDataSnapshot();
 
-		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
+		for(auto it = snapshot->root_world_parcels.begin(); it != snapshot->root_world_parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
 
 			// Look up owner
-			if(parcel->owner_id == logged_in_user->id)
+			if(parcel->owner_id == logged_in_user_id)
 			{
 				page += "<p>\n";
 				page += "<a href=\"/parcel/" + parcel->id.toString() + "\">Parcel " + parcel->id.toString() + "</a><br/>" +
@@ -99,11 +105,11 @@ void renderUserAccountPage(ServerAllWorldsState& world_state, const web::Request
 
 		page += "Linked Ethereum address: ";
 
-		if(logged_in_user->controlled_eth_address.empty())
+		if(controlled_eth_address.empty())
 			page += "No address linked.";
 		else
 		{
-			page += "<span class=\"eth-address\">" + web::Escaping::HTMLEscape(logged_in_user->controlled_eth_address) + "</span>";
+			page += "<span class=\"eth-address\">" + web::Escaping::HTMLEscape(controlled_eth_address) + "</span>";
 			page += "<br/>";
 			page += "This is an address that you control, and for which control of the address has been proven to the Substrata server.";
 		}
@@ -133,7 +139,7 @@ void renderProveEthAddressOwnerPage(ServerAllWorldsState& world_state, const web
 	std::string page;
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -195,7 +201,7 @@ void renderProveParcelOwnerByNFT(ServerAllWorldsState& world_state, const web::R
 	std::string page;
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -246,7 +252,7 @@ void handleEthSignMessagePost(ServerAllWorldsState& world_state, const web::Requ
 	 const web::UnsafeString sig = request_info.getURLParam("sig");
 
 	 { // lock scope
-		 Lock lock(world_state.mutex);
+		 ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		 User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		 if(logged_in_user == NULL)
@@ -299,7 +305,8 @@ void renderMakeParcelIntoNFTPage(ServerAllWorldsState& world_state, const web::R
 	const ParcelID parcel_id(request.getURLIntParam("parcel_id"));
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user == NULL)
@@ -471,7 +478,8 @@ void handleMakeParcelIntoNFTPost(ServerAllWorldsState& world_state, const web::R
 
 		const ParcelID parcel_id(request_info.getPostIntField("parcel_id"));
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -551,7 +559,8 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 
 		parcel_id = ParcelID(request_info.getPostIntField("parcel_id"));
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 		if(logged_in_user == NULL)
@@ -603,7 +612,8 @@ void handleClaimParcelOwnerByNFTPost(ServerAllWorldsState& world_state, const we
 			// The logged in user does indeed own the parcel NFT.  So assign ownership of the parcel.
 
 			{ // lock scope
-				Lock lock(world_state.mutex);
+				ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+				ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 				User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 				if(logged_in_user == NULL)
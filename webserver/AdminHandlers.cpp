@@ -14,6 +14,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "WebServerResponseUtils.h"
 #include "LoginHandlers.h"
 #include "../server/ServerWorldState.h"
+#include "../server/Server.h"
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
@@ -31,7 +32,7 @@ std::string sharedAdminHeader(ServerAllWorldsState& world_state, const web::Requ
 
 	page_out += "<p><a href=\"/admin\">Main admin page</a> | <a href=\"/admin_users\">Users</a> | <a href=\"/admin_parcels\">Parcels</a> | ";
 	page_out += "<a href=\"/admin_parcel_auctions\">Parcel Auctions</a> | <a href=\"/admin_orders\">Orders</a> | <a href=\"/admin_sub_eth_transactions\">Eth Transactions</a> | <a href=\"/admin_map\">Map</a> | ";
-	page_out += "<a href=\"/admin_news_posts\">News Posts</a></p>";
+	page_out += "<a href=\"/admin_news_posts\">News Posts</a> | <a href=\"/admin_lock_profile\">Lock Profile</a> | <a href=\"/admin_rate_limits\">Rate Limits</a> | <a href=\"/metrics\">Metrics</a></p>";
 
 	return page_out;
 }
@@ -50,7 +51,7 @@ void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestIn
 	page_out += "<p>Welcome!</p><br/><br/>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 		if(world_state.server_admin_message.empty())
 		{
 			page_out += "<p>No server admin message set.</p>";
@@ -67,7 +68,7 @@ void renderMainAdminPage(ServerAllWorldsState& world_state, const web::RequestIn
 	page_out += "</form>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		if(world_state.read_only_mode)
 			page_out += "<p>Server is in read-only mode!</p>";
@@ -100,7 +101,7 @@ void renderUsersPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		// Print out users
 		page_out += "<h2>Users</h2>\n";
@@ -150,7 +151,7 @@ void renderAdminUserPage(ServerAllWorldsState& world_state, const web::RequestIn
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>User " + toString(user_id) + "</h2>\n";
 
@@ -211,7 +212,8 @@ void renderParcelsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Root world Parcels</h2>\n";
 
@@ -286,7 +288,7 @@ void renderParcelAuctionsPage(ServerAllWorldsState& world_state, const web::Requ
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Parcel auctions</h2>\n";
 
@@ -350,7 +352,7 @@ void renderAdminParcelAuctionPage(ServerAllWorldsState& world_state, const web::
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		auto res = world_state.parcel_auctions.find(auction_id);
 		if(res != world_state.parcel_auctions.end())
@@ -436,7 +438,7 @@ void renderOrdersPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Orders</h2>\n";
 
@@ -484,7 +486,7 @@ void renderSubEthTransactionsPage(ServerAllWorldsState& world_state, const web::
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 
 		page_out += "<form action=\"/admin_set_min_next_nonce_post\" method=\"post\">";
@@ -556,7 +558,7 @@ void renderAdminSubEthTransactionPage(ServerAllWorldsState& world_state, const w
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Eth transaction " + toString(transaction_id) + "</h2>\n";
 
@@ -664,7 +666,7 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 	page_out += "</form>";
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Map Info</h2>\n";
 
@@ -685,6 +687,77 @@ void renderMapPage(ServerAllWorldsState& world_state, const web::RequestInfo& re
 }
 
 
+void renderLockProfilePage(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	std::string page_out = sharedAdminHeader(world_state, request);
+
+	page_out += "<h2>World state mutex profile</h2>\n";
+
+	if(LockProfiler::isEnabled())
+		page_out += "<p>Profiling is enabled.</p>";
+	else
+		page_out += "<p>Profiling is disabled.  Stats below are from when it was last enabled, if ever.</p>";
+
+	page_out += "<form action=\"/admin_set_lock_profiling_enabled_post\" method=\"post\">";
+	page_out += "<input type=\"number\" name=\"enabled\" value=\"" + toString(LockProfiler::isEnabled() ? 1 : 0) + "\">";
+	page_out += "<input type=\"submit\" value=\"Set profiling enabled (1 / 0)\">";
+	page_out += "</form>";
+
+	// Note that we don't need to hold the world state mutex here, the stats are read lock-free.
+	std::vector<LockProfiler::SiteStats> stats;
+	LockProfiler::getSiteStats(stats);
+
+	page_out += "<p>Acquisition sites, sorted by total hold time.  p99 times are the upper bound of the histogram bucket.</p>";
+	page_out += "<table><tr><th>Site</th><th>Acquisitions</th><th>Total hold (s)</th><th>Total wait (s)</th><th>p99 hold (ms)</th><th>p99 wait (ms)</th></tr>\n";
+	for(size_t i=0; i<stats.size(); ++i)
+	{
+		page_out += "<tr><td>" + web::Escaping::HTMLEscape(stats[i].site->description()) + "</td><td>" + toString(stats[i].num_acquisitions) + "</td><td>" + doubleToStringMaxNDecimalPlaces(stats[i].total_hold_s, 3) + 
+			"</td><td>" + doubleToStringMaxNDecimalPlaces(stats[i].total_wait_s, 3) + "</td><td>" + doubleToStringMaxNDecimalPlaces(stats[i].hold_p99_s * 1.0e3, 3) + 
+			"</td><td>" + doubleToStringMaxNDecimalPlaces(stats[i].wait_p99_s * 1.0e3, 3) + "</td></tr>\n";
+	}
+	page_out += "</table>";
+
+	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
+}
+
+
+void renderRateLimitsPage(Server& server, ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	std::string page_out = sharedAdminHeader(world_state, request);
+
+	page_out += "<h2>Rate limits</h2>\n";
+
+	page_out += "<p>Limits are set in the server config, a rate of 0 means no limit.  Rejected counts are since server start.</p>";
+
+	std::vector<RateLimiter*> limiters;
+	server.rate_limiters.getLimiters(limiters);
+
+	page_out += "<table><tr><th>Limiter</th><th>Rate (/s)</th><th>Burst</th><th>Allowed</th><th>Rejected</th><th>Num buckets</th></tr>\n";
+	for(size_t i=0; i<limiters.size(); ++i)
+	{
+		const RateLimiter* limiter = limiters[i];
+		page_out += "<tr><td>" + web::Escaping::HTMLEscape(limiter->name) + "</td><td>" + doubleToStringMaxNDecimalPlaces(limiter->getParams().rate_per_s, 2) + "</td><td>" + 
+			doubleToStringMaxNDecimalPlaces(limiter->getParams().burst, 2) + "</td><td>" + toString(limiter->num_allowed.getValue()) + "</td><td>" + toString(limiter->num_rejected.getValue()) + 
+			"</td><td>" + toString(limiter->getNumBuckets()) + "</td></tr>\n";
+	}
+	page_out += "</table>";
+
+	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, page_out);
+}
+
+
 void renderAdminOrderPage(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
@@ -706,7 +779,7 @@ void renderAdminOrderPage(ServerAllWorldsState& world_state, const web::RequestI
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>Order " + toString(order_id) + "</h2>\n";
 
@@ -760,7 +833,7 @@ void renderAdminNewsPostsPage(ServerAllWorldsState& world_state, const web::Requ
 	std::string page_out = sharedAdminHeader(world_state, request);
 
 	{ // Lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 		page_out += "<h2>News Posts</h2>\n";
 
@@ -857,7 +930,8 @@ void createParcelAuctionPost(ServerAllWorldsState& world_state, const web::Reque
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -968,7 +1042,8 @@ void renderSetParcelOwnerPage(ServerAllWorldsState& world_state, const web::Requ
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		// Lookup parcel
 		const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -1014,7 +1089,8 @@ void handleSetParcelOwnerPost(ServerAllWorldsState& world_state, const web::Requ
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -1060,7 +1136,8 @@ void handleMarkParcelAsNFTMintedPost(ServerAllWorldsState& world_state, const we
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -1097,7 +1174,8 @@ void handleMarkParcelAsNotNFTPost(ServerAllWorldsState& world_state, const web::
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(ParcelID((uint32)parcel_id));
@@ -1135,7 +1213,8 @@ void handleRetryParcelMintPost(ServerAllWorldsState& world_state, const web::Req
 		const int parcel_id = request.getPostIntField("parcel_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 
@@ -1202,7 +1281,7 @@ void handleSetTransactionStateToNewPost(ServerAllWorldsState& world_state, const
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1240,7 +1319,7 @@ void handleSetTransactionStateToCompletedPost(ServerAllWorldsState& world_state,
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1279,7 +1358,7 @@ void handleSetTransactionHashPost(ServerAllWorldsState& world_state, const web::
 		const UInt256 hash = UInt256::parseFromHexString(hash_str.str());
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1318,7 +1397,7 @@ void handleSetTransactionNoncePost(ServerAllWorldsState& world_state, const web:
 		const int nonce = request.getPostIntField("nonce");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup transaction
 			const auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1357,7 +1436,7 @@ void handleDeleteTransactionPost(ServerAllWorldsState& world_state, const web::R
 		const int transaction_id = request.getPostIntField("transaction_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup transaction
 			auto res = world_state.sub_eth_transactions.find(transaction_id);
@@ -1400,7 +1479,8 @@ void handleRegenerateParcelAuctionScreenshots(ServerAllWorldsState& world_state,
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1467,7 +1547,8 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -1531,7 +1612,8 @@ void handleRegenerateMultipleParcelScreenshots(ServerAllWorldsState& world_state
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			for(auto it = world_state.getRootWorldState()->parcels.begin(); it != world_state.getRootWorldState()->parcels.end(); ++it)
 			{
@@ -1642,7 +1724,7 @@ void handleTerminateParcelAuction(ServerAllWorldsState& world_state, const web::
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel auction
 			const auto res = world_state.parcel_auctions.find(parcel_auction_id);
@@ -1679,7 +1761,7 @@ void handleRegenMapTilesPost(ServerAllWorldsState& world_state, const web::Reque
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Mark all tile sceenshots as not done.
 			for(auto it = world_state.map_tile_info.info.begin(); it != world_state.map_tile_info.info.end(); ++it)
@@ -1721,7 +1803,7 @@ void handleRecreateMapTilesPost(ServerAllWorldsState& world_state, const web::Re
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			uint64 next_shot_id = world_state.getNextScreenshotUID();
 
@@ -1770,7 +1852,7 @@ void handleSetMinNextNoncePost(ServerAllWorldsState& world_state, const web::Req
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			world_state.eth_info.min_next_nonce = request.getPostIntField("min_next_nonce");
 			world_state.eth_info.db_dirty = true;
@@ -1802,7 +1884,7 @@ void handleSetServerAdminMessagePost(ServerAllWorldsState& world_state, const we
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			world_state.server_admin_message = request.getPostField("msg").str();
 			world_state.server_admin_message_changed = true;
@@ -1834,7 +1916,7 @@ void handleSetReadOnlyModePost(ServerAllWorldsState& world_state, const web::Req
 	{
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			world_state.read_only_mode = request.getPostIntField("read_only_mode") != 0;
 
@@ -1853,6 +1935,29 @@ void handleSetReadOnlyModePost(ServerAllWorldsState& world_state, const web::Req
 }
 
 
+void handleSetLockProfilingEnabledPost(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
+	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
+	{
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	try
+	{
+		LockProfiler::setEnabled(request.getPostIntField("enabled") != 0);
+
+		web::ResponseUtils::writeRedirectTo(reply_info, "/admin_lock_profile");
+	}
+	catch(glare::Exception& e)
+	{
+		if(!request.fuzzing)
+			conPrint("handleSetLockProfilingEnabledPost error: " + e.what());
+		web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, "Error: " + e.what());
+	}
+}
+
+
 void handleForceDynTexUpdatePost(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	if(!LoginHandlers::loggedInUserHasAdminPrivs(world_state, request))
@@ -1864,7 +1969,7 @@ void handleForceDynTexUpdatePost(ServerAllWorldsState& world_state, const web::R
 	try
 	{
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 			world_state.force_dyn_tex_update = true;
 		} // End lock scope
 
@@ -1894,7 +1999,7 @@ void handleSetUserAsWorldGardenerPost(ServerAllWorldsState& world_state, const w
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup user
 			const auto res = world_state.user_id_to_users.find(UserID(user_id));
@@ -1934,7 +2039,7 @@ void handleSetUserAllowDynTexUpdatePost(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup user
 			const auto res = world_state.user_id_to_users.find(UserID(user_id));
@@ -1973,7 +2078,7 @@ void handleNewNewsPostPost(ServerAllWorldsState& world_state, const web::Request
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			User* user = LoginHandlers::getLoggedInUser(world_state, request);
 			runtimeCheck(user != NULL);
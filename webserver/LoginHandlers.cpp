@@ -47,7 +47,7 @@ site-b cookie currently stores session ID.
 
 bool isLoggedIn(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::UnsafeString& logged_in_username_out, bool& is_user_admin_out)
 {
-	Lock lock(world_state.mutex);
+	ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 	const User* user = getLoggedInUser(world_state, request_info);
 	if(user == NULL)
@@ -84,21 +84,8 @@ User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo&
 		{
 			try
 			{
-				// Lookup session
-				const auto res = world_state.user_web_sessions.find(request_info.cookies[i].value);
-				if(res == world_state.user_web_sessions.end())
-					return NULL; // Session not found
-				else
-				{
-					const UserWebSession* session = res->second.ptr();
-
-					// Lookup user from session
-					const auto user_res = world_state.user_id_to_users.find(session->user_id);
-					if(user_res == world_state.user_id_to_users.end())
-						return NULL; // User not found
-					else
-						return user_res->second.ptr();
-				}
+				// Lookup user from session
+				return world_state.findUserForWebSession(request_info.cookies[i].value);
 			}
 			catch(glare::Exception& e)
 			{
@@ -113,7 +100,7 @@ User* getLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo&
 
 void setUserWebMessageForLoggedInUser(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, const std::string& message)
 {
-	Lock lock(world_state.mutex);
+	ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 	User* user = getLoggedInUser(world_state, request_info);
 	if(user)
 	{
@@ -194,35 +181,27 @@ void handleLoginPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 		if(!isSafeReturnURL(return_URL))
 			throw glare::Exception("Invalid return URL.");
 
-		bool valid_username_and_credentials = false;
+		// Check the password without holding the world state mutex, as hashing is slow.
+		const UserID user_id = world_state.checkUserPassword(username.str(), password.str());
+		const bool valid_username_and_credentials = user_id.valid();
+
 		std::string session_id;
+		if(valid_username_and_credentials)
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
-			// Lookup user by username
-			const auto res = world_state.name_to_users.find(username.str());
-			if(res != world_state.name_to_users.end())
-			{
-				// Found user for username
-				const User& user = *(res->second);
-				if(user.isPasswordValid(password.str()))
-				{
-					valid_username_and_credentials = true;
-
-					UserWebSessionRef session = new UserWebSession();
-					session->id = UserWebSession::generateRandomKey();
-					session->user_id = user.id;
-					session->created_time = TimeStamp::currentTime();
-					
-					world_state.addUserWebSessionAsDBDirty(session);
-
-					world_state.user_web_sessions[session->id] = session;
-					world_state.markAsChanged();
-
-					session_id = session->id;
-				}
-			}
+			UserWebSessionRef session = new UserWebSession();
+			session->id = UserWebSession::generateRandomKey();
+			session->user_id = user_id;
+			session->created_time = TimeStamp::currentTime();
+			
+			world_state.addUserWebSessionAsDBDirty(session);
+
+			world_state.user_web_sessions[session->id] = session;
+			world_state.markAsChanged();
+
+			session_id = session->id;
 		} // End lock scope
 
 		// Send data back to client after releasing world state mutex.
@@ -344,12 +323,15 @@ void handleSignUpPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 		if(!isSafeReturnURL(return_URL))
 			throw glare::Exception("Invalid return URL.");
 
+		// Hash the password before taking the world state mutex, as hashing is slow.
+		const std::string user_salt = PasswordHashing::generateSalt();
+		const std::string hashed_password = world_state.computePasswordHash(password.str(), user_salt, world_state.password_hash_params);
+
 		std::string reply;
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
-			auto res = world_state.name_to_users.find(username.str()); // Find existing user with username
-			if(res != world_state.name_to_users.end())
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			if(world_state.findUserByNameCaseInsensitive(username.str())) // Find existing user with username, ignoring case, so users can't be impersonated with e.g. 'Alice' vs 'alice'.
 				throw InvalidCredentialsExcep("That username is not available."); // Username already used.
 			
 			Reference<User> new_user = new User();
@@ -357,20 +339,10 @@ void handleSignUpPost(ServerAllWorldsState& world_state, const web::RequestInfo&
 			new_user->created_time = TimeStamp::currentTime();
 			new_user->name = username.str();
 			new_user->email_address = email.str();
-
-			// We need a random salt for the user.
-			uint8 random_bytes[32];
-			CryptoRNG::getRandomBytes(random_bytes, 32);
-
-			std::string user_salt;
-			Base64::encode(random_bytes, 32, user_salt); // Convert random bytes to base-64.
-
-			new_user->password_hash_salt = user_salt;
-			new_user->hashed_password = User::computePasswordHash(password.str(), user_salt);
+			new_user->setPasswordHash(hashed_password, user_salt, world_state.password_hash_params);
 
 			// Add new user to world state
-			world_state.user_id_to_users.insert(std::make_pair(new_user->id,   new_user));
-			world_state.name_to_users   .insert(std::make_pair(username.str(), new_user));
+			world_state.addUser(new_user);
 
 			world_state.addUserAsDBDirty(new_user);
 
@@ -451,13 +423,8 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 			const std::string email_addr = username_or_email.str();
 
 			{ // Lock scope
-				Lock lock(world_state.mutex);
-				for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-					if(it->second->email_address == email_addr)
-					{
-						matching_user = it->second.getPointer();
-						break;
-					}
+				ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+				matching_user = world_state.findUserByEmail(email_addr);
 			} // End lock scope
 		}
 		else // Treat this as a username
@@ -465,13 +432,10 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 			const std::string username = username_or_email.str();
 
 			{ // Lock scope
-				Lock lock(world_state.mutex);
-				for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-					if(it->second->name == username)
-					{
-						matching_user = it->second.getPointer();
-						break;
-					}
+				ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+				const auto res = world_state.name_to_users.find(username);
+				if(res != world_state.name_to_users.end())
+					matching_user = res->second.ptr();
 			} // End lock scope
 		}
 
@@ -491,7 +455,8 @@ void handleResetPasswordPost(ServerAllWorldsState& world_state, const web::Reque
 
 				matching_user->sendPasswordResetEmail(sending_info);
 
-				Lock lock(world_state.mutex);
+				ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+				world_state.indexPasswordResetsForUser(matching_user);
 				world_state.addUserAsDBDirty(matching_user);
 				
 				conPrint("Sent user password reset email to '" + matching_user->email_address + ", username '" + matching_user->name + "'");
@@ -550,18 +515,11 @@ void renderResetPasswordFromEmailPage(ServerAllWorldsState& world_state, const w
 
 		bool valid_token = false;
 		{
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
-			// Find user with the given email address:
-			for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-			{
-				User* user = it->second.getPointer();
-				if(user->isResetTokenHashValidForUser(token_hash))
-				{
-					valid_token = true;
-					break;
-				}
-			}
+			// Find user with the given reset token:
+			const User* user = world_state.findUserForResetTokenHash(token_hash);
+			valid_token = user && user->isResetTokenHashValidForUser(token_hash); // Check expiry
 		}
 
 		if(valid_token)
@@ -618,24 +576,16 @@ void handleSetNewPasswordPost(ServerAllWorldsState& world_state, const web::Requ
 			return;
 		}
 
+		// Hash the new password before taking the world state mutex, as hashing is slow.
+		const PasswordHashParams new_params = world_state.password_hash_params;
+		const std::string new_salt = PasswordHashing::generateSalt();
+		const std::string new_hashed_password = world_state.computePasswordHash(new_password, new_salt, new_params);
+
 		bool password_reset = false;
 		{
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
-			// Find user with the given email address:
-			for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-			{
-				User* user = it->second.getPointer();
-				if(user->isResetTokenHashValidForUser(token_hash))
-				{
-					password_reset = user->resetPasswordWithTokenHash(token_hash, new_password);
-					if(password_reset)
-					{
-						world_state.addUserAsDBDirty(user);
-						break;
-					}
-				}
-			}
+			password_reset = world_state.resetUserPasswordWithTokenHash(token_hash, new_hashed_password, new_salt, new_params);
 		}
 
 		if(password_reset)
@@ -671,7 +621,7 @@ void renderChangePasswordPage(ServerAllWorldsState& world_state, const web::Requ
 
 		// Display any messages for the user
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request_info);
 			if(logged_in_user)
@@ -729,20 +679,22 @@ void handleChangePasswordPost(ServerAllWorldsState& world_state, const web::Requ
 			return;
 		}
 
-		bool password_changed = false;
+		UserID user_id;
 		{
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			User* user = getLoggedInUser(world_state, request_info);
 			if(!user)
 				throw glare::Exception("Must be logged in");
+			user_id = user->id;
+		}
 
-			if(user->isPasswordValid(current_password))
-			{
-				user->setNewPasswordAndSalt(new_password);
-				world_state.addUserAsDBDirty(user);
-				password_changed = true;
-			}
+		// Check the current password and hash the new one without holding the world state mutex.
+		bool password_changed = false;
+		if(world_state.checkPasswordForUser(user_id, current_password))
+		{
+			world_state.setUserPassword(user_id, new_password);
+			password_changed = true;
 		}
 
 		if(password_changed)
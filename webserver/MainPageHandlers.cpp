@@ -63,26 +63,23 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 
 
 	std::string auction_html, latest_news_html;
-	{ // lock scope
-		Lock lock(world_state.mutex);
-
-		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
+	{
+		// Render from the web data snapshot, so we don't need to hold the world state mutex.
+		WebDataSnapshotRef snapshot = world_state.getWebDataSnapshot();
 
 		int num_auctions_shown = 0; // Num substrata auctions shown
 		const TimeStamp now = TimeStamp::currentTime();
 		auction_html += "<div class=\"root-auction-list-container\">\n";
-		for(auto it = root_world->parcels.begin(); (it != root_world->parcels.end()) && (num_auctions_shown < 3); ++it)
+		for(auto it = snapshot->root_world_parcels.begin(); (it != snapshot->root_world_parcels.end()) && (num_auctions_shown < 3); ++it)
 		{
-			Parcel* parcel = it->second.ptr();
+			const Parcel* parcel = it->second.ptr();
 
 			if(!parcel->parcel_auction_ids.empty())
 			{
 				const uint32 auction_id = parcel->parcel_auction_ids.back(); // Get most recent auction
-				auto res = world_state.parcel_auctions.find(auction_id);
-				if(res != world_state.parcel_auctions.end())
+				const ParcelAuction* auction = snapshot->findParcelAuction(auction_id);
+				if(auction)
 				{
-					const ParcelAuction* auction = res->second.ptr();
-
 					if(auction->currentlyForSale(now)) // If auction is valid and running:
 					{
 						if(!auction->screenshot_ids.empty())
@@ -90,10 +87,10 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 							const uint64 shot_id = auction->screenshot_ids[0]; // Get id of close-in screenshot
 
 							const double cur_price_EUR = auction->computeCurrentAuctionPrice();
-							const double cur_price_BTC = cur_price_EUR * world_state.BTC_per_EUR;
-							const double cur_price_ETH = cur_price_EUR * world_state.ETH_per_EUR;
+							const double cur_price_BTC = cur_price_EUR * snapshot->BTC_per_EUR;
+							const double cur_price_ETH = cur_price_EUR * snapshot->ETH_per_EUR;
 
-							auction_html += "<div class=\"root-auction-div\"><a href=\"/parcel_auction/" + toString(auction_id) + "\"><img src=\"/screenshot/" + toString(shot_id) + "\" class=\"root-auction-thumbnail\" alt=\"screenshot\" /></a>  <br/>"
+							auction_html += "<div class=\"root-auction-div\"><a href=\"/parcel_auction/" + toString(auction_id) + "\"><img src=\"/screenshot/" + toString(shot_id) + "?w=320\" srcset=\"/screenshot/" + toString(shot_id) + "?w=320 1x, /screenshot/" + toString(shot_id) + " 2x\" class=\"root-auction-thumbnail\" alt=\"screenshot\" /></a>  <br/>"
 								"&euro;" + doubleToStringNDecimalPlaces(cur_price_EUR, 2) + " / " + doubleToStringNSigFigs(cur_price_BTC, 2) + "&nbsp;BTC / " + doubleToStringNSigFigs(cur_price_ETH, 2) + "&nbsp;ETH</div>";
 						}
 
@@ -109,22 +106,20 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 		if(num_auctions_shown == 0)
 		{
 			auction_html += "<div class=\"root-auction-list-container\">\n";
-			for(auto it = world_state.opensea_parcel_listings.begin(); (it != world_state.opensea_parcel_listings.end()) && (opensea_num_shown < 3); ++it)
+			for(auto it = snapshot->opensea_listed_parcel_ids.begin(); (it != snapshot->opensea_listed_parcel_ids.end()) && (opensea_num_shown < 3); ++it)
 			{
-				const OpenSeaParcelListing& listing = *it;
+				const ParcelID listed_parcel_id = *it;
 
-				auto parcel_res = root_world->parcels.find(listing.parcel_id); // Look up parcel
-				if(parcel_res != root_world->parcels.end())
+				const Parcel* parcel = snapshot->findParcel(listed_parcel_id); // Look up parcel
+				if(parcel)
 				{
-					const Parcel* parcel = parcel_res->second.ptr();
-
 					if(parcel->screenshot_ids.size() >= 1)
 					{
 						const uint64 shot_id = parcel->screenshot_ids[0]; // Close-in screenshot
 
-						const std::string opensea_url = "https://opensea.io/assets/ethereum/0xa4535f84e8d746462f9774319e75b25bc151ba1d/" + listing.parcel_id.toString();
+						const std::string opensea_url = "https://opensea.io/assets/ethereum/0xa4535f84e8d746462f9774319e75b25bc151ba1d/" + listed_parcel_id.toString();
 
-						auction_html += "<div class=\"root-auction-div\"><a href=\"/parcel/" + parcel->id.toString() + "\"><img src=\"/screenshot/" + toString(shot_id) + "\" class=\"root-auction-thumbnail\" alt=\"screenshot\" /></a>  <br/>"
+						auction_html += "<div class=\"root-auction-div\"><a href=\"/parcel/" + parcel->id.toString() + "\"><img src=\"/screenshot/" + toString(shot_id) + "?w=320\" srcset=\"/screenshot/" + toString(shot_id) + "?w=320 1x, /screenshot/" + toString(shot_id) + " 2x\" class=\"root-auction-thumbnail\" alt=\"screenshot\" /></a>  <br/>"
 							"<a href=\"/parcel/" + parcel->id.toString() + "\">Parcel " + parcel->id.toString() + "</a> <a href=\"" + opensea_url + "\">View&nbsp;on&nbsp;OpenSea</a></div>";
 					}
 
@@ -142,9 +137,9 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 		// Build latest news HTML
 		latest_news_html += "<div class=\"root-news-div-container\">\n";		const int max_num_to_display = 4;
 		int num_displayed = 0;
-		for(auto it = world_state.news_posts.rbegin(); it != world_state.news_posts.rend() && num_displayed < max_num_to_display; ++it)
+		for(auto it = snapshot->news_posts.rbegin(); it != snapshot->news_posts.rend() && num_displayed < max_num_to_display; ++it)
 		{
-			NewsPost* post = it->second.ptr();
+			const NewsPost* post = it->second.ptr();
 
 			if(post->state == NewsPost::State_published)
 			{
@@ -166,8 +161,7 @@ void renderRootPage(ServerAllWorldsState& world_state, WebDataStore& data_store,
 			}
 		}
 		latest_news_html += "</div>\n";
-
-	} // end lock scope
+	}
 
 
 	Reference<WebDataStoreFile> store_file = data_store.getFragmentFile("root_page.htmlfrag");
@@ -705,7 +699,7 @@ void renderBotStatusPage(ServerAllWorldsState& world_state, const web::RequestIn
 	std::string page = WebServerResponseUtils::standardHeader(world_state, request_info, /*page title=*/"Bot Status");
 
 	{ // lock scope
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 		page += "<h3>Screenshot bot</h3>";
 		if(world_state.last_screenshot_bot_contact_time.time == 0)
 			page += "No contact from screenshot bot since last server start.";
@@ -0,0 +1,108 @@
+/*=====================================================================
+MetricsHandlers.cpp
+-------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "MetricsHandlers.h"
+
+
+#include "RequestInfo.h"
+#include "Response.h"
+#include "ResponseUtils.h"
+#include "LoginHandlers.h"
+#include "../server/Server.h"
+#include "../server/WorkerThread.h"
+#include <ConPrint.h>
+#include <Lock.h>
+#include <StringUtils.h>
+#include <MessageableThread.h>
+
+
+namespace MetricsHandlers
+{
+
+
+bool isRequestFromLocalhost(const web::RequestInfo& request_info)
+{
+	const std::string ip = request_info.client_ip_address.toString();
+	return ip == "127.0.0.1" || ip == "::1" || ip == "::ffff:127.0.0.1";
+}
+
+
+// Escape a string for use as a label value, see https://prometheus.io/docs/instrumenting/exposition_formats/
+static std::string escapeLabelValue(const std::string& s)
+{
+	std::string res;
+	res.reserve(s.size());
+	for(size_t i=0; i<s.size(); ++i)
+	{
+		if(s[i] == '\\')
+			res += "\\\\";
+		else if(s[i] == '"')
+			res += "\\\"";
+		else if(s[i] == '\n')
+			res += "\\n";
+		else
+			res.push_back(s[i]);
+	}
+	return res;
+}
+
+
+static size_t getTotalMessageQueueLength(ThreadManager& thread_manager)
+{
+	size_t total = 0;
+	Lock lock(thread_manager.getMutex());
+	for(auto it = thread_manager.getThreads().begin(); it != thread_manager.getThreads().end(); ++it)
+		total += (*it)->getMessageQueue().size();
+	return total;
+}
+
+
+void handleMetricsRequest(Server& server, ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info)
+{
+	if(!(isRequestFromLocalhost(request_info) || LoginHandlers::loggedInUserHasAdminPrivs(world_state, request_info)))
+	{
+		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Access denied sorry.");
+		return;
+	}
+
+	std::string s;
+	s.reserve(65536);
+
+	// Count connected clients per world.  Note that we don't need the world state mutex for this.
+	{
+		std::map<std::string, int> world_num_clients;
+		size_t num_worker_threads = 0;
+		{
+			Lock lock(server.worker_thread_manager.getMutex());
+			for(auto it = server.worker_thread_manager.getThreads().begin(); it != server.worker_thread_manager.getThreads().end(); ++it)
+			{
+				const WorkerThread* worker = static_cast<const WorkerThread*>(it->getPointer());
+				if(worker->connected_to_world != 0)
+					world_num_clients[worker->connected_world_name]++;
+				num_worker_threads++;
+			}
+		}
+
+		s += "# HELP substrata_connected_clients Clients with an open updates connection, by world.\n";
+		s += "# TYPE substrata_connected_clients gauge\n";
+		for(auto it = world_num_clients.begin(); it != world_num_clients.end(); ++it)
+			s += "substrata_connected_clients{world=\"" + escapeLabelValue(it->first) + "\"} " + toString(it->second) + "\n";
+
+		s += "# HELP substrata_worker_threads Worker threads, including resource upload and download connections.\n";
+		s += "# TYPE substrata_worker_threads gauge\n";
+		s += "substrata_worker_threads " + toString(num_worker_threads) + "\n";
+	}
+
+	s += "# HELP substrata_mesh_lod_gen_queue_length Messages waiting to be processed by the MeshLODGenThread.\n";
+	s += "# TYPE substrata_mesh_lod_gen_queue_length gauge\n";
+	s += "substrata_mesh_lod_gen_queue_length " + toString(getTotalMessageQueueLength(server.mesh_lod_gen_thread_manager)) + "\n";
+
+	server.metrics.appendPrometheusText(s);
+
+	web::ResponseUtils::writeHTTPOKHeaderAndData(reply_info, s.data(), s.size(), "text/plain; version=0.0.4");
+}
+
+
+} // end namespace MetricsHandlers
@@ -0,0 +1,29 @@
+/*=====================================================================
+MetricsHandlers.h
+-----------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+class ServerAllWorldsState;
+class Server;
+namespace web
+{
+class RequestInfo;
+class ReplyInfo;
+}
+
+
+/*=====================================================================
+MetricsHandlers
+---------------
+Serves server metrics (see ServerMetrics) in the Prometheus text format.
+=====================================================================*/
+namespace MetricsHandlers
+{
+	// Only accessible to admins, or to requests from localhost (so a local Prometheus instance can scrape it).
+	void handleMetricsRequest(Server& server, ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+
+	bool isRequestFromLocalhost(const web::RequestInfo& request_info);
+}
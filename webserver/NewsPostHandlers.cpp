@@ -45,7 +45,7 @@ void renderNewsPostPage(ServerAllWorldsState& world_state, const web::RequestInf
 		std::string page;
 
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			auto res = world_state.news_posts.find(post_id);
 			if(res == world_state.news_posts.end())
@@ -128,17 +128,17 @@ void renderAllNewsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 
 		const int max_num_to_display = 5;
 
-		{ // Lock scope
-
-			Lock lock(world_state.mutex);
+		{
+			// Render from the web data snapshot, so we don't need to hold the world state mutex.
+			WebDataSnapshotRef snapshot = world_state.getWebDataSnapshot();
 
 			// Advance to 'start' offset.  Use reverse iterators to show most recent posts first.
-			auto it = world_state.news_posts.rbegin();
-			for(int i=0; it != world_state.news_posts.rend() && i < start; ++it, ++i)
+			auto it = snapshot->news_posts.rbegin();
+			for(int i=0; it != snapshot->news_posts.rend() && i < start; ++it, ++i)
 			{}
 
 			int num_displayed = 0;
-			for(; it != world_state.news_posts.rend() && num_displayed < max_num_to_display; ++it)
+			for(; it != snapshot->news_posts.rend() && num_displayed < max_num_to_display; ++it)
 			{
 				const NewsPost* post = it->second.ptr();
 				if(post->state == NewsPost::State_published)
@@ -162,15 +162,14 @@ void renderAllNewsPage(ServerAllWorldsState& world_state, const web::RequestInfo
 		
 			// Show 'older posts' link if there are any older posts.
 			const int next_start = start + max_num_to_display;
-			const int num_older_posts_remaining = (int)world_state.news_posts.size() - next_start;
+			const int num_older_posts_remaining = (int)snapshot->news_posts.size() - next_start;
 			if(num_older_posts_remaining > 0)
 			{
 				if(start > 0)
 					page += " | ";
 				page += "<a href=\"/news?start=" + toString(next_start) + "\">Older posts &gt;</a>  \n";
 			}
-
-		} // end lock scope
+		}
 
 		page += "</div>   \n"; // end main div
 		page += WebServerResponseUtils::standardFooter(request, true);
@@ -195,7 +194,7 @@ void renderEditNewsPostPage(ServerAllWorldsState& world_state, const web::Reques
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup post
 			const auto res = world_state.news_posts.find(post_id);
@@ -247,7 +246,7 @@ void handleEditNewsPostPost(ServerAllWorldsState& world_state, const web::Reques
 		const bool new_published = request.getPostField("published") == "checked";
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup post
 			const auto res = world_state.news_posts.find(post_id);
@@ -294,7 +293,7 @@ void handleDeleteNewsPostPost(ServerAllWorldsState& world_state, const web::Requ
 		const int post_id = request.getPostIntField("post_id");
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			// Lookup post
 			const auto res = world_state.news_posts.find(post_id);
@@ -47,8 +47,12 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 		std::string page = WebServerResponseUtils::standardHeader(world_state, request, /*page title=*/"Parcel #" + toString(parcel_id) + "", extra_header_tags);
 		page += "<div class=\"main\">   \n";
 
+		// Build the map code before taking the lock, it iterates over all parcels in the web data snapshot.
+		const std::string map_embed_code = WebServerResponseUtils::getMapEmbedCode(world_state, /*highlighted_parcel_id=*/ParcelID(parcel_id));
+
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
@@ -84,7 +88,7 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 					if(shot->state == Screenshot::ScreenshotState_notdone)
 						page += "<div class=\"inline-block\">Screenshot processing...</div>     \n";
 					else
-						page += "<div class=\"inline-block\"><a href=\"/screenshot/" + toString(screenshot_id) + "\"><img src=\"/screenshot/" + toString(screenshot_id) + "\" width=\"320px\" alt=\"screenshot\" /></a></div>   \n";
+						page += "<div class=\"inline-block\"><a href=\"/screenshot/" + toString(screenshot_id) + "\"><img src=\"/screenshot/" + toString(screenshot_id) + "?w=320\" srcset=\"/screenshot/" + toString(screenshot_id) + "?w=320 1x, /screenshot/" + toString(screenshot_id) + " 2x\" width=\"320px\" alt=\"screenshot\" /></a></div>   \n";
 				}
 			}
 
@@ -161,7 +165,7 @@ void renderParcelPage(ServerAllWorldsState& world_state, const web::RequestInfo&
 				doubleToStringMaxNDecimalPlaces(parcel->aabb_min.z, 1) + " m above ground level</p>  \n";
 
 
-			page += WebServerResponseUtils::getMapEmbedCode(world_state, /*highlighted_parcel_id=*/parcel->id);
+			page += map_embed_code;
 
 			// Show NFT status
 			page += "<h2>NFT status</h2>         \n";
@@ -313,7 +317,8 @@ void renderEditParcelDescriptionPage(ServerAllWorldsState& world_state, const we
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		// Lookup parcel
 		const auto res = world_state.getRootWorldState()->parcels.find(ParcelID(parcel_id));
@@ -347,7 +352,8 @@ void renderAddParcelWriterPage(ServerAllWorldsState& world_state, const web::Req
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -386,7 +392,8 @@ void renderRemoveParcelWriterPage(ServerAllWorldsState& world_state, const web::
 
 	{ // Lock scope
 
-		Lock lock(world_state.mutex);
+		ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+		ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 		const User* logged_in_user = LoginHandlers::getLoggedInUser(world_state, request);
 		if(logged_in_user)
@@ -443,7 +450,8 @@ void renderMetadata(ServerAllWorldsState& world_state, const web::RequestInfo& r
 			;
 
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			Reference<ServerWorldState> root_world = world_state.getRootWorldState();
 
@@ -519,7 +527,8 @@ void handleRegenerateParcelScreenshots(ServerAllWorldsState& world_state, const
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -584,7 +593,8 @@ void handleEditParcelDescriptionPost(ServerAllWorldsState& world_state, const we
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -631,7 +641,8 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 
 		{ // Lock scope
 
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -644,9 +655,9 @@ void handleAddParcelWriterPost(ServerAllWorldsState& world_state, const web::Req
 				{
 					// Try and find user for writer_name
 					User* new_writer_user = NULL;
-					for(auto it = world_state.user_id_to_users.begin(); it != world_state.user_id_to_users.end(); ++it)
-						if(it->second->name == writer_name.str())
-							new_writer_user = it->second.ptr();
+					const auto writer_res = world_state.name_to_users.find(writer_name.str());
+					if(writer_res != world_state.name_to_users.end())
+						new_writer_user = writer_res->second.ptr();
 
 					if(new_writer_user)
 					{
@@ -703,7 +714,8 @@ void handleRemoveParcelWriterPost(ServerAllWorldsState& world_state, const web::
 		const UserID writer_id = UserID(request.getPostIntField("writer_id"));
 
 		{ // Lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
+			ProfiledLock world_lock(world_state.getRootWorldState()->mutex, LOCK_PROFILER_SITE());
 
 			// Lookup parcel
 			const auto res = world_state.getRootWorldState()->parcels.find(parcel_id);
@@ -12,8 +12,10 @@ Copyright Glare Technologies Limited 2021 -
 #include "Escaping.h"
 #include "ResponseUtils.h"
 #include "WebServerResponseUtils.h"
+#include "WebResponseCache.h"
 #include "../server/ServerWorldState.h"
 #include "../server/Order.h"
+#include "../server/ResourceCompression.h"
 #include <graphics/FormatDecoderGLTF.h>
 #include <graphics/BatchedMesh.h>
 #include <ConPrint.h>
@@ -24,12 +26,103 @@ Copyright Glare Technologies Limited 2021 -
 #include <MemMappedFile.h>
 #include <FileUtils.h>
 #include <RuntimeCheck.h>
+#include <xxhash.h>
+#include <mathstypes.h>
+#include <algorithm>
+#if BUILD_TESTS
+#include <utils/TestUtils.h>
+#endif
 
 
 namespace ResourceHandlers
 {
 
 
+static const size_t MAX_NUM_RANGES = 16; // Max number of ranges we will handle in a single request.
+
+
+bool resolveByteRanges(const std::vector<web::Range>& request_ranges, uint64 file_size, std::vector<ByteRange>& ranges_out)
+{
+	ranges_out.clear();
+	for(size_t i=0; i<request_ranges.size(); ++i)
+	{
+		const web::Range& range = request_ranges[i];
+		if(range.start < 0)
+			throw glare::Exception("invalid range");
+		if(range.end_incl != -1 && range.end_incl < range.start)
+			throw glare::Exception("invalid range");
+
+		if((uint64)range.start >= file_size) // Range is not satisfiable, ignore it.
+			continue;
+
+		ByteRange byte_range;
+		byte_range.start = (uint64)range.start;
+		byte_range.end = (range.end_incl == -1) ? file_size : myMin(file_size, (uint64)range.end_incl + 1); // Ranges that go past the end of the file are truncated.
+		ranges_out.push_back(byte_range);
+	}
+
+	// Sort and merge overlapping or adjacent ranges, so we never send the same data twice.
+	std::sort(ranges_out.begin(), ranges_out.end(), [](const ByteRange& a, const ByteRange& b) { return a.start < b.start; });
+	size_t num_merged = 0;
+	for(size_t i=0; i<ranges_out.size(); ++i)
+	{
+		if(num_merged > 0 && ranges_out[i].start <= ranges_out[num_merged - 1].end)
+			ranges_out[num_merged - 1].end = myMax(ranges_out[num_merged - 1].end, ranges_out[i].end);
+		else
+			ranges_out[num_merged++] = ranges_out[i];
+	}
+	ranges_out.resize(num_merged);
+
+	return !ranges_out.empty();
+}
+
+
+std::string byteRangesBoundary(const std::string& etag)
+{
+	return "substrata_byteranges_" + toHexString(XXH64(etag.data(), etag.size(), /*seed=*/2));
+}
+
+
+std::string byteRangePartHeader(const ByteRange& range, const std::string& boundary, const std::string& content_type, uint64 file_size)
+{
+	return "\r\n--" + boundary + "\r\n"
+		"Content-Type: " + content_type + "\r\n"
+		"Content-Range: bytes " + toString(range.start) + "-" + toString(range.end - 1) + "/" + toString(file_size) + "\r\n"
+		"\r\n";
+}
+
+
+std::string byteRangesClosingDelimiter(const std::string& boundary)
+{
+	return "\r\n--" + boundary + "--\r\n";
+}
+
+
+uint64 multipartByteRangesContentLength(const std::vector<ByteRange>& ranges, const std::string& boundary, const std::string& content_type, uint64 file_size)
+{
+	uint64 len = byteRangesClosingDelimiter(boundary).size();
+	for(size_t i=0; i<ranges.size(); ++i)
+		len += byteRangePartHeader(ranges[i], boundary, content_type, file_size).size() + (ranges[i].end - ranges[i].start);
+	return len;
+}
+
+
+// Writes a 404 response with Cache-Control: no-store, so that browsers and CDNs don't cache the error, given the long max-age we send for resources.
+// For example a resource may not have finished uploading yet.
+static void writeNotFoundResponse(web::ReplyInfo& reply_info, const std::string& msg)
+{
+	const std::string response = 
+		"HTTP/1.1 404 Not Found\r\n"
+		"Content-Type: text/plain\r\n"
+		"Cache-Control: no-store\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Content-Length: " + toString(msg.size()) + "\r\n"
+		"\r\n" + 
+		msg;
+	reply_info.socket->writeData(response.c_str(), response.size());
+}
+
+
 void handleResourceRequest(ServerAllWorldsState& world_state, const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
 	try
@@ -116,75 +209,162 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 			try
 			{
 				// Since resources have content hashes in URLs, the content for a given resource doesn't change.
-				// Therefore we can always return HTTP 304 not modified responses.
+				// Therefore we can always return HTTP 304 not modified responses for If-Modified-Since requests, and can use a hash of the URL as the ETag.
+				// If-None-Match takes precedence over If-Modified-Since though (RFC 7232 section 3.3), so only look at If-Modified-Since if there is no If-None-Match.
+				const std::string etag = "\"" + toHexString(XXH64(resource_URL.data(), resource_URL.size(), /*seed=*/1)) + "\"";
+
+				bool have_if_none_match = false;
+				bool have_if_modified_since = false;
 				for(size_t i=0; i<request.headers.size(); ++i)
-					if(StringUtils::equalCaseInsensitive(request.headers[i].key, "if-modified-since"))
-					{
-						conPrint("returning 304 Not Modified...");
-						
-						const std::string response = 
-							"HTTP/1.1 304 Not Modified\r\n"
-							"Connection: Keep-Alive\r\n"
-							"\r\n";
+				{
+					if(StringUtils::equalCaseInsensitive(request.headers[i].key, "if-none-match"))
+						have_if_none_match = true;
+					else if(StringUtils::equalCaseInsensitive(request.headers[i].key, "if-modified-since"))
+						have_if_modified_since = true;
+				}
+
+				const bool not_modified = have_if_none_match ? 
+					WebResponseCache::requestMatchesConditionalHeaders(request, etag, /*last modified=*/std::string()) : 
+					have_if_modified_since;
+
+				if(not_modified)
+				{
+					const std::string response = 
+						"HTTP/1.1 304 Not Modified\r\n"
+						"ETag: " + etag + "\r\n"
+						"Connection: Keep-Alive\r\n"
+						"\r\n";
 				
-						reply_info.socket->writeData(response.c_str(), response.size());
-						return;
-					}
+					reply_info.socket->writeData(response.c_str(), response.size());
+					return;
+				}
 
 
 				const std::string content_type = web::ResponseUtils::getContentTypeForPath(local_path); // Guess content type
 
 				MemMappedFile file(local_path);
 
-				// NOTE: only handle a single range for now, because the response content types (and encoding?) get different for multiple ranges.
-				if(request.ranges.size() == 1)
+				std::vector<ByteRange> ranges;
+				const bool use_ranges = !request.ranges.empty() && (request.ranges.size() <= MAX_NUM_RANGES); // We are allowed to ignore Range headers, so just send the whole file for requests with lots of ranges.
+				if(use_ranges && !resolveByteRanges(request.ranges, file.fileSize(), ranges))
 				{
-					for(size_t i=0; i<request.ranges.size(); ++i)
-					{
-						const web::Range range = request.ranges[i];
-						if(range.start < 0 || range.start >= (int64)file.fileSize())
-							throw glare::Exception("invalid range");
-						
-						int64 range_size;
-						if(range.end_incl == -1) // if this range is just to the end:
-							range_size = (int64)file.fileSize() - range.start;
-						else
-						{
-							if(range.start > range.end_incl)
-								throw glare::Exception("invalid range");
-							range_size = range.end_incl - range.start + 1;
-						}
-
-						const int64 use_range_end = range.start + range_size;
-						if(use_range_end > (int64)file.fileSize())
-							throw glare::Exception("invalid range");
-
-						//conPrint("\thandleResourceRequest: serving data range (start: " + toString(range.start) + ", range_size: " + toString(range_size) + ")");
+					const std::string response = 
+						"HTTP/1.1 416 Range Not Satisfiable\r\n"
+						"Content-Range: bytes */" + toString(file.fileSize()) + "\r\n"
+						"Cache-Control: no-store\r\n"
+						"Connection: Keep-Alive\r\n"
+						"Content-Length: 0\r\n"
+						"\r\n";
+					reply_info.socket->writeData(response.c_str(), response.size());
+					return;
+				}
+
+				if(use_ranges && (ranges.size() == 1))
+				{
+					const ByteRange& range = ranges[0];
+					const uint64 range_size = range.end - range.start;
+
+					//conPrint("\thandleResourceRequest: serving data range (start: " + toString(range.start) + ", range_size: " + toString(range_size) + ")");
 				
-						const std::string response = 
-							"HTTP/1.1 206 Partial Content\r\n"
-							"Content-Type: " + content_type + "\r\n"
-							"Content-Range: bytes " + toString(range.start) + "-" + toString(use_range_end - 1) + "/" + toString(file.fileSize()) + "\r\n" // Note that ranges are inclusive, hence the - 1.
-							"Cache-Control: max-age=1000000000, immutable\r\n"
-							"Connection: Keep-Alive\r\n"
-							"Content-Length: " + toString(range_size) + "\r\n"
-							"\r\n";
+					const std::string response = 
+						"HTTP/1.1 206 Partial Content\r\n"
+						"Content-Type: " + content_type + "\r\n"
+						"Content-Range: bytes " + toString(range.start) + "-" + toString(range.end - 1) + "/" + toString(file.fileSize()) + "\r\n" // Note that ranges are inclusive, hence the - 1.
+						"Cache-Control: max-age=1000000000, immutable\r\n"
+						"ETag: " + etag + "\r\n"
+						"Connection: Keep-Alive\r\n"
+						"Content-Length: " + toString(range_size) + "\r\n"
+						"\r\n";
+
+					reply_info.socket->writeData(response.c_str(), response.size());
+
+					// Sanity check range.start and range.end.  Should be valid by here.
+					runtimeCheck((range.start < range.end) && (range.end <= file.fileSize()));
+
+					reply_info.socket->writeData((const uint8*)file.fileData() + range.start, range_size);
+				
+					// conPrint("\thandleResourceRequest: sent data range. (len: " + toString(range_size) + ")");
+				}
+				else if(use_ranges)
+				{
+					// Multiple ranges: send a multipart/byteranges response, see RFC 7233 section 4.1.
+					const std::string boundary = byteRangesBoundary(etag);
 
-						reply_info.socket->writeData(response.c_str(), response.size());
+					const std::string response = 
+						"HTTP/1.1 206 Partial Content\r\n"
+						"Content-Type: multipart/byteranges; boundary=" + boundary + "\r\n"
+						"Cache-Control: max-age=1000000000, immutable\r\n"
+						"ETag: " + etag + "\r\n"
+						"Connection: Keep-Alive\r\n"
+						"Content-Length: " + toString(multipartByteRangesContentLength(ranges, boundary, content_type, file.fileSize())) + "\r\n"
+						"\r\n";
 
-						// Sanity check range.start and range_size.  Should be valid by here.
-						runtimeCheck((range.start >= 0) && (range.start <= (int64)file.fileSize()) && (range.start + range_size <= (int64)file.fileSize()));
+					reply_info.socket->writeData(response.c_str(), response.size());
 
-						reply_info.socket->writeData((const uint8*)file.fileData() + range.start, range_size);
-				
-						// conPrint("\thandleResourceRequest: sent data range. (len: " + toString(range_size) + ")");
+					for(size_t i=0; i<ranges.size(); ++i)
+					{
+						runtimeCheck((ranges[i].start < ranges[i].end) && (ranges[i].end <= file.fileSize()));
+
+						const std::string part_header = byteRangePartHeader(ranges[i], boundary, content_type, file.fileSize());
+						reply_info.socket->writeData(part_header.c_str(), part_header.size());
+						reply_info.socket->writeData((const uint8*)file.fileData() + ranges[i].start, ranges[i].end - ranges[i].start);
 					}
+
+					const std::string closing_delimiter = byteRangesClosingDelimiter(boundary);
+					reply_info.socket->writeData(closing_delimiter.c_str(), closing_delimiter.size());
 				}
 				else
 				{
 					// conPrint("handleResourceRequest: serving data for '" + resource_URL + "' (len: " + toString(file.fileSize()) + " B)");
 
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheControl(reply_info, file.fileData(), file.fileSize(), content_type.c_str(), /*cache control=*/"max-age=1000000000, immutable");
+					// Serve a precompressed variant if there is one that the client accepts.  (Range requests above are always served from the uncompressed file)
+					const bool compressible = ResourceCompression::isCompressibleURL(resource_URL);
+					std::string variant_path;
+					const char* content_encoding = NULL;
+					if(compressible && request.zstd_accept_encoding && FileUtils::fileExists(ResourceCompression::zstdVariantPath(local_path)))
+					{
+						variant_path = ResourceCompression::zstdVariantPath(local_path);
+						content_encoding = "zstd";
+					}
+					else if(compressible && request.deflate_accept_encoding && FileUtils::fileExists(ResourceCompression::deflateVariantPath(local_path)))
+					{
+						variant_path = ResourceCompression::deflateVariantPath(local_path);
+						content_encoding = "deflate";
+					}
+
+					if(content_encoding)
+					{
+						MemMappedFile variant_file(variant_path);
+
+						// The ETag is for the uncompressed content, so we use a weak ETag for compressed encodings, as in writeStoreFileResponse().
+						const std::string response = 
+							"HTTP/1.1 200 OK\r\n"
+							"Content-Type: " + content_type + "\r\n"
+							"Content-Encoding: " + std::string(content_encoding) + "\r\n"
+							"Vary: Accept-Encoding\r\n"
+							"Cache-Control: max-age=1000000000, immutable\r\n"
+							"ETag: W/" + etag + "\r\n"
+							"Connection: Keep-Alive\r\n"
+							"Content-Length: " + toString(variant_file.fileSize()) + "\r\n"
+							"\r\n";
+
+						reply_info.socket->writeData(response.c_str(), response.size());
+						reply_info.socket->writeData(variant_file.fileData(), variant_file.fileSize());
+						return;
+					}
+
+					const std::string response = 
+						"HTTP/1.1 200 OK\r\n"
+						"Content-Type: " + content_type + "\r\n" + 
+						(compressible ? "Vary: Accept-Encoding\r\n" : "") + 
+						"Cache-Control: max-age=1000000000, immutable\r\n"
+						"ETag: " + etag + "\r\n"
+						"Connection: Keep-Alive\r\n"
+						"Content-Length: " + toString(file.fileSize()) + "\r\n"
+						"\r\n";
+
+					reply_info.socket->writeData(response.c_str(), response.size());
+					reply_info.socket->writeData(file.fileData(), file.fileSize());
 
 					// conPrint("\thandleResourceRequest: sent data. (len: " + toString(file.fileSize()) + ")");
 				}
@@ -192,20 +372,20 @@ void handleResourceRequest(ServerAllWorldsState& world_state, const web::Request
 			catch(glare::Exception&)
 			{
 				// conPrint("Error while handling resource request: " + e.what());
-				web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "resource not found.");
+				writeNotFoundResponse(reply_info, "resource not found.");
 				return;
 			}
 		}
 		else
-			web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "resource not found.");
+			writeNotFoundResponse(reply_info, "resource not found.");
 	}
 	catch(glare::Exception&)
 	{
-		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Error while returning resource.");
+		writeNotFoundResponse(reply_info, "Error while returning resource.");
 	}
 	catch(std::exception&)
 	{
-		web::ResponseUtils::writeHTTPNotFoundHeaderAndData(reply_info, "Error while returning resource.");
+		writeNotFoundResponse(reply_info, "Error while returning resource.");
 	}
 }
 
@@ -246,5 +426,92 @@ void listResources(ServerAllWorldsState& world_state, const web::RequestInfo& re
 }
 
 
+#if BUILD_TESTS
+
+
+static web::Range makeRange(int64 start, int64 end_incl)
+{
+	web::Range range;
+	range.start = start;
+	range.end_incl = end_incl;
+	return range;
+}
+
+
+static bool rangesEqual(const std::vector<ByteRange>& ranges, const std::vector<std::pair<uint64, uint64>>& expected)
+{
+	if(ranges.size() != expected.size())
+		return false;
+	for(size_t i=0; i<ranges.size(); ++i)
+		if(ranges[i].start != expected[i].first || ranges[i].end != expected[i].second)
+			return false;
+	return true;
+}
+
+
+void test()
+{
+	conPrint("ResourceHandlers::test()");
+
+	try
+	{
+		std::vector<ByteRange> ranges;
+
+		// Single ranges
+		testAssert(resolveByteRanges({ makeRange(0, 99) }, 1000, ranges) && rangesEqual(ranges, { { 0, 100 } }));
+		testAssert(resolveByteRanges({ makeRange(900, -1) }, 1000, ranges) && rangesEqual(ranges, { { 900, 1000 } }));
+		testAssert(resolveByteRanges({ makeRange(900, 5000) }, 1000, ranges) && rangesEqual(ranges, { { 900, 1000 } })); // Should be truncated to file size
+
+		// Unsatisfiable
+		testAssert(!resolveByteRanges({ makeRange(1000, 1100) }, 1000, ranges));
+		testAssert(resolveByteRanges({ makeRange(1000, 1100), makeRange(10, 19) }, 1000, ranges) && rangesEqual(ranges, { { 10, 20 } }));
+
+		// Multiple ranges are sorted, and overlapping and adjacent ranges are merged
+		testAssert(resolveByteRanges({ makeRange(500, 599), makeRange(0, 99) }, 1000, ranges) && rangesEqual(ranges, { { 0, 100 }, { 500, 600 } }));
+		testAssert(resolveByteRanges({ makeRange(0, 99), makeRange(50, 149), makeRange(150, 199), makeRange(300, -1) }, 1000, ranges) && rangesEqual(ranges, { { 0, 200 }, { 300, 1000 } }));
+		testAssert(resolveByteRanges({ makeRange(0, 999), makeRange(10, 19) }, 1000, ranges) && rangesEqual(ranges, { { 0, 1000 } }));
+
+		// Invalid ranges
+		{
+			bool got_exception = false;
+			try
+			{
+				resolveByteRanges({ makeRange(100, 50) }, 1000, ranges);
+			}
+			catch(glare::Exception&)
+			{
+				got_exception = true;
+			}
+			testAssert(got_exception);
+		}
+
+		// Test multipart/byteranges content length matches the body we would write
+		{
+			const std::string data = "0123456789abcdefghijklmnopqrstuvwxyz";
+			testAssert(resolveByteRanges({ makeRange(0, 3), makeRange(10, 12), makeRange(30, -1) }, data.size(), ranges));
+			testAssert(ranges.size() == 3);
+
+			const std::string boundary = byteRangesBoundary("\"abc\"");
+			std::string body;
+			for(size_t i=0; i<ranges.size(); ++i)
+				body += byteRangePartHeader(ranges[i], boundary, "text/plain", data.size()) + data.substr(ranges[i].start, ranges[i].end - ranges[i].start);
+			body += byteRangesClosingDelimiter(boundary);
+
+			testAssert(body.size() == multipartByteRangesContentLength(ranges, boundary, "text/plain", data.size()));
+			testAssert(body.find("Content-Range: bytes 10-12/36\r\n\r\nabc\r\n--" + boundary + "\r\n") != std::string::npos);
+			testAssert(::hasSuffix(body, "wxyz\r\n--" + boundary + "--\r\n"));
+		}
+	}
+	catch(glare::Exception& e)
+	{
+		failTest(e.what());
+	}
+
+	conPrint("ResourceHandlers::test() done.");
+}
+
+
+#endif // BUILD_TESTS
+
 
 } // end namespace ResourceHandlers
@@ -6,6 +6,10 @@ Copyright Glare Technologies Limited 2021 -
 #pragma once
 
 
+#include <RequestInfo.h>
+#include <Platform.h>
+#include <string>
+#include <vector>
 class ServerAllWorldsState;
 namespace web
 {
@@ -24,4 +28,23 @@ namespace ResourceHandlers
 	void handleResourceRequest(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
 
 	void listResources(ServerAllWorldsState& world_state, const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+
+
+	struct ByteRange
+	{
+		uint64 start;
+		uint64 end; // One past the last byte in the range.
+	};
+
+	// Converts the ranges from a request into byte ranges in a file of size file_size, sorted, with overlapping and adjacent ranges merged, and truncated to the file size.
+	// Returns false if none of the ranges are satisfiable.  Throws glare::Exception if a range is invalid.
+	bool resolveByteRanges(const std::vector<web::Range>& request_ranges, uint64 file_size, std::vector<ByteRange>& ranges_out);
+
+	// For multipart/byteranges responses to requests with multiple ranges.
+	std::string byteRangesBoundary(const std::string& etag);
+	std::string byteRangePartHeader(const ByteRange& range, const std::string& boundary, const std::string& content_type, uint64 file_size);
+	std::string byteRangesClosingDelimiter(const std::string& boundary);
+	uint64 multipartByteRangesContentLength(const std::vector<ByteRange>& ranges, const std::string& boundary, const std::string& content_type, uint64 file_size);
+
+	void test();
 } 
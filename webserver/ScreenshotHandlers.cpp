@@ -15,6 +15,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "WebServerResponseUtils.h"
 #include "LoginHandlers.h"
 #include "../server/ServerWorldState.h"
+#include "../server/ScreenshotVariants.h"
 #include <ConPrint.h>
 #include <Exception.h>
 #include <Lock.h>
@@ -23,6 +24,7 @@ Copyright Glare Technologies Limited 2021 -
 #include <ConPrint.h>
 #include <Parser.h>
 #include <MemMappedFile.h>
+#include <FileUtils.h>
 
 
 namespace ScreenshotHandlers
@@ -45,7 +47,7 @@ void handleScreenshotRequest(ServerAllWorldsState& world_state, WebDataStore& da
 		// Get screenshot local path
 		std::string local_path;
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			auto res = world_state.screenshots.find(screenshot_id);
 			if(res == world_state.screenshots.end())
@@ -54,6 +56,14 @@ void handleScreenshotRequest(ServerAllWorldsState& world_state, WebDataStore& da
 			local_path = res->second->local_path;
 		} // end lock scope
 
+		// If a width is given, serve the smallest thumbnail that is at least that wide, if it has been made.
+		if(request.isURLParamPresent("w"))
+		{
+			const int width = ScreenshotVariants::chooseVariantWidth(ScreenshotVariants::THUMBNAIL_WIDTHS, staticArrayNumElems(ScreenshotVariants::THUMBNAIL_WIDTHS), request.getURLIntParam("w"));
+			if((width != 0) && FileUtils::fileExists(ScreenshotVariants::variantPath(local_path, width)))
+				local_path = ScreenshotVariants::variantPath(local_path, width);
+		}
+
 
 		try
 		{
@@ -87,7 +97,7 @@ void handleMapTileRequest(ServerAllWorldsState& world_state, WebDataStore& datas
 		// Get screenshot local path
 		std::string local_path;
 		{ // lock scope
-			Lock lock(world_state.mutex);
+			ProfiledLock lock(world_state.mutex, LOCK_PROFILER_SITE());
 
 			auto res = world_state.map_tile_info.info.find(Vec3<int>(x, y, z));
 			if(res == world_state.map_tile_info.info.end())
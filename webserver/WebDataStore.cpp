@@ -15,6 +15,7 @@ Copyright Glare Technologies Limited 2022 -
 #include <utils/Lock.h>
 #include <zlib.h>
 #include <zstd.h>
+#include <xxhash.h>
 #include <Timer.h>
 
 
@@ -121,6 +122,7 @@ static Reference<WebDataStoreFile> loadAndMaybeCompressFile(const std::string& p
 		compressFile(file, path);
 	
 	file->content_type = web::ResponseUtils::getContentTypeForPath(path);
+	file->etag = "\"" + toHexString(XXH64(file->uncompressed_data.data(), file->uncompressed_data.size(), /*seed=*/1)) + "\"";
 	return file;
 }
 
@@ -22,6 +22,7 @@ public:
 	js::Vector<uint8, 16> deflate_compressed_data;
 	js::Vector<uint8, 16> zstd_compressed_data;
 	std::string content_type;
+	std::string etag; // Strong ETag computed from a hash of uncompressed_data, including quotes.
 };
 
 
@@ -0,0 +1,425 @@
+/*=====================================================================
+WebResponseCache.cpp
+--------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#include "WebResponseCache.h"
+
+
+#include "RequestInfo.h"
+#include <StringUtils.h>
+#include <ConPrint.h>
+#include <Clock.h>
+#include <Lock.h>
+#include <xxhash.h>
+#include <ctime>
+
+
+const double WebResponseCache::MAX_AGE_S = 10.0;
+
+
+WebResponseCache::WebResponseCache(size_t max_total_size_B_)
+:	total_size_B(0),
+	max_total_size_B(max_total_size_B_)
+{}
+
+
+WebResponseCache::~WebResponseCache()
+{}
+
+
+// Pages that don't depend on who is viewing them, apart from the login state shown in the header.
+static bool isCacheablePath(const std::string& path)
+{
+	return
+		path == "/" ||
+		path == "/news" ||
+		path == "/map" ||
+		path == "/terms" ||
+		path == "/faq" ||
+		path == "/about_parcel_sales" ||
+		path == "/about_scripting" ||
+		path == "/about_substrata" ||
+		path == "/running_your_own_server" ||
+		::hasPrefix(path, "/parcel/") ||
+		::hasPrefix(path, "/news_post/");
+}
+
+
+std::string WebResponseCache::getCacheKey(const web::RequestInfo& request)
+{
+	if(request.verb != "GET")
+		return std::string();
+
+	if(!isCacheablePath(request.path))
+		return std::string();
+
+	// Pages are personalised for logged-in users (e.g. 'You are logged in as ...', edit links), so only cache responses for visitors who are not logged in.
+	for(size_t i=0; i<request.cookies.size(); ++i)
+		if(request.cookies[i].key == "site-b")
+			return std::string();
+
+	std::string key = request.path;
+	for(size_t i=0; i<request.URL_params.size(); ++i)
+		key += ((i == 0) ? "?" : "&") + toString(request.URL_params[i].key) + "=" + request.URL_params[i].value.str();
+	return key;
+}
+
+
+WebResponseCacheEntryRef WebResponseCache::lookup(const std::string& key, uint64 cur_snapshot_version)
+{
+	Lock lock(mutex);
+
+	auto res = entries.find(key);
+	if(res == entries.end())
+		return NULL;
+
+	WebResponseCacheEntryRef entry = res->second.first;
+	if((entry->snapshot_version != cur_snapshot_version) || (Clock::getTimeSinceInit() - entry->creation_time > MAX_AGE_S)) // If stale:
+	{
+		removeEntry(res);
+		return NULL;
+	}
+
+	// Move to front of LRU list
+	lru_keys.splice(lru_keys.begin(), lru_keys, res->second.second);
+
+	return entry;
+}
+
+
+WebResponseCacheEntryRef WebResponseCache::makeEntry(const std::string& captured_response, uint64 snapshot_version)
+{
+	// Only cache successful responses.
+	if(!::hasPrefix(captured_response, "HTTP/1.1 200"))
+		return NULL;
+
+	const size_t status_line_end = captured_response.find("\r\n");
+	const size_t headers_end = captured_response.find("\r\n\r\n");
+	if(status_line_end == std::string::npos || headers_end == std::string::npos)
+		return NULL;
+
+	const std::string headers = ::toLowerCase(captured_response.substr(status_line_end, headers_end - status_line_end));
+	if(headers.find("\r\nset-cookie:") != std::string::npos) // Never cache responses that set cookies.
+		return NULL;
+
+	const char* body = captured_response.data() + headers_end + 4;
+	const size_t body_size = captured_response.size() - (headers_end + 4);
+
+	WebResponseCacheEntryRef entry = new WebResponseCacheEntry();
+	entry->etag = "\"" + toHexString(XXH64(body, body_size, /*seed=*/1)) + "\"";
+	entry->last_modified = formatHTTPDate(Clock::getSecsSince1970());
+	entry->snapshot_version = snapshot_version;
+	entry->creation_time = Clock::getTimeSinceInit();
+
+	// Insert our headers after the status line.
+	std::string extra_headers = "\r\nETag: " + entry->etag + "\r\nLast-Modified: " + entry->last_modified;
+	if(headers.find("\r\ncache-control:") == std::string::npos)
+		extra_headers += "\r\nCache-Control: no-cache"; // Allow caching, but clients and CDNs should revalidate with If-None-Match before using a cached response.
+
+	entry->response.reserve(captured_response.size() + extra_headers.size());
+	entry->response.append(captured_response, 0, status_line_end);
+	entry->response += extra_headers;
+	entry->response.append(captured_response, status_line_end, std::string::npos);
+	return entry;
+}
+
+
+void WebResponseCache::insert(const std::string& key, WebResponseCacheEntryRef entry)
+{
+	if(entry->response.size() > max_total_size_B / 4) // Don't let a single huge page flush the rest of the cache.
+		return;
+
+	Lock lock(mutex);
+
+	auto res = entries.find(key);
+	if(res != entries.end())
+		removeEntry(res);
+
+	lru_keys.push_front(key);
+	entries[key] = std::make_pair(entry, lru_keys.begin());
+	total_size_B += entry->response.size();
+
+	// Evict least recently used entries until we are under budget.
+	while(total_size_B > max_total_size_B && !lru_keys.empty())
+		removeEntry(entries.find(lru_keys.back()));
+}
+
+
+void WebResponseCache::removeEntry(std::map<std::string, std::pair<WebResponseCacheEntryRef, std::list<std::string>::iterator>>::iterator it)
+{
+	assert(total_size_B >= it->second.first->response.size());
+	total_size_B -= it->second.first->response.size();
+	lru_keys.erase(it->second.second);
+	entries.erase(it);
+}
+
+
+void WebResponseCache::clear()
+{
+	Lock lock(mutex);
+	entries.clear();
+	lru_keys.clear();
+	total_size_B = 0;
+}
+
+
+size_t WebResponseCache::getTotalSizeB() const
+{
+	Lock lock(mutex);
+	return total_size_B;
+}
+
+
+size_t WebResponseCache::getNumEntries() const
+{
+	Lock lock(mutex);
+	return entries.size();
+}
+
+
+static bool isWhitespace(char c)
+{
+	return c == ' ' || c == '\t';
+}
+
+
+// Does the If-None-Match header value (a comma-separated list of entity tags, or "*") contain etag?
+// Uses weak comparison, as the RFC requires for If-None-Match, so W/ prefixes are ignored.
+static bool ifNoneMatchValueMatches(const std::string& header_val, const std::string& etag)
+{
+	size_t i = 0;
+	while(i < header_val.size())
+	{
+		while(i < header_val.size() && (isWhitespace(header_val[i]) || header_val[i] == ','))
+			i++;
+
+		size_t end = header_val.find(',', i);
+		if(end == std::string::npos)
+			end = header_val.size();
+
+		std::string tag = header_val.substr(i, end - i);
+		while(!tag.empty() && isWhitespace(tag.back()))
+			tag.pop_back();
+		if(::hasPrefix(tag, "W/"))
+			tag = tag.substr(2);
+
+		if(tag == "*" || tag == etag)
+			return true;
+
+		i = end;
+	}
+	return false;
+}
+
+
+bool WebResponseCache::requestMatchesConditionalHeaders(const web::RequestInfo& request, const std::string& etag, const std::string& last_modified)
+{
+	std::string if_none_match, if_modified_since;
+	bool have_if_none_match = false;
+	for(size_t i=0; i<request.headers.size(); ++i)
+	{
+		if(StringUtils::equalCaseInsensitive(request.headers[i].key, "if-none-match"))
+		{
+			if_none_match = toString(request.headers[i].value);
+			have_if_none_match = true;
+		}
+		else if(StringUtils::equalCaseInsensitive(request.headers[i].key, "if-modified-since"))
+			if_modified_since = toString(request.headers[i].value);
+	}
+
+	// If-None-Match takes precedence over If-Modified-Since, see RFC 7232 section 3.3.
+	if(have_if_none_match)
+		return ifNoneMatchValueMatches(if_none_match, etag);
+
+	// We only compare If-Modified-Since with the Last-Modified value we sent exactly, since it is just an echo of that in practice.
+	return !if_modified_since.empty() && (if_modified_since == last_modified);
+}
+
+
+std::string WebResponseCache::makeNotModifiedResponse(const std::string& etag, const std::string& last_modified)
+{
+	return
+		"HTTP/1.1 304 Not Modified\r\n"
+		"ETag: " + etag + "\r\n"
+		"Last-Modified: " + last_modified + "\r\n"
+		"Connection: Keep-Alive\r\n"
+		"\r\n";
+}
+
+
+std::string WebResponseCache::formatHTTPDate(uint64 secs_since_1970)
+{
+	const time_t t = (time_t)secs_since_1970;
+	tm thetime;
+#ifdef _WIN32
+	gmtime_s(&thetime, &t);
+#else
+	gmtime_r(&t, &thetime);
+#endif
+
+	static const char* day_names[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char* month_names[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	return std::string(day_names[thetime.tm_wday % 7]) + ", " + leftPad(toString(thetime.tm_mday), '0', 2) + " " + month_names[thetime.tm_mon % 12] + " " + toString(thetime.tm_year + 1900) + " " +
+		leftPad(toString(thetime.tm_hour), '0', 2) + ":" + leftPad(toString(thetime.tm_min), '0', 2) + ":" + leftPad(toString(thetime.tm_sec), '0', 2) + " GMT";
+}
+
+
+#if BUILD_TESTS
+
+
+#include <utils/TestUtils.h>
+
+
+static web::Header makeHeader(const char* key, const char* value)
+{
+	web::Header header;
+	header.key = key;
+	header.value = value;
+	return header;
+}
+
+
+void WebResponseCache::test()
+{
+	conPrint("WebResponseCache::test()");
+
+	//-------------------- Test formatHTTPDate --------------------
+	testAssert(formatHTTPDate(784111777) == "Sun, 06 Nov 1994 08:49:37 GMT"); // Example from RFC 7231
+	testAssert(formatHTTPDate(0) == "Thu, 01 Jan 1970 00:00:00 GMT");
+
+	//-------------------- Test makeEntry --------------------
+	{
+		const std::string captured = "HTTP/1.1 200 OK\r\nContent-Type: text/html\r\nContent-Length: 5\r\n\r\nhello";
+		WebResponseCacheEntryRef entry = makeEntry(captured, /*snapshot version=*/1);
+		testAssert(entry.nonNull());
+		testAssert(entry->etag.size() > 2 && entry->etag[0] == '"' && entry->etag.back() == '"');
+		testAssert(::hasPrefix(entry->response, "HTTP/1.1 200 OK\r\nETag: " + entry->etag + "\r\n"));
+		testAssert(entry->response.find("Cache-Control: no-cache\r\n") != std::string::npos);
+		testAssert(::hasSuffix(entry->response, "Content-Length: 5\r\n\r\nhello"));
+
+		// Same body should give same ETag, different body a different ETag.
+		testAssert(makeEntry(captured, 2)->etag == entry->etag);
+		testAssert(makeEntry("HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhellp", 1)->etag != entry->etag);
+
+		// Existing Cache-Control headers should be left alone.
+		WebResponseCacheEntryRef entry2 = makeEntry("HTTP/1.1 200 OK\r\nCache-Control: max-age=60\r\n\r\nhello", 1);
+		testAssert(entry2->response.find("no-cache") == std::string::npos);
+
+		// Non-200 responses and responses setting cookies should not be cached.
+		testAssert(makeEntry("HTTP/1.1 404 Not Found\r\nContent-Length: 5\r\n\r\nhello", 1).isNull());
+		testAssert(makeEntry("HTTP/1.1 200 OK\r\nSet-Cookie: a=b\r\n\r\nhello", 1).isNull());
+		testAssert(makeEntry("HTTP/1.1 200 OK\r\n", 1).isNull());
+	}
+
+	//-------------------- Test lookup, staleness and LRU eviction --------------------
+	{
+		WebResponseCache cache(/*max total size=*/1000);
+
+		const std::string body(100, 'a');
+		WebResponseCacheEntryRef entry = makeEntry("HTTP/1.1 200 OK\r\n\r\n" + body, /*snapshot version=*/1);
+		const size_t entry_size = entry->response.size();
+
+		cache.insert("/", entry);
+		testAssert(cache.lookup("/", 1).ptr() == entry.ptr());
+		testAssert(cache.lookup("/news", 1).isNull());
+		testAssert(cache.getTotalSizeB() == entry_size);
+
+		// A newer snapshot version makes the entry stale, and it should be removed.
+		testAssert(cache.lookup("/", 2).isNull());
+		testAssert(cache.getNumEntries() == 0);
+		testAssert(cache.getTotalSizeB() == 0);
+
+		// Fill cache past budget.  Oldest entries should be evicted first, but a lookup should make an entry most-recently-used.
+		const int num_inserted = (int)(1000 / entry_size) + 2;
+		for(int i=0; i<num_inserted; ++i)
+		{
+			cache.insert("/parcel/" + toString(i), makeEntry("HTTP/1.1 200 OK\r\n\r\n" + body, 1));
+			if(i >= 1)
+				testAssert(cache.lookup("/parcel/0", 1).nonNull());
+		}
+		testAssert(cache.getTotalSizeB() <= 1000);
+		testAssert(cache.lookup("/parcel/0", 1).nonNull());
+		testAssert(cache.lookup("/parcel/1", 1).isNull());
+		testAssert(cache.lookup("/parcel/" + toString(num_inserted - 1), 1).nonNull());
+
+		// Re-inserting with the same key should replace the old entry.
+		const size_t num_entries = cache.getNumEntries();
+		cache.insert("/parcel/0", makeEntry("HTTP/1.1 200 OK\r\n\r\n" + body, 1));
+		testAssert(cache.getNumEntries() == num_entries);
+
+		cache.clear();
+		testAssert(cache.getNumEntries() == 0 && cache.getTotalSizeB() == 0);
+	}
+
+	//-------------------- Test conditional request header matching --------------------
+	{
+		const std::string etag = "\"abc\"";
+		const std::string last_modified = "Sun, 06 Nov 1994 08:49:37 GMT";
+		{
+			web::RequestInfo request;
+			testAssert(!requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("If-None-Match", "\"abc\""));
+			testAssert(requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("if-none-match", "\"xyz\", W/\"abc\""));
+			testAssert(requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("If-None-Match", "*"));
+			testAssert(requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("If-None-Match", "\"xyz\""));
+			request.headers.push_back(makeHeader("If-Modified-Since", "Sun, 06 Nov 1994 08:49:37 GMT")); // Should be ignored since If-None-Match is present.
+			testAssert(!requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("If-Modified-Since", "Sun, 06 Nov 1994 08:49:37 GMT"));
+			testAssert(requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+		{
+			web::RequestInfo request;
+			request.headers.push_back(makeHeader("If-Modified-Since", "Sun, 06 Nov 1994 08:49:36 GMT"));
+			testAssert(!requestMatchesConditionalHeaders(request, etag, last_modified));
+		}
+	}
+
+	//-------------------- Test getCacheKey --------------------
+	{
+		web::RequestInfo request;
+		request.verb = "GET";
+		request.path = "/news";
+		testAssert(getCacheKey(request) == "/news");
+
+		request.path = "/account";
+		testAssert(getCacheKey(request).empty());
+
+		request.path = "/parcel/123";
+		testAssert(getCacheKey(request) == "/parcel/123");
+
+		request.verb = "POST";
+		testAssert(getCacheKey(request).empty());
+		request.verb = "GET";
+
+		web::Cookie cookie;
+		cookie.key = "site-b"; // login session cookie key
+		cookie.value = "AAA";
+		request.cookies.push_back(cookie);
+		testAssert(getCacheKey(request).empty()); // Logged-in users should not get cached pages.
+	}
+
+	conPrint("WebResponseCache::test() done.");
+}
+
+
+#endif // BUILD_TESTS
@@ -0,0 +1,92 @@
+/*=====================================================================
+WebResponseCache.h
+------------------
+Copyright Glare Technologies Limited 2024 -
+=====================================================================*/
+#pragma once
+
+
+#include <ThreadSafeRefCounted.h>
+#include <Reference.h>
+#include <Mutex.h>
+#include <Platform.h>
+#include <string>
+#include <map>
+#include <list>
+namespace web
+{
+class RequestInfo;
+}
+
+
+class WebResponseCacheEntry : public ThreadSafeRefCounted
+{
+public:
+	std::string response; // Complete HTTP response (status line, headers and body), with ETag and Last-Modified headers.
+	std::string etag; // Strong ETag, including quotes.
+	std::string last_modified; // HTTP-date the response was generated.
+	uint64 snapshot_version; // Version of the WebDataSnapshot that was current when the response was generated.
+	double creation_time; // From Clock::getTimeSinceInit()
+};
+typedef Reference<WebResponseCacheEntry> WebResponseCacheEntryRef;
+
+
+/*=====================================================================
+WebResponseCache
+----------------
+Bounded in-memory cache of complete HTTP responses, for GET requests of pages that
+are rendered the same for every visitor who is not logged in, such as the root page, news, map and parcel pages.
+
+Entries are keyed by path and URL parameters.  An entry is stale once a newer WebDataSnapshot has been
+published (so any change to parcels, auctions, users or news invalidates all entries), or after MAX_AGE_S.
+The least recently used entries are evicted when the total response size goes over max_total_size_B.
+
+Responses have a strong ETag (a hash of the body) and a Last-Modified header, and conditional requests
+with a matching If-None-Match or If-Modified-Since get a 304 Not Modified response.
+=====================================================================*/
+class WebResponseCache : public ThreadSafeRefCounted
+{
+public:
+	WebResponseCache(size_t max_total_size_B);
+	~WebResponseCache();
+
+	static const double MAX_AGE_S;
+
+	// Returns the cache key to use for the request, or the empty string if the response to the request should not be cached.
+	static std::string getCacheKey(const web::RequestInfo& request);
+
+	// Returns NULL if there is no entry for the key, or the entry is stale.  Threadsafe.
+	WebResponseCacheEntryRef lookup(const std::string& key, uint64 cur_snapshot_version);
+
+	// Makes a cache entry from a response captured from a page handler.  Returns NULL if the response can't be cached (e.g. is not a 200 OK response).
+	static WebResponseCacheEntryRef makeEntry(const std::string& captured_response, uint64 snapshot_version);
+
+	void insert(const std::string& key, WebResponseCacheEntryRef entry); // Threadsafe
+
+	void clear(); // Threadsafe
+
+	size_t getTotalSizeB() const; // Threadsafe
+	size_t getNumEntries() const; // Threadsafe
+
+	// Does the request have an If-None-Match header that matches etag, or (if there is no If-None-Match header) an If-Modified-Since header
+	// exactly matching last_modified?
+	static bool requestMatchesConditionalHeaders(const web::RequestInfo& request, const std::string& etag, const std::string& last_modified);
+
+	static std::string makeNotModifiedResponse(const std::string& etag, const std::string& last_modified);
+
+	// Formats a time (seconds since 1970) as an HTTP-date, e.g. "Sun, 06 Nov 1994 08:49:37 GMT".
+	static std::string formatHTTPDate(uint64 secs_since_1970);
+
+	static void test();
+
+private:
+	GLARE_DISABLE_COPY(WebResponseCache);
+
+	void removeEntry(std::map<std::string, std::pair<WebResponseCacheEntryRef, std::list<std::string>::iterator>>::iterator it) REQUIRES(mutex);
+
+	mutable Mutex mutex;
+	std::map<std::string, std::pair<WebResponseCacheEntryRef, std::list<std::string>::iterator>> entries GUARDED_BY(mutex); // Map from key to (entry, position in LRU list)
+	std::list<std::string> lru_keys GUARDED_BY(mutex); // Most recently used at front.
+	size_t total_size_B GUARDED_BY(mutex);
+	size_t max_total_size_B;
+};
@@ -7,6 +7,7 @@ Copyright Glare Technologies Limited 2021 -
 
 
 #include "WebDataStore.h"
+#include "WebResponseCache.h"
 #include "AdminHandlers.h"
 #include "MainPageHandlers.h"
 #include "NewsPostHandlers.h"
@@ -17,6 +18,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "ResponseUtils.h"
 #include "RequestHandler.h"
 #include "ResourceHandlers.h"
+#include "MetricsHandlers.h"
 #if USE_GLARE_PARCEL_AUCTION_CODE
 #include <webserver/PayPalHandlers.h>
 #include <webserver/CoinbaseHandlers.h>
@@ -34,11 +36,15 @@ Copyright Glare Technologies Limited 2021 -
 #include <FileUtils.h>
 #include <Exception.h>
 #include <Lock.h>
+#include <Timer.h>
+#include <Clock.h>
 #include <WebSocket.h>
+#include <BufferOutStream.h>
 
 
 WebServerRequestHandler::WebServerRequestHandler()
-:	dev_mode(false)
+:	response_cache(NULL),
+	dev_mode(false)
 {}
 
 
@@ -64,8 +70,97 @@ WebServerRequestHandler::~WebServerRequestHandler()
 }*/
 
 
+// Writes a response for a file from the web data store, compressed if the client accepts a compressed encoding we have.
+// Sends a 304 Not Modified response instead if the client has a cached copy with the same ETag.
+static void writeStoreFileResponse(const web::RequestInfo& request, web::ReplyInfo& reply_info, const WebDataStoreFile& store_file, const std::string& cache_control_val)
+{
+	if(WebResponseCache::requestMatchesConditionalHeaders(request, store_file.etag, /*last modified=*/std::string()))
+	{
+		const std::string response = 
+			"HTTP/1.1 304 Not Modified\r\n"
+			"ETag: " + store_file.etag + "\r\n"
+			"Cache-Control: " + cache_control_val + "\r\n"
+			"Connection: Keep-Alive\r\n"
+			"\r\n";
+		reply_info.socket->writeData(response.c_str(), response.size());
+		return;
+	}
+
+	const js::Vector<uint8, 16>* data = &store_file.uncompressed_data;
+	const char* content_encoding = NULL;
+	if(request.zstd_accept_encoding && !store_file.zstd_compressed_data.empty())
+	{
+		data = &store_file.zstd_compressed_data;
+		content_encoding = "zstd";
+	}
+	else if(request.deflate_accept_encoding && !store_file.deflate_compressed_data.empty())
+	{
+		data = &store_file.deflate_compressed_data;
+		content_encoding = "deflate";
+	}
+
+	// The ETag is for the uncompressed content, so we use a weak ETag for compressed encodings, as the RFC requires.
+	const std::string etag = content_encoding ? ("W/" + store_file.etag) : store_file.etag;
+
+	const std::string response = 
+		"HTTP/1.1 200 OK\r\n"
+		"Content-Type: " + store_file.content_type + "\r\n" + 
+		(content_encoding ? ("Content-Encoding: " + std::string(content_encoding) + "\r\n") : std::string()) + 
+		"Vary: Accept-Encoding\r\n"
+		"Cache-Control: " + cache_control_val + "\r\n"
+		"ETag: " + etag + "\r\n"
+		"Connection: Keep-Alive\r\n"
+		"Content-Length: " + toString(data->size()) + "\r\n"
+		"\r\n";
+
+	reply_info.socket->writeData(response.c_str(), response.size());
+	reply_info.socket->writeData(data->data(), data->size());
+}
+
+
+// Records the time taken to handle a request (when it goes out of scope) into the latency histogram for the request handler.
+class WebHandlerLatencyRecorder
+{
+public:
+	WebHandlerLatencyRecorder(MetricHistogram* histogram_) : histogram(histogram_) {}
+	~WebHandlerLatencyRecorder() { if(histogram) histogram->recordDuration(timer.elapsed()); }
+
+	MetricHistogram* histogram;
+	Timer timer;
+};
+
+
+static bool isAuthRequest(const web::RequestInfo& request)
+{
+	return (request.verb == "POST") && (request.path == "/login_post" || request.path == "/signup_post" || request.path == "/reset_password_post" || 
+		request.path == "/change_password_post" || request.path == "/set_new_password_post");
+}
+
+
+// Checks the request against the per-IP web rate limiters.  Resource and web client file requests aren't limited, as the web client
+// makes lots of them when loading a world.  Login, signup and password requests, which do expensive password hashing, have a separate, stricter limit.
+bool WebServerRequestHandler::isRateLimited(const web::RequestInfo& request)
+{
+	if(::hasPrefix(request.path, "/resource/") || ::hasPrefix(request.path, "/webclient") || request.path == "/gui_client.data")
+		return false;
+
+	const std::string ip = request.client_ip_address.toString();
+	const double cur_time = Clock::getTimeSinceInit();
+
+	if(!server->rate_limiters.web_requests.tryConsume(ip, cur_time))
+		return true;
+
+	if(isAuthRequest(request) && !server->rate_limiters.web_auth_requests.tryConsume(ip, cur_time))
+		return true;
+
+	return false;
+}
+
+
 void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web::ReplyInfo& reply_info)
 {
+	WebHandlerLatencyRecorder latency_recorder(server ? server->metrics.getWebHandlerLatencyHistogram(request.verb, request.path) : NULL);
+
 	if(!request.tls_connection)
 	{
 		// Redirect to https (unless the server is running on localhost, which we will allow to use non-https for testing)
@@ -87,7 +182,83 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		}
 	}
 
+	if(server && isRateLimited(request))
+	{
+		const std::string response = 
+			"HTTP/1.1 429 Too Many Requests\r\n"
+			"Retry-After: 10\r\n"
+			"Content-Type: text/plain\r\n"
+			"Content-Length: 18\r\n"
+			"\r\n"
+			"Too many requests.";
+		reply_info.socket->writeData(response.c_str(), response.size());
+		return;
+	}
+
+	if(response_cache)
+	{
+		const std::string cache_key = WebResponseCache::getCacheKey(request);
+		if(!cache_key.empty())
+		{
+			handleCacheableRequest(request, reply_info, cache_key);
+			return;
+		}
+	}
+
+	routeRequest(request, reply_info);
+}
+
+
+// Serves the response from the response cache if there is a fresh entry for it, otherwise renders the page and adds it to the cache.
+// Sends a 304 Not Modified response instead if the client already has the current version of the page.
+void WebServerRequestHandler::handleCacheableRequest(const web::RequestInfo& request, web::ReplyInfo& reply_info, const std::string& cache_key)
+{
+	const uint64 snapshot_version = world_state->getWebDataSnapshot()->version;
+
+	WebResponseCacheEntryRef entry = response_cache->lookup(cache_key, snapshot_version);
+	if(entry.nonNull())
+	{
+		if(server)
+			server->metrics.web_response_cache_hits.increment();
+	}
+	else
+	{
+		if(server)
+			server->metrics.web_response_cache_misses.increment();
+
+		// Render the page into a buffer, so we can cache it.
+		BufferOutStream capture_stream;
+		web::ReplyInfo capture_reply_info = reply_info;
+		capture_reply_info.socket = &capture_stream;
+
+		routeRequest(request, capture_reply_info);
+
+		const std::string captured_response((const char*)capture_stream.buf.data(), capture_stream.buf.size());
+		entry = WebResponseCache::makeEntry(captured_response, snapshot_version);
+		if(entry.isNull()) // If the response can't be cached (e.g. was an error page), just send it as is.
+		{
+			reply_info.socket->writeData(captured_response.data(), captured_response.size());
+			return;
+		}
+
+		response_cache->insert(cache_key, entry);
+	}
+
+	if(WebResponseCache::requestMatchesConditionalHeaders(request, entry->etag, entry->last_modified))
+	{
+		if(server)
+			server->metrics.web_not_modified_responses.increment();
+
+		const std::string response = WebResponseCache::makeNotModifiedResponse(entry->etag, entry->last_modified);
+		reply_info.socket->writeData(response.data(), response.size());
+	}
+	else
+		reply_info.socket->writeData(entry->response.data(), entry->response.size());
+}
+
 
+void WebServerRequestHandler::routeRequest(const web::RequestInfo& request, web::ReplyInfo& reply_info)
+{
 	if(request.verb == "POST")
 	{
 		// Route PUT request
@@ -201,6 +372,10 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		{
 			AdminHandlers::handleSetReadOnlyModePost(*this->world_state, request, reply_info);
 		}
+		else if(request.path == "/admin_set_lock_profiling_enabled_post")
+		{
+			AdminHandlers::handleSetLockProfilingEnabledPost(*this->world_state, request, reply_info);
+		}
 		else if(request.path == "/admin_force_dyn_tex_update_post")
 		{
 			AdminHandlers::handleForceDynTexUpdatePost(*this->world_state, request, reply_info);
@@ -314,6 +489,10 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		{
 			MainPageHandlers::renderMapPage(*this->world_state, request, reply_info);
 		}
+		else if(request.path == "/metrics" && server)
+		{
+			MetricsHandlers::handleMetricsRequest(*this->server, *this->world_state, request, reply_info);
+		}
 #if USE_GLARE_PARCEL_AUCTION_CODE
 		else if(request.path == "/pdt_landing")
 		{
@@ -404,6 +583,14 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 		{
 			AdminHandlers::renderMapPage(*this->world_state, request, reply_info);
 		}
+		else if(request.path == "/admin_lock_profile")
+		{
+			AdminHandlers::renderLockProfilePage(*this->world_state, request, reply_info);
+		}
+		else if(request.path == "/admin_rate_limits" && server)
+		{
+			AdminHandlers::renderRateLimitsPage(*this->server, *this->world_state, request, reply_info);
+		}
 		else if(::hasPrefix(request.path, "/admin_create_parcel_auction/")) // parcel ID follows in URL
 		{
 			AdminHandlers::renderCreateParcelAuction(*this->world_state, request, reply_info);
@@ -512,22 +699,8 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 
 			if(store_file.nonNull())
 			{
-				const std::string& content_type = store_file->content_type;
 				const int max_age_s = 3600*24*14;
-				if(request.zstd_accept_encoding && !store_file->zstd_compressed_data.empty())
-				{
-					web::ResponseUtils::writeHTTPOKHeaderWithCacheMaxAgeAndContentEncoding(reply_info, store_file->zstd_compressed_data.data(), store_file->zstd_compressed_data.size(), 
-						content_type, "zstd", max_age_s);
-				}
-				else if(request.deflate_accept_encoding && !store_file->deflate_compressed_data.empty())
-				{
-					web::ResponseUtils::writeHTTPOKHeaderWithCacheMaxAgeAndContentEncoding(reply_info, store_file->deflate_compressed_data.data(), store_file->deflate_compressed_data.size(), 
-						content_type, "deflate", max_age_s);
-				}
-				else
-				{
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheMaxAge(reply_info, store_file->uncompressed_data.data(), store_file->uncompressed_data.size(), content_type, max_age_s);
-				}
+				writeStoreFileResponse(request, reply_info, *store_file, "max-age=" + toString(max_age_s));
 			}
 			else
 			{
@@ -619,23 +792,11 @@ void WebServerRequestHandler::handleRequest(const web::RequestInfo& request, web
 
 			if(store_file.nonNull())
 			{
-				const std::string& content_type = store_file->content_type;
-
 				// We are using cache-busting hashes in webclient.html, so can set a very long max age and use 'immutable' when caching.
-				const char* cache_control_val = cache ? "max-age=1000000000, immutable" : "max-age=0"; 
+				// webclient.html itself is not cached without revalidating, but can be revalidated with its ETag.
+				const char* cache_control_val = cache ? "max-age=1000000000, immutable" : "no-cache"; 
 				
-				if(request.zstd_accept_encoding && !store_file->zstd_compressed_data.empty())
-				{
-					web::ResponseUtils::writeHTTPOKHeaderWithCacheControlAndContentEncoding(reply_info, store_file->zstd_compressed_data.data(), store_file->zstd_compressed_data.size(), content_type, cache_control_val, "zstd");
-				}
-				else if(request.deflate_accept_encoding && !store_file->deflate_compressed_data.empty())
-				{
-					web::ResponseUtils::writeHTTPOKHeaderWithCacheControlAndContentEncoding(reply_info, store_file->deflate_compressed_data.data(), store_file->deflate_compressed_data.size(), content_type, cache_control_val, "deflate");
-				}
-				else
-				{
-					web::ResponseUtils::writeHTTPOKHeaderAndDataWithCacheControl(reply_info, store_file->uncompressed_data.data(), store_file->uncompressed_data.size(), content_type, cache_control_val);
-				}
+				writeStoreFileResponse(request, reply_info, *store_file, cache_control_val);
 			}
 			else
 			{
@@ -10,6 +10,7 @@ Copyright Glare Technologies Limited 2021 -
 #include "../shared/UID.h"
 #include "../server/User.h"
 class WebDataStore;
+class WebResponseCache;
 class ServerAllWorldsState;
 class ServerWorldState;
 class Server;
@@ -28,15 +29,19 @@ public:
 	WebDataStore* data_store;
 	Server* server;
 	ServerAllWorldsState* world_state;
+	WebResponseCache* response_cache; // May be NULL, in which case responses are not cached.
 	bool dev_mode;
 private:
+	bool isRateLimited(const web::RequestInfo& request_info);
+	void routeRequest(const web::RequestInfo& request_info, web::ReplyInfo& reply_info);
+	void handleCacheableRequest(const web::RequestInfo& request_info, web::ReplyInfo& reply_info, const std::string& cache_key);
 };
 
 
 class WebServerSharedRequestHandler : public web::SharedRequestHandler
 {
 public:
-	WebServerSharedRequestHandler() : dev_mode(false) {}
+	WebServerSharedRequestHandler() : response_cache(NULL), dev_mode(false) {}
 	virtual ~WebServerSharedRequestHandler(){}
 
 	virtual Reference<web::RequestHandler> getOrMakeRequestHandler() // Factory method for request handler.
@@ -45,6 +50,7 @@ public:
 		h->data_store = data_store;
 		h->server = server;
 		h->world_state = world_state;
+		h->response_cache = response_cache;
 		h->dev_mode = dev_mode;
 		return h;
 	}
@@ -52,6 +58,7 @@ public:
 	WebDataStore* data_store;
 	Server* server;
 	ServerAllWorldsState* world_state;
+	WebResponseCache* response_cache;
 	bool dev_mode;
 private:
 };
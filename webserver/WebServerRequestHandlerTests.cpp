@@ -216,7 +216,7 @@ extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
 
 		WebServerRequestHandler handler;
 		handler.data_store = test_web_data_store.getPointer();
-		handler.server = NULL; // NOTE: only used for websocket connections
+		handler.server = NULL; // NOTE: only used for websocket connections and metrics
 		handler.world_state = test_world_state.getPointer();
 
 		// handler.handleRequest(request_info, reply_info);
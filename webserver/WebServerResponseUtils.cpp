@@ -139,21 +139,19 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 
 	const TimeStamp now = TimeStamp::currentTime();
 
-	{ // lock scope
-		Lock lock(world_state.mutex);
-
-		ServerWorldState* root_world = world_state.getRootWorldState().ptr();
-
+	{
+		// Use the web data snapshot, so we don't need to hold the world state mutex while iterating over all parcels.
+		WebDataSnapshotRef snapshot = world_state.getWebDataSnapshot();
 
 		poly_verts.reserve(44 * 4);
 		poly_parcel_ids.reserve(44);
 		poly_parcel_state.reserve(44);
 
-		rect_bounds.reserve(root_world->parcels.size());
-		rect_parcel_ids.reserve(root_world->parcels.size());
-		rect_parcel_state.reserve(root_world->parcels.size());
+		rect_bounds.reserve(snapshot->root_world_parcels.size());
+		rect_parcel_ids.reserve(snapshot->root_world_parcels.size());
+		rect_parcel_state.reserve(snapshot->root_world_parcels.size());
 
-		for(auto it = root_world->parcels.begin(); it != root_world->parcels.end(); ++it)
+		for(auto it = snapshot->root_world_parcels.begin(); it != snapshot->root_world_parcels.end(); ++it)
 		{
 			const Parcel* parcel = it->second.ptr();
 
@@ -166,13 +164,9 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 				if(!parcel->parcel_auction_ids.empty())
 				{
 					const uint32 auction_id = parcel->parcel_auction_ids.back();
-					auto auction_res = world_state.parcel_auctions.find(auction_id);
-					if(auction_res != world_state.parcel_auctions.end())
-					{
-						const ParcelAuction* auction = auction_res->second.ptr();
-						if(auction->currentlyForSale(now)) // If auction is valid and running:
-							state = 1;
-					}
+					const ParcelAuction* auction = snapshot->findParcelAuction(auction_id);
+					if(auction && auction->currentlyForSale(now)) // If auction is valid and running:
+						state = 1;
 				}
 			}
 			else
@@ -193,7 +187,7 @@ const std::string getMapEmbedCode(ServerAllWorldsState& world_state, ParcelID hi
 				poly_parcel_state.push_back(state);
 			}
 		}
-	} // End lock scope
+	}
 
 	const double scale = 1.0 / 20; // Not totally sure where this scale comes from, but somehow from const float TILE_WIDTH_M = 5120.f / (1 << tile_z);
 	std::string var_js;